@@ -30,6 +30,19 @@ constexpr unsigned long long confirmedTxLength = confirmedTxCurrentEpochLength +
 static ConfirmedTx *confirmedTx = NULL;
 static volatile char confirmedTxLock = 0;
 
+// Hash index from tx digest to position in confirmedTx (open addressing with linear probing, load factor <= 0.75).
+// Entries are confirmedTx index + 1, 0 marks an empty slot. Protected by confirmedTxLock.
+static constexpr unsigned long long getConfirmedTxDigestIndexLength(unsigned long long minLength)
+{
+    unsigned long long length = 1;
+    while (length < minLength)
+        length <<= 1;
+    return length;
+}
+constexpr unsigned long long confirmedTxDigestIndexLength = getConfirmedTxDigestIndexLength(confirmedTxLength + confirmedTxLength / 3 + 1);
+static_assert(confirmedTxLength < 0xffffffff && confirmedTxDigestIndexLength <= 0x100000000ULL, "confirmedTxDigestIndex entries need to fit into 32 bits");
+static unsigned int* confirmedTxDigestIndex = NULL;
+
 static struct
 {
     unsigned int tickTxCounter[MAX_NUMBER_OF_TICKS_PER_EPOCH + TICKS_TO_KEEP_FROM_PRIOR_EPOCH];    // store the amount of tx per tick
@@ -48,6 +61,32 @@ struct RequestTxStatus
 
 static_assert(sizeof(RequestTxStatus) == 4, "unexpected size");
 
+#define REQUEST_TX_STATUS_BY_DIGEST 203
+
+struct RequestTxStatusByDigest
+{
+    m256i digest;
+};
+
+static_assert(sizeof(RequestTxStatusByDigest) == 32, "unexpected size");
+
+#define RESPOND_TX_STATUS_BY_DIGEST 204
+
+#define TX_STATUS_UNKNOWN 0   // tx is not (yet) confirmed or not available on this node
+#define TX_STATUS_CONFIRMED 1 // tx has been executed in tick
+
+struct RespondTxStatusByDigest
+{
+    unsigned int currentTickOfNode;
+    unsigned int tick;
+    unsigned char status;
+    unsigned char moneyFlew;
+    unsigned char _padding[6];
+    m256i digest;
+};
+
+static_assert(sizeof(RespondTxStatusByDigest) == 48, "unexpected size");
+
 #define RESPOND_TX_STATUS 202
 
 #pragma pack(push, 1)
@@ -79,6 +118,9 @@ static bool initTxStatusRequestAddOn()
     // allocate tickTxStatus responses storage
     if (!allocatePool(MAX_NUMBER_OF_PROCESSORS * sizeof(RespondTxStatus), (void**)&tickTxStatusStorage))
         return false;
+    // allocate digest index of confirmed TX's
+    if (!allocatePool(confirmedTxDigestIndexLength * sizeof(confirmedTxDigestIndex[0]), (void**)&confirmedTxDigestIndex))
+        return false;
     txStatusData.confirmedTxPreviousEpochBeginTick = 0;
     txStatusData.confirmedTxCurrentEpochBeginTick = 0;
     return true;
@@ -90,6 +132,62 @@ static void deinitTxStatusRequestAddOn()
 {
     if (confirmedTx)
         freePool(confirmedTx);
+    if (confirmedTxDigestIndex)
+        freePool(confirmedTxDigestIndex);
+}
+
+
+// Add confirmedTx[confirmedTxIndex] to digest index (caller needs to hold confirmedTxLock)
+static void insertConfirmedTxDigestIndex(unsigned int confirmedTxIndex)
+{
+    ASSERT(confirmedTxIndex < confirmedTxLength);
+    unsigned long long slot = confirmedTx[confirmedTxIndex].digest.m256i_u32[0] & (confirmedTxDigestIndexLength - 1);
+    while (confirmedTxDigestIndex[slot])
+        slot = (slot + 1) & (confirmedTxDigestIndexLength - 1);
+    confirmedTxDigestIndex[slot] = confirmedTxIndex + 1;
+}
+
+
+// Return confirmed tx with given digest or NULL if not found (caller needs to hold confirmedTxLock)
+static const ConfirmedTx* findConfirmedTx(const m256i& digest)
+{
+    unsigned long long slot = digest.m256i_u32[0] & (confirmedTxDigestIndexLength - 1);
+    while (confirmedTxDigestIndex[slot])
+    {
+        // compare digest, because index may contain stale entries of previous epoch after loading a snapshot
+        const ConfirmedTx& localConfirmedTx = confirmedTx[confirmedTxDigestIndex[slot] - 1];
+        if (localConfirmedTx.digest == digest && localConfirmedTx.tick)
+            return &localConfirmedTx;
+        slot = (slot + 1) & (confirmedTxDigestIndexLength - 1);
+    }
+    return NULL;
+}
+
+
+// Rebuild digest index from the first currentEpochTxCount entries of current epoch and the stored ticks of previous epoch
+static void rebuildConfirmedTxDigestIndex(unsigned int currentEpochTxCount)
+{
+    ACQUIRE(confirmedTxLock);
+
+    setMem(confirmedTxDigestIndex, confirmedTxDigestIndexLength * sizeof(confirmedTxDigestIndex[0]), 0);
+
+    if (currentEpochTxCount > confirmedTxCurrentEpochLength)
+        currentEpochTxCount = confirmedTxCurrentEpochLength;
+    for (unsigned int i = 0; i < currentEpochTxCount; ++i)
+        insertConfirmedTxDigestIndex(i);
+
+    if (txStatusData.confirmedTxPreviousEpochBeginTick)
+    {
+        const unsigned int tickCount = txStatusData.confirmedTxCurrentEpochBeginTick - txStatusData.confirmedTxPreviousEpochBeginTick;
+        unsigned int previousEpochTxCount = 0;
+        for (unsigned int tickOffset = 0; tickOffset < tickCount && tickOffset < TICKS_TO_KEEP_FROM_PRIOR_EPOCH; ++tickOffset)
+            previousEpochTxCount += txStatusData.tickTxCounter[MAX_NUMBER_OF_TICKS_PER_EPOCH + tickOffset];
+        ASSERT(previousEpochTxCount <= confirmedTxPreviousEpochLength);
+        for (unsigned int i = 0; i < previousEpochTxCount; ++i)
+            insertConfirmedTxDigestIndex(confirmedTxCurrentEpochLength + i);
+    }
+
+    RELEASE(confirmedTxLock);
 }
 
 
@@ -156,6 +254,9 @@ static void beginEpochTxStatusRequestAddOn(unsigned int newInitialTick)
     }
 
     tickBegin = newInitialTick;
+
+    // digest index only contains the kept ticks of previous epoch now
+    rebuildConfirmedTxDigestIndex(0);
 }
 
 
@@ -180,6 +281,7 @@ static bool saveConfirmedTx(unsigned int txNumberMinusOne, bool moneyFlew, unsig
     txConfirmation.tick = tick;
     txConfirmation.moneyFlew = moneyFlew;
     txConfirmation.digest = digest;
+    insertConfirmedTxDigestIndex(txNumberMinusOne);
 
     // get current tick number in epoch
     int tickIndex = tick - system.initialTick;
@@ -248,6 +350,33 @@ static void processRequestConfirmedTx(long long processorNumber, Peer *peer, Req
     enqueueResponse(peer, tickTxStatus.size(), RESPOND_TX_STATUS, header->dejavu(), &tickTxStatus);
 }
 
+
+static void processRequestConfirmedTxByDigest(Peer* peer, RequestResponseHeader* header)
+{
+    if (header->size() != sizeof(RequestResponseHeader) + sizeof(RequestTxStatusByDigest))
+        return;
+
+    RequestTxStatusByDigest* request = header->getPayload<RequestTxStatusByDigest>();
+
+    RespondTxStatusByDigest response;
+    setMem(&response, sizeof(response), 0);
+    response.digest = request->digest;
+
+    ACQUIRE(confirmedTxLock);
+    response.currentTickOfNode = system.tick;
+    const ConfirmedTx* localConfirmedTx = findConfirmedTx(request->digest);
+    if (localConfirmedTx)
+    {
+        response.tick = localConfirmedTx->tick;
+        response.status = TX_STATUS_CONFIRMED;
+        response.moneyFlew = localConfirmedTx->moneyFlew;
+    }
+    RELEASE(confirmedTxLock);
+
+    // always respond, so the requester can tell from currentTickOfNode whether the tx failed or the node is lagging behind
+    enqueueResponse(peer, sizeof(response), RESPOND_TX_STATUS_BY_DIGEST, header->dejavu(), &response);
+}
+
 #if TICK_STORAGE_AUTOSAVE_MODE
 // can only be called from main thread
 static bool saveStateTxStatus(const unsigned int numberOfTransactions, CHAR16* directory)
@@ -267,6 +396,14 @@ static bool saveStateTxStatus(const unsigned int numberOfTransactions, CHAR16* d
         logToConsole(L"Failed to save ConfirmedTx");
         return false;
     }
+
+    static unsigned short CONFIRMED_TX_DIGEST_INDEX_SNAPSHOT_FILE_NAME[] = L"snapshotConfirmedTxDigestIndex";
+    savedSize = saveLargeFile(CONFIRMED_TX_DIGEST_INDEX_SNAPSHOT_FILE_NAME, confirmedTxDigestIndexLength * sizeof(confirmedTxDigestIndex[0]), (unsigned char*)confirmedTxDigestIndex, directory);
+    if (savedSize != confirmedTxDigestIndexLength * sizeof(confirmedTxDigestIndex[0]))
+    {
+        logToConsole(L"Failed to save ConfirmedTxDigestIndex");
+        return false;
+    }
     return true;
 }
 
@@ -292,6 +429,15 @@ static bool loadStateTxStatus(const unsigned int numberOfTransactions, CHAR16* d
             return false;
         }
     }
+
+    static unsigned short CONFIRMED_TX_DIGEST_INDEX_SNAPSHOT_FILE_NAME[] = L"snapshotConfirmedTxDigestIndex";
+    loadedSize = loadLargeFile(CONFIRMED_TX_DIGEST_INDEX_SNAPSHOT_FILE_NAME, confirmedTxDigestIndexLength * sizeof(confirmedTxDigestIndex[0]), (unsigned char*)confirmedTxDigestIndex, directory);
+    if (loadedSize != confirmedTxDigestIndexLength * sizeof(confirmedTxDigestIndex[0]))
+    {
+        // snapshot without index (or index of different size), rebuild it from confirmedTx
+        logToConsole(L"Failed to load ConfirmedTxDigestIndex, rebuilding it");
+        rebuildConfirmedTxDigestIndex(numberOfTransactions);
+    }
     return true;
 }
 #endif // TICK_STORAGE_AUTOSAVE_MODE
@@ -13,6 +13,8 @@
 #include "kangaroo_twelve.h"
 #include "four_q.h"
 #include "common_buffers.h"
+#include "state_snapshot.h"
+#include "compressed_file_io.h"
 
 
 
@@ -65,6 +67,7 @@ static long long issueAsset(const m256i& issuerPublicKey, char name[7], char num
 iteration:
     if (assets[*issuanceIndex].varStruct.issuance.type == EMPTY)
     {
+        StateSnapshot::beforeWrite(&assets[*issuanceIndex], sizeof(Asset));
         assets[*issuanceIndex].varStruct.issuance.publicKey = issuerPublicKey;
         assets[*issuanceIndex].varStruct.issuance.type = ISSUANCE;
         copyMem(assets[*issuanceIndex].varStruct.issuance.name, name, sizeof(assets[*issuanceIndex].varStruct.issuance.name));
@@ -75,6 +78,7 @@ iteration:
     iteration2:
         if (assets[*ownershipIndex].varStruct.ownership.type == EMPTY)
         {
+            StateSnapshot::beforeWrite(&assets[*ownershipIndex], sizeof(Asset));
             assets[*ownershipIndex].varStruct.ownership.publicKey = issuerPublicKey;
             assets[*ownershipIndex].varStruct.ownership.type = OWNERSHIP;
             assets[*ownershipIndex].varStruct.ownership.managingContractIndex = managingContractIndex;
@@ -85,6 +89,7 @@ iteration:
         iteration3:
             if (assets[*possessionIndex].varStruct.possession.type == EMPTY)
             {
+                StateSnapshot::beforeWrite(&assets[*possessionIndex], sizeof(Asset));
                 assets[*possessionIndex].varStruct.possession.publicKey = issuerPublicKey;
                 assets[*possessionIndex].varStruct.possession.type = POSSESSION;
                 assets[*possessionIndex].varStruct.possession.managingContractIndex = managingContractIndex;
@@ -171,6 +176,8 @@ iteration:
             && assets[*destinationOwnershipIndex].varStruct.ownership.issuanceIndex == assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex
             && assets[*destinationOwnershipIndex].varStruct.ownership.publicKey == destinationPublicKey))
     {
+        StateSnapshot::beforeWrite(&assets[sourceOwnershipIndex], sizeof(Asset));
+        StateSnapshot::beforeWrite(&assets[*destinationOwnershipIndex], sizeof(Asset));
         assets[sourceOwnershipIndex].varStruct.ownership.numberOfShares -= numberOfShares;
 
         if (assets[*destinationOwnershipIndex].varStruct.ownership.type == EMPTY)
@@ -190,6 +197,8 @@ iteration:
                 && assets[*destinationPossessionIndex].varStruct.possession.ownershipIndex == *destinationOwnershipIndex
                 && assets[*destinationPossessionIndex].varStruct.possession.publicKey == destinationPublicKey))
         {
+            StateSnapshot::beforeWrite(&assets[sourcePossessionIndex], sizeof(Asset));
+            StateSnapshot::beforeWrite(&assets[*destinationPossessionIndex], sizeof(Asset));
             assets[sourcePossessionIndex].varStruct.possession.numberOfShares -= numberOfShares;
 
             if (assets[*destinationPossessionIndex].varStruct.possession.type == EMPTY)
@@ -256,6 +265,7 @@ static void getUniverseDigest(m256i& digest)
     {
         if (assetChangeFlags[digestIndex >> 6] & (1ULL << (digestIndex & 63)))
         {
+            StateSnapshot::beforeWrite(&assetDigests[digestIndex], 32);
             KangarooTwelve(&assets[digestIndex], sizeof(Asset), &assetDigests[digestIndex], 32);
         }
     }
@@ -267,6 +277,7 @@ static void getUniverseDigest(m256i& digest)
         {
             if (assetChangeFlags[i >> 6] & (3ULL << (i & 63)))
             {
+                StateSnapshot::beforeWrite(&assetDigests[digestIndex], 32);
                 KangarooTwelve64To32(&assetDigests[previousLevelBeginning + i], &assetDigests[digestIndex]);
                 assetChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
                 assetChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
@@ -289,7 +300,7 @@ static bool saveUniverse(CHAR16* directory = NULL)
     const unsigned long long beginningTick = __rdtsc();
 
     ACQUIRE(universeLock);
-    long long savedSize = save(UNIVERSE_FILE_NAME, ASSETS_CAPACITY * sizeof(Asset), (unsigned char*)assets, directory);
+    long long savedSize = saveStateFile(UNIVERSE_FILE_NAME, ASSETS_CAPACITY * sizeof(Asset), (unsigned char*)assets, sizeof(Asset), directory);
     RELEASE(universeLock);
 
     if (savedSize == ASSETS_CAPACITY * sizeof(Asset))
@@ -306,7 +317,7 @@ static bool saveUniverse(CHAR16* directory = NULL)
 
 static bool loadUniverse(CHAR16* directory = NULL)
 {
-    long long loadedSize = load(UNIVERSE_FILE_NAME, ASSETS_CAPACITY * sizeof(Asset), (unsigned char*)assets, directory);
+    long long loadedSize = loadStateFile(UNIVERSE_FILE_NAME, ASSETS_CAPACITY * sizeof(Asset), (unsigned char*)assets, directory);
     if (loadedSize != ASSETS_CAPACITY * sizeof(Asset))
     {
         logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() reads invalid number of bytes", loadedSize, __LINE__);
@@ -321,7 +332,7 @@ static void assetsEndEpoch()
     ACQUIRE(universeLock);
 
     // TODO: comment what is done here
-    Asset* reorgAssets = (Asset*)reorgBuffer;
+    Asset* reorgAssets = (Asset*)__acquireScratchpad(universeSizeInBytes);
     setMem(reorgAssets, ASSETS_CAPACITY * sizeof(Asset), 0);
     for (unsigned int i = 0; i < ASSETS_CAPACITY; i++)
     {
@@ -401,7 +412,9 @@ static void assetsEndEpoch()
             }
         }
     }
+    StateSnapshot::beforeWrite(assets, ASSETS_CAPACITY * sizeof(Asset));
     copyMem(assets, reorgAssets, ASSETS_CAPACITY * sizeof(Asset));
+    __releaseScratchpad(reorgAssets);
 
     setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0xFF);
 
@@ -1,39 +1,195 @@
 #pragma once
 
 #include "platform/memory.h"
+#include "platform/concurrency.h"
+#include "platform/console_logging.h"
+#include "platform/assert.h"
 
 #include "network_messages/entity.h"
 #include "network_messages/assets.h"
 
+#include "public_settings.h"
 
-constexpr unsigned long long spectrumSizeInBytes = SPECTRUM_CAPACITY * sizeof(::Entity);
-constexpr unsigned long long universeSizeInBytes = ASSETS_CAPACITY * sizeof(Asset);
 
-// Buffer used for reorganizing spectrum and universe hash maps, currently also used as scratchpad buffer for contracts
+constexpr unsigned long long spectrumSizeInBytes = SPECTRUM_CAPACITY * sizeof(::Entity);
+constexpr unsigned long long universeSizeInBytes = ASSETS_CAPACITY * sizeof(Asset);
+
+// Buffer used for reorganizing spectrum and universe hash maps, also used as largest scratchpad buffer
 static void* reorgBuffer = nullptr; // Must be large enough to fit any contract, full spectrum, and full universe!
 
-static bool initCommonBuffers()
-{
-    // TODO: check that max contract state size does not exceed size of spectrum or universe
-    constexpr unsigned long long reorgBufferSize = (spectrumSizeInBytes >= universeSizeInBytes) ? spectrumSizeInBytes : universeSizeInBytes;
-    if (!allocatePool(reorgBufferSize, (void**)&reorgBuffer))
+#ifndef REORG_BUFFER_SIZE
+#define REORG_BUFFER_SIZE ((spectrumSizeInBytes >= universeSizeInBytes) ? spectrumSizeInBytes : universeSizeInBytes)
+#endif
+
+// Scratchpad buffers are handed out for exclusive use by one execution context at a time, so contract executions (one per
+// contractLocalsStack slot) and system tasks (tick processor, contract processor) can use scratchpads concurrently.
+// Buffers are organized in tiers of increasing size. A request is served by the smallest free buffer that is large enough.
+// There is one small buffer per execution context, so each context is guaranteed a buffer. Code holding a scratchpad does
+// not wait for anything else and releases it soon, so waiting in __acquireScratchpad() always ends. The reorgBuffer is only
+// used for requests that do not fit into a medium buffer, so holding a smaller scratchpad while reorganizing the spectrum
+// (as done when burning dust) cannot deadlock. If a processor times out while holding scratchpads, they are released with
+// releaseScratchpadsOfStack().
+#ifndef SCRATCHPAD_SMALL_BUFFER_SIZE
+#define SCRATCHPAD_SMALL_BUFFER_SIZE (1ULL << 20)
+#endif
+#ifndef SCRATCHPAD_MEDIUM_BUFFER_SIZE
+#define SCRATCHPAD_MEDIUM_BUFFER_SIZE (32ULL << 20)
+#endif
+#define NUMBER_OF_SCRATCHPAD_SYSTEM_TASKS 2
+#define NUMBER_OF_SCRATCHPAD_SMALL_BUFFERS (NUMBER_OF_CONTRACT_EXECUTION_BUFFERS + NUMBER_OF_SCRATCHPAD_SYSTEM_TASKS)
+#define NUMBER_OF_SCRATCHPAD_MEDIUM_BUFFERS 4
+#define NUMBER_OF_SCRATCHPAD_BUFFERS (NUMBER_OF_SCRATCHPAD_SMALL_BUFFERS + NUMBER_OF_SCRATCHPAD_MEDIUM_BUFFERS + 1)
+
+static_assert(SCRATCHPAD_SMALL_BUFFER_SIZE <= SCRATCHPAD_MEDIUM_BUFFER_SIZE && SCRATCHPAD_MEDIUM_BUFFER_SIZE <= REORG_BUFFER_SIZE, "Scratchpad tiers must be sorted by size");
+
+#ifdef NO_UEFI
+// In the test build, guard bytes are written behind the requested size of each acquired scratchpad and checked on release
+// in order to detect writes beyond the requested size (that would overlap with the memory of another user in a tighter layout).
+#define SCRATCHPAD_GUARD_SIZE 64
+#define SCRATCHPAD_GUARD_BYTE 0xA5
+#else
+#define SCRATCHPAD_GUARD_SIZE 0
+#endif
+
+struct ScratchpadBuffer
+{
+    unsigned char* ptr;
+    unsigned long long size;
+    unsigned long long acquiredSize;
+    const char* acquiredOnStack; // address in function call stack of the processor that acquired the buffer
+    volatile char lock;
+};
+
+// Sorted by size (small, medium, reorgBuffer)
+static ScratchpadBuffer scratchpadBuffers[NUMBER_OF_SCRATCHPAD_BUFFERS];
+static unsigned char* scratchpadPool = nullptr;
+static volatile long numberOfAcquiredScratchpads = 0;
+
+static void deinitCommonBuffers();
+
+static bool initCommonBuffers()
+{
+    // TODO: check that max contract state size does not exceed size of spectrum or universe
+    constexpr unsigned long long smallBuffersSize = NUMBER_OF_SCRATCHPAD_SMALL_BUFFERS * (SCRATCHPAD_SMALL_BUFFER_SIZE + SCRATCHPAD_GUARD_SIZE);
+    constexpr unsigned long long mediumBuffersSize = NUMBER_OF_SCRATCHPAD_MEDIUM_BUFFERS * (SCRATCHPAD_MEDIUM_BUFFER_SIZE + SCRATCHPAD_GUARD_SIZE);
+    if (!allocatePool(REORG_BUFFER_SIZE + SCRATCHPAD_GUARD_SIZE, (void**)&reorgBuffer)
+        || !allocatePool(smallBuffersSize + mediumBuffersSize, (void**)&scratchpadPool))
     {
         logToConsole(L"Failed to allocate common buffers!");
+        deinitCommonBuffers();
         return false;
     }
 
+    setMem(scratchpadBuffers, sizeof(scratchpadBuffers), 0);
+    unsigned char* ptr = scratchpadPool;
+    for (unsigned int i = 0; i < NUMBER_OF_SCRATCHPAD_BUFFERS - 1; i++)
+    {
+        scratchpadBuffers[i].ptr = ptr;
+        scratchpadBuffers[i].size = (i < NUMBER_OF_SCRATCHPAD_SMALL_BUFFERS) ? SCRATCHPAD_SMALL_BUFFER_SIZE : SCRATCHPAD_MEDIUM_BUFFER_SIZE;
+        ptr += scratchpadBuffers[i].size + SCRATCHPAD_GUARD_SIZE;
+    }
+    scratchpadBuffers[NUMBER_OF_SCRATCHPAD_BUFFERS - 1].ptr = (unsigned char*)reorgBuffer;
+    scratchpadBuffers[NUMBER_OF_SCRATCHPAD_BUFFERS - 1].size = REORG_BUFFER_SIZE;
+    numberOfAcquiredScratchpads = 0;
+
     return true;
-}
-
+}
+
 static void deinitCommonBuffers()
 {
+    ASSERT(numberOfAcquiredScratchpads == 0);
     if (reorgBuffer)
     {
         freePool(reorgBuffer);
+        reorgBuffer = nullptr;
+    }
+    if (scratchpadPool)
+    {
+        freePool(scratchpadPool);
+        scratchpadPool = nullptr;
+    }
+    setMem(scratchpadBuffers, sizeof(scratchpadBuffers), 0);
+}
+
+// Try to acquire scratchpad buffer of at least the given size for exclusive use. Thread-safe, returns nullptr if no
+// appropriate buffer is available. The content of the buffer is undefined. Release with __releaseScratchpad().
+static void* __tryAcquireScratchpad(unsigned long long size)
+{
+    const unsigned int numberOfBuffers = (size <= SCRATCHPAD_MEDIUM_BUFFER_SIZE) ? NUMBER_OF_SCRATCHPAD_BUFFERS - 1 : NUMBER_OF_SCRATCHPAD_BUFFERS;
+    for (unsigned int i = 0; i < numberOfBuffers; i++)
+    {
+        ScratchpadBuffer& buffer = scratchpadBuffers[i];
+        if (buffer.ptr && buffer.size >= size && TRY_ACQUIRE(buffer.lock))
+        {
+            buffer.acquiredSize = size;
+            buffer.acquiredOnStack = (const char*)_AddressOfReturnAddress();
+#ifdef NO_UEFI
+            setMem(buffer.ptr + size, SCRATCHPAD_GUARD_SIZE, SCRATCHPAD_GUARD_BYTE);
+#endif
+            _InterlockedIncrement(&numberOfAcquiredScratchpads);
+            return buffer.ptr;
+        }
+    }
+    return nullptr;
+}
+
+// Acquire scratchpad buffer of at least the given size for exclusive use, waiting until an appropriate buffer is available.
+// Thread-safe, returns nullptr only if size exceeds the largest buffer. Release with __releaseScratchpad().
+static void* __acquireScratchpad(unsigned long long size)
+{
+    if (size > REORG_BUFFER_SIZE)
+    {
+        return nullptr;
+    }
+    void* ptr;
+    while (!(ptr = __tryAcquireScratchpad(size)))
+    {
+        _mm_pause();
+    }
+    return ptr;
+}
+
+// Release scratchpad buffer acquired with __acquireScratchpad() or __tryAcquireScratchpad()
+static void __releaseScratchpad(void* ptr)
+{
+    for (unsigned int i = 0; i < NUMBER_OF_SCRATCHPAD_BUFFERS; i++)
+    {
+        ScratchpadBuffer& buffer = scratchpadBuffers[i];
+        if (buffer.ptr == ptr)
+        {
+            ASSERT(buffer.lock);
+#ifdef NO_UEFI
+            for (unsigned int j = 0; j < SCRATCHPAD_GUARD_SIZE; j++)
+            {
+                ASSERT(buffer.ptr[buffer.acquiredSize + j] == SCRATCHPAD_GUARD_BYTE);
+            }
+#endif
+            _InterlockedDecrement(&numberOfAcquiredScratchpads);
+            RELEASE(buffer.lock);
+            return;
+        }
+    }
+    ASSERT(!"Released scratchpad not found");
+}
+
+// Release all scratchpad buffers that have been acquired by code running on the function call stack [stackBottom, stackTop).
+// Used for recovering from a processor timeout. Must be called after the processor has been stopped.
+static void releaseScratchpadsOfStack(const char* stackBottom, const char* stackTop)
+{
+    for (unsigned int i = 0; i < NUMBER_OF_SCRATCHPAD_BUFFERS; i++)
+    {
+        ScratchpadBuffer& buffer = scratchpadBuffers[i];
+        if (buffer.lock && buffer.acquiredOnStack >= stackBottom && buffer.acquiredOnStack < stackTop)
+        {
+            buffer.acquiredOnStack = nullptr;
+            _InterlockedDecrement(&numberOfAcquiredScratchpads);
+            RELEASE(buffer.lock);
+        }
     }
 }
 
-static void* __scratchpad()
+// Return number of scratchpad buffers currently acquired (for detecting leaks)
+static unsigned int getNumberOfAcquiredScratchpads()
 {
-    return reorgBuffer;
+    return numberOfAcquiredScratchpads;
 }
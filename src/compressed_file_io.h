@@ -0,0 +1,596 @@
+#pragma once
+
+#include "platform/memory.h"
+#include "platform/file_io.h"
+#include "platform/console_logging.h"
+
+#include "kangaroo_twelve.h"
+#include "private_settings.h"
+
+// Maximum number of bytes of decoded data per block (rounded down to a multiple of the record size)
+#ifndef COMPRESSED_FILE_BLOCK_SIZE
+#define COMPRESSED_FILE_BLOCK_SIZE (1024 * 1024)
+#endif
+
+// Size of the buffer used for writing and reading the compressed file (has to hold the largest encoded block)
+#define COMPRESSED_FILE_IO_BUFFER_SIZE (4 * COMPRESSED_FILE_BLOCK_SIZE)
+
+#define COMPRESSED_FILE_MAGIC 0x504D434349425551ULL // "QUBICCMP"
+#define COMPRESSED_FILE_VERSION 1
+
+// Flags of CompressedFileBlockHeader
+#define COMPRESSED_FILE_BLOCK_ZERO_RECORDS_REMOVED 1 // bitmap of non-zero records followed by the non-zero records
+#define COMPRESSED_FILE_BLOCK_LZ 2 // LZ-compressed (after removing zero records if flag above is set)
+
+#define COMPRESSED_FILE_LZ_MIN_MATCH 4
+#define COMPRESSED_FILE_LZ_MAX_OFFSET 65535
+#define COMPRESSED_FILE_LZ_HASH_BITS 16
+
+
+// Compressed file: header followed by numberOfBlocks blocks, each consisting of a block header and encodedSize bytes.
+// Block i holds the decoded bytes [i * blockSize, min((i + 1) * blockSize, totalSize)).
+struct CompressedFileHeader
+{
+    unsigned long long magic;
+    unsigned int version;
+    unsigned int recordSize; // size of the slots of the saved array (0 if the data isn't an array of records)
+    unsigned long long totalSize; // size of decoded data
+    unsigned long long fileSize; // size of compressed file including this header (0 while the file is written)
+    unsigned int blockSize;
+    unsigned int numberOfBlocks;
+};
+
+struct CompressedFileBlockHeader
+{
+    unsigned int encodedSize;
+    unsigned int intermediateSize; // size after removing zero records (if COMPRESSED_FILE_BLOCK_ZERO_RECORDS_REMOVED)
+    unsigned int flags;
+    unsigned int reserved;
+    unsigned long long checksum; // first 8 bytes of K12 digest of the decoded block
+};
+
+
+static bool isZeroRecord(const unsigned char* record, unsigned int size)
+{
+    unsigned int i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        if (*((unsigned long long*)(record + i)))
+        {
+            return false;
+        }
+    }
+    for (; i < size; i++)
+    {
+        if (record[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Write bitmap of non-zero records of block followed by the non-zero records to output. Returns size of output.
+static unsigned int removeZeroRecords(const unsigned char* block, unsigned int size, unsigned int recordSize, unsigned char* output)
+{
+    const unsigned int numberOfRecords = size / recordSize;
+    const unsigned int bitmapSize = (numberOfRecords + 7) / 8;
+    setMem(output, bitmapSize, 0);
+    unsigned int outputSize = bitmapSize;
+    for (unsigned int i = 0; i < numberOfRecords; i++)
+    {
+        if (!isZeroRecord(block + i * recordSize, recordSize))
+        {
+            output[i >> 3] |= 1 << (i & 7);
+            copyMem(output + outputSize, block + i * recordSize, recordSize);
+            outputSize += recordSize;
+        }
+    }
+    return outputSize;
+}
+
+// Inverse of removeZeroRecords(). Returns false if input is invalid.
+static bool restoreZeroRecords(const unsigned char* input, unsigned int inputSize, unsigned int recordSize, unsigned char* block, unsigned int size)
+{
+    const unsigned int numberOfRecords = size / recordSize;
+    const unsigned int bitmapSize = (numberOfRecords + 7) / 8;
+    if (inputSize < bitmapSize)
+    {
+        return false;
+    }
+    unsigned int inputOffset = bitmapSize;
+    for (unsigned int i = 0; i < numberOfRecords; i++)
+    {
+        if (input[i >> 3] & (1 << (i & 7)))
+        {
+            if (inputSize - inputOffset < recordSize)
+            {
+                return false;
+            }
+            copyMem(block + i * recordSize, input + inputOffset, recordSize);
+            inputOffset += recordSize;
+        }
+        else
+        {
+            setMem(block + i * recordSize, recordSize, 0);
+        }
+    }
+    return inputOffset == inputSize;
+}
+
+static unsigned char* writeLzLength(unsigned char* output, unsigned int length)
+{
+    while (length >= 255)
+    {
+        *output++ = 255;
+        length -= 255;
+    }
+    *output++ = (unsigned char)length;
+    return output;
+}
+
+// Compress input with a simple LZ77 encoder (sequences of token, literals, 16-bit offset and match length like LZ4).
+// Output needs space for lzBound(size) bytes and hashTable for 2^COMPRESSED_FILE_LZ_HASH_BITS entries. Returns size
+// of output.
+static unsigned int compressLz(const unsigned char* input, unsigned int size, unsigned char* output, unsigned int* hashTable)
+{
+    setMem(hashTable, sizeof(unsigned int) << COMPRESSED_FILE_LZ_HASH_BITS, 0);
+    unsigned char* out = output;
+    unsigned int literalsBegin = 0;
+    unsigned int position = 0;
+
+    // last bytes are always stored as literals
+    const unsigned int matchLimit = (size > 12) ? size - 12 : 0;
+    while (position < matchLimit)
+    {
+        const unsigned int value = *((unsigned int*)(input + position));
+        const unsigned int hash = (value * 2654435761U) >> (32 - COMPRESSED_FILE_LZ_HASH_BITS);
+        const unsigned int candidate = hashTable[hash];
+        hashTable[hash] = position;
+        if (candidate >= position || position - candidate > COMPRESSED_FILE_LZ_MAX_OFFSET
+            || *((unsigned int*)(input + candidate)) != value)
+        {
+            position++;
+            continue;
+        }
+
+        unsigned int matchLength = COMPRESSED_FILE_LZ_MIN_MATCH;
+        while (position + matchLength + 8 <= size
+            && *((unsigned long long*)(input + candidate + matchLength)) == *((unsigned long long*)(input + position + matchLength)))
+        {
+            matchLength += 8;
+        }
+        while (position + matchLength < size && input[candidate + matchLength] == input[position + matchLength])
+        {
+            matchLength++;
+        }
+
+        const unsigned int literalLength = position - literalsBegin;
+        unsigned char* token = out++;
+        *token = (unsigned char)(((literalLength < 15) ? literalLength : 15) << 4);
+        if (literalLength >= 15)
+        {
+            out = writeLzLength(out, literalLength - 15);
+        }
+        copyMem(out, input + literalsBegin, literalLength);
+        out += literalLength;
+        const unsigned int offset = position - candidate;
+        *out++ = (unsigned char)offset;
+        *out++ = (unsigned char)(offset >> 8);
+        const unsigned int lengthCode = matchLength - COMPRESSED_FILE_LZ_MIN_MATCH;
+        *token |= (lengthCode < 15) ? lengthCode : 15;
+        if (lengthCode >= 15)
+        {
+            out = writeLzLength(out, lengthCode - 15);
+        }
+
+        position += matchLength;
+        literalsBegin = position;
+    }
+
+    // last sequence only consists of literals
+    const unsigned int literalLength = size - literalsBegin;
+    *out++ = (unsigned char)(((literalLength < 15) ? literalLength : 15) << 4);
+    if (literalLength >= 15)
+    {
+        out = writeLzLength(out, literalLength - 15);
+    }
+    copyMem(out, input + literalsBegin, literalLength);
+    out += literalLength;
+
+    return (unsigned int)(out - output);
+}
+
+// Maximum size of output of compressLz() for input of size bytes
+static constexpr unsigned int lzBound(unsigned int size)
+{
+    return size + size / 255 + 16;
+}
+
+static bool readLzLength(const unsigned char*& input, const unsigned char* inputEnd, unsigned int& length)
+{
+    unsigned char byte;
+    do
+    {
+        if (input == inputEnd)
+        {
+            return false;
+        }
+        byte = *input++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Decompress output of compressLz() with exactly size bytes of decoded data. Returns false if input is invalid.
+static bool decompressLz(const unsigned char* input, unsigned int inputSize, unsigned char* output, unsigned int size)
+{
+    const unsigned char* inputEnd = input + inputSize;
+    unsigned int position = 0;
+    while (input < inputEnd)
+    {
+        const unsigned char token = *input++;
+        unsigned int literalLength = token >> 4;
+        if (literalLength == 15 && !readLzLength(input, inputEnd, literalLength))
+        {
+            return false;
+        }
+        if ((unsigned long long)(inputEnd - input) < literalLength || size - position < literalLength)
+        {
+            return false;
+        }
+        copyMem(output + position, input, literalLength);
+        input += literalLength;
+        position += literalLength;
+        if (input == inputEnd)
+        {
+            break;
+        }
+
+        if (inputEnd - input < 2)
+        {
+            return false;
+        }
+        const unsigned int offset = input[0] | (input[1] << 8);
+        input += 2;
+        unsigned int matchLength = token & 15;
+        if (matchLength == 15 && !readLzLength(input, inputEnd, matchLength))
+        {
+            return false;
+        }
+        matchLength += COMPRESSED_FILE_LZ_MIN_MATCH;
+        if (!offset || offset > position || size - position < matchLength)
+        {
+            return false;
+        }
+
+        // byte by byte, because match may overlap with its own output
+        const unsigned char* match = output + position - offset;
+        for (unsigned int i = 0; i < matchLength; i++)
+        {
+            output[position + i] = match[i];
+        }
+        position += matchLength;
+    }
+    return position == size;
+}
+
+static unsigned long long compressedFileChecksum(const unsigned char* block, unsigned int size)
+{
+    unsigned long long checksum;
+    KangarooTwelve(block, size, &checksum, sizeof(checksum));
+    return checksum;
+}
+
+// Save totalSize bytes of buffer in compressed format. If the buffer is an array of records of recordSize bytes (such
+// as hash map slots), records that are all zero are only stored as a bit. The data is split into blocks, which are
+// compressed and stored with a checksum. An existing file is replaced. Returns totalSize on success and -1 otherwise.
+static long long saveCompressedFile(const CHAR16* fileName, unsigned long long totalSize, const unsigned char* buffer, unsigned int recordSize, const CHAR16* directory = NULL)
+{
+    CompressedFileHeader header;
+    header.magic = COMPRESSED_FILE_MAGIC;
+    header.version = COMPRESSED_FILE_VERSION;
+    header.recordSize = (recordSize <= COMPRESSED_FILE_BLOCK_SIZE / 8) ? recordSize : 0;
+    header.totalSize = totalSize;
+    header.blockSize = (header.recordSize) ? COMPRESSED_FILE_BLOCK_SIZE - COMPRESSED_FILE_BLOCK_SIZE % header.recordSize : COMPRESSED_FILE_BLOCK_SIZE;
+    const unsigned long long numberOfBlocks = (totalSize + header.blockSize - 1) / header.blockSize;
+    if (numberOfBlocks > 0xFFFFFFFFULL)
+    {
+        return -1;
+    }
+    header.numberOfBlocks = (unsigned int)numberOfBlocks;
+
+    // saveAt() doesn't truncate, so remove the old file (which may be larger or in raw format) first
+    if (!removeFile(fileName, directory))
+    {
+        logToConsole(L"Failed to remove old file before saving compressed file!");
+        return -1;
+    }
+
+    constexpr unsigned long long intermediateBufferSize = COMPRESSED_FILE_BLOCK_SIZE + COMPRESSED_FILE_BLOCK_SIZE / 8 + 8;
+    constexpr unsigned long long hashTableSize = sizeof(unsigned int) << COMPRESSED_FILE_LZ_HASH_BITS;
+    static_assert(sizeof(CompressedFileHeader) + sizeof(CompressedFileBlockHeader) + lzBound((unsigned int)intermediateBufferSize) <= COMPRESSED_FILE_IO_BUFFER_SIZE, "Encoded block may not fit into buffer");
+    unsigned char* workBuffer;
+    if (!allocatePool(COMPRESSED_FILE_IO_BUFFER_SIZE + intermediateBufferSize + hashTableSize, (void**)&workBuffer))
+    {
+        logToConsole(L"Failed to allocate buffer for saving compressed file!");
+        return -1;
+    }
+    unsigned char* outputBuffer = workBuffer;
+    unsigned char* intermediateBuffer = outputBuffer + COMPRESSED_FILE_IO_BUFFER_SIZE;
+    unsigned int* hashTable = (unsigned int*)(intermediateBuffer + intermediateBufferSize);
+
+    // header with file size 0 marks the file as incomplete until the final header is written after the blocks
+    header.fileSize = 0;
+    copyMem(outputBuffer, &header, sizeof(header));
+    unsigned long long outputSize = sizeof(header);
+    unsigned long long filePosition = 0;
+    bool ok = true;
+    for (unsigned long long offset = 0; offset < totalSize && ok; offset += header.blockSize)
+    {
+        const unsigned int blockSize = (unsigned int)((totalSize - offset < header.blockSize) ? totalSize - offset : header.blockSize);
+        const unsigned char* block = buffer + offset;
+
+        if (outputSize + sizeof(CompressedFileBlockHeader) + lzBound((unsigned int)intermediateBufferSize) > COMPRESSED_FILE_IO_BUFFER_SIZE)
+        {
+            ok = (saveAt(fileName, filePosition, outputSize, outputBuffer, directory) == (long long)outputSize);
+            filePosition += outputSize;
+            outputSize = 0;
+        }
+
+        CompressedFileBlockHeader* blockHeader = (CompressedFileBlockHeader*)(outputBuffer + outputSize);
+        unsigned char* encoded = outputBuffer + outputSize + sizeof(CompressedFileBlockHeader);
+        blockHeader->flags = 0;
+        blockHeader->reserved = 0;
+        blockHeader->checksum = compressedFileChecksum(block, blockSize);
+
+        const unsigned char* lzInput = block;
+        unsigned int lzInputSize = blockSize;
+        if (header.recordSize && blockSize % header.recordSize == 0)
+        {
+            const unsigned int intermediateSize = removeZeroRecords(block, blockSize, header.recordSize, intermediateBuffer);
+            if (intermediateSize < blockSize)
+            {
+                blockHeader->flags |= COMPRESSED_FILE_BLOCK_ZERO_RECORDS_REMOVED;
+                lzInput = intermediateBuffer;
+                lzInputSize = intermediateSize;
+            }
+        }
+        blockHeader->intermediateSize = lzInputSize;
+
+        const unsigned int lzSize = compressLz(lzInput, lzInputSize, encoded, hashTable);
+        if (lzSize < lzInputSize)
+        {
+            blockHeader->flags |= COMPRESSED_FILE_BLOCK_LZ;
+            blockHeader->encodedSize = lzSize;
+        }
+        else
+        {
+            copyMem(encoded, lzInput, lzInputSize);
+            blockHeader->encodedSize = lzInputSize;
+        }
+        outputSize += sizeof(CompressedFileBlockHeader) + blockHeader->encodedSize;
+    }
+
+    if (ok && outputSize)
+    {
+        ok = (saveAt(fileName, filePosition, outputSize, outputBuffer, directory) == (long long)outputSize);
+        filePosition += outputSize;
+    }
+    header.fileSize = filePosition;
+    if (ok)
+    {
+        ok = (saveAt(fileName, 0, sizeof(header), (unsigned char*)&header, directory) == sizeof(header));
+    }
+
+    freePool(workBuffer);
+    return (ok) ? (long long)totalSize : -1;
+}
+
+// Load file saved with saveCompressedFile() to buffer, checking totalSize and the checksums. Returns totalSize on
+// success, 0 if the file isn't compressed (saved in raw format), and -1 on error.
+static long long loadCompressedFile(const CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, const CHAR16* directory = NULL)
+{
+#ifndef NO_UEFI
+    // raw files smaller than the header and missing files (raw large files consist of chunk files) aren't probed
+    if (getFileSize((CHAR16*)fileName, (CHAR16*)directory) < (long long)sizeof(CompressedFileHeader))
+    {
+        return 0;
+    }
+#endif
+    CompressedFileHeader header;
+    if (totalSize < sizeof(header) || loadAt(fileName, 0, sizeof(header), (unsigned char*)&header, directory) != sizeof(header)
+        || header.magic != COMPRESSED_FILE_MAGIC)
+    {
+        return 0;
+    }
+    if (header.fileSize < sizeof(header))
+    {
+        // saving has been interrupted, so the file contains neither compressed nor raw data
+        logToConsole(L"Compressed file is incomplete!");
+        return -1;
+    }
+    if (header.version != COMPRESSED_FILE_VERSION || header.totalSize != totalSize || !header.blockSize
+        || header.blockSize > COMPRESSED_FILE_BLOCK_SIZE || (header.recordSize && header.blockSize % header.recordSize)
+        || header.numberOfBlocks != (totalSize + header.blockSize - 1) / header.blockSize)
+    {
+        logToConsole(L"Compressed file has unsupported version or unexpected size!");
+        return -1;
+    }
+
+    constexpr unsigned long long intermediateBufferSize = COMPRESSED_FILE_BLOCK_SIZE + COMPRESSED_FILE_BLOCK_SIZE / 8 + 8;
+    unsigned char* workBuffer;
+    if (!allocatePool(COMPRESSED_FILE_IO_BUFFER_SIZE + intermediateBufferSize, (void**)&workBuffer))
+    {
+        logToConsole(L"Failed to allocate buffer for loading compressed file!");
+        return -1;
+    }
+    unsigned char* inputBuffer = workBuffer;
+    unsigned char* intermediateBuffer = inputBuffer + COMPRESSED_FILE_IO_BUFFER_SIZE;
+
+    bool ok = true;
+    unsigned long long filePosition = sizeof(header);
+    unsigned long long inputSize = 0;
+    unsigned long long inputOffset = 0;
+    unsigned long long offset = 0;
+    for (unsigned int blockIndex = 0; blockIndex < header.numberOfBlocks && ok; blockIndex++)
+    {
+        // read next part of the file if the encoded block isn't complete in buffer
+        const CompressedFileBlockHeader* blockHeader = (const CompressedFileBlockHeader*)(inputBuffer + inputOffset);
+        if (inputSize - inputOffset < sizeof(CompressedFileBlockHeader)
+            || inputSize - inputOffset - sizeof(CompressedFileBlockHeader) < blockHeader->encodedSize)
+        {
+            filePosition += inputOffset;
+            inputOffset = 0;
+            if (header.fileSize <= filePosition)
+            {
+                ok = false;
+                break;
+            }
+            inputSize = (header.fileSize - filePosition < COMPRESSED_FILE_IO_BUFFER_SIZE) ? header.fileSize - filePosition : COMPRESSED_FILE_IO_BUFFER_SIZE;
+            if (loadAt(fileName, filePosition, inputSize, inputBuffer, directory) != (long long)inputSize)
+            {
+                ok = false;
+                break;
+            }
+            blockHeader = (const CompressedFileBlockHeader*)inputBuffer;
+            if (inputSize < sizeof(CompressedFileBlockHeader) || inputSize - sizeof(CompressedFileBlockHeader) < blockHeader->encodedSize)
+            {
+                ok = false;
+                break;
+            }
+        }
+        const unsigned char* encoded = inputBuffer + inputOffset + sizeof(CompressedFileBlockHeader);
+        inputOffset += sizeof(CompressedFileBlockHeader) + blockHeader->encodedSize;
+
+        const unsigned int blockSize = (unsigned int)((totalSize - offset < header.blockSize) ? totalSize - offset : header.blockSize);
+        unsigned char* block = buffer + offset;
+        const bool zeroRecordsRemoved = (blockHeader->flags & COMPRESSED_FILE_BLOCK_ZERO_RECORDS_REMOVED) != 0;
+        if (zeroRecordsRemoved && (!header.recordSize || blockSize % header.recordSize || blockHeader->intermediateSize > intermediateBufferSize))
+        {
+            ok = false;
+            break;
+        }
+        if (!zeroRecordsRemoved && blockHeader->intermediateSize != blockSize)
+        {
+            ok = false;
+            break;
+        }
+
+        const unsigned char* intermediate = encoded;
+        if (blockHeader->flags & COMPRESSED_FILE_BLOCK_LZ)
+        {
+            unsigned char* lzOutput = (zeroRecordsRemoved) ? intermediateBuffer : block;
+            ok = decompressLz(encoded, blockHeader->encodedSize, lzOutput, blockHeader->intermediateSize);
+            intermediate = lzOutput;
+        }
+        else
+        {
+            ok = (blockHeader->encodedSize == blockHeader->intermediateSize);
+            if (ok && !zeroRecordsRemoved)
+            {
+                copyMem(block, encoded, blockSize);
+            }
+        }
+        if (ok && zeroRecordsRemoved)
+        {
+            ok = restoreZeroRecords(intermediate, blockHeader->intermediateSize, header.recordSize, block, blockSize);
+        }
+        if (ok && compressedFileChecksum(block, blockSize) != blockHeader->checksum)
+        {
+            setText(message, L"Checksum mismatch in block ");
+            appendNumber(message, blockIndex, FALSE);
+            appendText(message, L" of compressed file ");
+            appendText(message, fileName);
+            logToConsole(message);
+            ok = false;
+        }
+        offset += blockSize;
+    }
+
+    freePool(workBuffer);
+    if (!ok)
+    {
+        logToConsole(L"Failed to load compressed file!");
+        return -1;
+    }
+    return totalSize;
+}
+
+// Check if file starts with the header of a compressed file
+static bool isCompressedFile(const CHAR16* fileName, const CHAR16* directory = NULL)
+{
+    CompressedFileHeader header;
+    return loadAt(fileName, 0, sizeof(header), (unsigned char*)&header, directory) == sizeof(header)
+        && header.magic == COMPRESSED_FILE_MAGIC;
+}
+
+// Save state file in compressed format if COMPRESSED_STATE_FILES is enabled or in raw format otherwise. Data smaller
+// than the compressed file header is always saved in raw format. If largeFile is set, data of at least FILE_CHUNK_SIZE
+// bytes is split into chunk files like in saveLargeFile(), each one saved in the selected format. Thus, files of both
+// formats have the same names and a file of the other format is always replaced. Returns totalSize on success.
+static long long saveStateFile(const CHAR16* fileName, unsigned long long totalSize, const unsigned char* buffer, unsigned int recordSize, const CHAR16* directory = NULL, bool largeFile = false)
+{
+    if (largeFile && totalSize >= FILE_CHUNK_SIZE)
+    {
+        int chunkId = 0;
+        for (unsigned long long offset = 0; offset < totalSize; offset += FILE_CHUNK_SIZE, chunkId++)
+        {
+            CHAR16 chunkFileName[64];
+            setLargeFileChunkName(chunkFileName, fileName, chunkId);
+            const unsigned long long chunkSize = (totalSize - offset < FILE_CHUNK_SIZE) ? totalSize - offset : FILE_CHUNK_SIZE;
+#if !COMPRESSED_STATE_FILES
+            // like saveLargeFile(), skip raw chunks that are complete already (data of growing files is appended)
+            if (getFileSize(chunkFileName, (CHAR16*)directory) == (long long)chunkSize && !isCompressedFile(chunkFileName, directory))
+            {
+                continue;
+            }
+#endif
+            if (saveStateFile(chunkFileName, chunkSize, buffer + offset, recordSize, directory) != (long long)chunkSize)
+            {
+                return -1;
+            }
+        }
+        return totalSize;
+    }
+
+#if COMPRESSED_STATE_FILES
+    if (totalSize >= sizeof(CompressedFileHeader))
+    {
+        return saveCompressedFile(fileName, totalSize, buffer, recordSize, directory);
+    }
+#endif
+    // save() doesn't truncate, so remove the old file (which may be larger or compressed) first
+    if (!removeFile(fileName, directory))
+    {
+        return -1;
+    }
+    return save(fileName, totalSize, buffer, directory);
+}
+
+// Load state file saved by saveStateFile() in any format, detected by the header of compressed files
+static long long loadStateFile(const CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, const CHAR16* directory = NULL, bool largeFile = false)
+{
+    if (largeFile && totalSize >= FILE_CHUNK_SIZE)
+    {
+        int chunkId = 0;
+        for (unsigned long long offset = 0; offset < totalSize; offset += FILE_CHUNK_SIZE, chunkId++)
+        {
+            CHAR16 chunkFileName[64];
+            setLargeFileChunkName(chunkFileName, fileName, chunkId);
+            const unsigned long long chunkSize = (totalSize - offset < FILE_CHUNK_SIZE) ? totalSize - offset : FILE_CHUNK_SIZE;
+            if (loadStateFile(chunkFileName, chunkSize, buffer + offset, directory) != (long long)chunkSize)
+            {
+                return -1;
+            }
+        }
+        return totalSize;
+    }
+
+    const long long loadedSize = loadCompressedFile(fileName, totalSize, buffer, directory);
+    if (loadedSize)
+    {
+        return loadedSize;
+    }
+    return load(fileName, totalSize, buffer, directory);
+}
@@ -39,9 +39,9 @@ template <typename T> static void __logContractDebugMessage(unsigned int, T&);
 template <typename T> static void __logContractErrorMessage(unsigned int, T&);
 template <typename T> static void __logContractInfoMessage(unsigned int, T&);
 template <typename T> static void __logContractWarningMessage(unsigned int, T&);
-static void* __scratchpad();    // TODO: concurrency support (n buffers for n allowed concurrent contract executions)
-// static void* __tryAcquireScratchpad(unsigned int size);  // Thread-safe, may return nullptr if no appropriate buffer is available
-// static void __ReleaseScratchpad(void*);
+static void* __acquireScratchpad(unsigned long long size);  // Thread-safe, waits until appropriate buffer is available
+static void* __tryAcquireScratchpad(unsigned long long size);  // Thread-safe, may return nullptr if no appropriate buffer is available
+static void __releaseScratchpad(void*);
 
 template <unsigned int functionOrProcedureId>
 struct __FunctionOrProcedureBeginEndGuard
@@ -11,9 +11,11 @@
 #include "contract_core/contract_def.h"
 #include "contract_core/stack_buffer.h"
 #include "contract_core/contract_action_tracker.h"
+#include "contract_core/speculative_execution.h"
 
 #include "logging/logging.h"
 #include "common_buffers.h"
+#include "state_snapshot.h"
 
 // TODO: remove, only for debug output
 #include "system.h"
@@ -43,8 +45,7 @@ static unsigned char* contractStates[contractCount];
 static volatile long long contractTotalExecutionTicks[contractCount];
 static unsigned int contractError[contractCount];
 
-// TODO: If we ever have parallel procedure calls (of different contracts), we need to make
-// access to contractStateChangeFlags thread-safe
+// Flags are set with setContractStateChangeFlag(), because procedures may run in parallel (speculative execution)
 static unsigned long long* contractStateChangeFlags = NULL;
 
 static ContractActionTracker<1024> contractActionTracker;
@@ -68,7 +69,10 @@ static bool initContractExec()
     setMem(contractUserProcedureLocalsSizes, sizeof(contractUserProcedureLocalsSizes), 0);
 
     for (ContractLocalsStack::SizeType i = 0; i < NUMBER_OF_CONTRACT_EXECUTION_BUFFERS; ++i)
+    {
         contractLocalsStack[i].init();
+        contractLocalsStack[i].zeroUnused();
+    }
     setMem((void*)contractLocalsStackLock, sizeof(contractLocalsStackLock), 0);
 
     setMem((void*)contractTotalExecutionTicks, sizeof(contractTotalExecutionTicks), 0);
@@ -88,6 +92,55 @@ static bool initContractExec()
     return true;
 }
 
+// Mark contract state as changed (thread-safe)
+static void setContractStateChangeFlag(unsigned int contractIndex)
+{
+    _InterlockedOr64((volatile long long*)&contractStateChangeFlags[contractIndex >> 6], 1LL << (contractIndex & 63));
+}
+
+// Return action tracker of the procedure call running on this processor
+static ContractActionTracker<1024>& currentContractActionTracker()
+{
+    SpeculativeLane* lane = getCurrentSpeculativeLane();
+    return (lane) ? lane->actionTracker : contractActionTracker;
+}
+
+// Track write access of speculatively executed transaction to contract state and save state for undo if needed.
+// Return the state the procedure should change, which is a temporary copy if the state cannot be saved (the
+// transaction is escaped in this case). Lock of contract state needs to be acquired for writing before.
+static void* acquireSpeculativeStateForWriting(SpeculativeLane& lane, unsigned int contractIndex)
+{
+    const unsigned long long stateSize = contractDescriptions[contractIndex].stateSize;
+    lane.trackWrite(speculativeContractStateResource(contractIndex));
+    if (lane.isContractStateSaved(contractIndex))
+        return contractStates[contractIndex];
+
+    if (!lane.isTransactionEscaped()
+        && stateSize <= MAX_SPECULATIVE_CONTRACT_STATE_SIZE
+        && lane.saveForUndo(contractStates[contractIndex], (unsigned int)stateSize))
+    {
+        lane.setContractStateSaved(contractIndex);
+        return contractStates[contractIndex];
+    }
+
+    // Transaction will be executed again sequentially -> let it change a temporary copy
+    lane.escapeTransaction();
+    void* shadowState = lane.allocShadowState(stateSize);
+    copyMem(shadowState, contractStates[contractIndex], stateSize);
+    lane.shadowStates[contractIndex] = shadowState;
+    return shadowState;
+}
+
+// Free temporary copy of contract state if acquireSpeculativeStateForWriting() has created one
+static void releaseSpeculativeStateForWriting(SpeculativeLane& lane, unsigned int contractIndex)
+{
+    if (lane.shadowStates[contractIndex])
+    {
+        lane.freeShadowState(contractDescriptions[contractIndex].stateSize);
+        lane.shadowStates[contractIndex] = nullptr;
+    }
+}
+
 // Acquire lock of an currently unused stack (may block if all in use)
 // stacksToIgnore > 0 can be passed by low priority tasks to keep some stacks reserved for high prio purposes.
 static void acquireContractLocalsStack(int& stackIdx, unsigned int stacksToIgnore = 0)
@@ -119,16 +172,70 @@ static void acquireContractLocalsStack(int& stackIdx, unsigned int stacksToIgnor
         contractLocalsStack[stackIdx].freeAll();
 }
 
-// Release locked stack (and reset stackIdx)
+// Release locked stack (and reset stackIdx). Memory used is zeroed here, so the next user does not need to zero its
+// locals before running the contract code.
 static void releaseContractLocalsStack(int& stackIdx)
 {
     ASSERT(stackIdx >= 0);
     ASSERT(stackIdx < NUMBER_OF_CONTRACT_EXECUTION_BUFFERS);
     ASSERT(contractLocalsStackLock[stackIdx]);
+    contractLocalsStack[stackIdx].zeroUnused();
     RELEASE(contractLocalsStackLock[stackIdx]);
     stackIdx = -1;
 }
 
+// Recover from timeout of speculative contract processor (for example caused by __qpiAbort()). The transaction that
+// was running is escaped, so its changes are undone by rollbackSpeculativeBatch() and it is executed again by the
+// contract processor. The locks, the contract execution buffer, and the scratchpads held by the aborted procedure call
+// are released, and the contract error set by __qpiAbort() is reverted.
+// Must be called after the processor of the lane has been stopped.
+static void abortSpeculativeLane(SpeculativeLane& lane)
+{
+    lane.escapeTransaction();
+
+    // spinlocks of short sections without nested calls (access table lock is taken while holding the spectrum lock)
+    if (lane.heldAccessTableLock)
+    {
+        lane.heldAccessTableLock = false;
+        RELEASE(speculativeAccessTableLock);
+    }
+    if (lane.heldSpectrumLock)
+    {
+        RELEASE(*lane.heldSpectrumLock);
+        lane.heldSpectrumLock = nullptr;
+    }
+
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; ++contractIndex)
+    {
+        while (lane.heldStateReadLocks[contractIndex])
+        {
+            contractStateLock[contractIndex].releaseRead();
+            lane.stateLockReleased(contractIndex, false);
+        }
+        if (lane.heldStateWriteLocks[contractIndex])
+        {
+            contractStateLock[contractIndex].releaseWrite();
+            lane.stateLockReleased(contractIndex, true);
+        }
+    }
+
+    if (lane.heldLocalsStackIndex >= 0)
+    {
+        contractLocalsStack[lane.heldLocalsStackIndex].freeAll();
+        releaseContractLocalsStack(lane.heldLocalsStackIndex);
+    }
+
+    // procedure may have timed out while cleaning up a HashMap or collection
+    releaseScratchpadsOfStack(lane.getStackBottom(), lane.getStackTop());
+
+    // transaction is executed again sequentially, which sets the error again if it also fails there
+    if (lane.abortedContractIndex >= 0)
+    {
+        contractError[lane.abortedContractIndex] = lane.contractErrorBeforeAbort;
+        lane.abortedContractIndex = -1;
+    }
+}
+
 // Allocate storage on ContractLocalsStack of QPI execution context
 void* QPI::QpiContextFunctionCall::__qpiAllocLocals(unsigned int sizeOfLocals) const
 {
@@ -146,7 +253,7 @@ void* QPI::QpiContextFunctionCall::__qpiAllocLocals(unsigned int sizeOfLocals) c
         // abort execution of contract here
         __qpiAbort(ContractErrorAllocLocalsFailed);
     }
-    void* p = contractLocalsStack[_stackIndex].allocate(sizeOfLocals);
+    void* p = contractLocalsStack[_stackIndex].allocateZeroed(sizeOfLocals);
     if (!p)
     {
 #ifndef NDEBUG
@@ -165,7 +272,6 @@ void* QPI::QpiContextFunctionCall::__qpiAllocLocals(unsigned int sizeOfLocals) c
         // abort execution of contract here
         __qpiAbort(ContractErrorAllocLocalsFailed);
     }
-    setMem(p, sizeOfLocals, 0);
     return p;
 }
 
@@ -248,6 +354,12 @@ void* QPI::QpiContextFunctionCall::__qpiAcquireStateForReading(unsigned int cont
 {
     ASSERT(contractIndex < contractCount);
     contractStateLock[contractIndex].acquireRead();
+    SpeculativeLane* lane = getCurrentSpeculativeLane();
+    if (lane)
+    {
+        lane->stateLockAcquired(contractIndex, false);
+        lane->trackRead(speculativeContractStateResource(contractIndex));
+    }
     return contractStates[contractIndex];
 }
 
@@ -255,6 +367,9 @@ void* QPI::QpiContextFunctionCall::__qpiAcquireStateForReading(unsigned int cont
 void QPI::QpiContextFunctionCall::__qpiReleaseStateForReading(unsigned int contractIndex) const
 {
     ASSERT(contractIndex < contractCount);
+    SpeculativeLane* lane = getCurrentSpeculativeLane();
+    if (lane)
+        lane->stateLockReleased(contractIndex, false);
     contractStateLock[contractIndex].releaseRead();
 }
 
@@ -263,6 +378,12 @@ void* QPI::QpiContextProcedureCall::__qpiAcquireStateForWriting(unsigned int con
 {
     ASSERT(contractIndex < contractCount);
     contractStateLock[contractIndex].acquireWrite();
+    SpeculativeLane* lane = getCurrentSpeculativeLane();
+    if (lane)
+        lane->stateLockAcquired(contractIndex, true);
+    StateSnapshot::beforeWrite(contractStates[contractIndex], contractDescriptions[contractIndex].stateSize);
+    if (lane)
+        return acquireSpeculativeStateForWriting(*lane, contractIndex);
     return contractStates[contractIndex];
 }
 
@@ -270,8 +391,14 @@ void* QPI::QpiContextProcedureCall::__qpiAcquireStateForWriting(unsigned int con
 void QPI::QpiContextProcedureCall::__qpiReleaseStateForWriting(unsigned int contractIndex) const
 {
     ASSERT(contractIndex < contractCount);
+    SpeculativeLane* lane = getCurrentSpeculativeLane();
+    if (lane)
+    {
+        releaseSpeculativeStateForWriting(*lane, contractIndex);
+        lane->stateLockReleased(contractIndex, true);
+    }
     contractStateLock[contractIndex].releaseWrite();
-    contractStateChangeFlags[_currentContractIndex >> 6] |= (1ULL << (_currentContractIndex & 63));
+    setContractStateChangeFlag(_currentContractIndex);
 }
 
 // Used to call a special system procedure of another contract from within a contract /for example in asset management rights transfer
@@ -305,10 +432,9 @@ void QPI::QpiContextProcedureCall::__qpiCallSystemProcOfOtherContract(unsigned i
 
     // Alloc locals
     unsigned short localsSize = contractSystemProcedureLocalsSizes[otherContractIndex][sysProcId];
-    char* localsBuffer = contractLocalsStack[_stackIndex].allocate(localsSize);
+    char* localsBuffer = contractLocalsStack[_stackIndex].allocateZeroed(localsSize);
     if (!localsBuffer)
         __qpiAbort(ContractErrorAllocLocalsFailed);
-    setMem(localsBuffer, localsSize, 0);
 
     // Run procedure
     contractSystemProcedures[otherContractIndex][sysProcId](otherContractContext, otherContractState, &input, &output, localsBuffer);
@@ -323,6 +449,12 @@ void QPI::QpiContextProcedureCall::__qpiCallSystemProcOfOtherContract(unsigned i
 void QPI::QpiContextFunctionCall::__qpiAbort(unsigned int errorCode) const
 {
     ASSERT(_currentContractIndex < contractCount);
+    SpeculativeLane* lane = getCurrentSpeculativeLane();
+    if (lane && lane->abortedContractIndex < 0)
+    {
+        lane->abortedContractIndex = _currentContractIndex;
+        lane->contractErrorBeforeAbort = contractError[_currentContractIndex];
+    }
     contractError[_currentContractIndex] = errorCode;
 
 #ifndef NDEBUG
@@ -419,6 +551,7 @@ struct QpiContextSystemProcedureCall : public QPI::QpiContextProcedureCall
         QPI::NoData noInOutData;
         // reserve resources for this processor (may block)
         contractStateLock[_currentContractIndex].acquireWrite();
+        StateSnapshot::beforeWrite(contractStates[_currentContractIndex], contractDescriptions[_currentContractIndex].stateSize);
 
         const unsigned long long startTick = __rdtsc();
         unsigned short localsSize = contractSystemProcedureLocalsSizes[_currentContractIndex][systemProcId];
@@ -431,10 +564,9 @@ struct QpiContextSystemProcedureCall : public QPI::QpiContextProcedureCall
         {
             // locals required: reserve stack and use stack (should not block because stack 0 is reserved for procedures)
             acquireContractLocalsStack(_stackIndex);
-            char* localsBuffer = contractLocalsStack[_stackIndex].allocate(localsSize);
+            char* localsBuffer = contractLocalsStack[_stackIndex].allocateZeroed(localsSize);
             if (!localsBuffer)
                 __qpiAbort(ContractErrorAllocLocalsFailed);
-            setMem(localsBuffer, localsSize, 0);
 
             // call system proc
             contractSystemProcedures[_currentContractIndex][systemProcId](*this, contractStates[_currentContractIndex], &noInOutData, &noInOutData, localsBuffer);
@@ -448,11 +580,11 @@ struct QpiContextSystemProcedureCall : public QPI::QpiContextProcedureCall
 
         // release lock of contract state and set state to changed
         contractStateLock[_currentContractIndex].releaseWrite();
-        contractStateChangeFlags[_currentContractIndex >> 6] |= (1ULL << (_currentContractIndex & 63));
+        setContractStateChangeFlag(_currentContractIndex);
     }
 };
 
-// QPI context used to call contract user procedure from qubic core (contract processor)
+// QPI context used to call contract user procedure from qubic core (contract processor or speculative contract processor)
 struct QpiContextUserProcedureCall : public QPI::QpiContextProcedureCall
 {
     char* outputBuffer;
@@ -460,8 +592,9 @@ struct QpiContextUserProcedureCall : public QPI::QpiContextProcedureCall
 
     QpiContextUserProcedureCall(unsigned int contractIndex, const m256i& originator, long long invocationReward) : QPI::QpiContextProcedureCall(contractIndex, originator, invocationReward)
     {
-        contractActionTracker.init();
-        if (!contractActionTracker.addQuTransfer(_originator, _currentContractId, _invocationReward))
+        ContractActionTracker<1024>& actionTracker = currentContractActionTracker();
+        actionTracker.init();
+        if (!actionTracker.addQuTransfer(_originator, _currentContractId, _invocationReward))
             __qpiAbort(ContractErrorTooManyActions);
         outputBuffer = nullptr;
         outputSize = 0;
@@ -491,12 +624,15 @@ struct QpiContextUserProcedureCall : public QPI::QpiContextProcedureCall
 
         // reserve stack for this processor (may block)
         acquireContractLocalsStack(_stackIndex);
+        SpeculativeLane* lane = getCurrentSpeculativeLane();
+        if (lane)
+            lane->heldLocalsStackIndex = _stackIndex;
 
-        // allocate input, output, and locals buffer from stack and init them
+        // allocate zeroed input, output, and locals buffer from stack
         unsigned short fullInputSize = contractUserProcedureInputSizes[_currentContractIndex][inputType];
         outputSize = contractUserProcedureOutputSizes[_currentContractIndex][inputType];
         unsigned int localsSize = contractUserProcedureLocalsSizes[_currentContractIndex][inputType];
-        char* inputBuffer = contractLocalsStack[_stackIndex].allocate(fullInputSize + outputSize + localsSize);
+        char* inputBuffer = contractLocalsStack[_stackIndex].allocateZeroed(fullInputSize + outputSize + localsSize);
         if (!inputBuffer)
         {
 #ifndef NDEBUG
@@ -524,30 +660,39 @@ struct QpiContextUserProcedureCall : public QPI::QpiContextProcedureCall
 
         outputBuffer = inputBuffer + fullInputSize;
         char* localsBuffer = outputBuffer + outputSize;
-        if (inputSize < fullInputSize)
-        {
-            // less input data than expected by contract -> fill with 0
-            setMem(inputBuffer + inputSize, fullInputSize - inputSize, 0);
-        }
-        else if (inputSize > fullInputSize)
+        if (inputSize > fullInputSize)
         {
             // more input data than expected by contract -> discard additional bytes
+            // (if there is less input data than expected, the rest stays 0)
             inputSize = fullInputSize;
         }
         copyMem(inputBuffer, inputPtr, inputSize);
-        setMem(outputBuffer, outputSize + localsSize, 0);
 
         // acquire lock of contract state for writing (shouldn't block because 1 stack is not used by functions and thus kept free for procedures)
         contractStateLock[_currentContractIndex].acquireWrite();
+        if (lane)
+            lane->stateLockAcquired(_currentContractIndex, true);
+        StateSnapshot::beforeWrite(contractStates[_currentContractIndex], contractDescriptions[_currentContractIndex].stateSize);
+
+        // in speculative execution, track access and save state for undo
+        void* state = contractStates[_currentContractIndex];
+        if (lane)
+            state = acquireSpeculativeStateForWriting(*lane, _currentContractIndex);
 
         // run procedure
         const unsigned long long startTick = __rdtsc();
-        contractUserProcedures[_currentContractIndex][inputType](*this, contractStates[_currentContractIndex], inputBuffer, outputBuffer, localsBuffer);
+        contractUserProcedures[_currentContractIndex][inputType](*this, state, inputBuffer, outputBuffer, localsBuffer);
         _interlockedadd64(&contractTotalExecutionTicks[_currentContractIndex], __rdtsc() - startTick);
 
+        if (lane)
+        {
+            releaseSpeculativeStateForWriting(*lane, _currentContractIndex);
+            lane->stateLockReleased(_currentContractIndex, true);
+        }
+
         // release lock of contract state and set state to changed
         contractStateLock[_currentContractIndex].releaseWrite();
-        contractStateChangeFlags[_currentContractIndex >> 6] |= (1ULL << (_currentContractIndex & 63));
+        setContractStateChangeFlag(_currentContractIndex);
     }
 
     // free buffer after output has been copied (or isn't needed anymore)
@@ -561,6 +706,9 @@ struct QpiContextUserProcedureCall : public QPI::QpiContextProcedureCall
         ASSERT(contractLocalsStack[_stackIndex].size() == 0);
 
         // release stack lock
+        SpeculativeLane* lane = getCurrentSpeculativeLane();
+        if (lane)
+            lane->heldLocalsStackIndex = -1;
         releaseContractLocalsStack(_stackIndex);
     }
 };
@@ -605,11 +753,11 @@ struct QpiContextUserFunctionCall : public QPI::QpiContextFunctionCall
         constexpr unsigned int stacksNotUsedToReserveThemForStateWriter = 1;
         acquireContractLocalsStack(_stackIndex, stacksNotUsedToReserveThemForStateWriter);
 
-        // allocate input, output, and locals buffer from stack and init them
+        // allocate zeroed input, output, and locals buffer from stack
         unsigned short fullInputSize = contractUserFunctionInputSizes[_currentContractIndex][inputType];
         outputSize = contractUserFunctionOutputSizes[_currentContractIndex][inputType];
         unsigned int localsSize = contractUserFunctionLocalsSizes[_currentContractIndex][inputType];
-        char* inputBuffer = contractLocalsStack[_stackIndex].allocate(fullInputSize + outputSize + localsSize);
+        char* inputBuffer = contractLocalsStack[_stackIndex].allocateZeroed(fullInputSize + outputSize + localsSize);
         if (!inputBuffer)
         {
 #ifndef NDEBUG
@@ -636,18 +784,13 @@ struct QpiContextUserFunctionCall : public QPI::QpiContextFunctionCall
         }
         outputBuffer = inputBuffer + fullInputSize;
         char* localsBuffer = outputBuffer + outputSize;
-        if (inputSize < fullInputSize)
-        {
-            // less input data than expected by contract -> fill with 0
-            setMem(inputBuffer + inputSize, fullInputSize - inputSize, 0);
-        }
-        else if (inputSize > fullInputSize)
+        if (inputSize > fullInputSize)
         {
             // more input data than expected by contract -> discard additional bytes
+            // (if there is less input data than expected, the rest stays 0)
             inputSize = fullInputSize;
         }
         copyMem(inputBuffer, inputPtr, inputSize);
-        setMem(outputBuffer, outputSize + localsSize, 0);
 
         // acquire lock of contract state for reading (may block)
         contractStateLock[_currentContractIndex].acquireRead();
@@ -4,6 +4,8 @@
 
 #include "assets/assets.h"
 
+#include "contract_core/speculative_execution.h"
+
 
 long long QPI::QpiContextProcedureCall::issueAsset(unsigned long long name, const QPI::id& issuer, signed char numberOfDecimalPlaces, long long numberOfShares, unsigned long long unitOfMeasurement) const
 {
@@ -56,6 +58,14 @@ long long QPI::QpiContextProcedureCall::issueAsset(unsigned long long name, cons
         return 0;
     }
 
+    // changes of universe cannot be undone -> execute transaction again sequentially
+    SpeculativeLane* lane = getCurrentSpeculativeLane();
+    if (lane)
+    {
+        lane->escapeTransaction();
+        return 0;
+    }
+
     char nameBuffer[7] = { char(name), char(name >> 8), char(name >> 16), char(name >> 24), char(name >> 32), char(name >> 40), char(name >> 48) };
     char unitOfMeasurementBuffer[7] = { char(unitOfMeasurement), char(unitOfMeasurement >> 8), char(unitOfMeasurement >> 16), char(unitOfMeasurement >> 24), char(unitOfMeasurement >> 32), char(unitOfMeasurement >> 40), char(unitOfMeasurement >> 48) };
     int issuanceIndex, ownershipIndex, possessionIndex;
@@ -152,6 +162,14 @@ long long QPI::QpiContextProcedureCall::transferShareOwnershipAndPossession(unsi
         return -((long long)(MAX_AMOUNT + 1));
     }
 
+    // changes of universe cannot be undone -> execute transaction again sequentially
+    SpeculativeLane* lane = getCurrentSpeculativeLane();
+    if (lane)
+    {
+        lane->escapeTransaction();
+        return -numberOfShares;
+    }
+
     ACQUIRE(universeLock);
 
     int issuanceIndex = issuer.m256i_u32[0] & (ASSETS_CAPACITY - 1);
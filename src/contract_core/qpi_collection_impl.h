@@ -280,14 +280,12 @@ namespace QPI
 	template <typename T, uint64 L>
 	sint64 collection<T, L>::_rebuild(sint64 rootIdx)
 	{
-		auto* sortedElementIndices = reinterpret_cast<sint64*>(::__scratchpad());
-		if (sortedElementIndices == NULL)
-		{
-			return rootIdx;
-		}
+		// Sorted indices and queue of ranges need up to 5 * L sint64 (waits if all appropriate scratchpads are in use)
+		auto* sortedElementIndices = reinterpret_cast<sint64*>(::__acquireScratchpad(L * sizeof(sint64) + L * sizeof(sint64_4)));
 		sint64 n = _getSortedElements(rootIdx, sortedElementIndices);
 		if (!n)
 		{
+			::__releaseScratchpad(sortedElementIndices);
 			return rootIdx;
 		}
 		// initialize root
@@ -360,6 +358,7 @@ namespace QPI
 			}
 		}
 
+		::__releaseScratchpad(sortedElementIndices);
 		return rootIdx;
 	}
 
@@ -583,11 +582,12 @@ namespace QPI
 		}
 
 		// Init buffers
-		auto* _povsBuffer = reinterpret_cast<PoV*>(::__scratchpad());
+		void* scratchpad = ::__acquireScratchpad(sizeof(_povs) + sizeof(_povOccupationFlags) + L * sizeof(sint64));
+		auto* _povsBuffer = reinterpret_cast<PoV*>(scratchpad);
 		auto* _povOccupationFlagsBuffer = reinterpret_cast<uint64*>(_povsBuffer + L);
 		auto* _stackBuffer = reinterpret_cast<sint64*>(
 			_povOccupationFlagsBuffer + sizeof(_povOccupationFlags) / sizeof(_povOccupationFlags[0]));
-		setMem(::__scratchpad(), sizeof(_povs) + sizeof(_povOccupationFlags), 0);
+		setMem(scratchpad, sizeof(_povs) + sizeof(_povOccupationFlags), 0);
 		uint64 newPopulation = 0;
 
 		// Go through pov hash map. For each pov that is occupied but not marked for removal, insert pov in new collection's pov buffers and
@@ -660,6 +660,7 @@ namespace QPI
 						copyMem(_povs, _povsBuffer, sizeof(_povs));
 						copyMem(_povOccupationFlags, _povOccupationFlagsBuffer, sizeof(_povOccupationFlags));
 						_markRemovalCounter = 0;
+						::__releaseScratchpad(scratchpad);
 						return;
 					}
 				}
@@ -671,6 +672,7 @@ namespace QPI
 		// don't expect here, certainly got error!!!
 		printf("ERROR: Something went wrong at cleanup!\n");
 #endif
+		::__releaseScratchpad(scratchpad);
 	}
 
 	template <typename T, uint64 L>
@@ -852,6 +854,73 @@ namespace QPI
 		return nextElementIdxOfRemoved;
 	}
 
+	template <typename T, uint64 L>
+	sint64 collection<T, L>::removeAndCompact(sint64 elementIdx)
+	{
+		elementIdx &= (L - 1);
+		if (uint64(elementIdx) >= _population)
+		{
+			return NULL_INDEX;
+		}
+
+		const sint64 povIndex = _elements[elementIdx].povIndex;
+		const bool povRemoved = (_povs[povIndex].population == 1);
+		const sint64 nextElementIdxOfRemoved = remove(elementIdx);
+		if (povRemoved)
+		{
+			_compactPovs(povIndex);
+		}
+		return nextElementIdxOfRemoved;
+	}
+
+	template <typename T, uint64 L>
+	void collection<T, L>::_compactPovs(sint64 povIndex)
+	{
+		// Walk along the probe sequence following the pov slot marked for removal (hole). Each pov that may be stored at
+		// the hole (because the hole is between its hash index and its current index) is moved back, leaving a new hole.
+		// If an empty slot is reached, no probe sequence passes the hole anymore and it can be marked as not occupied.
+		// Moving a pov requires updating the povIndex of all its elements, which is counted in the steps.
+		sint64 holeIndex = povIndex;
+		sint64 index = povIndex;
+		sint64 steps = 0;
+		for (sint64 counter = 1; counter < L && steps < _maxCompactionSteps; counter++, steps++)
+		{
+			index = (index + 1) & (L - 1);
+			const uint64 flags = (_povOccupationFlags[index >> 5] >> ((index & 31) << 1)) & 3ULL;
+			if (flags == 0)
+			{
+				_povOccupationFlags[holeIndex >> 5] &= ~(3ULL << ((holeIndex & 31) << 1));
+				setMem(&_povs[holeIndex], sizeof(PoV), 0);
+				_markRemovalCounter--;
+				return;
+			}
+			if (flags == 1)
+			{
+				const sint64 hashIndex = _povs[index].value.u64._0 & (L - 1);
+				if (((index - holeIndex) & (L - 1)) <= ((index - hashIndex) & (L - 1)))
+				{
+					if (steps + sint64(_povs[index].population) > _maxCompactionSteps)
+					{
+						// moving the pov is too expensive now, keep removal mark
+						break;
+					}
+					steps += _povs[index].population;
+
+					// move pov to hole and mark its old slot for removal
+					copyMem(&_povs[holeIndex], &_povs[index], sizeof(PoV));
+					_povOccupationFlags[holeIndex >> 5] ^= (3ULL << ((holeIndex & 31) << 1));
+					_povOccupationFlags[index >> 5] ^= (3ULL << ((index & 31) << 1));
+					setMem(&_povs[index], sizeof(PoV), 0);
+					for (sint64 elementIdx = _getMostLeft(_povs[holeIndex].bstRootIndex); elementIdx != NULL_INDEX; elementIdx = _nextElementIndex(elementIdx))
+					{
+						_elements[elementIdx].povIndex = holeIndex;
+					}
+					holeIndex = index;
+				}
+			}
+		}
+	}
+
 	template <typename T, uint64 L>
 	void collection<T, L>::replace(sint64 oldElementIndex, const T& newElement)
 	{
@@ -176,6 +176,58 @@ namespace QPI
 		}
 	}
 
+	template <typename KeyT, typename ValueT, uint64 L, typename HashFunc>
+	void HashMap<KeyT, ValueT, L, HashFunc>::removeByIndexAndCompact(sint64 elementIdx)
+	{
+		elementIdx &= (L - 1);
+		if ((_getEncodedOccupationFlags(_occupationFlags, elementIdx) & 3ULL) != 1)
+		{
+			return;
+		}
+		_population--;
+
+		// Walk along the probe sequence following the freed slot (hole). Each element that may be stored at the hole
+		// (because the hole is between its hash index and its current index) is moved back, leaving a new hole.
+		// If an empty slot is reached, no probe sequence passes the hole anymore and it can be marked as not occupied.
+		sint64 holeIndex = elementIdx;
+		sint64 index = elementIdx;
+		for (sint64 step = 1; step < L && step <= _maxCompactionSteps; step++)
+		{
+			index = (index + 1) & (L - 1);
+			const uint64 flags = (_occupationFlags[index >> 5] >> ((index & 31) << 1)) & 3ULL;
+			if (flags == 0)
+			{
+				_occupationFlags[holeIndex >> 5] &= ~(3ULL << ((holeIndex & 31) << 1));
+				setMem(&_elements[holeIndex], sizeof(Element), 0);
+				return;
+			}
+			if (flags == 1)
+			{
+				const sint64 hashIndex = HashFunc::hash(_elements[index].key) & (L - 1);
+				if (((index - holeIndex) & (L - 1)) <= ((index - hashIndex) & (L - 1)))
+				{
+					copyMem(&_elements[holeIndex], &_elements[index], sizeof(Element));
+					holeIndex = index;
+				}
+			}
+		}
+
+		// End of probe sequence not reached -> mark hole for removal
+		_markRemovalCounter++;
+		_occupationFlags[holeIndex >> 5] ^= (3ULL << ((holeIndex & 31) << 1));
+		setMem(&_elements[holeIndex], sizeof(Element), 0);
+	}
+
+	template <typename KeyT, typename ValueT, uint64 L, typename HashFunc>
+	sint64 HashMap<KeyT, ValueT, L, HashFunc>::removeByKeyAndCompact(const KeyT& key)
+	{
+		sint64 elementIndex = getElementIndex(key);
+		if (elementIndex != NULL_INDEX)
+		{
+			removeByIndexAndCompact(elementIndex);
+		}
+		return elementIndex;
+	}
 	template <typename KeyT, typename ValueT, uint64 L, typename HashFunc>
 	void HashMap<KeyT, ValueT, L, HashFunc>::cleanup()
 	{
@@ -197,11 +249,10 @@ namespace QPI
 		}
 
 		// Init buffers
-		auto* _elementsBuffer = reinterpret_cast<Element*>(::__scratchpad());
+		void* scratchpad = ::__acquireScratchpad(sizeof(_elements) + sizeof(_occupationFlags));
+		auto* _elementsBuffer = reinterpret_cast<Element*>(scratchpad);
 		auto* _occupationFlagsBuffer = reinterpret_cast<uint64*>(_elementsBuffer + L);
-		auto* _stackBuffer = reinterpret_cast<sint64*>(
-			_occupationFlagsBuffer + sizeof(_occupationFlags) / sizeof(_occupationFlags[0]));
-		setMem(::__scratchpad(), sizeof(_elements) + sizeof(_occupationFlags), 0);
+		setMem(scratchpad, sizeof(_elements) + sizeof(_occupationFlags), 0);
 		uint64 newPopulation = 0;
 
 		// Go through hash map. For each element that is occupied but not marked for removal, insert element in new hash map's buffers.
@@ -253,6 +304,7 @@ namespace QPI
 						copyMem(_elements, _elementsBuffer, sizeof(_elements));
 						copyMem(_occupationFlags, _occupationFlagsBuffer, sizeof(_occupationFlags));
 						_markRemovalCounter = 0;
+						::__releaseScratchpad(scratchpad);
 						return;
 					}
 				}
@@ -264,6 +316,7 @@ namespace QPI
 		// don't expect here, certainly got error!!!
 		printf("ERROR: Something went wrong at cleanup!\n");
 #endif
+		::__releaseScratchpad(scratchpad);
 	}
 
 	template <typename KeyT, typename ValueT, uint64 L, typename HashFunc>
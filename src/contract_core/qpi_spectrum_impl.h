@@ -21,6 +21,14 @@ bool QPI::QpiContextFunctionCall::getEntity(const m256i& id, QPI::Entity& entity
     }
     else
     {
+        // in speculative execution, track read access (entity must not change while reading)
+        SpeculativeLane* lane = getCurrentSpeculativeLane();
+        if (lane)
+        {
+            ACQUIRE(spectrumLock);
+            lane->trackRead(speculativeSpectrumEntityResource(index));
+        }
+
         entity.publicKey = spectrum[index].publicKey;
         entity.incomingAmount = spectrum[index].incomingAmount;
         entity.outgoingAmount = spectrum[index].outgoingAmount;
@@ -29,6 +37,11 @@ bool QPI::QpiContextFunctionCall::getEntity(const m256i& id, QPI::Entity& entity
         entity.latestIncomingTransferTick = spectrum[index].latestIncomingTransferTick;
         entity.latestOutgoingTransferTick = spectrum[index].latestOutgoingTransferTick;
 
+        if (lane)
+        {
+            RELEASE(spectrumLock);
+        }
+
         return true;
     }
 }
@@ -36,7 +49,7 @@ bool QPI::QpiContextFunctionCall::getEntity(const m256i& id, QPI::Entity& entity
 // Return reference to fee reserve of contract for changing its value (data stored in state of contract 0)
 static long long& contractFeeReserve(unsigned int contractIndex)
 {
-    contractStateChangeFlags[0] |= 1ULL;
+    setContractStateChangeFlag(0);
     return ((Contract0State*)contractStates[0])->contractFeeReserves[contractIndex];
 }
 
@@ -54,17 +67,22 @@ long long QPI::QpiContextProcedureCall::burn(long long amount) const
         return -amount;
     }
 
-    const long long remainingAmount = energy(index) - amount;
+    SpeculativeLane* lane = getCurrentSpeculativeLane();
+
+    const long long remainingAmount = ((lane) ? energySpeculative(*lane, index) : energy(index)) - amount;
 
     if (remainingAmount < 0)
     {
         return remainingAmount;
     }
 
-    if (decreaseEnergy(index, amount))
+    if ((lane) ? decreaseEnergySpeculative(*lane, index, amount) : decreaseEnergy(index, amount))
     {
         contractStateLock[0].acquireWrite();
-        contractFeeReserve(_currentContractIndex) += amount;
+        long long& feeReserve = contractFeeReserve(_currentContractIndex);
+        StateSnapshot::beforeWrite(&feeReserve, sizeof(feeReserve));
+        if (!lane || lane->prepareWrite(speculativeContractFeeReserveResource(_currentContractIndex), &feeReserve, sizeof(feeReserve)))
+            feeReserve += amount;
         contractStateLock[0].releaseWrite();
 
         const Burning burning = { _currentContractId , amount };
@@ -88,18 +106,23 @@ long long QPI::QpiContextProcedureCall::transfer(const m256i& destination, long
         return -amount;
     }
 
-    const long long remainingAmount = energy(index) - amount;
+    SpeculativeLane* lane = getCurrentSpeculativeLane();
+
+    const long long remainingAmount = ((lane) ? energySpeculative(*lane, index) : energy(index)) - amount;
 
     if (remainingAmount < 0)
     {
         return remainingAmount;
     }
 
-    if (decreaseEnergy(index, amount))
+    if ((lane) ? decreaseEnergySpeculative(*lane, index, amount) : decreaseEnergy(index, amount))
     {
-        increaseEnergy(destination, amount);
+        if (lane)
+            increaseEnergySpeculative(*lane, destination, amount);
+        else
+            increaseEnergy(destination, amount);
 
-        if (!contractActionTracker.addQuTransfer(_currentContractId, destination, amount))
+        if (!currentContractActionTracker().addQuTransfer(_currentContractId, destination, amount))
             __qpiAbort(ContractErrorTooManyActions);
 
         const QuTransfer quTransfer = { _currentContractId , destination , amount };
@@ -0,0 +1,559 @@
+#pragma once
+
+#include "platform/concurrency.h"
+#include "platform/memory.h"
+#include "platform/debugging.h"
+#include "platform/console_logging.h"
+
+#include "public_settings.h"
+#include "logging/logging.h"
+
+#include "contract_core/contract_action_tracker.h"
+
+
+// Speculative parallel execution of contract procedure transactions
+//
+// Consecutive transactions of a tick that invoke user procedures of contracts with small state form a batch, which
+// is executed by the speculative contract processors in parallel. Each processor runs one lane. All transactions of
+// the batch invoking the same contract are assigned to the same lane, which executes them in the order of the tick.
+//
+// Each access to a shared resource (contract state, spectrum entity, contract fee reserve) is tracked with the
+// position of the transaction in the batch. If the accesses of transactions of different lanes happen in an order
+// that may lead to a result differing from sequential execution, the escape position is lowered. Before changing a
+// resource, the old data is saved in the undo journal of the lane.
+//
+// After all lanes are done, all changes of the transactions at the escape position and later are undone, and these
+// transactions are executed again sequentially by the tick processor. Thus, the result is always the same as with
+// sequential execution.
+//
+// Operations that cannot be undone cheaply (creating spectrum entities, burning dust, changing the universe) are
+// never executed speculatively. Instead, the transaction is escaped and executed again sequentially.
+//
+// Like the contract processor, a speculative contract processor is started for each batch with a timeout. If it
+// times out (for example after __qpiAbort()), the transaction it was executing is escaped and everything held by the
+// lane (contract state locks, spinlocks, contract execution buffer, scratchpads) is released by the main loop. The
+// contract error set by __qpiAbort() is reverted, because the transaction is executed again sequentially (see
+// abortSpeculativeLane()).
+
+
+#if ENABLED_LOGGING
+// Log messages need to be recorded in the order of the transactions, which is not supported by speculative execution
+#define NUMBER_OF_SPECULATIVE_LANES 0
+#else
+#define NUMBER_OF_SPECULATIVE_LANES NUMBER_OF_SPECULATIVE_CONTRACT_PROCESSORS
+#endif
+
+static_assert(NUMBER_OF_SPECULATIVE_LANES < NUMBER_OF_CONTRACT_EXECUTION_BUFFERS, "Each speculative contract processor needs a contract execution buffer.");
+
+// Contracts with larger state are not executed speculatively, because the state is saved before each transaction.
+constexpr unsigned long long MAX_SPECULATIVE_CONTRACT_STATE_SIZE = 1024 * 1024;
+
+constexpr unsigned int SPECULATIVE_UNDO_RECORDS_PER_LANE = 65536;
+constexpr unsigned long long SPECULATIVE_UNDO_DATA_SIZE_PER_LANE = 64 * 1024 * 1024;
+
+constexpr unsigned int SPECULATIVE_ACCESS_TABLE_SIZE = 65536; // Must be 2^N
+constexpr unsigned int SPECULATIVE_ACCESS_TABLE_MAX_PROBES = 64;
+
+
+// Keys of the resources whose accesses are tracked
+static inline unsigned long long speculativeSpectrumEntityResource(unsigned int spectrumIndex)
+{
+    return spectrumIndex;
+}
+
+static inline unsigned long long speculativeContractStateResource(unsigned int contractIndex)
+{
+    return (1ULL << 32) | contractIndex;
+}
+
+static inline unsigned long long speculativeContractFeeReserveResource(unsigned int contractIndex)
+{
+    return (2ULL << 32) | contractIndex;
+}
+
+
+// Latest accesses to a resource in the current batch (positions are stored + 1, so 0 means no access)
+struct SpeculativeAccess
+{
+    unsigned long long resource;
+    unsigned int batchNumber;
+    unsigned int lastReadPosition;
+    unsigned int lastWritePosition;
+};
+
+// Data needed to undo one change. If size is 0, addition has been added to the unsigned long long at address.
+// Otherwise, size bytes at address have been saved to the undo data buffer at dataOffset.
+struct SpeculativeUndoRecord
+{
+    unsigned long long sequenceNumber;
+    void* address;
+    unsigned long long dataOffset;
+    long long addition;
+    unsigned int size;
+    unsigned int position;
+};
+
+
+// Transactions at this position of the batch and later are undone and executed again sequentially
+static volatile long speculativeEscapePosition = 0;
+
+// Global order of changes, used for undoing the changes of all lanes in reverse order
+static volatile long long speculativeUndoSequenceNumber = 0;
+
+static unsigned int speculativeBatchNumber = 0;
+static SpeculativeAccess* speculativeAccessTable = nullptr;
+static volatile char speculativeAccessTableLock = 0;
+
+
+// Lower escape position (thread-safe)
+static void lowerSpeculativeEscapePosition(unsigned int position)
+{
+    long currentEscapePosition = speculativeEscapePosition;
+    while ((long)position < currentEscapePosition)
+    {
+        const long previousEscapePosition = _InterlockedCompareExchange(&speculativeEscapePosition, position, currentEscapePosition);
+        if (previousEscapePosition == currentEscapePosition)
+            break;
+        currentEscapePosition = previousEscapePosition;
+    }
+}
+
+
+// Lane of speculative execution, run by one speculative contract processor
+class SpeculativeLane
+{
+public:
+    // Set to 1 by tick processor to request running the lane, to 2 by main loop when starting the processor, and
+    // to 0 when the processor has finished or timed out
+    volatile char state;
+
+    // Set by processor after executing all transactions of the lane (not set if it times out)
+    volatile bool completed;
+
+    // Positions of transactions in batch executed by this lane (in increasing order)
+    unsigned int numberOfTransactions;
+    unsigned short transactionPositions[NUMBER_OF_TRANSACTIONS_PER_TICK];
+
+    // Used instead of contractActionTracker for the procedure calls of this lane
+    ContractActionTracker<1024> actionTracker;
+
+    // Temporary copies of contract states changed by escaped transaction (nullptr if contract state is used directly)
+    void* shadowStates[MAX_NUMBER_OF_CONTRACTS];
+
+    // Contract state locks and contract execution buffer held by the procedure call running on this lane, which
+    // need to be released if the processor times out
+    unsigned short heldStateReadLocks[MAX_NUMBER_OF_CONTRACTS];
+    bool heldStateWriteLocks[MAX_NUMBER_OF_CONTRACTS];
+    int heldLocalsStackIndex;
+
+    // Spinlocks held by the lane, which need to be released if the processor times out: speculativeAccessTableLock
+    // and the lock of the spectrum (set by the speculative functions in spectrum.h, nullptr if not held)
+    volatile bool heldAccessTableLock;
+    volatile char* volatile heldSpectrumLock;
+
+    // Contract whose error has been set by __qpiAbort() on this lane (-1 if none) and its error before, which is
+    // restored if the lane is aborted
+    int abortedContractIndex;
+    unsigned int contractErrorBeforeAbort;
+
+    // Set all to 0 / nullptr.
+    void init()
+    {
+        state = 0;
+        completed = false;
+        numberOfTransactions = 0;
+        stackBottom = nullptr;
+        stackTop = nullptr;
+        undoRecords = nullptr;
+        undoData = nullptr;
+        shadowStateBuffer = nullptr;
+        shadowStateBufferSize = 0;
+        reset();
+    }
+
+    // Allocate undo journal and buffer for temporary copies of contract states, return if successful
+    bool alloc(unsigned long long shadowStateBufferSizeToAlloc)
+    {
+        if (!allocatePool(SPECULATIVE_UNDO_RECORDS_PER_LANE * sizeof(SpeculativeUndoRecord), (void**)&undoRecords)
+            || !allocatePool(SPECULATIVE_UNDO_DATA_SIZE_PER_LANE, (void**)&undoData)
+            || !allocatePool(shadowStateBufferSizeToAlloc, (void**)&shadowStateBuffer))
+        {
+            return false;
+        }
+        shadowStateBufferSize = shadowStateBufferSizeToAlloc;
+        return true;
+    }
+
+    // Free memory
+    void free()
+    {
+        if (undoRecords)
+            freePool(undoRecords);
+        if (undoData)
+            freePool(undoData);
+        if (shadowStateBuffer)
+            freePool(shadowStateBuffer);
+        init();
+    }
+
+    // Set memory of function call stack of the speculative contract processor running this lane
+    void setStack(const char* bottom, const char* top)
+    {
+        stackBottom = bottom;
+        stackTop = top;
+    }
+
+    // Get memory of function call stack set with setStack()
+    const char* getStackBottom() const
+    {
+        return stackBottom;
+    }
+
+    const char* getStackTop() const
+    {
+        return stackTop;
+    }
+
+    // Check if the calling function runs on the processor of this lane
+    bool isCurrentStack() const
+    {
+        const char* address = (const char*)_AddressOfReturnAddress();
+        return address >= stackBottom && address < stackTop;
+    }
+
+    // Clear transactions and undo journal for new batch
+    void reset()
+    {
+        numberOfTransactions = 0;
+        numberOfUndoRecords = 0;
+        undoDataSize = 0;
+        shadowStateBufferUsed = 0;
+        currentPosition = 0;
+        setMem(savedContractStateFlags, sizeof(savedContractStateFlags), 0);
+        setMem(shadowStates, sizeof(shadowStates), 0);
+        setMem(heldStateReadLocks, sizeof(heldStateReadLocks), 0);
+        setMem(heldStateWriteLocks, sizeof(heldStateWriteLocks), 0);
+        heldLocalsStackIndex = -1;
+        heldAccessTableLock = false;
+        heldSpectrumLock = nullptr;
+        abortedContractIndex = -1;
+        contractErrorBeforeAbort = 0;
+    }
+
+    // Start execution of transaction at position in batch. Return false if it is escaped already.
+    bool beginTransaction(unsigned int position)
+    {
+        ASSERT(numberOfUndoRecords == 0 || undoRecords[numberOfUndoRecords - 1].position <= position);
+        ASSERT(shadowStateBufferUsed == 0);
+        currentPosition = position;
+        setMem(savedContractStateFlags, sizeof(savedContractStateFlags), 0);
+        return position < (unsigned int)speculativeEscapePosition;
+    }
+
+    // Check if current transaction will be undone and executed again sequentially
+    bool isTransactionEscaped() const
+    {
+        return currentPosition >= (unsigned int)speculativeEscapePosition;
+    }
+
+    // Make sure current transaction is undone and executed again sequentially
+    void escapeTransaction()
+    {
+        lowerSpeculativeEscapePosition(currentPosition);
+    }
+
+    // Record that lock of contract state has been acquired / released by the procedure call running on this lane
+    void stateLockAcquired(unsigned int contractIndex, bool write)
+    {
+        if (write)
+            heldStateWriteLocks[contractIndex] = true;
+        else
+            ++heldStateReadLocks[contractIndex];
+    }
+
+    void stateLockReleased(unsigned int contractIndex, bool write)
+    {
+        if (write)
+            heldStateWriteLocks[contractIndex] = false;
+        else
+            --heldStateReadLocks[contractIndex];
+    }
+
+    // Track read access of current transaction. Lock protecting the resource must be held.
+    void trackRead(unsigned long long resource)
+    {
+        trackAccess(resource, false);
+    }
+
+    // Track write access (including read before) of current transaction. Lock protecting the resource must be held.
+    void trackWrite(unsigned long long resource)
+    {
+        trackAccess(resource, true);
+    }
+
+    // Save size bytes at address for undo. Escape transaction and return false if journal is full.
+    // Lock protecting the data must be held.
+    bool saveForUndo(void* address, unsigned int size)
+    {
+        if (numberOfUndoRecords == SPECULATIVE_UNDO_RECORDS_PER_LANE || undoDataSize + size > SPECULATIVE_UNDO_DATA_SIZE_PER_LANE)
+        {
+            escapeTransaction();
+            return false;
+        }
+
+        SpeculativeUndoRecord& record = undoRecords[numberOfUndoRecords++];
+        record.sequenceNumber = _InterlockedIncrement64(&speculativeUndoSequenceNumber);
+        record.address = address;
+        record.dataOffset = undoDataSize;
+        record.addition = 0;
+        record.size = size;
+        record.position = currentPosition;
+        copyMem(undoData + undoDataSize, address, size);
+        undoDataSize += (size + 7) & ~7ULL;
+
+        return true;
+    }
+
+    // Save that addition will be added to value at address. Escape transaction and return false if journal is full.
+    // Lock protecting the value must be held.
+    bool saveAdditionForUndo(unsigned long long* address, long long addition)
+    {
+        if (numberOfUndoRecords == SPECULATIVE_UNDO_RECORDS_PER_LANE)
+        {
+            escapeTransaction();
+            return false;
+        }
+
+        SpeculativeUndoRecord& record = undoRecords[numberOfUndoRecords++];
+        record.sequenceNumber = _InterlockedIncrement64(&speculativeUndoSequenceNumber);
+        record.address = address;
+        record.dataOffset = 0;
+        record.addition = addition;
+        record.size = 0;
+        record.position = currentPosition;
+
+        return true;
+    }
+
+    // Track write access and save data for undo. Return if the data may be changed, which is not the case if the
+    // transaction is escaped. Lock protecting the resource must be held.
+    bool prepareWrite(unsigned long long resource, void* address, unsigned int size)
+    {
+        trackWrite(resource);
+        if (isTransactionEscaped())
+            return false;
+        return saveForUndo(address, size);
+    }
+
+    // Check if state of contract has been saved for undo in current transaction
+    bool isContractStateSaved(unsigned int contractIndex) const
+    {
+        return (savedContractStateFlags[contractIndex >> 6] >> (contractIndex & 63)) & 1;
+    }
+
+    void setContractStateSaved(unsigned int contractIndex)
+    {
+        savedContractStateFlags[contractIndex >> 6] |= (1ULL << (contractIndex & 63));
+    }
+
+    // Allocate temporary copy of contract state. Copies are freed in reverse order of allocation (nested calls).
+    void* allocShadowState(unsigned long long size)
+    {
+        size = (size + 63) & ~63ULL;
+        ASSERT(shadowStateBufferUsed + size <= shadowStateBufferSize);
+        void* shadowState = shadowStateBuffer + shadowStateBufferUsed;
+        shadowStateBufferUsed += size;
+        return shadowState;
+    }
+
+    void freeShadowState(unsigned long long size)
+    {
+        size = (size + 63) & ~63ULL;
+        ASSERT(shadowStateBufferUsed >= size);
+        shadowStateBufferUsed -= size;
+    }
+
+    // Return latest change that needs to be undone (of transaction at escapePosition or later), nullptr if none
+    const SpeculativeUndoRecord* latestChangeToUndo(unsigned int escapePosition) const
+    {
+        if (numberOfUndoRecords && undoRecords[numberOfUndoRecords - 1].position >= escapePosition)
+            return &undoRecords[numberOfUndoRecords - 1];
+        return nullptr;
+    }
+
+    // Undo latest change and remove it from journal
+    void undoLatestChange()
+    {
+        ASSERT(numberOfUndoRecords > 0);
+        const SpeculativeUndoRecord& record = undoRecords[--numberOfUndoRecords];
+        if (record.size)
+            copyMem(record.address, undoData + record.dataOffset, record.size);
+        else
+            *(unsigned long long*)record.address -= record.addition;
+    }
+
+private:
+    // Detect if the access may lead to a different result than sequential execution. If a transaction has read data
+    // that is changed by an earlier transaction afterwards, the later transaction is escaped. If a transaction accesses
+    // data that a later transaction has changed already, the transaction is escaped.
+    void trackAccess(unsigned long long resource, bool write)
+    {
+        const unsigned int position = currentPosition + 1;
+
+        ACQUIRE(speculativeAccessTableLock);
+        heldAccessTableLock = true;
+
+        unsigned int index = (unsigned int)((resource * 0x9E3779B97F4A7C15ULL) >> 32) & (SPECULATIVE_ACCESS_TABLE_SIZE - 1);
+        for (unsigned int probes = 0; probes < SPECULATIVE_ACCESS_TABLE_MAX_PROBES; ++probes)
+        {
+            SpeculativeAccess& access = speculativeAccessTable[index];
+            if (access.batchNumber != speculativeBatchNumber)
+            {
+                // Entry unused in this batch -> start tracking resource
+                access.resource = resource;
+                access.batchNumber = speculativeBatchNumber;
+                access.lastReadPosition = 0;
+                access.lastWritePosition = 0;
+            }
+            if (access.resource == resource)
+            {
+                if (access.lastWritePosition > position)
+                    lowerSpeculativeEscapePosition(currentPosition);
+                if (write)
+                {
+                    if (access.lastReadPosition > position)
+                        lowerSpeculativeEscapePosition(currentPosition + 1);
+                    if (access.lastWritePosition < position)
+                        access.lastWritePosition = position;
+                }
+                else
+                {
+                    if (access.lastReadPosition < position)
+                        access.lastReadPosition = position;
+                }
+
+                heldAccessTableLock = false;
+                RELEASE(speculativeAccessTableLock);
+                return;
+            }
+            index = (index + 1) & (SPECULATIVE_ACCESS_TABLE_SIZE - 1);
+        }
+
+        // Too many resources accessed in this batch -> cannot track access
+        heldAccessTableLock = false;
+        RELEASE(speculativeAccessTableLock);
+        escapeTransaction();
+    }
+
+    const char* stackBottom;
+    const char* stackTop;
+
+    unsigned int currentPosition;
+    unsigned long long savedContractStateFlags[MAX_NUMBER_OF_CONTRACTS / 64];
+
+    SpeculativeUndoRecord* undoRecords;
+    unsigned int numberOfUndoRecords;
+    unsigned char* undoData;
+    unsigned long long undoDataSize;
+
+    unsigned char* shadowStateBuffer;
+    unsigned long long shadowStateBufferSize;
+    unsigned long long shadowStateBufferUsed;
+};
+
+static SpeculativeLane speculativeLanes[NUMBER_OF_SPECULATIVE_LANES ? NUMBER_OF_SPECULATIVE_LANES : 1];
+
+
+// Return lane if calling function runs on a speculative contract processor, nullptr otherwise
+static SpeculativeLane* getCurrentSpeculativeLane()
+{
+    for (unsigned int i = 0; i < NUMBER_OF_SPECULATIVE_LANES; ++i)
+    {
+        if (speculativeLanes[i].isCurrentStack())
+            return &speculativeLanes[i];
+    }
+    return nullptr;
+}
+
+// Allocate memory of lanes. Escaped transactions may change temporary copies of all contract states in a chain of
+// nested calls, so shadowStateBufferSize should be the total size of all contract states.
+static bool initSpeculativeExecution(unsigned long long shadowStateBufferSize)
+{
+    for (unsigned int i = 0; i < NUMBER_OF_SPECULATIVE_LANES; ++i)
+        speculativeLanes[i].init();
+
+    if (!NUMBER_OF_SPECULATIVE_LANES)
+        return true;
+
+    if (!allocatePool(SPECULATIVE_ACCESS_TABLE_SIZE * sizeof(SpeculativeAccess), (void**)&speculativeAccessTable))
+    {
+        logToConsole(L"Failed to allocate speculativeAccessTable!");
+        return false;
+    }
+    setMem(speculativeAccessTable, SPECULATIVE_ACCESS_TABLE_SIZE * sizeof(SpeculativeAccess), 0);
+    speculativeBatchNumber = 0;
+
+    for (unsigned int i = 0; i < NUMBER_OF_SPECULATIVE_LANES; ++i)
+    {
+        if (!speculativeLanes[i].alloc(shadowStateBufferSize))
+        {
+            logToConsole(L"Failed to allocate memory for speculative contract processor!");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void deinitSpeculativeExecution()
+{
+    for (unsigned int i = 0; i < NUMBER_OF_SPECULATIVE_LANES; ++i)
+        speculativeLanes[i].free();
+
+    if (speculativeAccessTable)
+    {
+        freePool(speculativeAccessTable);
+        speculativeAccessTable = nullptr;
+    }
+}
+
+// Start new batch of transactions (lanes' transactions are set afterwards)
+static void beginSpeculativeBatch(unsigned int numberOfTransactionsInBatch)
+{
+    if (++speculativeBatchNumber == 0)
+    {
+        // Batch number overflow -> clear access table to make sure no old entries are considered valid
+        setMem(speculativeAccessTable, SPECULATIVE_ACCESS_TABLE_SIZE * sizeof(SpeculativeAccess), 0);
+        speculativeBatchNumber = 1;
+    }
+    speculativeEscapePosition = numberOfTransactionsInBatch;
+
+    for (unsigned int i = 0; i < NUMBER_OF_SPECULATIVE_LANES; ++i)
+        speculativeLanes[i].reset();
+}
+
+// Undo all changes of transactions at escape position and later (in reverse global order of the changes).
+// Must be called after all lanes are done.
+static void rollbackSpeculativeBatch()
+{
+    const unsigned int escapePosition = speculativeEscapePosition;
+    while (1)
+    {
+        SpeculativeLane* latestLane = nullptr;
+        unsigned long long latestSequenceNumber = 0;
+        for (unsigned int i = 0; i < NUMBER_OF_SPECULATIVE_LANES; ++i)
+        {
+            const SpeculativeUndoRecord* record = speculativeLanes[i].latestChangeToUndo(escapePosition);
+            if (record && record->sequenceNumber > latestSequenceNumber)
+            {
+                latestSequenceNumber = record->sequenceNumber;
+                latestLane = &speculativeLanes[i];
+            }
+        }
+
+        if (!latestLane)
+            break;
+
+        latestLane->undoLatestChange();
+    }
+}
@@ -1,10 +1,17 @@
 #pragma once
 
+#include <intrin.h>
+
 #include "../platform/debugging.h"
+#include "../platform/memory.h"
 
 // Last-In-First-Out storage for data of different size.
 // Size type used for StackBuffer needs to be unsigned.
 // #define TRACK_MAX_STACK_BUFFER_SIZE to collect info on how much stack is used.
+//
+// The buffer keeps a watermark of the memory that may have been written (dirty size). Everything above it is known
+// to be zero, so allocateZeroed() only needs to clear the part of the allocation below the watermark. Calling
+// zeroUnused() when the stack is not in use moves the cost of zeroing off the critical path.
 template <typename StackBufferSizeType, StackBufferSizeType bufferSize>
 struct StackBuffer
 {
@@ -18,10 +25,11 @@ struct StackBuffer
     //    init();
     //}
 
-    // Initialize as empty stack (memory not zeroed)
+    // Initialize as empty stack (memory not zeroed, so all of it is considered dirty until zeroUnused() is called)
     void init()
     {
         _allocatedSize = 0;
+        _dirtySize = bufferSize;
 #ifdef TRACK_MAX_STACK_BUFFER_SIZE
         _maxAllocatedSize = 0;
         _failedAllocAttempts = 0;
@@ -40,6 +48,12 @@ struct StackBuffer
         return _allocatedSize;
     }
 
+    // Number of bytes at the beginning of the buffer that may be non-zero.
+    SizeType dirtySize() const
+    {
+        return _dirtySize;
+    }
+
 #ifdef TRACK_MAX_STACK_BUFFER_SIZE
     SizeType maxSizeObserved() const
     {
@@ -92,6 +106,8 @@ struct StackBuffer
          
         // update size
         _allocatedSize = newSize;
+        if (_dirtySize < newSize)
+            _dirtySize = newSize;
 #ifdef TRACK_MAX_STACK_BUFFER_SIZE
         ASSERT(_maxAllocatedSize <= bufferSize);
         if (_allocatedSize > _maxAllocatedSize)
@@ -101,6 +117,52 @@ struct StackBuffer
         return allocatedBuffer;
     }
 
+    // Allocate storage in buffer and make sure it is zeroed. Only the part below the dirty size watermark is cleared.
+    char* allocateZeroed(SizeType size)
+    {
+        const SizeType offset = _allocatedSize;
+        const SizeType dirtySize = _dirtySize;
+        char* allocatedBuffer = allocate(size);
+        if (allocatedBuffer && dirtySize > offset)
+        {
+            const SizeType dirtyPart = dirtySize - offset;
+            setMem(allocatedBuffer, (dirtyPart < size) ? dirtyPart : size, 0);
+        }
+        return allocatedBuffer;
+    }
+
+    // Zero all memory above the allocated part that may have been written since the last call, using non-temporal
+    // stores in order to not evict useful data from the cache. Call this while no other thread uses the buffer.
+    void zeroUnused()
+    {
+        if (_dirtySize > _allocatedSize)
+        {
+            char* ptr = _buffer + _allocatedSize;
+            unsigned long long size = _dirtySize - _allocatedSize;
+
+            // unaligned head and tail are cleared with setMem()
+            const unsigned long long head = (32 - ((unsigned long long)ptr & 31)) & 31;
+            if (head >= size)
+            {
+                setMem(ptr, size, 0);
+            }
+            else
+            {
+                setMem(ptr, head, 0);
+                ptr += head;
+                size -= head;
+                const __m256i zero = _mm256_setzero_si256();
+                for (; size >= 32; ptr += 32, size -= 32)
+                {
+                    _mm256_stream_si256((__m256i*)ptr, zero);
+                }
+                setMem(ptr, size, 0);
+                _mm_sfence();
+            }
+            _dirtySize = _allocatedSize;
+        }
+    }
+
     // Free storage allocated by last call to allocate().
     bool free()
     {
@@ -154,6 +216,9 @@ protected:
     // number of bytes used in buffer
     SizeType _allocatedSize;
 
+    // number of bytes at the beginning of the buffer that may be non-zero (all others are zero)
+    SizeType _dirtySize;
+
 #ifdef TRACK_MAX_STACK_BUFFER_SIZE
     SizeType _maxAllocatedSize;
     unsigned int _failedAllocAttempts;
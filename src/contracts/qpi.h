@@ -346,6 +346,9 @@ namespace QPI
 		// Read and encode 32 POV occupation flags, return a 64bits number presents 32 occupation flags
 		uint64 _getEncodedOccupationFlags(const uint64* occupationFlags, const sint64 elementIndex) const;
 
+		// Max number of slots inspected by removeByIndexAndCompact()
+		static constexpr sint64 _maxCompactionSteps = 128;
+
 	public:
 		HashMap()
 		{
@@ -386,6 +389,16 @@ namespace QPI
 		// returning the elementIndex (or NULL_INDEX if the hash map does not contain the key).
 		sint64 removeByKey(const KeyT& key);
 
+		// Remove element without leaving a removal mark if possible (backward-shift deletion), so cleanup() is rarely needed.
+		// Following elements of the same probe sequence may be moved, which invalidates their element indices.
+		// The cost is bounded: if the end of the probe sequence is not reached within a fixed number of slots, the last
+		// freed slot is marked for removal instead.
+		void removeByIndexAndCompact(sint64 elementIdx);
+
+		// Remove element like removeByIndexAndCompact() if key is contained in the hash map,
+		// returning the elementIndex before removal (or NULL_INDEX if the hash map does not contain the key).
+		sint64 removeByKeyAndCompact(const KeyT& key);
+
 		// Remove all elements marked for removal, this is a very expensive operation.
 		void cleanup();
 
@@ -501,6 +514,12 @@ namespace QPI
 		// Read and encode 32 POV occupation flags, return a 64bits number presents 32 occupation flags
 		uint64 _getEncodedPovOccupationFlags(const uint64* povOccupationFlags, const sint64 povIndex) const;;
 
+		// Max number of pov slots inspected plus elements updated by removeAndCompact()
+		static constexpr sint64 _maxCompactionSteps = 128;
+
+		// Free pov slot marked for removal by moving back following povs of the probe sequence (bounded number of steps)
+		void _compactPovs(sint64 povIndex);
+
 	public:
 		// Add element to priority queue of ID pov, return elementIndex of new element
 		sint64 add(const id& pov, T element, sint64 priority);
@@ -546,6 +565,12 @@ namespace QPI
 		// Element indices obtained before this call are invalidated, because at least one element is moved.
 		sint64 remove(sint64 elementIdx);
 
+		// Remove element like remove(). If it is the last element of its pov, the pov slot is freed without leaving a removal
+		// mark if possible, so cleanup() is rarely needed. This may move other povs in the pov hash map, but element indices
+		// are affected the same way as by remove(). The cost is bounded: if compaction would exceed a fixed number of steps,
+		// the pov slot is marked for removal instead.
+		sint64 removeAndCompact(sint64 elementIdx);
+
 		// Replace *existing* element, do nothing otherwise.
 		// - The element exists: replace its value.
 		// - The index is out of bounds: no action is taken.
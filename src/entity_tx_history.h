@@ -0,0 +1,323 @@
+#pragma once
+
+#include "network_messages/common_def.h"
+#include "network_messages/entity.h"
+
+#include "platform/memory.h"
+#include "platform/concurrency.h"
+#include "platform/console_logging.h"
+
+// Size of the chunk pool shared by all entities (32 bytes per chunk). If it runs out of chunks, indexing stops until the next epoch.
+#ifndef ENTITY_TX_HISTORY_NUMBER_OF_CHUNKS
+#define ENTITY_TX_HISTORY_NUMBER_OF_CHUNKS (1ULL << 24)
+#endif
+
+// Max tick delta between postings in the same chunk
+#define ENTITY_TX_HISTORY_MAX_TICK_DELTA (1 << 20)
+
+// Chunk of postings of one entity. Postings are varint encoded as (tickDelta << 12) | (transactionIndex << 2) | flags,
+// with tickDelta relative to the previous posting in the chunk (0 for the first posting of the chunk at firstTick).
+struct EntityTxHistoryChunk
+{
+    unsigned int previous; // older chunk of the same entity, 0 if none
+    unsigned int firstTick;
+    unsigned int lastTick;
+    unsigned char size;
+    unsigned char data[19];
+};
+
+static_assert(sizeof(EntityTxHistoryChunk) == 32, "Something is wrong with the struct size.");
+static_assert(NUMBER_OF_TRANSACTIONS_PER_TICK <= 1024, "Transaction index needs to fit into 10 bits of posting");
+static_assert(NUMBER_OF_TRANSACTIONS_PER_TICK <= ENTITY_TX_HISTORY_MAX_POSTINGS, "All postings of a tick need to fit into one response");
+static_assert(ENTITY_TX_HISTORY_NUMBER_OF_CHUNKS <= 0xFFFFFFFFULL, "Chunk indices need to fit into 32 bits");
+
+
+// Per-epoch index from spectrum index to the transactions with the entity as source or destination, enabling nodes to answer
+// RequestEntityTxHistory without replaying ticks.
+//
+// The postings of each entity are stored in a list of chunks from newest to oldest, so recent history is found quickly.
+// Postings are added by the tick processor after executing the transactions of a tick. Because the index is keyed by spectrum
+// index, it is cleared if the spectrum is reorganized. The range of ticks covered is reported with each response.
+//
+// Peer and enqueueResponse() have to be declared before including this file.
+class EntityTxHistory
+{
+    // Index of newest chunk per spectrum index (0 if none)
+    inline static unsigned int* newestChunks = nullptr;
+
+    // Pool of chunks, chunk 0 is not used
+    inline static EntityTxHistoryChunk* chunks = nullptr;
+    inline static unsigned int numberOfUsedChunks = 1;
+
+    inline static unsigned int indexedFromTick = 0;
+    inline static unsigned int indexedToTick = 0;
+    inline static unsigned int spectrumReorganizations = 0;
+    inline static bool full = false;
+
+    // Lock for securing all data of the index
+    inline static volatile char lock = 0;
+
+    // Clear index (lock has to be held)
+    static void clear()
+    {
+        if (numberOfUsedChunks > 1)
+        {
+            setMem(newestChunks, SPECTRUM_CAPACITY * sizeof(unsigned int), 0);
+        }
+        numberOfUsedChunks = 1;
+        indexedFromTick = 0;
+        indexedToTick = 0;
+        full = false;
+    }
+
+    static unsigned int encodePosting(unsigned int tickDelta, unsigned short transactionIndex, unsigned char flags, unsigned char* encoded)
+    {
+        unsigned int value = (tickDelta << 12) | (transactionIndex << 2) | flags;
+        unsigned int size = 0;
+        do
+        {
+            encoded[size] = value & 0x7F;
+            value >>= 7;
+            if (value)
+            {
+                encoded[size] |= 0x80;
+            }
+            size++;
+        } while (value);
+        return size;
+    }
+
+    // Decode postings of chunk in ascending order, returns number of postings
+    static unsigned int decodeChunk(const EntityTxHistoryChunk& chunk, EntityTxHistoryPosting* postings)
+    {
+        unsigned int numberOfPostings = 0;
+        unsigned int tick = chunk.firstTick;
+        unsigned int pos = 0;
+        while (pos < chunk.size)
+        {
+            unsigned int value = 0;
+            unsigned int shift = 0;
+            unsigned char byte;
+            do
+            {
+                byte = chunk.data[pos++];
+                value |= (byte & 0x7F) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+
+            tick += value >> 12;
+            postings[numberOfPostings].tick = tick;
+            postings[numberOfPostings].transactionIndex = (value >> 2) & 0x3FF;
+            postings[numberOfPostings].flags = value & 3;
+            postings[numberOfPostings]._padding = 0;
+            numberOfPostings++;
+        }
+        return numberOfPostings;
+    }
+
+    // Append posting to list of entity (lock has to be held), returns false if chunk pool is exhausted
+    static bool addPosting(unsigned int spectrumIndex, unsigned int tick, unsigned short transactionIndex, unsigned char flags)
+    {
+        unsigned int chunkIndex = newestChunks[spectrumIndex];
+        unsigned char encoded[5];
+        unsigned int encodedSize = 0;
+        if (chunkIndex && tick - chunks[chunkIndex].lastTick < ENTITY_TX_HISTORY_MAX_TICK_DELTA)
+        {
+            encodedSize = encodePosting(tick - chunks[chunkIndex].lastTick, transactionIndex, flags, encoded);
+            if (chunks[chunkIndex].size + encodedSize > sizeof(EntityTxHistoryChunk::data))
+            {
+                encodedSize = 0;
+            }
+        }
+
+        if (!encodedSize)
+        {
+            // start new chunk
+            if (numberOfUsedChunks >= ENTITY_TX_HISTORY_NUMBER_OF_CHUNKS)
+            {
+                return false;
+            }
+            EntityTxHistoryChunk& newChunk = chunks[numberOfUsedChunks];
+            newChunk.previous = chunkIndex;
+            newChunk.firstTick = tick;
+            newChunk.size = 0;
+            chunkIndex = numberOfUsedChunks++;
+            newestChunks[spectrumIndex] = chunkIndex;
+            encodedSize = encodePosting(0, transactionIndex, flags, encoded);
+        }
+
+        EntityTxHistoryChunk& chunk = chunks[chunkIndex];
+        copyMem(chunk.data + chunk.size, encoded, encodedSize);
+        chunk.size += encodedSize;
+        chunk.lastTick = tick;
+        return true;
+    }
+
+public:
+    static bool init()
+    {
+        if ((!newestChunks && !allocatePool(SPECTRUM_CAPACITY * sizeof(unsigned int), (void**)&newestChunks))
+            || (!chunks && !allocatePool(ENTITY_TX_HISTORY_NUMBER_OF_CHUNKS * sizeof(EntityTxHistoryChunk), (void**)&chunks)))
+        {
+            logToConsole(L"Failed to allocate entity transaction history buffers!");
+            deinit();
+            return false;
+        }
+        setMem(newestChunks, SPECTRUM_CAPACITY * sizeof(unsigned int), 0);
+        numberOfUsedChunks = 1;
+        indexedFromTick = 0;
+        indexedToTick = 0;
+        spectrumReorganizations = 0;
+        full = false;
+        return true;
+    }
+
+    static void deinit()
+    {
+        if (newestChunks)
+        {
+            freePool(newestChunks);
+            newestChunks = nullptr;
+        }
+        if (chunks)
+        {
+            freePool(chunks);
+            chunks = nullptr;
+        }
+    }
+
+    static void beginEpoch()
+    {
+        ACQUIRE(lock);
+        clear();
+        RELEASE(lock);
+    }
+
+    // Called by tick processor before adding transactions of tick. The index is cleared if the spectrum has been reorganized
+    // since the last tick, because spectrum indices have changed.
+    static void beginTick(unsigned int tick, unsigned int numberOfSpectrumReorganizations)
+    {
+        ACQUIRE(lock);
+        if (numberOfSpectrumReorganizations != spectrumReorganizations)
+        {
+            clear();
+            spectrumReorganizations = numberOfSpectrumReorganizations;
+        }
+        if (!indexedFromTick)
+        {
+            indexedFromTick = tick;
+        }
+        RELEASE(lock);
+    }
+
+    // Add executed transaction of tick with source and destination entity given by spectrum index (negative if not in spectrum)
+    static void addTransaction(unsigned int tick, unsigned short transactionIndex, int sourceIndex, int destinationIndex)
+    {
+        ACQUIRE(lock);
+        if (!full && sourceIndex >= 0)
+        {
+            const unsigned char flags = (sourceIndex == destinationIndex) ? (ENTITY_TX_HISTORY_SOURCE | ENTITY_TX_HISTORY_DESTINATION) : ENTITY_TX_HISTORY_SOURCE;
+            full = !addPosting(sourceIndex, tick, transactionIndex, flags);
+        }
+        if (!full && destinationIndex >= 0 && destinationIndex != sourceIndex)
+        {
+            full = !addPosting(destinationIndex, tick, transactionIndex, ENTITY_TX_HISTORY_DESTINATION);
+        }
+        RELEASE(lock);
+    }
+
+    // Called by tick processor after adding all transactions of tick
+    static void endTick(unsigned int tick)
+    {
+        ACQUIRE(lock);
+        if (!full)
+        {
+            indexedToTick = tick;
+        }
+        RELEASE(lock);
+    }
+
+    // Send one page of RespondEntityTxHistory for entity at spectrumIndex (negative if not in spectrum). The spectrum index
+    // has to be looked up together with the number of spectrum reorganizations (both with spectrumLock held). If the index is
+    // not keyed by the same spectrum layout, nothing is reported. The buffer needs to hold sizeof(RespondEntityTxHistory) +
+    // ENTITY_TX_HISTORY_MAX_POSTINGS * sizeof(EntityTxHistoryPosting) bytes.
+    static void respond(Peer* peer, unsigned int dejavu, int spectrumIndex, unsigned int numberOfSpectrumReorganizations, const RequestEntityTxHistory& request, unsigned char* buffer)
+    {
+        RespondEntityTxHistory* response = (RespondEntityTxHistory*)buffer;
+        EntityTxHistoryPosting* postings = (EntityTxHistoryPosting*)(response + 1);
+        setMem(response, sizeof(RespondEntityTxHistory), 0);
+        response->publicKey = request.publicKey;
+        unsigned int numberOfPostings = 0;
+
+        ACQUIRE(lock);
+        if (numberOfSpectrumReorganizations != spectrumReorganizations)
+        {
+            // spectrum has been reorganized after lookup, or index has not been cleared yet after reorganization
+            RELEASE(lock);
+            response->numberOfPostings = 0;
+            enqueueResponse(peer, sizeof(RespondEntityTxHistory), RespondEntityTxHistory::type, dejavu, buffer);
+            return;
+        }
+        response->indexedFromTick = indexedFromTick;
+        response->indexedToTick = indexedToTick;
+        const unsigned int lastTick = (request.lastTick < indexedToTick) ? request.lastTick : indexedToTick;
+        if (spectrumIndex >= 0 && newestChunks && request.firstTick <= lastTick)
+        {
+            // index of first posting of the oldest tick in the page, for dropping the tick if it does not fit completely
+            unsigned int firstPostingOfTick = 0;
+            bool done = false;
+            for (unsigned int chunkIndex = newestChunks[spectrumIndex]; chunkIndex && !done; chunkIndex = chunks[chunkIndex].previous)
+            {
+                const EntityTxHistoryChunk& chunk = chunks[chunkIndex];
+                if (chunk.firstTick > lastTick)
+                {
+                    continue;
+                }
+                if (chunk.lastTick < request.firstTick)
+                {
+                    break;
+                }
+
+                EntityTxHistoryPosting decoded[sizeof(EntityTxHistoryChunk::data)];
+                for (unsigned int i = decodeChunk(chunk, decoded); i-- > 0; )
+                {
+                    const EntityTxHistoryPosting& posting = decoded[i];
+                    if (posting.tick > lastTick)
+                    {
+                        continue;
+                    }
+                    if (posting.tick < request.firstTick)
+                    {
+                        done = true;
+                        break;
+                    }
+                    if (numberOfPostings == ENTITY_TX_HISTORY_MAX_POSTINGS)
+                    {
+                        if (posting.tick == postings[numberOfPostings - 1].tick)
+                        {
+                            numberOfPostings = firstPostingOfTick;
+                        }
+                        response->nextLastTick = posting.tick;
+                        done = true;
+                        break;
+                    }
+                    if (!numberOfPostings || posting.tick != postings[numberOfPostings - 1].tick)
+                    {
+                        firstPostingOfTick = numberOfPostings;
+                    }
+                    postings[numberOfPostings++] = posting;
+                }
+            }
+        }
+        RELEASE(lock);
+
+        response->numberOfPostings = numberOfPostings;
+        enqueueResponse(peer, sizeof(RespondEntityTxHistory) + numberOfPostings * sizeof(EntityTxHistoryPosting), RespondEntityTxHistory::type, dejavu, buffer);
+    }
+
+    // Return number of chunks used by the index (for monitoring)
+    static unsigned int getNumberOfUsedChunks()
+    {
+        return numberOfUsedChunks;
+    }
+};
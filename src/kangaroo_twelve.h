@@ -2518,14 +2518,8 @@ static constexpr unsigned int RANDOM2_POOL_ACTUAL_SIZE = 1048576;
 static constexpr unsigned int RANDOM2_POOL_SIZE = RANDOM2_POOL_ACTUAL_SIZE + 24;  // Need a multiple of 200
 static_assert(RANDOM2_POOL_SIZE % 200 == 0, "Random2: pool buffer size must be a multiple of 200");
 
-// Provide the pool buffer from outside
-static void random2(
-    const unsigned char* publicKey,
-    const unsigned char* nonce,
-    unsigned char* output,
-    unsigned long long outputSize, // outputSize must be a multiple of 8
-    unsigned char* poolBuffer // intermediate buffer that have size of RANDOM2_POOL_SIZE
-)
+// Fill the pool buffer of RANDOM2_POOL_SIZE bytes that random2 draws its output from
+static void random2Pool(const unsigned char* publicKey, const unsigned char* nonce, unsigned char* poolBuffer)
 {
     unsigned char state[200];
     *((__m256i*) & state[0]) = *((__m256i*)publicKey);
@@ -2537,7 +2531,183 @@ static void random2(
         KeccakP1600_Permute_12rounds(state);
         copyMem(&poolBuffer[i], state, sizeof(state));
     }
+}
+
+// Number of random2 pools that are generated in parallel by random2PoolLanes(), one Keccak state per SIMD lane
+#if defined (__AVX512F__)
+#define RANDOM2_LANES 8
+#elif defined (__AVX2__)
+#define RANDOM2_LANES 4
+#else
+#define RANDOM2_LANES 1
+#endif
 
+#if RANDOM2_LANES > 1
+
+#if RANDOM2_LANES == 8
+typedef __m512i Random2Lanes;
+#define LANES_LOAD(p) _mm512_loadu_si512(p)
+#define LANES_STORE(p, a) _mm512_storeu_si512(p, a)
+#define LANES_SET1(x) _mm512_set1_epi64(x)
+#define LANES_XOR(a, b) _mm512_xor_si512(a, b)
+#define LANES_XOR5(a, b, c, d, e) _mm512_ternarylogic_epi64(_mm512_ternarylogic_epi64(a, b, c, 0x96), d, e, 0x96)
+#define LANES_ROL(a, n) _mm512_rol_epi64(a, n)
+#define LANES_CHI(a, b, c) _mm512_ternarylogic_epi64(a, b, c, 0xD2) // a ^ (~b & c)
+#else
+typedef __m256i Random2Lanes;
+#define LANES_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define LANES_STORE(p, a) _mm256_storeu_si256((__m256i*)(p), a)
+#define LANES_SET1(x) _mm256_set1_epi64x(x)
+#define LANES_XOR(a, b) _mm256_xor_si256(a, b)
+#define LANES_XOR5(a, b, c, d, e) _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(c, d)), e)
+#define LANES_ROL(a, n) _mm256_or_si256(_mm256_slli_epi64(a, n), _mm256_srli_epi64(a, 64 - (n)))
+#define LANES_CHI(a, b, c) _mm256_xor_si256(a, _mm256_andnot_si256(b, c))
+#endif
+
+// Keccak-p[1600, 12] on RANDOM2_LANES independent states, A[i] holds word i of all states
+static void KeccakP1600Lanes_Permute_12rounds(Random2Lanes* A)
+{
+    static const unsigned long long roundConstants[12] = {
+        KeccakF1600RoundConstant0, KeccakF1600RoundConstant1, KeccakF1600RoundConstant2, KeccakF1600RoundConstant3,
+        KeccakF1600RoundConstant4, KeccakF1600RoundConstant5, KeccakF1600RoundConstant6, KeccakF1600RoundConstant7,
+        KeccakF1600RoundConstant8, KeccakF1600RoundConstant9, KeccakF1600RoundConstant10, 0x8000000080008008ULL
+    };
+    Random2Lanes B[25], C[5], D[5];
+    for (int round = 0; round < 12; round++)
+    {
+        // theta
+        C[0] = LANES_XOR5(A[0], A[5], A[10], A[15], A[20]);
+        C[1] = LANES_XOR5(A[1], A[6], A[11], A[16], A[21]);
+        C[2] = LANES_XOR5(A[2], A[7], A[12], A[17], A[22]);
+        C[3] = LANES_XOR5(A[3], A[8], A[13], A[18], A[23]);
+        C[4] = LANES_XOR5(A[4], A[9], A[14], A[19], A[24]);
+        D[0] = LANES_XOR(C[4], LANES_ROL(C[1], 1));
+        D[1] = LANES_XOR(C[0], LANES_ROL(C[2], 1));
+        D[2] = LANES_XOR(C[1], LANES_ROL(C[3], 1));
+        D[3] = LANES_XOR(C[2], LANES_ROL(C[4], 1));
+        D[4] = LANES_XOR(C[3], LANES_ROL(C[0], 1));
+
+        // rho and pi
+        B[0] = LANES_XOR(A[0], D[0]);
+        B[10] = LANES_ROL(LANES_XOR(A[1], D[1]), 1);
+        B[20] = LANES_ROL(LANES_XOR(A[2], D[2]), 62);
+        B[5] = LANES_ROL(LANES_XOR(A[3], D[3]), 28);
+        B[15] = LANES_ROL(LANES_XOR(A[4], D[4]), 27);
+        B[16] = LANES_ROL(LANES_XOR(A[5], D[0]), 36);
+        B[1] = LANES_ROL(LANES_XOR(A[6], D[1]), 44);
+        B[11] = LANES_ROL(LANES_XOR(A[7], D[2]), 6);
+        B[21] = LANES_ROL(LANES_XOR(A[8], D[3]), 55);
+        B[6] = LANES_ROL(LANES_XOR(A[9], D[4]), 20);
+        B[7] = LANES_ROL(LANES_XOR(A[10], D[0]), 3);
+        B[17] = LANES_ROL(LANES_XOR(A[11], D[1]), 10);
+        B[2] = LANES_ROL(LANES_XOR(A[12], D[2]), 43);
+        B[12] = LANES_ROL(LANES_XOR(A[13], D[3]), 25);
+        B[22] = LANES_ROL(LANES_XOR(A[14], D[4]), 39);
+        B[23] = LANES_ROL(LANES_XOR(A[15], D[0]), 41);
+        B[8] = LANES_ROL(LANES_XOR(A[16], D[1]), 45);
+        B[18] = LANES_ROL(LANES_XOR(A[17], D[2]), 15);
+        B[3] = LANES_ROL(LANES_XOR(A[18], D[3]), 21);
+        B[13] = LANES_ROL(LANES_XOR(A[19], D[4]), 8);
+        B[14] = LANES_ROL(LANES_XOR(A[20], D[0]), 18);
+        B[24] = LANES_ROL(LANES_XOR(A[21], D[1]), 2);
+        B[9] = LANES_ROL(LANES_XOR(A[22], D[2]), 61);
+        B[19] = LANES_ROL(LANES_XOR(A[23], D[3]), 56);
+        B[4] = LANES_ROL(LANES_XOR(A[24], D[4]), 14);
+
+        // chi and iota
+        A[0] = LANES_CHI(B[0], B[1], B[2]);
+        A[1] = LANES_CHI(B[1], B[2], B[3]);
+        A[2] = LANES_CHI(B[2], B[3], B[4]);
+        A[3] = LANES_CHI(B[3], B[4], B[0]);
+        A[4] = LANES_CHI(B[4], B[0], B[1]);
+        A[5] = LANES_CHI(B[5], B[6], B[7]);
+        A[6] = LANES_CHI(B[6], B[7], B[8]);
+        A[7] = LANES_CHI(B[7], B[8], B[9]);
+        A[8] = LANES_CHI(B[8], B[9], B[5]);
+        A[9] = LANES_CHI(B[9], B[5], B[6]);
+        A[10] = LANES_CHI(B[10], B[11], B[12]);
+        A[11] = LANES_CHI(B[11], B[12], B[13]);
+        A[12] = LANES_CHI(B[12], B[13], B[14]);
+        A[13] = LANES_CHI(B[13], B[14], B[10]);
+        A[14] = LANES_CHI(B[14], B[10], B[11]);
+        A[15] = LANES_CHI(B[15], B[16], B[17]);
+        A[16] = LANES_CHI(B[16], B[17], B[18]);
+        A[17] = LANES_CHI(B[17], B[18], B[19]);
+        A[18] = LANES_CHI(B[18], B[19], B[15]);
+        A[19] = LANES_CHI(B[19], B[15], B[16]);
+        A[20] = LANES_CHI(B[20], B[21], B[22]);
+        A[21] = LANES_CHI(B[21], B[22], B[23]);
+        A[22] = LANES_CHI(B[22], B[23], B[24]);
+        A[23] = LANES_CHI(B[23], B[24], B[20]);
+        A[24] = LANES_CHI(B[24], B[20], B[21]);
+        A[0] = LANES_XOR(A[0], LANES_SET1(roundConstants[round]));
+    }
+}
+
+#endif
+
+// Fill the pool buffers of count solutions, which gives the same result as calling random2Pool() for each of them.
+// Up to RANDOM2_LANES pools are generated at once in SIMD lanes, a single remaining pool is generated with the scalar code.
+static void random2PoolLanes(const unsigned char* const* publicKeys, const unsigned char* const* nonces, unsigned char* const* poolBuffers, unsigned int count)
+{
+#if RANDOM2_LANES > 1
+    while (count > 1)
+    {
+        const unsigned int lanes = (count < RANDOM2_LANES) ? count : RANDOM2_LANES;
+
+        // words[i][lane] is word i of the state of lane, unused lanes are zero and not stored
+        unsigned long long words[25][RANDOM2_LANES];
+        setMem(words, sizeof(words), 0);
+        for (unsigned int lane = 0; lane < lanes; lane++)
+        {
+            for (unsigned int i = 0; i < 4; i++)
+            {
+                words[i][lane] = ((const unsigned long long*)publicKeys[lane])[i];
+                words[i + 4][lane] = ((const unsigned long long*)nonces[lane])[i];
+            }
+        }
+        Random2Lanes state[25];
+        for (unsigned int i = 0; i < 25; i++)
+        {
+            state[i] = LANES_LOAD(words[i]);
+        }
+
+        for (unsigned int offset = 0; offset < RANDOM2_POOL_SIZE; offset += 200)
+        {
+            KeccakP1600Lanes_Permute_12rounds(state);
+            for (unsigned int i = 0; i < 25; i++)
+            {
+                LANES_STORE(words[i], state[i]);
+            }
+            for (unsigned int lane = 0; lane < lanes; lane++)
+            {
+                unsigned long long* pool = (unsigned long long*)(poolBuffers[lane] + offset);
+                for (unsigned int i = 0; i < 25; i++)
+                {
+                    pool[i] = words[i][lane];
+                }
+            }
+        }
+
+        publicKeys += lanes;
+        nonces += lanes;
+        poolBuffers += lanes;
+        count -= lanes;
+    }
+#endif
+    for (unsigned int i = 0; i < count; i++)
+    {
+        random2Pool(publicKeys[i], nonces[i], poolBuffers[i]);
+    }
+}
+
+// Generate the output of random2 from a pool buffer filled by random2Pool() or random2PoolLanes()
+static void random2FromPool(
+    const unsigned char* poolBuffer,
+    unsigned char* output,
+    unsigned long long outputSize // outputSize must be a multiple of 8
+)
+{
     unsigned int x = 0; // The same sequence is always used, exploit this for optimization
     for (unsigned long long i = 0; i < outputSize; i += 8)
     {
@@ -2545,3 +2715,16 @@ static void random2(
         x = x * 1664525 + 1013904223;// https://en.wikipedia.org/wiki/Linear_congruential_generator#Parameters_in_common_use
     }
 }
+
+// Provide the pool buffer from outside
+static void random2(
+    const unsigned char* publicKey,
+    const unsigned char* nonce,
+    unsigned char* output,
+    unsigned long long outputSize, // outputSize must be a multiple of 8
+    unsigned char* poolBuffer // intermediate buffer that have size of RANDOM2_POOL_SIZE
+)
+{
+    random2Pool(publicKey, nonce, poolBuffer);
+    random2FromPool(poolBuffer, output, outputSize);
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "logging/logging.h"
+#include "platform/file_io.h"
+
+
+#if ENABLED_LOGGING && LOG_PERSIST_TO_DISK
+// Get file name "logSSSSS.EEE" of segment
+static void getLogSegmentFileName(CHAR16* fileName, unsigned int segment, unsigned short epoch)
+{
+    setText(fileName, L"log00000.000");
+    for (int i = 7; i >= 3; i--)
+    {
+        fileName[i] = segment % 10 + L'0';
+        segment /= 10;
+    }
+    addEpochToFileName(fileName, 13, epoch);
+}
+#endif
+
+void qLogger::processDiskStorage()
+{
+#if ENABLED_LOGGING && LOG_PERSIST_TO_DISK
+    CHAR16 fileName[16];
+
+    // save one sealed segment per call to keep main loop responsive
+    ACQUIRE(logSegmentsLock);
+    const unsigned int segmentToPersist = nextSegmentToPersist;
+    const bool persistSegment = segmentToPersist < currentSegment;
+    RELEASE(logSegmentsLock);
+    if (persistSegment)
+    {
+        LogSegment& seg = getSegment(segmentToPersist);
+        ASSERT(seg.number == segmentToPersist && seg.state == SEGMENT_SEALED);
+        getLogSegmentFileName(fileName, segmentToPersist, seg.epoch);
+        const char* segmentData = logBuffer + (segmentToPersist % LOG_NUMBER_OF_RAM_SEGMENTS) * LOG_SEGMENT_SIZE;
+        if (save(fileName, seg.size, (const unsigned char*)segmentData, LOG_DIRECTORY) == (long long)seg.size)
+        {
+            ACQUIRE(logSegmentsLock);
+            seg.state = SEGMENT_PERSISTED;
+            nextSegmentToPersist = segmentToPersist + 1;
+            RELEASE(logSegmentsLock);
+            numberOfFailedSegmentSaves = 0;
+        }
+        else if (numberOfFailedSegmentSaves++ == 0)
+        {
+            // retried in the next call, the tick processor waits before the RAM of the segment is reused
+            logToConsole(L"Failed to save log segment, retrying! Logging will stall if saving keeps failing.");
+        }
+    }
+
+    // load segment requested by first pending request and respond to all pending requests of this segment
+    ACQUIRE(logDiskCacheLock);
+    if (!numberOfPendingDiskRequests)
+    {
+        RELEASE(logDiskCacheLock);
+
+        // otherwise load segment needed by lagging subscribers, processSubscriptions() pushes from it in its next call
+        if (subscriptionDiskSegment >= 0)
+        {
+            loadSegmentToDiskCache((unsigned int)subscriptionDiskSegment);
+            subscriptionDiskSegment = -1;
+        }
+        return;
+    }
+    const unsigned int segmentToLoad = pendingDiskRequests[0].segment;
+    RELEASE(logDiskCacheLock);
+
+    loadSegmentToDiskCache(segmentToLoad);
+
+    PendingDiskRequest requests[LOG_MAX_PENDING_DISK_REQUESTS];
+    unsigned int numberOfRequests = 0;
+    ACQUIRE(logDiskCacheLock);
+    unsigned int remaining = 0;
+    for (unsigned int i = 0; i < numberOfPendingDiskRequests; i++)
+    {
+        if (pendingDiskRequests[i].segment == segmentToLoad)
+            requests[numberOfRequests++] = pendingDiskRequests[i];
+        else
+            pendingDiskRequests[remaining++] = pendingDiskRequests[i];
+    }
+    numberOfPendingDiskRequests = remaining;
+    RELEASE(logDiskCacheLock);
+
+    // if loading failed, an empty response is sent (but not to another connection that uses the peer slot now)
+    for (unsigned int i = 0; i < numberOfRequests; i++)
+    {
+        if (isPeerConnectionActive(requests[i].peer, requests[i].connection))
+        {
+            respondLog(requests[i].peer, requests[i].dejavu, requests[i].fromID, requests[i].toID, false);
+        }
+    }
+#endif
+}
+
+bool qLogger::loadSegmentToDiskCache(unsigned int segment)
+{
+#if ENABLED_LOGGING && LOG_PERSIST_TO_DISK
+    ACQUIRE(logDiskCacheLock);
+    if (logDiskCacheSegment == segment)
+    {
+        RELEASE(logDiskCacheLock);
+        return true;
+    }
+    logDiskCacheSegment = -1;
+    RELEASE(logDiskCacheLock);
+
+    const LogSegment& seg = getSegment(segment);
+    if (seg.number != segment || seg.state != SEGMENT_PERSISTED)
+    {
+        return false;
+    }
+    CHAR16 fileName[16];
+    getLogSegmentFileName(fileName, segment, seg.epoch);
+    if (load(fileName, seg.size, (unsigned char*)logDiskCache, LOG_DIRECTORY) != (long long)seg.size)
+    {
+        return false;
+    }
+
+    ACQUIRE(logDiskCacheLock);
+    logDiskCacheSegment = segment;
+    RELEASE(logDiskCacheLock);
+    return true;
+#else
+    return false;
+#endif
+}
@@ -3,6 +3,7 @@
 #include "platform/m256.h"
 #include "platform/concurrency.h"
 #include "platform/time.h"
+#include "platform/time_stamp_counter.h"
 #include "platform/memory.h"
 #include "platform/debugging.h"
 
@@ -29,7 +30,28 @@ struct Peer;
 #ifndef LOG_BUFFER_SIZE
 #define LOG_BUFFER_SIZE 8589934592ULL // 8GiB
 #endif
-#define LOG_MAX_STORAGE_ENTRIES (LOG_BUFFER_SIZE / sizeof(QuTransfer)) // Adjustable: here we assume most of logs are just qu transfer
+#define LOG_SEGMENT_SIZE 67108864ULL // 64MiB, logs are stored in segments that are persisted to disk as a whole
+#define LOG_NUMBER_OF_RAM_SEGMENTS (LOG_BUFFER_SIZE / LOG_SEGMENT_SIZE)
+#define LOG_MAX_NUMBER_OF_SEGMENTS 4096 // max number of segments per epoch that can be accessed (256 GiB)
+#if LOG_PERSIST_TO_DISK
+#define LOG_STORAGE_SIZE (LOG_MAX_NUMBER_OF_SEGMENTS * LOG_SEGMENT_SIZE)
+#else
+#define LOG_STORAGE_SIZE LOG_BUFFER_SIZE
+#endif
+#define LOG_MAX_STORAGE_ENTRIES (LOG_STORAGE_SIZE / sizeof(QuTransfer)) // Adjustable: here we assume most of logs are just qu transfer
+#define LOG_INDEX_SPARSENESS 256 // position is only indexed for every LOG_INDEX_SPARSENESS-th log ID
+#define LOG_INDEX_CAPACITY (LOG_MAX_STORAGE_ENTRIES / LOG_INDEX_SPARSENESS)
+#define LOG_MAX_PENDING_DISK_REQUESTS 16
+#define LOG_DIRECTORY L"logs"
+#define LOG_FILTER_BLOOM_SIZE 128 // bytes of per-tick bloom filter of entities occurring in the logs of the tick
+#define LOG_FILTER_MAX_PUBLIC_KEYS 4096
+#define LOG_FILTER_RESPONSE_BUFFER_SIZE 1048576
+#define LOG_FILTER_NUMBER_OF_RESPONSE_BUFFERS 4
+#define LOG_MAX_NUMBER_OF_SUBSCRIPTIONS 16
+#define LOG_SUBSCRIPTION_MAX_UNACKNOWLEDGED_MESSAGES 16
+#define LOG_SUBSCRIPTION_ACK_TIMEOUT 10 // seconds without acknowledgement after which unacknowledged messages are sent again
+static_assert(LOG_BUFFER_SIZE % LOG_SEGMENT_SIZE == 0, "LOG_BUFFER_SIZE must be a multiple of LOG_SEGMENT_SIZE");
+static_assert(LOG_NUMBER_OF_RAM_SEGMENTS >= 2 && LOG_NUMBER_OF_RAM_SEGMENTS <= LOG_MAX_NUMBER_OF_SEGMENTS, "Invalid LOG_BUFFER_SIZE");
 #define LOG_TX_NUMBER_OF_SPECIAL_EVENT 5
 #define LOG_TX_PER_TICK (NUMBER_OF_TRANSACTIONS_PER_TICK + LOG_TX_NUMBER_OF_SPECIAL_EVENT)// +5 special events
 #define LOG_TX_INFO_STORAGE (MAX_NUMBER_OF_TICKS_PER_EPOCH * LOG_TX_PER_TICK) 
@@ -105,6 +127,79 @@ struct ResponseAllLogIdRangesFromTick
     };
 };
 
+// Fetches logs of range that match all given filters
+struct RequestFilteredLog
+{
+    unsigned long long passcode[4];
+    unsigned long long fromID;
+    unsigned long long toID; // inclusive
+    unsigned long long messageTypes; // bit t set = include message type t (bit 63 for CUSTOM_MESSAGE), all bits set = any type
+    unsigned int contractIndex; // only contract messages of this contract, 0xffffffff = no contract filter
+    unsigned int numberOfPublicKeys; // only logs with one of the public keys, 0 = no entity filter (max LOG_FILTER_MAX_PUBLIC_KEYS)
+
+    // Followed by numberOfPublicKeys public keys (m256i)
+
+    enum {
+        type = 52,
+    };
+};
+
+
+// Response to RequestFilteredLog, only contains logs of one segment
+struct RespondFilteredLog
+{
+    unsigned long long nextID; // all logs before nextID were checked, request again with fromID = nextID for the rest
+
+    // Followed by matching logs (same format as in RespondLog)
+
+    enum {
+        type = 53,
+    };
+};
+
+// Subscribe to new logs of completed ticks, which are pushed with RespondLogSubscription (replaces previous subscription of peer).
+// The subscription ends if the connection is closed or a new epoch starts, after reconnect it can be resumed by subscribing with
+// fromID = last nextID. There is no response if the subscription is accepted, an empty RespondLogSubscription if it is rejected.
+struct RequestLogSubscription
+{
+    unsigned long long passcode[4];
+    unsigned long long fromID;
+    unsigned long long messageTypes; // see RequestFilteredLog
+    unsigned int maxUnacknowledgedMessages; // flow control (max LOG_SUBSCRIPTION_MAX_UNACKNOWLEDGED_MESSAGES), 0 = unsubscribe
+    unsigned int _padding;
+
+    enum {
+        type = 54,
+    };
+};
+
+
+// Pushed to subscriber with dejavu of RequestLogSubscription
+struct RespondLogSubscription
+{
+    unsigned long long fromID; // > nextID of previous message if logs are not available anymore, < if unacknowledged messages are sent again
+    unsigned long long nextID; // all logs before nextID were checked
+
+    // Followed by logs matching messageTypes (same format as in RespondLog)
+
+    enum {
+        type = 55,
+    };
+};
+
+
+// Confirm receipt of RespondLogSubscription, the node does not push more than maxUnacknowledgedMessages ahead. If there is no
+// acknowledgement for LOG_SUBSCRIPTION_ACK_TIMEOUT seconds, the node pushes again starting with the last acknowledged nextID.
+struct AcknowledgeLogSubscription
+{
+    unsigned long long passcode[4];
+    unsigned long long nextID; // nextID of last RespondLogSubscription processed
+
+    enum {
+        type = 56,
+    };
+};
+
 #define QU_TRANSFER 0
 #define ASSET_ISSUANCE 1
 #define ASSET_OWNERSHIP_CHANGE 2
@@ -272,10 +367,102 @@ public:
         long long length;
     };
 
+    // Logs are appended to segments of LOG_SEGMENT_SIZE bytes, which are stored in the RAM ring buffer logBuffer
+    // (holding the latest LOG_NUMBER_OF_RAM_SEGMENTS segments). A log never spans two segments. If LOG_PERSIST_TO_DISK
+    // is enabled, the main loop saves sealed (full) segments to disk and logs that are not in RAM anymore are loaded
+    // from there on request. No sealed segment is dropped: before the RAM of a segment is reused, the writer waits until
+    // the main loop has saved it (a failed save is retried), so logging is slowed down to the speed of saving instead of
+    // losing logs. With LOG_PERSIST_TO_DISK, segment numbers continue in the next epoch, so the last segments of an
+    // epoch can still be saved after the logger has been reset.
+    struct LogSegment
+    {
+        unsigned long long firstLogId;
+        volatile unsigned long long size;
+        unsigned int number; // segment number within epoch, to detect outdated entries in logSegments ring
+        unsigned short epoch;
+        volatile unsigned char state;
+    };
+
+    enum
+    {
+        SEGMENT_UNUSED = 0,
+        SEGMENT_OPEN = 1,
+        SEGMENT_SEALED = 2,
+        SEGMENT_PERSISTED = 3,
+    };
+
+    struct PendingDiskRequest
+    {
+        Peer* peer;
+        void* connection; // to detect that peer slot is used by another connection
+        unsigned int dejavu;
+        unsigned int segment;
+        unsigned long long fromID;
+        unsigned long long toID;
+    };
+
+    // Summary of the logs of a tick for skipping ticks without matching logs in RequestFilteredLog. Filled by logMessage()
+    // before a log is written and numberOfLogs is incremented, so it never misses logs counted in numberOfLogs.
+    struct TickLogFilter
+    {
+        unsigned long long firstLogId;
+        volatile unsigned int numberOfLogs; // 0xffffffff if logs of tick are not consecutive (filter cannot be used for skipping)
+        unsigned int tick; // 0 if unused
+        unsigned long long messageTypes;
+        unsigned char entityBloom[LOG_FILTER_BLOOM_SIZE];
+    };
+
     inline static char* logBuffer = NULL;
     inline static BlobInfo* mapTxToLogId = NULL;
-    inline static BlobInfo* mapLogIdToBufferIndex = NULL;
-    inline static unsigned long long logBufferTail;
+    inline static unsigned long long* logIdIndex = NULL; // position of every LOG_INDEX_SPARSENESS-th log ID (ring)
+    inline static LogSegment* logSegments = NULL; // ring of LOG_MAX_NUMBER_OF_SEGMENTS entries
+    inline static unsigned long long logBufferTail; // position of next log, segment number * LOG_SEGMENT_SIZE + offset
+    inline static volatile unsigned int currentSegment;
+    inline static unsigned int firstSegmentOfEpoch;
+    inline static volatile unsigned int nextSegmentToPersist;
+    inline static unsigned int numberOfFailedSegmentSaves; // failed attempts to save segment nextSegmentToPersist
+    inline static volatile char logSegmentsLock = 0;
+
+    // Segment loaded from disk (only used with LOG_PERSIST_TO_DISK)
+    inline static char* logDiskCache = NULL;
+    inline static volatile long long logDiskCacheSegment = -1;
+    inline static PendingDiskRequest pendingDiskRequests[LOG_MAX_PENDING_DISK_REQUESTS];
+    inline static unsigned int numberOfPendingDiskRequests = 0;
+    inline static long long subscriptionDiskSegment = -1; // segment to load for lagging subscribers, only used by main loop
+    inline static volatile char logDiskCacheLock = 0;
+
+    struct LogSubscription
+    {
+        Peer* peer; // NULL if unused
+        void* connection; // to detect that peer slot is used by another connection
+        unsigned int dejavu;
+        unsigned int maxUnacknowledgedMessages;
+        unsigned long long messageTypes;
+        unsigned long long nextID;
+        unsigned long long unacknowledgedNextIDs[LOG_SUBSCRIPTION_MAX_UNACKNOWLEDGED_MESSAGES]; // ring buffer
+        unsigned int firstUnacknowledged;
+        unsigned int numberOfUnacknowledged;
+        unsigned long long acknowledgedNextID; // pushing is restarted here if acknowledgement times out
+        unsigned long long waitingForAcknowledgementSince; // __rdtsc() of first push or last acknowledgement
+    };
+
+    // Bloom filter bits and candidates of the requested public keys of RequestFilteredLog, too large for the stack of the
+    // request processors (one per processor)
+    struct FilterKeys
+    {
+        unsigned short keyBloomBits[LOG_FILTER_MAX_PUBLIC_KEYS][2];
+        unsigned short candidates[LOG_FILTER_MAX_PUBLIC_KEYS];
+    };
+
+    inline static TickLogFilter* tickLogFilters = NULL; // one per tick of epoch
+    inline static FilterKeys filterKeys[MAX_NUMBER_OF_PROCESSORS];
+    inline static char* filterResponseBuffers[LOG_FILTER_NUMBER_OF_RESPONSE_BUFFERS];
+    inline static volatile char filterResponseBufferLocks[LOG_FILTER_NUMBER_OF_RESPONSE_BUFFERS];
+
+    inline static LogSubscription logSubscriptions[LOG_MAX_NUMBER_OF_SUBSCRIPTIONS];
+    inline static volatile char logSubscriptionsLock = 0;
+    inline static volatile unsigned long long endLogIdOfCompletedTicks; // only logs before are pushed to subscribers
+
     inline static unsigned long long logId;
     inline static unsigned int tickBegin;
     inline static unsigned int currentTxId;
@@ -337,44 +524,94 @@ public:
     }
 
 #if ENABLED_LOGGING
-    // Struct to map log buffer from log id    
-    static struct mapLogIdToBuffer
+    static LogSegment& getSegment(unsigned int segment)
     {
-        static void init()
+        return logSegments[segment % LOG_MAX_NUMBER_OF_SEGMENTS];
+    }
+
+    // Return pointer to data of segment if it is still in logBuffer, otherwise NULL
+    static const char* getRamSegmentData(unsigned int segment)
+    {
+        const unsigned int current = currentSegment;
+        const LogSegment& seg = getSegment(segment);
+        if (seg.number != segment || seg.state == SEGMENT_UNUSED || segment < firstSegmentOfEpoch || segment > current || segment + LOG_NUMBER_OF_RAM_SEGMENTS <= current)
         {
-            BlobInfo null_blob{ -1,-1 };
-            for (unsigned long long i = 0; i < LOG_MAX_STORAGE_ENTRIES; i++)
-            {
-                mapLogIdToBufferIndex[i] = null_blob;
-            }
+            return NULL;
         }
-        static long long getIndex(unsigned long long logId)
+        return logBuffer + (segment % LOG_NUMBER_OF_RAM_SEGMENTS) * LOG_SEGMENT_SIZE;
+    }
+
+    // Find segment containing log, also returning offset and ID of a log in this segment that is not after the log searched
+    static bool locateLog(unsigned long long logId, unsigned int& segment, unsigned long long& offset, unsigned long long& offsetLogId)
+    {
+        if (logId >= qLogger::logId)
         {
-            BlobInfo res = mapLogIdToBufferIndex[logId % LOG_MAX_STORAGE_ENTRIES];
-            if (verifyLog(logBuffer + res.startIndex, logId))
-            {
-                return res.startIndex;
-            }
-            return -1;
+            return false;
+        }
+        const unsigned long long indexedLogId = logId - logId % LOG_INDEX_SPARSENESS;
+        const unsigned long long position = logIdIndex[(logId / LOG_INDEX_SPARSENESS) % LOG_INDEX_CAPACITY];
+        if (position == 0xffffffffffffffffULL)
+        {
+            return false;
+        }
+        segment = (unsigned int)(position / LOG_SEGMENT_SIZE);
+        offset = position % LOG_SEGMENT_SIZE;
+        offsetLogId = indexedLogId;
+        if (getSegment(segment).number != segment || getSegment(segment).firstLogId > indexedLogId)
+        {
+            return false;
         }
 
-        static BlobInfo getBlobInfo(unsigned long long logId)
+        // the log may be in one of the following segments
+        const unsigned int current = currentSegment;
+        while (segment < current)
         {
-            BlobInfo res = mapLogIdToBufferIndex[logId % LOG_MAX_STORAGE_ENTRIES];
-            if (verifyLog(logBuffer + res.startIndex, logId))
+            const LogSegment& nextSeg = getSegment(segment + 1);
+            if (nextSeg.number != segment + 1 || nextSeg.firstLogId > logId)
             {
-                return res;
+                break;
             }
-            return BlobInfo{ -1,-1 };
+            segment++;
+            offset = 0;
+            offsetLogId = nextSeg.firstLogId;
+        }
+        return true;
+    }
+
+    // Return offset of log in segment data by walking from offset with ID offsetLogId, or -1 if not found / invalid
+    static long long findLogInSegment(const char* segmentData, unsigned long long segmentSize, unsigned long long offset, unsigned long long offsetLogId, unsigned long long logId)
+    {
+        while (offsetLogId < logId && offset + LOG_HEADER_SIZE <= segmentSize)
+        {
+            offset += LOG_HEADER_SIZE + getLogSize(segmentData + offset);
+            offsetLogId++;
         }
+        if (offset + LOG_HEADER_SIZE > segmentSize
+            || offset + LOG_HEADER_SIZE + getLogSize(segmentData + offset) > segmentSize
+            || !verifyLog(segmentData + offset, logId))
+        {
+            return -1;
+        }
+        return offset;
+    }
 
-        static void set(unsigned long long logId, long long index, long long length)
+    // Return pointer to log (starting with header) if it is in RAM, otherwise NULL
+    static const char* getLog(unsigned long long logId)
+    {
+        unsigned int segment;
+        unsigned long long offset, offsetLogId;
+        if (!locateLog(logId, segment, offset, offsetLogId))
+        {
+            return NULL;
+        }
+        const char* segmentData = getRamSegmentData(segment);
+        if (!segmentData)
         {
-            BlobInfo& res = mapLogIdToBufferIndex[logId % LOG_MAX_STORAGE_ENTRIES];
-            res.startIndex = index;
-            res.length = length;
+            return NULL;
         }
-    } logBuf;
+        const long long logOffset = findLogInSegment(segmentData, getSegment(segment).size, offset, offsetLogId, logId);
+        return (logOffset < 0) ? NULL : segmentData + logOffset;
+    }
 
 
     // Struct to map log id ranges from tx hash
@@ -429,6 +666,145 @@ public:
             }
         }
     } tx;
+
+    // Type bit used in TickLogFilter::messageTypes and RequestFilteredLog::messageTypes
+    static unsigned long long getMessageTypeFlag(unsigned char messageType)
+    {
+        return 1ULL << ((messageType < 63) ? messageType : 63);
+    }
+
+    static unsigned char getLogType(const char* ptr)
+    {
+        // first 6 bytes are: epoch(2) + tick(4)
+        // next 4 bytes are size&type
+        return *((unsigned char*)(ptr + 9));
+    }
+
+    static unsigned int getLogTick(const char* ptr)
+    {
+        return *((unsigned int*)(ptr + 2));
+    }
+
+    // Get i-th entity the log message refers to (contracts as m256i(contractIndex, 0, 0, 0)), return false if there is none
+    static bool getLogEntity(unsigned char messageType, const char* message, unsigned int messageSize, unsigned int i, m256i& publicKey)
+    {
+        unsigned long long offset;
+        switch (messageType)
+        {
+        case QU_TRANSFER:
+            if (i > 1 || messageSize < offsetof(QuTransfer, _terminator))
+                return false;
+            offset = (i == 0) ? offsetof(QuTransfer, sourcePublicKey) : offsetof(QuTransfer, destinationPublicKey);
+            break;
+        case ASSET_ISSUANCE:
+            if (i > 0 || messageSize < offsetof(AssetIssuance, _terminator))
+                return false;
+            offset = offsetof(AssetIssuance, issuerPublicKey);
+            break;
+        case ASSET_OWNERSHIP_CHANGE:
+        case ASSET_POSSESSION_CHANGE:
+            // AssetOwnershipChange and AssetPossessionChange have the same layout
+            if (i > 2 || messageSize < offsetof(AssetOwnershipChange, _terminator))
+                return false;
+            offset = (i == 0) ? offsetof(AssetOwnershipChange, sourcePublicKey) : (i == 1) ? offsetof(AssetOwnershipChange, destinationPublicKey) : offsetof(AssetOwnershipChange, issuerPublicKey);
+            break;
+        case CONTRACT_ERROR_MESSAGE:
+        case CONTRACT_WARNING_MESSAGE:
+        case CONTRACT_INFORMATION_MESSAGE:
+        case CONTRACT_DEBUG_MESSAGE:
+            if (i > 0 || messageSize < sizeof(unsigned int))
+                return false;
+            publicKey = m256i(*((unsigned int*)message), 0, 0, 0);
+            return true;
+        case BURNING:
+            if (i > 0 || messageSize < offsetof(Burning, _terminator))
+                return false;
+            offset = offsetof(Burning, sourcePublicKey);
+            break;
+        case DUST_BURNING:
+            if (messageSize < 2 || i >= *((unsigned short*)message) || 2 + (i + 1) * sizeof(DustBurning::Entity) > messageSize)
+                return false;
+            offset = 2 + i * sizeof(DustBurning::Entity);
+            break;
+        default:
+            return false;
+        }
+        // message may be unaligned
+        copyMem(&publicKey, message + offset, sizeof(m256i));
+        return true;
+    }
+
+    // Return the 2 bit positions of public key in the entity bloom filter of TickLogFilter
+    static void getEntityBloomBits(const m256i& publicKey, unsigned int& bit0, unsigned int& bit1)
+    {
+        const unsigned long long hash = (publicKey.m256i_u64[0] ^ publicKey.m256i_u64[1] ^ publicKey.m256i_u64[2] ^ publicKey.m256i_u64[3]) * 0x9E3779B97F4A7C15ULL;
+        bit0 = (unsigned int)(hash >> 32) % (LOG_FILTER_BLOOM_SIZE * 8);
+        bit1 = (unsigned int)(hash >> 8) % (LOG_FILTER_BLOOM_SIZE * 8);
+    }
+
+    static bool mayContainEntity(const TickLogFilter& filter, const m256i& publicKey)
+    {
+        unsigned int bit0, bit1;
+        getEntityBloomBits(publicKey, bit0, bit1);
+        return (filter.entityBloom[bit0 >> 3] & (1 << (bit0 & 7))) && (filter.entityBloom[bit1 >> 3] & (1 << (bit1 & 7)));
+    }
+
+    // Struct to summarize logs per tick for filtered log requests
+    static struct tickLogFilterAccess
+    {
+        static void init()
+        {
+            setMem(tickLogFilters, MAX_NUMBER_OF_TICKS_PER_EPOCH * sizeof(TickLogFilter), 0);
+        }
+
+        // return filter of tick or NULL if tick has no (usable) filter
+        static const TickLogFilter* get(unsigned int tick)
+        {
+            const unsigned long long tickOffset = tick - tickBegin;
+            if (tickOffset < MAX_NUMBER_OF_TICKS_PER_EPOCH && tickLogFilters[tickOffset].tick == tick)
+            {
+                return &tickLogFilters[tickOffset];
+            }
+            return NULL;
+        }
+
+        // add log that is about to be written with ID logId
+        static void addLog(unsigned int tick, unsigned char messageType, const void* message, unsigned int messageSize)
+        {
+            const unsigned long long tickOffset = tick - tickBegin;
+            if (tickOffset >= MAX_NUMBER_OF_TICKS_PER_EPOCH)
+            {
+                return;
+            }
+            TickLogFilter& filter = tickLogFilters[tickOffset];
+            if (filter.tick != tick)
+            {
+                filter.numberOfLogs = 0;
+                filter.firstLogId = logId;
+                filter.messageTypes = 0;
+                setMem(filter.entityBloom, sizeof(filter.entityBloom), 0);
+                filter.tick = tick;
+            }
+            else if (filter.numberOfLogs != 0xffffffff && filter.firstLogId + filter.numberOfLogs != logId)
+            {
+                filter.numberOfLogs = 0xffffffff;
+            }
+
+            filter.messageTypes |= getMessageTypeFlag(messageType);
+            m256i publicKey;
+            for (unsigned int i = 0; getLogEntity(messageType, (const char*)message, messageSize, i, publicKey); i++)
+            {
+                unsigned int bit0, bit1;
+                getEntityBloomBits(publicKey, bit0, bit1);
+                filter.entityBloom[bit0 >> 3] |= (1 << (bit0 & 7));
+                filter.entityBloom[bit1 >> 3] |= (1 << (bit1 & 7));
+            }
+            if (filter.numberOfLogs != 0xffffffff)
+            {
+                filter.numberOfLogs++;
+            }
+        }
+    } tickFilter;
 #endif
 
     static void registerNewTx(const unsigned int tick, const unsigned int txId)
@@ -438,6 +814,14 @@ public:
 #endif
     }
 
+    // Called by tick processor after all logs of system.tick have been written, making them available to subscribers
+    static void tickCompleted()
+    {
+#if ENABLED_LOGGING
+        endLogIdOfCompletedTicks = logId;
+#endif
+    }
+
 
     static bool initLogging()
     {
@@ -462,15 +846,62 @@ public:
             }
         }
 
-        if (mapLogIdToBufferIndex == NULL)
+        if (logIdIndex == NULL)
+        {
+            if (!allocatePool(LOG_INDEX_CAPACITY * sizeof(unsigned long long), (void**)&logIdIndex))
+            {
+                logToConsole(L"Failed to allocate logging buffer!");
+
+                return false;
+            }
+        }
+
+        if (logSegments == NULL)
+        {
+            if (!allocatePool(LOG_MAX_NUMBER_OF_SEGMENTS * sizeof(LogSegment), (void**)&logSegments))
+            {
+                logToConsole(L"Failed to allocate logging buffer!");
+
+                return false;
+            }
+        }
+
+#if LOG_PERSIST_TO_DISK
+        if (logDiskCache == NULL)
         {
-            if (!allocatePool(LOG_MAX_STORAGE_ENTRIES * sizeof(BlobInfo), (void**)&mapLogIdToBufferIndex))
+            if (!allocatePool(LOG_SEGMENT_SIZE, (void**)&logDiskCache))
             {
                 logToConsole(L"Failed to allocate logging buffer!");
 
                 return false;
             }
         }
+#endif
+
+        if (tickLogFilters == NULL)
+        {
+            if (!allocatePool(MAX_NUMBER_OF_TICKS_PER_EPOCH * sizeof(TickLogFilter), (void**)&tickLogFilters))
+            {
+                logToConsole(L"Failed to allocate logging buffer!");
+
+                return false;
+            }
+        }
+
+        for (unsigned int i = 0; i < LOG_FILTER_NUMBER_OF_RESPONSE_BUFFERS; i++)
+        {
+            if (filterResponseBuffers[i] == NULL)
+            {
+                if (!allocatePool(LOG_FILTER_RESPONSE_BUFFER_SIZE, (void**)&filterResponseBuffers[i]))
+                {
+                    logToConsole(L"Failed to allocate logging buffer!");
+
+                    return false;
+                }
+            }
+            filterResponseBufferLocks[i] = 0;
+        }
+        clearSegments();
         reset(0);
 #endif
         return true;
@@ -489,21 +920,122 @@ public:
             freePool(mapTxToLogId);
             mapTxToLogId = nullptr;
         }
-        if (mapLogIdToBufferIndex)
+        if (logIdIndex)
+        {
+            freePool(logIdIndex);
+            logIdIndex = nullptr;
+        }
+        if (logSegments)
+        {
+            freePool(logSegments);
+            logSegments = nullptr;
+        }
+        if (logDiskCache)
+        {
+            freePool(logDiskCache);
+            logDiskCache = nullptr;
+        }
+        if (tickLogFilters)
         {
-            freePool(mapLogIdToBufferIndex);
-            mapLogIdToBufferIndex = nullptr;
+            freePool(tickLogFilters);
+            tickLogFilters = nullptr;
+        }
+        for (unsigned int i = 0; i < LOG_FILTER_NUMBER_OF_RESPONSE_BUFFERS; i++)
+        {
+            if (filterResponseBuffers[i])
+            {
+                freePool(filterResponseBuffers[i]);
+                filterResponseBuffers[i] = nullptr;
+            }
         }
 #endif
     }
 
+#if ENABLED_LOGGING
+    // Seal current segment (no more logs are added) and start new one at position of logBufferTail
+    static void openNextSegment()
+    {
+        const unsigned int segment = currentSegment + 1;
+
+        ACQUIRE(logSegmentsLock);
+        getSegment(currentSegment).state = SEGMENT_SEALED;
+        RELEASE(logSegmentsLock);
+#if LOG_PERSIST_TO_DISK
+        // wait until the main loop has saved the segment whose RAM is reused (backpressure if saving is slower than logging)
+        if (segment >= LOG_NUMBER_OF_RAM_SEGMENTS)
+        {
+            while (nextSegmentToPersist <= segment - LOG_NUMBER_OF_RAM_SEGMENTS)
+            {
+                _mm_pause();
+            }
+        }
+#endif
+        ACQUIRE(logSegmentsLock);
+        LogSegment& seg = getSegment(segment);
+        seg.state = SEGMENT_UNUSED;
+        seg.number = segment;
+        seg.firstLogId = logId;
+        seg.size = 0;
+        seg.epoch = system.epoch;
+        seg.state = SEGMENT_OPEN;
+        currentSegment = segment;
+        RELEASE(logSegmentsLock);
+        logBufferTail = (unsigned long long)segment * LOG_SEGMENT_SIZE;
+    }
+
+    // Start with empty segment 0 in RAM
+    static void clearSegments()
+    {
+        ACQUIRE(logSegmentsLock);
+        setMem(logSegments, LOG_MAX_NUMBER_OF_SEGMENTS * sizeof(LogSegment), 0);
+        logSegments[0].epoch = system.epoch;
+        logSegments[0].state = SEGMENT_OPEN;
+        currentSegment = 0;
+        firstSegmentOfEpoch = 0;
+        nextSegmentToPersist = 0;
+        numberOfFailedSegmentSaves = 0;
+        RELEASE(logSegmentsLock);
+        logBufferTail = 0;
+    }
+#endif
+
     static void reset(unsigned int _tickBegin)
     {
 #if ENABLED_LOGGING
-        logBuf.init();
+#if LOG_PERSIST_TO_DISK
+        ACQUIRE(logDiskCacheLock);
+        logDiskCacheSegment = -1;
+        numberOfPendingDiskRequests = 0;
+        subscriptionDiskSegment = -1;
+        RELEASE(logDiskCacheLock);
+#endif
         tx.init();
-        logBufferTail = 0;
+        tickFilter.init();
+        ACQUIRE(logSubscriptionsLock);
+        setMem(logSubscriptions, sizeof(logSubscriptions), 0);
+        endLogIdOfCompletedTicks = 0;
+        RELEASE(logSubscriptionsLock);
+        setMem(logIdIndex, LOG_INDEX_CAPACITY * sizeof(unsigned long long), 0xff);
         logId = 0;
+#if LOG_PERSIST_TO_DISK
+        // continue with the next segment instead of overwriting segments of the previous epoch that may not have
+        // been saved yet (the main loop saves them later)
+        if (logBufferTail > (unsigned long long)currentSegment * LOG_SEGMENT_SIZE)
+        {
+            openNextSegment();
+        }
+        else
+        {
+            ACQUIRE(logSegmentsLock);
+            LogSegment& seg = getSegment(currentSegment);
+            seg.firstLogId = 0;
+            seg.epoch = system.epoch;
+            RELEASE(logSegmentsLock);
+        }
+        firstSegmentOfEpoch = currentSegment;
+#else
+        clearSegments();
+#endif
         tickBegin = _tickBegin;
 #endif
     }
@@ -512,20 +1044,27 @@ public:
     {
 #if ENABLED_LOGGING
         tx.addLogId();
-        if (logBufferTail + LOG_HEADER_SIZE + messageSize >= LOG_BUFFER_SIZE)
+        if (logBufferTail + LOG_HEADER_SIZE + messageSize > ((unsigned long long)currentSegment + 1) * LOG_SEGMENT_SIZE)
+        {
+            openNextSegment();
+        }
+        if (logId % LOG_INDEX_SPARSENESS == 0)
         {
-            logBufferTail = 0; // reset back to beginning
+            logIdIndex[(logId / LOG_INDEX_SPARSENESS) % LOG_INDEX_CAPACITY] = logBufferTail;
         }
-        logBuf.set(logId, logBufferTail, LOG_HEADER_SIZE + messageSize);
-        *((unsigned short*)(logBuffer + (logBufferTail))) = system.epoch;
-        *((unsigned int*)(logBuffer + (logBufferTail + 2))) = system.tick;
-        *((unsigned int*)(logBuffer + (logBufferTail + 6))) = messageSize | (messageType << 24);
-        *((unsigned long long*)(logBuffer + (logBufferTail + 10))) = logId++;
+        tickFilter.addLog(system.tick, messageType, message, messageSize);
+        char* logPtr = logBuffer + (logBufferTail % LOG_BUFFER_SIZE);
+        *((unsigned short*)(logPtr)) = system.epoch;
+        *((unsigned int*)(logPtr + 2)) = system.tick;
+        *((unsigned int*)(logPtr + 6)) = messageSize | (messageType << 24);
+        *((unsigned long long*)(logPtr + 10)) = logId;
         unsigned long long logDigest = 0;
         KangarooTwelve(message, messageSize, &logDigest, 8);
-        *((unsigned long long*)(logBuffer + (logBufferTail + 18))) = logDigest;
-        copyMem(logBuffer + (logBufferTail + LOG_HEADER_SIZE), message, messageSize);
+        *((unsigned long long*)(logPtr + 18)) = logDigest;
+        copyMem(logPtr + LOG_HEADER_SIZE, message, messageSize);
         logBufferTail += LOG_HEADER_SIZE + messageSize;
+        getSegment(currentSegment).size = logBufferTail - (unsigned long long)currentSegment * LOG_SEGMENT_SIZE;
+        logId++;
 #endif
     }
 
@@ -656,6 +1195,25 @@ public:
     // get logging content from log ID
     static void processRequestLog(Peer* peer, RequestResponseHeader* header);
 
+    // get logs of log ID range that match filters
+    static void processRequestFilteredLog(unsigned long long processorNumber, Peer* peer, RequestResponseHeader* header);
+
+    // send logs from fromID to toID (inclusive) as far as they are in one segment, return false if deferred until segment is loaded from disk
+    static bool respondLog(Peer* peer, unsigned int dejavu, unsigned long long fromID, unsigned long long toID, bool mayDefer);
+
+    // save sealed segments and load segments for pending requests or lagging subscribers, called by main loop (only one with file access)
+    static void processDiskStorage();
+
+    // load persisted segment to logDiskCache if it is not there yet, only called by main loop
+    static bool loadSegmentToDiskCache(unsigned int segment);
+
+    // subscribe to / acknowledge pushed logs
+    static void processRequestLogSubscription(Peer* peer, RequestResponseHeader* header);
+    static void processAcknowledgeLogSubscription(Peer* peer, RequestResponseHeader* header);
+
+    // push new logs to subscribers, called by main loop
+    static void processSubscriptions();
+
     // convert from tx id to log ID
     static void processRequestTxLogInfo(Peer* peer, RequestResponseHeader* header);
 
@@ -4,59 +4,579 @@
 #include "network_core/peers.h"
 
 
-// Request: ranges of log ID
-void qLogger::processRequestLog(Peer* peer, RequestResponseHeader* header)
+#if ENABLED_LOGGING
+// Send logs fromID to toID (inclusive) that are in segment with data segmentData, starting search at offset with ID offsetLogId.
+// The response is limited to the segment and the max message size, the client has to request the rest.
+static void sendLogsOfSegment(Peer* peer, unsigned int dejavu, const char* segmentData, unsigned long long segmentSize,
+    unsigned long long offset, unsigned long long offsetLogId, unsigned long long fromID, unsigned long long toID)
+{
+    const long long fromOffset = qLogger::findLogInSegment(segmentData, segmentSize, offset, offsetLogId, fromID);
+    if (fromOffset < 0)
+    {
+        enqueueResponse(peer, 0, RespondLog::type, dejavu, NULL);
+        return;
+    }
+
+    const unsigned long long startFrom = fromOffset;
+    offset = fromOffset;
+    offsetLogId = fromID;
+    unsigned long long lastOffset = offset;
+    while (offsetLogId <= toID && offset + LOG_HEADER_SIZE <= segmentSize)
+    {
+        const unsigned long long logSize = LOG_HEADER_SIZE + qLogger::getLogSize(segmentData + offset);
+        if (offset + logSize > segmentSize || offset + logSize - startFrom > RequestResponseHeader::max_size - sizeof(RequestResponseHeader))
+        {
+            break;
+        }
+        lastOffset = offset;
+        offset += logSize;
+        offsetLogId++;
+    }
+
+    // logs may have been overwritten in the meantime (RAM ring buffer), so check last log too
+    if (offset == startFrom || !qLogger::verifyLog(segmentData + lastOffset, offsetLogId - 1))
+    {
+        enqueueResponse(peer, 0, RespondLog::type, dejavu, NULL);
+        return;
+    }
+    enqueueResponse(peer, (unsigned int)(offset - startFrom), RespondLog::type, dejavu, segmentData + startFrom);
+}
+
+// Check if log message matches filters of request. Only the requested public keys listed in candidates are compared.
+static bool matchesLogFilter(const RequestFilteredLog* request, const unsigned char* requestedPublicKeys, const unsigned short* candidates, unsigned int numberOfCandidates,
+    unsigned char messageType, const char* message, unsigned int messageSize)
+{
+    if (!(qLogger::getMessageTypeFlag(messageType) & request->messageTypes))
+    {
+        return false;
+    }
+    if (request->contractIndex != 0xffffffff
+        && (messageType < CONTRACT_ERROR_MESSAGE || messageType > CONTRACT_DEBUG_MESSAGE
+            || messageSize < sizeof(unsigned int) || *((unsigned int*)message) != request->contractIndex))
+    {
+        return false;
+    }
+    if (!request->numberOfPublicKeys)
+    {
+        return true;
+    }
+    m256i publicKey;
+    for (unsigned int i = 0; qLogger::getLogEntity(messageType, message, messageSize, i, publicKey); i++)
+    {
+        for (unsigned int j = 0; j < numberOfCandidates; j++)
+        {
+            // public keys in request may be unaligned
+            const unsigned long long* requestedPublicKey = (const unsigned long long*)(requestedPublicKeys + candidates[j] * sizeof(m256i));
+            if (requestedPublicKey[0] == publicKey.m256i_u64[0]
+                && requestedPublicKey[1] == publicKey.m256i_u64[1]
+                && requestedPublicKey[2] == publicKey.m256i_u64[2]
+                && requestedPublicKey[3] == publicKey.m256i_u64[3])
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Append the logs fromID to toID (inclusive) of segment that match the filters of request to buffer (after responseSize bytes of
+// response header), starting search at offset with ID offsetLogId. Ticks whose TickLogFilter shows that they have no matching log
+// are skipped. Return new size of response (0 if logs are not available) and set nextID to the first log ID not checked.
+static unsigned int filterLogsOfSegment(const RequestFilteredLog* request, const unsigned short (*keyBloomBits)[2], unsigned short* candidates,
+    unsigned int segment, const char* segmentData, unsigned long long segmentSize, unsigned long long offset, unsigned long long offsetLogId,
+    char* buffer, unsigned int responseSize, unsigned long long& nextID)
+{
+    const long long fromOffset = qLogger::findLogInSegment(segmentData, segmentSize, offset, offsetLogId, request->fromID);
+    if (fromOffset < 0)
+    {
+        return 0;
+    }
+
+    const unsigned char* requestedPublicKeys = (const unsigned char*)(request + 1);
+    const m256i contractId(request->contractIndex, 0, 0, 0);
+    unsigned long long logId = request->fromID;
+    unsigned int numberOfCandidates = 0;
+    unsigned long long skipUntilLogId = 0;
+    unsigned int checkedTick = 0;
+    offset = fromOffset;
+    while (logId <= request->toID && offset + LOG_HEADER_SIZE <= segmentSize)
+    {
+        const char* ptr = segmentData + offset;
+        const unsigned int messageSize = qLogger::getLogSize(ptr);
+        if (offset + LOG_HEADER_SIZE + messageSize > segmentSize)
+        {
+            break;
+        }
+
+        const unsigned int tick = qLogger::getLogTick(ptr);
+        if (tick != checkedTick)
+        {
+            // check filter of tick to find out which requested public keys may occur and if the tick can be skipped
+            checkedTick = tick;
+            const qLogger::TickLogFilter* filter = qLogger::tickFilter.get(tick);
+            const unsigned int numberOfLogs = (filter) ? filter->numberOfLogs : 0xffffffff;
+            if (numberOfLogs != 0xffffffff && logId >= filter->firstLogId && logId < filter->firstLogId + numberOfLogs)
+            {
+                bool mayMatch = (filter->messageTypes & request->messageTypes) != 0;
+                if (mayMatch && request->contractIndex != 0xffffffff)
+                {
+                    mayMatch = qLogger::mayContainEntity(*filter, contractId);
+                }
+                numberOfCandidates = 0;
+                if (mayMatch && request->numberOfPublicKeys)
+                {
+                    for (unsigned int i = 0; i < request->numberOfPublicKeys; i++)
+                    {
+                        const unsigned int bit0 = keyBloomBits[i][0], bit1 = keyBloomBits[i][1];
+                        if ((filter->entityBloom[bit0 >> 3] & (1 << (bit0 & 7))) && (filter->entityBloom[bit1 >> 3] & (1 << (bit1 & 7))))
+                        {
+                            candidates[numberOfCandidates++] = i;
+                        }
+                    }
+                    mayMatch = numberOfCandidates > 0;
+                }
+                if (!mayMatch)
+                {
+                    skipUntilLogId = filter->firstLogId + numberOfLogs;
+                    if (skipUntilLogId > request->toID + 1)
+                    {
+                        skipUntilLogId = request->toID + 1;
+                    }
+                    if (skipUntilLogId - logId > LOG_INDEX_SPARSENESS)
+                    {
+                        // jump close to the end of tick with sparse index instead of walking through all logs
+                        unsigned int skipSegment;
+                        unsigned long long skipOffset, skipOffsetLogId;
+                        if (!qLogger::locateLog(skipUntilLogId, skipSegment, skipOffset, skipOffsetLogId) || skipSegment != segment)
+                        {
+                            logId = skipUntilLogId;
+                            break;
+                        }
+                        if (skipOffsetLogId > logId)
+                        {
+                            offset = skipOffset;
+                            logId = skipOffsetLogId;
+                            continue;
+                        }
+                    }
+                }
+            }
+            else
+            {
+                // no usable filter, compare with all requested public keys
+                numberOfCandidates = request->numberOfPublicKeys;
+                for (unsigned int i = 0; i < numberOfCandidates; i++)
+                {
+                    candidates[i] = i;
+                }
+            }
+        }
+
+        if (logId >= skipUntilLogId
+            && matchesLogFilter(request, requestedPublicKeys, candidates, numberOfCandidates, qLogger::getLogType(ptr), ptr + LOG_HEADER_SIZE, messageSize))
+        {
+            if (responseSize + LOG_HEADER_SIZE + messageSize > LOG_FILTER_RESPONSE_BUFFER_SIZE)
+            {
+                break;
+            }
+            // logs may have been overwritten in the meantime (RAM ring buffer)
+            if (!qLogger::verifyLog(ptr, logId))
+            {
+                return 0;
+            }
+            copyMem(buffer + responseSize, ptr, LOG_HEADER_SIZE + messageSize);
+            responseSize += LOG_HEADER_SIZE + messageSize;
+        }
+
+        offset += LOG_HEADER_SIZE + messageSize;
+        logId++;
+    }
+
+    nextID = logId;
+    return responseSize;
+}
+
+// Locate segment of request->fromID and filter its logs if the segment is in RAM or in the disk cache (see filterLogsOfSegment())
+static unsigned int filterLogs(const RequestFilteredLog* request, const unsigned short (*keyBloomBits)[2], unsigned short* candidates,
+    char* buffer, unsigned int responseSize, unsigned long long& nextID)
+{
+    unsigned int segment;
+    unsigned long long offset, offsetLogId;
+    if (!qLogger::locateLog(request->fromID, segment, offset, offsetLogId))
+    {
+        return 0;
+    }
+
+    const char* segmentData = qLogger::getRamSegmentData(segment);
+    if (segmentData)
+    {
+        responseSize = filterLogsOfSegment(request, keyBloomBits, candidates, segment, segmentData, qLogger::getSegment(segment).size, offset, offsetLogId, buffer, responseSize, nextID);
+
+        // segment may have been overwritten in the meantime
+        return (qLogger::getRamSegmentData(segment)) ? responseSize : 0;
+    }
+
+#if LOG_PERSIST_TO_DISK
+    ACQUIRE(qLogger::logDiskCacheLock);
+    if (qLogger::logDiskCacheSegment == segment)
+    {
+        responseSize = filterLogsOfSegment(request, keyBloomBits, candidates, segment, qLogger::logDiskCache, qLogger::getSegment(segment).size, offset, offsetLogId, buffer, responseSize, nextID);
+    }
+    else
+    {
+        responseSize = 0;
+    }
+    RELEASE(qLogger::logDiskCacheLock);
+    return responseSize;
+#else
+    return 0;
+#endif
+}
+
+static char* acquireFilterResponseBuffer(unsigned int& bufferIndex)
+{
+    bufferIndex = 0;
+    while (!TRY_ACQUIRE(qLogger::filterResponseBufferLocks[bufferIndex]))
+    {
+        bufferIndex = (bufferIndex + 1) % LOG_FILTER_NUMBER_OF_RESPONSE_BUFFERS;
+        _mm_pause();
+    }
+    return qLogger::filterResponseBuffers[bufferIndex];
+}
+#endif
+
+bool qLogger::respondLog(Peer* peer, unsigned int dejavu, unsigned long long fromID, unsigned long long toID, bool mayDefer)
 {
 #if ENABLED_LOGGING
-    RequestLog* request = header->getPayload<RequestLog>();
-    if (request->passcode[0] == logReaderPasscodes[0]
+    unsigned int segment;
+    unsigned long long offset, offsetLogId;
+    if (fromID <= toID && locateLog(fromID, segment, offset, offsetLogId))
+    {
+        const char* segmentData = getRamSegmentData(segment);
+        if (segmentData)
+        {
+            sendLogsOfSegment(peer, dejavu, segmentData, getSegment(segment).size, offset, offsetLogId, fromID, toID);
+            return true;
+        }
+#if LOG_PERSIST_TO_DISK
+        ACQUIRE(logDiskCacheLock);
+        if (logDiskCacheSegment == segment)
+        {
+            sendLogsOfSegment(peer, dejavu, logDiskCache, getSegment(segment).size, offset, offsetLogId, fromID, toID);
+            RELEASE(logDiskCacheLock);
+            return true;
+        }
+        if (mayDefer && getSegment(segment).state == SEGMENT_PERSISTED && numberOfPendingDiskRequests < LOG_MAX_PENDING_DISK_REQUESTS)
+        {
+            PendingDiskRequest& pending = pendingDiskRequests[numberOfPendingDiskRequests++];
+            pending.peer = peer;
+            pending.connection = getPeerConnection(peer);
+            pending.dejavu = dejavu;
+            pending.segment = segment;
+            pending.fromID = fromID;
+            pending.toID = toID;
+            RELEASE(logDiskCacheLock);
+            return false;
+        }
+        RELEASE(logDiskCacheLock);
+#endif
+    }
+#endif
+    enqueueResponse(peer, 0, RespondLog::type, dejavu, NULL);
+    return true;
+}
+
+// Request: ranges of log ID with filters
+void qLogger::processRequestFilteredLog(unsigned long long processorNumber, Peer* peer, RequestResponseHeader* header)
+{
+#if ENABLED_LOGGING
+    RequestFilteredLog* request = header->getPayload<RequestFilteredLog>();
+    if (header->size() >= sizeof(RequestResponseHeader) + sizeof(RequestFilteredLog)
+        && request->numberOfPublicKeys <= LOG_FILTER_MAX_PUBLIC_KEYS
+        && header->size() == sizeof(RequestResponseHeader) + sizeof(RequestFilteredLog) + request->numberOfPublicKeys * sizeof(m256i)
+        && request->passcode[0] == logReaderPasscodes[0]
+        && request->passcode[1] == logReaderPasscodes[1]
+        && request->passcode[2] == logReaderPasscodes[2]
+        && request->passcode[3] == logReaderPasscodes[3]
+        && request->fromID <= request->toID)
+    {
+        unsigned short (*keyBloomBits)[2] = filterKeys[processorNumber].keyBloomBits;
+        unsigned short* candidates = filterKeys[processorNumber].candidates;
+        const unsigned char* requestedPublicKeys = (const unsigned char*)(request + 1);
+        for (unsigned int i = 0; i < request->numberOfPublicKeys; i++)
+        {
+            m256i publicKey;
+            copyMem(&publicKey, requestedPublicKeys + i * sizeof(m256i), sizeof(m256i));
+            unsigned int bit0, bit1;
+            getEntityBloomBits(publicKey, bit0, bit1);
+            keyBloomBits[i][0] = bit0;
+            keyBloomBits[i][1] = bit1;
+        }
+
+        // unlike RequestLog, filtered requests are not deferred until the segment is loaded from disk
+        unsigned int bufferIndex;
+        char* buffer = acquireFilterResponseBuffer(bufferIndex);
+        RespondFilteredLog* response = (RespondFilteredLog*)buffer;
+        const unsigned int responseSize = filterLogs(request, keyBloomBits, candidates, buffer, sizeof(RespondFilteredLog), response->nextID);
+        enqueueResponse(peer, responseSize, RespondFilteredLog::type, header->dejavu(), (responseSize) ? buffer : NULL);
+        RELEASE(filterResponseBufferLocks[bufferIndex]);
+        return;
+    }
+#endif
+    enqueueResponse(peer, 0, RespondFilteredLog::type, header->dejavu(), NULL);
+}
+
+// Request: subscribe to logs pushed after each tick (no response if accepted, empty RespondLogSubscription if rejected)
+void qLogger::processRequestLogSubscription(Peer* peer, RequestResponseHeader* header)
+{
+#if ENABLED_LOGGING
+    RequestLogSubscription* request = header->getPayload<RequestLogSubscription>();
+    if (header->size() == sizeof(RequestResponseHeader) + sizeof(RequestLogSubscription)
+        && request->passcode[0] == logReaderPasscodes[0]
+        && request->passcode[1] == logReaderPasscodes[1]
+        && request->passcode[2] == logReaderPasscodes[2]
+        && request->passcode[3] == logReaderPasscodes[3])
+    {
+        void* connection = getPeerConnection(peer);
+        bool accepted = true;
+        ACQUIRE(logSubscriptionsLock);
+        int index = -1, freeIndex = -1;
+        for (int i = 0; i < LOG_MAX_NUMBER_OF_SUBSCRIPTIONS; i++)
+        {
+            if (logSubscriptions[i].peer == peer && logSubscriptions[i].connection == connection)
+            {
+                index = i;
+                break;
+            }
+            if (!logSubscriptions[i].peer && freeIndex < 0)
+            {
+                freeIndex = i;
+            }
+        }
+        if (!request->maxUnacknowledgedMessages)
+        {
+            // unsubscribe
+            if (index >= 0)
+            {
+                logSubscriptions[index].peer = NULL;
+            }
+        }
+        else
+        {
+            if (index < 0)
+            {
+                index = freeIndex;
+            }
+            if (index >= 0)
+            {
+                LogSubscription& subscription = logSubscriptions[index];
+                subscription.peer = peer;
+                subscription.connection = connection;
+                subscription.dejavu = header->dejavu();
+                subscription.maxUnacknowledgedMessages = (request->maxUnacknowledgedMessages < LOG_SUBSCRIPTION_MAX_UNACKNOWLEDGED_MESSAGES) ? request->maxUnacknowledgedMessages : LOG_SUBSCRIPTION_MAX_UNACKNOWLEDGED_MESSAGES;
+                subscription.messageTypes = request->messageTypes;
+                subscription.nextID = request->fromID;
+                subscription.firstUnacknowledged = 0;
+                subscription.numberOfUnacknowledged = 0;
+                subscription.acknowledgedNextID = request->fromID;
+            }
+            else
+            {
+                accepted = false;
+            }
+        }
+        RELEASE(logSubscriptionsLock);
+        if (accepted)
+        {
+            return;
+        }
+    }
+#endif
+    enqueueResponse(peer, 0, RespondLogSubscription::type, header->dejavu(), NULL);
+}
+
+// Request: confirm receipt of pushed logs, allowing the next messages to be sent (no response)
+void qLogger::processAcknowledgeLogSubscription(Peer* peer, RequestResponseHeader* header)
+{
+#if ENABLED_LOGGING
+    AcknowledgeLogSubscription* request = header->getPayload<AcknowledgeLogSubscription>();
+    if (header->size() == sizeof(RequestResponseHeader) + sizeof(AcknowledgeLogSubscription)
+        && request->passcode[0] == logReaderPasscodes[0]
         && request->passcode[1] == logReaderPasscodes[1]
         && request->passcode[2] == logReaderPasscodes[2]
         && request->passcode[3] == logReaderPasscodes[3])
     {
-        BlobInfo startIdBufferRange = logBuf.getBlobInfo(request->fromID);
-        BlobInfo endIdBufferRange = logBuf.getBlobInfo(request->toID); // inclusive
-        if (startIdBufferRange.startIndex != -1 && startIdBufferRange.length != -1
-            && endIdBufferRange.startIndex != -1 && endIdBufferRange.length != -1)
+        void* connection = getPeerConnection(peer);
+        ACQUIRE(logSubscriptionsLock);
+        for (int i = 0; i < LOG_MAX_NUMBER_OF_SUBSCRIPTIONS; i++)
         {
-            if (endIdBufferRange.startIndex < startIdBufferRange.startIndex)
+            LogSubscription& subscription = logSubscriptions[i];
+            if (subscription.peer == peer && subscription.connection == connection)
             {
-                // round buffer case, only response first packet - let the client figure out and request the rest
-                for (unsigned long long i = request->fromID; i <= request->toID; i++)
+                if (subscription.numberOfUnacknowledged
+                    && subscription.unacknowledgedNextIDs[subscription.firstUnacknowledged] <= request->nextID)
                 {
-                    BlobInfo iBufferRange = logBuf.getBlobInfo(i);
-                    ASSERT(iBufferRange.startIndex >= 0);
-                    ASSERT(iBufferRange.length >= 0);
-                    if (iBufferRange.startIndex < startIdBufferRange.startIndex)
+                    do
                     {
-                        endIdBufferRange = logBuf.getBlobInfo(i - 1);
-                        break;
-                    }
+                        subscription.acknowledgedNextID = subscription.unacknowledgedNextIDs[subscription.firstUnacknowledged];
+                        subscription.firstUnacknowledged = (subscription.firstUnacknowledged + 1) % LOG_SUBSCRIPTION_MAX_UNACKNOWLEDGED_MESSAGES;
+                        subscription.numberOfUnacknowledged--;
+                    } while (subscription.numberOfUnacknowledged
+                        && subscription.unacknowledgedNextIDs[subscription.firstUnacknowledged] <= request->nextID);
+                    subscription.waitingForAcknowledgementSince = __rdtsc();
                 }
-                // first packet: from startID to end of buffer IS SENT BELOW
-                // second packet: from start buffer to endID IS NOT SENT FROM HERE, but requested by client later
+                break;
+            }
+        }
+        RELEASE(logSubscriptionsLock);
+    }
+#endif
+}
+
+void qLogger::processSubscriptions()
+{
+#if ENABLED_LOGGING
+    // only push logs of completed ticks (published by the tick processor)
+    const unsigned long long endLogId = endLogIdOfCompletedTicks;
+    const unsigned long long ackTimeout = LOG_SUBSCRIPTION_ACK_TIMEOUT * frequency;
+#if LOG_PERSIST_TO_DISK
+    // Subscribers lagging behind the RAM segments are only served if their segment is in logDiskCache. The segment of
+    // the first other lagging subscriber is loaded by processDiskStorage() (one segment per pass), but only if no
+    // subscriber has been served from the cached segment in this pass.
+    long long neededDiskSegment = -1;
+    bool diskCacheUsed = false;
+#endif
+
+    for (int i = 0; i < LOG_MAX_NUMBER_OF_SUBSCRIPTIONS; i++)
+    {
+        ACQUIRE(logSubscriptionsLock);
+        LogSubscription& currentSubscription = logSubscriptions[i];
+        if (currentSubscription.peer && currentSubscription.numberOfUnacknowledged
+            && __rdtsc() - currentSubscription.waitingForAcknowledgementSince > ackTimeout)
+        {
+            // pushed messages or acknowledgements may have been dropped (for example if the response queue was full),
+            // so send again starting with the first log not acknowledged
+            currentSubscription.nextID = currentSubscription.acknowledgedNextID;
+            currentSubscription.firstUnacknowledged = 0;
+            currentSubscription.numberOfUnacknowledged = 0;
+        }
+        const LogSubscription subscription = currentSubscription;
+        RELEASE(logSubscriptionsLock);
+        Peer* peer = subscription.peer;
+        if (!peer)
+        {
+            continue;
+        }
+
+        // subscription ends when connection is closed (peer slot may be reused for other connection)
+        if (!isPeerConnectionActive(peer, subscription.connection))
+        {
+            ACQUIRE(logSubscriptionsLock);
+            if (logSubscriptions[i].peer == peer && logSubscriptions[i].connection == subscription.connection)
+            {
+                logSubscriptions[i].peer = NULL;
             }
+            RELEASE(logSubscriptionsLock);
+            continue;
+        }
 
-            long long startFrom = startIdBufferRange.startIndex;
-            long long length = endIdBufferRange.length + endIdBufferRange.startIndex - startFrom;
-            if (length > RequestResponseHeader::max_size)
+        if (subscription.nextID >= endLogId || subscription.numberOfUnacknowledged >= subscription.maxUnacknowledgedMessages)
+        {
+            continue;
+        }
+
+        RequestFilteredLog request;
+        setMem(&request, sizeof(request), 0);
+        request.fromID = subscription.nextID;
+        request.toID = endLogId - 1;
+        request.messageTypes = subscription.messageTypes;
+        request.contractIndex = 0xffffffff;
+
+#if LOG_PERSIST_TO_DISK
+        // subscriber lagging behind RAM segments
+        unsigned int segment;
+        unsigned long long offset, offsetLogId;
+        if (locateLog(request.fromID, segment, offset, offsetLogId) && !getRamSegmentData(segment))
+        {
+            ACQUIRE(logDiskCacheLock);
+            const bool segmentIsCached = (logDiskCacheSegment == segment);
+            RELEASE(logDiskCacheLock);
+            if (segmentIsCached)
             {
-                unsigned long long toID = request->toID;
-                length -= endIdBufferRange.length;
-                while (length > RequestResponseHeader::max_size)
+                diskCacheUsed = true;
+            }
+            else if (getSegment(segment).state == SEGMENT_PERSISTED)
+            {
+                if (neededDiskSegment < 0)
                 {
-                    ASSERT(toID > request->fromID);
-                    --toID;
-                    endIdBufferRange = logBuf.getBlobInfo(toID);
-                    length -= endIdBufferRange.length;
+                    neededDiskSegment = segment;
                 }
+                continue;
             }
-            enqueueResponse(peer, (unsigned int)(length), RespondLog::type, header->dejavu(), logBuffer + startFrom);
         }
-        else
+#endif
+
+        unsigned int bufferIndex;
+        char* buffer = acquireFilterResponseBuffer(bufferIndex);
+        RespondLogSubscription* response = (RespondLogSubscription*)buffer;
+        response->fromID = subscription.nextID;
+        unsigned int responseSize = filterLogs(&request, NULL, NULL, buffer, sizeof(RespondLogSubscription), response->nextID);
+        if (!responseSize)
         {
-            enqueueResponse(peer, 0, RespondLog::type, header->dejavu(), NULL);
+            // logs are not available anymore, continue with oldest segment in RAM (subscriber sees gap between fromID and nextID)
+            const unsigned int current = currentSegment;
+            unsigned int oldestSegment = (current >= LOG_NUMBER_OF_RAM_SEGMENTS) ? current - LOG_NUMBER_OF_RAM_SEGMENTS + 1 : 0;
+            if (oldestSegment < firstSegmentOfEpoch)
+            {
+                oldestSegment = firstSegmentOfEpoch;
+            }
+            const LogSegment& seg = getSegment(oldestSegment);
+            if (seg.number != oldestSegment || seg.firstLogId <= subscription.nextID)
+            {
+                // temporary failure, try again later
+                RELEASE(filterResponseBufferLocks[bufferIndex]);
+                continue;
+            }
+            response->nextID = seg.firstLogId;
+            responseSize = sizeof(RespondLogSubscription);
         }
+        const unsigned long long nextID = response->nextID;
+        enqueueResponse(peer, responseSize, RespondLogSubscription::type, subscription.dejavu, buffer);
+        RELEASE(filterResponseBufferLocks[bufferIndex]);
+
+        ACQUIRE(logSubscriptionsLock);
+        LogSubscription& updatedSubscription = logSubscriptions[i];
+        if (updatedSubscription.peer == peer && updatedSubscription.connection == subscription.connection
+            && updatedSubscription.dejavu == subscription.dejavu && updatedSubscription.nextID == subscription.nextID)
+        {
+            if (!updatedSubscription.numberOfUnacknowledged)
+            {
+                updatedSubscription.waitingForAcknowledgementSince = __rdtsc();
+            }
+            updatedSubscription.nextID = nextID;
+            updatedSubscription.unacknowledgedNextIDs[(updatedSubscription.firstUnacknowledged + updatedSubscription.numberOfUnacknowledged) % LOG_SUBSCRIPTION_MAX_UNACKNOWLEDGED_MESSAGES] = nextID;
+            updatedSubscription.numberOfUnacknowledged++;
+        }
+        RELEASE(logSubscriptionsLock);
+    }
+#if LOG_PERSIST_TO_DISK
+    subscriptionDiskSegment = (diskCacheUsed) ? -1 : neededDiskSegment;
+#endif
+#endif
+}
+
+// Request: ranges of log ID
+void qLogger::processRequestLog(Peer* peer, RequestResponseHeader* header)
+{
+#if ENABLED_LOGGING
+    RequestLog* request = header->getPayload<RequestLog>();
+    if (request->passcode[0] == logReaderPasscodes[0]
+        && request->passcode[1] == logReaderPasscodes[1]
+        && request->passcode[2] == logReaderPasscodes[2]
+        && request->passcode[3] == logReaderPasscodes[3])
+    {
+        // if logs have to be loaded from disk, the response is sent by the main loop later
+        respondLog(peer, header->dejavu(), request->fromID, request->toID, true);
         return;
     }
 #endif
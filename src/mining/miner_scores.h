@@ -0,0 +1,379 @@
+#pragma once
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+#include "platform/assert.h"
+#include "network_messages/common_def.h"
+
+// Scores of miners (number of accepted solutions) in the current epoch, split into the computors of the epoch
+// (NUMBER_OF_COMPUTORS entries, set by BroadcastComputors) and the candidates (all other miners).
+//
+// The ranking is the same as the one resulting from keeping flat arrays that are sorted by insertion after each
+// solution: within each of the two groups, miners are sorted by descending score and miners with equal score
+// keep the order in which they reached that score. Instead of scanning and shifting the arrays, a hash index
+// maps public keys to slots and the ranking is kept as a list of buckets of equal score, so adding a solution
+// is O(1) and the competitor window is obtained by walking at most NUMBER_OF_COMPUTORS entries.
+//
+// Not thread-safe, the caller has to take care of locking.
+template <unsigned int maxNumberOfMiners>
+class MinerScores
+{
+public:
+    static constexpr unsigned int NO_SLOT = 0xffffffff;
+    static constexpr unsigned int numberOfCompetitors = (NUMBER_OF_COMPUTORS - QUORUM) * 2;
+
+private:
+    static_assert(maxNumberOfMiners > NUMBER_OF_COMPUTORS, "Miner capacity must exceed number of computors");
+    static constexpr unsigned int indexCapacity = maxNumberOfMiners * 2;
+    static_assert((indexCapacity & (indexCapacity - 1)) == 0, "maxNumberOfMiners must be 2^N");
+
+    struct Miner
+    {
+        unsigned int bucket;
+        unsigned int prevMiner;
+        unsigned int nextMiner;
+    };
+
+    // Run of miners with equal score within one group, buckets of a group are sorted by descending score
+    struct Bucket
+    {
+        unsigned int score;
+        unsigned int firstMiner;
+        unsigned int lastMiner;
+        unsigned int prevBucket;
+        unsigned int nextBucket;
+    };
+
+    // public keys are kept separately and first for 32 byte alignment
+    m256i minerPublicKeys[maxNumberOfMiners];
+    m256i candidatePublicKeys[numberOfCompetitors / 2]; // copy of the candidate entries merged in getCompetitors()
+    unsigned int candidateScores[numberOfCompetitors / 2];
+
+    Miner miners[maxNumberOfMiners];
+    Bucket buckets[maxNumberOfMiners + 1]; // +1 for temporary extra bucket in addSolution()
+    unsigned int index[indexCapacity];
+    unsigned int firstBucket[2];
+    unsigned int lastBucket[2];
+    unsigned int freeBucket;
+    unsigned int minerCount;
+
+    // Slots below NUMBER_OF_COMPUTORS are computors (group 0), the others are candidates (group 1)
+    static unsigned int group(unsigned int slot)
+    {
+        return (slot < NUMBER_OF_COMPUTORS) ? 0 : 1;
+    }
+
+    static unsigned int hashIndex(const m256i& publicKey)
+    {
+        return publicKey.m256i_u32[0] & (indexCapacity - 1);
+    }
+
+    unsigned int allocBucket(unsigned int score)
+    {
+        ASSERT(freeBucket != NO_SLOT);
+        const unsigned int bucket = freeBucket;
+        freeBucket = buckets[bucket].nextBucket;
+        buckets[bucket].score = score;
+        buckets[bucket].firstMiner = NO_SLOT;
+        buckets[bucket].lastMiner = NO_SLOT;
+        return bucket;
+    }
+
+    // Insert bucket into list of group before the bucket nextBucket (NO_SLOT = append)
+    void linkBucket(unsigned int grp, unsigned int bucket, unsigned int nextBucket)
+    {
+        const unsigned int prevBucket = (nextBucket == NO_SLOT) ? lastBucket[grp] : buckets[nextBucket].prevBucket;
+        buckets[bucket].prevBucket = prevBucket;
+        buckets[bucket].nextBucket = nextBucket;
+        if (prevBucket == NO_SLOT)
+            firstBucket[grp] = bucket;
+        else
+            buckets[prevBucket].nextBucket = bucket;
+        if (nextBucket == NO_SLOT)
+            lastBucket[grp] = bucket;
+        else
+            buckets[nextBucket].prevBucket = bucket;
+    }
+
+    void unlinkAndFreeBucket(unsigned int grp, unsigned int bucket)
+    {
+        const unsigned int prevBucket = buckets[bucket].prevBucket;
+        const unsigned int nextBucket = buckets[bucket].nextBucket;
+        if (prevBucket == NO_SLOT)
+            firstBucket[grp] = nextBucket;
+        else
+            buckets[prevBucket].nextBucket = nextBucket;
+        if (nextBucket == NO_SLOT)
+            lastBucket[grp] = prevBucket;
+        else
+            buckets[nextBucket].prevBucket = prevBucket;
+        buckets[bucket].nextBucket = freeBucket;
+        freeBucket = bucket;
+    }
+
+    void appendMinerToBucket(unsigned int slot, unsigned int bucket)
+    {
+        const unsigned int lastMiner = buckets[bucket].lastMiner;
+        miners[slot].bucket = bucket;
+        miners[slot].prevMiner = lastMiner;
+        miners[slot].nextMiner = NO_SLOT;
+        if (lastMiner == NO_SLOT)
+            buckets[bucket].firstMiner = slot;
+        else
+            miners[lastMiner].nextMiner = slot;
+        buckets[bucket].lastMiner = slot;
+    }
+
+    void removeMinerFromBucket(unsigned int slot)
+    {
+        const unsigned int bucket = miners[slot].bucket;
+        const unsigned int prevMiner = miners[slot].prevMiner;
+        const unsigned int nextMiner = miners[slot].nextMiner;
+        if (prevMiner == NO_SLOT)
+            buckets[bucket].firstMiner = nextMiner;
+        else
+            miners[prevMiner].nextMiner = nextMiner;
+        if (nextMiner == NO_SLOT)
+            buckets[bucket].lastMiner = prevMiner;
+        else
+            miners[nextMiner].prevMiner = prevMiner;
+    }
+
+    // Append miner as last one of its group, must not have higher score than the current last one
+    void appendMiner(unsigned int slot, unsigned int score)
+    {
+        const unsigned int grp = group(slot);
+        unsigned int bucket = lastBucket[grp];
+        if (bucket == NO_SLOT || buckets[bucket].score != score)
+        {
+            bucket = allocBucket(score);
+            linkBucket(grp, bucket, NO_SLOT);
+        }
+        appendMinerToBucket(slot, bucket);
+    }
+
+    // Add slot to index unless an entry with the same key exists already (first one added wins)
+    void addToIndex(unsigned int slot)
+    {
+        unsigned int i = hashIndex(minerPublicKeys[slot]);
+        while (index[i] != NO_SLOT)
+        {
+            if (minerPublicKeys[index[i]] == minerPublicKeys[slot])
+                return;
+            i = (i + 1) & (indexCapacity - 1);
+        }
+        index[i] = slot;
+    }
+
+    // Rebuild index in ranking order, so duplicate keys resolve to the entry ranked first
+    void rebuildIndex()
+    {
+        setMem(index, sizeof(index), 0xff);
+        for (unsigned int slot = beginRanking(); slot != NO_SLOT; slot = nextInRanking(slot))
+            addToIndex(slot);
+    }
+
+    void clear()
+    {
+        for (unsigned int i = 0; i <= maxNumberOfMiners; i++)
+            buckets[i].nextBucket = (i < maxNumberOfMiners) ? i + 1 : NO_SLOT;
+        freeBucket = 0;
+        firstBucket[0] = firstBucket[1] = NO_SLOT;
+        lastBucket[0] = lastBucket[1] = NO_SLOT;
+    }
+
+public:
+    // Reset to NUMBER_OF_COMPUTORS computors with zero public key and score, and no candidates
+    void reset()
+    {
+        setMem(minerPublicKeys, sizeof(minerPublicKeys), 0);
+        clear();
+        for (unsigned int slot = 0; slot < NUMBER_OF_COMPUTORS; slot++)
+            appendMiner(slot, 0);
+        minerCount = NUMBER_OF_COMPUTORS;
+        rebuildIndex();
+    }
+
+    unsigned int numberOfMiners() const
+    {
+        return minerCount;
+    }
+
+    const m256i& publicKey(unsigned int slot) const
+    {
+        ASSERT(slot < minerCount);
+        return minerPublicKeys[slot];
+    }
+
+    unsigned int score(unsigned int slot) const
+    {
+        ASSERT(slot < minerCount);
+        return buckets[miners[slot].bucket].score;
+    }
+
+    // Iterate miners in ranking order (computors first, candidates afterwards):
+    // for (unsigned int slot = beginRanking(); slot != NO_SLOT; slot = nextInRanking(slot))
+    unsigned int beginRanking() const
+    {
+        return buckets[firstBucket[0]].firstMiner;
+    }
+
+    unsigned int nextInRanking(unsigned int slot) const
+    {
+        if (miners[slot].nextMiner != NO_SLOT)
+            return miners[slot].nextMiner;
+        const unsigned int nextBucket = buckets[miners[slot].bucket].nextBucket;
+        if (nextBucket != NO_SLOT)
+            return buckets[nextBucket].firstMiner;
+        if (group(slot) == 0 && firstBucket[1] != NO_SLOT)
+            return buckets[firstBucket[1]].firstMiner;
+        return NO_SLOT;
+    }
+
+    // Return slot of miner or NO_SLOT if not found
+    unsigned int find(const m256i& publicKey) const
+    {
+        unsigned int i = hashIndex(publicKey);
+        while (index[i] != NO_SLOT)
+        {
+            if (minerPublicKeys[index[i]] == publicKey)
+                return index[i];
+            i = (i + 1) & (indexCapacity - 1);
+        }
+        return NO_SLOT;
+    }
+
+    // Increment score of miner, adding it as a new candidate if it is unknown. Return false if miner capacity is exhausted.
+    bool addSolution(const m256i& publicKey)
+    {
+        unsigned int slot = find(publicKey);
+        if (slot == NO_SLOT)
+        {
+            if (minerCount == maxNumberOfMiners)
+                return false;
+
+            // new candidates start with score 1 and candidates never have lower score, so they are ranked last
+            slot = minerCount++;
+            minerPublicKeys[slot] = publicKey;
+            appendMiner(slot, 1);
+            addToIndex(slot);
+            return true;
+        }
+
+        // move miner to the end of the bucket with score + 1, which is directly before its current bucket
+        const unsigned int grp = group(slot);
+        const unsigned int bucket = miners[slot].bucket;
+        const unsigned int newScore = buckets[bucket].score + 1;
+        unsigned int newBucket = buckets[bucket].prevBucket;
+        if (newBucket == NO_SLOT || buckets[newBucket].score != newScore)
+        {
+            newBucket = allocBucket(newScore);
+            linkBucket(grp, newBucket, bucket);
+        }
+        removeMinerFromBucket(slot);
+        appendMinerToBucket(slot, newBucket);
+        if (buckets[bucket].firstMiner == NO_SLOT)
+            unlinkAndFreeBucket(grp, bucket);
+
+        return true;
+    }
+
+    // Set public keys of the computors in ranking order, keeping the scores of the ranks
+    void setComputors(const m256i* publicKeys)
+    {
+        unsigned int i = 0;
+        for (unsigned int slot = beginRanking(); i < NUMBER_OF_COMPUTORS; slot = nextInRanking(slot))
+            minerPublicKeys[slot] = publicKeys[i++];
+        rebuildIndex();
+    }
+
+    // Get public keys and scores of all miners in ranking order, the remaining entries up to maxNumberOfMiners are zeroed
+    void getRanking(m256i* publicKeys, unsigned int* scores) const
+    {
+        unsigned int i = 0;
+        for (unsigned int slot = beginRanking(); slot != NO_SLOT; slot = nextInRanking(slot), i++)
+        {
+            publicKeys[i] = minerPublicKeys[slot];
+            scores[i] = buckets[miners[slot].bucket].score;
+        }
+        setMem(publicKeys + i, (maxNumberOfMiners - i) * sizeof(m256i), 0);
+        setMem(scores + i, (maxNumberOfMiners - i) * sizeof(unsigned int), 0);
+    }
+
+    // Set ranking from arrays obtained with getRanking()
+    void setRanking(const m256i* publicKeys, const unsigned int* scores, unsigned int numberOfMiners)
+    {
+        ASSERT(numberOfMiners >= NUMBER_OF_COMPUTORS && numberOfMiners <= maxNumberOfMiners);
+        setMem(minerPublicKeys, sizeof(minerPublicKeys), 0);
+        clear();
+        for (unsigned int slot = 0; slot < numberOfMiners; slot++)
+        {
+            minerPublicKeys[slot] = publicKeys[slot];
+            appendMiner(slot, scores[slot]);
+        }
+        minerCount = numberOfMiners;
+        rebuildIndex();
+    }
+
+    // Get public keys of the top computors
+    void getTopComputors(m256i* publicKeys, unsigned int count) const
+    {
+        ASSERT(count <= NUMBER_OF_COMPUTORS);
+        unsigned int i = 0;
+        for (unsigned int slot = beginRanking(); i < count; slot = nextInRanking(slot))
+            publicKeys[i++] = minerPublicKeys[slot];
+    }
+
+    // Combine the NUMBER_OF_COMPUTORS - QUORUM worst computors with the same number of best candidates, sorted by
+    // descending score (computors before candidates with equal score). If there are not enough candidates, the missing
+    // ones have score 0 and keep their public key from the previous call, which are at the end of the arrays.
+    void getCompetitors(m256i* publicKeys, unsigned int* scores, bool* computorStatuses)
+    {
+        constexpr unsigned int half = numberOfCompetitors / 2;
+
+        unsigned int slot = beginRanking();
+        for (unsigned int i = 0; i < QUORUM; i++)
+            slot = nextInRanking(slot);
+        const unsigned int firstComputor = slot;
+
+        while (slot != NO_SLOT && group(slot) == 0)
+            slot = nextInRanking(slot);
+        for (unsigned int i = 0; i < half; i++)
+        {
+            if (slot != NO_SLOT)
+            {
+                candidatePublicKeys[i] = minerPublicKeys[slot];
+                candidateScores[i] = buckets[miners[slot].bucket].score;
+                slot = nextInRanking(slot);
+            }
+            else
+            {
+                candidatePublicKeys[i] = publicKeys[half + i];
+                candidateScores[i] = 0;
+            }
+        }
+
+        // merge computors and candidates, which are both sorted already
+        unsigned int computorSlot = firstComputor;
+        unsigned int computorCount = 0, candidateCount = 0;
+        for (unsigned int i = 0; i < numberOfCompetitors; i++)
+        {
+            if (computorCount < half
+                && (candidateCount == half || buckets[miners[computorSlot].bucket].score >= candidateScores[candidateCount]))
+            {
+                publicKeys[i] = minerPublicKeys[computorSlot];
+                scores[i] = buckets[miners[computorSlot].bucket].score;
+                computorStatuses[i] = true;
+                computorSlot = nextInRanking(computorSlot);
+                computorCount++;
+            }
+            else
+            {
+                publicKeys[i] = candidatePublicKeys[candidateCount];
+                scores[i] = candidateScores[candidateCount];
+                computorStatuses[i] = false;
+                candidateCount++;
+            }
+        }
+    }
+};
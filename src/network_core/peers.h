@@ -159,6 +159,20 @@ static void closePeer(Peer* peer)
     }
 }
 
+// Get identity of the current connection of peer. Used to detect that the peer slot is used by another connection
+// when responding to a request later.
+static void* getPeerConnection(const Peer* peer)
+{
+    return peer->connectAcceptToken.NewChildHandle;
+}
+
+// Check that peer is still connected with the connection identified by getPeerConnection() before
+static bool isPeerConnectionActive(const Peer* peer, void* connection)
+{
+    return peer->tcp4Protocol && peer->isConnectedAccepted && !peer->isClosing
+        && peer->connectAcceptToken.NewChildHandle == connection;
+}
+
 // Add message to sending buffer of specific peer, can only called from main thread (not thread-safe).
 static void push(Peer* peer, RequestResponseHeader* requestResponseHeader)
 {
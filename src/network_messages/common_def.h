@@ -78,3 +78,37 @@ static void getSiblings(int digestIndex, const m256i* digests, m256i siblings[de
         siblingIndex >>= 1;
     }
 }
+
+// Compute the siblings needed for verifying multiple leaves of the tree at once (multi-proof), omitting siblings that
+// can be computed from the leaves. The siblings are ordered by level (starting with the leaf level) and by index within
+// the level. The leaf indices must be sorted in ascending order without duplicates and are overwritten. Returns the number
+// of siblings, which is at most numberOfIndices * depth.
+// This function is not thread safe, make sure resource protection is handled outside
+template <unsigned int depth>
+static unsigned int getMultiProofSiblings(unsigned int* indices, unsigned int numberOfIndices, const m256i* digests, m256i* siblings)
+{
+    const unsigned long long capacity = (1ULL << depth);
+    unsigned long long digestOffset = 0;
+    unsigned int numberOfSiblings = 0;
+    for (unsigned int j = 0; j < depth; j++)
+    {
+        unsigned int numberOfParents = 0;
+        for (unsigned int i = 0; i < numberOfIndices; i++)
+        {
+            const unsigned int index = indices[i];
+            if (i + 1 < numberOfIndices && indices[i + 1] == (index ^ 1))
+            {
+                // sibling is known
+                i++;
+            }
+            else
+            {
+                siblings[numberOfSiblings++] = digests[digestOffset + (index ^ 1)];
+            }
+            indices[numberOfParents++] = index >> 1;
+        }
+        numberOfIndices = numberOfParents;
+        digestOffset += (capacity >> j);
+    }
+    return numberOfSiblings;
+}
@@ -37,3 +37,97 @@ struct RespondedEntity
 };
 
 static_assert(sizeof(RespondedEntity) == sizeof(::Entity) + 4 + 4 + 32 * SPECTRUM_DEPTH, "Something is wrong with the struct size.");
+
+
+#define MAX_NUMBER_OF_ENTITIES_PER_REQUEST 1024
+
+// Request multiple entities at once. The payload is an array of 1 to MAX_NUMBER_OF_ENTITIES_PER_REQUEST public keys.
+struct RequestEntities
+{
+    m256i publicKeys[MAX_NUMBER_OF_ENTITIES_PER_REQUEST];
+
+    enum {
+        type = 63,
+    };
+};
+
+
+struct RespondedEntitiesEntry
+{
+    ::Entity entity;
+    int spectrumIndex; // -1 if entity is not in spectrum (entity is zero except publicKey)
+    unsigned int _padding;
+};
+
+static_assert(sizeof(RespondedEntitiesEntry) == sizeof(::Entity) + 8, "Something is wrong with the struct size.");
+
+// Entities in the order of the request, followed by one Merkle multi-proof of all entities in spectrum against spectrumDigest
+// (see getMultiProofSiblings()). Entities and proof are taken from the state of the spectrum at the end of tick. While a tick
+// is processed, the spectrum digest is outdated and EndResponse is sent instead, so the request should be repeated later.
+struct RespondEntities
+{
+    unsigned int tick; // tick at the end of which the spectrum had this state (spectrumDigest is the one of this tick)
+    unsigned int numberOfEntities;
+    unsigned int numberOfSiblings;
+    unsigned int _padding;
+    m256i spectrumDigest;
+    // followed by RespondedEntitiesEntry entities[numberOfEntities] and m256i siblings[numberOfSiblings]
+
+    enum {
+        type = 64,
+    };
+};
+
+static_assert(sizeof(RespondEntities) == 16 + 32, "Something is wrong with the struct size.");
+
+
+#define ENTITY_TX_HISTORY_MAX_POSTINGS 1024
+
+#define ENTITY_TX_HISTORY_SOURCE 1
+#define ENTITY_TX_HISTORY_DESTINATION 2
+
+// Request ticks and slots of transactions with publicKey as source or destination in ticks firstTick..lastTick of the current
+// epoch. Postings are sent newest first in pages of up to ENTITY_TX_HISTORY_MAX_POSTINGS. Pages only contain complete ticks,
+// the next page is requested with lastTick = RespondEntityTxHistory::nextLastTick.
+struct RequestEntityTxHistory
+{
+    m256i publicKey;
+    unsigned int firstTick;
+    unsigned int lastTick;
+
+    enum {
+        type = 61,
+    };
+};
+
+static_assert(sizeof(RequestEntityTxHistory) == 40, "Something is wrong with the struct size.");
+
+
+struct EntityTxHistoryPosting
+{
+    unsigned int tick;
+    unsigned short transactionIndex; // slot in TickData::transactionDigests
+    unsigned char flags; // ENTITY_TX_HISTORY_SOURCE and/or ENTITY_TX_HISTORY_DESTINATION
+    unsigned char _padding;
+};
+
+static_assert(sizeof(EntityTxHistoryPosting) == 8, "Something is wrong with the struct size.");
+
+
+struct RespondEntityTxHistory
+{
+    m256i publicKey;
+    unsigned int indexedFromTick; // history is available for ticks indexedFromTick..indexedToTick (both 0 if not available)
+    unsigned int indexedToTick;
+    unsigned int nextLastTick; // 0 if there are no more postings in the requested range
+    unsigned short numberOfPostings;
+    unsigned short _padding;
+
+    // Followed by numberOfPostings EntityTxHistoryPosting in descending order of tick and transactionIndex
+
+    enum {
+        type = 62,
+    };
+};
+
+static_assert(sizeof(RespondEntityTxHistory) == 48, "Something is wrong with the struct size.");
@@ -114,6 +114,45 @@ struct RequestTickData
 };
 
 
+#define TICK_RANGE_MAX_NUMBER_OF_TICKS 8
+
+#define TICK_RANGE_QUORUM_TICKS 1
+#define TICK_RANGE_TICK_DATA 2
+#define TICK_RANGE_TRANSACTIONS 4
+
+// Request quorum votes, tick data and/or transactions (see flags TICK_RANGE_*) of up to TICK_RANGE_MAX_NUMBER_OF_TICKS
+// consecutive ticks, used by lagging nodes to catch up. The response is one RespondTickRange per tick followed by EndResponse.
+struct RequestTickRange
+{
+    unsigned int firstTick;
+    unsigned short numberOfTicks;
+    unsigned char flags;
+    unsigned char _padding;
+
+    enum {
+        type = 59,
+    };
+};
+
+
+struct RespondTickRange
+{
+    unsigned int tick;
+    unsigned short numberOfVotes;
+    unsigned short numberOfTransactions;
+    unsigned char flags; // TICK_RANGE_TICK_DATA is set if TickData is included
+    unsigned char _padding[15]; // with 8 byte message header, following Tick structs are aligned to 32 bytes
+
+    // Followed by numberOfVotes Tick structs, TickData (if included) and numberOfTransactions transactions in ascending order of slot
+
+    enum {
+        type = 60,
+    };
+};
+
+static_assert(sizeof(RespondTickRange) == 24, "Something is wrong with the struct size.");
+
+
 #define REQUEST_CURRENT_TICK_INFO 27
 
 #define RESPOND_CURRENT_TICK_INFO 28
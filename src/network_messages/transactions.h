@@ -63,6 +63,31 @@ struct RequestedTickTransactions
     unsigned char transactionFlags[NUMBER_OF_TRANSACTIONS_PER_TICK / 8];
 };
 
+// Request all transactions of a tick in few messages of type RespondTickTransactionBundle, followed by EndResponse
+struct RequestTickTransactionBundle
+{
+    unsigned int tick;
+    unsigned int maxBundleSize; // max payload size of each RespondTickTransactionBundle, 0 = node default
+    unsigned char transactionFlags[NUMBER_OF_TRANSACTIONS_PER_TICK / 8]; // set bit = transaction of slot already known, skip it
+
+    enum {
+        type = 57,
+    };
+};
+
+struct RespondTickTransactionBundle
+{
+    unsigned int tick;
+    unsigned int numberOfTransactions;
+    unsigned char transactionFlags[NUMBER_OF_TRANSACTIONS_PER_TICK / 8]; // set bit = transaction of slot included in this bundle
+
+    // Followed by numberOfTransactions transactions (see Transaction::totalSize()) in ascending order of slot
+
+    enum {
+        type = 58,
+    };
+};
+
 #define REQUEST_TRANSACTION_INFO 26
 struct RequestedTransactionInfo
 {
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "network_messages/tick.h"
+#include "network_messages/computors.h"
+
+#include "public_settings.h"
+#include "system.h"
+#include "vote_counter.h"
+
+#define MAX_NUMBER_OF_MINERS 8192
+#define NUMBER_OF_MINER_SOLUTION_FLAGS 0x100000000
+
+// Node states that are not stored in their own file when saving all node states (file snapshotNodeMiningState).
+// Also read by tools replaying the ticks of a saved node state (tools/tick_replay).
+struct NodeStateBuffer
+{
+    Tick etalonTick;
+    m256i minerPublicKeys[MAX_NUMBER_OF_MINERS + 1];
+    unsigned int minerScores[MAX_NUMBER_OF_MINERS + 1];
+    m256i competitorPublicKeys[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
+    unsigned int competitorScores[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
+    bool competitorComputorStatuses[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
+    m256i currentRandomSeed;    
+    int solutionPublicationTicks[MAX_NUMBER_OF_SOLUTIONS];
+    unsigned long long faultyComputorFlags[(NUMBER_OF_COMPUTORS + 63) / 64];
+    unsigned char voteCounterData[VoteCounter::VoteCounterDataSize];
+    BroadcastComputors broadcastedComputors;
+    unsigned long long resourceTestingDigest;
+    unsigned int numberOfMiners;
+    unsigned int numberOfTransactions;
+    unsigned long long lastLogId;
+};
@@ -63,6 +63,18 @@ public:
         return 0;
     }
 
+    // Get lowest address of stack memory (stack grows downwards)
+    const char* bottom() const
+    {
+        return stackBottom;
+    }
+
+    // Get address after end of stack memory (initial stack pointer)
+    const char* top() const
+    {
+        return stackTop;
+    }
+
     // Prepare function call with run()
     void setupFunction(CustomStackProcessorFunc functionToCall, void* dataToPassToFunction)
     {
@@ -3,6 +3,7 @@
 #include <intrin.h>
 
 #ifdef NO_UEFI
+#include <cerrno>
 #include <cstdio>
 #endif
 
@@ -14,7 +15,9 @@
 // cluster size, try 16384.
 #define READING_CHUNK_SIZE 32768
 #define WRITING_CHUNK_SIZE 32768
+#ifndef FILE_CHUNK_SIZE
 #define FILE_CHUNK_SIZE (209715200ULL) // for large file saving
+#endif
 #define VOLUME_LABEL L"Qubic"
 
 static EFI_FILE_PROTOCOL* root = NULL;
@@ -275,6 +278,224 @@ static long long save(const CHAR16* fileName, unsigned long long totalSize, cons
 #endif
 }
 
+// Write totalSize bytes to file starting at position. The file is created if it does not exist. Existing content
+// outside of the written range is kept.
+static long long saveAt(const CHAR16* fileName, unsigned long long position, unsigned long long totalSize, const unsigned char* buffer, const CHAR16* directory = NULL)
+{
+#ifdef NO_UEFI
+    if (directory)
+    {
+        logToConsole(L"Argument directory not implemented for NO_UEFI saveAt()! Pass full path as fileName!");
+        return -1;
+    }
+    FILE* file = nullptr;
+    if ((_wfopen_s(&file, fileName, L"r+b") != 0 || !file) && (_wfopen_s(&file, fileName, L"wb") != 0 || !file))
+    {
+        wprintf(L"Error opening file %s!\n", fileName);
+        return -1;
+    }
+    if (_fseeki64(file, position, SEEK_SET) != 0 || fwrite(buffer, 1, totalSize, file) != totalSize)
+    {
+        wprintf(L"Error writing %llu bytes to %s!\n", totalSize, fileName);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    return totalSize;
+#else
+    EFI_STATUS status;
+    EFI_FILE_PROTOCOL* file = NULL;
+    EFI_FILE_PROTOCOL* directoryProtocol = NULL;
+
+    if (NULL != directory)
+    {
+        createDir(directory);
+
+        if (status = root->Open(root, (void**)&directoryProtocol, (CHAR16*)directory, EFI_FILE_MODE_READ, 0))
+        {
+            logStatusToConsole(L"FileIOSaveAt:OpenDir EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
+            return -1;
+        }
+
+        if (status = directoryProtocol->Open(directoryProtocol, (void**)&file, (CHAR16*)fileName, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0))
+        {
+            logStatusToConsole(L"FileIOSaveAt:OpenDir::OpenFile EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
+            directoryProtocol->Close(directoryProtocol);
+            return -1;
+        }
+        directoryProtocol->Close(directoryProtocol);
+    }
+    else
+    {
+        if (status = root->Open(root, (void**)&file, (CHAR16*)fileName, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0))
+        {
+            logStatusToConsole(L"FileIOSaveAt:OpenFile EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
+            return -1;
+        }
+    }
+
+    if (status = file->SetPosition(file, position))
+    {
+        logStatusToConsole(L"EFI_FILE_PROTOCOL.SetPosition() fails", status, __LINE__);
+        file->Close(file);
+        return -1;
+    }
+
+    unsigned long long writtenSize = 0;
+    while (writtenSize < totalSize)
+    {
+        unsigned long long size = (WRITING_CHUNK_SIZE <= (totalSize - writtenSize) ? WRITING_CHUNK_SIZE : (totalSize - writtenSize));
+        status = file->Write(file, &size, (void*)&buffer[writtenSize]);
+        if (status
+            || size != (WRITING_CHUNK_SIZE <= (totalSize - writtenSize) ? WRITING_CHUNK_SIZE : (totalSize - writtenSize)))
+        {
+            // If this error occurs, see the definition of WRITING_CHUNK_SIZE above.
+            logStatusToConsole(L"EFI_FILE_PROTOCOL.Write() fails", status, __LINE__);
+
+            file->Close(file);
+
+            return -1;
+        }
+        writtenSize += size;
+    }
+    file->Close(file);
+
+    return writtenSize;
+#endif
+}
+
+// Delete file if it exists. Returns false if the file exists but cannot be deleted.
+static bool removeFile(const CHAR16* fileName, const CHAR16* directory = NULL)
+{
+#ifdef NO_UEFI
+    if (directory)
+    {
+        logToConsole(L"Argument directory not implemented for NO_UEFI removeFile()! Pass full path as fileName!");
+        return false;
+    }
+    return _wremove((const wchar_t*)fileName) == 0 || errno == ENOENT;
+#else
+    EFI_STATUS status;
+    EFI_FILE_PROTOCOL* file = NULL;
+    EFI_FILE_PROTOCOL* directoryProtocol = NULL;
+
+    if (NULL != directory)
+    {
+        if (status = root->Open(root, (void**)&directoryProtocol, (CHAR16*)directory, EFI_FILE_MODE_READ, 0))
+        {
+            // no directory -> no file
+            return status == EFI_NOT_FOUND;
+        }
+        status = directoryProtocol->Open(directoryProtocol, (void**)&file, (CHAR16*)fileName, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0);
+        directoryProtocol->Close(directoryProtocol);
+    }
+    else
+    {
+        status = root->Open(root, (void**)&file, (CHAR16*)fileName, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0);
+    }
+    if (status == EFI_NOT_FOUND)
+    {
+        return true;
+    }
+    if (status)
+    {
+        logStatusToConsole(L"FileIORemove:OpenFile EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
+        return false;
+    }
+
+    // Delete() closes the file, also if it fails
+    if (status = file->Delete(file))
+    {
+        logStatusToConsole(L"EFI_FILE_PROTOCOL.Delete() fails", status, __LINE__);
+        return false;
+    }
+    return true;
+#endif
+}
+
+// Read totalSize bytes from file starting at position
+static long long loadAt(const CHAR16* fileName, unsigned long long position, unsigned long long totalSize, unsigned char* buffer, const CHAR16* directory = NULL)
+{
+#ifdef NO_UEFI
+    if (directory)
+    {
+        logToConsole(L"Argument directory not implemented for NO_UEFI loadAt()! Pass full path as fileName!");
+        return -1;
+    }
+    FILE* file = nullptr;
+    if (_wfopen_s(&file, fileName, L"rb") != 0 || !file)
+    {
+        wprintf(L"Error opening file %s!\n", fileName);
+        return -1;
+    }
+    if (_fseeki64(file, position, SEEK_SET) != 0 || fread(buffer, 1, totalSize, file) != totalSize)
+    {
+        wprintf(L"Error reading %llu bytes from %s!\n", totalSize, fileName);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    return totalSize;
+#else
+    EFI_STATUS status;
+    EFI_FILE_PROTOCOL* file = NULL;
+    EFI_FILE_PROTOCOL* directoryProtocol = NULL;
+
+    if (NULL != directory)
+    {
+        if (status = root->Open(root, (void**)&directoryProtocol, (CHAR16*)directory, EFI_FILE_MODE_READ, 0))
+        {
+            logStatusToConsole(L"FileIOLoadAt:OpenDir EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
+            return -1;
+        }
+
+        if (status = directoryProtocol->Open(directoryProtocol, (void**)&file, (CHAR16*)fileName, EFI_FILE_MODE_READ, 0))
+        {
+            logStatusToConsole(L"FileIOLoadAt:OpenDir::OpenFile EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
+            directoryProtocol->Close(directoryProtocol);
+            return -1;
+        }
+        directoryProtocol->Close(directoryProtocol);
+    }
+    else
+    {
+        if (status = root->Open(root, (void**)&file, (CHAR16*)fileName, EFI_FILE_MODE_READ, 0))
+        {
+            logStatusToConsole(L"FileIOLoadAt:OpenFile EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
+            return -1;
+        }
+    }
+
+    if (status = file->SetPosition(file, position))
+    {
+        logStatusToConsole(L"EFI_FILE_PROTOCOL.SetPosition() fails", status, __LINE__);
+        file->Close(file);
+        return -1;
+    }
+
+    unsigned long long readSize = 0;
+    while (readSize < totalSize)
+    {
+        unsigned long long size = (READING_CHUNK_SIZE <= (totalSize - readSize) ? READING_CHUNK_SIZE : (totalSize - readSize));
+        status = file->Read(file, &size, &buffer[readSize]);
+        if (status
+            || size != (READING_CHUNK_SIZE <= (totalSize - readSize) ? READING_CHUNK_SIZE : (totalSize - readSize)))
+        {
+            // If this error occurs, see the definition of READING_CHUNK_SIZE above.
+            logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() fails", status, __LINE__);
+
+            file->Close(file);
+
+            return -1;
+        }
+        readSize += size;
+    }
+    file->Close(file);
+
+    return readSize;
+#endif
+}
+
 
 static bool initFilesystem()
 {
@@ -403,6 +624,14 @@ static unsigned int getTextSize(CHAR16* text, int maximumSize)
     return result;
 }
 
+// Set name of chunk file chunkId of a large file (fileName.XXX)
+static void setLargeFileChunkName(CHAR16* chunkFileName, const CHAR16* fileName, int chunkId)
+{
+    setText(chunkFileName, fileName);
+    appendText(chunkFileName, L".XXX");
+    addEpochToFileName(chunkFileName, getTextSize(chunkFileName, 64) + 1, chunkId);
+}
+
 // Break the large file to many chunks to write if the size is greater or equal FILE_CHUNK_SIZE
 // - skipWriteEqualChunkSize: skip write the chunk file if the size of existed file match with buffer data. Set false if need the write always happens
 static long long saveLargeFile(CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, CHAR16* directory = NULL, bool skipWriteEqualChunkSize = true)
@@ -415,9 +644,7 @@ static long long saveLargeFile(CHAR16* fileName, unsigned long long totalSize, u
     unsigned long long totalWriteSize = 0;
     while (totalSize) {
         CHAR16 fileNameWithChunkId[64];
-        setText(fileNameWithChunkId, fileName);
-        appendText(fileNameWithChunkId, L".XXX");
-        addEpochToFileName(fileNameWithChunkId, getTextSize(fileNameWithChunkId, 64) + 1, chunkId);
+        setLargeFileChunkName(fileNameWithChunkId, fileName, chunkId);
         const unsigned long long writeSize = maxWriteSizePerChunk < totalSize ? maxWriteSizePerChunk : totalSize;
         long long existFileSize = getFileSize(fileNameWithChunkId, directory);
         if (!skipWriteEqualChunkSize || (existFileSize != writeSize)) {
@@ -444,9 +671,7 @@ static long long loadLargeFile(CHAR16* fileName, unsigned long long totalSize, u
     unsigned long long totalReadSize = 0;
     while (totalSize) {
         CHAR16 fileNameWithChunkId[64];
-        setText(fileNameWithChunkId, fileName);
-        appendText(fileNameWithChunkId, L".XXX");
-        addEpochToFileName(fileNameWithChunkId, getTextSize(fileNameWithChunkId, 64) + 1, chunkId);
+        setLargeFileChunkName(fileNameWithChunkId, fileName, chunkId);
         const unsigned long long readSize = maxReadSizePerChunk < totalSize ? maxReadSizePerChunk : totalSize;
         unsigned long long res = load(fileNameWithChunkId, readSize, buffer, directory);
         if (res != readSize) {
@@ -34,6 +34,10 @@ static const unsigned char whiteListPeers[][4] = {
 #define LOG_CONTRACT_INFO_MESSAGES 0
 #define LOG_CONTRACT_DEBUG_MESSAGES 0
 #define LOG_CUSTOM_MESSAGES 0
+// Persist all logs of the current epoch to disk (directory "logs"), so RequestLog can be served for the full epoch.
+// With "0", logs are only kept in the RAM ring buffer of LOG_BUFFER_SIZE bytes and old logs are overwritten.
+// With "1", LOG_BUFFER_SIZE may be reduced (define it here, it must be a multiple of LOG_SEGMENT_SIZE).
+#define LOG_PERSIST_TO_DISK 0
 static unsigned long long logReaderPasscodes[4] = {
     0, 0, 0, 0 // REMOVE THIS ENTRY AND REPLACE IT WITH YOUR OWN RANDOM NUMBERS IN [0..18446744073709551615] RANGE IF LOGGING IS ENABLED
 };
@@ -48,4 +52,21 @@ static unsigned long long logReaderPasscodes[4] = {
 // Perform state persisting when your node is misaligned will also make your node misaligned after resuming.
 // Thus, picking various TICK_STORAGE_AUTOSAVE_TICK_PERIOD numbers across AUX nodes is recommended.
 // some suggested prime numbers you can try: 971 977 983 991 997
-#define TICK_STORAGE_AUTOSAVE_TICK_PERIOD 1000
\ No newline at end of file
+#define TICK_STORAGE_AUTOSAVE_TICK_PERIOD 1000
+// Number of delta snapshots saved between two full snapshots of the node states. A delta snapshot only contains the
+// pages of spectrum, universe, contract states and digests that have been changed since the previous snapshot.
+// Loading applies the deltas to the last full snapshot. 0 disables delta snapshots.
+#define TICK_STORAGE_AUTOSAVE_MAX_DELTAS 10
+// Save spectrum, universe, contract and tick storage files in compressed format (only non-empty slots, compressed
+// blocks with checksums). Files of both formats can be loaded, but other tools reading these files (e.g. the epoch
+// files distributed to other nodes) may only support the raw format.
+#define COMPRESSED_STATE_FILES 0
+
+// Archive finalized ticks (quorum votes, tick data, and transactions) to disk (directory "archive"), so RequestQuorumTick,
+// RequestTickData, RequestTickTransactions, and RequestTransactionInfo can be served for ticks of previous epochs.
+// Requires about 300 MB of additional RAM for the segment directory and the page cache.
+#define TICK_ARCHIVE 0
+
+// Index the transactions of each entity in the current epoch by spectrum index, so RequestEntityTxHistory can be served.
+// Requires about 576 MB of additional RAM.
+#define ENTITY_TX_HISTORY 0
\ No newline at end of file
@@ -16,9 +16,16 @@
 // is MAX_NUMBER_OF_PROCESSORS - 1.
 #define NUMBER_OF_CONTRACT_EXECUTION_BUFFERS 10
 
+// Number of processors used for executing independent contract procedure transactions of a tick in parallel (experimental,
+// see contract_core/speculative_execution.h). Each of these processors reserves about 70 MB plus the total size of all contract
+// states. 0 means all transactions are executed sequentially by the contract processor. Not used if any logging is enabled.
+#define NUMBER_OF_SPECULATIVE_CONTRACT_PROCESSORS 0
+
 #define USE_SCORE_CACHE 1
 #define SCORE_CACHE_SIZE 2000000 // the larger the better
 #define SCORE_CACHE_COLLISION_RETRIES 20 // number of retries to find entry in cache in case of hash collision
+#define USE_SCORE_HELPERS 1 // idle processors help to compute the neuron ticks of solutions scored by other processors
+#define USE_SCORE_BIT_PLANE_KERNEL 0 // score kernel that keeps neuron values as bit-planes instead of one byte per neuron (experimental)
 
 // Number of ticks from prior epoch that are kept after seamless epoch transition. These can be requested after transition.
 #define TICKS_TO_KEEP_FROM_PRIOR_EPOCH 100
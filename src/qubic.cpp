@@ -46,24 +46,31 @@
 
 #include "logging/logging.h"
 #include "logging/net_msg_impl.h"
+#include "logging/disk_storage_impl.h"
 
 #include "tick_storage.h"
+#include "tick_validation.h"
+#include "state_snapshot.h"
+#include "state_loader.h"
+#include "tick_sync.h"
+#include "tick_archive.h"
+#include "entity_tx_history.h"
 #include "vote_counter.h"
+#include "node_state.h"
+#include "tick_processing.h"
 
 #include "addons/tx_status_request.h"
 
 #include "files/files.h"
 #include "mining/mining.h"
+#include "mining/miner_scores.h"
 #include "oracles/oracle_machines.h"
 
 ////////// Qubic \\\\\\\\\\
 
 #define CONTRACT_STATES_DEPTH 10 // Is derived from MAX_NUMBER_OF_CONTRACTS (=N)
 #define TICK_REQUESTING_PERIOD 500ULL
-#define MAX_NUMBER_EPOCH 1000ULL
 #define INVALIDATED_TICK_DATA (MAX_NUMBER_EPOCH+1)
-#define MAX_NUMBER_OF_MINERS 8192
-#define NUMBER_OF_MINER_SOLUTION_FLAGS 0x100000000
 #define MAX_MESSAGE_PAYLOAD_SIZE MAX_TRANSACTION_SIZE
 #define MAX_UNIVERSE_SIZE 1073741824
 #define MESSAGE_DISSEMINATION_THRESHOLD 1000000000
@@ -73,12 +80,11 @@
 #define TICK_TRANSACTIONS_PUBLICATION_OFFSET 2 // Must be only 2
 #define TICK_VOTE_COUNTER_PUBLICATION_OFFSET 4 // Must be at least 3+: 1+ for tx propagration + 1 for tickData propagration + 1 for vote propagration
 #define MIN_MINING_SOLUTIONS_PUBLICATION_OFFSET 3 // Must be 3+
-#define TIME_ACCURACY 5000
 
 
 struct Processor : public CustomStack
 {
-    enum Type { Unused = 0, RequestProcessor, TickProcessor, ContractProcessor };
+    enum Type { Unused = 0, RequestProcessor, TickProcessor, ContractProcessor, SpeculativeContractProcessor };
     Type type;
     EFI_EVENT event;
     Peer* peer;
@@ -95,7 +101,6 @@ static volatile unsigned char mainAuxStatus = 0;
 static volatile bool forceRefreshPeerList = false;
 static volatile bool forceNextTick = false;
 static volatile bool forceSwitchEpoch = false;
-static volatile char criticalSituation = 0;
 static volatile bool systemMustBeSaved = false, spectrumMustBeSaved = false, universeMustBeSaved = false, computerMustBeSaved = false;
 
 static int misalignedState = 0;
@@ -106,34 +111,20 @@ static volatile long epochTransitionWaitingRequestProcessors = 0;
 static m256i operatorPublicKey;
 static m256i computorSubseeds[sizeof(computorSeeds) / sizeof(computorSeeds[0])];
 static m256i computorPrivateKeys[sizeof(computorSeeds) / sizeof(computorSeeds[0])];
-static m256i computorPublicKeys[sizeof(computorSeeds) / sizeof(computorSeeds[0])];
-static m256i arbitratorPublicKey;
-
-BroadcastComputors broadcastedComputors;
-
-// data closely related to system
-static int solutionPublicationTicks[MAX_NUMBER_OF_SOLUTIONS]; // scheduled tick to broadcast solution, -1 means already broadcasted, -2 means obsolete solution
-#define SOLUTION_RECORDED_FLAG -1
-#define SOLUTION_OBSOLETE_FLAG -2
-
-static unsigned long long faultyComputorFlags[(NUMBER_OF_COMPUTORS + 63) / 64];
 static unsigned int tickNumberOfComputors = 0, tickTotalNumberOfComputors = 0, futureTickTotalNumberOfComputors = 0;
 static unsigned int nextTickTransactionsSemaphore = 0, numberOfNextTickTransactions = 0, numberOfKnownNextTickTransactions = 0;
 static unsigned short numberOfOwnComputorIndices;
 static unsigned short ownComputorIndices[sizeof(computorSeeds) / sizeof(computorSeeds[0])];
 static unsigned short ownComputorIndicesMapping[sizeof(computorSeeds) / sizeof(computorSeeds[0])];
 
-static TickStorage ts;
-static VoteCounter voteCounter;
-static Tick etalonTick;
-static TickData nextTickData;
+static TickSync tickSync;
+#if TICK_ARCHIVE
+static TickArchive tickArchive;
+#endif
 
 static m256i uniqueNextTickTransactionDigests[NUMBER_OF_COMPUTORS];
 static unsigned int uniqueNextTickTransactionDigestCounters[NUMBER_OF_COMPUTORS];
 
-static unsigned long long resourceTestingDigest = 0;
-
-static unsigned int numberOfTransactions = 0;
 static volatile char entityPendingTransactionsLock = 0;
 static unsigned char* entityPendingTransactions = NULL;
 static unsigned char* entityPendingTransactionDigests = NULL;
@@ -141,16 +132,9 @@ static unsigned int entityPendingTransactionIndices[SPECTRUM_CAPACITY]; // [SPEC
 static volatile char computorPendingTransactionsLock = 0;
 static unsigned char* computorPendingTransactions = NULL;
 static unsigned char* computorPendingTransactionDigests = NULL;
-static unsigned long long spectrumChangeFlags[SPECTRUM_CAPACITY / (sizeof(unsigned long long) * 8)];
 
 static unsigned long long mainLoopNumerator = 0, mainLoopDenominator = 0;
-static unsigned char contractProcessorState = 0;
-static unsigned int contractProcessorPhase;
-static const Transaction* contractProcessorTransaction = 0;
-static int contractProcessorTransactionMoneyflew = 0;
 static EFI_EVENT contractProcessorEvent;
-static m256i contractStateDigests[MAX_NUMBER_OF_CONTRACTS * 2 - 1];
-const unsigned long long contractStateDigestsSizeInBytes = sizeof(contractStateDigests);
 
 // targetNextTickDataDigestIsKnown == true signals that we need to fetch TickData (update the version in this node)
 // targetNextTickDataDigestIsKnown == false means there is no consensus on next tick data yet
@@ -158,10 +142,6 @@ static bool targetNextTickDataDigestIsKnown = false;
 static m256i targetNextTickDataDigest;
 static unsigned long long tickTicks[11];
 
-static m256i releasedPublicKeys[NUMBER_OF_COMPUTORS];
-static long long releasedAmounts[NUMBER_OF_COMPUTORS];
-static unsigned int numberOfReleasedEntities;
-
 static EFI_MP_SERVICES_PROTOCOL* mpServicesProtocol;
 static unsigned int numberOfProcessors = 0;
 static Processor processors[MAX_NUMBER_OF_PROCESSORS];
@@ -170,6 +150,7 @@ static Processor processors[MAX_NUMBER_OF_PROCESSORS];
 static unsigned long long tickProcessorIDs[MAX_NUMBER_OF_PROCESSORS]; // a list of proc id that run function tickProcessor
 static unsigned long long requestProcessorIDs[MAX_NUMBER_OF_PROCESSORS]; // a list of proc id that run function requestProcessor
 static unsigned long long contractProcessorIDs[MAX_NUMBER_OF_PROCESSORS]; // a list of proc id that run function contractProcessor
+static unsigned long long speculativeContractProcessorIDs[MAX_NUMBER_OF_PROCESSORS]; // a list of proc id that run function speculativeContractProcessor
 
 static unsigned long long solutionProcessorIDs[MAX_NUMBER_OF_PROCESSORS]; // a list of proc id that will process solution
 static bool solutionProcessorFlags[MAX_NUMBER_OF_PROCESSORS]; // flag array to indicate that whether a procId should help processing solutions or not
@@ -177,33 +158,11 @@ static unsigned long long mainThreadProcessorID = -1;
 static int nTickProcessorIDs = 0;
 static int nRequestProcessorIDs = 0;
 static int nContractProcessorIDs = 0;
+static unsigned int speculativeContractProcessorNumbers[MAX_NUMBER_OF_PROCESSORS]; // indices in processors[] of the speculative contract processors
 static int nSolutionProcessorIDs = 0;
 
 
 
-static ScoreFunction<
-    DATA_LENGTH,
-    NUMBER_OF_HIDDEN_NEURONS, 
-    NUMBER_OF_NEIGHBOR_NEURONS,
-    MAX_DURATION,
-    NUMBER_OF_SOLUTION_PROCESSORS
-> * score = nullptr;
-static volatile char solutionsLock = 0;
-static unsigned long long* minerSolutionFlags = NULL;
-static volatile m256i minerPublicKeys[MAX_NUMBER_OF_MINERS + 1];
-static volatile unsigned int minerScores[MAX_NUMBER_OF_MINERS + 1];
-static volatile unsigned int numberOfMiners = NUMBER_OF_COMPUTORS;
-static m256i competitorPublicKeys[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
-static unsigned int competitorScores[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
-static bool competitorComputorStatuses[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
-static unsigned int minimumComputorScore = 0, minimumCandidateScore = 0;
-static int solutionThreshold[MAX_NUMBER_EPOCH] = { -1 };
-static unsigned long long solutionTotalExecutionTicks = 0;
-static unsigned long long K12TotalExecutionTicks = 0;
-static unsigned long long K12StartingExecutionTicks = 0;
-int K12GlobalIndex = 0;
-static unsigned long long K12MeasurementsSum = 0;
-static volatile char minerScoreArrayLock = 0;
 static SpecialCommandGetMiningScoreRanking<MAX_NUMBER_OF_MINERS> requestMiningScoreRanking;
 
 
@@ -213,26 +172,6 @@ static volatile int persistingNodeStateTickProcWaiting = 0;
 static m256i initialRandomSeedFromPersistingState;
 static bool loadMiningSeedFromFile = false;
 static bool loadAllNodeStateFromFile = false;
-#if TICK_STORAGE_AUTOSAVE_MODE
-struct
-{
-    Tick etalonTick;
-    m256i minerPublicKeys[MAX_NUMBER_OF_MINERS + 1];
-    unsigned int minerScores[MAX_NUMBER_OF_MINERS + 1];
-    m256i competitorPublicKeys[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
-    unsigned int competitorScores[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
-    bool competitorComputorStatuses[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
-    m256i currentRandomSeed;    
-    int solutionPublicationTicks[MAX_NUMBER_OF_SOLUTIONS];
-    unsigned long long faultyComputorFlags[(NUMBER_OF_COMPUTORS + 63) / 64];
-    unsigned char voteCounterData[VoteCounter::VoteCounterDataSize];
-    BroadcastComputors broadcastedComputors;
-    unsigned long long resourceTestingDigest;
-    unsigned int numberOfMiners;
-    unsigned int numberOfTransactions;
-    unsigned long long lastLogId;
-} nodeStateBuffer;
-#endif
 static bool saveComputer(CHAR16* directory = NULL);
 static bool saveSystem(CHAR16* directory = NULL);
 static bool loadComputer(CHAR16* directory = NULL, bool forceLoadFromFile = false);
@@ -269,6 +208,12 @@ static struct
     RequestedTickTransactions requestedTickTransactions;
 } requestedTickTransactions;
 
+static struct
+{
+    RequestResponseHeader header;
+    RequestTickRange requestTickRange;
+} requestedTickRange;
+
 static struct {
     unsigned char day;
     unsigned char hour;
@@ -340,19 +285,6 @@ static void logToConsole(const CHAR16* message)
 }
 
 
-static int computorIndex(m256i computor)
-{
-    for (int computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
-    {
-        if (broadcastedComputors.computors.publicKeys[computorIndex] == computor)
-        {
-            return computorIndex;
-        }
-    }
-
-    return -1;
-}
-
 // NOTE: this function doesn't work well on a few CPUs, some bits will be flipped after calling this. It's probably microcode bug.
 static void enableAVX()
 {
@@ -364,63 +296,6 @@ static void enableAVX()
         ));
 }
 
-// Should only be called from tick processor to avoid concurrent state changes, which can cause race conditions as detailed in FIXME below.
-static void getComputerDigest(m256i& digest)
-{
-    unsigned int digestIndex;
-    for (digestIndex = 0; digestIndex < MAX_NUMBER_OF_CONTRACTS; digestIndex++)
-    {
-        if (contractStateChangeFlags[digestIndex >> 6] & (1ULL << (digestIndex & 63)))
-        {
-            const unsigned long long size = digestIndex < contractCount ? contractDescriptions[digestIndex].stateSize : 0;
-            if (!size)
-            {
-                contractStateDigests[digestIndex] = m256i::zero();
-            }
-            else
-            {
-                // FIXME: We may have a race condition here if a digest is computed here by thread A, the state is changed
-                // + contractStateChangeFlags set afterwards by thread B and contractStateChangeFlags cleared below below
-                // by thread A. We then have a changed state but a cleared contractStateChangeFlags flag leading to wrong
-                // digest.
-                // This is currently avoided by calling getComputerDigest() from tick processor only (and in non-concurrent init)
-                contractStateLock[digestIndex].acquireRead();
-
-                K12StartingExecutionTicks = __rdtsc();
-                KangarooTwelve(contractStates[digestIndex], (unsigned int)size, &contractStateDigests[digestIndex], 32);
-                K12TotalExecutionTicks = __rdtsc() - K12StartingExecutionTicks;
-                if (K12GlobalIndex < 500)
-                {
-                    K12MeasurementsSum += K12TotalExecutionTicks;
-                    K12GlobalIndex++;
-                }
-                contractStateLock[digestIndex].releaseRead();
-            }
-        }
-    }
-    unsigned int previousLevelBeginning = 0;
-    unsigned int numberOfLeafs = MAX_NUMBER_OF_CONTRACTS;
-    while (numberOfLeafs > 1)
-    {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-        {
-            if (contractStateChangeFlags[i >> 6] & (3ULL << (i & 63)))
-            {
-                KangarooTwelve64To32(&contractStateDigests[previousLevelBeginning + i], &contractStateDigests[digestIndex]);
-                contractStateChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
-                contractStateChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
-            }
-            digestIndex++;
-        }
-        previousLevelBeginning += numberOfLeafs;
-        numberOfLeafs >>= 1;
-    }
-    contractStateChangeFlags[0] = 0;
-
-    digest = contractStateDigests[(MAX_NUMBER_OF_CONTRACTS * 2 - 1) - 1];
-}
-
-
 static void processExchangePublicPeers(Peer* peer, RequestResponseHeader* header)
 {
     if (!peer->exchangedPublicPeers)
@@ -607,15 +482,14 @@ static void processBroadcastComputors(Peer* peer, RequestResponseHeader* header)
             // Copy computor list
             bs->CopyMem(&broadcastedComputors.computors, &request->computors, sizeof(Computors));
 
-            // Update ownComputorIndices and minerPublicKeys
+            // Update ownComputorIndices and computors in minerScores
             if (request->computors.epoch == system.epoch)
             {
                 numberOfOwnComputorIndices = 0;
                 ACQUIRE(minerScoreArrayLock);
+                minerScores.setComputors(request->computors.publicKeys);
                 for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
                 {
-                    minerPublicKeys[i] = request->computors.publicKeys[i];
-
                     for (unsigned int j = 0; j < sizeof(computorSeeds) / sizeof(computorSeeds[0]); j++)
                     {
                         if (request->computors.publicKeys[i] == computorPublicKeys[j])
@@ -636,150 +510,78 @@ static void processBroadcastComputors(Peer* peer, RequestResponseHeader* header)
 static void processBroadcastTick(Peer* peer, RequestResponseHeader* header)
 {
     BroadcastTick* request = header->getPayload<BroadcastTick>();
-    if (request->tick.computorIndex < NUMBER_OF_COMPUTORS
-        && request->tick.epoch == system.epoch
-        && request->tick.tick >= system.tick
+    if (request->tick.tick >= system.tick
         && ts.tickInCurrentEpochStorage(request->tick.tick)
-        && request->tick.month >= 1 && request->tick.month <= 12
-        && request->tick.day >= 1 && request->tick.day <= ((request->tick.month == 1 || request->tick.month == 3 || request->tick.month == 5 || request->tick.month == 7 || request->tick.month == 8 || request->tick.month == 10 || request->tick.month == 12) ? 31 : ((request->tick.month == 4 || request->tick.month == 6 || request->tick.month == 9 || request->tick.month == 11) ? 30 : ((request->tick.year & 3) ? 28 : 29)))
-        && request->tick.hour <= 23
-        && request->tick.minute <= 59
-        && request->tick.second <= 59
-        && request->tick.millisecond <= 999)
+        && isValidVote(&request->tick, broadcastedComputors.computors.publicKeys))
     {
-        unsigned char digest[32];
-        request->tick.computorIndex ^= BroadcastTick::type;
-        KangarooTwelve(&request->tick, sizeof(Tick) - SIGNATURE_SIZE, digest, sizeof(digest));
-        request->tick.computorIndex ^= BroadcastTick::type;
-        if (verify(broadcastedComputors.computors.publicKeys[request->tick.computorIndex].m256i_u8, digest, request->tick.signature))
+        if (header->isDejavuZero())
         {
-            if (header->isDejavuZero())
-            {
-                enqueueResponse(NULL, header);
-            }
+            enqueueResponse(NULL, header);
+        }
 
-            ts.ticks.acquireLock(request->tick.computorIndex);
+        tickSync.updateLatestKnownTick(request->tick.tick);
 
-            // Find element in tick storage and check if contains data (epoch is set to 0 on init)
-            Tick* tsTick = ts.ticks.getByTickInCurrentEpoch(request->tick.tick) + request->tick.computorIndex;
-            if (tsTick->epoch == system.epoch)
-            {
-                // Check if the sent tick matches the tick in tick storage
-                if (*((unsigned long long*)&request->tick.millisecond) != *((unsigned long long*)&tsTick->millisecond)
-                    || request->tick.prevSpectrumDigest != tsTick->prevSpectrumDigest
-                    || request->tick.prevUniverseDigest != tsTick->prevUniverseDigest
-                    || request->tick.prevComputerDigest != tsTick->prevComputerDigest
-                    || request->tick.saltedSpectrumDigest != tsTick->saltedSpectrumDigest
-                    || request->tick.saltedUniverseDigest != tsTick->saltedUniverseDigest
-                    || request->tick.saltedComputerDigest != tsTick->saltedComputerDigest
-                    || request->tick.transactionDigest != tsTick->transactionDigest
-                    || request->tick.expectedNextTickTransactionDigest != tsTick->expectedNextTickTransactionDigest)
-                {
-                    faultyComputorFlags[request->tick.computorIndex >> 6] |= (1ULL << (request->tick.computorIndex & 63));
-                }
-            }
-            else
-            {
-                // Copy the sent tick to the tick storage
-                bs->CopyMem(tsTick, &request->tick, sizeof(Tick));
-            }
+        ts.ticks.acquireLock(request->tick.computorIndex);
 
-            ts.ticks.releaseLock(request->tick.computorIndex);
+        // Find element in tick storage and check if contains data (epoch is set to 0 on init)
+        Tick* tsTick = ts.ticks.getByTickInCurrentEpoch(request->tick.tick) + request->tick.computorIndex;
+        if (tsTick->epoch == system.epoch)
+        {
+            // Check if the sent tick matches the tick in tick storage
+            checkVoteConflict(request->tick, *tsTick);
+        }
+        else
+        {
+            // Copy the sent tick to the tick storage
+            bs->CopyMem(tsTick, &request->tick, sizeof(Tick));
         }
+
+        ts.ticks.releaseLock(request->tick.computorIndex);
     }
 }
 
 static void processBroadcastFutureTickData(Peer* peer, RequestResponseHeader* header)
 {
     BroadcastFutureTickData* request = header->getPayload<BroadcastFutureTickData>();
-    if (request->tickData.epoch == system.epoch
-        && request->tickData.tick > system.tick
+    if (request->tickData.tick > system.tick
         && ts.tickInCurrentEpochStorage(request->tickData.tick)
-        && request->tickData.tick % NUMBER_OF_COMPUTORS == request->tickData.computorIndex
-        && request->tickData.month >= 1 && request->tickData.month <= 12
-        && request->tickData.day >= 1 && request->tickData.day <= ((request->tickData.month == 1 || request->tickData.month == 3 || request->tickData.month == 5 || request->tickData.month == 7 || request->tickData.month == 8 || request->tickData.month == 10 || request->tickData.month == 12) ? 31 : ((request->tickData.month == 4 || request->tickData.month == 6 || request->tickData.month == 9 || request->tickData.month == 11) ? 30 : ((request->tickData.year & 3) ? 28 : 29)))
-        && request->tickData.hour <= 23
-        && request->tickData.minute <= 59
-        && request->tickData.second <= 59
-        && request->tickData.millisecond <= 999
-        && ms(request->tickData.year, request->tickData.month, request->tickData.day, request->tickData.hour, request->tickData.minute, request->tickData.second, request->tickData.millisecond) <= ms(utcTime.Year - 2000, utcTime.Month, utcTime.Day, utcTime.Hour, utcTime.Minute, utcTime.Second, utcTime.Nanosecond / 1000000) + TIME_ACCURACY)
-    {
-        bool ok = true;
-        for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK && ok; i++)
+        && isValidTickData(&request->tickData, broadcastedComputors.computors.publicKeys))
+    {
+        if (header->isDejavuZero())
+        {
+            enqueueResponse(NULL, header);
+        }
+
+        ts.tickData.acquireLock();
+        TickData& td = ts.tickData.getByTickInCurrentEpoch(request->tickData.tick);
+        if (td.epoch != INVALIDATED_TICK_DATA)
         {
-            if (!isZero(request->tickData.transactionDigests[i]))
+            if (request->tickData.tick == system.tick + 1 && targetNextTickDataDigestIsKnown)
             {
-                for (unsigned int j = 0; j < i; j++)
+                if (!isZero(targetNextTickDataDigest))
                 {
-                    if (request->tickData.transactionDigests[i] == request->tickData.transactionDigests[j])
+                    unsigned char digest[32];
+                    KangarooTwelve(&request->tickData, sizeof(TickData), digest, 32);
+                    if (digest == targetNextTickDataDigest)
                     {
-                        ok = false;
-
-                        break;
+                        bs->CopyMem(&td, &request->tickData, sizeof(TickData));
                     }
                 }
             }
-        }
-        if (ok)
-        {
-            unsigned char digest[32];
-            request->tickData.computorIndex ^= BroadcastFutureTickData::type;
-            KangarooTwelve(&request->tickData, sizeof(TickData) - SIGNATURE_SIZE, digest, sizeof(digest));
-            request->tickData.computorIndex ^= BroadcastFutureTickData::type;
-            if (verify(broadcastedComputors.computors.publicKeys[request->tickData.computorIndex].m256i_u8, digest, request->tickData.signature))
+            else
             {
-                if (header->isDejavuZero())
+                if (td.epoch == system.epoch)
                 {
-                    enqueueResponse(NULL, header);
+                    // Tick data already available. Mark computor as faulty if the data that was sent differs.
+                    checkTickDataConflict(request->tickData, td);
                 }
-
-                ts.tickData.acquireLock();
-                TickData& td = ts.tickData.getByTickInCurrentEpoch(request->tickData.tick);
-                if (td.epoch != INVALIDATED_TICK_DATA)
+                else
                 {
-                    if (request->tickData.tick == system.tick + 1 && targetNextTickDataDigestIsKnown)
-                    {
-                        if (!isZero(targetNextTickDataDigest))
-                        {
-                            unsigned char digest[32];
-                            KangarooTwelve(&request->tickData, sizeof(TickData), digest, 32);
-                            if (digest == targetNextTickDataDigest)
-                            {
-                                bs->CopyMem(&td, &request->tickData, sizeof(TickData));
-                            }
-                        }
-                    }
-                    else
-                    {
-                        if (td.epoch == system.epoch)
-                        {
-                            // Tick data already available. Mark computor as faulty if the data that was sent differs.
-                            if (*((unsigned long long*) & request->tickData.millisecond) != *((unsigned long long*) & td.millisecond))
-                            {
-                                faultyComputorFlags[request->tickData.computorIndex >> 6] |= (1ULL << (request->tickData.computorIndex & 63));
-                            }
-                            else
-                            {
-                                for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
-                                {
-                                    if (request->tickData.transactionDigests[i] != td.transactionDigests[i])
-                                    {
-                                        faultyComputorFlags[request->tickData.computorIndex >> 6] |= (1ULL << (request->tickData.computorIndex & 63));
-
-                                        break;
-                                    }
-                                }
-                            }
-                        }
-                        else
-                        {
-                            bs->CopyMem(&td, &request->tickData, sizeof(TickData));
-                        }
-                    }
+                    bs->CopyMem(&td, &request->tickData, sizeof(TickData));
                 }
-                ts.tickData.releaseLock();
             }
         }
+        ts.tickData.releaseLock();
     }
 }
 
@@ -923,6 +725,12 @@ static void processRequestQuorumTick(Peer* peer, RequestResponseHeader* header)
             computorIndices[index] = computorIndices[--numberOfComputorIndices];
         }
     }
+#if TICK_ARCHIVE
+    else if (tickArchive.respondTickRequest(peer, header->dejavu(), RequestQuorumTick::type, request->quorumTick.tick, request->quorumTick.voteFlags, sizeof(request->quorumTick.voteFlags)))
+    {
+        return;
+    }
+#endif
     enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
 }
 
@@ -936,28 +744,47 @@ static void processRequestTickData(Peer* peer, RequestResponseHeader* header)
     }
     else
     {
+#if TICK_ARCHIVE
+        if (tickArchive.respondTickRequest(peer, header->dejavu(), RequestTickData::type, request->requestedTickData.tick, NULL, 0))
+        {
+            return;
+        }
+#endif
         enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
     }
 }
 
-static void processRequestTickTransactions(Peer* peer, RequestResponseHeader* header)
-{
-    RequestedTickTransactions* request = header->getPayload<RequestedTickTransactions>();
+static_assert(sizeof(RequestResponseHeader) + sizeof(RespondTickRange) + TICK_SYNC_MAX_TICK_SIZE <= BUFFER_SIZE, "Tick range response does not fit into processor buffer");
 
-    unsigned short tickEpoch = 0;
-    const unsigned long long* tsReqTickTransactionOffsets;
-    if (ts.tickInCurrentEpochStorage(request->tick))
+static void processRequestTickRange(Peer* peer, RequestResponseHeader* header)
+{
+    const unsigned int dejavu = header->dejavu();
+    if (header->size() == sizeof(RequestResponseHeader) + sizeof(RequestTickRange))
     {
-        tickEpoch = system.epoch;
-        tsReqTickTransactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(request->tick);
+        // copy request, because the processor buffer holding it is reused to build the responses
+        const RequestTickRange request = *header->getPayload<RequestTickRange>();
+        tickSync.respondTickRange(peer, dejavu, request, (unsigned char*)header);
     }
-    else if (ts.tickInPreviousEpochStorage(request->tick))
+    else
     {
-        tickEpoch = system.epoch - 1;
-        tsReqTickTransactionOffsets = ts.tickTransactionOffsets.getByTickInPreviousEpoch(request->tick);
+        enqueueResponse(peer, 0, EndResponse::type, dejavu, NULL);
     }
+}
 
-    if (tickEpoch != 0)
+static void processRespondTickRange(Peer* peer, RequestResponseHeader* header)
+{
+    if (broadcastedComputors.computors.epoch == system.epoch)
+    {
+        tickSync.processRespondTickRange(header->getPayload<RespondTickRange>(), header->getPayloadSize(), broadcastedComputors.computors.publicKeys);
+    }
+}
+
+static void processRequestTickTransactions(Peer* peer, RequestResponseHeader* header)
+{
+    RequestedTickTransactions* request = header->getPayload<RequestedTickTransactions>();
+
+    const unsigned long long* tsReqTickTransactionOffsets = ts.tickTransactionOffsets.getByTickIfStored(request->tick);
+    if (tsReqTickTransactionOffsets)
     {
         unsigned short tickTransactionIndices[NUMBER_OF_TRANSACTIONS_PER_TICK];
         unsigned short numberOfTickTransactions;
@@ -996,9 +823,22 @@ static void processRequestTickTransactions(Peer* peer, RequestResponseHeader* he
             tickTransactionIndices[index] = tickTransactionIndices[--numberOfTickTransactions];
         }
     }
+#if TICK_ARCHIVE
+    else if (tickArchive.respondTickRequest(peer, header->dejavu(), REQUEST_TICK_TRANSACTIONS, request->tick, request->transactionFlags, sizeof(request->transactionFlags)))
+    {
+        return;
+    }
+#endif
     enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
 }
 
+static_assert(TICK_TRANSACTION_BUNDLE_MAX_SIZE <= BUFFER_SIZE, "Tick transaction bundle does not fit into processor buffer");
+
+static void processRequestTickTransactionBundle(Peer* peer, RequestResponseHeader* header)
+{
+    tickSync.processRequestTickTransactionBundle(peer, header);
+}
+
 static void processRequestTransactionInfo(Peer* peer, RequestResponseHeader* header)
 {
     RequestedTransactionInfo* request = header->getPayload<RequestedTransactionInfo>();
@@ -1009,6 +849,12 @@ static void processRequestTransactionInfo(Peer* peer, RequestResponseHeader* hea
     }
     else
     {
+#if TICK_ARCHIVE
+        if (tickArchive.respondTransactionInfo(peer, header->dejavu(), request->txDigest))
+        {
+            return;
+        }
+#endif
         enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
     }
 }
@@ -1072,6 +918,111 @@ static void processRequestEntity(Peer* peer, RequestResponseHeader* header)
     enqueueResponse(peer, sizeof(respondedEntity), RESPOND_ENTITY, header->dejavu(), &respondedEntity);
 }
 
+static_assert(sizeof(RespondEntities) + MAX_NUMBER_OF_ENTITIES_PER_REQUEST * (sizeof(RespondedEntitiesEntry) + SPECTRUM_DEPTH * sizeof(m256i))
+    + MAX_NUMBER_OF_ENTITIES_PER_REQUEST * (sizeof(m256i) + sizeof(unsigned int)) <= BUFFER_SIZE, "Entities response does not fit into processor buffer");
+
+static void processRequestEntities(Peer* peer, RequestResponseHeader* header)
+{
+    const unsigned int dejavu = header->dejavu();
+    const unsigned int numberOfPublicKeys = header->getPayloadSize() / sizeof(m256i);
+    if (!numberOfPublicKeys || numberOfPublicKeys > MAX_NUMBER_OF_ENTITIES_PER_REQUEST || header->getPayloadSize() != numberOfPublicKeys * sizeof(m256i))
+    {
+        enqueueResponse(peer, 0, EndResponse::type, dejavu, NULL);
+        return;
+    }
+
+    // The processor buffer holding the request (BUFFER_SIZE bytes) is reused for building the response. Public keys and
+    // sorted leaf indices are kept at its end.
+    unsigned char* buffer = (unsigned char*)header;
+    m256i* publicKeys = (m256i*)(buffer + BUFFER_SIZE - MAX_NUMBER_OF_ENTITIES_PER_REQUEST * sizeof(m256i));
+    unsigned int* leafIndices = (unsigned int*)(((unsigned char*)publicKeys) - MAX_NUMBER_OF_ENTITIES_PER_REQUEST * sizeof(unsigned int));
+    copyMem(publicKeys, header->getPayload<m256i>(), numberOfPublicKeys * sizeof(m256i));
+
+    RespondEntities* response = (RespondEntities*)buffer;
+    RespondedEntitiesEntry* entries = (RespondedEntitiesEntry*)(response + 1);
+    m256i* siblings = (m256i*)(entries + numberOfPublicKeys);
+    setMem(response, sizeof(RespondEntities) + numberOfPublicKeys * sizeof(RespondedEntitiesEntry), 0);
+    response->numberOfEntities = numberOfPublicKeys;
+
+    // Entities, proof, and spectrum digest are taken under one lock hold to be consistent. The digests are only updated at the
+    // end of each tick, so while a tick is processed they do not match the spectrum and no proof can be given.
+    ACQUIRE(spectrumLock);
+    if (!spectrumDigestsTick)
+    {
+        RELEASE(spectrumLock);
+        enqueueResponse(peer, 0, EndResponse::type, dejavu, NULL);
+        return;
+    }
+    response->tick = spectrumDigestsTick;
+    response->spectrumDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
+    unsigned int numberOfLeaves = 0;
+    for (unsigned int i = 0; i < numberOfPublicKeys; i++)
+    {
+        const int index = spectrumIndexNoLock(publicKeys[i]);
+        entries[i].spectrumIndex = index;
+        if (index < 0)
+        {
+            entries[i].entity.publicKey = publicKeys[i];
+            continue;
+        }
+        copyMem(&entries[i].entity, &spectrum[index], sizeof(::Entity));
+
+        // insert into sorted leaf indices, skipping duplicates
+        unsigned int low = 0, high = numberOfLeaves;
+        while (low < high)
+        {
+            const unsigned int middle = (low + high) >> 1;
+            if (leafIndices[middle] < (unsigned int)index)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        if (low == numberOfLeaves || leafIndices[low] != (unsigned int)index)
+        {
+            for (unsigned int j = numberOfLeaves; j > low; j--)
+            {
+                leafIndices[j] = leafIndices[j - 1];
+            }
+            leafIndices[low] = index;
+            numberOfLeaves++;
+        }
+    }
+    response->numberOfSiblings = getMultiProofSiblings<SPECTRUM_DEPTH>(leafIndices, numberOfLeaves, spectrumDigests, siblings);
+    RELEASE(spectrumLock);
+
+    enqueueResponse(peer, sizeof(RespondEntities) + numberOfPublicKeys * sizeof(RespondedEntitiesEntry) + response->numberOfSiblings * sizeof(m256i),
+        RespondEntities::type, dejavu, buffer);
+}
+
+#if ENTITY_TX_HISTORY
+static_assert(sizeof(RequestResponseHeader) + sizeof(RespondEntityTxHistory) + ENTITY_TX_HISTORY_MAX_POSTINGS * sizeof(EntityTxHistoryPosting) <= BUFFER_SIZE, "Entity tx history response does not fit into processor buffer");
+
+static void processRequestEntityTxHistory(Peer* peer, RequestResponseHeader* header)
+{
+    const unsigned int dejavu = header->dejavu();
+    if (header->size() != sizeof(RequestResponseHeader) + sizeof(RequestEntityTxHistory))
+    {
+        enqueueResponse(peer, 0, EndResponse::type, dejavu, NULL);
+        return;
+    }
+
+    // copy request, because the processor buffer holding it is reused to build the response
+    const RequestEntityTxHistory request = *header->getPayload<RequestEntityTxHistory>();
+
+    // spectrum index is only valid until next reorganization, which is detected by the history index
+    ACQUIRE(spectrumLock);
+    const int index = spectrumIndexNoLock(request.publicKey);
+    const unsigned int numberOfSpectrumReorganizations = spectrumReorgCount;
+    RELEASE(spectrumLock);
+
+    entityTxHistory.respond(peer, dejavu, index, numberOfSpectrumReorganizations, request, (unsigned char*)header);
+}
+#endif
+
 static void processRequestContractIPO(Peer* peer, RequestResponseHeader* header)
 {
     RespondContractIPO respondContractIPO;
@@ -1238,11 +1189,12 @@ static void processSpecialCommand(Peer* peer, RequestResponseHeader* header)
                     (request->everIncreasingNonceAndCommandType & 0xFFFFFFFFFFFFFF) | (SPECIAL_COMMAND_GET_MINING_SCORE_RANKING << 56);
 
                 ACQUIRE(minerScoreArrayLock);
-                requestMiningScoreRanking.numberOfRankings = numberOfMiners;
-                for (unsigned int i = 0; i < requestMiningScoreRanking.numberOfRankings; ++i)
+                requestMiningScoreRanking.numberOfRankings = minerScores.numberOfMiners();
+                unsigned int rank = 0;
+                for (unsigned int slot = minerScores.beginRanking(); slot != minerScores.NO_SLOT; slot = minerScores.nextInRanking(slot), ++rank)
                 {
-                    requestMiningScoreRanking.rankings[i].minerPublicKey = minerPublicKeys[i];
-                    requestMiningScoreRanking.rankings[i].minerScore = minerScores[i];
+                    requestMiningScoreRanking.rankings[rank].minerPublicKey = minerScores.publicKey(slot);
+                    requestMiningScoreRanking.rankings[rank].minerScore = minerScores.score(slot);
                 }
                 RELEASE(minerScoreArrayLock);
                 enqueueResponse(peer,
@@ -1268,32 +1220,6 @@ static void checkinTime(unsigned long long processorNumber)
     threadTimeCheckin[processorNumber].day = utcTime.Day;
 }
 
-static void setNewMiningSeed()
-{
-    score->initMiningData(spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1]);
-}
-
-static unsigned int getTickInMiningPhaseCycle()
-{
-    return (system.tick - system.initialTick) % (INTERNAL_COMPUTATIONS_INTERVAL + EXTERNAL_COMPUTATIONS_INTERVAL);
-}
-
-static void checkAndSwitchMiningPhase()
-{
-    const unsigned int r = getTickInMiningPhaseCycle();
-    if (!r)
-    {
-        setNewMiningSeed();
-    }
-    else
-    {
-        if (r == INTERNAL_COMPUTATIONS_INTERVAL + 3) // 3 is added because of 3-tick shift for transaction confirmation
-        {
-            score->initMiningData(m256i::zero());
-        }
-    }
-}
-
 static void requestProcessor(void* ProcedureArgument)
 {
     enableAVX();
@@ -1325,7 +1251,11 @@ static void requestProcessor(void* ProcedureArgument)
         
         if (requestQueueElementTail == requestQueueElementHead)
         {
-            _mm_pause();
+            // without requests, help computing the neuron ticks of solutions being scored by other processors
+            if (!score->tryHelpScoring(processorNumber))
+            {
+                _mm_pause();
+            }
         }
         else
         {
@@ -1410,12 +1340,30 @@ static void requestProcessor(void* ProcedureArgument)
                 }
                 break;
 
+                case RequestTickRange::type:
+                {
+                    processRequestTickRange(peer, header);
+                }
+                break;
+
+                case RespondTickRange::type:
+                {
+                    processRespondTickRange(peer, header);
+                }
+                break;
+
                 case REQUEST_TICK_TRANSACTIONS:
                 {
                     processRequestTickTransactions(peer, header);
                 }
                 break;
 
+                case RequestTickTransactionBundle::type:
+                {
+                    processRequestTickTransactionBundle(peer, header);
+                }
+                break;
+
                 case REQUEST_TRANSACTION_INFO:
                 {
                     processRequestTransactionInfo(peer, header);
@@ -1434,6 +1382,20 @@ static void requestProcessor(void* ProcedureArgument)
                 }
                 break;
 
+                case RequestEntities::type:
+                {
+                    processRequestEntities(peer, header);
+                }
+                break;
+
+#if ENTITY_TX_HISTORY
+                case RequestEntityTxHistory::type:
+                {
+                    processRequestEntityTxHistory(peer, header);
+                }
+                break;
+#endif
+
                 case RequestContractIPO::type:
                 {
                     processRequestContractIPO(peer, header);
@@ -1470,6 +1432,24 @@ static void requestProcessor(void* ProcedureArgument)
                 }
                 break;
 
+                case RequestFilteredLog::type:
+                {
+                    logger.processRequestFilteredLog(processorNumber, peer, header);
+                }
+                break;
+
+                case RequestLogSubscription::type:
+                {
+                    logger.processRequestLogSubscription(peer, header);
+                }
+                break;
+
+                case AcknowledgeLogSubscription::type:
+                {
+                    logger.processAcknowledgeLogSubscription(peer, header);
+                }
+                break;
+
                 case RequestLogIdRangeFromTx::type:
                 {
                     logger.processRequestTxLogInfo(peer, header);
@@ -1501,6 +1481,12 @@ static void requestProcessor(void* ProcedureArgument)
                     processRequestConfirmedTx(processorNumber, peer, header);
                 }
                 break;
+
+                case REQUEST_TX_STATUS_BY_DIGEST:
+                {
+                    processRequestConfirmedTxByDigest(peer, header);
+                }
+                break;
 #endif
 
                 }
@@ -1515,936 +1501,38 @@ static void requestProcessor(void* ProcedureArgument)
 }
 
 
-QPI::id QPI::QpiContextFunctionCall::arbitrator() const
+static void contractProcessor(void*)
 {
-    return arbitratorPublicKey;
+    enableAVX();
+
+    executeContractProcessorPhase();
 }
 
-bool QPI::QpiContextProcedureCall::acquireShares(uint64 assetName, const id& issuer, const id& owner, const id& possessor, sint64 numberOfShares, uint16 sourceOwnershipManagingContractIndex, uint16 sourcePossessionManagingContractIndex) const
+// Started by main loop with timeout (like contractProcessor()) for each batch the lane has transactions in
+static void speculativeContractProcessor(void* ProcedureArgument)
 {
-    // Just examples, to make it compile, move these to parameter list
-    unsigned int contractIndex = QX_CONTRACT_INDEX;
-    QPI::sint64 invocationReward = 10;
-
-    if (contractIndex >= contractCount)
-        return false;
-    if (invocationReward < 0)
-        return false;
-    // ...
-
-    // TODO: Init input
-    QPI::PreManagementRightsTransfer_input pre_input;
-    // output is zeroed in __qpiCallSystemProcOfOtherContract
-    QPI::PreManagementRightsTransfer_output pre_output;
-
-    // Call PRE_ACQUIRE_SHARES in other contract after transferring invocationReward
-    __qpiCallSystemProcOfOtherContract<PRE_ACQUIRE_SHARES>(contractIndex, pre_input, pre_output, invocationReward);
+    enableAVX();
 
-    if (pre_output.ok)
+    SpeculativeLane& lane = *(SpeculativeLane*)ProcedureArgument;
+    for (unsigned int i = 0; i < lane.numberOfTransactions; i++)
     {
-        // TODO: transfer
-
-        // TODO: init input
-        QPI::PostManagementRightsTransfer_input post_input;
-        // Output is unused, but needed for generalized interface
-        QPI::NoData post_output;
-
-        // Call POST_ACQUIRE_SHARES in other contract without transferring an invocationReward
-        __qpiCallSystemProcOfOtherContract<POST_ACQUIRE_SHARES>(contractIndex, post_input, post_output, 0);
-    }
-
-    return pre_output.ok;
-}
-
-QPI::id QPI::QpiContextFunctionCall::computor(unsigned short computorIndex) const
-{
-    return broadcastedComputors.computors.publicKeys[computorIndex % NUMBER_OF_COMPUTORS];
-}
-
-unsigned char QPI::QpiContextFunctionCall::day() const
-{
-    return etalonTick.day;
-}
-
-unsigned char QPI::QpiContextFunctionCall::dayOfWeek(unsigned char year, unsigned char month, unsigned char day) const
-{
-    return dayIndex(year, month, day) % 7;
-}
-
-unsigned char QPI::QpiContextFunctionCall::hour() const
-{
-    return etalonTick.hour;
-}
-
-unsigned short QPI::QpiContextFunctionCall::millisecond() const
-{
-    return etalonTick.millisecond;
-}
-
-unsigned char QPI::QpiContextFunctionCall::minute() const
-{
-    return etalonTick.minute;
-}
-
-unsigned char QPI::QpiContextFunctionCall::month() const
-{
-    return etalonTick.month;
-}
-
-m256i QPI::QpiContextFunctionCall::nextId(const m256i& currentId) const
-{
-    int index = spectrumIndex(currentId);
-    while (++index < SPECTRUM_CAPACITY)
-    {
-        const m256i& nextId = spectrum[index].publicKey;
-        if (!isZero(nextId))
-        {
-            return nextId;
-        }
-    }
-
-    return m256i::zero();
-}
-
-int QPI::QpiContextFunctionCall::numberOfTickTransactions() const
-{
-    return -1; // TODO: Return -1 if the current tick is empty, return the number of the transactions in the tick otherwise, including 0
-}
-
-bool QPI::QpiContextProcedureCall::releaseShares(uint64 assetName, const id& issuer, const id& owner, const id& possessor, sint64 numberOfShares, uint16 destinationOwnershipManagingContractIndex, uint16 destinationPossessionManagingContractIndex) const
-{
-    // TODO
-
-    return false;
-}
-
-unsigned char QPI::QpiContextFunctionCall::second() const
-{
-    return etalonTick.second;
-}
-
-bool QPI::QpiContextFunctionCall::signatureValidity(const m256i& entity, const m256i& digest, const array<signed char, 64>& signature) const
-{
-    return verify(entity.m256i_u8, digest.m256i_u8, reinterpret_cast<const unsigned char*>(&signature));
-}
-
-unsigned char QPI::QpiContextFunctionCall::year() const
-{
-    return etalonTick.year;
-}
-
-template <typename T>
-m256i QPI::QpiContextFunctionCall::K12(const T& data) const
-{
-    m256i digest;
-
-    KangarooTwelve(&data, sizeof(data), &digest, sizeof(digest));
-
-    return digest;
-}
-
-static void contractProcessor(void*)
-{
-    enableAVX();
-
-    unsigned long long processorNumber;
-    mpServicesProtocol->WhoAmI(mpServicesProtocol, &processorNumber);
-
-    unsigned int executedContractIndex;
-    switch (contractProcessorPhase)
-    {
-    case INITIALIZE:
-    {
-        for (executedContractIndex = 1; executedContractIndex < contractCount; executedContractIndex++)
-        {
-            if (system.epoch == contractDescriptions[executedContractIndex].constructionEpoch
-                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
-            {
-                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
-                qpiContext.call(INITIALIZE);
-            }
-        }
-    }
-    break;
-
-    case BEGIN_EPOCH:
-    {
-        for (executedContractIndex = 1; executedContractIndex < contractCount; executedContractIndex++)
-        {
-            if (system.epoch >= contractDescriptions[executedContractIndex].constructionEpoch
-                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
-            {
-                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
-                qpiContext.call(BEGIN_EPOCH);
-            }
-        }
-    }
-    break;
-
-    case BEGIN_TICK:
-    {
-        for (executedContractIndex = 1; executedContractIndex < contractCount; executedContractIndex++)
-        {
-            if (system.epoch >= contractDescriptions[executedContractIndex].constructionEpoch
-                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
-            {
-                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
-                qpiContext.call(BEGIN_TICK);
-            }
-        }
-    }
-    break;
-
-    case END_TICK:
-    {
-        for (executedContractIndex = contractCount; executedContractIndex-- > 1; )
-        {
-            if (system.epoch >= contractDescriptions[executedContractIndex].constructionEpoch
-                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
-            {
-                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
-                qpiContext.call(END_TICK);
-            }
-        }
-    }
-    break;
-
-    case END_EPOCH:
-    {
-        for (executedContractIndex = contractCount; executedContractIndex-- > 1; )
-        {
-            if (system.epoch >= contractDescriptions[executedContractIndex].constructionEpoch
-                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
-            {
-                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
-                qpiContext.call(END_EPOCH);
-            }
-        }
-    }
-    break;
-
-    case USER_PROCEDURE_CALL:
-    {
-        const Transaction* transaction = contractProcessorTransaction;
-        ASSERT(transaction && transaction->checkValidity());
-
-        unsigned int contractIndex = (unsigned int)transaction->destinationPublicKey.m256i_u64[0];
-        ASSERT(system.epoch >= contractDescriptions[contractIndex].constructionEpoch);
-        ASSERT(system.epoch < contractDescriptions[contractIndex].destructionEpoch);
-        ASSERT(contractUserProcedures[contractIndex][transaction->inputType]);
-
-        QpiContextUserProcedureCall qpiContext(contractIndex, transaction->sourcePublicKey, transaction->amount);
-        qpiContext.call(transaction->inputType, transaction->inputPtr(), transaction->inputSize);
-
-        if (contractActionTracker.getOverallQuTransferBalance(transaction->sourcePublicKey) == 0)
-            contractProcessorTransactionMoneyflew = 0;
-        else
-            contractProcessorTransactionMoneyflew = 1;
-        contractProcessorTransaction = 0;
-    }
-    break;
-    }
-}
-
-static void processTickTransactionContractIPO(const Transaction* transaction, const int spectrumIndex, const unsigned int contractIndex)
-{
-    ASSERT(nextTickData.epoch == system.epoch);
-    ASSERT(transaction != nullptr);
-    ASSERT(transaction->checkValidity());
-    ASSERT(transaction->tick == system.tick);
-    ASSERT(!transaction->amount && transaction->inputSize == sizeof(ContractIPOBid));
-    ASSERT(spectrumIndex >= 0);
-    ASSERT(contractIndex < contractCount);
-    ASSERT(system.epoch < contractDescriptions[contractIndex].constructionEpoch);
-
-    ContractIPOBid* contractIPOBid = (ContractIPOBid*)transaction->inputPtr();
-    if (contractIPOBid->price > 0 && contractIPOBid->price <= MAX_AMOUNT / NUMBER_OF_COMPUTORS
-        && contractIPOBid->quantity > 0 && contractIPOBid->quantity <= NUMBER_OF_COMPUTORS)
-    {
-        const long long amount = contractIPOBid->price * contractIPOBid->quantity;
-        if (decreaseEnergy(spectrumIndex, amount))
-        {
-            const QuTransfer quTransfer = { transaction->sourcePublicKey, m256i::zero(), amount };
-            logger.logQuTransfer(quTransfer);
-
-            numberOfReleasedEntities = 0;
-            contractStateLock[contractIndex].acquireWrite();
-            IPO* ipo = (IPO*)contractStates[contractIndex];
-            for (unsigned int i = 0; i < contractIPOBid->quantity; i++)
-            {
-                if (contractIPOBid->price <= ipo->prices[NUMBER_OF_COMPUTORS - 1])
-                {
-                    unsigned int j;
-                    for (j = 0; j < numberOfReleasedEntities; j++)
-                    {
-                        if (transaction->sourcePublicKey == releasedPublicKeys[j])
-                        {
-                            break;
-                        }
-                    }
-                    if (j == numberOfReleasedEntities)
-                    {
-                        releasedPublicKeys[numberOfReleasedEntities] = transaction->sourcePublicKey;
-                        releasedAmounts[numberOfReleasedEntities++] = contractIPOBid->price;
-                    }
-                    else
-                    {
-                        releasedAmounts[j] += contractIPOBid->price;
-                    }
-                }
-                else
-                {
-                    unsigned int j;
-                    for (j = 0; j < numberOfReleasedEntities; j++)
-                    {
-                        if (ipo->publicKeys[NUMBER_OF_COMPUTORS - 1] == releasedPublicKeys[j])
-                        {
-                            break;
-                        }
-                    }
-                    if (j == numberOfReleasedEntities)
-                    {
-                        releasedPublicKeys[numberOfReleasedEntities] = ipo->publicKeys[NUMBER_OF_COMPUTORS - 1];
-                        releasedAmounts[numberOfReleasedEntities++] = ipo->prices[NUMBER_OF_COMPUTORS - 1];
-                    }
-                    else
-                    {
-                        releasedAmounts[j] += ipo->prices[NUMBER_OF_COMPUTORS - 1];
-                    }
-
-                    ipo->publicKeys[NUMBER_OF_COMPUTORS - 1] = transaction->sourcePublicKey;
-                    ipo->prices[NUMBER_OF_COMPUTORS - 1] = contractIPOBid->price;
-                    j = NUMBER_OF_COMPUTORS - 1;
-                    while (j
-                        && ipo->prices[j - 1] < ipo->prices[j])
-                    {
-                        const m256i tmpPublicKey = ipo->publicKeys[j - 1];
-                        const long long tmpPrice = ipo->prices[j - 1];
-                        ipo->publicKeys[j - 1] = ipo->publicKeys[j];
-                        ipo->prices[j - 1] = ipo->prices[j];
-                        ipo->publicKeys[j] = tmpPublicKey;
-                        ipo->prices[j--] = tmpPrice;
-                    }
-
-                    contractStateChangeFlags[contractIndex >> 6] |= (1ULL << (contractIndex & 63));
-                }
-            }
-            contractStateLock[contractIndex].releaseWrite();
-
-            for (unsigned int i = 0; i < numberOfReleasedEntities; i++)
-            {
-                increaseEnergy(releasedPublicKeys[i], releasedAmounts[i]);
-                const QuTransfer quTransfer = { m256i::zero(), releasedPublicKeys[i], releasedAmounts[i] };
-                logger.logQuTransfer(quTransfer);
-            }
-        }
-    }
-}
-
-// Return if money flew
-static bool processTickTransactionContractProcedure(const Transaction* transaction, const int spectrumIndex, const unsigned int contractIndex)
-{
-    ASSERT(nextTickData.epoch == system.epoch);
-    ASSERT(transaction != nullptr);
-    ASSERT(transaction->checkValidity());
-    ASSERT(transaction->tick == system.tick);
-    ASSERT(spectrumIndex >= 0);
-    ASSERT(contractIndex < contractCount);
-    ASSERT(system.epoch >= contractDescriptions[contractIndex].constructionEpoch);
-    ASSERT(system.epoch < contractDescriptions[contractIndex].destructionEpoch);
-
-    if (contractUserProcedures[contractIndex][transaction->inputType])
-    {
-        // Run user procedure call of transaction in contract processor
-        // and wait for completion
-        contractProcessorTransaction = transaction;
-        contractProcessorPhase = USER_PROCEDURE_CALL;
-        contractProcessorState = 1;
-        while (contractProcessorState)
-        {
-            _mm_pause();
-        }
-
-        return contractProcessorTransactionMoneyflew;
-    }
-
-    // if transaction tries to invoke non-registered procedure, transaction amount is not reimbursed
-    return transaction->amount > 0;
-}
-
-static void processTickTransactionSolution(const MiningSolutionTransaction* transaction, const unsigned long long processorNumber)
-{
-    ASSERT(nextTickData.epoch == system.epoch);
-    ASSERT(transaction != nullptr);
-    ASSERT(transaction->checkValidity());
-    ASSERT(transaction->tick == system.tick);
-    ASSERT(isZero(transaction->destinationPublicKey));
-    ASSERT(transaction->amount >=MiningSolutionTransaction::minAmount()
-            && transaction->inputSize == 64
-            && transaction->inputType == MiningSolutionTransaction::transactionType());
-
-    m256i data[3] = { transaction->sourcePublicKey, transaction->miningSeed, transaction->nonce };
-    static_assert(sizeof(data) == 3 * 32, "Unexpected array size");
-    unsigned int flagIndex;
-    KangarooTwelve(data, sizeof(data), &flagIndex, sizeof(flagIndex));
-    if (!(minerSolutionFlags[flagIndex >> 6] & (1ULL << (flagIndex & 63))))
-    {
-        minerSolutionFlags[flagIndex >> 6] |= (1ULL << (flagIndex & 63));
-
-        unsigned int solutionScore = (*::score)(processorNumber, transaction->sourcePublicKey, transaction->miningSeed, transaction->nonce);
-        if (score->isValidScore(solutionScore))
-        {
-            resourceTestingDigest ^= (unsigned long long)(solutionScore);
-            KangarooTwelve(&resourceTestingDigest, sizeof(resourceTestingDigest), &resourceTestingDigest, sizeof(resourceTestingDigest));
-
-            const int threshold = (system.epoch < MAX_NUMBER_EPOCH) ? solutionThreshold[system.epoch] : SOLUTION_THRESHOLD_DEFAULT;
-            if (score->isGoodScore(solutionScore, threshold))
-            {
-                // Solution deposit return
-                {
-                    increaseEnergy(transaction->sourcePublicKey, transaction->amount);
-
-                    const QuTransfer quTransfer = { m256i::zero(), transaction->sourcePublicKey, transaction->amount };
-                    logger.logQuTransfer(quTransfer);
-                }
-
-                for (unsigned int i = 0; i < sizeof(computorSeeds) / sizeof(computorSeeds[0]); i++)
-                {
-                    if (transaction->sourcePublicKey == computorPublicKeys[i])
-                    {
-                        ACQUIRE(solutionsLock);
-
-                        unsigned int j;
-                        for (j = 0; j < system.numberOfSolutions; j++)
-                        {
-                            if (transaction->nonce == system.solutions[j].nonce
-                                && transaction->miningSeed == system.solutions[j].miningSeed
-                                && transaction->sourcePublicKey == system.solutions[j].computorPublicKey)
-                            {
-                                solutionPublicationTicks[j] = SOLUTION_RECORDED_FLAG;
-
-                                break;
-                            }
-                        }
-                        if (j == system.numberOfSolutions
-                            && system.numberOfSolutions < MAX_NUMBER_OF_SOLUTIONS)
-                        {
-                            system.solutions[system.numberOfSolutions].computorPublicKey = transaction->sourcePublicKey;
-                            system.solutions[system.numberOfSolutions].miningSeed = transaction->miningSeed;
-                            system.solutions[system.numberOfSolutions].nonce = transaction->nonce;
-                            solutionPublicationTicks[system.numberOfSolutions++] = SOLUTION_RECORDED_FLAG;
-                        }
-
-                        RELEASE(solutionsLock);
-
-                        break;
-                    }
-                }
-
-                ACQUIRE(minerScoreArrayLock);
-                unsigned int minerIndex;
-                for (minerIndex = 0; minerIndex < numberOfMiners; minerIndex++)
-                {
-                    if (transaction->sourcePublicKey == minerPublicKeys[minerIndex])
-                    {
-                        minerScores[minerIndex]++;
-
-                        break;
-                    }
-                }
-                if (minerIndex == numberOfMiners
-                    && numberOfMiners < MAX_NUMBER_OF_MINERS)
-                {
-                    minerPublicKeys[numberOfMiners] = transaction->sourcePublicKey;
-                    minerScores[numberOfMiners++] = 1;
-                }
-
-                const m256i tmpPublicKey = minerPublicKeys[minerIndex];
-                const unsigned int tmpScore = minerScores[minerIndex];
-                while (minerIndex > (unsigned int)(minerIndex < NUMBER_OF_COMPUTORS ? 0 : NUMBER_OF_COMPUTORS)
-                    && minerScores[minerIndex - 1] < minerScores[minerIndex])
-                {
-                    minerPublicKeys[minerIndex] = minerPublicKeys[minerIndex - 1];
-                    minerScores[minerIndex] = minerScores[minerIndex - 1];
-                    minerPublicKeys[--minerIndex] = tmpPublicKey;
-                    minerScores[minerIndex] = tmpScore;
-                }
-
-                // combine 225 worst current computors with 225 best candidates
-                for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS - QUORUM; i++)
-                {
-                    competitorPublicKeys[i] = minerPublicKeys[QUORUM + i];
-                    competitorScores[i] = minerScores[QUORUM + i];
-                    competitorComputorStatuses[i] = true;
-
-                    if (NUMBER_OF_COMPUTORS + i < numberOfMiners)
-                    {
-                        competitorPublicKeys[i + (NUMBER_OF_COMPUTORS - QUORUM)] = minerPublicKeys[NUMBER_OF_COMPUTORS + i];
-                        competitorScores[i + (NUMBER_OF_COMPUTORS - QUORUM)] = minerScores[NUMBER_OF_COMPUTORS + i];
-                    }
-                    else
-                    {
-                        competitorScores[i + (NUMBER_OF_COMPUTORS - QUORUM)] = 0;
-                    }
-                    competitorComputorStatuses[i + (NUMBER_OF_COMPUTORS - QUORUM)] = false;
-                }
-                RELEASE(minerScoreArrayLock);
-
-                // bubble sorting -> top 225 from competitorPublicKeys have computors and candidates which are the best from that subset
-                for (unsigned int i = NUMBER_OF_COMPUTORS - QUORUM; i < (NUMBER_OF_COMPUTORS - QUORUM) * 2; i++)
-                {
-                    int j = i;
-                    const m256i tmpPublicKey = competitorPublicKeys[j];
-                    const unsigned int tmpScore = competitorScores[j];
-                    const bool tmpComputorStatus = false;
-                    while (j
-                        && competitorScores[j - 1] < competitorScores[j])
-                    {
-                        competitorPublicKeys[j] = competitorPublicKeys[j - 1];
-                        competitorScores[j] = competitorScores[j - 1];
-                        competitorComputorStatuses[j] = competitorComputorStatuses[j - 1];
-                        competitorPublicKeys[--j] = tmpPublicKey;
-                        competitorScores[j] = tmpScore;
-                        competitorComputorStatuses[j] = tmpComputorStatus;
-                    }
-                }
-
-                minimumComputorScore = competitorScores[NUMBER_OF_COMPUTORS - QUORUM - 1];
-
-                unsigned char candidateCounter = 0;
-                for (unsigned int i = 0; i < (NUMBER_OF_COMPUTORS - QUORUM) * 2; i++)
-                {
-                    if (!competitorComputorStatuses[i])
-                    {
-                        minimumCandidateScore = competitorScores[i];
-                        candidateCounter++;
-                    }
-                }
-                if (candidateCounter < NUMBER_OF_COMPUTORS - QUORUM)
-                {
-                    minimumCandidateScore = minimumComputorScore;
-                }
-
-                ACQUIRE(minerScoreArrayLock);
-                for (unsigned int i = 0; i < QUORUM; i++)
-                {
-                    system.futureComputors[i] = minerPublicKeys[i];
-                }
-                RELEASE(minerScoreArrayLock);
-
-                for (unsigned int i = QUORUM; i < NUMBER_OF_COMPUTORS; i++)
-                {
-                    system.futureComputors[i] = competitorPublicKeys[i - QUORUM];
-                }
-            }
-        }        
-    }
-    else
-    {
-        for (unsigned int i = 0; i < sizeof(computorSeeds) / sizeof(computorSeeds[0]); i++)
-        {
-            if (transaction->sourcePublicKey == computorPublicKeys[i])
-            {
-                ACQUIRE(solutionsLock);
-
-                unsigned int j;
-                for (j = 0; j < system.numberOfSolutions; j++)
-                {
-                    if (transaction->nonce == system.solutions[j].nonce
-                        && transaction->miningSeed == system.solutions[j].miningSeed
-                        && transaction->sourcePublicKey == system.solutions[j].computorPublicKey)
-                    {
-                        solutionPublicationTicks[j] = SOLUTION_RECORDED_FLAG;
-
-                        break;
-                    }
-                }
-                if (j == system.numberOfSolutions
-                    && system.numberOfSolutions < MAX_NUMBER_OF_SOLUTIONS)
-                {
-                    system.solutions[system.numberOfSolutions].computorPublicKey = transaction->sourcePublicKey;
-                    system.solutions[system.numberOfSolutions].miningSeed = transaction->miningSeed;
-                    system.solutions[system.numberOfSolutions].nonce = transaction->nonce;
-                    solutionPublicationTicks[system.numberOfSolutions++] = SOLUTION_RECORDED_FLAG;
-                }
-
-                RELEASE(solutionsLock);
-
-                break;
-            }
-        }
-    }
-}
-
-static void processTickTransactionFileHeader(const FileHeaderTransaction* transaction)
-{
-    ASSERT(nextTickData.epoch == system.epoch);
-    ASSERT(transaction != nullptr);
-    ASSERT(transaction->checkValidity());
-    ASSERT(isZero(transaction->destinationPublicKey));
-    ASSERT(transaction->tick == system.tick);
-
-    // TODO
-}
-
-static void processTickTransactionFileFragment(const FileFragmentTransactionPrefix* transactionPrefix, const FileFragmentTransactionPostfix* transactionPostfix)
-{
-    ASSERT(nextTickData.epoch == system.epoch);
-    ASSERT(transactionPrefix != nullptr);
-    ASSERT(transactionPostfix != nullptr);
-    ASSERT(transactionPrefix->checkValidity());
-    ASSERT(isZero(transactionPrefix->destinationPublicKey));
-    ASSERT(transactionPrefix->tick == system.tick);
-
-    // TODO
-}
-
-static void processTickTransactionOracleReplyCommit(const OracleReplyCommitTransaction* transaction)
-{
-    ASSERT(nextTickData.epoch == system.epoch);
-    ASSERT(transaction != nullptr);
-    ASSERT(transaction->checkValidity());
-    ASSERT(isZero(transaction->destinationPublicKey));
-    ASSERT(transaction->tick == system.tick);
-
-    // TODO
-}
-
-static void processTickTransactionOracleReplyReveal(const OracleReplyRevealTransactionPrefix* transaction)
-{
-    ASSERT(nextTickData.epoch == system.epoch);
-    ASSERT(transaction != nullptr);
-    ASSERT(transaction->checkValidity());
-    ASSERT(isZero(transaction->destinationPublicKey));
-    ASSERT(transaction->tick == system.tick);
-
-    // TODO
-}
-
-static void processTickTransaction(const Transaction* transaction, const m256i& transactionDigest, unsigned long long processorNumber)
-{
-    ASSERT(nextTickData.epoch == system.epoch);
-    ASSERT(transaction != nullptr);
-    ASSERT(transaction->checkValidity());
-    ASSERT(transaction->tick == system.tick);
-
-    // Record the tx with digest
-    ts.transactionsDigestAccess.acquireLock();
-    ts.transactionsDigestAccess.insertTransaction(transactionDigest, transaction);
-    ts.transactionsDigestAccess.releaseLock();
-
-    const int spectrumIndex = ::spectrumIndex(transaction->sourcePublicKey);
-    if (spectrumIndex >= 0)
-    {
-        numberOfTransactions++;
-        bool moneyFlew = false;
-#if ADDON_TX_STATUS_REQUEST
-        txStatusData.tickTxIndexStart[system.tick - system.initialTick + 1] = numberOfTransactions; // qli: part of tx_status_request add-on
-#endif
-        if (decreaseEnergy(spectrumIndex, transaction->amount))
-        {
-            increaseEnergy(transaction->destinationPublicKey, transaction->amount);
-
-            if (transaction->amount)
-            {
-                moneyFlew = true;
-                const QuTransfer quTransfer = { transaction->sourcePublicKey , transaction->destinationPublicKey , transaction->amount };
-                logger.logQuTransfer(quTransfer);
-            }
-
-            if (isZero(transaction->destinationPublicKey))
-            {
-                switch (transaction->inputType)
-                {
-                case VOTE_COUNTER_INPUT_TYPE:
-                {
-                    int computorIndex = transaction->tick % NUMBER_OF_COMPUTORS;
-                    if (transaction->sourcePublicKey == broadcastedComputors.computors.publicKeys[computorIndex]) // this tx was sent by the tick leader of this tick
-                    {
-                        if (!transaction->amount
-                            && transaction->inputSize == VOTE_COUNTER_DATA_SIZE_IN_BYTES)
-                        {
-                            voteCounter.addVotes(transaction->inputPtr(), computorIndex);
-                        }
-                    }
-                }
-                break;
-
-                case FileHeaderTransaction::transactionType():
-                {
-                    if (transaction->amount >= FileFragmentTransactionPrefix::minAmount()
-                        && transaction->inputSize >= FileFragmentTransactionPrefix::minInputSize())
-                    {
-                        processTickTransactionFileHeader((FileHeaderTransaction*)transaction);
-                    }
-                }
-                break;
-
-                case FileFragmentTransactionPrefix::transactionType():
-                {
-                    if (transaction->amount >= FileFragmentTransactionPrefix::minAmount()
-                        && transaction->inputSize >= FileFragmentTransactionPrefix::minInputSize())
-                    {
-                        processTickTransactionFileFragment((FileFragmentTransactionPrefix*)transaction, (FileFragmentTransactionPostfix*)(((char*)transaction) + sizeof(Transaction) + transaction->inputSize));
-                    }
-                }
-                break;
-
-                case MiningSolutionTransaction::transactionType():
-                {
-                    if (transaction->amount >= MiningSolutionTransaction::minAmount()
-                        && transaction->inputSize >= MiningSolutionTransaction::minInputSize())
-                    {
-                        processTickTransactionSolution((MiningSolutionTransaction*)transaction, processorNumber);
-                    }
-                }
-                break;
-
-                case OracleReplyCommitTransaction::transactionType():
-                {
-                    if (computorIndex(transaction->sourcePublicKey) >= 0
-                        && transaction->inputSize == sizeof(OracleReplyCommitTransaction))
-                    {
-                        processTickTransactionOracleReplyCommit((OracleReplyCommitTransaction*)transaction);
-                    }
-                }
-                break;
-
-                case OracleReplyRevealTransactionPrefix::transactionType():
-                {
-                    if (computorIndex(transaction->sourcePublicKey) >= 0
-                        && transaction->inputSize >= sizeof(OracleReplyRevealTransactionPrefix) + sizeof(OracleReplyRevealTransactionPostfix))
-                    {
-                        processTickTransactionOracleReplyReveal((OracleReplyRevealTransactionPrefix*)transaction);
-                    }
-                }
-                break;
-                }
-            }
-            else
-            {
-                // Contracts are identified by their index stored in the first 64 bits of the id, all
-                // other bits are zeroed. However, the max number of contracts is limited to 2^32 - 1,
-                // only 32 bits are used for the contract index.
-                m256i maskedDestinationPublicKey = transaction->destinationPublicKey;
-                maskedDestinationPublicKey.m256i_u64[0] &= ~(MAX_NUMBER_OF_CONTRACTS - 1ULL);
-                unsigned int contractIndex = (unsigned int)transaction->destinationPublicKey.m256i_u64[0];
-                if (isZero(maskedDestinationPublicKey)
-                    && contractIndex < contractCount)
-                {
-                    // Contract transactions
-                    if (system.epoch < contractDescriptions[contractIndex].constructionEpoch)
-                    {
-                        // IPO
-                        if (!transaction->amount
-                            && transaction->inputSize == sizeof(ContractIPOBid))
-                        {
-                            processTickTransactionContractIPO(transaction, spectrumIndex, contractIndex);
-                        }
-                    }
-                    else if (system.epoch < contractDescriptions[contractIndex].destructionEpoch)
-                    {
-                        // Regular contract procedure invocation
-                        moneyFlew = processTickTransactionContractProcedure(transaction, spectrumIndex, contractIndex);
-                    }
-                }
-            }
+        // stop if this and all following transactions of the lane will be executed again sequentially anyway
+        if (!lane.beginTransaction(lane.transactionPositions[i]))
+        {
+            break;
         }
-
-#if ADDON_TX_STATUS_REQUEST
-        saveConfirmedTx(numberOfTransactions - 1, moneyFlew, system.tick, transactionDigest); // qli: save tx
-#endif
+        processTickTransactionSpeculatively(lane, lane.transactionPositions[i]);
     }
+    lane.completed = true;
 }
 
+// Process tick system.tick and publish the data of the ticks led by own computors
 static void processTick(unsigned long long processorNumber)
 {
-    if (system.tick > system.initialTick)
-    {
-        etalonTick.prevResourceTestingDigest = resourceTestingDigest;
-        etalonTick.prevSpectrumDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
-        getUniverseDigest(etalonTick.prevUniverseDigest);
-        getComputerDigest(etalonTick.prevComputerDigest);
-    }
-    else if (system.tick == system.initialTick) // the first tick of an epoch
-    {
-        // RULE: prevDigests of tick T are the digests of tick T-1, so epoch number doesn't matter.        
-        // For seamless transition, spectrum and universe and computer have been changed after endEpoch event
-        // (miner rewards, IPO finalizing, contract endEpoch procedures,...)
-        // Here we still let prevDigests == digests of the last tick of last epoch
-        // so that lite client can verify the state of spectrum        
-
-#if START_NETWORK_FROM_SCRATCH // only update it if the whole network starts from scratch
-        // everything starts from files, there is no previous tick of the last epoch
-        // thus, prevDigests are the digests of the files
-        if (system.epoch == EPOCH)
-        {
-            etalonTick.prevResourceTestingDigest = resourceTestingDigest;
-            etalonTick.prevSpectrumDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
-            getUniverseDigest(etalonTick.prevUniverseDigest);
-            getComputerDigest(etalonTick.prevComputerDigest);
-        }
-#endif
-    }
-    else
-    {
-        // it should never go here
-    }
-
-    if (system.tick == system.initialTick)
-    {
-        logger.reset(system.initialTick); // reset here to persist the data when we do seamless transition
-        logger.registerNewTx(system.tick, logger.SC_INITIALIZE_TX);
-        contractProcessorPhase = INITIALIZE;
-        contractProcessorState = 1;
-        while (contractProcessorState)
-        {
-            _mm_pause();
-        }
-
-        logger.registerNewTx(system.tick, logger.SC_BEGIN_EPOCH_TX);
-        contractProcessorPhase = BEGIN_EPOCH;
-        contractProcessorState = 1;
-        while (contractProcessorState)
-        {
-            _mm_pause();
-        }
-    }
-
-    logger.registerNewTx(system.tick, logger.SC_BEGIN_TICK_TX);
-    contractProcessorPhase = BEGIN_TICK;
-    contractProcessorState = 1;
-    while (contractProcessorState)
-    {
-        _mm_pause();
-    }
-
-    unsigned int tickIndex = ts.tickToIndexCurrentEpoch(system.tick);
-    ts.tickData.acquireLock();
-    bs->CopyMem(&nextTickData, &ts.tickData[tickIndex], sizeof(TickData));
-    ts.tickData.releaseLock();
-    unsigned long long solutionProcessStartTick = __rdtsc(); // for tracking the time processing solutions
-    if (nextTickData.epoch == system.epoch)
-    {
-        auto* tsCurrentTickTransactionOffsets = ts.tickTransactionOffsets.getByTickIndex(tickIndex);
-#if ADDON_TX_STATUS_REQUEST
-        txStatusData.tickTxIndexStart[system.tick - system.initialTick] = numberOfTransactions; // qli: part of tx_status_request add-on
-#endif
-        // reset solution task queue
-        score->resetTaskQueue();
-        // pre-scan any solution tx and add them to solution task queue
-        for (unsigned int transactionIndex = 0; transactionIndex < NUMBER_OF_TRANSACTIONS_PER_TICK; transactionIndex++)
-        {
-            if (!isZero(nextTickData.transactionDigests[transactionIndex]))
-            {
-                if (tsCurrentTickTransactionOffsets[transactionIndex])
-                {
-                    Transaction* transaction = ts.tickTransactions(tsCurrentTickTransactionOffsets[transactionIndex]);
-                    ASSERT(transaction->checkValidity());
-                    ASSERT(transaction->tick == system.tick);
-                    const int spectrumIndex = ::spectrumIndex(transaction->sourcePublicKey);
-                    if (spectrumIndex >= 0)
-                    {
-                        // Solution transactions
-                        if (isZero(transaction->destinationPublicKey)
-                            && transaction->amount >= MiningSolutionTransaction::minAmount()
-                            && transaction->inputType == MiningSolutionTransaction::transactionType())
-                        {
-                            if (transaction->inputSize == 32 + 32)
-                            {
-                                const m256i& solution_miningSeed = *(m256i*)transaction->inputPtr();
-                                const m256i& solution_nonce = *(m256i*)(transaction->inputPtr() + 32);
-                                m256i data[3] = { transaction->sourcePublicKey, solution_miningSeed, solution_nonce };
-                                static_assert(sizeof(data) == 3 * 32, "Unexpected array size");
-                                unsigned int flagIndex;
-                                KangarooTwelve(data, sizeof(data), &flagIndex, sizeof(flagIndex));
-                                if (!(minerSolutionFlags[flagIndex >> 6] & (1ULL << (flagIndex & 63))))
-                                {
-                                    score->addTask(transaction->sourcePublicKey, solution_miningSeed, solution_nonce);
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
-
-        {
-            // Process solutions in this tick and store in cache. In parallel, score->tryProcessSolution() is called by
-            // request processors to speed up solution processing.
-            score->startProcessTaskQueue();
-            while (!score->isTaskQueueProcessed())
-            {
-                score->tryProcessSolution(processorNumber);
-            }
-            score->stopProcessTaskQueue();
-        }
-        solutionTotalExecutionTicks = __rdtsc() - solutionProcessStartTick; // for tracking the time processing solutions
-
-        // Process all transaction of the tick
-        for (unsigned int transactionIndex = 0; transactionIndex < NUMBER_OF_TRANSACTIONS_PER_TICK; transactionIndex++)
-        {
-            if (!isZero(nextTickData.transactionDigests[transactionIndex]))
-            {
-                if (tsCurrentTickTransactionOffsets[transactionIndex])
-                {
-                    Transaction* transaction = ts.tickTransactions(tsCurrentTickTransactionOffsets[transactionIndex]);
-                    logger.registerNewTx(transaction->tick, transactionIndex);
-                    processTickTransaction(transaction, nextTickData.transactionDigests[transactionIndex], processorNumber);
-                }
-                else
-                {
-                    while (true)
-                    {
-                        criticalSituation = 1;
-                    }
-                }
-            }
-        }
-    }
-
-    logger.registerNewTx(system.tick, logger.SC_END_TICK_TX);
-    contractProcessorPhase = END_TICK;
-    contractProcessorState = 1;
-    while (contractProcessorState)
-    {
-        _mm_pause();
-    }
-
-    unsigned int digestIndex;
-    ACQUIRE(spectrumLock);
-    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-    {
-        if (spectrum[digestIndex].latestIncomingTransferTick == system.tick || spectrum[digestIndex].latestOutgoingTransferTick == system.tick)
-        {
-            KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-            spectrumChangeFlags[digestIndex >> 6] |= (1ULL << (digestIndex & 63));
-        }
-    }
-    unsigned int previousLevelBeginning = 0;
-    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-    while (numberOfLeafs > 1)
-    {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-        {
-            if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
-            {
-                KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex]);
-                spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
-                spectrumChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
-            }
-            digestIndex++;
-        }
-        previousLevelBeginning += numberOfLeafs;
-        numberOfLeafs >>= 1;
-    }
-    spectrumChangeFlags[0] = 0;
-
-    etalonTick.saltedSpectrumDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
-    RELEASE(spectrumLock);
-
-    getUniverseDigest(etalonTick.saltedUniverseDigest);
-    getComputerDigest(etalonTick.saltedComputerDigest);
+    beginTick();
+    processTickTransactions(processorNumber);
+    endTick();
+    updateTickDigests();
 
     for (unsigned int i = 0; i < numberOfOwnComputorIndices; i++)
     {
@@ -2670,20 +1758,6 @@ static void processTick(unsigned long long processorNumber)
             }
         }
     }
-
-#ifndef NDEBUG
-    // Check that continous updating of spectrum info is consistent with counting from scratch
-    SpectrumInfo si;
-    updateSpectrumInfo(si);
-    if (si.numberOfEntities != spectrumInfo.numberOfEntities || si.totalAmount != spectrumInfo.totalAmount)
-    {
-        addDebugMessage(L"BUG DETECTED: Spectrum info of continuous updating is inconsistent with counting from scratch!");
-    }
-#endif
-
-    // Update entity category populations and dust thresholds each 8 ticks
-    if ((system.tick & 7) == 0)
-        updateAndAnalzeEntityCategoryPopulations();
 }
 
 static void beginEpoch()
@@ -2737,10 +1811,9 @@ static void beginEpoch()
 
     score->initMemory();
     score->resetTaskQueue();
+    StateSnapshot::beforeWrite(minerSolutionFlags, NUMBER_OF_MINER_SOLUTION_FLAGS / 8);
     bs->SetMem(minerSolutionFlags, NUMBER_OF_MINER_SOLUTION_FLAGS / 8, 0);
-    bs->SetMem((void*)minerPublicKeys, sizeof(minerPublicKeys), 0);
-    bs->SetMem((void*)minerScores, sizeof(minerScores), 0);
-    numberOfMiners = NUMBER_OF_COMPUTORS;
+    minerScores.reset();
     bs->SetMem(competitorPublicKeys, sizeof(competitorPublicKeys), 0);
     bs->SetMem(competitorScores, sizeof(competitorScores), 0);
     bs->SetMem(competitorComputorStatuses, sizeof(competitorComputorStatuses), 0);
@@ -2771,12 +1844,7 @@ static void beginEpoch()
 static void endEpoch()
 {
     logger.registerNewTx(system.tick, logger.SC_END_EPOCH_TX);
-    contractProcessorPhase = END_EPOCH;
-    contractProcessorState = 1;
-    while (contractProcessorState)
-    {
-        _mm_pause();
-    }
+    runContractProcessor(END_EPOCH);
 
     // treating endEpoch as a tick, start updating etalonTick:
     // this is the last tick of an epoch, should we set prevResourceTestingDigest to zero? nodes that start from scratch (for the new epoch)
@@ -2840,6 +1908,7 @@ static void endEpoch()
             contractStateLock[contractIndex].releaseRead();
 
             contractStateLock[0].acquireWrite();
+            StateSnapshot::beforeWrite(&contractFeeReserve(contractIndex), sizeof(long long));
             contractFeeReserve(contractIndex) = finalPrice * NUMBER_OF_COMPUTORS;
             contractStateLock[0].releaseWrite();
         }
@@ -3127,150 +2196,388 @@ static bool invalidateNodeStates(CHAR16* directory)
     return ts.saveInvalidateData(system.epoch, directory);
 }
 
-// can only called from main thread
-static bool saveAllNodeStates()
+// Node states at the time the snapshot was cut, which are written while ticks are processed
+static System systemSnapshot;
+static unsigned short nodeStateSnapshotEpoch = 0;
+static unsigned int nodeStateSnapshotTick = 0;
+static CHAR16 nodeStateSnapshotDirectory[16];
+
+// Number of delta snapshots saved on top of the last full snapshot, stored in file snapshotDeltaCount of the epoch directory
+static unsigned int nodeStateSnapshotNumberOfDeltas = 0;
+static unsigned int nodeStateSnapshotDeltaIndex = 0;
+
+static void setNodeStateDeltaFileName(CHAR16* fileName, unsigned int deltaIndex)
+{
+    setText(fileName, L"snapshotDelta.XXX");
+    addEpochToFileName(fileName, getTextSize(fileName, 32) + 1, deltaIndex);
+}
+
+// Cut snapshot of node states while the tick processor is waiting. Small states are copied and large state arrays are
+// shadowed by StateSnapshot, so the tick processor can continue while continueSavingAllNodeStates() writes the files.
+// Up to TICK_STORAGE_AUTOSAVE_MAX_DELTAS snapshots after a full one only write the changed pages to a delta file.
+// Can only be called from main thread.
+static bool beginSavingAllNodeStates()
 {
-    CHAR16 directory[16];
+    CHAR16* directory = nodeStateSnapshotDirectory;
     setText(directory, L"ep");
     appendNumber(directory, system.epoch, false);
 
     logToConsole(L"Start saving node states from main thread");
 
-    // Mark current snapshot metadata as invalid at the beginning.
-    // Any reasons make the valid metadata can not be overwritten at the final step will keep this invalid file
-    // and make the loadAllNodeStates see this saving as an invalid save.
-    if (!invalidateNodeStates(directory))
+    // Mark current snapshot metadata as invalid at the beginning.
+    // Any reasons make the valid metadata can not be overwritten at the final step will keep this invalid file
+    // and make the loadAllNodeStates see this saving as an invalid save.
+    if (!invalidateNodeStates(directory))
+    {
+        logToConsole(L"Failed to init snapshot metadata");
+        return false;
+    }
+
+    if (!StateSnapshot::prepare(directory))
+    {
+        logToConsole(L"Failed to prepare snapshot, last one is still being written");
+        return false;
+    }
+
+    copyMem(&systemSnapshot, &system, sizeof(system));
+    saveTickProcessingStates(nodeStateBuffer);
+    copyMem(nodeStateBuffer.faultyComputorFlags, (void*)faultyComputorFlags, sizeof(faultyComputorFlags));
+    if (!addNodeStateSnapshotRegions(&systemSnapshot))
+    {
+        logToConsole(L"Failed to define snapshot regions");
+        return false;
+    }
+
+#if ADDON_TX_STATUS_REQUEST
+    // tx status is not shadowed, so it is saved before ticks continue
+    if (!saveStateTxStatus(numberOfTransactions, directory))
+    {
+        logToConsole(L"Failed to save tx status");
+        return false;
+    }
+#endif
+
+    nodeStateSnapshotEpoch = system.epoch;
+    nodeStateSnapshotTick = system.tick;
+    if (StateSnapshot::canWriteDelta() && nodeStateSnapshotNumberOfDeltas < TICK_STORAGE_AUTOSAVE_MAX_DELTAS)
+    {
+        CHAR16 deltaFileName[32];
+        nodeStateSnapshotDeltaIndex = nodeStateSnapshotNumberOfDeltas + 1;
+        setNodeStateDeltaFileName(deltaFileName, nodeStateSnapshotDeltaIndex);
+        StateSnapshot::start(deltaFileName);
+    }
+    else
+    {
+        // full snapshot compacting all deltas
+        nodeStateSnapshotDeltaIndex = 0;
+        StateSnapshot::start();
+    }
+
+    return true;
+}
+
+// Save data that is not part of the snapshot regions and mark snapshot as valid. Can only be called from main thread.
+static bool finishSavingAllNodeStates()
+{
+    CHAR16* directory = nodeStateSnapshotDirectory;
+
+    score->saveScoreCache(nodeStateSnapshotEpoch, directory);
+
+    if (save(L"snapshotDeltaCount", sizeof(nodeStateSnapshotDeltaIndex), (unsigned char*)&nodeStateSnapshotDeltaIndex, directory) != sizeof(nodeStateSnapshotDeltaIndex))
+    {
+        logToConsole(L"Failed to save number of snapshot deltas");
+        return false;
+    }
+    nodeStateSnapshotNumberOfDeltas = nodeStateSnapshotDeltaIndex;
+
+    setText(message, L"Saving tick storage ");
+    logToConsole(message);
+    if (ts.trySaveToFile(nodeStateSnapshotEpoch, nodeStateSnapshotTick, directory) != 0)
+    {
+        logToConsole(L"Failed to save tick storage");
+        return false;
+    }
+
+    return true;
+}
+
+// Write next part of node states snapshot, called in each iteration of the main loop while the snapshot is active.
+// Can only be called from main thread.
+static void continueSavingAllNodeStates()
+{
+    if (system.epoch != nodeStateSnapshotEpoch)
+    {
+        StateSnapshot::abort();
+        logToConsole(L"Saving node states aborted due to epoch change");
+        return;
+    }
+
+    switch (StateSnapshot::writeStep())
+    {
+    case StateSnapshotWriteDone:
+        if (finishSavingAllNodeStates())
+        {
+            setText(message, L"Complete saving all node states of tick ");
+            appendNumber(message, nodeStateSnapshotTick, FALSE);
+            if (StateSnapshot::isDelta())
+            {
+                appendText(message, L" as delta ");
+                appendNumber(message, nodeStateSnapshotDeltaIndex, FALSE);
+            }
+            appendText(message, L" (");
+            appendNumber(message, StateSnapshot::getWrittenBytes(), TRUE);
+            appendText(message, L" bytes, ");
+            appendNumber(message, StateSnapshot::getNumberOfShadowedPages(), TRUE);
+            appendText(message, L" pages shadowed, ");
+            appendNumber(message, StateSnapshot::getNumberOfStalls(), TRUE);
+            appendText(message, L" stalls)");
+            logToConsole(message);
+        }
+        break;
+    case StateSnapshotWriteFailed:
+        logToConsole(L"Failed to write node states snapshot");
+        break;
+    default:
+        break;
+    }
+}
+
+// Run by all other processors while the main processor loads node states, verifying the loaded states
+static void stateLoadWorker(void*)
+{
+    enableAVX();
+    StateLoader::runWorker();
+}
+
+// Append duration of finished loading phase to text and start measuring the next phase
+static void appendLoadingPhaseDuration(CHAR16* text, const CHAR16* phase, unsigned long long& phaseBeginningTick)
+{
+    const unsigned long long now = __rdtsc();
+    appendText(text, phase);
+    appendNumber(text, (now - phaseBeginningTick) * 1000 / frequency, TRUE);
+    appendText(text, L" ms");
+    phaseBeginningTick = now;
+}
+
+// Load contract states like loadComputer(directory, true) and queue verification of each state
+static bool loadAndVerifyComputer(CHAR16* directory, int computerTree)
+{
+    logToConsole(L"Loading contract files ...");
+    for (unsigned int contractIndex = 0; contractIndex < MAX_NUMBER_OF_CONTRACTS; contractIndex++)
+    {
+        if (contractIndex >= contractCount)
+        {
+            StateLoader::verifyLeaf(computerTree, contractIndex, NULL, 0);
+            continue;
+        }
+
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 9] = contractIndex / 1000 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 8] = (contractIndex % 1000) / 100 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 7] = (contractIndex % 100) / 10 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 6] = contractIndex % 10 + L'0';
+        const unsigned long long size = contractDescriptions[contractIndex].stateSize;
+        long long loadedSize = load(CONTRACT_FILE_NAME, size, contractStates[contractIndex], directory);
+        if (loadedSize != size)
+        {
+            logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() reads invalid number of bytes", loadedSize, __LINE__);
+            return false;
+        }
+        StateLoader::verifyLeaf(computerTree, contractIndex, contractStates[contractIndex], size);
+    }
+    return true;
+}
+
+static bool loadAllNodeStatesFromFiles(CHAR16* directory, CHAR16* timing)
+{
+    unsigned long long phaseBeginningTick = __rdtsc();
+    if (ts.tryLoadFromFile(system.epoch, directory) != 0)
+    {
+        logToConsole(L"Failed to load tick storage");
+        return false;
+    }
+    appendLoadingPhaseDuration(timing, L"tick storage ", phaseBeginningTick);
+
+    // digests are loaded first, so the states can be verified while they are loaded
+    CHAR16 SPECTRUM_DIGEST_FILE_NAME[] = L"snapshotSpectrumDigest";
+    long long loadedSize = load(SPECTRUM_DIGEST_FILE_NAME, spectrumDigestsSizeInByte, (unsigned char*)spectrumDigests, directory);
+    logToConsole(L"Loading spectrum digests");
+    if (loadedSize != spectrumDigestsSizeInByte)
+    {
+        logToConsole(L"Failed to load spectrum digest");
+        return false;
+    }
+
+    CHAR16 UNIVERSE_DIGEST_FILE_NAME[] = L"snapshotUniverseDigest";
+    loadedSize = load(UNIVERSE_DIGEST_FILE_NAME, assetDigestsSizeInBytes, (unsigned char*)assetDigests, directory);
+    logToConsole(L"Loading universe digests");
+    if (loadedSize != assetDigestsSizeInBytes)
+    {
+        logToConsole(L"Failed to load universe digest");
+        return false;
+    }
+
+    CHAR16 COMPUTER_DIGEST_FILE_NAME[] = L"snapshotComputerDigest";
+    loadedSize = load(COMPUTER_DIGEST_FILE_NAME, contractStateDigestsSizeInBytes, (unsigned char*)contractStateDigests, directory);
+    logToConsole(L"Loading computer digests");
+    if (loadedSize != contractStateDigestsSizeInBytes)
     {
-        logToConsole(L"Failed to init snapshot metadata");
+        logToConsole(L"Failed to load computer digest");
         return false;
     }
+    appendLoadingPhaseDuration(timing, L", digests ", phaseBeginningTick);
+
+    const int spectrumTree = StateLoader::addTree(spectrumDigests, SPECTRUM_CAPACITY, sizeof(::Entity));
+    const int universeTree = StateLoader::addTree(assetDigests, ASSETS_CAPACITY, sizeof(Asset));
+    const int computerTree = StateLoader::addTree(contractStateDigests, MAX_NUMBER_OF_CONTRACTS, 0);
 
     SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 4] = L'0';
     SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 3] = L'0';
     SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 2] = L'0';
-    setText(message, L"Saving spectrum to ");
-    appendText(message, directory); appendText(message, L"/");
-    appendText(message, SPECTRUM_FILE_NAME);
-    logToConsole(message);
-    if (!saveSpectrum(SPECTRUM_FILE_NAME, directory))
+    logToConsole(L"Loading spectrum file ...");
+    if (!StateLoader::loadLeaves(spectrumTree, SPECTRUM_FILE_NAME, directory, spectrum))
     {
-        logToConsole(L"Failed to save spectrum");
+        logToConsole(L"Failed to load spectrum");
         return false;
     }
+    updateSpectrumInfo();
+    appendLoadingPhaseDuration(timing, L", spectrum ", phaseBeginningTick);
 
     UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 4] = L'0';
     UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 3] = L'0';
     UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 2] = L'0';
-    setText(message, L"Saving universe to ");
-    appendText(message, directory); appendText(message, L"/");
-    appendText(message, UNIVERSE_FILE_NAME);
-    logToConsole(message);
-    if (!saveUniverse(directory))
+    logToConsole(L"Loading universe file ...");
+    if (!StateLoader::loadLeaves(universeTree, UNIVERSE_FILE_NAME, directory, assets))
     {
-        logToConsole(L"Failed to save universe");
+        logToConsole(L"Failed to load universe");
         return false;
     }
+    appendLoadingPhaseDuration(timing, L", universe ", phaseBeginningTick);
 
     CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 4] = L'0';
     CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 3] = L'0';
     CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 2] = L'0';
-    setText(message, L"Saving computer files");
-    logToConsole(message);
-    if (!saveComputer(directory))
+    if (!loadAndVerifyComputer(directory, computerTree))
     {
-        logToConsole(L"Failed to save computer");
+        logToConsole(L"Failed to load computer");
         return false;
     }
-    setText(message, L"Saving system to system.snp");
-    logToConsole(message);
+    appendLoadingPhaseDuration(timing, L", computer ", phaseBeginningTick);
 
-    static unsigned short SYSTEM_SNAPSHOT_FILE_NAME[] = L"system.snp";
-    long long savedSize = save(SYSTEM_SNAPSHOT_FILE_NAME, sizeof(system), (unsigned char*)&system, directory);
-    if (savedSize != sizeof(system))
+    CHAR16 NODE_STATE_FILE_NAME[] = L"snapshotNodeMiningState";
+    loadedSize = load(NODE_STATE_FILE_NAME, sizeof(nodeStateBuffer), (unsigned char*)&nodeStateBuffer, directory);
+    if (loadedSize != sizeof(nodeStateBuffer))
     {
-        logToConsole(L"Failed to save system");
+        logToConsole(L"Failed to load mining state");
         return false;
     }
-    
-    score->saveScoreCache(system.epoch, directory);
-    
-    copyMem(&nodeStateBuffer.etalonTick, &etalonTick, sizeof(etalonTick));
-    copyMem(nodeStateBuffer.minerPublicKeys, (void*)minerPublicKeys, sizeof(minerPublicKeys));
-    copyMem(nodeStateBuffer.minerScores, (void*)minerScores, sizeof(minerScores));
-    copyMem(nodeStateBuffer.competitorPublicKeys, (void*)competitorPublicKeys, sizeof(competitorPublicKeys));
-    copyMem(nodeStateBuffer.competitorScores, (void*)competitorScores, sizeof(competitorScores));
-    copyMem(nodeStateBuffer.competitorComputorStatuses, (void*)competitorComputorStatuses, sizeof(competitorComputorStatuses));
-    copyMem(nodeStateBuffer.solutionPublicationTicks, (void*)solutionPublicationTicks, sizeof(solutionPublicationTicks));
-    copyMem(nodeStateBuffer.faultyComputorFlags, (void*)faultyComputorFlags, sizeof(faultyComputorFlags));
-    copyMem(&nodeStateBuffer.broadcastedComputors, (void*)&broadcastedComputors, sizeof(broadcastedComputors));
-    copyMem(&nodeStateBuffer.resourceTestingDigest, &resourceTestingDigest, sizeof(resourceTestingDigest));
-    nodeStateBuffer.currentRandomSeed = score->currentRandomSeed;
-    nodeStateBuffer.numberOfMiners = numberOfMiners;
-    nodeStateBuffer.numberOfTransactions = numberOfTransactions;
-    nodeStateBuffer.lastLogId = logger.logId;
-    voteCounter.saveAllDataToArray(nodeStateBuffer.voteCounterData);
 
-    CHAR16 NODE_STATE_FILE_NAME[] = L"snapshotNodeMiningState";
-    savedSize = save(NODE_STATE_FILE_NAME, sizeof(nodeStateBuffer), (unsigned char*)&nodeStateBuffer, directory);
-    logToConsole(L"Saving mining states");
-    if (savedSize != sizeof(nodeStateBuffer))
+    static unsigned short SYSTEM_SNAPSHOT_FILE_NAME[] = L"system.snp";
+    loadedSize = load(SYSTEM_SNAPSHOT_FILE_NAME, sizeof(system), (unsigned char*)&system, directory);
+    if (loadedSize != sizeof(system))
     {
-        logToConsole(L"Failed to save etalon tick and other states");
+        logToConsole(L"Failed to load system");
         return false;
     }
-    
-    CHAR16 SPECTRUM_DIGEST_FILE_NAME[] = L"snapshotSpectrumDigest";
-    savedSize = save(SPECTRUM_DIGEST_FILE_NAME, spectrumDigestsSizeInByte, (unsigned char*)spectrumDigests, directory);
-    logToConsole(L"Saving spectrum digests");
-    if (savedSize != spectrumDigestsSizeInByte)
+
+    CHAR16 MINER_SOL_FLAG_FILE_NAME[] = L"snapshotMinerSolutionFlag";
+    logToConsole(L"Loading miner solution flags");
+    loadedSize = load(MINER_SOL_FLAG_FILE_NAME, NUMBER_OF_MINER_SOLUTION_FLAGS / 8, (unsigned char*)minerSolutionFlags, directory);
+    if (loadedSize != NUMBER_OF_MINER_SOLUTION_FLAGS / 8)
     {
-        logToConsole(L"Failed to save spectrum digest");
+        logToConsole(L"Failed to load miner solution flag");
         return false;
     }
+    appendLoadingPhaseDuration(timing, L", other files ", phaseBeginningTick);
 
-    CHAR16 UNIVERSE_DIGEST_FILE_NAME[] = L"snapshotUniverseDigest";
-    savedSize = save(UNIVERSE_DIGEST_FILE_NAME, assetDigestsSizeInBytes, (unsigned char*)assetDigests, directory);
-    logToConsole(L"Saving universe digests");
-    if (savedSize != assetDigestsSizeInBytes)
+    // digests only need to be recomputed (in the first tick) if the states don't match the saved digests
+    const bool spectrumVerified = StateLoader::endTree(spectrumTree);
+    const bool universeVerified = StateLoader::endTree(universeTree);
+    const bool computerVerified = StateLoader::endTree(computerTree);
+    setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), (spectrumVerified) ? 0 : 0xFF);
+    setMem(assetChangeFlags, ASSETS_CAPACITY / 8, (universeVerified) ? 0 : 0xFF);
+    setMem(contractStateChangeFlags, MAX_NUMBER_OF_CONTRACTS / 8, (computerVerified) ? 0 : 0xFF);
+    if (!spectrumVerified)
     {
-        logToConsole(L"Failed to save universe digest");
-        return false;
+        logToConsole(L"Spectrum does not match saved digests, digests will be recomputed");
     }
-
-    CHAR16 COMPUTER_DIGEST_FILE_NAME[] = L"snapshotComputerDigest";
-    savedSize = save(COMPUTER_DIGEST_FILE_NAME, contractStateDigestsSizeInBytes, (unsigned char*)contractStateDigests, directory);
-    logToConsole(L"Saving computer digests");
-    if (savedSize != contractStateDigestsSizeInBytes)
+    if (!universeVerified)
     {
-        logToConsole(L"Failed to save computer digest");
-        return false;
+        logToConsole(L"Universe does not match saved digests, digests will be recomputed");
     }
+    if (!computerVerified)
+    {
+        logToConsole(L"Contract states do not match saved digests, digests will be recomputed");
+    }
+    appendLoadingPhaseDuration(timing, L", verification ", phaseBeginningTick);
 
-    CHAR16 MINER_SOL_FLAG_FILE_NAME[] = L"snapshotMinerSolutionFlag";
-    logToConsole(L"Saving miner solution flags");
-    savedSize = save(MINER_SOL_FLAG_FILE_NAME, NUMBER_OF_MINER_SOLUTION_FLAGS / 8, (unsigned char*)minerSolutionFlags, directory);
-    if (savedSize != NUMBER_OF_MINER_SOLUTION_FLAGS / 8)
+    // apply changes of delta snapshots saved after the last full snapshot (snapshots without deltas lack the count file)
+    CHAR16 DELTA_COUNT_FILE_NAME[] = L"snapshotDeltaCount";
+    nodeStateSnapshotNumberOfDeltas = 0;
+    if (getFileSize(DELTA_COUNT_FILE_NAME, directory) == sizeof(nodeStateSnapshotNumberOfDeltas)
+        && load(DELTA_COUNT_FILE_NAME, sizeof(nodeStateSnapshotNumberOfDeltas), (unsigned char*)&nodeStateSnapshotNumberOfDeltas, directory) != sizeof(nodeStateSnapshotNumberOfDeltas))
     {
-        logToConsole(L"Failed to save miner solution flag");
+        logToConsole(L"Failed to load number of snapshot deltas");
         return false;
     }
+    if (nodeStateSnapshotNumberOfDeltas)
+    {
+        if (!StateSnapshot::prepare(directory) || !addNodeStateSnapshotRegions(&system))
+        {
+            logToConsole(L"Failed to define snapshot regions");
+            return false;
+        }
+        for (unsigned int deltaIndex = 1; deltaIndex <= nodeStateSnapshotNumberOfDeltas; deltaIndex++)
+        {
+            CHAR16 deltaFileName[32];
+            setNodeStateDeltaFileName(deltaFileName, deltaIndex);
+            if (!StateSnapshot::applyDelta(deltaFileName))
+            {
+                logToConsole(L"Failed to apply snapshot delta");
+                return false;
+            }
+        }
+        updateSpectrumInfo();
+        setText(message, L"Applied ");
+        appendNumber(message, nodeStateSnapshotNumberOfDeltas, FALSE);
+        appendText(message, L" snapshot deltas");
+        logToConsole(message);
+    }
+    appendLoadingPhaseDuration(timing, L", deltas ", phaseBeginningTick);
 
-    setText(message, L"Saving tick storage ");
-    logToConsole(message);
-    if (ts.trySaveToFile(system.epoch, system.tick, directory) != 0)
+    loadTickProcessingStates(nodeStateBuffer);
+    copyMem((void*)faultyComputorFlags, nodeStateBuffer.faultyComputorFlags, sizeof(faultyComputorFlags));
+    initialRandomSeedFromPersistingState = nodeStateBuffer.currentRandomSeed;
+    logger.tickCompleted();
+    loadMiningSeedFromFile = true;
+
+    // update own computor indices
+    for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
     {
-        logToConsole(L"Failed to save tick storage");
-        return false;
+        for (unsigned int j = 0; j < sizeof(computorSeeds) / sizeof(computorSeeds[0]); j++)
+        {
+            if (broadcastedComputors.computors.publicKeys[i] == computorPublicKeys[j])
+            {
+                ownComputorIndices[numberOfOwnComputorIndices] = i;
+                ownComputorIndicesMapping[numberOfOwnComputorIndices++] = j;
+
+                break;
+            }
+        }
     }
 
 #if ADDON_TX_STATUS_REQUEST
-    if (!saveStateTxStatus(numberOfTransactions, directory))
+    if (!loadStateTxStatus(numberOfTransactions, directory))
     {
-        logToConsole(L"Failed to save tx status");
+        logToConsole(L"Failed to load tx status");
         return false;
     }
+    appendLoadingPhaseDuration(timing, L", tx status ", phaseBeginningTick);
 #endif
 
+#if ENABLED_LOGGING
+    logToConsole(L"Initializing logger");
+    logger.reset(system.initialTick); // initialize the logger
+#endif
     return true;
 }
 
@@ -3291,141 +2598,69 @@ static bool loadAllNodeStates()
         logToConsole(L"Found epoch snapshot directory. Using node states snapshot.");
     }
 
-    if (ts.tryLoadFromFile(system.epoch, directory) != 0)
-    {
-        logToConsole(L"Failed to load tick storage");
-        return false;
-    }
-    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 4] = L'0';
-    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 3] = L'0';
-    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 2] = L'0';
-    if (!loadSpectrum(SPECTRUM_FILE_NAME, directory))
+    // All other processors verify the loaded states against the saved digests while the main processor reads the
+    // files. Without them, the main processor verifies the states itself.
+    StateLoader::begin();
+    EFI_EVENT workersEvent = NULL;
+    EFI_GUID mpServiceProtocolGuid = EFI_MP_SERVICES_PROTOCOL_GUID;
+    if (bs->LocateProtocol(&mpServiceProtocolGuid, NULL, (void**)&mpServicesProtocol)
+        || bs->CreateEvent(0, 0, NULL, NULL, &workersEvent))
     {
-        logToConsole(L"Failed to load spectrum");
-        return false;
+        workersEvent = NULL;
     }
-
-    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 4] = L'0';
-    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 3] = L'0';
-    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 2] = L'0';
-    if (!loadUniverse(directory))
+    else if (mpServicesProtocol->StartupAllAPs(mpServicesProtocol, stateLoadWorker, FALSE, workersEvent, 0, NULL, NULL))
     {
-        logToConsole(L"Failed to load universe");
-        return false;
+        bs->CloseEvent(workersEvent);
+        workersEvent = NULL;
     }
-
-    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 4] = L'0';
-    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 3] = L'0';
-    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 2] = L'0';
-    const bool forceLoadContractFile = true;
-    if (!loadComputer(directory, forceLoadContractFile))
+    if (!workersEvent)
     {
-        logToConsole(L"Failed to load computer");
-        return false;
+        logToConsole(L"Verifying node states without other processors");
     }
 
-    CHAR16 NODE_STATE_FILE_NAME[] = L"snapshotNodeMiningState";
-    long long loadedSize = load(NODE_STATE_FILE_NAME, sizeof(nodeStateBuffer), (unsigned char*)&nodeStateBuffer, directory);
-    if (loadedSize != sizeof(nodeStateBuffer))
-    {
-        logToConsole(L"Failed to load mining state");
-        return false;
-    }
-    copyMem(&etalonTick, &nodeStateBuffer.etalonTick, sizeof(etalonTick));
-    copyMem((void*)minerPublicKeys, nodeStateBuffer.minerPublicKeys, sizeof(minerPublicKeys));
-    copyMem((void*)minerScores, nodeStateBuffer.minerScores, sizeof(minerScores));
-    copyMem((void*)competitorPublicKeys, nodeStateBuffer.competitorPublicKeys, sizeof(competitorPublicKeys));
-    copyMem((void*)competitorScores, nodeStateBuffer.competitorScores, sizeof(competitorScores));
-    copyMem((void*)competitorComputorStatuses, nodeStateBuffer.competitorComputorStatuses, sizeof(competitorComputorStatuses));
-    copyMem((void*)solutionPublicationTicks, nodeStateBuffer.solutionPublicationTicks, sizeof(solutionPublicationTicks));
-    copyMem((void*)faultyComputorFlags, nodeStateBuffer.faultyComputorFlags, sizeof(faultyComputorFlags));
-    copyMem((void*)&broadcastedComputors, &nodeStateBuffer.broadcastedComputors, sizeof(broadcastedComputors));
-    copyMem(&resourceTestingDigest, &nodeStateBuffer.resourceTestingDigest, sizeof(resourceTestingDigest));
-    numberOfMiners = nodeStateBuffer.numberOfMiners;
-    initialRandomSeedFromPersistingState = nodeStateBuffer.currentRandomSeed;
-    numberOfTransactions = nodeStateBuffer.numberOfTransactions;
-    logger.logId = nodeStateBuffer.lastLogId;
-    loadMiningSeedFromFile = true;
-    voteCounter.loadAllDataFromArray(nodeStateBuffer.voteCounterData);
+    const unsigned long long beginningTick = __rdtsc();
+    CHAR16 timing[256];
+    setText(timing, L"Node states loaded: ");
+    const bool ok = loadAllNodeStatesFromFiles(directory, timing);
 
-    // update own computor indices
-    for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+    // wait until all processors are available again
+    StateLoader::end();
+    if (workersEvent)
     {
-        for (unsigned int j = 0; j < sizeof(computorSeeds) / sizeof(computorSeeds[0]); j++)
+        while (bs->CheckEvent(workersEvent) == EFI_NOT_READY)
         {
-            if (broadcastedComputors.computors.publicKeys[i] == computorPublicKeys[j])
-            {
-                ownComputorIndices[numberOfOwnComputorIndices] = i;
-                ownComputorIndicesMapping[numberOfOwnComputorIndices++] = j;
-
-                break;
-            }
+            _mm_pause();
         }
+        bs->CloseEvent(workersEvent);
     }
 
-    static unsigned short SYSTEM_SNAPSHOT_FILE_NAME[] = L"system.snp";
-    loadedSize = load(SYSTEM_SNAPSHOT_FILE_NAME, sizeof(system), (unsigned char*)&system, directory);
-    if (loadedSize != sizeof(system))
-    {
-        logToConsole(L"Failed to load system");
-        return false;
-    }
-
-    setMem(assetChangeFlags, sizeof(assetChangeFlags), 0);
-    setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
-    CHAR16 SPECTRUM_DIGEST_FILE_NAME[] = L"snapshotSpectrumDigest";
-    loadedSize = load(SPECTRUM_DIGEST_FILE_NAME, spectrumDigestsSizeInByte, (unsigned char*)spectrumDigests, directory);
-    logToConsole(L"Loading spectrum digests");
-    if (loadedSize != spectrumDigestsSizeInByte)
-    {
-        logToConsole(L"Failed to load spectrum digest");
-        return false;
-    }
-
-    CHAR16 UNIVERSE_DIGEST_FILE_NAME[] = L"snapshotUniverseDigest";
-    loadedSize = load(UNIVERSE_DIGEST_FILE_NAME, assetDigestsSizeInBytes, (unsigned char*)assetDigests, directory);
-    logToConsole(L"Loading universe digests");
-    if (loadedSize != assetDigestsSizeInBytes)
-    {
-        logToConsole(L"Failed to load universe digest");
-        return false;
-    }
-
-    CHAR16 COMPUTER_DIGEST_FILE_NAME[] = L"snapshotComputerDigest";
-    loadedSize = load(COMPUTER_DIGEST_FILE_NAME, contractStateDigestsSizeInBytes, (unsigned char*)contractStateDigests, directory);
-    logToConsole(L"Loading computer digests");
-    if (loadedSize != contractStateDigestsSizeInBytes)
+    if (ok)
     {
-        logToConsole(L"Failed to load computer digest");
-        return false;
+        appendText(timing, L", total ");
+        appendNumber(timing, (__rdtsc() - beginningTick) * 1000 / frequency, TRUE);
+        appendText(timing, L" ms (");
+        appendNumber(timing, StateLoader::getNumberOfVerifiedBytes(), TRUE);
+        appendText(timing, L" bytes verified)");
+        logToConsole(timing);
     }
+    return ok;
+}
 
-    CHAR16 MINER_SOL_FLAG_FILE_NAME[] = L"snapshotMinerSolutionFlag";
-    logToConsole(L"Loading miner solution flags");
-    loadedSize = load(MINER_SOL_FLAG_FILE_NAME, NUMBER_OF_MINER_SOLUTION_FLAGS / 8, (unsigned char*)minerSolutionFlags, directory);
-    if (loadedSize != NUMBER_OF_MINER_SOLUTION_FLAGS / 8)
-    {
-        logToConsole(L"Failed to load miner solution flag");
-        return false;
-    }
+#endif
 
-#if ADDON_TX_STATUS_REQUEST
-    if (!loadStateTxStatus(numberOfTransactions, directory))
+// Complete writing the node states snapshot (main loop only). Processors changing the state may wait for the snapshot
+// while holding spectrumLock, universeLock, or a contract state lock (if all shadow pages are in use). So the main loop
+// has to call this before acquiring one of these locks, for example for saving the spectrum, universe, or contracts.
+static void completeSavingAllNodeStates()
+{
+#if TICK_STORAGE_AUTOSAVE_MODE
+    while (StateSnapshot::isActive())
     {
-        logToConsole(L"Failed to load tx status");
-        return false;
+        continueSavingAllNodeStates();
     }
 #endif
-
-#if ENABLED_LOGGING
-    logToConsole(L"Initializing logger");
-    logger.reset(system.initialTick); // initialize the logger
-#endif
-    return true;
 }
 
-#endif
-
 static void tickProcessor(void*)
 {
     enableAVX();
@@ -3442,6 +2677,9 @@ static void tickProcessor(void*)
 
     loadAllNodeStateFromFile = false;
     unsigned int latestProcessedTick = 0;
+    // solutions of the next tick are prefetched once per transaction slot, not on every pass of the waiting loop
+    unsigned int solutionPrefetchTick = 0;
+    unsigned long long solutionPrefetchFlags[NUMBER_OF_TRANSACTIONS_PER_TICK / 64];
     while (!shutDownNode)
     {
         checkinTime(processorNumber);
@@ -3724,6 +2962,11 @@ static void tickProcessor(void*)
                         unsigned long long unknownTransactions[NUMBER_OF_TRANSACTIONS_PER_TICK / 64];
                         bs->SetMem(unknownTransactions, sizeof(unknownTransactions), 0);
                         const auto* tsNextTickTransactionOffsets = ts.tickTransactionOffsets.getByTickIndex(nextTickIndex);
+                        if (solutionPrefetchTick != nextTick)
+                        {
+                            bs->SetMem(solutionPrefetchFlags, sizeof(solutionPrefetchFlags), 0);
+                            solutionPrefetchTick = nextTick;
+                        }
                         for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
                         {
                             if (!isZero(nextTickData.transactionDigests[i]))
@@ -3742,6 +2985,11 @@ static void tickProcessor(void*)
                                     if (digest == nextTickData.transactionDigests[i])
                                     {
                                         numberOfKnownNextTickTransactions++;
+                                        if (!(solutionPrefetchFlags[i >> 6] & (1ULL << (i & 63))))
+                                        {
+                                            solutionPrefetchFlags[i >> 6] |= (1ULL << (i & 63));
+                                            addSolutionTask(transaction, score->PrefetchTask);
+                                        }
                                     }
                                     else
                                     {
@@ -4051,9 +3299,7 @@ static void tickProcessor(void*)
                                 }
                                 if (tickDataSuits)
                                 {
-                                    const int dayIndex = ::dayIndex(etalonTick.year, etalonTick.month, etalonTick.day);
-                                    if ((dayIndex == 738570 + system.epoch * 7 && etalonTick.hour >= 12)
-                                        || dayIndex > 738570 + system.epoch * 7)
+                                    if (isEpochEndReached())
                                     {
                                         // start seamless epoch transition
                                         epochTransitionState = 1;
@@ -4061,64 +3307,10 @@ static void tickProcessor(void*)
                                     }
                                     else
                                     {
-                                        // update etalonTick
-                                        etalonTick.tick++;
-                                        ts.tickData.acquireLock();
-                                        const TickData& td = ts.tickData[currentTickIndex];
-                                        if (td.epoch == system.epoch
-                                            && (td.year > etalonTick.year
-                                                || (td.year == etalonTick.year && (td.month > etalonTick.month
-                                                    || (td.month == etalonTick.month && (td.day > etalonTick.day
-                                                        || (td.day == etalonTick.day && (td.hour > etalonTick.hour
-                                                            || (td.hour == etalonTick.hour && (td.minute > etalonTick.minute
-                                                                || (td.minute == etalonTick.minute && (td.second > etalonTick.second
-                                                                    || (td.second == etalonTick.second && td.millisecond > etalonTick.millisecond)))))))))))))
-                                        {
-                                            etalonTick.millisecond = td.millisecond;
-                                            etalonTick.second = td.second;
-                                            etalonTick.minute = td.minute;
-                                            etalonTick.hour = td.hour;
-                                            etalonTick.day = td.day;
-                                            etalonTick.month = td.month;
-                                            etalonTick.year = td.year;
-                                        }
-                                        else
-                                        {
-                                            if (++etalonTick.millisecond > 999)
-                                            {
-                                                etalonTick.millisecond = 0;
-
-                                                if (++etalonTick.second > 59)
-                                                {
-                                                    etalonTick.second = 0;
-
-                                                    if (++etalonTick.minute > 59)
-                                                    {
-                                                        etalonTick.minute = 0;
-
-                                                        if (++etalonTick.hour > 23)
-                                                        {
-                                                            etalonTick.hour = 0;
-
-                                                            if (++etalonTick.day > ((etalonTick.month == 1 || etalonTick.month == 3 || etalonTick.month == 5 || etalonTick.month == 7 || etalonTick.month == 8 || etalonTick.month == 10 || etalonTick.month == 12) ? 31 : ((etalonTick.month == 4 || etalonTick.month == 6 || etalonTick.month == 9 || etalonTick.month == 11) ? 30 : ((etalonTick.year & 3) ? 28 : 29))))
-                                                            {
-                                                                etalonTick.day = 1;
-
-                                                                if (++etalonTick.month > 12)
-                                                                {
-                                                                    etalonTick.month = 1;
-
-                                                                    ++etalonTick.year;
-                                                                }
-                                                            }
-                                                        }
-                                                    }
-                                                }
-                                            }
-                                        }
-                                        ts.tickData.releaseLock();
+                                        advanceEtalonTick();
                                     }
 
+                                    logger.tickCompleted();
                                     system.tick++;
 
                                     checkAndSwitchMiningPhase();
@@ -4174,12 +3366,11 @@ static void tickProcessor(void*)
 
                                         // Some debug checks that we are ready for the next epoch
                                         ASSERT(system.numberOfSolutions == 0);
-                                        ASSERT(numberOfMiners == NUMBER_OF_COMPUTORS);
+                                        ASSERT(minerScores.numberOfMiners() == NUMBER_OF_COMPUTORS);
                                         ASSERT(isZero(system.solutions, sizeof(system.solutions)));
                                         ASSERT(isZero(solutionPublicationTicks, sizeof(solutionPublicationTicks)));
                                         ASSERT(isZero(minerSolutionFlags, NUMBER_OF_MINER_SOLUTION_FLAGS / 8));
-                                        ASSERT(isZero((void*)minerScores, sizeof(minerScores)));
-                                        ASSERT(isZero((void*)minerPublicKeys, sizeof(minerPublicKeys)));
+                                        ASSERT(minerScores.score(minerScores.beginRanking()) == 0);
                                         ASSERT(isZero(competitorScores, sizeof(competitorScores)));
                                         ASSERT(isZero(competitorPublicKeys, sizeof(competitorPublicKeys)));
                                         ASSERT(isZero(competitorComputorStatuses, sizeof(competitorComputorStatuses)));
@@ -4245,9 +3436,27 @@ static void contractProcessorShutdownCallback(EFI_EVENT Event, void* Context)
 {
     bs->CloseEvent(Event);
 
+    // After timeout, release scratchpads that the contract processor holds (for example in HashMap or collection cleanup),
+    // because otherwise reorganizeSpectrum() and assetsEndEpoch() wait for them forever. Nothing is held after finishing.
+    const Processor* processor = (const Processor*)Context;
+    releaseScratchpadsOfStack(processor->bottom(), processor->top());
+
     contractProcessorState = 0;
 }
 
+static void speculativeContractProcessorShutdownCallback(EFI_EVENT Event, void* Context)
+{
+    bs->CloseEvent(Event);
+
+    SpeculativeLane& lane = *(SpeculativeLane*)Context;
+    if (!lane.completed)
+    {
+        // timeout (for example caused by __qpiAbort()) -> undo transaction and execute it again sequentially
+        abortSpeculativeLane(lane);
+    }
+    lane.state = 0;
+}
+
 // directory: source directory to load the file. Default: NULL - load from root dir /
 // forceLoadFromFile: when loading node states from file, we want to make sure it load from file and ignore constructionEpoch == system.epoch case
 static bool loadComputer(CHAR16* directory, bool forceLoadFromFile)
@@ -4266,7 +3475,7 @@ static bool loadComputer(CHAR16* directory, bool forceLoadFromFile)
             CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 8] = (contractIndex % 1000) / 100 + L'0';
             CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 7] = (contractIndex % 100) / 10 + L'0';
             CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 6] = contractIndex % 10 + L'0';
-            long long loadedSize = load(CONTRACT_FILE_NAME, contractDescriptions[contractIndex].stateSize, contractStates[contractIndex], directory);
+            long long loadedSize = loadStateFile(CONTRACT_FILE_NAME, contractDescriptions[contractIndex].stateSize, contractStates[contractIndex], directory);
             if (loadedSize != contractDescriptions[contractIndex].stateSize)
             {
                 logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() reads invalid number of bytes", loadedSize, __LINE__);
@@ -4299,7 +3508,8 @@ static bool saveComputer(CHAR16* directory)
         CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 7] = (contractIndex % 100) / 10 + L'0';
         CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 6] = contractIndex % 10 + L'0';
         contractStateLock[contractIndex].acquireRead();
-        long long savedSize = save(CONTRACT_FILE_NAME, contractDescriptions[contractIndex].stateSize, contractStates[contractIndex], directory);
+        // contract states have no common slot size, zero records of cache line size are removed
+        long long savedSize = saveStateFile(CONTRACT_FILE_NAME, contractDescriptions[contractIndex].stateSize, contractStates[contractIndex], 64, directory);
         contractStateLock[contractIndex].releaseRead();
         totalSize += savedSize;
         if (savedSize != contractDescriptions[contractIndex].stateSize)
@@ -4386,6 +3596,8 @@ static bool initialize()
     requestedTickData.header.setType(RequestTickData::type);
     requestedTickTransactions.header.setSize<sizeof(requestedTickTransactions)>();
     requestedTickTransactions.header.setType(REQUEST_TICK_TRANSACTIONS);
+    requestedTickRange.header.setSize<sizeof(requestedTickRange)>();
+    requestedTickRange.header.setType(RequestTickRange::type);
     requestedTickTransactions.requestedTickTransactions.tick = 0;
 
     if (!initFilesystem())
@@ -4395,6 +3607,14 @@ static bool initialize()
     {
         if (!ts.init())
             return false;
+#if TICK_ARCHIVE
+        if (!tickArchive.init())
+            return false;
+#endif
+#if ENTITY_TX_HISTORY
+        if (!entityTxHistory.init())
+            return false;
+#endif
         if (status = bs->AllocatePool(EfiRuntimeServicesData, SPECTRUM_CAPACITY * MAX_TRANSACTION_SIZE, (void**)&entityPendingTransactions))
         {
             logStatusAndMemInfoToConsole(L"EFI_BOOT_SERVICES.AllocatePool() fails", status, __LINE__, SPECTRUM_CAPACITY * MAX_TRANSACTION_SIZE);
@@ -4429,6 +3649,7 @@ static bool initialize()
             return false;
 
         initContractExec();
+        unsigned long long totalContractStateSize = 0;
         for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
         {
             unsigned long long size = contractDescriptions[contractIndex].stateSize;
@@ -4438,7 +3659,10 @@ static bool initialize()
 
                 return false;
             }
+            totalContractStateSize += (size + 63) & ~63ULL;
         }
+        if (!initSpeculativeExecution(totalContractStateSize))
+            return false;
 
         if (status = bs->AllocatePool(EfiRuntimeServicesData, sizeof(*score), (void**)&score))
         {
@@ -4455,6 +3679,14 @@ static bool initialize()
             return false;
         }
 
+#if TICK_STORAGE_AUTOSAVE_MODE
+        if (!StateSnapshot::init(spectrumSizeInBytes + spectrumDigestsSizeInByte + universeSizeInBytes + assetDigestsSizeInBytes
+            + totalContractStateSize + contractStateDigestsSizeInBytes + sizeof(system) + sizeof(nodeStateBuffer) + NUMBER_OF_MINER_SOLUTION_FLAGS / 8))
+        {
+            return false;
+        }
+#endif
+
         if (!logger.initLogging())
         {
             return false;
@@ -4706,6 +3938,14 @@ static void deinitialize()
 
     logger.deinitLogging();
 
+#if TICK_ARCHIVE
+    tickArchive.deinit();
+#endif
+
+#if ENTITY_TX_HISTORY
+    entityTxHistory.deinit();
+#endif
+
 #if ADDON_TX_STATUS_REQUEST
     deinitTxStatusRequestAddOn();
 #endif
@@ -4714,6 +3954,7 @@ static void deinitialize()
     {
         bs->FreePool(contractStateChangeFlags);
     }
+    deinitSpeculativeExecution();
     for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
     {
         if (contractStates[contractIndex])
@@ -4748,6 +3989,9 @@ static void deinitialize()
     {
         bs->FreePool(minerSolutionFlags);
     }
+#if TICK_STORAGE_AUTOSAVE_MODE
+    StateSnapshot::deinit();
+#endif
 
     if (dejavu0)
     {
@@ -5063,6 +4307,7 @@ static void logHealthStatus()
                 maxStackUsageTick = used;
             break;
         case Processor::ContractProcessor:
+        case Processor::SpeculativeContractProcessor:
             if (maxStackUsageContract < used)
                 maxStackUsageContract = used;
             break;
@@ -5297,11 +4542,11 @@ static void processKeyPresses()
         case 0x0D:
         {
             unsigned int numberOfSolutions = 0;
-            for (unsigned int i = 0; i < numberOfMiners; i++)
+            for (unsigned int i = 0; i < minerScores.numberOfMiners(); i++)
             {
-                numberOfSolutions += minerScores[i];
+                numberOfSolutions += minerScores.score(i);
             }
-            setNumber(message, numberOfMiners, TRUE);
+            setNumber(message, minerScores.numberOfMiners(), TRUE);
             appendText(message, L" miners with ");
             appendNumber(message, numberOfSolutions, TRUE);
             appendText(message, L" solutions (min computor score = ");
@@ -5348,6 +4593,7 @@ static void processKeyPresses()
         case 0x10:
         {
             logToConsole(L"Pressed F6 key");
+            completeSavingAllNodeStates();
             SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 4] = L'0';
             SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 3] = L'0';
             SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 2] = L'0';
@@ -5492,6 +4738,7 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
         nTickProcessorIDs = 0;
         nRequestProcessorIDs = 0;
         nContractProcessorIDs = 0;
+        nSpeculativeContractProcessorIDs = 0;
         nSolutionProcessorIDs = 0;
         
         for (int i = 0; i < MAX_NUMBER_OF_PROCESSORS; i++)
@@ -5527,6 +4774,15 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                     computingProcessorNumber = numberOfProcessors;
                     contractProcessorIDs[nContractProcessorIDs++] = i;
                 }
+                else if (numberOfProcessors > 2 && numberOfProcessors <= 2 + NUMBER_OF_SPECULATIVE_LANES)
+                {
+                    SpeculativeLane& lane = speculativeLanes[nSpeculativeContractProcessorIDs];
+                    lane.setStack(processors[numberOfProcessors].bottom(), processors[numberOfProcessors].top());
+                    processors[numberOfProcessors].type = Processor::SpeculativeContractProcessor;
+                    processors[numberOfProcessors].setupFunction(speculativeContractProcessor, &lane);
+                    speculativeContractProcessorNumbers[nSpeculativeContractProcessorIDs] = numberOfProcessors;
+                    speculativeContractProcessorIDs[nSpeculativeContractProcessorIDs++] = i;
+                }
                 else
                 {
                     if (numberOfProcessors == 1)
@@ -5590,6 +4846,18 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
             }
             logToConsole(message);
 
+            if (nSpeculativeContractProcessorIDs)
+            {
+                setText(message, L"Speculative contract processors: ");
+                for (int i = 0; i < nSpeculativeContractProcessorIDs; i++)
+                {
+                    appendText(message, L"Processor #");
+                    appendNumber(message, speculativeContractProcessorIDs[i], false);
+                    if (i != nSpeculativeContractProcessorIDs - 1) appendText(message, L" | ");
+                }
+                logToConsole(message);
+            }
+
             setText(message, L"Solution processors: ");
             for (int i = 0; i < nSolutionProcessorIDs; i++)
             {
@@ -5652,9 +4920,19 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                 if (contractProcessorState == 1)
                 {
                     contractProcessorState = 2;
-                    bs->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_NOTIFY, contractProcessorShutdownCallback, NULL, &contractProcessorEvent);
+                    bs->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_NOTIFY, contractProcessorShutdownCallback, &processors[computingProcessorNumber], &contractProcessorEvent);
                     mpServicesProtocol->StartupThisAP(mpServicesProtocol, Processor::runFunction, contractProcessorIDs[0], contractProcessorEvent, MAX_CONTRACT_ITERATION_DURATION * 1000, &processors[computingProcessorNumber], NULL);
                 }
+                for (int i = 0; i < nSpeculativeContractProcessorIDs; i++)
+                {
+                    if (speculativeLanes[i].state == 1)
+                    {
+                        Processor& processor = processors[speculativeContractProcessorNumbers[i]];
+                        speculativeLanes[i].state = 2;
+                        bs->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_NOTIFY, speculativeContractProcessorShutdownCallback, &speculativeLanes[i], &processor.event);
+                        mpServicesProtocol->StartupThisAP(mpServicesProtocol, Processor::runFunction, speculativeContractProcessorIDs[i], processor.event, MAX_CONTRACT_ITERATION_DURATION * 1000, &processor, NULL);
+                    }
+                }
                 /*if (!computationProcessorState && (computation || __computation))
                 {
                     numberOfAllSCs++;
@@ -5827,6 +5105,14 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
 
                         requestedTickTransactions.requestedTickTransactions.tick = 0;
                     }
+
+                    // Pipeline requests of tick windows if node lags behind
+                    tickSync.beginRequestRound();
+                    while (tickSync.getNextRequest(requestedTickRange.requestTickRange))
+                    {
+                        requestedTickRange.header.randomizeDejavu();
+                        pushToAny(&requestedTickRange.header);
+                    }
                 }
 
                 // Add messages from response queue to sending buffer
@@ -5860,6 +5146,10 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                     saveSystem();
                     systemMustBeSaved = false;
                 }
+                if (spectrumMustBeSaved || universeMustBeSaved || computerMustBeSaved)
+                {
+                    completeSavingAllNodeStates();
+                }
                 if (spectrumMustBeSaved)
                 {
                     saveSpectrum();
@@ -5875,6 +5165,14 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                     saveComputer();
                     computerMustBeSaved = false;
                 }
+                logger.processDiskStorage();
+                logger.processSubscriptions();
+#if TICK_ARCHIVE
+                if (!epochTransitionState)
+                {
+                    tickArchive.process();
+                }
+#endif
 
                 if (forceRefreshPeerList)
                 {
@@ -5893,7 +5191,7 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                     if (system.tick > ts.getPreloadTick()) // check the last saved tick
                     {
                         unsigned int deltaTick = system.tick - lastSavedTick;
-                        if (deltaTick >= TICK_STORAGE_AUTOSAVE_TICK_PERIOD) {
+                        if (deltaTick >= TICK_STORAGE_AUTOSAVE_TICK_PERIOD && !StateSnapshot::isActive()) {
                             requestPersistingNodeState = 1;
                             lastSavedTick = system.tick;
                         }
@@ -5902,9 +5200,19 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                 if (requestPersistingNodeState == 1 && persistingNodeStateTickProcWaiting == 1)
                 {
                     logToConsole(L"Saving node state...");
-                    saveAllNodeStates();
+                    if (!beginSavingAllNodeStates())
+                    {
+                        logToConsole(L"Failed to save node states");
+                    }
                     requestPersistingNodeState = 0;
-                    logToConsole(L"Complete saving all node states");
+                }
+                if (StateSnapshot::isActive())
+                {
+                    // keep writing while the tick processor waits for pages to be written
+                    do
+                    {
+                        continueSavingAllNodeStates();
+                    } while (StateSnapshot::hasWaitingWriters());
                 }
 #endif
 
@@ -14,12 +14,19 @@ unsigned long long top_of_stack;
 #define NOT_CALCULATED -127 //not yet calculated
 #define NULL_INDEX -2
 
+// Accumulate the CPU cycles of the scoring phases per solution buffer (used by tools/score_benchmark, off in the node).
+// Level 2 additionally times the mask computation of every synapse block, which slows down the neuron ticks.
+#ifndef SCORE_PHASE_STATISTICS
+#define SCORE_PHASE_STATISTICS 0
+#endif
+
 template<
     unsigned int dataLength,
     unsigned int numberOfHiddenNeurons,
     unsigned int numberOfNeighborNeurons,
     unsigned int maxDuration,
-    unsigned int solutionBufferCount
+    unsigned int solutionBufferCount,
+    bool useBitPlaneKernel = USE_SCORE_BIT_PLANE_KERNEL
 >
 struct ScoreFunction
 {
@@ -28,6 +35,10 @@ struct ScoreFunction
     static constexpr unsigned long long synapseInputSize = inNeuronsCount * numberOfNeighborNeurons;
     static constexpr unsigned int numberOfCheckPoints = 2;
 
+    // Bit-plane kernel: words per plane of neuron values of a tick, including the copy of the first numberOfNeighborNeurons
+    // neurons at the end and one word of padding for reading 64 bits at any position
+    static constexpr unsigned int neuronPlaneWords = (allParamsCount + numberOfNeighborNeurons + 63) / 64 + 1;
+
 #if defined (__AVX512F__)
     static constexpr int OFFSET = 64;
 #elif defined(__AVX2__)
@@ -55,6 +66,8 @@ struct ScoreFunction
                                                 48)))));
 
     long long miningData[dataLength];
+    // Bit-planes of miningData for the bit-plane kernel: [nonzero / negative]
+    unsigned long long _miningDataPlanes[2][(dataLength + 63) / 64];
     struct synapseStruct
     {
         char* inputLength = nullptr;
@@ -163,8 +176,10 @@ struct ScoreFunction
     struct computeBuffer {
         // neuron only has values [-1, 0, 1]
         struct {
-            char inputAtTick[maxDuration + 1][dataLength + numberOfHiddenNeurons + dataLength + numberOfNeighborNeurons];
+            char inputAtTick[useBitPlaneKernel ? 1 : maxDuration + 1][dataLength + numberOfHiddenNeurons + dataLength + numberOfNeighborNeurons];
         } neurons;
+        // bit-plane kernel: [previous / current tick][nonzero / negative]
+        unsigned long long neuronPlanes[2][2][neuronPlaneWords];
         char* inputLength;
         unsigned int* nnNeuronIndicePos[inNeuronsCount];
         int synapseBucketPos[inNeuronsCount][129];
@@ -184,6 +199,17 @@ struct ScoreFunction
 
         unsigned char* _poolBuffer;
 
+#if SCORE_PHASE_STATISTICS
+        // CPU cycles of the solutions scored with this buffer, neuron ticks include the mask computation
+        struct {
+            unsigned long long numberOfScores;
+            unsigned long long random2PoolCycles;
+            unsigned long long synapseCycles;
+            unsigned long long neuronTickCycles;
+            unsigned long long maskCycles;
+        } phaseStatistics;
+#endif
+
     } *_computeBuffer = nullptr;
     unsigned int* _indiceBigBuffer = nullptr;
 
@@ -192,11 +218,23 @@ struct ScoreFunction
     // i is divisible by _modNum[i][j], j < _totalModNum[i]
     unsigned char _modNum[maxDuration + 1][129];
     unsigned char _tickDiviable[maxDuration + 1][129];
+    // Bitmap of the divisors of tick i in 1..127 for the bit-plane kernel, divisor d is bit (d >> 4) of byte (d & 15)
+    unsigned char _tickDivisorBitmap[maxDuration + 1][16];
 
     m256i currentRandomSeed;
 
     volatile char solutionEngineLock[solutionBufferCount];
 
+    // Neuron ticks of the solution in a solution buffer, shared with helping processors. The neurons of a tick only
+    // depend on the previous tick, so they are split into chunks that any processor can compute. workCounter holds the
+    // tick in the upper 32 bits (0 if no solution is scored) and the next chunk to claim in the lower 32 bits.
+    static constexpr unsigned int neuronChunkSize = 256;
+    static constexpr unsigned int numberOfNeuronChunks = (inNeuronsCount + neuronChunkSize - 1) / neuronChunkSize;
+    struct {
+        volatile long long workCounter;
+        volatile long finishedChunks;
+    } _neuronTickWork[solutionBufferCount];
+
 #if USE_SCORE_CACHE
     volatile char scoreCacheLock;
     ScoreCache<SCORE_CACHE_SIZE, SCORE_CACHE_COLLISION_RETRIES> scoreCache;
@@ -212,9 +250,19 @@ struct ScoreFunction
             {
                 miningData[i] = (miningData[i] >= 0 ? 1 : -1);
             }
+            setMem(_miningDataPlanes, sizeof(_miningDataPlanes), 0);
+            for (unsigned int i = 0; i < dataLength; i++)
+            {
+                _miningDataPlanes[0][i >> 6] |= (1ULL << (i & 63));
+                if (miningData[i] < 0)
+                {
+                    _miningDataPlanes[1][i >> 6] |= (1ULL << (i & 63));
+                }
+            }
             setMem(_totalModNum, sizeof(_totalModNum), 0);
             setMem(_modNum, sizeof(_modNum), 0);
             setMem(_tickDiviable, sizeof(_tickDiviable), 0);
+            setMem(_tickDivisorBitmap, sizeof(_tickDivisorBitmap), 0);
 
             // init the divisible table
             for (int i = 1; i <= maxDuration; i++) 
@@ -225,12 +273,23 @@ struct ScoreFunction
                     {
                         _modNum[i][_totalModNum[i]++] = j;
                         _tickDiviable[i][j] = 1;
+                        _tickDivisorBitmap[i][j & 15] |= (1 << (j >> 4));
                     }
                 }
             }
         }
     }
 
+#if SCORE_PHASE_STATISTICS
+    void resetPhaseStatistics()
+    {
+        for (unsigned int i = 0; i < solutionBufferCount; i++)
+        {
+            setMem(&_computeBuffer[i].phaseStatistics, sizeof(_computeBuffer[i].phaseStatistics), 0);
+        }
+    }
+#endif
+
     ~ScoreFunction()
     {
         freeMemory();
@@ -315,7 +374,7 @@ struct ScoreFunction
                     bigBuffer += numberOfNeighborNeurons;
                 }
 
-                if (!allocatePool(RANDOM2_POOL_SIZE, (void**)&(cb._poolBuffer)))
+                if (!allocatePool(RANDOM2_POOL_SIZE * RANDOM2_LANES, (void**)&(cb._poolBuffer)))
                 {
                     logToConsole(L"Failed to allocate memory for score pool buffer!");
                     return false;
@@ -340,7 +399,12 @@ struct ScoreFunction
             setMem(&_computeBuffer[i].k12, sizeof(_computeBuffer[i].k12), 0);
             setMem(_computeBuffer[i].sckpInput, sizeof(_computeBuffer[i].sckpInput), 0);
             solutionEngineLock[i] = 0;
+            _neuronTickWork[i].workCounter = 0;
+            _neuronTickWork[i].finishedChunks = 0;
         }
+#if SCORE_PHASE_STATISTICS
+        resetPhaseStatistics();
+#endif
 
 #if USE_SCORE_CACHE
         scoreCacheLock = 0;
@@ -429,10 +493,11 @@ struct ScoreFunction
         }
     }
 
-    void generateSynapse(computeBuffer& cb, int solutionBufIdx, const m256i& publicKey, const m256i& nonce)
+    // poolBuffer has been filled by random2Pool() or random2PoolLanes() for publicKey and nonce
+    void generateSynapse(int solutionBufIdx, const unsigned char* poolBuffer)
     {
         auto& synapses = _synapses[solutionBufIdx];
-        random2(&publicKey.m256i_u8[0], &nonce.m256i_u8[0], (unsigned char*)(synapses.inputLength), synapseInputSize, cb._poolBuffer);
+        random2FromPool(poolBuffer, (unsigned char*)(synapses.inputLength), synapseInputSize);
     }
 
     void cacheBucketIndices(const char* synapseLength, computeBuffer& cb, size_t nrIdx, size_t fromSynapseOffset, size_t toSynapseOffset) {
@@ -728,8 +793,329 @@ struct ScoreFunction
 
     }
 
-    // Compute score
-    unsigned int computeScore(const unsigned long long processor_Number, const m256i& publicKey, const m256i& miningSeed, const m256i& nonce)
+    // Compute the input neurons [beginNeuron, endNeuron) of a tick from the neurons of the previous tick (byte kernel)
+    void computeNeuronsAtTick(computeBuffer& cb, const char* pSynapses, int tick, unsigned int beginNeuron, unsigned int endNeuron)
+    {
+        const char* pSynapseInput = pSynapses + beginNeuron * (unsigned long long)numberOfNeighborNeurons;
+        for (unsigned int inputNeuronIndex = beginNeuron; inputNeuronIndex < endNeuron; inputNeuronIndex++, pSynapseInput += numberOfNeighborNeurons)
+        {
+            char prev = 2;
+            char sum = 0;
+
+            bool foundShortCut = false;
+            long long i = (long long)numberOfNeighborNeurons - OFFSET;
+            for (; i >= 0 && !foundShortCut; i -= OFFSET)
+            {
+                const char* pNNSynapse = pSynapseInput + i;
+                char* pNNNr = cb.neurons.inputAtTick[tick - 1] + inputNeuronIndex + 1 + i;
+                unsigned long long negMask = 0;
+                unsigned long long nonZerosMask = 0;
+
+#if SCORE_PHASE_STATISTICS > 1
+                const unsigned long long maskStart = __rdtsc();
+                computeMask(pNNNr, pNNSynapse, tick, nonZerosMask, negMask);
+                cb.phaseStatistics.maskCycles += __rdtsc() - maskStart;
+#else
+                computeMask(pNNNr, pNNSynapse, tick, nonZerosMask, negMask);
+#endif
+
+                constexpr unsigned long long markBit = (1ULL << 63);
+                while (nonZerosMask)
+                {
+                    const unsigned long long maskBit = markBit >> _lzcnt_u64(nonZerosMask);
+                    const char nnV = (maskBit & negMask) ? -1 : 1;
+                    if (nnV == prev)
+                    {
+                        foundShortCut = true;
+                        break;
+                    }
+                    sum += nnV;
+                    prev = nnV;
+                    nonZerosMask ^= maskBit;
+                }
+            }
+
+            if (!foundShortCut)
+            {
+                unsigned int remainData = numberOfNeighborNeurons & OFFSET_1;
+                for (int k = remainData - 1; k >= 0; k--)
+                {
+                    char s = pSynapseInput[k];
+                    if (s == 0 || s == -128) continue;
+                    if (tick % s != 0) continue;
+                    char nn = cb.neurons.inputAtTick[tick - 1][inputNeuronIndex + 1 + k];
+                    if (!nn) continue;
+                    char product = nn;
+                    if (s < 0) product = -product;
+                    if (product == prev)
+                    {
+                        foundShortCut = true;
+                        break;
+                    }
+                    prev = product;
+                    sum += prev;
+                }
+            }
+
+            if (!foundShortCut)
+            {
+                char v = cb.neurons.inputAtTick[tick - 1][dataLength + inputNeuronIndex];
+                if (v != prev)
+                {
+                    sum += v;
+                    clampNeuron(sum);
+                }
+            }
+            cb.neurons.inputAtTick[tick][dataLength + inputNeuronIndex] = sum;
+        }
+    }
+
+    // Compute all input neurons of a tick. With USE_SCORE_HELPERS, idle processors calling tryHelpScoring() take chunks
+    // of the neurons. Every neuron is computed the same way no matter which processor takes its chunk, so the result is
+    // identical to computing the tick on one processor.
+    void computeNeuronTick(int solutionBufIdx, int tick)
+    {
+#if USE_SCORE_HELPERS
+        auto& work = _neuronTickWork[solutionBufIdx];
+        work.finishedChunks = 0;
+        _InterlockedExchange64(&work.workCounter, ((long long)tick) << 32);
+        while (helpNeuronTick(solutionBufIdx))
+        {
+        }
+        // wait for the chunks that helpers are computing
+        while (work.finishedChunks < numberOfNeuronChunks)
+        {
+            _mm_pause();
+        }
+#else
+        computeNeuronsAtTick(_computeBuffer[solutionBufIdx], _synapses[solutionBufIdx].inputLength, tick, 0, inNeuronsCount);
+#endif
+    }
+
+    // Claim and compute one chunk of the current neuron tick of a solution buffer, return false if there is none left
+    bool helpNeuronTick(unsigned int solutionBufIdx)
+    {
+        auto& work = _neuronTickWork[solutionBufIdx];
+        const long long workCounter = work.workCounter;
+        if (!(workCounter >> 32) || (workCounter & 0xFFFFFFFF) >= numberOfNeuronChunks)
+        {
+            return false;
+        }
+
+        // the tick may have changed since reading workCounter, the claimed value tells which tick the chunk belongs to
+        const long long claimed = _InterlockedIncrement64(&work.workCounter) - 1;
+        const int tick = (int)(claimed >> 32);
+        const unsigned int chunk = (unsigned int)(claimed & 0xFFFFFFFF);
+        if (!tick || chunk >= numberOfNeuronChunks)
+        {
+            return false;
+        }
+
+        const unsigned int beginNeuron = chunk * neuronChunkSize;
+        const unsigned int endNeuron = (beginNeuron + neuronChunkSize < inNeuronsCount) ? beginNeuron + neuronChunkSize : inNeuronsCount;
+        computeNeuronsAtTick(_computeBuffer[solutionBufIdx], _synapses[solutionBufIdx].inputLength, tick, beginNeuron, endNeuron);
+        _InterlockedIncrement(&work.finishedChunks);
+        return true;
+    }
+
+    // Help computing the neuron ticks of solutions that other processors are scoring, return true if any chunk was computed
+    bool tryHelpScoring(unsigned long long processorNumber)
+    {
+        bool helped = false;
+#if USE_SCORE_HELPERS
+        for (unsigned int i = 0; i < solutionBufferCount; i++)
+        {
+            const unsigned int solutionBufIdx = (unsigned int)((processorNumber + i) % solutionBufferCount);
+            while (helpNeuronTick(solutionBufIdx))
+            {
+                helped = true;
+            }
+        }
+#endif
+        return helped;
+    }
+
+    // Get the 64 bits of a bit-plane that start at bit position, the word after the bits has to exist
+    static inline unsigned long long getPlaneBits(const unsigned long long* plane, unsigned long long position)
+    {
+        const unsigned long long word = position >> 6;
+        const unsigned int shift = position & 63;
+        if (!shift)
+        {
+            return plane[word];
+        }
+        return (plane[word] >> shift) | (plane[word + 1] << (64 - shift));
+    }
+
+    // Copy the bits of the first numberOfNeighborNeurons neurons to the end of the planes, so that neighbor windows
+    // wrap around without special cases like the byte rows do
+    static inline void wrapNeuronPlanes(unsigned long long (*planes)[neuronPlaneWords])
+    {
+        for (unsigned int plane = 0; plane < 2; plane++)
+        {
+            for (unsigned int i = 0; i < numberOfNeighborNeurons; i += 64)
+            {
+                unsigned long long bits = planes[plane][i >> 6];
+                if (numberOfNeighborNeurons - i < 64)
+                {
+                    bits &= (1ULL << (numberOfNeighborNeurons - i)) - 1;
+                }
+                const unsigned long long position = allParamsCount + i;
+                const unsigned int shift = position & 63;
+                planes[plane][position >> 6] |= bits << shift;
+                if (shift)
+                {
+                    planes[plane][(position >> 6) + 1] |= bits >> (64 - shift);
+                }
+            }
+        }
+    }
+
+    // Masks of 64 synapses that are active at the tick (the length divides the tick) and of the negative synapses
+    static inline void getSynapseMasks(const char* pSynapse, const unsigned char* divisorBitmap, unsigned long long& activeMask, unsigned long long& negMask)
+    {
+        // abs(-128) stays 0x80, which selects no bit, the same as length 0
+#if defined (__AVX512F__)
+        const __m512i synapses512 = _mm512_loadu_si512((const __m512i*)pSynapse);
+        const __m512i absSynapse = _mm512_abs_epi8(synapses512);
+        const __m512i low4 = _mm512_set1_epi8(0x0F);
+        const __m512i bitmap = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)divisorBitmap));
+        const __m512i bitSelect = _mm512_broadcast_i32x4(_mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0));
+        const __m512i divisors = _mm512_shuffle_epi8(bitmap, _mm512_and_si512(absSynapse, low4));
+        const __m512i bits = _mm512_shuffle_epi8(bitSelect, _mm512_and_si512(_mm512_srli_epi16(absSynapse, 4), low4));
+        activeMask = _mm512_test_epi8_mask(divisors, bits);
+        negMask = _mm512_movepi8_mask(synapses512);
+#else
+        const __m256i low4 = _mm256_set1_epi8(0x0F);
+        const __m256i zeros256 = _mm256_setzero_si256();
+        const __m256i bitmap = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)divisorBitmap));
+        const __m256i bitSelect = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                   1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+        activeMask = 0;
+        negMask = 0;
+        for (unsigned int half = 0; half < 2; half++)
+        {
+            const __m256i synapses256 = _mm256_loadu_si256((const __m256i*)(pSynapse + half * 32));
+            const __m256i absSynapse = _mm256_abs_epi8(synapses256);
+            const __m256i divisors = _mm256_shuffle_epi8(bitmap, _mm256_and_si256(absSynapse, low4));
+            const __m256i bits = _mm256_shuffle_epi8(bitSelect, _mm256_and_si256(_mm256_srli_epi16(absSynapse, 4), low4));
+            const unsigned int inactive = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(divisors, bits), zeros256));
+            activeMask |= (unsigned long long)(~inactive) << (half * 32);
+            negMask |= (unsigned long long)(unsigned int)_mm256_movemask_epi8(synapses256) << (half * 32);
+        }
+#endif
+    }
+
+    // Bit-plane kernel of computeScore. The ternary neuron values of the previous and the current tick are kept as
+    // a nonzero and a negative bit-plane, so a block of 64 products is an AND for the nonzero bits and a XOR for the
+    // sign. The synapse lengths are not ternary, they stay bytes and their active and sign masks are computed per block.
+    // The evaluation order, the shortcut and the clamping are the same as in the byte kernel, so the scores are identical.
+    unsigned int computeScoreBitPlanes(computeBuffer& cb, const char* pSynapses)
+    {
+        unsigned long long (*prevPlanes)[neuronPlaneWords] = cb.neuronPlanes[0];
+        unsigned long long (*curPlanes)[neuronPlaneWords] = cb.neuronPlanes[1];
+
+        // tick 0: only the input neurons are set
+        setMem(prevPlanes, sizeof(cb.neuronPlanes[0]), 0);
+        copyMem(prevPlanes[0], _miningDataPlanes[0], sizeof(_miningDataPlanes[0]));
+        copyMem(prevPlanes[1], _miningDataPlanes[1], sizeof(_miningDataPlanes[1]));
+        wrapNeuronPlanes(prevPlanes);
+
+        for (int tick = 1; tick <= maxDuration; tick++)
+        {
+            setMem(curPlanes, sizeof(cb.neuronPlanes[1]), 0);
+            copyMem(curPlanes[0], _miningDataPlanes[0], sizeof(_miningDataPlanes[0]));
+            copyMem(curPlanes[1], _miningDataPlanes[1], sizeof(_miningDataPlanes[1]));
+
+            const char* pSynapseInput = pSynapses;
+            for (unsigned int inputNeuronIndex = 0; inputNeuronIndex < inNeuronsCount; inputNeuronIndex++, pSynapseInput += numberOfNeighborNeurons)
+            {
+                char prev = 2;
+                char sum = 0;
+
+                // blocks of 64 synapses from the top, the last block at 0 may be shorter
+                bool foundShortCut = false;
+                unsigned long long blockEnd = numberOfNeighborNeurons;
+                while (blockEnd && !foundShortCut)
+                {
+                    const unsigned long long blockStart = (blockEnd >= 64) ? blockEnd - 64 : 0;
+                    unsigned long long activeMask, negMask;
+#if SCORE_PHASE_STATISTICS > 1
+                    const unsigned long long maskStart = __rdtsc();
+                    getSynapseMasks(pSynapseInput + blockStart, _tickDivisorBitmap[tick], activeMask, negMask);
+                    cb.phaseStatistics.maskCycles += __rdtsc() - maskStart;
+#else
+                    getSynapseMasks(pSynapseInput + blockStart, _tickDivisorBitmap[tick], activeMask, negMask);
+#endif
+
+                    const unsigned long long neuronPosition = inputNeuronIndex + 1 + blockStart;
+                    unsigned long long nonZerosMask = activeMask & getPlaneBits(prevPlanes[0], neuronPosition);
+                    if (blockEnd - blockStart < 64)
+                    {
+                        nonZerosMask &= (1ULL << (blockEnd - blockStart)) - 1;
+                    }
+                    negMask ^= getPlaneBits(prevPlanes[1], neuronPosition);
+
+                    constexpr unsigned long long markBit = (1ULL << 63);
+                    while (nonZerosMask)
+                    {
+                        const unsigned long long maskBit = markBit >> _lzcnt_u64(nonZerosMask);
+                        const char nnV = (maskBit & negMask) ? -1 : 1;
+                        if (nnV == prev)
+                        {
+                            foundShortCut = true;
+                            break;
+                        }
+                        sum += nnV;
+                        prev = nnV;
+                        nonZerosMask ^= maskBit;
+                    }
+                    blockEnd = blockStart;
+                }
+
+                const unsigned long long word = (dataLength + inputNeuronIndex) >> 6;
+                const unsigned long long bit = 1ULL << ((dataLength + inputNeuronIndex) & 63);
+                if (!foundShortCut && (prevPlanes[0][word] & bit))
+                {
+                    char v = (prevPlanes[1][word] & bit) ? -1 : 1;
+                    if (v != prev)
+                    {
+                        sum += v;
+                        clampNeuron(sum);
+                    }
+                }
+                if (sum)
+                {
+                    curPlanes[0][word] |= bit;
+                    if (sum < 0)
+                    {
+                        curPlanes[1][word] |= bit;
+                    }
+                }
+            }
+
+            wrapNeuronPlanes(curPlanes);
+            unsigned long long (*tmp)[neuronPlaneWords] = prevPlanes;
+            prevPlanes = curPlanes;
+            curPlanes = tmp;
+        }
+
+        // prevPlanes hold the neurons of the last tick
+        unsigned int score = 0;
+        for (unsigned int i = 0; i < dataLength; i++)
+        {
+            const unsigned long long position = dataLength + numberOfHiddenNeurons + i;
+            const unsigned long long bit = 1ULL << (position & 63);
+            if ((prevPlanes[0][position >> 6] & bit) && ((miningData[i] < 0) == ((prevPlanes[1][position >> 6] & bit) != 0)))
+            {
+                score++;
+            }
+        }
+        return score;
+    }
+
+    // Compute score, the random2 pool of the solution is already generated in poolBuffer
+    unsigned int computeScore(const unsigned long long processor_Number, const m256i& publicKey, const m256i& miningSeed, const m256i& nonce, const unsigned char* poolBuffer)
     {
         const int solutionBufIdx = (int)(processor_Number % solutionBufferCount);
 
@@ -737,9 +1123,20 @@ struct ScoreFunction
         auto& synapses = _synapses[solutionBufIdx];
         auto& cb = _computeBuffer[solutionBufIdx];
 
-        generateSynapse(cb, solutionBufIdx, publicKey, nonce);
+#if SCORE_PHASE_STATISTICS
+        const unsigned long long synapseStart = __rdtsc();
+        generateSynapse(solutionBufIdx, poolBuffer);
+        cb.phaseStatistics.synapseCycles += __rdtsc() - synapseStart;
+#else
+        generateSynapse(solutionBufIdx, poolBuffer);
+#endif
         cb.inputLength = synapses.inputLength;
 
+        if constexpr (useBitPlaneKernel)
+        {
+            return computeScoreBitPlanes(cb, synapses.inputLength);
+        }
+
         setMem(cb.synapseBucketPos, sizeof(cb.synapseBucketPos), 0);
         setMem(cb.isGeneratedBucketOffset, sizeof(cb.isGeneratedBucketOffset), 0);
 
@@ -767,73 +1164,11 @@ struct ScoreFunction
                     cb.neurons.inputAtTick[tick][i] = (char)miningData[i];
                 }
 
-                char* pSynapseInput = synapses.inputLength;
-                for (unsigned int inputNeuronIndex = 0; inputNeuronIndex < inNeuronsCount; inputNeuronIndex++, pSynapseInput += numberOfNeighborNeurons)
-                {
-                    char prev = 2;
-                    char sum = 0;
-
-                    bool foundShortCut = false;
-                    long long i = (long long)numberOfNeighborNeurons - OFFSET;
-                    for (; i >= 0 && !foundShortCut; i -= OFFSET)
-                    {
-                        char* pNNSynapse = pSynapseInput + i;
-                        char* pNNNr = cb.neurons.inputAtTick[tick - 1] + inputNeuronIndex + 1 + i;
-                        unsigned long long negMask = 0;
-                        unsigned long long nonZerosMask = 0;
-
-                        computeMask(pNNNr, pNNSynapse, tick, nonZerosMask, negMask);
-
-                        constexpr unsigned long long markBit = (1ULL << 63);
-                        while (nonZerosMask)
-                        {
-                            const unsigned long long maskBit = markBit >> _lzcnt_u64(nonZerosMask);
-                            const char nnV = (maskBit & negMask) ? -1 : 1;
-                            if (nnV == prev)
-                            {
-                                foundShortCut = true;
-                                break;
-                            }
-                            sum += nnV;
-                            prev = nnV;
-                            nonZerosMask ^= maskBit;
-                        }
-                    }
-
-                    if (!foundShortCut)
-                    {
-                        unsigned int remainData = numberOfNeighborNeurons & OFFSET_1;
-                        for (int k = remainData - 1; k >= 0; k--)
-                        {
-                            char s = pSynapseInput[k];
-                            if (s == 0 || s == -128) continue;
-                            if (tick % s != 0) continue;
-                            char nn = cb.neurons.inputAtTick[tick - 1][inputNeuronIndex + 1 + k];
-                            if (!nn) continue;
-                            char product = nn;
-                            if (s < 0) product = -product;
-                            if (product == prev)
-                            {
-                                foundShortCut = true;
-                                break;
-                            }
-                            prev = product;
-                            sum += prev;
-                        }
-                    }
-
-                    if (!foundShortCut)
-                    {
-                        char v = cb.neurons.inputAtTick[tick - 1][dataLength + inputNeuronIndex];
-                        if (v != prev)
-                        {
-                            sum += v;
-                            clampNeuron(sum);
-                        }
-                    }
-                    cb.neurons.inputAtTick[tick][dataLength + inputNeuronIndex] = sum;
-                }
+                computeNeuronTick(solutionBufIdx, tick);
             }
+#if USE_SCORE_HELPERS
+            _InterlockedExchange64(&_neuronTickWork[solutionBufIdx].workCounter, 0);
+#endif
         }
 
         score = 0;
@@ -847,34 +1182,87 @@ struct ScoreFunction
         return score;
     }
 
-    // main score function
-    unsigned int operator()(const unsigned long long processor_Number, const m256i& publicKey, const m256i& miningSeed, const m256i& nonce)
+    // Score up to RANDOM2_LANES solutions. The random2 pools of the solutions that are not in the score cache are
+    // generated together in SIMD lanes, the rest of the scoring runs one solution after the other.
+    void computeScores(const unsigned long long processor_Number, const m256i* publicKey, const m256i* miningSeed, const m256i* nonce, unsigned int count, unsigned int* score)
     {
-        if (isZero(miningSeed) || miningSeed != currentRandomSeed)
+        unsigned int computeIndex[RANDOM2_LANES];
+        unsigned int computeCount = 0;
+#if USE_SCORE_CACHE
+        unsigned int scoreCacheIndex[RANDOM2_LANES];
+#endif
+        for (unsigned int i = 0; i < count; i++)
         {
-            return DATA_LENGTH + 1; // return invalid score
-        }
-
-        int score = 0;
+            if (isZero(miningSeed[i]) || miningSeed[i] != currentRandomSeed)
+            {
+                score[i] = DATA_LENGTH + 1; // invalid score
+                continue;
+            }
 #if USE_SCORE_CACHE
-        unsigned int scoreCacheIndex = scoreCache.getCacheIndex(publicKey, miningSeed, nonce);
-        score = scoreCache.tryFetching(publicKey, miningSeed, nonce, scoreCacheIndex);
-        if (score >= scoreCache.MIN_VALID_SCORE)
+            scoreCacheIndex[i] = scoreCache.getCacheIndex(publicKey[i], miningSeed[i], nonce[i]);
+            const int cachedScore = scoreCache.tryFetching(publicKey[i], miningSeed[i], nonce[i], scoreCacheIndex[i]);
+            if (cachedScore >= scoreCache.MIN_VALID_SCORE)
+            {
+                score[i] = cachedScore;
+                continue;
+            }
+#endif
+            computeIndex[computeCount++] = i;
+        }
+        if (!computeCount)
         {
-            return score;
+            return;
         }
-        score = 0;
-#endif
 
         const int solutionBufIdx = (int)(processor_Number % solutionBufferCount);
         ACQUIRE(solutionEngineLock[solutionBufIdx]);
 
-        score = computeScore(processor_Number, publicKey, miningSeed, nonce);
+        const unsigned char* publicKeys[RANDOM2_LANES];
+        const unsigned char* nonces[RANDOM2_LANES];
+        unsigned char* poolBuffers[RANDOM2_LANES];
+        for (unsigned int j = 0; j < computeCount; j++)
+        {
+            publicKeys[j] = publicKey[computeIndex[j]].m256i_u8;
+            nonces[j] = nonce[computeIndex[j]].m256i_u8;
+            poolBuffers[j] = _computeBuffer[solutionBufIdx]._poolBuffer + j * RANDOM2_POOL_SIZE;
+        }
+#if SCORE_PHASE_STATISTICS
+        auto& phaseStatistics = _computeBuffer[solutionBufIdx].phaseStatistics;
+        unsigned long long phaseStart = __rdtsc();
+        random2PoolLanes(publicKeys, nonces, poolBuffers, computeCount);
+        phaseStatistics.random2PoolCycles += __rdtsc() - phaseStart;
+        phaseStatistics.numberOfScores += computeCount;
+        const unsigned long long synapseCycles = phaseStatistics.synapseCycles;
+        phaseStart = __rdtsc();
+#else
+        random2PoolLanes(publicKeys, nonces, poolBuffers, computeCount);
+#endif
+
+        for (unsigned int j = 0; j < computeCount; j++)
+        {
+            const unsigned int i = computeIndex[j];
+            score[i] = computeScore(processor_Number, publicKey[i], miningSeed[i], nonce[i], poolBuffers[j]);
+        }
+#if SCORE_PHASE_STATISTICS
+        // computeScore() accounts the synapse generation itself, the rest are the neuron ticks
+        phaseStatistics.neuronTickCycles += __rdtsc() - phaseStart - (phaseStatistics.synapseCycles - synapseCycles);
+#endif
 
         RELEASE(solutionEngineLock[solutionBufIdx]);
 #if USE_SCORE_CACHE
-        scoreCache.addEntry(publicKey, miningSeed, nonce, scoreCacheIndex, score);
+        for (unsigned int j = 0; j < computeCount; j++)
+        {
+            const unsigned int i = computeIndex[j];
+            scoreCache.addEntry(publicKey[i], miningSeed[i], nonce[i], scoreCacheIndex[i], score[i]);
+        }
 #endif
+    }
+
+    // main score function
+    unsigned int operator()(const unsigned long long processor_Number, const m256i& publicKey, const m256i& miningSeed, const m256i& nonce)
+    {
+        unsigned int score;
+        computeScores(processor_Number, &publicKey, &miningSeed, &nonce, 1, &score);
 #ifdef NO_UEFI
         int y = 2 + score;
         stackSize = top_of_stack - ((unsigned long long)(&y));
@@ -887,45 +1275,193 @@ struct ScoreFunction
 #endif
 
     // Multithreaded solutions verification:
-    // This module mainly serve tick processor in qubic core node, thus the queue size is limited at NUMBER_OF_TRANSACTIONS_PER_TICK 
-    // for future use for somewhere else, you can only increase the size.
+    // This module mainly serve tick processor in qubic core node. Solutions of the tick being processed are queued
+    // as CurrentTickTask and the tick processor waits until they are scored. Solutions of upcoming ticks may be queued
+    // as PrefetchTask, which are scored into the score cache by solution processors that have nothing else to do.
+    // Each solution processor has a deque per priority. Tasks are distributed round-robin, processors take tasks from
+    // the front of their own deque and steal from the back of the fullest other deque when their own is empty.
+    // A solution that is already queued, being scored or scored since the last reset is not queued again.
+
+    enum TaskPriority
+    {
+        CurrentTickTask = 0,
+        PrefetchTask = 1,
+        NumberOfTaskPriorities = 2
+    };
+    enum TaskState
+    {
+        TaskQueued = 0,
+        TaskProcessing = 1,
+        TaskFinished = 2
+    };
+
+    // Up to NUMBER_OF_TRANSACTIONS_PER_TICK tasks per priority
+    static constexpr unsigned int taskCapacity = NUMBER_OF_TRANSACTIONS_PER_TICK * NumberOfTaskPriorities;
+    static constexpr unsigned int taskHashTableSize = taskCapacity * 2;
+    static_assert(taskCapacity < 65536, "Task indices are stored as unsigned short");
+
+    struct TaskDeque
+    {
+        // a task is pushed at most once per priority, so the deque does not need to wrap around before reset
+        unsigned short task[taskCapacity * NumberOfTaskPriorities];
+        unsigned int head;
+        unsigned int tail;
+    };
 
     volatile char taskQueueLock = 0;
     struct {
-        m256i publicKey[NUMBER_OF_TRANSACTIONS_PER_TICK];
-        m256i miningSeed[NUMBER_OF_TRANSACTIONS_PER_TICK];
-        m256i nonce[NUMBER_OF_TRANSACTIONS_PER_TICK];
+        m256i publicKey[taskCapacity];
+        m256i miningSeed[taskCapacity];
+        m256i nonce[taskCapacity];
+        unsigned char priority[taskCapacity];
+        unsigned char state[taskCapacity];
     } taskQueue;
-    unsigned int _nTask;
-    unsigned int _nProcessing;
-    unsigned int _nFinished;
+    unsigned short taskHashTable[taskHashTableSize]; // task index + 1, 0 marks an empty slot
+    TaskDeque taskDeque[solutionBufferCount][NumberOfTaskPriorities];
+    unsigned int _nTaskCount;
+    unsigned int _nTask[NumberOfTaskPriorities];
+    unsigned int _nQueued[NumberOfTaskPriorities];
+    unsigned int _nFinished[NumberOfTaskPriorities];
+    unsigned int _nNextDeque;
+    unsigned int _nDuplicateTasks;
+    unsigned int _nStolenTasks;
     bool _nIsTaskQueueReady;
 
+    // Hash the whole solution like the score cache, so solutions chosen by miners cannot collide on purpose
+    static unsigned int getTaskHashTableSlot(const m256i& publicKey, const m256i& miningSeed, const m256i& nonce)
+    {
+        m256i buffer[3] = { publicKey, miningSeed, nonce };
+        unsigned long long digest;
+        KangarooTwelve(buffer, sizeof(buffer), &digest, sizeof(digest));
+        return (unsigned int)(digest % taskHashTableSize);
+    }
+
+    // Return index of task or -1 if not found, taskQueueLock has to be acquired
+    int findTask(const m256i& publicKey, const m256i& miningSeed, const m256i& nonce)
+    {
+        unsigned int slot = getTaskHashTableSlot(publicKey, miningSeed, nonce);
+        while (taskHashTable[slot])
+        {
+            const unsigned int index = taskHashTable[slot] - 1;
+            if (taskQueue.publicKey[index] == publicKey && taskQueue.nonce[index] == nonce && taskQueue.miningSeed[index] == miningSeed)
+            {
+                return index;
+            }
+            slot = (slot + 1) % taskHashTableSize;
+        }
+        return -1;
+    }
+
+    void insertTaskIntoHashTable(unsigned int index)
+    {
+        unsigned int slot = getTaskHashTableSlot(taskQueue.publicKey[index], taskQueue.miningSeed[index], taskQueue.nonce[index]);
+        while (taskHashTable[slot])
+        {
+            slot = (slot + 1) % taskHashTableSize;
+        }
+        taskHashTable[slot] = (unsigned short)(index + 1);
+    }
+
+    void pushTask(unsigned int index, unsigned int priority)
+    {
+        TaskDeque& deque = taskDeque[_nNextDeque][priority];
+        deque.task[deque.tail++] = (unsigned short)index;
+        _nNextDeque = (_nNextDeque + 1) % solutionBufferCount;
+    }
+
+    // Drop all queued and finished tasks. Tasks that are being scored are kept as PrefetchTask, so that they are not
+    // scored again if they are added after the reset.
     void resetTaskQueue()
     {
         ACQUIRE(taskQueueLock);
-        _nTask = 0;
-        _nProcessing = 0;
-        _nFinished = 0;
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < _nTaskCount; i++)
+        {
+            if (taskQueue.state[i] == TaskProcessing)
+            {
+                taskQueue.publicKey[count] = taskQueue.publicKey[i];
+                taskQueue.miningSeed[count] = taskQueue.miningSeed[i];
+                taskQueue.nonce[count] = taskQueue.nonce[i];
+                taskQueue.priority[count] = PrefetchTask;
+                taskQueue.state[count] = TaskProcessing;
+                count++;
+            }
+        }
+        _nTaskCount = count;
+        setMem(taskHashTable, sizeof(taskHashTable), 0);
+        for (unsigned int i = 0; i < _nTaskCount; i++)
+        {
+            insertTaskIntoHashTable(i);
+        }
+        for (unsigned int i = 0; i < solutionBufferCount; i++)
+        {
+            for (unsigned int priority = 0; priority < NumberOfTaskPriorities; priority++)
+            {
+                taskDeque[i][priority].head = 0;
+                taskDeque[i][priority].tail = 0;
+            }
+        }
+        for (unsigned int priority = 0; priority < NumberOfTaskPriorities; priority++)
+        {
+            _nTask[priority] = 0;
+            _nQueued[priority] = 0;
+            _nFinished[priority] = 0;
+        }
+        _nTask[PrefetchTask] = count;
+        _nNextDeque = 0;
+        _nDuplicateTasks = 0;
+        _nStolenTasks = 0;
         _nIsTaskQueueReady = false;
         RELEASE(taskQueueLock);
     }
 
-    // add task to the queue
-    // queue size is limited at NUMBER_OF_TRANSACTIONS_PER_TICK 
-    void addTask(m256i publicKey, m256i miningSeed, m256i nonce)
+    // add task to the queue, can call on any thread
+    // If the solution is known already, only its priority is raised if needed.
+    // Queue size is limited at NUMBER_OF_TRANSACTIONS_PER_TICK per priority.
+    void addTask(m256i publicKey, m256i miningSeed, m256i nonce, unsigned int priority = CurrentTickTask)
     {
         ACQUIRE(taskQueueLock);
-        if (_nTask < NUMBER_OF_TRANSACTIONS_PER_TICK)
+        int index = findTask(publicKey, miningSeed, nonce);
+        if (index >= 0)
+        {
+            _nDuplicateTasks++;
+            const unsigned int oldPriority = taskQueue.priority[index];
+            if (priority < oldPriority)
+            {
+                taskQueue.priority[index] = priority;
+                _nTask[oldPriority]--;
+                _nTask[priority]++;
+                if (taskQueue.state[index] == TaskQueued)
+                {
+                    // the entry in the deque of the old priority is skipped when the task has been taken already
+                    _nQueued[oldPriority]--;
+                    _nQueued[priority]++;
+                    pushTask(index, priority);
+                }
+                else if (taskQueue.state[index] == TaskFinished)
+                {
+                    _nFinished[oldPriority]--;
+                    _nFinished[priority]++;
+                }
+            }
+        }
+        else if (_nTaskCount < taskCapacity && _nTask[priority] < NUMBER_OF_TRANSACTIONS_PER_TICK)
         {
-            unsigned int index = _nTask++;
+            index = _nTaskCount++;
             taskQueue.publicKey[index] = publicKey;
             taskQueue.miningSeed[index] = miningSeed;
             taskQueue.nonce[index] = nonce;
+            taskQueue.priority[index] = priority;
+            taskQueue.state[index] = TaskQueued;
+            insertTaskIntoHashTable(index);
+            _nTask[priority]++;
+            _nQueued[priority]++;
+            pushTask(index, priority);
         }
         RELEASE(taskQueueLock);
     }
 
+    // Start processing of CurrentTickTask, PrefetchTask are processed anytime
     void startProcessTaskQueue()
     {
         ACQUIRE(taskQueueLock);
@@ -940,52 +1476,102 @@ struct ScoreFunction
         RELEASE(taskQueueLock);
     }
 
-    // get a task, can call on any thread
-    bool getTask(m256i* publicKey, m256i* miningSeed, m256i* nonce)
+    // get up to RANDOM2_LANES tasks with priority up to lowestPriority for a solution processor, can call on any thread
+    // Tasks are only batched if there are more than solutionBufferCount queued, so that a burst of solutions is
+    // spread over all solution processors before several solutions are scored by one processor.
+    unsigned int getTasks(unsigned int processorIndex, unsigned int lowestPriority, m256i* publicKey, m256i* miningSeed, m256i* nonce)
     {
-        if (!_nIsTaskQueueReady)
-        {
-            return false;
-        }
-        bool result = false;
+        unsigned int count = 0;
         ACQUIRE(taskQueueLock);
-        if (_nProcessing < _nTask)
+        for (unsigned int priority = (_nIsTaskQueueReady ? CurrentTickTask : PrefetchTask); priority <= lowestPriority && !count; priority++)
         {
-            unsigned int index = _nProcessing++;
-            *publicKey = taskQueue.publicKey[index];
-            *miningSeed = taskQueue.miningSeed[index];
-            *nonce = taskQueue.nonce[index];
-            result = true;
-        }
-        else
-        {
-            result = false;
+            unsigned int maxCount = (_nQueued[priority] + solutionBufferCount - 1) / solutionBufferCount;
+            if (maxCount > RANDOM2_LANES)
+            {
+                maxCount = RANDOM2_LANES;
+            }
+            while (count < maxCount)
+            {
+                unsigned int index;
+                TaskDeque& ownDeque = taskDeque[processorIndex][priority];
+                if (ownDeque.head < ownDeque.tail)
+                {
+                    index = ownDeque.task[ownDeque.head++];
+                }
+                else
+                {
+                    TaskDeque* victim = nullptr;
+                    for (unsigned int i = 0; i < solutionBufferCount; i++)
+                    {
+                        TaskDeque& deque = taskDeque[i][priority];
+                        if (deque.tail - deque.head > (victim ? victim->tail - victim->head : 0))
+                        {
+                            victim = &deque;
+                        }
+                    }
+                    if (!victim)
+                    {
+                        break;
+                    }
+                    index = victim->task[--victim->tail];
+                    if (taskQueue.state[index] == TaskQueued)
+                    {
+                        _nStolenTasks++;
+                    }
+                }
+                if (taskQueue.state[index] != TaskQueued)
+                {
+                    continue;
+                }
+                taskQueue.state[index] = TaskProcessing;
+                _nQueued[taskQueue.priority[index]]--;
+                publicKey[count] = taskQueue.publicKey[index];
+                miningSeed[count] = taskQueue.miningSeed[index];
+                nonce[count] = taskQueue.nonce[index];
+                count++;
+            }
         }
         RELEASE(taskQueueLock);
-        return result;
+        return count;
     }
-    void finishTask()
+
+    // Tasks are looked up again, because their index changes if the queue is reset while they are scored
+    void finishTasks(const m256i* publicKey, const m256i* miningSeed, const m256i* nonce, unsigned int count)
     {
         ACQUIRE(taskQueueLock);
-        _nFinished++;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            const int index = findTask(publicKey[i], miningSeed[i], nonce[i]);
+            if (index >= 0 && taskQueue.state[index] == TaskProcessing)
+            {
+                taskQueue.state[index] = TaskFinished;
+                _nFinished[taskQueue.priority[index]]++;
+            }
+        }
         RELEASE(taskQueueLock);
     }
 
+    // All CurrentTickTask are scored
     bool isTaskQueueProcessed()
     {
-        return _nFinished == _nTask;
+        return _nFinished[CurrentTickTask] == _nTask[CurrentTickTask];
     }
 
-    void tryProcessSolution(unsigned long long processorNumber)
+    void tryProcessSolution(unsigned long long processorNumber, unsigned int lowestPriority = PrefetchTask)
     {
-        m256i publicKey;
-        m256i miningSeed;
-        m256i nonce;
-        bool res = this->getTask(&publicKey, &miningSeed, &nonce);
-        if (res)
+        m256i publicKey[RANDOM2_LANES];
+        m256i miningSeed[RANDOM2_LANES];
+        m256i nonce[RANDOM2_LANES];
+        unsigned int score[RANDOM2_LANES];
+        unsigned int count = this->getTasks((unsigned int)(processorNumber % solutionBufferCount), lowestPriority, publicKey, miningSeed, nonce);
+        if (count)
+        {
+            this->computeScores(processorNumber, publicKey, miningSeed, nonce, count, score);
+            this->finishTasks(publicKey, miningSeed, nonce, count);
+        }
+        else
         {
-            (*this)(processorNumber, publicKey, miningSeed, nonce);
-            this->finishTask();
+            tryHelpScoring(processorNumber);
         }
     }
 };
@@ -10,10 +10,14 @@
 
 #include "logging/logging.h"
 
+#include "contract_core/speculative_execution.h"
+
 #include "public_settings.h"
 #include "system.h"
 #include "kangaroo_twelve.h"
 #include "common_buffers.h"
+#include "state_snapshot.h"
+#include "compressed_file_io.h"
 
 
 static volatile char spectrumLock = 0;
@@ -30,8 +34,14 @@ static unsigned long long dustThresholdBurnAll = 0, dustThresholdBurnHalf = 0;
 static m256i* spectrumDigests = nullptr;
 constexpr unsigned long long spectrumDigestsSizeInByte = (SPECTRUM_CAPACITY * 2 - 1) * 32ULL;
 
+// Tick at the end of which spectrumDigests have been updated, 0 if the spectrum has been changed since then (spectrumLock)
+static unsigned int spectrumDigestsTick = 0;
+
 static unsigned long long spectrumReorgTotalExecutionTicks = 0;
 
+// Incremented with each reorganization (spectrumLock held), which changes the indices of entities
+static unsigned int spectrumReorgCount = 0;
+
 
 // Update SpectrumInfo data (exensive, because it iterates the whole spectrum), acquire no lock
 static void updateSpectrumInfo(SpectrumInfo& si = spectrumInfo)
@@ -107,15 +117,19 @@ static void logSpectrumStats()
 }
 
 // Build and log variable-size DustBurning log message.
-// Assumes to be used tick processor or contract processor only, so can use reorgBuffer.
 struct DustBurnLogger
 {
     DustBurnLogger()
     {
-        buf = (DustBurning*)reorgBuffer;
+        buf = (DustBurning*)__acquireScratchpad(sizeof(DustBurning) + 1000 * sizeof(DustBurning::Entity));
         buf->numberOfBurns = 0;
     }
 
+    ~DustBurnLogger()
+    {
+        __releaseScratchpad(buf);
+    }
+
     // Add burned amount of of entity, may send buffered message to logging.
     void addDustBurn(const m256i& publicKey, unsigned long long amount)
     {
@@ -144,7 +158,11 @@ static void reorganizeSpectrum()
 {
     unsigned long long spectrumReorgStartTick = __rdtsc();
 
-    ::Entity* reorgSpectrum = (::Entity*)reorgBuffer;
+    StateSnapshot::beforeWrite(spectrum, spectrumSizeInBytes);
+    StateSnapshot::beforeWrite(spectrumDigests, spectrumDigestsSizeInByte);
+    spectrumDigestsTick = 0;
+
+    ::Entity* reorgSpectrum = (::Entity*)__acquireScratchpad(spectrumSizeInBytes);
     setMem(reorgSpectrum, SPECTRUM_CAPACITY * sizeof(::Entity), 0);
     for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
     {
@@ -166,6 +184,7 @@ static void reorganizeSpectrum()
         }
     }
     copyMem(spectrum, reorgSpectrum, SPECTRUM_CAPACITY * sizeof(::Entity));
+    __releaseScratchpad(reorgSpectrum);
 
     unsigned int digestIndex;
     for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
@@ -187,10 +206,12 @@ static void reorganizeSpectrum()
 
     updateSpectrumInfo();
 
+    spectrumReorgCount++;
     spectrumReorgTotalExecutionTicks += __rdtsc() - spectrumReorgStartTick;
 }
 
-static int spectrumIndex(const m256i& publicKey)
+// Return index of entity in spectrum or -1 if not found (spectrumLock has to be held)
+static int spectrumIndexNoLock(const m256i& publicKey)
 {
     if (isZero(publicKey))
     {
@@ -199,21 +220,15 @@ static int spectrumIndex(const m256i& publicKey)
 
     unsigned int index = publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
 
-    ACQUIRE(spectrumLock);
-
 iteration:
     if (spectrum[index].publicKey == publicKey)
     {
-        RELEASE(spectrumLock);
-
         return index;
     }
     else
     {
         if (isZero(spectrum[index].publicKey))
         {
-            RELEASE(spectrumLock);
-
             return -1;
         }
         else
@@ -225,6 +240,20 @@ iteration:
     }
 }
 
+static int spectrumIndex(const m256i& publicKey)
+{
+    if (isZero(publicKey))
+    {
+        return -1;
+    }
+
+    ACQUIRE(spectrumLock);
+    const int index = spectrumIndexNoLock(publicKey);
+    RELEASE(spectrumLock);
+
+    return index;
+}
+
 static long long energy(const int index)
 {
     return spectrum[index].incomingAmount - spectrum[index].outgoingAmount;
@@ -251,6 +280,8 @@ static void increaseEnergy(const m256i& publicKey, long long amount)
             DustBurnLogger dbl;
 #endif
 
+            StateSnapshot::beforeWrite(spectrum, spectrumSizeInBytes);
+
             if (dustThresholdBurnAll > 0)
             {
                 // Burn every balance with balance < dustThresholdBurnAll
@@ -305,6 +336,8 @@ static void increaseEnergy(const m256i& publicKey, long long amount)
     iteration:
         if (spectrum[index].publicKey == publicKey)
         {
+            StateSnapshot::beforeWrite(&spectrum[index], sizeof(::Entity));
+            spectrumDigestsTick = 0;
             spectrum[index].incomingAmount += amount;
             spectrum[index].numberOfIncomingTransfers++;
             spectrum[index].latestIncomingTransferTick = system.tick;
@@ -315,6 +348,8 @@ static void increaseEnergy(const m256i& publicKey, long long amount)
         {
             if (isZero(spectrum[index].publicKey))
             {
+                StateSnapshot::beforeWrite(&spectrum[index], sizeof(::Entity));
+                spectrumDigestsTick = 0;
                 spectrum[index].publicKey = publicKey;
                 spectrum[index].incomingAmount = amount;
                 spectrum[index].numberOfIncomingTransfers = 1;
@@ -354,17 +389,113 @@ static bool decreaseEnergy(const int index, long long amount)
 
         if (energy(index) >= amount)
         {
+            StateSnapshot::beforeWrite(&spectrum[index], sizeof(::Entity));
+            spectrumDigestsTick = 0;
+            spectrum[index].outgoingAmount += amount;
+            spectrum[index].numberOfOutgoingTransfers++;
+            spectrum[index].latestOutgoingTransferTick = system.tick;
+
+            spectrumInfo.totalAmount -= amount;
+
+            RELEASE(spectrumLock);
+
+            return true;
+        }
+
+        RELEASE(spectrumLock);
+    }
+
+    return false;
+}
+
+// Get balance of entity in speculative execution (see contract_core/speculative_execution.h), tracking read access.
+static long long energySpeculative(SpeculativeLane& lane, const int index)
+{
+    ACQUIRE(spectrumLock);
+    lane.heldSpectrumLock = &spectrumLock;
+    lane.trackRead(speculativeSpectrumEntityResource(index));
+    const long long balance = energy(index);
+    lane.heldSpectrumLock = nullptr;
+    RELEASE(spectrumLock);
+
+    return balance;
+}
+
+// Increase balance of entity in speculative execution. Changes are saved for undo. Creating an entity or burning
+// dust cannot be undone -> transaction is escaped without changing spectrum.
+static void increaseEnergySpeculative(SpeculativeLane& lane, const m256i& publicKey, long long amount)
+{
+    if (!isZero(publicKey) && amount >= 0)
+    {
+        unsigned int index = publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+
+        ACQUIRE(spectrumLock);
+        lane.heldSpectrumLock = &spectrumLock;
+
+        if (spectrumInfo.numberOfEntities >= (SPECTRUM_CAPACITY / 2) + (SPECTRUM_CAPACITY / 4))
+        {
+            // anti-dust feature would be triggered in increaseEnergy()
+            lane.escapeTransaction();
+        }
+        else
+        {
+            while (!(spectrum[index].publicKey == publicKey) && !isZero(spectrum[index].publicKey))
+            {
+                index = (index + 1) & (SPECTRUM_CAPACITY - 1);
+            }
+
+            if (isZero(spectrum[index].publicKey))
+            {
+                // entity would be created in increaseEnergy()
+                lane.escapeTransaction();
+            }
+            else if (lane.prepareWrite(speculativeSpectrumEntityResource(index), &spectrum[index], sizeof(::Entity))
+                && lane.saveAdditionForUndo(&spectrumInfo.totalAmount, amount))
+            {
+                StateSnapshot::beforeWrite(&spectrum[index], sizeof(::Entity));
+                spectrumDigestsTick = 0;
+                spectrum[index].incomingAmount += amount;
+                spectrum[index].numberOfIncomingTransfers++;
+                spectrum[index].latestIncomingTransferTick = system.tick;
+
+                spectrumInfo.totalAmount += amount;
+            }
+        }
+
+        lane.heldSpectrumLock = nullptr;
+        RELEASE(spectrumLock);
+    }
+}
+
+// Decrease balance of entity if it is high enough in speculative execution. Changes are saved for undo. Return false
+// if balance is too low or if the transaction is escaped.
+static bool decreaseEnergySpeculative(SpeculativeLane& lane, const int index, long long amount)
+{
+    if (amount >= 0)
+    {
+        ACQUIRE(spectrumLock);
+        lane.heldSpectrumLock = &spectrumLock;
+
+        lane.trackRead(speculativeSpectrumEntityResource(index));
+        if (energy(index) >= amount
+            && lane.prepareWrite(speculativeSpectrumEntityResource(index), &spectrum[index], sizeof(::Entity))
+            && lane.saveAdditionForUndo(&spectrumInfo.totalAmount, -amount))
+        {
+            StateSnapshot::beforeWrite(&spectrum[index], sizeof(::Entity));
+            spectrumDigestsTick = 0;
             spectrum[index].outgoingAmount += amount;
             spectrum[index].numberOfOutgoingTransfers++;
             spectrum[index].latestOutgoingTransferTick = system.tick;
 
             spectrumInfo.totalAmount -= amount;
 
+            lane.heldSpectrumLock = nullptr;
             RELEASE(spectrumLock);
 
             return true;
         }
 
+        lane.heldSpectrumLock = nullptr;
         RELEASE(spectrumLock);
     }
 
@@ -375,7 +506,7 @@ static bool decreaseEnergy(const int index, long long amount)
 static bool loadSpectrum(const CHAR16* fileName = SPECTRUM_FILE_NAME, const CHAR16* directory = nullptr)
 {
     logToConsole(L"Loading spectrum file ...");
-    long long loadedSize = load(fileName, SPECTRUM_CAPACITY * sizeof(::Entity), (unsigned char*)spectrum, directory);
+    long long loadedSize = loadStateFile(fileName, SPECTRUM_CAPACITY * sizeof(::Entity), (unsigned char*)spectrum, directory);
     if (loadedSize != SPECTRUM_CAPACITY * sizeof(::Entity))
     {
         logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() reads invalid number of bytes", loadedSize, __LINE__);
@@ -393,7 +524,7 @@ static bool saveSpectrum(const CHAR16* fileName = SPECTRUM_FILE_NAME, const CHAR
     const unsigned long long beginningTick = __rdtsc();
 
     ACQUIRE(spectrumLock);
-    long long savedSize = save(fileName, SPECTRUM_CAPACITY * sizeof(::Entity), (unsigned char*)spectrum, directory);
+    long long savedSize = saveStateFile(fileName, SPECTRUM_CAPACITY * sizeof(::Entity), (unsigned char*)spectrum, sizeof(::Entity), directory);
     RELEASE(spectrumLock);
 
     if (savedSize == SPECTRUM_CAPACITY * sizeof(::Entity))
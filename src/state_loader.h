@@ -0,0 +1,317 @@
+#pragma once
+
+#include "platform/m256.h"
+#include "platform/concurrency.h"
+#include "platform/file_io.h"
+#include "platform/console_logging.h"
+
+#include "kangaroo_twelve.h"
+
+// Number of bytes read from a file at once by the processor loading the state
+#ifndef STATE_LOADER_READ_SIZE
+#define STATE_LOADER_READ_SIZE (32ULL * 1024 * 1024)
+#endif
+
+// Maximum number of bytes of leaves verified by one task
+#ifndef STATE_LOADER_TASK_SIZE
+#define STATE_LOADER_TASK_SIZE (1024ULL * 1024)
+#endif
+
+#define STATE_LOADER_MAX_TREES 8
+#define STATE_LOADER_MAX_TASKS 1024
+
+
+// Loads state arrays from files while other processors verify the loaded parts against the saved Merkle trees of
+// their digests (leaf i is the K12 digest of element i and each inner node the K12 digest of its two children,
+// stored level by level like spectrumDigests).
+//
+// Files are read by the processor calling loadLeaves() (the only one with file system access). Each loaded part is
+// queued as a task that hashes the leaves of a subtree and checks them and the inner nodes of the subtree against
+// the saved digests. Other processors run runWorker() between begin() and end() to process the tasks, so
+// verification overlaps with loading. If a tree matches, its digests don't need to be recomputed after loading.
+class StateLoader
+{
+    struct Tree
+    {
+        const m256i* digests;
+        unsigned int numberOfLeaves;
+        unsigned long long leafSize; // 0 if size differs between leaves
+        unsigned int subtreeLeaves; // number of leaves of the subtree verified by one task
+        volatile long pendingTasks;
+        volatile bool mismatch;
+    };
+
+    struct Task
+    {
+        const unsigned char* data; // NULL for leaf with zero digest
+        unsigned long long leafSize;
+        unsigned int tree;
+        unsigned int firstLeaf;
+        unsigned int numberOfLeaves;
+    };
+
+    inline static Tree trees[STATE_LOADER_MAX_TREES];
+    inline static unsigned int numberOfTrees = 0;
+
+    // Ring buffer of queued tasks
+    inline static Task tasks[STATE_LOADER_MAX_TASKS];
+    inline static unsigned int firstTask = 0;
+    inline static unsigned int numberOfTasks = 0;
+    inline static volatile char tasksLock = 0;
+
+    inline static volatile bool stopping = true;
+    inline static volatile long long numberOfVerifiedBytes = 0;
+
+    static bool pushTask(const Task& task)
+    {
+        bool pushed = false;
+        ACQUIRE(tasksLock);
+        if (numberOfTasks < STATE_LOADER_MAX_TASKS)
+        {
+            tasks[(firstTask + numberOfTasks) % STATE_LOADER_MAX_TASKS] = task;
+            numberOfTasks++;
+            pushed = true;
+        }
+        RELEASE(tasksLock);
+        return pushed;
+    }
+
+    static bool popTask(Task& task)
+    {
+        bool popped = false;
+        ACQUIRE(tasksLock);
+        if (numberOfTasks)
+        {
+            task = tasks[firstTask];
+            firstTask = (firstTask + 1) % STATE_LOADER_MAX_TASKS;
+            numberOfTasks--;
+            popped = true;
+        }
+        RELEASE(tasksLock);
+        return popped;
+    }
+
+    // Check inner nodes of the subtree whose nodes [firstNode, firstNode + numberOfNodes) at level form its bottom
+    // (level 0 are the leaves). numberOfNodes must be a power of 2 and firstNode a multiple of it.
+    static bool verifyInnerNodes(const Tree& tree, unsigned int level, unsigned int firstNode, unsigned int numberOfNodes)
+    {
+        unsigned long long levelBeginning = 0;
+        unsigned int levelSize = tree.numberOfLeaves;
+        for (unsigned int i = 0; i < level; i++)
+        {
+            levelBeginning += levelSize;
+            levelSize >>= 1;
+        }
+
+        while (numberOfNodes > 1)
+        {
+            const unsigned long long nextLevelBeginning = levelBeginning + levelSize;
+            for (unsigned int i = 0; i < numberOfNodes; i += 2)
+            {
+                m256i digest;
+                KangarooTwelve64To32(&tree.digests[levelBeginning + firstNode + i], &digest);
+                if (digest != tree.digests[nextLevelBeginning + (firstNode + i) / 2])
+                {
+                    return false;
+                }
+            }
+            levelBeginning = nextLevelBeginning;
+            levelSize >>= 1;
+            firstNode >>= 1;
+            numberOfNodes >>= 1;
+        }
+        return true;
+    }
+
+    static void runTask(const Task& task)
+    {
+        Tree& tree = trees[task.tree];
+        bool match = true;
+        for (unsigned int i = 0; i < task.numberOfLeaves && match; i++)
+        {
+            m256i digest;
+            if (!task.data)
+            {
+                digest = m256i::zero();
+            }
+            else if (task.leafSize == 64)
+            {
+                KangarooTwelve64To32(task.data + i * 64ULL, &digest);
+            }
+            else
+            {
+                KangarooTwelve(task.data + i * task.leafSize, (unsigned int)task.leafSize, &digest, 32);
+            }
+            match = (digest == tree.digests[task.firstLeaf + i]);
+        }
+        if (match)
+        {
+            match = verifyInnerNodes(tree, 0, task.firstLeaf, task.numberOfLeaves);
+        }
+
+        if (!match)
+        {
+            tree.mismatch = true;
+        }
+        _InterlockedExchangeAdd64(&numberOfVerifiedBytes, task.numberOfLeaves * task.leafSize);
+        _InterlockedDecrement(&tree.pendingTasks);
+    }
+
+    // Queue task, running queued tasks on this processor while the queue is full
+    static void queueTask(const Task& task)
+    {
+        _InterlockedIncrement(&trees[task.tree].pendingTasks);
+        while (!pushTask(task))
+        {
+            Task queuedTask;
+            if (popTask(queuedTask))
+            {
+                runTask(queuedTask);
+            }
+        }
+    }
+
+public:
+    // Start loading, afterwards workers can run runWorker()
+    static void begin()
+    {
+        numberOfTrees = 0;
+        firstTask = 0;
+        numberOfTasks = 0;
+        tasksLock = 0;
+        numberOfVerifiedBytes = 0;
+        stopping = false;
+    }
+
+    // Process tasks until end() is called. Run by all processors helping to verify the loaded state.
+    static void runWorker()
+    {
+        while (true)
+        {
+            Task task;
+            if (popTask(task))
+            {
+                runTask(task);
+            }
+            else if (stopping)
+            {
+                break;
+            }
+            else
+            {
+                _mm_pause();
+            }
+        }
+    }
+
+    // Finish remaining tasks and let runWorker() return
+    static void end()
+    {
+        stopping = true;
+        runWorker();
+    }
+
+    // Add tree of numberOfLeaves leaves (power of 2) with saved digests, which are verified while loading leaves of
+    // leafSize bytes with loadLeaves() or leaves of different sizes with verifyLeaf() (leafSize = 0). Returns index
+    // of tree or -1 on error.
+    static int addTree(const m256i* digests, unsigned int numberOfLeaves, unsigned long long leafSize)
+    {
+        if (numberOfTrees == STATE_LOADER_MAX_TREES || !numberOfLeaves || (numberOfLeaves & (numberOfLeaves - 1)))
+        {
+            return -1;
+        }
+
+        Tree& tree = trees[numberOfTrees];
+        tree.digests = digests;
+        tree.numberOfLeaves = numberOfLeaves;
+        tree.leafSize = leafSize;
+        tree.subtreeLeaves = 1;
+        if (leafSize)
+        {
+            while (tree.subtreeLeaves < numberOfLeaves && tree.subtreeLeaves * 2 * leafSize <= STATE_LOADER_TASK_SIZE)
+            {
+                tree.subtreeLeaves *= 2;
+            }
+        }
+        tree.pendingTasks = 0;
+        tree.mismatch = false;
+        return numberOfTrees++;
+    }
+
+    // Load all leaves of tree from file to data and queue verification of each read part
+    static bool loadLeaves(int treeIndex, const CHAR16* fileName, const CHAR16* directory, void* data)
+    {
+        const Tree& tree = trees[treeIndex];
+        const unsigned long long taskSize = tree.subtreeLeaves * tree.leafSize;
+        const unsigned long long readSize = (STATE_LOADER_READ_SIZE > taskSize) ? STATE_LOADER_READ_SIZE - STATE_LOADER_READ_SIZE % taskSize : taskSize;
+        const unsigned long long totalSize = tree.numberOfLeaves * tree.leafSize;
+        unsigned char* buffer = (unsigned char*)data;
+        for (unsigned long long offset = 0; offset < totalSize; offset += readSize)
+        {
+            const unsigned long long size = (totalSize - offset < readSize) ? totalSize - offset : readSize;
+            if (loadAt(fileName, offset, size, buffer + offset, directory) != (long long)size)
+            {
+                return false;
+            }
+
+            for (unsigned long long taskOffset = 0; taskOffset < size; taskOffset += taskSize)
+            {
+                Task task;
+                task.data = buffer + offset + taskOffset;
+                task.leafSize = tree.leafSize;
+                task.tree = treeIndex;
+                task.firstLeaf = (unsigned int)((offset + taskOffset) / tree.leafSize);
+                task.numberOfLeaves = tree.subtreeLeaves;
+                queueTask(task);
+            }
+        }
+        return true;
+    }
+
+    // Queue verification of a single leaf of size bytes at data (NULL for leaf with zero digest)
+    static void verifyLeaf(int treeIndex, unsigned int leaf, const void* data, unsigned long long size)
+    {
+        Task task;
+        task.data = (const unsigned char*)data;
+        task.leafSize = size;
+        task.tree = treeIndex;
+        task.firstLeaf = leaf;
+        task.numberOfLeaves = 1;
+        queueTask(task);
+    }
+
+    // Wait for verification of all queued leaves of tree and check the levels above the subtrees verified by the
+    // tasks. Returns true if leaves and inner nodes match the saved digests. All leaves have to be queued before.
+    static bool endTree(int treeIndex)
+    {
+        const Tree& tree = trees[treeIndex];
+        while (tree.pendingTasks)
+        {
+            Task task;
+            if (popTask(task))
+            {
+                runTask(task);
+            }
+            else
+            {
+                _mm_pause();
+            }
+        }
+        if (tree.mismatch)
+        {
+            return false;
+        }
+
+        unsigned int level = 0;
+        while ((1U << level) < tree.subtreeLeaves)
+        {
+            level++;
+        }
+        return verifyInnerNodes(tree, level, 0, tree.numberOfLeaves / tree.subtreeLeaves);
+    }
+
+    static long long getNumberOfVerifiedBytes()
+    {
+        return numberOfVerifiedBytes;
+    }
+};
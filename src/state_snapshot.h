@@ -0,0 +1,666 @@
+#pragma once
+
+#include "platform/memory.h"
+#include "platform/concurrency.h"
+#include "platform/file_io.h"
+#include "platform/console_logging.h"
+
+// Granularity of copy-on-write during writing a snapshot
+#define STATE_SNAPSHOT_PAGE_SIZE 4096ULL
+
+// Number of pages that can be shadowed at the same time (default: 256 MB). If all shadow pages are in use, changes
+// of the state wait until the page has been written to disk.
+#ifndef STATE_SNAPSHOT_SHADOW_PAGES
+#define STATE_SNAPSHOT_SHADOW_PAGES 65536ULL
+#endif
+
+// Number of bytes written by one call of StateSnapshot::writeStep() (multiple of page size)
+#ifndef STATE_SNAPSHOT_WRITE_BATCH_SIZE
+#define STATE_SNAPSHOT_WRITE_BATCH_SIZE (4ULL * 1024 * 1024)
+#endif
+
+#define STATE_SNAPSHOT_MAX_REGIONS 64
+#define STATE_SNAPSHOT_PAGE_LOCKS 1024
+
+enum StateSnapshotWriteResult
+{
+    StateSnapshotWriteDone = 0,
+    StateSnapshotWriteInProgress,
+    StateSnapshotWriteFailed,
+};
+
+// Delta snapshot file: header followed by numberOfPages records of fixed size (record header + page data)
+struct StateSnapshotDeltaHeader
+{
+    unsigned long long numberOfPages;
+    unsigned long long totalSizeOfRegions;
+};
+
+struct StateSnapshotDeltaRecord
+{
+    unsigned int regionIndex;
+    unsigned int size;
+    unsigned long long offset;
+    unsigned char data[STATE_SNAPSHOT_PAGE_SIZE];
+};
+
+static_assert(STATE_SNAPSHOT_WRITE_BATCH_SIZE % STATE_SNAPSHOT_PAGE_SIZE == 0, "Write batch size must be multiple of page size");
+static_assert(STATE_SNAPSHOT_WRITE_BATCH_SIZE >= sizeof(StateSnapshotDeltaHeader) + sizeof(StateSnapshotDeltaRecord), "Write batch size too small for delta snapshots");
+static_assert(STATE_SNAPSHOT_SHADOW_PAGES <= 0xFFFFFFFFULL, "Shadow page indices need to fit into 32 bits");
+
+
+// Consistent snapshot of large state arrays (regions), written to disk while the state keeps changing.
+//
+// The snapshot is cut by calling start() while no region is changed (the tick processor waits between two ticks).
+// Afterwards, writeStep() is called repeatedly by the main processor (the only one with file system access) to write
+// the regions to their files batch by batch, while the tick processor continues processing ticks.
+//
+// Each region is divided into pages. Before a page that has not been written yet is changed, beforeWrite() copies it
+// to a shadow page, which is written instead of the live page. Thus, the files contain the data of the cut. If all
+// shadow pages are in use, beforeWrite() waits until writeStep() has written the page. So beforeWrite() must not be
+// called by the processor running writeStep(). Callers of beforeWrite() may hold locks of the state while waiting, so
+// the processor running writeStep() must not acquire these locks while the snapshot is active. It should call
+// writeStep() repeatedly while hasWaitingWriters() is true (for example if a whole contract state is changed).
+//
+// After the first cut, beforeWrite() also marks changed pages as dirty. If the last snapshot has been completed and
+// the regions have not been changed, the next one can be a delta snapshot, which only writes the dirty pages to a
+// single delta file. Applying the deltas to the files of the last full snapshot with applyDelta() restores the state.
+class StateSnapshot
+{
+    enum PageState
+    {
+        PagePending = 0, // not written yet and not changed since cut
+        PageShadowed = 1, // not written yet, data of cut is in shadow page
+        PageWritten = 2,
+    };
+
+    struct Region
+    {
+        const unsigned char* data;
+        unsigned long long size;
+        unsigned long long firstPage;
+        bool writeAlways;
+        CHAR16 fileName[64];
+    };
+
+    inline static Region regions[STATE_SNAPSHOT_MAX_REGIONS];
+    inline static unsigned int numberOfRegions = 0;
+    inline static CHAR16 directory[32];
+
+    // State and shadow page index of each page of all regions
+    inline static volatile unsigned char* pageStates = nullptr;
+    inline static unsigned int* pageShadowSlots = nullptr;
+    inline static unsigned long long numberOfPages = 0;
+    inline static unsigned long long maxNumberOfPages = 0;
+
+    // Locks protecting page states and copying, page i is protected by pageLocks[i % STATE_SNAPSHOT_PAGE_LOCKS]
+    inline static volatile char pageLocks[STATE_SNAPSHOT_PAGE_LOCKS];
+
+    // Pool of shadow pages with stack of free pages
+    inline static unsigned char* shadowPages = nullptr;
+    inline static unsigned int* freeShadowSlots = nullptr;
+    inline static unsigned int numberOfFreeShadowSlots = 0;
+    inline static volatile char shadowSlotsLock = 0;
+
+    // Buffer of batch to write
+    inline static unsigned char* writeBuffer = nullptr;
+    inline static unsigned int currentRegion = 0;
+    inline static unsigned long long currentOffset = 0;
+
+    // Pages changed since last cut (bit per page), recorded while tracking is enabled
+    inline static volatile unsigned long long* dirtyPages = nullptr;
+    inline static volatile bool tracking = false;
+
+    // Delta snapshot: file of delta, next page to check, and number of records (dirty pages) written
+    inline static bool deltaMode = false;
+    inline static CHAR16 deltaFileName[64];
+    inline static unsigned long long currentPage = 0;
+    inline static unsigned long long numberOfDeltaPages = 0;
+    inline static unsigned long long writtenDeltaPages = 0;
+
+    // Last snapshot has been completed with same regions and directory, so a delta can be written on top of it
+    inline static bool haveBase = false;
+    inline static unsigned int lastNumberOfRegions = 0;
+
+    inline static volatile bool active = false;
+    inline static volatile long numberOfMutators = 0;
+
+    // Statistics of current / last snapshot
+    inline static unsigned long long writtenBytes = 0;
+    inline static unsigned long long totalBytes = 0;
+    inline static volatile long long numberOfShadowedPages = 0;
+    inline static volatile long long numberOfStalls = 0;
+    inline static volatile long numberOfWaitingWriters = 0;
+
+    // Save data of cut in page of region if it has not been written or shadowed yet
+    static void shadowPage(const Region& region, unsigned long long pageInRegion)
+    {
+        const unsigned long long page = region.firstPage + pageInRegion;
+        if (pageStates[page] != PagePending)
+        {
+            return;
+        }
+
+        const unsigned long long offset = pageInRegion * STATE_SNAPSHOT_PAGE_SIZE;
+        const unsigned long long size = (region.size - offset < STATE_SNAPSHOT_PAGE_SIZE) ? region.size - offset : STATE_SNAPSHOT_PAGE_SIZE;
+        volatile char& lock = pageLocks[page % STATE_SNAPSHOT_PAGE_LOCKS];
+
+        ACQUIRE(lock);
+        if (pageStates[page] != PagePending)
+        {
+            RELEASE(lock);
+            return;
+        }
+
+        bool haveSlot = false;
+        unsigned int slot = 0;
+        ACQUIRE(shadowSlotsLock);
+        if (numberOfFreeShadowSlots)
+        {
+            slot = freeShadowSlots[--numberOfFreeShadowSlots];
+            haveSlot = true;
+        }
+        RELEASE(shadowSlotsLock);
+
+        if (haveSlot)
+        {
+            copyMem(shadowPages + slot * STATE_SNAPSHOT_PAGE_SIZE, region.data + offset, size);
+            pageShadowSlots[page] = slot;
+            pageStates[page] = PageShadowed;
+            RELEASE(lock);
+            _InterlockedIncrement64(&numberOfShadowedPages);
+            return;
+        }
+        RELEASE(lock);
+
+        // No shadow page available -> wait until page has been written (or snapshot has been aborted)
+        _InterlockedIncrement64(&numberOfStalls);
+        _InterlockedIncrement(&numberOfWaitingWriters);
+        while (active && pageStates[page] == PagePending)
+        {
+            _mm_pause();
+        }
+        _InterlockedDecrement(&numberOfWaitingWriters);
+    }
+
+    static void markDirty(unsigned long long page)
+    {
+        volatile unsigned long long& word = dirtyPages[page >> 6];
+        const unsigned long long bit = 1ULL << (page & 63);
+        if (!(word & bit))
+        {
+            _InterlockedOr64((volatile long long*)&word, bit);
+        }
+    }
+
+    static void shadow(const void* address, unsigned long long size)
+    {
+        _InterlockedIncrement(&numberOfMutators);
+        const unsigned char* begin = (const unsigned char*)address;
+        for (unsigned int regionIndex = 0; regionIndex < numberOfRegions; regionIndex++)
+        {
+            const Region& region = regions[regionIndex];
+            if (begin >= region.data && begin < region.data + region.size)
+            {
+                const unsigned long long offset = begin - region.data;
+                const unsigned long long end = (size < region.size - offset) ? offset + size : region.size;
+                for (unsigned long long page = offset / STATE_SNAPSHOT_PAGE_SIZE; page * STATE_SNAPSHOT_PAGE_SIZE < end; page++)
+                {
+                    if (tracking)
+                    {
+                        markDirty(region.firstPage + page);
+                    }
+                    if (active)
+                    {
+                        shadowPage(region, page);
+                    }
+                }
+                break;
+            }
+        }
+        _InterlockedDecrement(&numberOfMutators);
+    }
+
+    // Copy data of cut in page to buffer and mark page as written
+    static void copyPageOfCut(const Region& region, unsigned long long offsetInRegion, unsigned long long size, unsigned char* buffer)
+    {
+        const unsigned long long page = region.firstPage + offsetInRegion / STATE_SNAPSHOT_PAGE_SIZE;
+        volatile char& lock = pageLocks[page % STATE_SNAPSHOT_PAGE_LOCKS];
+
+        ACQUIRE(lock);
+        if (pageStates[page] == PageShadowed)
+        {
+            const unsigned int slot = pageShadowSlots[page];
+            copyMem(buffer, shadowPages + slot * STATE_SNAPSHOT_PAGE_SIZE, size);
+
+            ACQUIRE(shadowSlotsLock);
+            freeShadowSlots[numberOfFreeShadowSlots++] = slot;
+            RELEASE(shadowSlotsLock);
+        }
+        else
+        {
+            copyMem(buffer, region.data + offsetInRegion, size);
+        }
+        pageStates[page] = PageWritten;
+        RELEASE(lock);
+    }
+
+    static void finish()
+    {
+        haveBase = true;
+        active = false;
+    }
+
+    // Skip completely written regions, finishing the snapshot after the last one
+    static void skipWrittenRegions()
+    {
+        while (currentRegion < numberOfRegions && currentOffset == regions[currentRegion].size)
+        {
+            currentRegion++;
+            currentOffset = 0;
+        }
+        if (currentRegion == numberOfRegions)
+        {
+            finish();
+        }
+    }
+
+    static unsigned long long pageSize(const Region& region, unsigned long long pageInRegion)
+    {
+        const unsigned long long offset = pageInRegion * STATE_SNAPSHOT_PAGE_SIZE;
+        return (region.size - offset < STATE_SNAPSHOT_PAGE_SIZE) ? region.size - offset : STATE_SNAPSHOT_PAGE_SIZE;
+    }
+
+    static StateSnapshotWriteResult writeFullStep()
+    {
+        const Region& region = regions[currentRegion];
+        const unsigned long long batchSize = (region.size - currentOffset < STATE_SNAPSHOT_WRITE_BATCH_SIZE) ? region.size - currentOffset : STATE_SNAPSHOT_WRITE_BATCH_SIZE;
+        for (unsigned long long offset = 0; offset < batchSize; offset += STATE_SNAPSHOT_PAGE_SIZE)
+        {
+            const unsigned long long size = (batchSize - offset < STATE_SNAPSHOT_PAGE_SIZE) ? batchSize - offset : STATE_SNAPSHOT_PAGE_SIZE;
+            copyPageOfCut(region, currentOffset + offset, size, writeBuffer + offset);
+        }
+
+        if (saveAt(region.fileName, currentOffset, batchSize, writeBuffer, (directory[0]) ? directory : NULL) != (long long)batchSize)
+        {
+            logToConsole(L"Failed to write state snapshot!");
+            abort();
+            return StateSnapshotWriteFailed;
+        }
+        currentOffset += batchSize;
+        writtenBytes += batchSize;
+
+        skipWrittenRegions();
+        return (active) ? StateSnapshotWriteInProgress : StateSnapshotWriteDone;
+    }
+
+    // Write records of next dirty pages to delta file (the header is written with the first batch)
+    static StateSnapshotWriteResult writeDeltaStep()
+    {
+        unsigned long long position = 0;
+        unsigned long long batchSize = 0;
+        if (writtenDeltaPages)
+        {
+            position = sizeof(StateSnapshotDeltaHeader) + writtenDeltaPages * sizeof(StateSnapshotDeltaRecord);
+        }
+        else
+        {
+            StateSnapshotDeltaHeader* header = (StateSnapshotDeltaHeader*)writeBuffer;
+            header->numberOfPages = numberOfDeltaPages;
+            header->totalSizeOfRegions = 0;
+            for (unsigned int i = 0; i < numberOfRegions; i++)
+            {
+                header->totalSizeOfRegions += regions[i].size;
+            }
+            batchSize = sizeof(StateSnapshotDeltaHeader);
+        }
+
+        unsigned long long batchPages = 0;
+        while (currentPage < numberOfPages && batchSize + sizeof(StateSnapshotDeltaRecord) <= STATE_SNAPSHOT_WRITE_BATCH_SIZE)
+        {
+            while (currentPage >= regions[currentRegion].firstPage + (regions[currentRegion].size + STATE_SNAPSHOT_PAGE_SIZE - 1) / STATE_SNAPSHOT_PAGE_SIZE)
+            {
+                currentRegion++;
+            }
+            if (pageStates[currentPage] != PageWritten)
+            {
+                const Region& region = regions[currentRegion];
+                const unsigned long long pageInRegion = currentPage - region.firstPage;
+                StateSnapshotDeltaRecord* record = (StateSnapshotDeltaRecord*)(writeBuffer + batchSize);
+                record->regionIndex = currentRegion;
+                record->size = (unsigned int)pageSize(region, pageInRegion);
+                record->offset = pageInRegion * STATE_SNAPSHOT_PAGE_SIZE;
+                copyPageOfCut(region, record->offset, record->size, record->data);
+                batchSize += sizeof(StateSnapshotDeltaRecord);
+                writtenBytes += record->size;
+                batchPages++;
+            }
+            currentPage++;
+        }
+
+        if (batchSize && saveAt(deltaFileName, position, batchSize, writeBuffer, (directory[0]) ? directory : NULL) != (long long)batchSize)
+        {
+            logToConsole(L"Failed to write state snapshot delta!");
+            abort();
+            return StateSnapshotWriteFailed;
+        }
+        writtenDeltaPages += batchPages;
+
+        if (currentPage == numberOfPages)
+        {
+            finish();
+            return StateSnapshotWriteDone;
+        }
+        return StateSnapshotWriteInProgress;
+    }
+
+public:
+    // Allocate buffers for snapshots with up to maxTotalSize bytes in all regions
+    static bool init(unsigned long long maxTotalSize)
+    {
+        maxNumberOfPages = (maxTotalSize + STATE_SNAPSHOT_PAGE_SIZE - 1) / STATE_SNAPSHOT_PAGE_SIZE + STATE_SNAPSHOT_MAX_REGIONS;
+        if (!allocatePool(maxNumberOfPages, (void**)&pageStates)
+            || !allocatePool(maxNumberOfPages * sizeof(unsigned int), (void**)&pageShadowSlots)
+            || !allocatePool(STATE_SNAPSHOT_SHADOW_PAGES * STATE_SNAPSHOT_PAGE_SIZE, (void**)&shadowPages)
+            || !allocatePool(STATE_SNAPSHOT_SHADOW_PAGES * sizeof(unsigned int), (void**)&freeShadowSlots)
+            || !allocatePool(STATE_SNAPSHOT_WRITE_BATCH_SIZE, (void**)&writeBuffer)
+            || !allocatePool((maxNumberOfPages + 63) / 64 * 8, (void**)&dirtyPages))
+        {
+            logToConsole(L"Failed to allocate state snapshot buffers!");
+            deinit();
+            return false;
+        }
+        setMem((void*)pageLocks, sizeof(pageLocks), 0);
+        shadowSlotsLock = 0;
+        numberOfRegions = 0;
+        numberOfPages = 0;
+        haveBase = false;
+        tracking = false;
+        active = false;
+        return true;
+    }
+
+    static void deinit()
+    {
+        active = false;
+        tracking = false;
+        if (pageStates)
+        {
+            freePool((void*)pageStates);
+            pageStates = nullptr;
+        }
+        if (pageShadowSlots)
+        {
+            freePool(pageShadowSlots);
+            pageShadowSlots = nullptr;
+        }
+        if (shadowPages)
+        {
+            freePool(shadowPages);
+            shadowPages = nullptr;
+        }
+        if (freeShadowSlots)
+        {
+            freePool(freeShadowSlots);
+            freeShadowSlots = nullptr;
+        }
+        if (writeBuffer)
+        {
+            freePool(writeBuffer);
+            writeBuffer = nullptr;
+        }
+        if (dirtyPages)
+        {
+            freePool((void*)dirtyPages);
+            dirtyPages = nullptr;
+        }
+    }
+
+    // Begin defining new snapshot written to directory (NULL for root directory). Returns false if the last
+    // snapshot is still being written. Like start(), it has to be called while none of the regions is changed.
+    static bool prepare(const CHAR16* directoryName)
+    {
+        if (active)
+        {
+            return false;
+        }
+
+        // stop tracking while regions are redefined and wait for beforeWrite() calls still running
+        tracking = false;
+        _mm_mfence();
+        while (numberOfMutators)
+        {
+            _mm_pause();
+        }
+
+        if (!directoryName)
+        {
+            directoryName = L"";
+        }
+        unsigned int i = 0;
+        while (directoryName[i] && directoryName[i] == directory[i])
+        {
+            i++;
+        }
+        if (directoryName[i] != directory[i])
+        {
+            // delta files are only written to the directory of their base
+            haveBase = false;
+        }
+        setText(directory, directoryName);
+
+        lastNumberOfRegions = numberOfRegions;
+        numberOfRegions = 0;
+        numberOfPages = 0;
+        return true;
+    }
+
+    // Add region of size bytes at data to snapshot, which is written to file fileName. Set writeAlways for regions
+    // that are changed without beforeWrite() (such as copies filled before each cut), so delta snapshots include
+    // all of their pages.
+    static bool addRegion(const void* data, unsigned long long size, const CHAR16* fileName, bool writeAlways = false)
+    {
+        const unsigned long long regionPages = (size + STATE_SNAPSHOT_PAGE_SIZE - 1) / STATE_SNAPSHOT_PAGE_SIZE;
+        if (active || numberOfRegions == STATE_SNAPSHOT_MAX_REGIONS || numberOfPages + regionPages > maxNumberOfPages)
+        {
+            logToConsole(L"Cannot add region to state snapshot!");
+            return false;
+        }
+
+        Region& region = regions[numberOfRegions++];
+        if (numberOfRegions > lastNumberOfRegions || region.data != data || region.size != size)
+        {
+            // dirty page bits refer to the regions of the last snapshot
+            haveBase = false;
+        }
+        region.data = (const unsigned char*)data;
+        region.size = size;
+        region.firstPage = numberOfPages;
+        region.writeAlways = writeAlways;
+        setText(region.fileName, fileName);
+        numberOfPages += regionPages;
+        return true;
+    }
+
+    // Check if the pages changed since the last snapshot can be written as delta instead of a full snapshot
+    static bool canWriteDelta()
+    {
+        return haveBase && !active && numberOfRegions == lastNumberOfRegions;
+    }
+
+    // Cut snapshot of all added regions. Has to be called while none of the regions is changed. If deltaFile is
+    // NULL, all regions are written to their files. Otherwise only the pages changed since the last snapshot are
+    // written to deltaFile, which requires canWriteDelta().
+    static void start(const CHAR16* deltaFile = NULL)
+    {
+        deltaMode = (deltaFile != NULL) && canWriteDelta();
+        const unsigned long long numberOfDirtyWords = (numberOfPages + 63) / 64;
+        if (deltaMode)
+        {
+            setText(deltaFileName, deltaFile);
+            numberOfDeltaPages = 0;
+            totalBytes = 0;
+            unsigned int regionIndex = 0;
+            for (unsigned long long page = 0; page < numberOfPages; page++)
+            {
+                while (page >= regions[regionIndex].firstPage + (regions[regionIndex].size + STATE_SNAPSHOT_PAGE_SIZE - 1) / STATE_SNAPSHOT_PAGE_SIZE)
+                {
+                    regionIndex++;
+                }
+                if (regions[regionIndex].writeAlways || (dirtyPages[page >> 6] & (1ULL << (page & 63))))
+                {
+                    pageStates[page] = PagePending;
+                    numberOfDeltaPages++;
+                    totalBytes += pageSize(regions[regionIndex], page - regions[regionIndex].firstPage);
+                }
+                else
+                {
+                    pageStates[page] = PageWritten;
+                }
+            }
+        }
+        else
+        {
+            setMem((void*)pageStates, numberOfPages, PagePending);
+            totalBytes = 0;
+            for (unsigned int i = 0; i < numberOfRegions; i++)
+            {
+                totalBytes += regions[i].size;
+            }
+        }
+        setMem((void*)dirtyPages, numberOfDirtyWords * 8, 0);
+
+        for (unsigned int i = 0; i < STATE_SNAPSHOT_SHADOW_PAGES; i++)
+        {
+            freeShadowSlots[i] = i;
+        }
+        numberOfFreeShadowSlots = STATE_SNAPSHOT_SHADOW_PAGES;
+        currentRegion = 0;
+        currentOffset = 0;
+        currentPage = 0;
+        writtenDeltaPages = 0;
+        writtenBytes = 0;
+        numberOfShadowedPages = 0;
+        numberOfStalls = 0;
+
+        // base is only valid again if this snapshot is completed
+        haveBase = false;
+        tracking = true;
+        active = true;
+        _mm_mfence();
+        if (!deltaMode)
+        {
+            skipWrittenRegions();
+        }
+    }
+
+    // Has to be called before changing size bytes at address if the memory may be part of a region
+    static void beforeWrite(const void* address, unsigned long long size)
+    {
+        if (active || tracking)
+        {
+            shadow(address, size);
+        }
+    }
+
+    // Write next batch of snapshot to disk. Can only be called from main processor.
+    static StateSnapshotWriteResult writeStep()
+    {
+        if (!active)
+        {
+            return StateSnapshotWriteDone;
+        }
+        return (deltaMode) ? writeDeltaStep() : writeFullStep();
+    }
+
+    // Stop writing snapshot, leaving incomplete files. The next snapshot has to be a full one.
+    static void abort()
+    {
+        haveBase = false;
+        active = false;
+    }
+
+    // Apply delta file written by a snapshot with the same regions to the regions added after prepare(). Used for
+    // loading the state from the files of a full snapshot followed by its deltas.
+    static bool applyDelta(const CHAR16* deltaFile)
+    {
+        const CHAR16* dir = (directory[0]) ? directory : NULL;
+        StateSnapshotDeltaHeader header;
+        if (active || loadAt(deltaFile, 0, sizeof(header), (unsigned char*)&header, dir) != sizeof(header))
+        {
+            return false;
+        }
+        unsigned long long totalSizeOfRegions = 0;
+        for (unsigned int i = 0; i < numberOfRegions; i++)
+        {
+            totalSizeOfRegions += regions[i].size;
+        }
+        if (header.totalSizeOfRegions != totalSizeOfRegions)
+        {
+            logToConsole(L"State snapshot delta does not match regions!");
+            return false;
+        }
+
+        constexpr unsigned long long recordsPerBatch = STATE_SNAPSHOT_WRITE_BATCH_SIZE / sizeof(StateSnapshotDeltaRecord);
+        for (unsigned long long page = 0; page < header.numberOfPages; page += recordsPerBatch)
+        {
+            const unsigned long long batchPages = (header.numberOfPages - page < recordsPerBatch) ? header.numberOfPages - page : recordsPerBatch;
+            const unsigned long long batchSize = batchPages * sizeof(StateSnapshotDeltaRecord);
+            if (loadAt(deltaFile, sizeof(header) + page * sizeof(StateSnapshotDeltaRecord), batchSize, writeBuffer, dir) != (long long)batchSize)
+            {
+                return false;
+            }
+            for (unsigned long long i = 0; i < batchPages; i++)
+            {
+                const StateSnapshotDeltaRecord& record = ((const StateSnapshotDeltaRecord*)writeBuffer)[i];
+                if (record.regionIndex >= numberOfRegions || record.size > STATE_SNAPSHOT_PAGE_SIZE
+                    || record.offset + record.size > regions[record.regionIndex].size)
+                {
+                    logToConsole(L"Invalid record in state snapshot delta!");
+                    return false;
+                }
+                copyMem((unsigned char*)regions[record.regionIndex].data + record.offset, record.data, record.size);
+            }
+        }
+        return true;
+    }
+
+    static bool isActive()
+    {
+        return active;
+    }
+
+    // Check if changes of the state wait for writeStep(), because all shadow pages are in use
+    static bool hasWaitingWriters()
+    {
+        return active && numberOfWaitingWriters;
+    }
+
+    static unsigned long long getWrittenBytes()
+    {
+        return writtenBytes;
+    }
+
+    static unsigned long long getTotalBytes()
+    {
+        return totalBytes;
+    }
+
+    // Check if current / last snapshot is a delta
+    static bool isDelta()
+    {
+        return deltaMode;
+    }
+
+    // Number of pages copied before being changed by other processors
+    static long long getNumberOfShadowedPages()
+    {
+        return numberOfShadowedPages;
+    }
+
+    // Number of times changing the state had to wait because all shadow pages were in use
+    static long long getNumberOfStalls()
+    {
+        return numberOfStalls;
+    }
+};
@@ -0,0 +1,988 @@
+#pragma once
+
+#include "network_messages/header.h"
+#include "network_messages/common_response.h"
+#include "network_messages/tick.h"
+#include "network_messages/transactions.h"
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+#include "platform/concurrency.h"
+#include "platform/file_io.h"
+#include "platform/console_logging.h"
+
+#include "system.h"
+#include "tick_storage.h"
+
+#define ARCHIVE_DIRECTORY L"archive"
+
+// Ticks are appended to the open segment in RAM. The segment is sealed and written to disk if it contains
+// ARCHIVE_MAX_TICKS_PER_SEGMENT ticks, if the epoch changes, or if the next tick does not fit into the segment.
+#define ARCHIVE_SEGMENT_SIZE (32ULL * 1024 * 1024)
+#define ARCHIVE_MAX_TICKS_PER_SEGMENT 64
+
+// Each segment has a digest index file with an open addressing hash map of ARCHIVE_DIGEST_INDEX_LENGTH entries (must be 2^N)
+#define ARCHIVE_DIGEST_INDEX_LENGTH 8192
+#define ARCHIVE_MAX_TRANSACTIONS_PER_SEGMENT (ARCHIVE_DIGEST_INDEX_LENGTH * 3 / 4)
+
+// The directory of the last ARCHIVE_MAX_NUMBER_OF_SEGMENTS segments is kept in RAM, including a Bloom filter of
+// ARCHIVE_DIGEST_FILTER_SIZE bytes (must be 2^N) per segment that avoids reading digest indexes of most segments.
+// With about 3000 transactions per segment, the false positive rate of the filter is below 0.03%.
+// On disk, the directory is stored in files of ARCHIVE_DIRECTORY_CHUNK_LENGTH entries.
+#define ARCHIVE_MAX_NUMBER_OF_SEGMENTS 16384
+#define ARCHIVE_DIGEST_FILTER_SIZE 8192
+#define ARCHIVE_DIGEST_FILTER_HASHES 6
+#define ARCHIVE_DIRECTORY_CHUNK_LENGTH 64
+
+// Size of the page cache filled lazily by the main loop
+#define ARCHIVE_NUMBER_OF_CACHED_SEGMENTS 4
+#define ARCHIVE_NUMBER_OF_CACHED_DIGEST_INDEXES 16
+
+// Requests that need data from disk are queued and answered by the main loop
+#define ARCHIVE_MAX_PENDING_REQUESTS 16
+#define ARCHIVE_MAX_DIGEST_INDEX_LOADS_PER_CALL 4
+#define ARCHIVE_MAX_DIGEST_INDEX_LOADS_PER_REQUEST 64
+
+// Max size of one tick in a segment, including alignment of the votes, tick data, and transaction offsets blocks
+#define ARCHIVE_MAX_TICK_SIZE (NUMBER_OF_COMPUTORS * sizeof(Tick) + sizeof(TickData) + NUMBER_OF_TRANSACTIONS_PER_TICK * (sizeof(unsigned int) + MAX_TRANSACTION_SIZE) + 24)
+
+
+struct ArchiveTickEntry
+{
+    unsigned int votesOffset;
+    unsigned int tickDataOffset; // 0 if tick data is not available (empty tick)
+    unsigned int transactionOffsetsOffset; // offset of NUMBER_OF_TRANSACTIONS_PER_TICK transaction offsets (0 if slot is empty), or 0 if tick has no transactions
+    unsigned short numberOfVotes;
+    unsigned short numberOfTransactions;
+};
+
+static_assert(sizeof(ArchiveTickEntry) == 16, "Something is wrong with the struct size.");
+
+// Start of segment file, followed by votes, tick data, transaction offsets, and transactions of the ticks
+struct ArchiveSegmentHeader
+{
+    unsigned int segment;
+    unsigned int firstTick;
+    unsigned int numberOfTransactions;
+    unsigned int size;
+    unsigned short epoch;
+    unsigned short numberOfTicks;
+    unsigned char _padding[12];
+
+    ArchiveTickEntry ticks[ARCHIVE_MAX_TICKS_PER_SEGMENT];
+};
+
+static_assert(sizeof(ArchiveSegmentHeader) + ARCHIVE_MAX_TICK_SIZE <= ARCHIVE_SEGMENT_SIZE, "Archive segment too small for largest possible tick");
+static_assert(NUMBER_OF_TRANSACTIONS_PER_TICK <= ARCHIVE_MAX_TRANSACTIONS_PER_SEGMENT, "Archive digest index too small for largest possible tick");
+
+// Entry of digest index file
+struct ArchiveDigestIndexEntry
+{
+    m256i digest;
+    unsigned int tick; // 0 marks empty entry
+    unsigned int transactionOffset;
+};
+
+static_assert(sizeof(ArchiveDigestIndexEntry) == 40, "Something is wrong with the struct size.");
+
+// Entry of segment directory
+struct ArchiveSegmentInfo
+{
+    unsigned int segment;
+    unsigned int firstTick;
+    unsigned int numberOfTransactions;
+    unsigned int size;
+    unsigned short epoch;
+    unsigned short numberOfTicks; // 0 marks unused entry
+    unsigned char persisted;
+    unsigned char _padding[11];
+
+    unsigned char digestFilter[ARCHIVE_DIGEST_FILTER_SIZE];
+};
+
+static_assert(ARCHIVE_DIGEST_FILTER_SIZE * 8 <= 65536, "Archive digest filter bits are addressed with 16 bits of digest");
+static_assert(ARCHIVE_DIGEST_FILTER_HASHES <= 16, "Archive digest filter bits are addressed with 16 bits of digest");
+
+
+// Bounded page cache of segment files with least-recently-used replacement.
+// Only the main loop changes slots, so it may read without lock. Other threads have to hold the lock of the archive.
+template <unsigned long long slotSize, unsigned int numberOfSlots>
+struct ArchivePageCache
+{
+    static constexpr unsigned int noSegment = 0xFFFFFFFF;
+
+    unsigned char* buffers[numberOfSlots];
+    unsigned int segments[numberOfSlots];
+    unsigned long long lastUse[numberOfSlots];
+    unsigned long long useCounter;
+
+    bool init()
+    {
+        for (unsigned int i = 0; i < numberOfSlots; i++)
+        {
+            if (!buffers[i] && !allocatePool(slotSize, (void**)&buffers[i]))
+            {
+                return false;
+            }
+            segments[i] = noSegment;
+            lastUse[i] = 0;
+        }
+        useCounter = 0;
+        return true;
+    }
+
+    void deinit()
+    {
+        for (unsigned int i = 0; i < numberOfSlots; i++)
+        {
+            if (buffers[i])
+            {
+                freePool(buffers[i]);
+                buffers[i] = nullptr;
+            }
+        }
+    }
+
+    // Return data of segment if cached or nullptr otherwise
+    unsigned char* find(unsigned int segment)
+    {
+        for (unsigned int i = 0; i < numberOfSlots; i++)
+        {
+            if (segments[i] == segment)
+            {
+                lastUse[i] = ++useCounter;
+                return buffers[i];
+            }
+        }
+        return nullptr;
+    }
+
+    // Invalidate least recently used slot and return its index
+    unsigned int evict()
+    {
+        unsigned int slot = 0;
+        for (unsigned int i = 1; i < numberOfSlots; i++)
+        {
+            if (lastUse[i] < lastUse[slot])
+            {
+                slot = i;
+            }
+        }
+        segments[slot] = noSegment;
+        return slot;
+    }
+
+    // Mark slot as holding segment
+    void assign(unsigned int slot, unsigned int segment)
+    {
+        segments[slot] = segment;
+        lastUse[slot] = ++useCounter;
+    }
+};
+
+
+// Optional archive of finalized ticks (quorum votes, tick data, and transactions), enabling nodes to answer RequestQuorumTick,
+// RequestTickData, RequestTickTransactions, and RequestTransactionInfo for ticks that are not in the tick storage anymore.
+//
+// Ticks are archived by the main loop in segments of consecutive ticks of one epoch. Each segment is written once when sealed,
+// as segment file "segSSSSSSSS.arc" with a tick index in its header and digest index file "idxSSSSSSSS.arc". Segment numbers
+// are global across epochs. Requests are answered directly from the page cache by the request processors if possible. Otherwise,
+// they are queued and answered by the main loop, which loads the needed files into the cache.
+//
+// Peer, enqueueResponse(), getPeerConnection(), and isPeerConnectionActive() have to be declared before including this file.
+class TickArchive
+{
+public:
+    static constexpr unsigned int noSegment = 0xFFFFFFFF;
+
+private:
+    static constexpr unsigned long long digestIndexSize = ARCHIVE_DIGEST_INDEX_LENGTH * sizeof(ArchiveDigestIndexEntry);
+    static constexpr unsigned long long directoryChunkSize = ARCHIVE_DIRECTORY_CHUNK_LENGTH * sizeof(ArchiveSegmentInfo);
+    static_assert(ARCHIVE_MAX_NUMBER_OF_SEGMENTS % ARCHIVE_DIRECTORY_CHUNK_LENGTH == 0, "Directory chunks must not wrap around in RAM");
+
+    struct PendingRequest
+    {
+        Peer* peer;
+        void* connection; // connection of peer when request was received, queued requests are dropped if it has been closed
+        unsigned int dejavu;
+        unsigned int tick;
+        unsigned int segment; // segment of tick, or next segment to check for REQUEST_TRANSACTION_INFO
+        unsigned int digestIndexLoads; // number of digest indexes checked for REQUEST_TRANSACTION_INFO
+        unsigned char type;
+        unsigned char flags[NUMBER_OF_TRANSACTIONS_PER_TICK / 8]; // vote flags or transaction flags of request
+        m256i digest;
+    };
+    static_assert(sizeof(PendingRequest::flags) >= sizeof(RequestedQuorumTick::voteFlags), "Pending request cannot hold vote flags");
+
+    inline static TickStorage ts; // singleton with static members only, refers to the same data as all other instances
+
+    // Ring buffer of ARCHIVE_MAX_NUMBER_OF_SEGMENTS directory entries, indexed by segment % ARCHIVE_MAX_NUMBER_OF_SEGMENTS
+    inline static ArchiveSegmentInfo* directory = nullptr;
+    inline static unsigned int numberOfSegments = 0;
+
+    inline static ArchivePageCache<ARCHIVE_SEGMENT_SIZE, ARCHIVE_NUMBER_OF_CACHED_SEGMENTS> segmentCache;
+    inline static ArchivePageCache<digestIndexSize, ARCHIVE_NUMBER_OF_CACHED_DIGEST_INDEXES> digestIndexCache;
+
+    // Open segment, only accessed by main loop. After sealing, the buffers are handed over to the caches.
+    inline static unsigned char* segmentBuffer = nullptr;
+    inline static unsigned char* digestIndexBuffer = nullptr;
+    inline static ArchiveSegmentInfo openSegmentInfo;
+
+    inline static unsigned char* directoryChunkBuffer = nullptr;
+    inline static bool directoryLoaded = false;
+    inline static unsigned int nextTickToArchive = 0;
+
+    inline static PendingRequest pendingRequests[ARCHIVE_MAX_PENDING_REQUESTS];
+    inline static unsigned int numberOfPendingRequests = 0;
+
+    // Lock for securing directory, numberOfSegments, caches, and pending requests
+    inline static volatile char lock = 0;
+
+    // Set file name "<prefix>NNNNNNNN.arc"
+    static void getFileName(CHAR16* fileName, const CHAR16* prefix, unsigned int number)
+    {
+        setText(fileName, prefix);
+        appendText(fileName, L"00000000.arc");
+        for (int i = 10; i >= 3; i--)
+        {
+            fileName[i] = number % 10 + L'0';
+            number /= 10;
+        }
+    }
+
+    static unsigned int getOldestSegment()
+    {
+        return (numberOfSegments > ARCHIVE_MAX_NUMBER_OF_SEGMENTS) ? numberOfSegments - ARCHIVE_MAX_NUMBER_OF_SEGMENTS : 0;
+    }
+
+    static ArchiveSegmentInfo& getSegmentInfo(unsigned int segment)
+    {
+        return directory[segment % ARCHIVE_MAX_NUMBER_OF_SEGMENTS];
+    }
+
+    static void addToDigestFilter(unsigned char* filter, const m256i& digest)
+    {
+        for (int i = 0; i < ARCHIVE_DIGEST_FILTER_HASHES; i++)
+        {
+            const unsigned int bit = digest.m256i_u16[i] & (ARCHIVE_DIGEST_FILTER_SIZE * 8 - 1);
+            filter[bit >> 3] |= (1 << (bit & 7));
+        }
+    }
+
+    static bool mayContainDigest(const unsigned char* filter, const m256i& digest)
+    {
+        for (int i = 0; i < ARCHIVE_DIGEST_FILTER_HASHES; i++)
+        {
+            const unsigned int bit = digest.m256i_u16[i] & (ARCHIVE_DIGEST_FILTER_SIZE * 8 - 1);
+            if (!(filter[bit >> 3] & (1 << (bit & 7))))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void addToDigestIndex(ArchiveDigestIndexEntry* index, const m256i& digest, unsigned int tick, unsigned int transactionOffset)
+    {
+        unsigned int pos = digest.m256i_u32[2] & (ARCHIVE_DIGEST_INDEX_LENGTH - 1);
+        while (index[pos].tick)
+        {
+            pos = (pos + 1) & (ARCHIVE_DIGEST_INDEX_LENGTH - 1);
+        }
+        index[pos].digest = digest;
+        index[pos].tick = tick;
+        index[pos].transactionOffset = transactionOffset;
+    }
+
+    static const ArchiveDigestIndexEntry* findInDigestIndex(const ArchiveDigestIndexEntry* index, const m256i& digest)
+    {
+        unsigned int pos = digest.m256i_u32[2] & (ARCHIVE_DIGEST_INDEX_LENGTH - 1);
+        while (index[pos].tick)
+        {
+            if (index[pos].digest == digest)
+            {
+                return &index[pos];
+            }
+            pos = (pos + 1) & (ARCHIVE_DIGEST_INDEX_LENGTH - 1);
+        }
+        return nullptr;
+    }
+
+    // Return segment containing tick or noSegment (lock has to be held)
+    static unsigned int findSegmentOfTick(unsigned int tick)
+    {
+        // binary search for last segment with firstTick <= tick (ticks are archived in ascending order)
+        unsigned int begin = getOldestSegment(), end = numberOfSegments;
+        while (begin < end)
+        {
+            const unsigned int mid = begin + (end - begin) / 2;
+            if (getSegmentInfo(mid).firstTick <= tick)
+                begin = mid + 1;
+            else
+                end = mid;
+        }
+        if (begin == getOldestSegment())
+        {
+            return noSegment;
+        }
+        const ArchiveSegmentInfo& info = getSegmentInfo(begin - 1);
+        return (tick < info.firstTick + info.numberOfTicks) ? begin - 1 : noSegment;
+    }
+
+    // Return newest segment <= segment whose digest filter may contain digest, or noSegment (lock has to be held)
+    static unsigned int findSegmentOfDigest(const m256i& digest, unsigned int segment)
+    {
+        const unsigned int oldestSegment = getOldestSegment();
+        for (unsigned int s = segment + 1; s > oldestSegment; s--)
+        {
+            if (mayContainDigest(getSegmentInfo(s - 1).digestFilter, digest))
+            {
+                return s - 1;
+            }
+        }
+        return noSegment;
+    }
+
+    // Send response to tick request from data of segment containing the tick (with lock held if not called by main loop)
+    static void respondFromSegment(const unsigned char* segmentData, const PendingRequest& request)
+    {
+        const ArchiveSegmentHeader* header = (const ArchiveSegmentHeader*)segmentData;
+        ASSERT(request.tick >= header->firstTick && request.tick < header->firstTick + header->numberOfTicks);
+        const ArchiveTickEntry& entry = header->ticks[request.tick - header->firstTick];
+        switch (request.type)
+        {
+        case RequestQuorumTick::type:
+        {
+            const Tick* votes = (const Tick*)(segmentData + entry.votesOffset);
+            for (unsigned int i = 0; i < entry.numberOfVotes; i++)
+            {
+                if (!(request.flags[votes[i].computorIndex >> 3] & (1 << (votes[i].computorIndex & 7))))
+                {
+                    enqueueResponse(request.peer, sizeof(Tick), BroadcastTick::type, request.dejavu, &votes[i]);
+                }
+            }
+            enqueueResponse(request.peer, 0, EndResponse::type, request.dejavu, NULL);
+            break;
+        }
+        case RequestTickData::type:
+        {
+            if (entry.tickDataOffset)
+            {
+                enqueueResponse(request.peer, sizeof(TickData), BroadcastFutureTickData::type, request.dejavu, segmentData + entry.tickDataOffset);
+            }
+            else
+            {
+                enqueueResponse(request.peer, 0, EndResponse::type, request.dejavu, NULL);
+            }
+            break;
+        }
+        case REQUEST_TICK_TRANSACTIONS:
+        {
+            if (entry.transactionOffsetsOffset)
+            {
+                const unsigned int* transactionOffsets = (const unsigned int*)(segmentData + entry.transactionOffsetsOffset);
+                for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+                {
+                    if (transactionOffsets[i] && !(request.flags[i >> 3] & (1 << (i & 7))))
+                    {
+                        const Transaction* transaction = (const Transaction*)(segmentData + transactionOffsets[i]);
+                        enqueueResponse(request.peer, transaction->totalSize(), BROADCAST_TRANSACTION, request.dejavu, transaction);
+                    }
+                }
+            }
+            enqueueResponse(request.peer, 0, EndResponse::type, request.dejavu, NULL);
+            break;
+        }
+        }
+    }
+
+    // Queue request to be answered by main loop, or send empty response if queue is full (lock has to be held)
+    static void queueRequest(const PendingRequest& request)
+    {
+        if (numberOfPendingRequests < ARCHIVE_MAX_PENDING_REQUESTS)
+        {
+            pendingRequests[numberOfPendingRequests++] = request;
+        }
+        else
+        {
+            enqueueResponse(request.peer, 0, EndResponse::type, request.dejavu, NULL);
+        }
+    }
+
+    // Return data of segment, loading it into the cache if needed (main loop only)
+    static const unsigned char* loadSegment(unsigned int segment)
+    {
+        ACQUIRE(lock);
+        const unsigned char* data = segmentCache.find(segment);
+        const ArchiveSegmentInfo& info = getSegmentInfo(segment);
+        const bool loadable = segment >= getOldestSegment() && segment < numberOfSegments && info.persisted;
+        if (data || !loadable)
+        {
+            RELEASE(lock);
+            return data;
+        }
+        const unsigned int slot = segmentCache.evict();
+        const unsigned int size = info.size;
+        RELEASE(lock);
+
+        CHAR16 fileName[16];
+        getFileName(fileName, L"seg", segment);
+        if (load(fileName, size, segmentCache.buffers[slot], ARCHIVE_DIRECTORY) != (long long)size)
+        {
+            return nullptr;
+        }
+
+        ACQUIRE(lock);
+        segmentCache.assign(slot, segment);
+        RELEASE(lock);
+        return segmentCache.buffers[slot];
+    }
+
+    // Return digest index of segment, loading it into the cache if needed (main loop only)
+    static const ArchiveDigestIndexEntry* loadDigestIndex(unsigned int segment)
+    {
+        ACQUIRE(lock);
+        const unsigned char* data = digestIndexCache.find(segment);
+        const ArchiveSegmentInfo& info = getSegmentInfo(segment);
+        const bool loadable = segment >= getOldestSegment() && segment < numberOfSegments && info.persisted;
+        if (data || !loadable)
+        {
+            RELEASE(lock);
+            return (const ArchiveDigestIndexEntry*)data;
+        }
+        const unsigned int slot = digestIndexCache.evict();
+        RELEASE(lock);
+
+        CHAR16 fileName[16];
+        getFileName(fileName, L"idx", segment);
+        if (load(fileName, digestIndexSize, digestIndexCache.buffers[slot], ARCHIVE_DIRECTORY) != (long long)digestIndexSize)
+        {
+            return nullptr;
+        }
+
+        ACQUIRE(lock);
+        digestIndexCache.assign(slot, segment);
+        RELEASE(lock);
+        return (const ArchiveDigestIndexEntry*)digestIndexCache.buffers[slot];
+    }
+
+    static void loadDirectory()
+    {
+        if (!checkDir(ARCHIVE_DIRECTORY))
+        {
+            createDir(ARCHIVE_DIRECTORY);
+            return;
+        }
+
+        CHAR16 fileName[16];
+        for (unsigned int chunk = 0; ; chunk++)
+        {
+            getFileName(fileName, L"dir", chunk);
+            if (load(fileName, directoryChunkSize, directoryChunkBuffer, ARCHIVE_DIRECTORY) != (long long)directoryChunkSize)
+            {
+                break;
+            }
+            const ArchiveSegmentInfo* chunkEntries = (const ArchiveSegmentInfo*)directoryChunkBuffer;
+            for (unsigned int i = 0; i < ARCHIVE_DIRECTORY_CHUNK_LENGTH; i++)
+            {
+                if (chunkEntries[i].numberOfTicks && chunkEntries[i].segment == chunk * ARCHIVE_DIRECTORY_CHUNK_LENGTH + i)
+                {
+                    copyMem(&getSegmentInfo(chunkEntries[i].segment), &chunkEntries[i], sizeof(ArchiveSegmentInfo));
+                    numberOfSegments = chunkEntries[i].segment + 1;
+                }
+            }
+        }
+    }
+
+    // Write directory file of chunk containing segment (main loop only)
+    static void saveDirectoryChunk(unsigned int segment)
+    {
+        const unsigned int chunk = segment / ARCHIVE_DIRECTORY_CHUNK_LENGTH;
+        const unsigned int firstSegment = chunk * ARCHIVE_DIRECTORY_CHUNK_LENGTH;
+        setMem(directoryChunkBuffer, directoryChunkSize, 0);
+        copyMem(directoryChunkBuffer, &getSegmentInfo(firstSegment), (segment - firstSegment + 1) * sizeof(ArchiveSegmentInfo));
+
+        CHAR16 fileName[16];
+        getFileName(fileName, L"dir", chunk);
+        if (save(fileName, directoryChunkSize, directoryChunkBuffer, ARCHIVE_DIRECTORY) != (long long)directoryChunkSize)
+        {
+            logToConsole(L"Failed to save tick archive directory!");
+        }
+    }
+
+    // Seal open segment, write it to disk, and hand it over to the caches (main loop only)
+    static void sealSegment()
+    {
+        ArchiveSegmentHeader* header = (ArchiveSegmentHeader*)segmentBuffer;
+        ASSERT(header->numberOfTicks > 0);
+
+        CHAR16 fileName[16];
+        getFileName(fileName, L"seg", header->segment);
+        bool persisted = save(fileName, header->size, segmentBuffer, ARCHIVE_DIRECTORY) == (long long)header->size;
+        getFileName(fileName, L"idx", header->segment);
+        persisted = persisted && save(fileName, digestIndexSize, digestIndexBuffer, ARCHIVE_DIRECTORY) == (long long)digestIndexSize;
+        if (!persisted)
+        {
+            logToConsole(L"Failed to save tick archive segment, ticks of segment will not be available after being evicted from cache!");
+        }
+
+        openSegmentInfo.segment = header->segment;
+        openSegmentInfo.firstTick = header->firstTick;
+        openSegmentInfo.numberOfTransactions = header->numberOfTransactions;
+        openSegmentInfo.size = header->size;
+        openSegmentInfo.epoch = header->epoch;
+        openSegmentInfo.numberOfTicks = header->numberOfTicks;
+        openSegmentInfo.persisted = persisted;
+
+        ACQUIRE(lock);
+        copyMem(&getSegmentInfo(header->segment), &openSegmentInfo, sizeof(ArchiveSegmentInfo));
+        numberOfSegments = header->segment + 1;
+
+        // recently archived ticks are most likely to be requested, so the sealed segment replaces the oldest cache entry
+        unsigned int slot = segmentCache.evict();
+        unsigned char* buffer = segmentCache.buffers[slot];
+        segmentCache.buffers[slot] = segmentBuffer;
+        segmentCache.assign(slot, header->segment);
+        segmentBuffer = buffer;
+
+        slot = digestIndexCache.evict();
+        buffer = digestIndexCache.buffers[slot];
+        digestIndexCache.buffers[slot] = digestIndexBuffer;
+        digestIndexCache.assign(slot, openSegmentInfo.segment);
+        digestIndexBuffer = buffer;
+        RELEASE(lock);
+
+        saveDirectoryChunk(openSegmentInfo.segment);
+
+        ((ArchiveSegmentHeader*)segmentBuffer)->numberOfTicks = 0;
+    }
+
+    // Count votes of tick in tick storage that will be archived
+    static unsigned int countVotes(const Tick* votes, unsigned short tickEpoch, unsigned int tick)
+    {
+        unsigned int numberOfVotes = 0;
+        for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+        {
+            if (votes[i].epoch == tickEpoch && votes[i].tick == tick)
+            {
+                numberOfVotes++;
+            }
+        }
+        return numberOfVotes;
+    }
+
+    // Append tick from tick storage to open segment if there is enough space, returns false if segment has to be sealed first
+    static bool appendTick(unsigned int tick, unsigned short tickEpoch, const Tick* votes, const TickData& tickData, const unsigned long long* transactionOffsets)
+    {
+        ArchiveSegmentHeader* header = (ArchiveSegmentHeader*)segmentBuffer;
+        if (header->numberOfTicks
+            && (header->epoch != tickEpoch || header->firstTick + header->numberOfTicks != tick || header->numberOfTicks == ARCHIVE_MAX_TICKS_PER_SEGMENT))
+        {
+            return false;
+        }
+
+        const bool tickDataAvailable = tickData.epoch == tickEpoch && tickData.tick == tick;
+        const unsigned int numberOfVotes = countVotes(votes, tickEpoch, tick);
+        unsigned long long tickSize = numberOfVotes * sizeof(Tick) + sizeof(TickData) + 16;
+        unsigned int numberOfTransactions = 0;
+        if (tickDataAvailable)
+        {
+            for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+            {
+                if (transactionOffsets[i])
+                {
+                    const Transaction* transaction = ts.tickTransactions(transactionOffsets[i]);
+                    if (transaction->tick == tick && transaction->checkValidity())
+                    {
+                        tickSize += transaction->totalSize();
+                        numberOfTransactions++;
+                    }
+                }
+            }
+            if (numberOfTransactions)
+            {
+                tickSize += NUMBER_OF_TRANSACTIONS_PER_TICK * sizeof(unsigned int) + 8;
+            }
+        }
+        if (header->numberOfTicks
+            && (header->size + tickSize > ARCHIVE_SEGMENT_SIZE || header->numberOfTransactions + numberOfTransactions > ARCHIVE_MAX_TRANSACTIONS_PER_SEGMENT))
+        {
+            return false;
+        }
+
+        if (!header->numberOfTicks)
+        {
+            setMem(header, sizeof(ArchiveSegmentHeader), 0);
+            header->segment = numberOfSegments;
+            header->firstTick = tick;
+            header->epoch = tickEpoch;
+            header->size = sizeof(ArchiveSegmentHeader);
+            setMem(digestIndexBuffer, digestIndexSize, 0);
+            setMem(&openSegmentInfo, sizeof(openSegmentInfo), 0);
+        }
+
+        ArchiveTickEntry& entry = header->ticks[header->numberOfTicks++];
+        unsigned int size = header->size;
+
+        entry.votesOffset = size;
+        for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+        {
+            if (votes[i].epoch == tickEpoch && votes[i].tick == tick)
+            {
+                copyMem(segmentBuffer + size, &votes[i], sizeof(Tick));
+                size += sizeof(Tick);
+            }
+        }
+        entry.numberOfVotes = numberOfVotes;
+
+        if (tickDataAvailable)
+        {
+            entry.tickDataOffset = size;
+            copyMem(segmentBuffer + size, &tickData, sizeof(TickData));
+            size += sizeof(TickData);
+
+            if (numberOfTransactions)
+            {
+                size = (size + 7) & ~7;
+                entry.transactionOffsetsOffset = size;
+                unsigned int* archivedTransactionOffsets = (unsigned int*)(segmentBuffer + size);
+                setMem(archivedTransactionOffsets, NUMBER_OF_TRANSACTIONS_PER_TICK * sizeof(unsigned int), 0);
+                size += NUMBER_OF_TRANSACTIONS_PER_TICK * sizeof(unsigned int);
+                for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+                {
+                    if (transactionOffsets[i])
+                    {
+                        const Transaction* transaction = ts.tickTransactions(transactionOffsets[i]);
+                        if (transaction->tick == tick && transaction->checkValidity())
+                        {
+                            archivedTransactionOffsets[i] = size;
+                            copyMem(segmentBuffer + size, transaction, transaction->totalSize());
+                            addToDigestIndex((ArchiveDigestIndexEntry*)digestIndexBuffer, tickData.transactionDigests[i], tick, size);
+                            addToDigestFilter(openSegmentInfo.digestFilter, tickData.transactionDigests[i]);
+                            size += transaction->totalSize();
+                        }
+                    }
+                }
+                entry.numberOfTransactions = numberOfTransactions;
+                header->numberOfTransactions += numberOfTransactions;
+            }
+        }
+
+        header->size = (size + 7) & ~7;
+        return true;
+    }
+
+    // Archive tick from tick storage, returns false if the tick is not available in tick storage
+    static bool archiveTick(unsigned int tick, bool& segmentSealed)
+    {
+        unsigned short tickEpoch;
+        const Tick* votes;
+        const TickData* tickData;
+        const unsigned long long* transactionOffsets;
+        if (ts.tickInCurrentEpochStorage(tick))
+        {
+            tickEpoch = system.epoch;
+            votes = ts.ticks.getByTickInCurrentEpoch(tick);
+            tickData = &ts.tickData.getByTickInCurrentEpoch(tick);
+            transactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(tick);
+        }
+        else if (ts.tickInPreviousEpochStorage(tick))
+        {
+            tickEpoch = system.epoch - 1;
+            votes = ts.ticks.getByTickInPreviousEpoch(tick);
+            tickData = &ts.tickData.getByTickInPreviousEpoch(tick);
+            transactionOffsets = ts.tickTransactionOffsets.getByTickInPreviousEpoch(tick);
+        }
+        else
+        {
+            return false;
+        }
+
+        // ticks before system.tick are not changed anymore, so no locking is needed
+        segmentSealed = false;
+        if (!appendTick(tick, tickEpoch, votes, *tickData, transactionOffsets))
+        {
+            sealSegment();
+            segmentSealed = true;
+            appendTick(tick, tickEpoch, votes, *tickData, transactionOffsets);
+        }
+        return true;
+    }
+
+    // Answer first pending request and all other pending tick requests that can be answered from the same segment (main loop only)
+    static void processPendingRequests()
+    {
+        ACQUIRE(lock);
+        if (!numberOfPendingRequests)
+        {
+            RELEASE(lock);
+            return;
+        }
+        PendingRequest request = pendingRequests[0];
+        numberOfPendingRequests--;
+        for (unsigned int i = 0; i < numberOfPendingRequests; i++)
+        {
+            pendingRequests[i] = pendingRequests[i + 1];
+        }
+        RELEASE(lock);
+
+        // peer slot may have been reused by another connection in the meantime
+        if (!isPeerConnectionActive(request.peer, request.connection))
+        {
+            return;
+        }
+
+        if (request.type == REQUEST_TRANSACTION_INFO)
+        {
+            unsigned int digestIndexLoads = 0;
+            while (request.segment != noSegment && request.digestIndexLoads < ARCHIVE_MAX_DIGEST_INDEX_LOADS_PER_REQUEST)
+            {
+                if (digestIndexLoads == ARCHIVE_MAX_DIGEST_INDEX_LOADS_PER_CALL)
+                {
+                    // continue with next call to keep main loop responsive
+                    ACQUIRE(lock);
+                    queueRequest(request);
+                    RELEASE(lock);
+                    return;
+                }
+                digestIndexLoads++;
+                request.digestIndexLoads++;
+
+                const ArchiveDigestIndexEntry* digestIndex = loadDigestIndex(request.segment);
+                const ArchiveDigestIndexEntry* indexEntry = (digestIndex) ? findInDigestIndex(digestIndex, request.digest) : nullptr;
+                if (indexEntry)
+                {
+                    const unsigned char* segmentData = loadSegment(request.segment);
+                    if (segmentData)
+                    {
+                        const Transaction* transaction = (const Transaction*)(segmentData + indexEntry->transactionOffset);
+                        enqueueResponse(request.peer, transaction->totalSize(), BROADCAST_TRANSACTION, request.dejavu, transaction);
+                        return;
+                    }
+                    break;
+                }
+
+                ACQUIRE(lock);
+                request.segment = (request.segment > getOldestSegment()) ? findSegmentOfDigest(request.digest, request.segment - 1) : noSegment;
+                RELEASE(lock);
+            }
+            enqueueResponse(request.peer, 0, EndResponse::type, request.dejavu, NULL);
+            return;
+        }
+
+        // if loading failed, empty responses are sent
+        const unsigned int segment = request.segment;
+        const unsigned char* segmentData = loadSegment(segment);
+        if (segmentData)
+            respondFromSegment(segmentData, request);
+        else
+            enqueueResponse(request.peer, 0, EndResponse::type, request.dejavu, NULL);
+
+        ACQUIRE(lock);
+        unsigned int remaining = 0;
+        for (unsigned int i = 0; i < numberOfPendingRequests; i++)
+        {
+            if (pendingRequests[i].type != REQUEST_TRANSACTION_INFO && pendingRequests[i].segment == segment)
+            {
+                if (!isPeerConnectionActive(pendingRequests[i].peer, pendingRequests[i].connection))
+                    continue;
+                if (segmentData)
+                    respondFromSegment(segmentData, pendingRequests[i]);
+                else
+                    enqueueResponse(pendingRequests[i].peer, 0, EndResponse::type, pendingRequests[i].dejavu, NULL);
+            }
+            else
+            {
+                pendingRequests[remaining++] = pendingRequests[i];
+            }
+        }
+        numberOfPendingRequests = remaining;
+        RELEASE(lock);
+    }
+
+public:
+    static bool init()
+    {
+        if ((!directory && !allocatePool(ARCHIVE_MAX_NUMBER_OF_SEGMENTS * sizeof(ArchiveSegmentInfo), (void**)&directory))
+            || (!segmentBuffer && !allocatePool(ARCHIVE_SEGMENT_SIZE, (void**)&segmentBuffer))
+            || (!digestIndexBuffer && !allocatePool(digestIndexSize, (void**)&digestIndexBuffer))
+            || (!directoryChunkBuffer && !allocatePool(directoryChunkSize, (void**)&directoryChunkBuffer))
+            || !segmentCache.init()
+            || !digestIndexCache.init())
+        {
+            logToConsole(L"Failed to allocate tick archive buffers!");
+            deinit();
+            return false;
+        }
+        setMem(directory, ARCHIVE_MAX_NUMBER_OF_SEGMENTS * sizeof(ArchiveSegmentInfo), 0);
+        ((ArchiveSegmentHeader*)segmentBuffer)->numberOfTicks = 0;
+        numberOfSegments = 0;
+        directoryLoaded = false;
+        nextTickToArchive = 0;
+        numberOfPendingRequests = 0;
+        return true;
+    }
+
+    static void deinit()
+    {
+        if (directory)
+        {
+            freePool(directory);
+            directory = nullptr;
+        }
+        if (segmentBuffer)
+        {
+            freePool(segmentBuffer);
+            segmentBuffer = nullptr;
+        }
+        if (digestIndexBuffer)
+        {
+            freePool(digestIndexBuffer);
+            digestIndexBuffer = nullptr;
+        }
+        if (directoryChunkBuffer)
+        {
+            freePool(directoryChunkBuffer);
+            directoryChunkBuffer = nullptr;
+        }
+        segmentCache.deinit();
+        digestIndexCache.deinit();
+    }
+
+    // Archive finalized ticks and answer pending requests, called by main loop outside of epoch transition.
+    // Ticks are archived until a segment is sealed, which limits the work per call to saving one segment.
+    static void process()
+    {
+        if (!directoryLoaded)
+        {
+            loadDirectory();
+            directoryLoaded = true;
+        }
+
+        if (!nextTickToArchive)
+        {
+            if (numberOfSegments)
+            {
+                const ArchiveSegmentInfo& info = getSegmentInfo(numberOfSegments - 1);
+                nextTickToArchive = info.firstTick + info.numberOfTicks;
+            }
+            else
+            {
+                nextTickToArchive = system.initialTick;
+            }
+        }
+
+        // votes of a tick may still arrive while the next tick is processed, so the tick before system.tick is not archived yet
+        while (nextTickToArchive + 1 < system.tick)
+        {
+            bool segmentSealed;
+            if (!archiveTick(nextTickToArchive, segmentSealed))
+            {
+                if (nextTickToArchive >= system.initialTick)
+                {
+                    break;
+                }
+                // skip ticks of previous epochs that are not in tick storage anymore
+                while (nextTickToArchive < system.initialTick && !ts.tickInPreviousEpochStorage(nextTickToArchive))
+                {
+                    nextTickToArchive++;
+                }
+                continue;
+            }
+            nextTickToArchive++;
+            if (segmentSealed)
+            {
+                break;
+            }
+        }
+
+        processPendingRequests();
+    }
+
+    // Answer RequestQuorumTick, RequestTickData, or RequestTickTransactions (type) for tick that is not in tick storage.
+    // Returns false if tick is not archived. Otherwise, the response is sent or will be sent by the main loop.
+    static bool respondTickRequest(Peer* peer, unsigned int dejavu, unsigned char type, unsigned int tick, const unsigned char* flags, unsigned int flagsSize)
+    {
+        if (ts.tickInCurrentEpochStorage(tick) || ts.tickInPreviousEpochStorage(tick))
+        {
+            return false;
+        }
+
+        PendingRequest request;
+        request.peer = peer;
+        request.connection = getPeerConnection(peer);
+        request.dejavu = dejavu;
+        request.tick = tick;
+        request.digestIndexLoads = 0;
+        request.type = type;
+        setMem(request.flags, sizeof(request.flags), 0);
+        copyMem(request.flags, flags, (flagsSize < sizeof(request.flags)) ? flagsSize : sizeof(request.flags));
+
+        ACQUIRE(lock);
+        request.segment = (directory) ? findSegmentOfTick(tick) : noSegment;
+        if (request.segment == noSegment)
+        {
+            RELEASE(lock);
+            return false;
+        }
+        const unsigned char* segmentData = segmentCache.find(request.segment);
+        if (segmentData)
+        {
+            respondFromSegment(segmentData, request);
+        }
+        else
+        {
+            queueRequest(request);
+        }
+        RELEASE(lock);
+        return true;
+    }
+
+    // Answer RequestTransactionInfo for transaction that is not in tick storage.
+    // Returns false if transaction is not archived. Otherwise, the response is sent or will be sent by the main loop.
+    static bool respondTransactionInfo(Peer* peer, unsigned int dejavu, const m256i& digest)
+    {
+        PendingRequest request;
+        request.peer = peer;
+        request.connection = getPeerConnection(peer);
+        request.dejavu = dejavu;
+        request.tick = 0;
+        request.digestIndexLoads = 0;
+        request.type = REQUEST_TRANSACTION_INFO;
+        request.digest = digest;
+
+        ACQUIRE(lock);
+        request.segment = (directory && numberOfSegments) ? findSegmentOfDigest(digest, numberOfSegments - 1) : noSegment;
+        if (request.segment == noSegment)
+        {
+            RELEASE(lock);
+            return false;
+        }
+        const unsigned char* digestIndex = digestIndexCache.find(request.segment);
+        const unsigned char* segmentData = segmentCache.find(request.segment);
+        const ArchiveDigestIndexEntry* indexEntry = (digestIndex) ? findInDigestIndex((const ArchiveDigestIndexEntry*)digestIndex, digest) : nullptr;
+        if (indexEntry && segmentData)
+        {
+            const Transaction* transaction = (const Transaction*)(segmentData + indexEntry->transactionOffset);
+            enqueueResponse(peer, transaction->totalSize(), BROADCAST_TRANSACTION, dejavu, transaction);
+        }
+        else
+        {
+            queueRequest(request);
+        }
+        RELEASE(lock);
+        return true;
+    }
+
+    // Return number of sealed segments
+    static unsigned int getNumberOfSegments()
+    {
+        return numberOfSegments;
+    }
+
+    // Return next tick that will be archived
+    static unsigned int getNextTickToArchive()
+    {
+        return nextTickToArchive;
+    }
+};
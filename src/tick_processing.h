@@ -0,0 +1,1405 @@
+#pragma once
+
+#include "platform/m256.h"
+#include "platform/concurrency.h"
+#include "platform/memory.h"
+#include "platform/debugging.h"
+#include "platform/time.h"
+
+#include "network_messages/all.h"
+
+#include "private_settings.h"
+#include "public_settings.h"
+
+#include "contract_core/contract_exec.h"
+#include "contract_core/qpi_system_impl.h"
+#include "contract_core/qpi_asset_impl.h"
+#include "contract_core/qpi_spectrum_impl.h"
+
+#include "kangaroo_twelve.h"
+#include "four_q.h"
+#include "score.h"
+#include "system.h"
+#include "spectrum.h"
+#include "assets/assets.h"
+#include "logging/logging.h"
+#include "tick_storage.h"
+#include "state_snapshot.h"
+#include "vote_counter.h"
+#include "node_state.h"
+
+#if ENTITY_TX_HISTORY
+#include "entity_tx_history.h"
+#endif
+#if ADDON_TX_STATUS_REQUEST
+#include "addons/tx_status_request.h"
+#endif
+
+#include "files/files.h"
+#include "mining/mining.h"
+#include "mining/miner_scores.h"
+#include "oracles/oracle_machines.h"
+
+// State transition of the ticks: the system procedures of the contracts, the transactions of the tick and the digests
+// of spectrum, universe and computer. Shared by the tick processor of the node (qubic.cpp) and tools/tick_replay, which
+// replays saved ticks offline. With NO_UEFI, the contract procedures run on the calling thread instead of the contract
+// processor.
+
+#define MAX_NUMBER_EPOCH 1000ULL
+
+static volatile char criticalSituation = 0;
+
+static m256i computorPublicKeys[sizeof(computorSeeds) / sizeof(computorSeeds[0])];
+static m256i arbitratorPublicKey;
+
+BroadcastComputors broadcastedComputors;
+
+// data closely related to system
+static int solutionPublicationTicks[MAX_NUMBER_OF_SOLUTIONS]; // scheduled tick to broadcast solution, -1 means already broadcasted, -2 means obsolete solution
+#define SOLUTION_RECORDED_FLAG -1
+#define SOLUTION_OBSOLETE_FLAG -2
+
+static TickStorage ts;
+#if ENTITY_TX_HISTORY
+static EntityTxHistory entityTxHistory;
+#endif
+static VoteCounter voteCounter;
+static Tick etalonTick;
+static TickData nextTickData;
+
+static unsigned long long resourceTestingDigest = 0;
+
+static unsigned int numberOfTransactions = 0;
+static unsigned long long spectrumChangeFlags[SPECTRUM_CAPACITY / (sizeof(unsigned long long) * 8)];
+
+static unsigned char contractProcessorState = 0;
+static unsigned int contractProcessorPhase;
+static const Transaction* contractProcessorTransaction = 0;
+static int contractProcessorTransactionMoneyflew = 0;
+static m256i contractStateDigests[MAX_NUMBER_OF_CONTRACTS * 2 - 1];
+const unsigned long long contractStateDigestsSizeInBytes = sizeof(contractStateDigests);
+
+static m256i releasedPublicKeys[NUMBER_OF_COMPUTORS];
+static long long releasedAmounts[NUMBER_OF_COMPUTORS];
+static unsigned int numberOfReleasedEntities;
+
+static int nSpeculativeContractProcessorIDs = 0;
+
+static ScoreFunction<
+    DATA_LENGTH,
+    NUMBER_OF_HIDDEN_NEURONS, 
+    NUMBER_OF_NEIGHBOR_NEURONS,
+    MAX_DURATION,
+    NUMBER_OF_SOLUTION_PROCESSORS
+> * score = nullptr;
+static volatile char solutionsLock = 0;
+static unsigned long long* minerSolutionFlags = NULL;
+static MinerScores<MAX_NUMBER_OF_MINERS> minerScores;
+static m256i competitorPublicKeys[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
+static unsigned int competitorScores[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
+static bool competitorComputorStatuses[(NUMBER_OF_COMPUTORS - QUORUM) * 2];
+static unsigned int minimumComputorScore = 0, minimumCandidateScore = 0;
+static int solutionThreshold[MAX_NUMBER_EPOCH] = { -1 };
+static unsigned long long solutionTotalExecutionTicks = 0;
+static unsigned long long K12TotalExecutionTicks = 0;
+static unsigned long long K12StartingExecutionTicks = 0;
+int K12GlobalIndex = 0;
+static unsigned long long K12MeasurementsSum = 0;
+static volatile char minerScoreArrayLock = 0;
+
+
+QPI::id QPI::QpiContextFunctionCall::arbitrator() const
+{
+    return arbitratorPublicKey;
+}
+
+bool QPI::QpiContextProcedureCall::acquireShares(uint64 assetName, const id& issuer, const id& owner, const id& possessor, sint64 numberOfShares, uint16 sourceOwnershipManagingContractIndex, uint16 sourcePossessionManagingContractIndex) const
+{
+    // Just examples, to make it compile, move these to parameter list
+    unsigned int contractIndex = QX_CONTRACT_INDEX;
+    QPI::sint64 invocationReward = 10;
+
+    if (contractIndex >= contractCount)
+        return false;
+    if (invocationReward < 0)
+        return false;
+    // ...
+
+    // TODO: Init input
+    QPI::PreManagementRightsTransfer_input pre_input;
+    // output is zeroed in __qpiCallSystemProcOfOtherContract
+    QPI::PreManagementRightsTransfer_output pre_output;
+
+    // Call PRE_ACQUIRE_SHARES in other contract after transferring invocationReward
+    __qpiCallSystemProcOfOtherContract<PRE_ACQUIRE_SHARES>(contractIndex, pre_input, pre_output, invocationReward);
+
+    if (pre_output.ok)
+    {
+        // TODO: transfer
+
+        // TODO: init input
+        QPI::PostManagementRightsTransfer_input post_input;
+        // Output is unused, but needed for generalized interface
+        QPI::NoData post_output;
+
+        // Call POST_ACQUIRE_SHARES in other contract without transferring an invocationReward
+        __qpiCallSystemProcOfOtherContract<POST_ACQUIRE_SHARES>(contractIndex, post_input, post_output, 0);
+    }
+
+    return pre_output.ok;
+}
+
+QPI::id QPI::QpiContextFunctionCall::computor(unsigned short computorIndex) const
+{
+    return broadcastedComputors.computors.publicKeys[computorIndex % NUMBER_OF_COMPUTORS];
+}
+
+unsigned char QPI::QpiContextFunctionCall::day() const
+{
+    return etalonTick.day;
+}
+
+unsigned char QPI::QpiContextFunctionCall::dayOfWeek(unsigned char year, unsigned char month, unsigned char day) const
+{
+    return dayIndex(year, month, day) % 7;
+}
+
+unsigned char QPI::QpiContextFunctionCall::hour() const
+{
+    return etalonTick.hour;
+}
+
+unsigned short QPI::QpiContextFunctionCall::millisecond() const
+{
+    return etalonTick.millisecond;
+}
+
+unsigned char QPI::QpiContextFunctionCall::minute() const
+{
+    return etalonTick.minute;
+}
+
+unsigned char QPI::QpiContextFunctionCall::month() const
+{
+    return etalonTick.month;
+}
+
+m256i QPI::QpiContextFunctionCall::nextId(const m256i& currentId) const
+{
+    int index = spectrumIndex(currentId);
+    while (++index < SPECTRUM_CAPACITY)
+    {
+        const m256i& nextId = spectrum[index].publicKey;
+        if (!isZero(nextId))
+        {
+            return nextId;
+        }
+    }
+
+    return m256i::zero();
+}
+
+int QPI::QpiContextFunctionCall::numberOfTickTransactions() const
+{
+    return -1; // TODO: Return -1 if the current tick is empty, return the number of the transactions in the tick otherwise, including 0
+}
+
+bool QPI::QpiContextProcedureCall::releaseShares(uint64 assetName, const id& issuer, const id& owner, const id& possessor, sint64 numberOfShares, uint16 destinationOwnershipManagingContractIndex, uint16 destinationPossessionManagingContractIndex) const
+{
+    // TODO
+
+    return false;
+}
+
+unsigned char QPI::QpiContextFunctionCall::second() const
+{
+    return etalonTick.second;
+}
+
+bool QPI::QpiContextFunctionCall::signatureValidity(const m256i& entity, const m256i& digest, const array<signed char, 64>& signature) const
+{
+    return verify(entity.m256i_u8, digest.m256i_u8, reinterpret_cast<const unsigned char*>(&signature));
+}
+
+unsigned char QPI::QpiContextFunctionCall::year() const
+{
+    return etalonTick.year;
+}
+
+template <typename T>
+m256i QPI::QpiContextFunctionCall::K12(const T& data) const
+{
+    m256i digest;
+
+    KangarooTwelve(&data, sizeof(data), &digest, sizeof(digest));
+
+    return digest;
+}
+
+static int computorIndex(m256i computor)
+{
+    for (int computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
+    {
+        if (broadcastedComputors.computors.publicKeys[computorIndex] == computor)
+        {
+            return computorIndex;
+        }
+    }
+
+    return -1;
+}
+
+// Should only be called from tick processor to avoid concurrent state changes, which can cause race conditions as detailed in FIXME below.
+static void getComputerDigest(m256i& digest)
+{
+    unsigned int digestIndex;
+    for (digestIndex = 0; digestIndex < MAX_NUMBER_OF_CONTRACTS; digestIndex++)
+    {
+        if (contractStateChangeFlags[digestIndex >> 6] & (1ULL << (digestIndex & 63)))
+        {
+            const unsigned long long size = digestIndex < contractCount ? contractDescriptions[digestIndex].stateSize : 0;
+            StateSnapshot::beforeWrite(&contractStateDigests[digestIndex], 32);
+            if (!size)
+            {
+                contractStateDigests[digestIndex] = m256i::zero();
+            }
+            else
+            {
+                // FIXME: We may have a race condition here if a digest is computed here by thread A, the state is changed
+                // + contractStateChangeFlags set afterwards by thread B and contractStateChangeFlags cleared below below
+                // by thread A. We then have a changed state but a cleared contractStateChangeFlags flag leading to wrong
+                // digest.
+                // This is currently avoided by calling getComputerDigest() from tick processor only (and in non-concurrent init)
+                contractStateLock[digestIndex].acquireRead();
+
+                K12StartingExecutionTicks = __rdtsc();
+                KangarooTwelve(contractStates[digestIndex], (unsigned int)size, &contractStateDigests[digestIndex], 32);
+                K12TotalExecutionTicks = __rdtsc() - K12StartingExecutionTicks;
+                if (K12GlobalIndex < 500)
+                {
+                    K12MeasurementsSum += K12TotalExecutionTicks;
+                    K12GlobalIndex++;
+                }
+                contractStateLock[digestIndex].releaseRead();
+            }
+        }
+    }
+    unsigned int previousLevelBeginning = 0;
+    unsigned int numberOfLeafs = MAX_NUMBER_OF_CONTRACTS;
+    while (numberOfLeafs > 1)
+    {
+        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+        {
+            if (contractStateChangeFlags[i >> 6] & (3ULL << (i & 63)))
+            {
+                StateSnapshot::beforeWrite(&contractStateDigests[digestIndex], 32);
+                KangarooTwelve64To32(&contractStateDigests[previousLevelBeginning + i], &contractStateDigests[digestIndex]);
+                contractStateChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
+                contractStateChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
+            }
+            digestIndex++;
+        }
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+    contractStateChangeFlags[0] = 0;
+
+    digest = contractStateDigests[(MAX_NUMBER_OF_CONTRACTS * 2 - 1) - 1];
+}
+
+static void setNewMiningSeed()
+{
+    score->initMiningData(spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1]);
+}
+
+static unsigned int getTickInMiningPhaseCycle()
+{
+    return (system.tick - system.initialTick) % (INTERNAL_COMPUTATIONS_INTERVAL + EXTERNAL_COMPUTATIONS_INTERVAL);
+}
+
+static void checkAndSwitchMiningPhase()
+{
+    const unsigned int r = getTickInMiningPhaseCycle();
+    if (!r)
+    {
+        setNewMiningSeed();
+    }
+    else
+    {
+        if (r == INTERNAL_COMPUTATIONS_INTERVAL + 3) // 3 is added because of 3-tick shift for transaction confirmation
+        {
+            score->initMiningData(m256i::zero());
+        }
+    }
+}
+
+// Run the contract procedures of contractProcessorPhase, done by contractProcessor() in the node
+static void executeContractProcessorPhase()
+{
+    unsigned int executedContractIndex;
+    switch (contractProcessorPhase)
+    {
+    case INITIALIZE:
+    {
+        for (executedContractIndex = 1; executedContractIndex < contractCount; executedContractIndex++)
+        {
+            if (system.epoch == contractDescriptions[executedContractIndex].constructionEpoch
+                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
+            {
+                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
+                qpiContext.call(INITIALIZE);
+            }
+        }
+    }
+    break;
+
+    case BEGIN_EPOCH:
+    {
+        for (executedContractIndex = 1; executedContractIndex < contractCount; executedContractIndex++)
+        {
+            if (system.epoch >= contractDescriptions[executedContractIndex].constructionEpoch
+                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
+            {
+                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
+                qpiContext.call(BEGIN_EPOCH);
+            }
+        }
+    }
+    break;
+
+    case BEGIN_TICK:
+    {
+        for (executedContractIndex = 1; executedContractIndex < contractCount; executedContractIndex++)
+        {
+            if (system.epoch >= contractDescriptions[executedContractIndex].constructionEpoch
+                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
+            {
+                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
+                qpiContext.call(BEGIN_TICK);
+            }
+        }
+    }
+    break;
+
+    case END_TICK:
+    {
+        for (executedContractIndex = contractCount; executedContractIndex-- > 1; )
+        {
+            if (system.epoch >= contractDescriptions[executedContractIndex].constructionEpoch
+                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
+            {
+                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
+                qpiContext.call(END_TICK);
+            }
+        }
+    }
+    break;
+
+    case END_EPOCH:
+    {
+        for (executedContractIndex = contractCount; executedContractIndex-- > 1; )
+        {
+            if (system.epoch >= contractDescriptions[executedContractIndex].constructionEpoch
+                && system.epoch < contractDescriptions[executedContractIndex].destructionEpoch)
+            {
+                QpiContextSystemProcedureCall qpiContext(executedContractIndex);
+                qpiContext.call(END_EPOCH);
+            }
+        }
+    }
+    break;
+
+    case USER_PROCEDURE_CALL:
+    {
+        const Transaction* transaction = contractProcessorTransaction;
+        ASSERT(transaction && transaction->checkValidity());
+
+        unsigned int contractIndex = (unsigned int)transaction->destinationPublicKey.m256i_u64[0];
+        ASSERT(system.epoch >= contractDescriptions[contractIndex].constructionEpoch);
+        ASSERT(system.epoch < contractDescriptions[contractIndex].destructionEpoch);
+        ASSERT(contractUserProcedures[contractIndex][transaction->inputType]);
+
+        QpiContextUserProcedureCall qpiContext(contractIndex, transaction->sourcePublicKey, transaction->amount);
+        qpiContext.call(transaction->inputType, transaction->inputPtr(), transaction->inputSize);
+
+        if (contractActionTracker.getOverallQuTransferBalance(transaction->sourcePublicKey) == 0)
+            contractProcessorTransactionMoneyflew = 0;
+        else
+            contractProcessorTransactionMoneyflew = 1;
+        contractProcessorTransaction = 0;
+    }
+    break;
+    }
+}
+
+// Let the contract processor run the procedures of phase and wait for completion. Without UEFI, they run on the
+// calling thread.
+static void runContractProcessor(unsigned int phase)
+{
+    contractProcessorPhase = phase;
+#ifdef NO_UEFI
+    executeContractProcessorPhase();
+#else
+    contractProcessorState = 1;
+    while (contractProcessorState)
+    {
+        _mm_pause();
+    }
+#endif
+}
+
+static void processTickTransactionContractIPO(const Transaction* transaction, const int spectrumIndex, const unsigned int contractIndex)
+{
+    ASSERT(nextTickData.epoch == system.epoch);
+    ASSERT(transaction != nullptr);
+    ASSERT(transaction->checkValidity());
+    ASSERT(transaction->tick == system.tick);
+    ASSERT(!transaction->amount && transaction->inputSize == sizeof(ContractIPOBid));
+    ASSERT(spectrumIndex >= 0);
+    ASSERT(contractIndex < contractCount);
+    ASSERT(system.epoch < contractDescriptions[contractIndex].constructionEpoch);
+
+    ContractIPOBid* contractIPOBid = (ContractIPOBid*)transaction->inputPtr();
+    if (contractIPOBid->price > 0 && contractIPOBid->price <= MAX_AMOUNT / NUMBER_OF_COMPUTORS
+        && contractIPOBid->quantity > 0 && contractIPOBid->quantity <= NUMBER_OF_COMPUTORS)
+    {
+        const long long amount = contractIPOBid->price * contractIPOBid->quantity;
+        if (decreaseEnergy(spectrumIndex, amount))
+        {
+            const QuTransfer quTransfer = { transaction->sourcePublicKey, m256i::zero(), amount };
+            logger.logQuTransfer(quTransfer);
+
+            numberOfReleasedEntities = 0;
+            contractStateLock[contractIndex].acquireWrite();
+            StateSnapshot::beforeWrite(contractStates[contractIndex], contractDescriptions[contractIndex].stateSize);
+            IPO* ipo = (IPO*)contractStates[contractIndex];
+            for (unsigned int i = 0; i < contractIPOBid->quantity; i++)
+            {
+                if (contractIPOBid->price <= ipo->prices[NUMBER_OF_COMPUTORS - 1])
+                {
+                    unsigned int j;
+                    for (j = 0; j < numberOfReleasedEntities; j++)
+                    {
+                        if (transaction->sourcePublicKey == releasedPublicKeys[j])
+                        {
+                            break;
+                        }
+                    }
+                    if (j == numberOfReleasedEntities)
+                    {
+                        releasedPublicKeys[numberOfReleasedEntities] = transaction->sourcePublicKey;
+                        releasedAmounts[numberOfReleasedEntities++] = contractIPOBid->price;
+                    }
+                    else
+                    {
+                        releasedAmounts[j] += contractIPOBid->price;
+                    }
+                }
+                else
+                {
+                    unsigned int j;
+                    for (j = 0; j < numberOfReleasedEntities; j++)
+                    {
+                        if (ipo->publicKeys[NUMBER_OF_COMPUTORS - 1] == releasedPublicKeys[j])
+                        {
+                            break;
+                        }
+                    }
+                    if (j == numberOfReleasedEntities)
+                    {
+                        releasedPublicKeys[numberOfReleasedEntities] = ipo->publicKeys[NUMBER_OF_COMPUTORS - 1];
+                        releasedAmounts[numberOfReleasedEntities++] = ipo->prices[NUMBER_OF_COMPUTORS - 1];
+                    }
+                    else
+                    {
+                        releasedAmounts[j] += ipo->prices[NUMBER_OF_COMPUTORS - 1];
+                    }
+
+                    ipo->publicKeys[NUMBER_OF_COMPUTORS - 1] = transaction->sourcePublicKey;
+                    ipo->prices[NUMBER_OF_COMPUTORS - 1] = contractIPOBid->price;
+                    j = NUMBER_OF_COMPUTORS - 1;
+                    while (j
+                        && ipo->prices[j - 1] < ipo->prices[j])
+                    {
+                        const m256i tmpPublicKey = ipo->publicKeys[j - 1];
+                        const long long tmpPrice = ipo->prices[j - 1];
+                        ipo->publicKeys[j - 1] = ipo->publicKeys[j];
+                        ipo->prices[j - 1] = ipo->prices[j];
+                        ipo->publicKeys[j] = tmpPublicKey;
+                        ipo->prices[j--] = tmpPrice;
+                    }
+
+                    setContractStateChangeFlag(contractIndex);
+                }
+            }
+            contractStateLock[contractIndex].releaseWrite();
+
+            for (unsigned int i = 0; i < numberOfReleasedEntities; i++)
+            {
+                increaseEnergy(releasedPublicKeys[i], releasedAmounts[i]);
+                const QuTransfer quTransfer = { m256i::zero(), releasedPublicKeys[i], releasedAmounts[i] };
+                logger.logQuTransfer(quTransfer);
+            }
+        }
+    }
+}
+
+// Return if money flew
+static bool processTickTransactionContractProcedure(const Transaction* transaction, const int spectrumIndex, const unsigned int contractIndex)
+{
+    ASSERT(nextTickData.epoch == system.epoch);
+    ASSERT(transaction != nullptr);
+    ASSERT(transaction->checkValidity());
+    ASSERT(transaction->tick == system.tick);
+    ASSERT(spectrumIndex >= 0);
+    ASSERT(contractIndex < contractCount);
+    ASSERT(system.epoch >= contractDescriptions[contractIndex].constructionEpoch);
+    ASSERT(system.epoch < contractDescriptions[contractIndex].destructionEpoch);
+
+    if (contractUserProcedures[contractIndex][transaction->inputType])
+    {
+        // Run user procedure call of transaction in contract processor and wait for completion
+        contractProcessorTransaction = transaction;
+        runContractProcessor(USER_PROCEDURE_CALL);
+
+        return contractProcessorTransactionMoneyflew;
+    }
+
+    // if transaction tries to invoke non-registered procedure, transaction amount is not reimbursed
+    return transaction->amount > 0;
+}
+
+// Add the solution of a transaction to the score task queue if it is not processed yet. The solutions of the
+// current tick are added before processing the tick, those of the next tick are prefetched while waiting for it.
+static void addSolutionTask(const Transaction* transaction, unsigned int taskPriority)
+{
+    if (isZero(transaction->destinationPublicKey)
+        && transaction->amount >= MiningSolutionTransaction::minAmount()
+        && transaction->inputType == MiningSolutionTransaction::transactionType()
+        && transaction->inputSize == 32 + 32
+        && spectrumIndex(transaction->sourcePublicKey) >= 0)
+    {
+        const m256i& solution_miningSeed = *(m256i*)transaction->inputPtr();
+        const m256i& solution_nonce = *(m256i*)(transaction->inputPtr() + 32);
+        m256i data[3] = { transaction->sourcePublicKey, solution_miningSeed, solution_nonce };
+        static_assert(sizeof(data) == 3 * 32, "Unexpected array size");
+        unsigned int flagIndex;
+        KangarooTwelve(data, sizeof(data), &flagIndex, sizeof(flagIndex));
+        if (!(minerSolutionFlags[flagIndex >> 6] & (1ULL << (flagIndex & 63))))
+        {
+            score->addTask(transaction->sourcePublicKey, solution_miningSeed, solution_nonce, taskPriority);
+        }
+    }
+}
+
+static void processTickTransactionSolution(const MiningSolutionTransaction* transaction, const unsigned long long processorNumber)
+{
+    ASSERT(nextTickData.epoch == system.epoch);
+    ASSERT(transaction != nullptr);
+    ASSERT(transaction->checkValidity());
+    ASSERT(transaction->tick == system.tick);
+    ASSERT(isZero(transaction->destinationPublicKey));
+    ASSERT(transaction->amount >=MiningSolutionTransaction::minAmount()
+            && transaction->inputSize == 64
+            && transaction->inputType == MiningSolutionTransaction::transactionType());
+
+    m256i data[3] = { transaction->sourcePublicKey, transaction->miningSeed, transaction->nonce };
+    static_assert(sizeof(data) == 3 * 32, "Unexpected array size");
+    unsigned int flagIndex;
+    KangarooTwelve(data, sizeof(data), &flagIndex, sizeof(flagIndex));
+    if (!(minerSolutionFlags[flagIndex >> 6] & (1ULL << (flagIndex & 63))))
+    {
+        StateSnapshot::beforeWrite(&minerSolutionFlags[flagIndex >> 6], 8);
+        minerSolutionFlags[flagIndex >> 6] |= (1ULL << (flagIndex & 63));
+
+        unsigned int solutionScore = (*::score)(processorNumber, transaction->sourcePublicKey, transaction->miningSeed, transaction->nonce);
+        if (score->isValidScore(solutionScore))
+        {
+            resourceTestingDigest ^= (unsigned long long)(solutionScore);
+            KangarooTwelve(&resourceTestingDigest, sizeof(resourceTestingDigest), &resourceTestingDigest, sizeof(resourceTestingDigest));
+
+            const int threshold = (system.epoch < MAX_NUMBER_EPOCH) ? solutionThreshold[system.epoch] : SOLUTION_THRESHOLD_DEFAULT;
+            if (score->isGoodScore(solutionScore, threshold))
+            {
+                // Solution deposit return
+                {
+                    increaseEnergy(transaction->sourcePublicKey, transaction->amount);
+
+                    const QuTransfer quTransfer = { m256i::zero(), transaction->sourcePublicKey, transaction->amount };
+                    logger.logQuTransfer(quTransfer);
+                }
+
+                for (unsigned int i = 0; i < sizeof(computorSeeds) / sizeof(computorSeeds[0]); i++)
+                {
+                    if (transaction->sourcePublicKey == computorPublicKeys[i])
+                    {
+                        ACQUIRE(solutionsLock);
+
+                        unsigned int j;
+                        for (j = 0; j < system.numberOfSolutions; j++)
+                        {
+                            if (transaction->nonce == system.solutions[j].nonce
+                                && transaction->miningSeed == system.solutions[j].miningSeed
+                                && transaction->sourcePublicKey == system.solutions[j].computorPublicKey)
+                            {
+                                solutionPublicationTicks[j] = SOLUTION_RECORDED_FLAG;
+
+                                break;
+                            }
+                        }
+                        if (j == system.numberOfSolutions
+                            && system.numberOfSolutions < MAX_NUMBER_OF_SOLUTIONS)
+                        {
+                            system.solutions[system.numberOfSolutions].computorPublicKey = transaction->sourcePublicKey;
+                            system.solutions[system.numberOfSolutions].miningSeed = transaction->miningSeed;
+                            system.solutions[system.numberOfSolutions].nonce = transaction->nonce;
+                            solutionPublicationTicks[system.numberOfSolutions++] = SOLUTION_RECORDED_FLAG;
+                        }
+
+                        RELEASE(solutionsLock);
+
+                        break;
+                    }
+                }
+
+                ACQUIRE(minerScoreArrayLock);
+                minerScores.addSolution(transaction->sourcePublicKey);
+
+                // combine 225 worst current computors with 225 best candidates, sorted by score
+                // -> top 225 from competitorPublicKeys have computors and candidates which are the best from that subset
+                minerScores.getCompetitors(competitorPublicKeys, competitorScores, competitorComputorStatuses);
+
+                minerScores.getTopComputors(system.futureComputors, QUORUM);
+                RELEASE(minerScoreArrayLock);
+
+                minimumComputorScore = competitorScores[NUMBER_OF_COMPUTORS - QUORUM - 1];
+
+                unsigned char candidateCounter = 0;
+                for (unsigned int i = 0; i < (NUMBER_OF_COMPUTORS - QUORUM) * 2; i++)
+                {
+                    if (!competitorComputorStatuses[i])
+                    {
+                        minimumCandidateScore = competitorScores[i];
+                        candidateCounter++;
+                    }
+                }
+                if (candidateCounter < NUMBER_OF_COMPUTORS - QUORUM)
+                {
+                    minimumCandidateScore = minimumComputorScore;
+                }
+
+                for (unsigned int i = QUORUM; i < NUMBER_OF_COMPUTORS; i++)
+                {
+                    system.futureComputors[i] = competitorPublicKeys[i - QUORUM];
+                }
+            }
+        }        
+    }
+    else
+    {
+        for (unsigned int i = 0; i < sizeof(computorSeeds) / sizeof(computorSeeds[0]); i++)
+        {
+            if (transaction->sourcePublicKey == computorPublicKeys[i])
+            {
+                ACQUIRE(solutionsLock);
+
+                unsigned int j;
+                for (j = 0; j < system.numberOfSolutions; j++)
+                {
+                    if (transaction->nonce == system.solutions[j].nonce
+                        && transaction->miningSeed == system.solutions[j].miningSeed
+                        && transaction->sourcePublicKey == system.solutions[j].computorPublicKey)
+                    {
+                        solutionPublicationTicks[j] = SOLUTION_RECORDED_FLAG;
+
+                        break;
+                    }
+                }
+                if (j == system.numberOfSolutions
+                    && system.numberOfSolutions < MAX_NUMBER_OF_SOLUTIONS)
+                {
+                    system.solutions[system.numberOfSolutions].computorPublicKey = transaction->sourcePublicKey;
+                    system.solutions[system.numberOfSolutions].miningSeed = transaction->miningSeed;
+                    system.solutions[system.numberOfSolutions].nonce = transaction->nonce;
+                    solutionPublicationTicks[system.numberOfSolutions++] = SOLUTION_RECORDED_FLAG;
+                }
+
+                RELEASE(solutionsLock);
+
+                break;
+            }
+        }
+    }
+}
+
+static void processTickTransactionFileHeader(const FileHeaderTransaction* transaction)
+{
+    ASSERT(nextTickData.epoch == system.epoch);
+    ASSERT(transaction != nullptr);
+    ASSERT(transaction->checkValidity());
+    ASSERT(isZero(transaction->destinationPublicKey));
+    ASSERT(transaction->tick == system.tick);
+
+    // TODO
+}
+
+static void processTickTransactionFileFragment(const FileFragmentTransactionPrefix* transactionPrefix, const FileFragmentTransactionPostfix* transactionPostfix)
+{
+    ASSERT(nextTickData.epoch == system.epoch);
+    ASSERT(transactionPrefix != nullptr);
+    ASSERT(transactionPostfix != nullptr);
+    ASSERT(transactionPrefix->checkValidity());
+    ASSERT(isZero(transactionPrefix->destinationPublicKey));
+    ASSERT(transactionPrefix->tick == system.tick);
+
+    // TODO
+}
+
+static void processTickTransactionOracleReplyCommit(const OracleReplyCommitTransaction* transaction)
+{
+    ASSERT(nextTickData.epoch == system.epoch);
+    ASSERT(transaction != nullptr);
+    ASSERT(transaction->checkValidity());
+    ASSERT(isZero(transaction->destinationPublicKey));
+    ASSERT(transaction->tick == system.tick);
+
+    // TODO
+}
+
+static void processTickTransactionOracleReplyReveal(const OracleReplyRevealTransactionPrefix* transaction)
+{
+    ASSERT(nextTickData.epoch == system.epoch);
+    ASSERT(transaction != nullptr);
+    ASSERT(transaction->checkValidity());
+    ASSERT(isZero(transaction->destinationPublicKey));
+    ASSERT(transaction->tick == system.tick);
+
+    // TODO
+}
+
+static void processTickTransaction(const Transaction* transaction, const m256i& transactionDigest, unsigned long long processorNumber)
+{
+    ASSERT(nextTickData.epoch == system.epoch);
+    ASSERT(transaction != nullptr);
+    ASSERT(transaction->checkValidity());
+    ASSERT(transaction->tick == system.tick);
+
+    // Record the tx with digest
+    ts.transactionsDigestAccess.acquireLock();
+    ts.transactionsDigestAccess.insertTransaction(transactionDigest, transaction);
+    ts.transactionsDigestAccess.releaseLock();
+
+    const int spectrumIndex = ::spectrumIndex(transaction->sourcePublicKey);
+    if (spectrumIndex >= 0)
+    {
+        numberOfTransactions++;
+        bool moneyFlew = false;
+#if ADDON_TX_STATUS_REQUEST
+        txStatusData.tickTxIndexStart[system.tick - system.initialTick + 1] = numberOfTransactions; // qli: part of tx_status_request add-on
+#endif
+        if (decreaseEnergy(spectrumIndex, transaction->amount))
+        {
+            increaseEnergy(transaction->destinationPublicKey, transaction->amount);
+
+            if (transaction->amount)
+            {
+                moneyFlew = true;
+                const QuTransfer quTransfer = { transaction->sourcePublicKey , transaction->destinationPublicKey , transaction->amount };
+                logger.logQuTransfer(quTransfer);
+            }
+
+            if (isZero(transaction->destinationPublicKey))
+            {
+                switch (transaction->inputType)
+                {
+                case VOTE_COUNTER_INPUT_TYPE:
+                {
+                    int computorIndex = transaction->tick % NUMBER_OF_COMPUTORS;
+                    if (transaction->sourcePublicKey == broadcastedComputors.computors.publicKeys[computorIndex]) // this tx was sent by the tick leader of this tick
+                    {
+                        if (!transaction->amount
+                            && transaction->inputSize == VOTE_COUNTER_DATA_SIZE_IN_BYTES)
+                        {
+                            voteCounter.addVotes(transaction->inputPtr(), computorIndex);
+                        }
+                    }
+                }
+                break;
+
+                case FileHeaderTransaction::transactionType():
+                {
+                    if (transaction->amount >= FileFragmentTransactionPrefix::minAmount()
+                        && transaction->inputSize >= FileFragmentTransactionPrefix::minInputSize())
+                    {
+                        processTickTransactionFileHeader((FileHeaderTransaction*)transaction);
+                    }
+                }
+                break;
+
+                case FileFragmentTransactionPrefix::transactionType():
+                {
+                    if (transaction->amount >= FileFragmentTransactionPrefix::minAmount()
+                        && transaction->inputSize >= FileFragmentTransactionPrefix::minInputSize())
+                    {
+                        processTickTransactionFileFragment((FileFragmentTransactionPrefix*)transaction, (FileFragmentTransactionPostfix*)(((char*)transaction) + sizeof(Transaction) + transaction->inputSize));
+                    }
+                }
+                break;
+
+                case MiningSolutionTransaction::transactionType():
+                {
+                    if (transaction->amount >= MiningSolutionTransaction::minAmount()
+                        && transaction->inputSize >= MiningSolutionTransaction::minInputSize())
+                    {
+                        processTickTransactionSolution((MiningSolutionTransaction*)transaction, processorNumber);
+                    }
+                }
+                break;
+
+                case OracleReplyCommitTransaction::transactionType():
+                {
+                    if (computorIndex(transaction->sourcePublicKey) >= 0
+                        && transaction->inputSize == sizeof(OracleReplyCommitTransaction))
+                    {
+                        processTickTransactionOracleReplyCommit((OracleReplyCommitTransaction*)transaction);
+                    }
+                }
+                break;
+
+                case OracleReplyRevealTransactionPrefix::transactionType():
+                {
+                    if (computorIndex(transaction->sourcePublicKey) >= 0
+                        && transaction->inputSize >= sizeof(OracleReplyRevealTransactionPrefix) + sizeof(OracleReplyRevealTransactionPostfix))
+                    {
+                        processTickTransactionOracleReplyReveal((OracleReplyRevealTransactionPrefix*)transaction);
+                    }
+                }
+                break;
+                }
+            }
+            else
+            {
+                // Contracts are identified by their index stored in the first 64 bits of the id, all
+                // other bits are zeroed. However, the max number of contracts is limited to 2^32 - 1,
+                // only 32 bits are used for the contract index.
+                m256i maskedDestinationPublicKey = transaction->destinationPublicKey;
+                maskedDestinationPublicKey.m256i_u64[0] &= ~(MAX_NUMBER_OF_CONTRACTS - 1ULL);
+                unsigned int contractIndex = (unsigned int)transaction->destinationPublicKey.m256i_u64[0];
+                if (isZero(maskedDestinationPublicKey)
+                    && contractIndex < contractCount)
+                {
+                    // Contract transactions
+                    if (system.epoch < contractDescriptions[contractIndex].constructionEpoch)
+                    {
+                        // IPO
+                        if (!transaction->amount
+                            && transaction->inputSize == sizeof(ContractIPOBid))
+                        {
+                            processTickTransactionContractIPO(transaction, spectrumIndex, contractIndex);
+                        }
+                    }
+                    else if (system.epoch < contractDescriptions[contractIndex].destructionEpoch)
+                    {
+                        // Regular contract procedure invocation
+                        moneyFlew = processTickTransactionContractProcedure(transaction, spectrumIndex, contractIndex);
+                    }
+                }
+            }
+        }
+
+#if ADDON_TX_STATUS_REQUEST
+        saveConfirmedTx(numberOfTransactions - 1, moneyFlew, system.tick, transactionDigest); // qli: save tx
+#endif
+    }
+}
+
+// Batch of consecutive contract procedure transactions of the current tick, executed by the speculative contract processors
+static struct
+{
+    unsigned int numberOfTransactions;
+    unsigned short transactionIndices[NUMBER_OF_TRANSACTIONS_PER_TICK];
+    const Transaction* transactions[NUMBER_OF_TRANSACTIONS_PER_TICK];
+    bool sourceFound[NUMBER_OF_TRANSACTIONS_PER_TICK];
+    bool moneyFlew[NUMBER_OF_TRANSACTIONS_PER_TICK];
+} speculativeBatch;
+
+// Check if transaction invokes a registered user procedure of a contract that may be executed speculatively
+static bool isSpeculativeExecutionCandidate(const Transaction* transaction)
+{
+    if (!nSpeculativeContractProcessorIDs)
+        return false;
+
+    m256i maskedDestinationPublicKey = transaction->destinationPublicKey;
+    maskedDestinationPublicKey.m256i_u64[0] &= ~(MAX_NUMBER_OF_CONTRACTS - 1ULL);
+    unsigned int contractIndex = (unsigned int)transaction->destinationPublicKey.m256i_u64[0];
+    return isZero(maskedDestinationPublicKey)
+        && contractIndex > 0
+        && contractIndex < contractCount
+        && system.epoch >= contractDescriptions[contractIndex].constructionEpoch
+        && system.epoch < contractDescriptions[contractIndex].destructionEpoch
+        && contractDescriptions[contractIndex].stateSize <= MAX_SPECULATIVE_CONTRACT_STATE_SIZE
+        && contractUserProcedures[contractIndex][transaction->inputType];
+}
+
+// Speculative counterpart of processTickTransaction() for contract procedure transactions, run by speculative contract processor.
+// Recording the transaction (digest, counter, status) is done by processSpeculativeBatch() when committing the results.
+static void processTickTransactionSpeculatively(SpeculativeLane& lane, unsigned int position)
+{
+    const Transaction* transaction = speculativeBatch.transactions[position];
+    const unsigned int contractIndex = (unsigned int)transaction->destinationPublicKey.m256i_u64[0];
+    bool moneyFlew = false;
+
+    const int spectrumIndex = ::spectrumIndex(transaction->sourcePublicKey);
+    speculativeBatch.sourceFound[position] = (spectrumIndex >= 0);
+    if (spectrumIndex >= 0)
+    {
+        if (decreaseEnergySpeculative(lane, spectrumIndex, transaction->amount))
+        {
+            increaseEnergySpeculative(lane, transaction->destinationPublicKey, transaction->amount);
+
+            QpiContextUserProcedureCall qpiContext(contractIndex, transaction->sourcePublicKey, transaction->amount);
+            qpiContext.call(transaction->inputType, transaction->inputPtr(), transaction->inputSize);
+
+            moneyFlew = (lane.actionTracker.getOverallQuTransferBalance(transaction->sourcePublicKey) != 0);
+        }
+    }
+    speculativeBatch.moneyFlew[position] = moneyFlew;
+}
+
+// Execute collected batch of contract procedure transactions in parallel and commit results in the order of the tick.
+// Transactions that may have been affected by a conflict are rolled back and processed again sequentially.
+static void processSpeculativeBatch(unsigned long long processorNumber)
+{
+    const unsigned int batchSize = speculativeBatch.numberOfTransactions;
+    speculativeBatch.numberOfTransactions = 0;
+
+    unsigned int escapePosition = 0;
+    if (batchSize > 1)
+    {
+        beginSpeculativeBatch(batchSize);
+
+        // Assign transactions to lanes, keeping all transactions invoking the same contract in the same lane
+        unsigned char contractLanes[contractCount];
+        setMem(contractLanes, sizeof(contractLanes), 0xFF);
+        unsigned int nextLane = 0;
+        for (unsigned int position = 0; position < batchSize; position++)
+        {
+            const unsigned int contractIndex = (unsigned int)speculativeBatch.transactions[position]->destinationPublicKey.m256i_u64[0];
+            if (contractLanes[contractIndex] == 0xFF)
+            {
+                contractLanes[contractIndex] = nextLane;
+                nextLane = (nextLane + 1) % nSpeculativeContractProcessorIDs;
+            }
+            SpeculativeLane& lane = speculativeLanes[contractLanes[contractIndex]];
+            lane.transactionPositions[lane.numberOfTransactions++] = (unsigned short)position;
+        }
+
+        // Run lanes and wait for completion or timeout (lanes are started by main loop)
+        for (int i = 0; i < nSpeculativeContractProcessorIDs; i++)
+        {
+            if (speculativeLanes[i].numberOfTransactions)
+            {
+                speculativeLanes[i].completed = false;
+                speculativeLanes[i].state = 1;
+            }
+        }
+        for (int i = 0; i < nSpeculativeContractProcessorIDs; i++)
+        {
+            while (speculativeLanes[i].state)
+            {
+                _mm_pause();
+            }
+        }
+
+        rollbackSpeculativeBatch();
+        escapePosition = speculativeEscapePosition;
+
+        // Commit transactions before escape position in order
+        for (unsigned int position = 0; position < escapePosition; position++)
+        {
+            const Transaction* transaction = speculativeBatch.transactions[position];
+            const unsigned int transactionIndex = speculativeBatch.transactionIndices[position];
+            const m256i& transactionDigest = nextTickData.transactionDigests[transactionIndex];
+
+            ts.transactionsDigestAccess.acquireLock();
+            ts.transactionsDigestAccess.insertTransaction(transactionDigest, transaction);
+            ts.transactionsDigestAccess.releaseLock();
+
+            logger.registerNewTx(transaction->tick, transactionIndex);
+            if (speculativeBatch.sourceFound[position])
+            {
+                numberOfTransactions++;
+#if ADDON_TX_STATUS_REQUEST
+                txStatusData.tickTxIndexStart[system.tick - system.initialTick + 1] = numberOfTransactions; // qli: part of tx_status_request add-on
+                saveConfirmedTx(numberOfTransactions - 1, speculativeBatch.moneyFlew[position], system.tick, transactionDigest); // qli: save tx
+#endif
+            }
+        }
+    }
+
+    // Process remaining transactions sequentially
+    for (unsigned int position = escapePosition; position < batchSize; position++)
+    {
+        const Transaction* transaction = speculativeBatch.transactions[position];
+        const unsigned int transactionIndex = speculativeBatch.transactionIndices[position];
+        logger.registerNewTx(transaction->tick, transactionIndex);
+        processTickTransaction(transaction, nextTickData.transactionDigests[transactionIndex], processorNumber);
+    }
+}
+
+// Set the prev digests of etalonTick and run the system procedures at the beginning of tick system.tick
+static void beginTick()
+{
+    if (system.tick > system.initialTick)
+    {
+        etalonTick.prevResourceTestingDigest = resourceTestingDigest;
+        etalonTick.prevSpectrumDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
+        getUniverseDigest(etalonTick.prevUniverseDigest);
+        getComputerDigest(etalonTick.prevComputerDigest);
+    }
+    else if (system.tick == system.initialTick) // the first tick of an epoch
+    {
+        // RULE: prevDigests of tick T are the digests of tick T-1, so epoch number doesn't matter.        
+        // For seamless transition, spectrum and universe and computer have been changed after endEpoch event
+        // (miner rewards, IPO finalizing, contract endEpoch procedures,...)
+        // Here we still let prevDigests == digests of the last tick of last epoch
+        // so that lite client can verify the state of spectrum        
+
+#if START_NETWORK_FROM_SCRATCH // only update it if the whole network starts from scratch
+        // everything starts from files, there is no previous tick of the last epoch
+        // thus, prevDigests are the digests of the files
+        if (system.epoch == EPOCH)
+        {
+            etalonTick.prevResourceTestingDigest = resourceTestingDigest;
+            etalonTick.prevSpectrumDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
+            getUniverseDigest(etalonTick.prevUniverseDigest);
+            getComputerDigest(etalonTick.prevComputerDigest);
+        }
+#endif
+    }
+    else
+    {
+        // it should never go here
+    }
+
+    if (system.tick == system.initialTick)
+    {
+#if ENTITY_TX_HISTORY
+        entityTxHistory.beginEpoch();
+#endif
+        logger.reset(system.initialTick); // reset here to persist the data when we do seamless transition
+        logger.registerNewTx(system.tick, logger.SC_INITIALIZE_TX);
+        runContractProcessor(INITIALIZE);
+
+        logger.registerNewTx(system.tick, logger.SC_BEGIN_EPOCH_TX);
+        runContractProcessor(BEGIN_EPOCH);
+    }
+
+    logger.registerNewTx(system.tick, logger.SC_BEGIN_TICK_TX);
+    runContractProcessor(BEGIN_TICK);
+}
+
+// Score the solutions of tick system.tick and process all its transactions
+static void processTickTransactions(unsigned long long processorNumber)
+{
+    unsigned int tickIndex = ts.tickToIndexCurrentEpoch(system.tick);
+    ts.tickData.acquireLock();
+    copyMem(&nextTickData, &ts.tickData[tickIndex], sizeof(TickData));
+    ts.tickData.releaseLock();
+    unsigned long long solutionProcessStartTick = __rdtsc(); // for tracking the time processing solutions
+    if (nextTickData.epoch == system.epoch)
+    {
+        auto* tsCurrentTickTransactionOffsets = ts.tickTransactionOffsets.getByTickIndex(tickIndex);
+#if ADDON_TX_STATUS_REQUEST
+        txStatusData.tickTxIndexStart[system.tick - system.initialTick] = numberOfTransactions; // qli: part of tx_status_request add-on
+#endif
+        // reset solution task queue
+        score->resetTaskQueue();
+        // pre-scan any solution tx and add them to solution task queue
+        for (unsigned int transactionIndex = 0; transactionIndex < NUMBER_OF_TRANSACTIONS_PER_TICK; transactionIndex++)
+        {
+            if (!isZero(nextTickData.transactionDigests[transactionIndex]))
+            {
+                if (tsCurrentTickTransactionOffsets[transactionIndex])
+                {
+                    Transaction* transaction = ts.tickTransactions(tsCurrentTickTransactionOffsets[transactionIndex]);
+                    ASSERT(transaction->checkValidity());
+                    ASSERT(transaction->tick == system.tick);
+                    addSolutionTask(transaction, score->CurrentTickTask);
+                }
+            }
+        }
+
+        {
+            // Process solutions in this tick and store in cache. In parallel, score->tryProcessSolution() is called by
+            // request processors to speed up solution processing. The tick processor does not take prefetch tasks,
+            // because it would have to wait for them.
+            score->startProcessTaskQueue();
+            while (!score->isTaskQueueProcessed())
+            {
+                score->tryProcessSolution(processorNumber, score->CurrentTickTask);
+            }
+            score->stopProcessTaskQueue();
+        }
+        solutionTotalExecutionTicks = __rdtsc() - solutionProcessStartTick; // for tracking the time processing solutions
+
+        // Process all transaction of the tick
+        for (unsigned int transactionIndex = 0; transactionIndex < NUMBER_OF_TRANSACTIONS_PER_TICK; transactionIndex++)
+        {
+            if (!isZero(nextTickData.transactionDigests[transactionIndex]))
+            {
+                if (tsCurrentTickTransactionOffsets[transactionIndex])
+                {
+                    Transaction* transaction = ts.tickTransactions(tsCurrentTickTransactionOffsets[transactionIndex]);
+                    if (isSpeculativeExecutionCandidate(transaction))
+                    {
+                        // Collect consecutive contract procedure transactions for executing them in parallel
+                        speculativeBatch.transactionIndices[speculativeBatch.numberOfTransactions] = (unsigned short)transactionIndex;
+                        speculativeBatch.transactions[speculativeBatch.numberOfTransactions] = transaction;
+                        speculativeBatch.numberOfTransactions++;
+                        continue;
+                    }
+                    processSpeculativeBatch(processorNumber);
+
+                    logger.registerNewTx(transaction->tick, transactionIndex);
+                    processTickTransaction(transaction, nextTickData.transactionDigests[transactionIndex], processorNumber);
+                }
+                else
+                {
+                    while (true)
+                    {
+                        criticalSituation = 1;
+                    }
+                }
+            }
+        }
+        processSpeculativeBatch(processorNumber);
+
+#if ENTITY_TX_HISTORY
+        // Index source and destination of all transactions of the tick (after execution, so new entities are in spectrum)
+        entityTxHistory.beginTick(system.tick, spectrumReorgCount);
+        for (unsigned int transactionIndex = 0; transactionIndex < NUMBER_OF_TRANSACTIONS_PER_TICK; transactionIndex++)
+        {
+            if (!isZero(nextTickData.transactionDigests[transactionIndex]) && tsCurrentTickTransactionOffsets[transactionIndex])
+            {
+                const Transaction* transaction = ts.tickTransactions(tsCurrentTickTransactionOffsets[transactionIndex]);
+                entityTxHistory.addTransaction(system.tick, (unsigned short)transactionIndex,
+                    spectrumIndex(transaction->sourcePublicKey), spectrumIndex(transaction->destinationPublicKey));
+            }
+        }
+#endif
+    }
+#if ENTITY_TX_HISTORY
+    else
+    {
+        entityTxHistory.beginTick(system.tick, spectrumReorgCount);
+    }
+    entityTxHistory.endTick(system.tick);
+#endif
+}
+
+// Run the system procedures at the end of tick system.tick and update the entity category populations
+static void endTick()
+{
+    logger.registerNewTx(system.tick, logger.SC_END_TICK_TX);
+    runContractProcessor(END_TICK);
+
+#ifndef NDEBUG
+    // Check that continous updating of spectrum info is consistent with counting from scratch
+    SpectrumInfo si;
+    updateSpectrumInfo(si);
+    if (si.numberOfEntities != spectrumInfo.numberOfEntities || si.totalAmount != spectrumInfo.totalAmount)
+    {
+        addDebugMessage(L"BUG DETECTED: Spectrum info of continuous updating is inconsistent with counting from scratch!");
+    }
+#endif
+
+    // Update entity category populations and dust thresholds each 8 ticks
+    if ((system.tick & 7) == 0)
+        updateAndAnalzeEntityCategoryPopulations();
+}
+
+// Update the digests of spectrum, universe and computer after processing tick system.tick
+static void updateTickDigests()
+{
+    unsigned int digestIndex;
+    ACQUIRE(spectrumLock);
+    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
+    {
+        if (spectrum[digestIndex].latestIncomingTransferTick == system.tick || spectrum[digestIndex].latestOutgoingTransferTick == system.tick)
+        {
+            StateSnapshot::beforeWrite(&spectrumDigests[digestIndex], 32);
+            KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
+            spectrumChangeFlags[digestIndex >> 6] |= (1ULL << (digestIndex & 63));
+        }
+    }
+    unsigned int previousLevelBeginning = 0;
+    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
+    while (numberOfLeafs > 1)
+    {
+        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+        {
+            if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
+            {
+                StateSnapshot::beforeWrite(&spectrumDigests[digestIndex], 32);
+                KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex]);
+                spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
+                spectrumChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
+            }
+            digestIndex++;
+        }
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+    spectrumChangeFlags[0] = 0;
+    spectrumDigestsTick = system.tick;
+
+    etalonTick.saltedSpectrumDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
+    RELEASE(spectrumLock);
+
+    getUniverseDigest(etalonTick.saltedUniverseDigest);
+    getComputerDigest(etalonTick.saltedComputerDigest);
+}
+
+// Check if the time of etalonTick has reached the end of epoch system.epoch, which starts the epoch transition
+static bool isEpochEndReached()
+{
+    const int dayIndex = ::dayIndex(etalonTick.year, etalonTick.month, etalonTick.day);
+    return (dayIndex == 738570 + system.epoch * 7 && etalonTick.hour >= 12)
+        || dayIndex > 738570 + system.epoch * 7;
+}
+
+// Advance etalonTick to the tick after system.tick. The time is taken from the tick data of system.tick if it is
+// later, otherwise it is increased by 1 millisecond.
+static void advanceEtalonTick()
+{
+    etalonTick.tick++;
+    ts.tickData.acquireLock();
+    const TickData& td = ts.tickData[ts.tickToIndexCurrentEpoch(system.tick)];
+    if (td.epoch == system.epoch
+        && (td.year > etalonTick.year
+            || (td.year == etalonTick.year && (td.month > etalonTick.month
+                || (td.month == etalonTick.month && (td.day > etalonTick.day
+                    || (td.day == etalonTick.day && (td.hour > etalonTick.hour
+                        || (td.hour == etalonTick.hour && (td.minute > etalonTick.minute
+                            || (td.minute == etalonTick.minute && (td.second > etalonTick.second
+                                || (td.second == etalonTick.second && td.millisecond > etalonTick.millisecond)))))))))))))
+    {
+        etalonTick.millisecond = td.millisecond;
+        etalonTick.second = td.second;
+        etalonTick.minute = td.minute;
+        etalonTick.hour = td.hour;
+        etalonTick.day = td.day;
+        etalonTick.month = td.month;
+        etalonTick.year = td.year;
+    }
+    else
+    {
+        if (++etalonTick.millisecond > 999)
+        {
+            etalonTick.millisecond = 0;
+
+            if (++etalonTick.second > 59)
+            {
+                etalonTick.second = 0;
+
+                if (++etalonTick.minute > 59)
+                {
+                    etalonTick.minute = 0;
+
+                    if (++etalonTick.hour > 23)
+                    {
+                        etalonTick.hour = 0;
+
+                        if (++etalonTick.day > ((etalonTick.month == 1 || etalonTick.month == 3 || etalonTick.month == 5 || etalonTick.month == 7 || etalonTick.month == 8 || etalonTick.month == 10 || etalonTick.month == 12) ? 31 : ((etalonTick.month == 4 || etalonTick.month == 6 || etalonTick.month == 9 || etalonTick.month == 11) ? 30 : ((etalonTick.year & 3) ? 28 : 29))))
+                        {
+                            etalonTick.day = 1;
+
+                            if (++etalonTick.month > 12)
+                            {
+                                etalonTick.month = 1;
+
+                                ++etalonTick.year;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    ts.tickData.releaseLock();
+}
+
+// Copy the states of the tick processing that are not saved in their own files to buffer
+static void saveTickProcessingStates(NodeStateBuffer& buffer)
+{
+    copyMem(&buffer.etalonTick, &etalonTick, sizeof(etalonTick));
+    minerScores.getRanking(buffer.minerPublicKeys, buffer.minerScores);
+    copyMem(buffer.competitorPublicKeys, (void*)competitorPublicKeys, sizeof(competitorPublicKeys));
+    copyMem(buffer.competitorScores, (void*)competitorScores, sizeof(competitorScores));
+    copyMem(buffer.competitorComputorStatuses, (void*)competitorComputorStatuses, sizeof(competitorComputorStatuses));
+    copyMem(buffer.solutionPublicationTicks, (void*)solutionPublicationTicks, sizeof(solutionPublicationTicks));
+    copyMem(&buffer.broadcastedComputors, (void*)&broadcastedComputors, sizeof(broadcastedComputors));
+    copyMem(&buffer.resourceTestingDigest, &resourceTestingDigest, sizeof(resourceTestingDigest));
+    buffer.currentRandomSeed = score->currentRandomSeed;
+    buffer.numberOfMiners = minerScores.numberOfMiners();
+    buffer.numberOfTransactions = numberOfTransactions;
+    buffer.lastLogId = logger.logId;
+    voteCounter.saveAllDataToArray(buffer.voteCounterData);
+}
+
+// Restore the states saved by saveTickProcessingStates(), except for the mining seed, which is set by the caller
+static void loadTickProcessingStates(const NodeStateBuffer& buffer)
+{
+    copyMem(&etalonTick, &buffer.etalonTick, sizeof(etalonTick));
+    minerScores.setRanking(buffer.minerPublicKeys, buffer.minerScores, buffer.numberOfMiners);
+    copyMem((void*)competitorPublicKeys, buffer.competitorPublicKeys, sizeof(competitorPublicKeys));
+    copyMem((void*)competitorScores, buffer.competitorScores, sizeof(competitorScores));
+    copyMem((void*)competitorComputorStatuses, buffer.competitorComputorStatuses, sizeof(competitorComputorStatuses));
+    copyMem((void*)solutionPublicationTicks, buffer.solutionPublicationTicks, sizeof(solutionPublicationTicks));
+    copyMem((void*)&broadcastedComputors, &buffer.broadcastedComputors, sizeof(broadcastedComputors));
+    copyMem(&resourceTestingDigest, &buffer.resourceTestingDigest, sizeof(resourceTestingDigest));
+    numberOfTransactions = buffer.numberOfTransactions;
+    logger.logId = buffer.lastLogId;
+    voteCounter.loadAllDataFromArray(buffer.voteCounterData);
+}
+
+#if TICK_STORAGE_AUTOSAVE_MODE
+static NodeStateBuffer nodeStateBuffer;
+
+// Define the regions of the node states snapshot. The order has to be the same for saving and loading, because the
+// records of delta snapshots refer to the regions by index. Used by the node and by tools/tick_replay.
+static bool addNodeStateSnapshotRegions(System* systemData)
+{
+    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 4] = L'0';
+    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 3] = L'0';
+    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 2] = L'0';
+    bool ok = StateSnapshot::addRegion(spectrum, spectrumSizeInBytes, SPECTRUM_FILE_NAME);
+
+    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 4] = L'0';
+    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 3] = L'0';
+    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 2] = L'0';
+    ok = ok && StateSnapshot::addRegion(assets, universeSizeInBytes, UNIVERSE_FILE_NAME);
+
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 4] = L'0';
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 3] = L'0';
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 2] = L'0';
+    for (unsigned int contractIndex = 0; contractIndex < contractCount && ok; contractIndex++)
+    {
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 9] = contractIndex / 1000 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 8] = (contractIndex % 1000) / 100 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 7] = (contractIndex % 100) / 10 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 6] = contractIndex % 10 + L'0';
+        ok = StateSnapshot::addRegion(contractStates[contractIndex], contractDescriptions[contractIndex].stateSize, CONTRACT_FILE_NAME);
+    }
+
+    // system and node state buffer are copied before each cut, so they are not tracked by beforeWrite()
+    ok = ok && StateSnapshot::addRegion(systemData, sizeof(System), L"system.snp", true);
+    ok = ok && StateSnapshot::addRegion(&nodeStateBuffer, sizeof(nodeStateBuffer), L"snapshotNodeMiningState", true);
+    ok = ok && StateSnapshot::addRegion(spectrumDigests, spectrumDigestsSizeInByte, L"snapshotSpectrumDigest");
+    ok = ok && StateSnapshot::addRegion(assetDigests, assetDigestsSizeInBytes, L"snapshotUniverseDigest");
+    ok = ok && StateSnapshot::addRegion(contractStateDigests, contractStateDigestsSizeInBytes, L"snapshotComputerDigest");
+    ok = ok && StateSnapshot::addRegion(minerSolutionFlags, NUMBER_OF_MINER_SOLUTION_FLAGS / 8, L"snapshotMinerSolutionFlag");
+    return ok;
+}
+#endif
@@ -8,6 +8,8 @@
 #include "platform/console_logging.h"
 #include "platform/debugging.h"
 
+#include "compressed_file_io.h"
+
 #include "public_settings.h"
 
 #if TICK_STORAGE_AUTOSAVE_MODE
@@ -17,6 +19,7 @@ static unsigned short SNAPSHOT_TICKS_FILE_NAME[] = L"snapshotTicks.???";
 static unsigned short SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME[] = L"snapshotTickTransactionOffsets.???";
 static unsigned short SNAPSHOT_TRANSACTIONS_FILE_NAME[] = L"snapshotTickTransaction.???";
 #endif
+
 // Encapsulated tick storage of current epoch that can additionally keep the last ticks of the previous epoch.
 // The number of ticks to keep from the previous epoch is TICKS_TO_KEEP_FROM_PRIOR_EPOCH (defined in public_settings.h).
 //
@@ -50,6 +53,22 @@ private:
     static constexpr unsigned long long tickTransactionOffsetsSizePreviousEpoch = tickTransactionOffsetsLengthPreviousEpoch * sizeof(unsigned long long);
     static constexpr unsigned long long tickTransactionOffsetsSize = tickTransactionOffsetsLength * sizeof(unsigned long long);
 
+    // Number of one-byte tags compared at once when probing the transaction digest hash map
+#if defined (__AVX512F__)
+    static constexpr unsigned long long transactionsDigestTagGroupSize = 64;
+#elif defined(__AVX2__)
+    static constexpr unsigned long long transactionsDigestTagGroupSize = 32;
+#else
+    static constexpr unsigned long long transactionsDigestTagGroupSize = 16;
+#endif
+
+    // Capacity of the transaction digest hash map. Every transaction slot of the tick storage fits without exceeding the max
+    // load factor of 15/16, so insertTransaction() never drops a digest. To save memory, the capacity is not rounded up to a
+    // power of two (the home slot is computed by multiply-shift instead of masking).
+    static constexpr unsigned long long transactionsDigestMapCapacity = (tickTransactionOffsetsLength + tickTransactionOffsetsLength / 15 + transactionsDigestTagGroupSize) / transactionsDigestTagGroupSize * transactionsDigestTagGroupSize;
+    static constexpr unsigned long long transactionsDigestMapMaxEntries = transactionsDigestMapCapacity - transactionsDigestMapCapacity / 16;
+    static_assert(transactionsDigestMapMaxEntries >= tickTransactionOffsetsLength, "Transaction digest hash map cannot hold all transactions");
+
 
     // Tick number range of current epoch storage
     inline static unsigned int tickBegin = 0;
@@ -83,9 +102,16 @@ private:
     // Tick transaction offsets of previous epoch. Points to tickTransactionOffsetsPtr + tickTransactionOffsetsLengthCurrentEpoch.
     inline static unsigned long long* oldTickTransactionOffsetsPtr = nullptr;
 
-    // Allocated transaction access digest buffer with current epoch transactions.
+    // Allocated transaction digest hash map with transactionsDigestMapCapacity entries (includes current and previous epoch data)
     inline static unsigned char* tickTransactionsDigestPtr = nullptr;
 
+    // Allocated tags of transaction digest hash map with transactionsDigestMapCapacity + transactionsDigestTagGroupSize bytes.
+    // The first group of tags is mirrored at the end, so a group starting at any slot can be loaded without wrap-around.
+    inline static unsigned char* tickTransactionsDigestTagsPtr = nullptr;
+
+    // Number of entries in transaction digest hash map
+    inline static unsigned long long tickTransactionsDigestCount = 0;
+
     // Lock for securing tickData
     inline static volatile char tickDataLock = 0;
 
@@ -137,7 +163,7 @@ private:
     bool saveTickData(unsigned long long nTick, CHAR16* directory = NULL)
     {
         long long totalWriteSize = nTick * sizeof(TickData);
-        auto sz = saveLargeFile(SNAPSHOT_TICK_DATA_FILE_NAME, totalWriteSize, (unsigned char*)tickDataPtr, directory);
+        auto sz = saveStateFile(SNAPSHOT_TICK_DATA_FILE_NAME, totalWriteSize, (unsigned char*)tickDataPtr, sizeof(TickData), directory, true);
         if (sz != totalWriteSize)
         {
             return false;
@@ -147,7 +173,7 @@ private:
     bool saveTicks(unsigned long long nTick, CHAR16* directory = NULL)
     {
         long long totalWriteSize = nTick * sizeof(Tick) * NUMBER_OF_COMPUTORS;
-        auto sz = saveLargeFile(SNAPSHOT_TICKS_FILE_NAME, totalWriteSize, (unsigned char*)ticksPtr, directory);
+        auto sz = saveStateFile(SNAPSHOT_TICKS_FILE_NAME, totalWriteSize, (unsigned char*)ticksPtr, sizeof(Tick), directory, true);
         if (sz != totalWriteSize)
         {
             return false;
@@ -157,7 +183,7 @@ private:
     bool saveTickTransactionOffsets(unsigned long long nTick, CHAR16* directory = NULL)
     {
         long long totalWriteSize = nTick * sizeof(tickTransactionOffsetsPtr[0]) * NUMBER_OF_TRANSACTIONS_PER_TICK;
-        auto sz = saveLargeFile(SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME, totalWriteSize, (unsigned char*)tickTransactionOffsetsPtr, directory);
+        auto sz = saveStateFile(SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME, totalWriteSize, (unsigned char*)tickTransactionOffsetsPtr, sizeof(tickTransactionOffsetsPtr[0]), directory, true);
         if (sz != totalWriteSize)
         {
             return false;
@@ -197,7 +223,7 @@ private:
         // saving from the first tx of from tick to the last tx of (totick)
         long long totalWriteSize = toPtr;
         unsigned char* ptr = tickTransactionsPtr;
-        auto sz = saveLargeFile(SNAPSHOT_TRANSACTIONS_FILE_NAME, totalWriteSize, (unsigned char*)ptr, directory);
+        auto sz = saveStateFile(SNAPSHOT_TRANSACTIONS_FILE_NAME, totalWriteSize, (unsigned char*)ptr, 0, directory, true);
         if (sz != totalWriteSize)
         {
             outTotalTransactionSize = -1;
@@ -237,7 +263,7 @@ private:
     bool loadTickData(unsigned long long nTick, CHAR16* directory = NULL)
     {
         long long totalLoadSize = nTick * sizeof(TickData);
-        auto sz = loadLargeFile(SNAPSHOT_TICK_DATA_FILE_NAME, totalLoadSize, (unsigned char*)tickDataPtr, directory);
+        auto sz = loadStateFile(SNAPSHOT_TICK_DATA_FILE_NAME, totalLoadSize, (unsigned char*)tickDataPtr, directory, true);
         if (sz != totalLoadSize)
         {
             return false;
@@ -247,7 +273,7 @@ private:
     bool loadTicks(unsigned long long nTick, CHAR16* directory = NULL)
     {
         long long totalLoadSize = nTick * sizeof(Tick) * NUMBER_OF_COMPUTORS;
-        auto sz = loadLargeFile(SNAPSHOT_TICKS_FILE_NAME, totalLoadSize, (unsigned char*)ticksPtr, directory);
+        auto sz = loadStateFile(SNAPSHOT_TICKS_FILE_NAME, totalLoadSize, (unsigned char*)ticksPtr, directory, true);
         if (sz != totalLoadSize)
         {
             return false;
@@ -257,7 +283,7 @@ private:
     bool loadTickTransactionOffsets(unsigned long long nTick, CHAR16* directory = NULL)
     {
         long long totalLoadSize = nTick * sizeof(tickTransactionOffsetsPtr[0]) * NUMBER_OF_TRANSACTIONS_PER_TICK;
-        auto sz = loadLargeFile(SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME, totalLoadSize, (unsigned char*)tickTransactionOffsetsPtr, directory);
+        auto sz = loadStateFile(SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME, totalLoadSize, (unsigned char*)tickTransactionOffsetsPtr, directory, true);
         if (sz != totalLoadSize)
         {
             return false;
@@ -267,7 +293,7 @@ private:
     bool loadTransactions(unsigned long long nTick, unsigned long long totalLoadSize, CHAR16* directory = NULL)
     {
         unsigned char* ptr = tickTransactionsPtr;
-        auto sz = loadLargeFile(SNAPSHOT_TRANSACTIONS_FILE_NAME, totalLoadSize, (unsigned char*)ptr, directory);
+        auto sz = loadStateFile(SNAPSHOT_TRANSACTIONS_FILE_NAME, totalLoadSize, (unsigned char*)ptr, directory, true);
         if (sz != totalLoadSize)
         {
             return false;
@@ -446,7 +472,8 @@ public:
             || !allocatePool(ticksSize, (void**)&ticksPtr)
             || !allocatePool(tickTransactionsSize, (void**)&tickTransactionsPtr)
             || !allocatePool(tickTransactionOffsetsSize, (void**)&tickTransactionOffsetsPtr)
-            || !allocatePool(tickTransactionOffsetsLengthCurrentEpoch * sizeof(TransactionsDigestAccess::HashMapEntry), (void**)&tickTransactionsDigestPtr))
+            || !allocatePool(transactionsDigestMapCapacity * sizeof(TransactionsDigestAccess::HashMapEntry), (void**)&tickTransactionsDigestPtr)
+            || !allocatePool(transactionsDigestMapCapacity + transactionsDigestTagGroupSize, (void**)&tickTransactionsDigestTagsPtr))
         {
             logToConsole(L"Failed to allocate tick storage memory!");
             return false;
@@ -467,7 +494,7 @@ public:
         oldTickBegin = 0;
         oldTickEnd = 0;
 
-        setMem((void*)tickTransactionsDigestPtr, tickTransactionOffsetsLengthCurrentEpoch * sizeof(TransactionsDigestAccess::HashMapEntry), 0);
+        TransactionsDigestAccess::clear();
 
         return true;
     }
@@ -499,6 +526,11 @@ public:
         {
             freePool(tickTransactionsDigestPtr);
         }
+
+        if (tickTransactionsDigestTagsPtr)
+        {
+            freePool(tickTransactionsDigestTagsPtr);
+        }
     }
 
     // Begin new epoch. If not called the first time (seamless transition), assume that the ticks to keep
@@ -583,6 +615,23 @@ public:
                 }
             }
 
+            // rebuild digest hash map with kept transactions (dropping all others without leaving tombstones)
+            TransactionsDigestAccess::acquireLock();
+            TransactionsDigestAccess::clear();
+            for (unsigned int tickId = oldTickBegin; tickId < oldTickEnd; ++tickId)
+            {
+                const TickData& tickDataPrevEp = TickDataAccess::getByTickInPreviousEpoch(tickId);
+                const unsigned long long* tickOffsetsPrevEp = TickTransactionOffsetsAccess::getByTickInPreviousEpoch(tickId);
+                for (unsigned int transactionIdx = 0; transactionIdx < NUMBER_OF_TRANSACTIONS_PER_TICK; ++transactionIdx)
+                {
+                    if (tickOffsetsPrevEp[transactionIdx])
+                    {
+                        TransactionsDigestAccess::insertTransaction(tickDataPrevEp.transactionDigests[transactionIdx], TickTransactionsAccess::ptr(tickOffsetsPrevEp[transactionIdx]));
+                    }
+                }
+            }
+            TransactionsDigestAccess::releaseLock();
+
             // reset data storage of new epoch
             setMem(tickDataPtr, MAX_NUMBER_OF_TICKS_PER_EPOCH * sizeof(TickData), 0);
             setMem(ticksPtr, ticksLengthCurrentEpoch * sizeof(Tick), 0);
@@ -598,6 +647,10 @@ public:
             setMem(tickTransactionsPtr, tickTransactionsSize, 0);
             oldTickBegin = 0;
             oldTickEnd = 0;
+
+            TransactionsDigestAccess::acquireLock();
+            TransactionsDigestAccess::clear();
+            TransactionsDigestAccess::releaseLock();
         }
 
         tickBegin = newInitialTick;
@@ -916,6 +969,20 @@ public:
             return getByTickIndex(tickIndex);
         }
 
+        // Return pointer to offset array of transactions of tick in current or previous epoch, or NULL if tick isn't stored
+        inline static unsigned long long* getByTickIfStored(unsigned int tick)
+        {
+            if (tickInCurrentEpochStorage(tick))
+            {
+                return getByTickInCurrentEpoch(tick);
+            }
+            if (tickInPreviousEpochStorage(tick))
+            {
+                return getByTickInPreviousEpoch(tick);
+            }
+            return NULL;
+        }
+
         // Return reference to offset by tick and transaction in current epoch (checking inputs with ASSERT)
         inline unsigned long long& operator()(unsigned int tick, unsigned int transaction)
         {
@@ -957,7 +1024,10 @@ public:
         }
     } tickTransactions;
 
-    // Struct for access the transaction using its digest. It contains the offset in tickTransactionsPtr
+    // Struct for access the transaction using its digest. Open addressing hash map with power-of-two capacity and linear
+    // probing. Each slot has a one-byte tag in a separate array (0 = empty, otherwise 0x80 | 7 bits of the digest), so a
+    // whole group of slots is checked with one SIMD compare and digests are only compared if the tag matches.
+    // Entries are never removed individually. The map is rebuilt in beginEpoch() with the transactions of the ticks kept.
     struct TransactionsDigestAccess
     {
         inline static void acquireLock()
@@ -972,15 +1042,110 @@ public:
 
         struct HashMapEntry
         {
-            m256i digest; // isZero mean not occupied
+            m256i digest;
             const Transaction* transaction;
         };
-        unsigned long long hashFunc(const m256i& digest)
+
+        // Map digest to home slot in [0, transactionsDigestMapCapacity)
+        inline static unsigned long long hashFunc(const m256i& digest)
+        {
+            unsigned long long slot;
+            _umul128(digest.m256i_u64[0], transactionsDigestMapCapacity, &slot);
+            return slot;
+        }
+
+        inline static unsigned long long wrapIndex(unsigned long long index)
+        {
+            return (index >= transactionsDigestMapCapacity) ? index - transactionsDigestMapCapacity : index;
+        }
+
+        inline static unsigned char tagFunc(const m256i& digest)
+        {
+            return 0x80 | digest.m256i_u8[31];
+        }
+
+        // Get bit masks of slots with matching tag and of empty slots in group of transactionsDigestTagGroupSize slots starting at index
+        inline static void matchTagGroup(unsigned long long index, unsigned char tag, unsigned long long& tagMask, unsigned long long& emptyMask)
+        {
+            const unsigned char* tags = tickTransactionsDigestTagsPtr + index;
+#if defined (__AVX512F__)
+            const __m512i tags512 = _mm512_loadu_si512((const __m512i*)tags);
+            tagMask = _mm512_cmpeq_epi8_mask(tags512, _mm512_set1_epi8(tag));
+            emptyMask = _mm512_cmpeq_epi8_mask(tags512, _mm512_setzero_si512());
+#elif defined(__AVX2__)
+            const __m256i tags256 = _mm256_loadu_si256((const __m256i*)tags);
+            tagMask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(tags256, _mm256_set1_epi8(tag)));
+            emptyMask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(tags256, _mm256_setzero_si256()));
+#else
+            tagMask = 0;
+            emptyMask = 0;
+            for (unsigned int i = 0; i < transactionsDigestTagGroupSize; ++i)
+            {
+                tagMask |= (unsigned long long)(tags[i] == tag) << i;
+                emptyMask |= (unsigned long long)(tags[i] == 0) << i;
+            }
+#endif
+        }
+
+        // Find slot of digest or, if not found, first empty slot of probe sequence. Returns false if neither has been found.
+        inline static bool findSlot(const m256i& digest, unsigned long long& slot, bool& found)
+        {
+            const HashMapEntry* pHashMap = (const HashMapEntry*)tickTransactionsDigestPtr;
+            const unsigned char tag = tagFunc(digest);
+            unsigned long long index = hashFunc(digest);
+            for (unsigned long long probed = 0; probed < transactionsDigestMapCapacity; probed += transactionsDigestTagGroupSize)
+            {
+                unsigned long long tagMask, emptyMask;
+                matchTagGroup(index, tag, tagMask, emptyMask);
+
+                // only slots before the first empty slot belong to the probe sequence
+                if (emptyMask)
+                {
+                    tagMask &= (emptyMask & (0 - emptyMask)) - 1;
+                }
+                while (tagMask)
+                {
+                    const unsigned long long candidate = wrapIndex(index + _tzcnt_u64(tagMask));
+                    if (pHashMap[candidate].digest == digest)
+                    {
+                        slot = candidate;
+                        found = true;
+                        return true;
+                    }
+                    tagMask &= tagMask - 1;
+                }
+                if (emptyMask)
+                {
+                    slot = wrapIndex(index + _tzcnt_u64(emptyMask));
+                    found = false;
+                    return true;
+                }
+                index = wrapIndex(index + transactionsDigestTagGroupSize);
+            }
+            return false;
+        }
+
+        // Remove all entries
+        inline static void clear()
+        {
+            setMem(tickTransactionsDigestTagsPtr, transactionsDigestMapCapacity + transactionsDigestTagGroupSize, 0);
+            tickTransactionsDigestCount = 0;
+        }
+
+        // Number of entries (for testing and monitoring)
+        inline static unsigned long long population()
+        {
+            return tickTransactionsDigestCount;
+        }
+
+        // Number of slots
+        inline static constexpr unsigned long long capacity()
         {
-            return digest.m256i_u32[7] % tickTransactionOffsetsLengthCurrentEpoch;
+            return transactionsDigestMapCapacity;
         }
 
-        void insertTransaction(const m256i& digest, const Transaction* transaction)
+        // Insert transaction. Caller needs to hold lock.
+        inline static void insertTransaction(const m256i& digest, const Transaction* transaction)
         {
             // Zero digest. No further process
             if (isZero(digest))
@@ -988,24 +1153,34 @@ public:
                 return;
             }
 
+            // Keep empty slots, so probe sequences stay short and terminate
+            if (tickTransactionsDigestCount >= transactionsDigestMapMaxEntries)
+            {
+                return;
+            }
+
+            unsigned long long slot;
+            bool found;
+            if (!findSlot(digest, slot, found) || found)
+            {
+                return;
+            }
+
+            // Write entry before tag (volatile store), because findTransaction() does not acquire the lock
             HashMapEntry* pHashMap = (HashMapEntry*)tickTransactionsDigestPtr;
-            unsigned long long index = hashFunc(digest);
-            unsigned long long original_index = index;
-            // TODO: check alraeady added tx ?
-            while (!isZero(pHashMap[index].digest))
+            pHashMap[slot].transaction = transaction;
+            pHashMap[slot].digest = digest;
+            volatile unsigned char* tags = tickTransactionsDigestTagsPtr;
+            const unsigned char tag = tagFunc(digest);
+            tags[slot] = tag;
+            if (slot < transactionsDigestTagGroupSize)
             {
-                index = (index + 1) % tickTransactionOffsetsLengthCurrentEpoch;
-                if (index == original_index)
-                {
-                    // Don't have enough place in the table
-                    return;
-                }
+                tags[transactionsDigestMapCapacity + slot] = tag;
             }
-            pHashMap[index].transaction = transaction;
-            pHashMap[index].digest = digest;
+            ++tickTransactionsDigestCount;
         }
 
-        const Transaction* findTransaction(const m256i& digest)
+        inline static const Transaction* findTransaction(const m256i& digest)
         {
             // Zero digest. No further process
             if (isZero(digest))
@@ -1013,22 +1188,13 @@ public:
                 return NULL;
             }
 
-            HashMapEntry* pHashMap = (HashMapEntry*)tickTransactionsDigestPtr;
-            unsigned long long index = hashFunc(digest);
-            unsigned long long original_index = index;
-            while (!isZero(pHashMap[index].digest))
+            unsigned long long slot;
+            bool found;
+            if (!findSlot(digest, slot, found) || !found)
             {
-                if (pHashMap[index].digest == digest)
-                {
-                    return pHashMap[index].transaction;
-                }
-                index = (index + 1) % tickTransactionOffsetsLengthCurrentEpoch;
-                if (index == original_index)
-                {
-                    break;
-                }
+                return NULL;
             }
-            return NULL;
+            return ((const HashMapEntry*)tickTransactionsDigestPtr)[slot].transaction;
         }
     } transactionsDigestAccess;
 };
@@ -0,0 +1,379 @@
+#pragma once
+
+#include "network_messages/header.h"
+#include "network_messages/common_response.h"
+#include "network_messages/tick.h"
+#include "network_messages/transactions.h"
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+
+#include "kangaroo_twelve.h"
+#include "four_q.h"
+#include "system.h"
+#include "tick_storage.h"
+#include "tick_validation.h"
+
+// Catching up is driven by the main loop, which pipelines up to TICK_SYNC_NUMBER_OF_PIPELINED_REQUESTS RequestTickRange
+// messages to random peers if verified votes show that the node lags at least TICK_SYNC_MIN_LAG ticks behind.
+// If the node makes no progress within TICK_SYNC_STALL_ROUNDS request rounds, the windows are requested again.
+#define TICK_SYNC_MIN_LAG 3
+#define TICK_SYNC_NUMBER_OF_PIPELINED_REQUESTS 4
+#define TICK_SYNC_STALL_ROUNDS 4
+
+// Max size of RespondTickRange payload following the struct
+#define TICK_SYNC_MAX_TICK_SIZE (NUMBER_OF_COMPUTORS * sizeof(Tick) + sizeof(TickData) + NUMBER_OF_TRANSACTIONS_PER_TICK * MAX_TRANSACTION_SIZE)
+
+// Max payload size of RespondTickTransactionBundle
+#define TICK_TRANSACTION_BUNDLE_MAX_SIZE (sizeof(RespondTickTransactionBundle) + NUMBER_OF_TRANSACTIONS_PER_TICK * MAX_TRANSACTION_SIZE)
+
+// Range-based sync of quorum votes, tick data, and transactions for fast catch-up of lagging nodes.
+//
+// The serving side reads directly from tick storage and sends one RespondTickRange per tick. The receiving side verifies and
+// stores the content of each RespondTickRange independently, so the ticks of a range are verified in parallel by the request
+// processors. Votes and tick data are validated like broadcasted ones (see tick_validation.h). Data is only added to empty slots
+// of the tick storage, computors that sent data conflicting with stored data are marked as faulty.
+//
+// Peer and enqueueResponse() have to be declared before including this file.
+class TickSync
+{
+    inline static TickStorage ts; // singleton with static members only, refers to the same data as all other instances
+
+    inline static volatile unsigned int latestKnownTick = 0;
+    inline static unsigned int nextRequestedTick = 0;
+    inline static unsigned int tickOfLastRound = 0;
+    inline static unsigned int stalledRounds = 0;
+
+    static bool storeVote(Tick* vote, unsigned int tick, const m256i* computorPublicKeys)
+    {
+        if (vote->tick != tick || !isValidVote(vote, computorPublicKeys))
+        {
+            return false;
+        }
+
+        ts.ticks.acquireLock(vote->computorIndex);
+        Tick* tsTick = ts.ticks.getByTickInCurrentEpoch(tick) + vote->computorIndex;
+        if (tsTick->epoch == system.epoch)
+        {
+            checkVoteConflict(*vote, *tsTick);
+        }
+        else
+        {
+            copyMem(tsTick, vote, sizeof(Tick));
+        }
+        ts.ticks.releaseLock(vote->computorIndex);
+        return true;
+    }
+
+    static bool storeTickData(TickData* tickData, unsigned int tick, const m256i* computorPublicKeys)
+    {
+        // tick data of next tick may be subject to quorum decision, leave it to regular requests
+        if (tickData->tick != tick || tick <= system.tick + 1 || !isValidTickData(tickData, computorPublicKeys))
+        {
+            return false;
+        }
+
+        ts.tickData.acquireLock();
+        TickData& td = ts.tickData.getByTickInCurrentEpoch(tick);
+        if (td.epoch == system.epoch)
+        {
+            checkTickDataConflict(*tickData, td);
+        }
+        else if (!td.epoch)
+        {
+            copyMem(&td, tickData, sizeof(TickData));
+        }
+        ts.tickData.releaseLock();
+        return true;
+    }
+
+    // Store transaction if it is listed in stored tick data of tick
+    static bool storeTransaction(const Transaction* transaction, unsigned int tick)
+    {
+        const unsigned int transactionSize = transaction->totalSize();
+        unsigned char signedDigest[32];
+        KangarooTwelve(transaction, transactionSize - SIGNATURE_SIZE, signedDigest, sizeof(signedDigest));
+        if (!verify(transaction->sourcePublicKey.m256i_u8, signedDigest, ((const unsigned char*)transaction) + transactionSize - SIGNATURE_SIZE))
+        {
+            return false;
+        }
+        m256i digest;
+        KangarooTwelve(transaction, transactionSize, &digest, sizeof(digest));
+
+        // hold lock of tick data until transaction is stored, so the tick data cannot change in between
+        bool listed = false;
+        ts.tickData.acquireLock();
+        const TickData& td = ts.tickData.getByTickInCurrentEpoch(tick);
+        if (td.epoch == system.epoch)
+        {
+            for (unsigned int slot = 0; slot < NUMBER_OF_TRANSACTIONS_PER_TICK; slot++)
+            {
+                if (digest == td.transactionDigests[slot])
+                {
+                    unsigned long long* tsTransactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(tick);
+                    ts.tickTransactions.acquireLock();
+                    if (!tsTransactionOffsets[slot] && ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
+                    {
+                        copyMem(ts.tickTransactions(ts.nextTickTransactionOffset), transaction, transactionSize);
+                        tsTransactionOffsets[slot] = ts.nextTickTransactionOffset;
+                        ts.nextTickTransactionOffset += transactionSize;
+                    }
+                    ts.tickTransactions.releaseLock();
+                    listed = true;
+                    break;
+                }
+            }
+        }
+        ts.tickData.releaseLock();
+        return listed;
+    }
+
+public:
+    // Send RespondTickRange for each requested tick of current epoch storage, followed by EndResponse.
+    // The message is built in buffer, which needs to have space for sizeof(RespondTickRange) + TICK_SYNC_MAX_TICK_SIZE bytes.
+    static void respondTickRange(Peer* peer, unsigned int dejavu, const RequestTickRange& request, unsigned char* buffer)
+    {
+        const unsigned int numberOfTicks = (request.numberOfTicks < TICK_RANGE_MAX_NUMBER_OF_TICKS) ? request.numberOfTicks : TICK_RANGE_MAX_NUMBER_OF_TICKS;
+        for (unsigned int tick = request.firstTick; tick < request.firstTick + numberOfTicks && tick <= system.tick; tick++)
+        {
+            if (!ts.tickInCurrentEpochStorage(tick))
+            {
+                continue;
+            }
+
+            RespondTickRange* response = (RespondTickRange*)buffer;
+            setMem(response, sizeof(RespondTickRange), 0);
+            response->tick = tick;
+            unsigned long long size = sizeof(RespondTickRange);
+
+            if (request.flags & TICK_RANGE_QUORUM_TICKS)
+            {
+                const Tick* tsCompTicks = ts.ticks.getByTickInCurrentEpoch(tick);
+                for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+                {
+                    ts.ticks.acquireLock(i);
+                    if (tsCompTicks[i].epoch == system.epoch)
+                    {
+                        copyMem(buffer + size, &tsCompTicks[i], sizeof(Tick));
+                        size += sizeof(Tick);
+                        response->numberOfVotes++;
+                    }
+                    ts.ticks.releaseLock(i);
+                }
+            }
+
+            if (request.flags & (TICK_RANGE_TICK_DATA | TICK_RANGE_TRANSACTIONS))
+            {
+                ts.tickData.acquireLock();
+                const TickData& td = ts.tickData.getByTickInCurrentEpoch(tick);
+                const bool tickDataAvailable = td.epoch == system.epoch;
+                if (tickDataAvailable && (request.flags & TICK_RANGE_TICK_DATA))
+                {
+                    copyMem(buffer + size, &td, sizeof(TickData));
+                    size += sizeof(TickData);
+                    response->flags |= TICK_RANGE_TICK_DATA;
+                }
+                ts.tickData.releaseLock();
+
+                if (tickDataAvailable && (request.flags & TICK_RANGE_TRANSACTIONS))
+                {
+                    const unsigned long long* tsTransactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(tick);
+                    for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+                    {
+                        if (tsTransactionOffsets[i])
+                        {
+                            const Transaction* transaction = ts.tickTransactions(tsTransactionOffsets[i]);
+                            if (transaction->tick == tick && transaction->checkValidity())
+                            {
+                                copyMem(buffer + size, transaction, transaction->totalSize());
+                                size += transaction->totalSize();
+                                response->numberOfTransactions++;
+                            }
+                        }
+                    }
+                }
+            }
+
+            enqueueResponse(peer, (unsigned int)size, RespondTickRange::type, dejavu, buffer);
+        }
+        enqueueResponse(peer, 0, EndResponse::type, dejavu, NULL);
+    }
+
+    // Send the transactions of the requested tick (current or previous epoch storage) in RespondTickTransactionBundle messages,
+    // followed by EndResponse. The messages are built in the memory of the request, which needs to have space for
+    // TICK_TRANSACTION_BUNDLE_MAX_SIZE bytes.
+    static void processRequestTickTransactionBundle(Peer* peer, RequestResponseHeader* header)
+    {
+        const unsigned int dejavu = header->dejavu();
+        if (header->size() != sizeof(RequestResponseHeader) + sizeof(RequestTickTransactionBundle))
+        {
+            enqueueResponse(peer, 0, EndResponse::type, dejavu, NULL);
+            return;
+        }
+
+        // copy request, because its memory is reused to build the bundles
+        const RequestTickTransactionBundle request = *header->getPayload<RequestTickTransactionBundle>();
+        const unsigned long long* tsTransactionOffsets = ts.tickTransactionOffsets.getByTickIfStored(request.tick);
+        if (tsTransactionOffsets)
+        {
+            unsigned int maxBundleSize = request.maxBundleSize;
+            if (!maxBundleSize || maxBundleSize > TICK_TRANSACTION_BUNDLE_MAX_SIZE)
+            {
+                maxBundleSize = TICK_TRANSACTION_BUNDLE_MAX_SIZE;
+            }
+            else if (maxBundleSize < sizeof(RespondTickTransactionBundle) + MAX_TRANSACTION_SIZE)
+            {
+                maxBundleSize = sizeof(RespondTickTransactionBundle) + MAX_TRANSACTION_SIZE;
+            }
+
+            RespondTickTransactionBundle* bundle = (RespondTickTransactionBundle*)header;
+            unsigned int bundleSize = sizeof(RespondTickTransactionBundle);
+            bundle->tick = request.tick;
+            bundle->numberOfTransactions = 0;
+            setMem(bundle->transactionFlags, sizeof(bundle->transactionFlags), 0);
+            for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+            {
+                if ((request.transactionFlags[i >> 3] & (1 << (i & 7))) || !tsTransactionOffsets[i])
+                {
+                    continue;
+                }
+
+                // skip transactions that don't belong to the tick (tick storage messed up)
+                const Transaction* transaction = ts.tickTransactions(tsTransactionOffsets[i]);
+                if (transaction->tick != request.tick || !transaction->checkValidity())
+                {
+                    continue;
+                }
+
+                const unsigned int transactionSize = transaction->totalSize();
+                if (bundleSize + transactionSize > maxBundleSize)
+                {
+                    enqueueResponse(peer, bundleSize, RespondTickTransactionBundle::type, dejavu, bundle);
+                    bundleSize = sizeof(RespondTickTransactionBundle);
+                    bundle->numberOfTransactions = 0;
+                    setMem(bundle->transactionFlags, sizeof(bundle->transactionFlags), 0);
+                }
+                copyMem(((unsigned char*)bundle) + bundleSize, transaction, transactionSize);
+                bundleSize += transactionSize;
+                bundle->transactionFlags[i >> 3] |= (1 << (i & 7));
+                bundle->numberOfTransactions++;
+            }
+            if (bundle->numberOfTransactions)
+            {
+                enqueueResponse(peer, bundleSize, RespondTickTransactionBundle::type, dejavu, bundle);
+            }
+        }
+        enqueueResponse(peer, 0, EndResponse::type, dejavu, NULL);
+    }
+
+    // Verify and store content of RespondTickRange with payloadSize bytes, can be called by several threads in parallel
+    static void processRespondTickRange(RespondTickRange* response, unsigned int payloadSize, const m256i* computorPublicKeys)
+    {
+        const unsigned int tick = response->tick;
+        if (payloadSize < sizeof(RespondTickRange)
+            || response->numberOfVotes > NUMBER_OF_COMPUTORS
+            || response->numberOfTransactions > NUMBER_OF_TRANSACTIONS_PER_TICK
+            || tick < system.tick
+            || !ts.tickInCurrentEpochStorage(tick))
+        {
+            return;
+        }
+
+        unsigned char* ptr = (unsigned char*)(response + 1);
+        const unsigned char* end = ((const unsigned char*)response) + payloadSize;
+        if (ptr + response->numberOfVotes * sizeof(Tick) > end)
+        {
+            return;
+        }
+        for (unsigned int i = 0; i < response->numberOfVotes; i++)
+        {
+            if (storeVote((Tick*)ptr, tick, computorPublicKeys))
+            {
+                updateLatestKnownTick(tick);
+            }
+            ptr += sizeof(Tick);
+        }
+
+        if (response->flags & TICK_RANGE_TICK_DATA)
+        {
+            if (ptr + sizeof(TickData) > end)
+            {
+                return;
+            }
+            storeTickData((TickData*)ptr, tick, computorPublicKeys);
+            ptr += sizeof(TickData);
+        }
+
+        if (tick <= system.tick)
+        {
+            return;
+        }
+        for (unsigned int i = 0; i < response->numberOfTransactions; i++)
+        {
+            const Transaction* transaction = (const Transaction*)ptr;
+            if (ptr + sizeof(Transaction) > end || ptr + transaction->totalSize() > end
+                || !transaction->checkValidity() || transaction->tick != tick)
+            {
+                return;
+            }
+            storeTransaction(transaction, tick);
+            ptr += transaction->totalSize();
+        }
+    }
+
+    // Record tick of a verified vote, used to detect that this node lags behind
+    static void updateLatestKnownTick(unsigned int tick)
+    {
+        if (tick > latestKnownTick)
+        {
+            latestKnownTick = tick;
+        }
+    }
+
+    // Start new round of requests, called by main loop before getNextRequest()
+    static void beginRequestRound()
+    {
+        const unsigned int currentTick = system.tick;
+        if (currentTick != tickOfLastRound)
+        {
+            tickOfLastRound = currentTick;
+            stalledRounds = 0;
+        }
+        else if (++stalledRounds >= TICK_SYNC_STALL_ROUNDS)
+        {
+            // responses may have been lost, request windows again
+            nextRequestedTick = 0;
+            stalledRounds = 0;
+        }
+    }
+
+    // Get request for next window of ticks if node lags behind and the pipeline is not full yet, return false otherwise
+    static bool getNextRequest(RequestTickRange& request)
+    {
+        const unsigned int currentTick = system.tick;
+        const unsigned int knownTick = latestKnownTick;
+        if (knownTick < currentTick + TICK_SYNC_MIN_LAG)
+        {
+            nextRequestedTick = 0;
+            return false;
+        }
+        if (nextRequestedTick < currentTick)
+        {
+            nextRequestedTick = currentTick;
+        }
+        if (nextRequestedTick >= knownTick
+            || nextRequestedTick >= currentTick + TICK_SYNC_NUMBER_OF_PIPELINED_REQUESTS * TICK_RANGE_MAX_NUMBER_OF_TICKS)
+        {
+            return false;
+        }
+
+        // votes of latest known tick are usually incomplete, so do not request it
+        const unsigned int numberOfTicks = knownTick - nextRequestedTick;
+        request.firstTick = nextRequestedTick;
+        request.numberOfTicks = (numberOfTicks < TICK_RANGE_MAX_NUMBER_OF_TICKS) ? numberOfTicks : TICK_RANGE_MAX_NUMBER_OF_TICKS;
+        request.flags = TICK_RANGE_QUORUM_TICKS | TICK_RANGE_TICK_DATA | TICK_RANGE_TRANSACTIONS;
+        request._padding = 0;
+        nextRequestedTick += request.numberOfTicks;
+        return true;
+    }
+};
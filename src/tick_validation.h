@@ -0,0 +1,119 @@
+#pragma once
+
+#include "network_messages/tick.h"
+
+#include "platform/m256.h"
+#include "platform/time.h"
+
+#include "kangaroo_twelve.h"
+#include "four_q.h"
+#include "system.h"
+
+// Max number of milliseconds that the timestamp of tick data may be ahead of the clock of this node
+#define TIME_ACCURACY 5000
+
+// Validation of quorum votes and tick data received from other nodes, shared by the broadcast handlers and the range-based
+// tick sync, so data is accepted under the same conditions regardless of how it arrives.
+
+// Computors that sent conflicting votes or tick data (one bit per computor index)
+static unsigned long long faultyComputorFlags[(NUMBER_OF_COMPUTORS + 63) / 64];
+
+static void markComputorFaulty(unsigned int computorIndex)
+{
+    _InterlockedOr64((volatile long long*)&faultyComputorFlags[computorIndex >> 6], 1LL << (computorIndex & 63));
+}
+
+// Check date and time of Tick or TickData
+template <typename T>
+static bool hasValidTimestamp(const T& t)
+{
+    return t.month >= 1 && t.month <= 12
+        && t.day >= 1 && t.day <= ((t.month == 1 || t.month == 3 || t.month == 5 || t.month == 7 || t.month == 8 || t.month == 10 || t.month == 12) ? 31 : ((t.month == 4 || t.month == 6 || t.month == 9 || t.month == 11) ? 30 : ((t.year & 3) ? 28 : 29)))
+        && t.hour <= 23
+        && t.minute <= 59
+        && t.second <= 59
+        && t.millisecond <= 999;
+}
+
+// Check vote of current epoch including signature of computor (computorIndex is modified temporarily)
+static bool isValidVote(Tick* vote, const m256i* computorPublicKeys)
+{
+    if (vote->computorIndex >= NUMBER_OF_COMPUTORS
+        || vote->epoch != system.epoch
+        || !hasValidTimestamp(*vote))
+    {
+        return false;
+    }
+
+    unsigned char digest[32];
+    vote->computorIndex ^= BroadcastTick::type;
+    KangarooTwelve(vote, sizeof(Tick) - SIGNATURE_SIZE, digest, sizeof(digest));
+    vote->computorIndex ^= BroadcastTick::type;
+    return verify(computorPublicKeys[vote->computorIndex].m256i_u8, digest, vote->signature);
+}
+
+// Check tick data of current epoch including signature of tick leader (computorIndex is modified temporarily)
+static bool isValidTickData(TickData* tickData, const m256i* computorPublicKeys)
+{
+    if (tickData->epoch != system.epoch
+        || tickData->tick % NUMBER_OF_COMPUTORS != tickData->computorIndex
+        || !hasValidTimestamp(*tickData)
+        || ms(tickData->year, tickData->month, tickData->day, tickData->hour, tickData->minute, tickData->second, tickData->millisecond) > ms(utcTime.Year - 2000, utcTime.Month, utcTime.Day, utcTime.Hour, utcTime.Minute, utcTime.Second, utcTime.Nanosecond / 1000000) + TIME_ACCURACY)
+    {
+        return false;
+    }
+    for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+    {
+        if (!isZero(tickData->transactionDigests[i]))
+        {
+            for (unsigned int j = 0; j < i; j++)
+            {
+                if (tickData->transactionDigests[i] == tickData->transactionDigests[j])
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    unsigned char digest[32];
+    tickData->computorIndex ^= BroadcastFutureTickData::type;
+    KangarooTwelve(tickData, sizeof(TickData) - SIGNATURE_SIZE, digest, sizeof(digest));
+    tickData->computorIndex ^= BroadcastFutureTickData::type;
+    return verify(computorPublicKeys[tickData->computorIndex].m256i_u8, digest, tickData->signature);
+}
+
+// Mark computor as faulty if valid vote differs from the vote of the same computor and tick in tick storage
+static void checkVoteConflict(const Tick& vote, const Tick& storedVote)
+{
+    if (*((unsigned long long*)&vote.millisecond) != *((unsigned long long*)&storedVote.millisecond)
+        || vote.prevSpectrumDigest != storedVote.prevSpectrumDigest
+        || vote.prevUniverseDigest != storedVote.prevUniverseDigest
+        || vote.prevComputerDigest != storedVote.prevComputerDigest
+        || vote.saltedSpectrumDigest != storedVote.saltedSpectrumDigest
+        || vote.saltedUniverseDigest != storedVote.saltedUniverseDigest
+        || vote.saltedComputerDigest != storedVote.saltedComputerDigest
+        || vote.transactionDigest != storedVote.transactionDigest
+        || vote.expectedNextTickTransactionDigest != storedVote.expectedNextTickTransactionDigest)
+    {
+        markComputorFaulty(vote.computorIndex);
+    }
+}
+
+// Mark tick leader as faulty if valid tick data differs from the tick data of the same tick in tick storage
+static void checkTickDataConflict(const TickData& tickData, const TickData& storedTickData)
+{
+    if (*((unsigned long long*)&tickData.millisecond) != *((unsigned long long*)&storedTickData.millisecond))
+    {
+        markComputorFaulty(tickData.computorIndex);
+        return;
+    }
+    for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+    {
+        if (tickData.transactionDigests[i] != storedTickData.transactionDigests[i])
+        {
+            markComputorFaulty(tickData.computorIndex);
+            return;
+        }
+    }
+}
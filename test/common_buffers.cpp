@@ -0,0 +1,144 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+// reduced buffer sizes for testing
+#define SCRATCHPAD_SMALL_BUFFER_SIZE 1024
+#define SCRATCHPAD_MEDIUM_BUFFER_SIZE 4096
+#define REORG_BUFFER_SIZE 65536
+
+#include "../src/common_buffers.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+TEST(TestCoreCommonBuffers, ScratchpadTiers)
+{
+    EXPECT_TRUE(initCommonBuffers());
+    EXPECT_EQ(getNumberOfAcquiredScratchpads(), 0);
+
+    // small requests are served by small buffers first, then by medium buffers, but never by the reorg buffer
+    std::vector<void*> buffers;
+    for (unsigned int i = 0; i < NUMBER_OF_SCRATCHPAD_SMALL_BUFFERS + NUMBER_OF_SCRATCHPAD_MEDIUM_BUFFERS; ++i)
+    {
+        void* ptr = __tryAcquireScratchpad(100);
+        ASSERT_NE(ptr, nullptr);
+        EXPECT_NE(ptr, reorgBuffer);
+        for (void* other : buffers)
+            EXPECT_NE(ptr, other);
+        setMem(ptr, 100, 0xff);
+        buffers.push_back(ptr);
+    }
+    EXPECT_EQ(getNumberOfAcquiredScratchpads(), buffers.size());
+    EXPECT_EQ(__tryAcquireScratchpad(100), nullptr);
+    EXPECT_EQ(__tryAcquireScratchpad(SCRATCHPAD_MEDIUM_BUFFER_SIZE), nullptr);
+
+    // large request is served by reorg buffer
+    void* large = __tryAcquireScratchpad(SCRATCHPAD_MEDIUM_BUFFER_SIZE + 1);
+    EXPECT_EQ(large, reorgBuffer);
+    EXPECT_EQ(__tryAcquireScratchpad(SCRATCHPAD_MEDIUM_BUFFER_SIZE + 1), nullptr);
+    setMem(large, SCRATCHPAD_MEDIUM_BUFFER_SIZE + 1, 0);
+    __releaseScratchpad(large);
+    EXPECT_EQ(__acquireScratchpad(REORG_BUFFER_SIZE), reorgBuffer);
+    __releaseScratchpad(reorgBuffer);
+
+    // too large request cannot be served
+    EXPECT_EQ(__acquireScratchpad(REORG_BUFFER_SIZE + 1), nullptr);
+    EXPECT_EQ(__tryAcquireScratchpad(REORG_BUFFER_SIZE + 1), nullptr);
+
+    // released buffer is reused for request fitting into it
+    __releaseScratchpad(buffers[3]);
+    EXPECT_EQ(__tryAcquireScratchpad(SCRATCHPAD_MEDIUM_BUFFER_SIZE), nullptr);
+    EXPECT_EQ(__acquireScratchpad(SCRATCHPAD_SMALL_BUFFER_SIZE), buffers[3]);
+
+    // medium request is served by medium buffer
+    __releaseScratchpad(buffers.back());
+    EXPECT_EQ(__acquireScratchpad(SCRATCHPAD_SMALL_BUFFER_SIZE + 1), buffers.back());
+
+    for (void* ptr : buffers)
+        __releaseScratchpad(ptr);
+    EXPECT_EQ(getNumberOfAcquiredScratchpads(), 0);
+
+    deinitCommonBuffers();
+}
+
+static std::atomic<unsigned int> scratchpadErrors = 0;
+
+// Repeatedly acquire scratchpad, fill it, and check that no other thread writes to it
+static void useScratchpads(unsigned int threadIndex)
+{
+    for (unsigned int i = 0; i < 500; ++i)
+    {
+        const unsigned long long size = ((threadIndex + i) % 7 == 0) ? SCRATCHPAD_MEDIUM_BUFFER_SIZE : SCRATCHPAD_SMALL_BUFFER_SIZE;
+        unsigned char* ptr = (unsigned char*)__acquireScratchpad(size);
+        setMem(ptr, size, (unsigned char)threadIndex);
+        std::this_thread::yield();
+        for (unsigned long long j = 0; j < size; ++j)
+        {
+            if (ptr[j] != (unsigned char)threadIndex)
+            {
+                ++scratchpadErrors;
+                break;
+            }
+        }
+        __releaseScratchpad(ptr);
+    }
+}
+
+TEST(TestCoreCommonBuffers, ConcurrentScratchpads)
+{
+    EXPECT_TRUE(initCommonBuffers());
+
+    // more threads than buffers
+    constexpr unsigned int numberOfThreads = NUMBER_OF_SCRATCHPAD_SMALL_BUFFERS + NUMBER_OF_SCRATCHPAD_MEDIUM_BUFFERS + 4;
+    std::thread threads[numberOfThreads];
+    for (unsigned int t = 0; t < numberOfThreads; ++t)
+    {
+        threads[t] = std::thread(useScratchpads, t);
+    }
+    for (unsigned int t = 0; t < numberOfThreads; ++t)
+    {
+        threads[t].join();
+    }
+
+    EXPECT_EQ(scratchpadErrors, 0);
+    EXPECT_EQ(getNumberOfAcquiredScratchpads(), 0);
+
+    deinitCommonBuffers();
+}
+
+TEST(TestCoreCommonBuffers, ReleaseScratchpadsOfStack)
+{
+    EXPECT_TRUE(initCommonBuffers());
+
+    // scratchpad acquired by other thread (other stack)
+    void* otherThreadBuffer = nullptr;
+    std::thread otherThread([&otherThreadBuffer]() { otherThreadBuffer = __acquireScratchpad(SCRATCHPAD_MEDIUM_BUFFER_SIZE); });
+    otherThread.join();
+    ASSERT_NE(otherThreadBuffer, nullptr);
+
+    // scratchpads acquired on this stack, like contract processor that times out in HashMap cleanup
+    void* small = __acquireScratchpad(SCRATCHPAD_SMALL_BUFFER_SIZE);
+    void* large = __acquireScratchpad(REORG_BUFFER_SIZE);
+    ASSERT_NE(small, nullptr);
+    ASSERT_NE(large, nullptr);
+    EXPECT_EQ(getNumberOfAcquiredScratchpads(), 3);
+
+    const char marker = 0;
+    const char* stackBottom = &marker - (1 << 20);
+    const char* stackTop = &marker + (1 << 20);
+    releaseScratchpadsOfStack(stackTop, stackTop + (1 << 20));
+    EXPECT_EQ(getNumberOfAcquiredScratchpads(), 3);
+    releaseScratchpadsOfStack(stackBottom, stackTop);
+    EXPECT_EQ(getNumberOfAcquiredScratchpads(), 1);
+
+    // released buffers can be acquired again
+    EXPECT_EQ(__tryAcquireScratchpad(REORG_BUFFER_SIZE), large);
+    __releaseScratchpad(large);
+    __releaseScratchpad(otherThreadBuffer);
+    EXPECT_EQ(getNumberOfAcquiredScratchpads(), 0);
+
+    deinitCommonBuffers();
+}
@@ -0,0 +1,215 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include <random>
+#include <vector>
+
+// Small blocks, so files consist of many blocks and the IO buffer is flushed and refilled
+#define COMPRESSED_FILE_BLOCK_SIZE (16 * 1024)
+// Small chunks of large files
+#define FILE_CHUNK_SIZE (100 * 1024ULL)
+#include "../src/compressed_file_io.h"
+
+
+static const CHAR16* compressedFileName = L"compressed_file_io_test.bin";
+static const CHAR16* chunkFileNames[] = { L"compressed_file_io_test.bin.000", L"compressed_file_io_test.bin.001", L"compressed_file_io_test.bin.002" };
+
+struct CompressedFileTest
+{
+    ~CompressedFileTest()
+    {
+        _wremove((const wchar_t*)compressedFileName);
+        for (auto chunkFileName : chunkFileNames)
+            _wremove((const wchar_t*)chunkFileName);
+    }
+};
+
+// Array of records, of which about occupiedPercent are filled with random bytes and the rest are zero
+static std::vector<unsigned char> generateRecords(unsigned long long seed, unsigned int recordSize, unsigned int numberOfRecords, unsigned int occupiedPercent)
+{
+    std::mt19937_64 gen64(seed);
+    std::vector<unsigned char> data(recordSize * numberOfRecords, 0);
+    for (unsigned int i = 0; i < numberOfRecords; i++)
+    {
+        if (gen64() % 100 < occupiedPercent)
+        {
+            for (unsigned int j = 0; j < recordSize; j++)
+                data[i * recordSize + j] = (unsigned char)gen64();
+        }
+    }
+    return data;
+}
+
+static unsigned long long compressedFileSize()
+{
+    CompressedFileHeader header;
+    EXPECT_EQ(loadAt(compressedFileName, 0, sizeof(header), (unsigned char*)&header), (long long)sizeof(header));
+    return header.fileSize;
+}
+
+static void expectRoundTrip(const std::vector<unsigned char>& data, unsigned int recordSize)
+{
+    EXPECT_EQ(saveCompressedFile(compressedFileName, data.size(), data.data(), recordSize), (long long)data.size());
+    std::vector<unsigned char> loaded(data.size(), 0xAB);
+    EXPECT_EQ(loadStateFile(compressedFileName, loaded.size(), loaded.data()), (long long)data.size());
+    EXPECT_TRUE(loaded == data);
+}
+
+TEST(TestCoreCompressedFileIO, RoundTrip)
+{
+    CompressedFileTest test;
+
+    // sparse arrays of entity-like and asset-like records
+    for (unsigned int occupiedPercent : { 0, 1, 30, 100 })
+    {
+        expectRoundTrip(generateRecords(occupiedPercent, 64, 4096, occupiedPercent), 64);
+        expectRoundTrip(generateRecords(occupiedPercent + 1, 48, 5000, occupiedPercent), 48);
+    }
+
+    // records larger than the block size are not removed if zero, last block is smaller than the others
+    expectRoundTrip(generateRecords(2, 40000, 5, 60), 40000);
+
+    // byte stream with repetitions and random parts
+    std::mt19937_64 gen64(3);
+    std::vector<unsigned char> stream;
+    while (stream.size() < 100000)
+    {
+        const unsigned int length = 1 + gen64() % 3000;
+        if (stream.size() > 1000 && gen64() % 2)
+        {
+            const unsigned long long begin = gen64() % (stream.size() - 500);
+            for (unsigned int i = 0; i < length; i++)
+                stream.push_back(stream[begin + i]);
+        }
+        else
+        {
+            for (unsigned int i = 0; i < length; i++)
+                stream.push_back((unsigned char)(gen64() % 7));
+        }
+    }
+    expectRoundTrip(stream, 0);
+
+    // small data
+    expectRoundTrip(std::vector<unsigned char>(64, 0), 8);
+    expectRoundTrip(std::vector<unsigned char>(65, 0x11), 0);
+}
+
+TEST(TestCoreCompressedFileIO, OnlyOccupiedSlotsAreStored)
+{
+    CompressedFileTest test;
+
+    const std::vector<unsigned char> sparse = generateRecords(4, 64, 16384, 2);
+    expectRoundTrip(sparse, 64);
+    EXPECT_LT(compressedFileSize(), sparse.size() / 20);
+
+    const std::vector<unsigned char> empty(64 * 16384, 0);
+    expectRoundTrip(empty, 64);
+    EXPECT_LT(compressedFileSize(), 4096);
+
+    // incompressible data grows only by the headers
+    const std::vector<unsigned char> full = generateRecords(5, 64, 16384, 100);
+    expectRoundTrip(full, 64);
+    EXPECT_LE(compressedFileSize(), full.size() + sizeof(CompressedFileHeader) + 64 * sizeof(CompressedFileBlockHeader));
+}
+
+TEST(TestCoreCompressedFileIO, DetectCorruption)
+{
+    CompressedFileTest test;
+
+    const std::vector<unsigned char> data = generateRecords(6, 64, 4096, 50);
+    std::vector<unsigned char> loaded(data.size());
+    EXPECT_EQ(saveCompressedFile(compressedFileName, data.size(), data.data(), 64), (long long)data.size());
+    const unsigned long long fileSize = compressedFileSize();
+
+    // flip bits of headers and encoded blocks
+    for (unsigned long long position : { 8ULL, 20ULL, sizeof(CompressedFileHeader) + 2ULL, sizeof(CompressedFileHeader) + 30ULL, fileSize / 2, fileSize - 1 })
+    {
+        unsigned char byte;
+        EXPECT_EQ(loadAt(compressedFileName, position, 1, &byte), 1);
+        byte ^= 0x10;
+        EXPECT_EQ(saveAt(compressedFileName, position, 1, &byte), 1);
+        EXPECT_EQ(loadCompressedFile(compressedFileName, loaded.size(), loaded.data()), -1);
+        byte ^= 0x10;
+        EXPECT_EQ(saveAt(compressedFileName, position, 1, &byte), 1);
+        EXPECT_EQ(loadCompressedFile(compressedFileName, loaded.size(), loaded.data()), (long long)data.size());
+    }
+
+    // unexpected size
+    EXPECT_EQ(loadCompressedFile(compressedFileName, loaded.size() - 64, loaded.data()), -1);
+}
+
+TEST(TestCoreCompressedFileIO, LoadRawFile)
+{
+    CompressedFileTest test;
+
+    const std::vector<unsigned char> data = generateRecords(7, 64, 1000, 50);
+    EXPECT_EQ(saveAt(compressedFileName, 0, data.size(), data.data()), (long long)data.size());
+    std::vector<unsigned char> loaded(data.size());
+    EXPECT_EQ(loadCompressedFile(compressedFileName, loaded.size(), loaded.data()), 0);
+    EXPECT_EQ(loadStateFile(compressedFileName, loaded.size(), loaded.data()), (long long)data.size());
+    EXPECT_TRUE(loaded == data);
+
+    // raw file overwriting a larger compressed file
+    EXPECT_EQ(saveCompressedFile(compressedFileName, data.size() * 4, std::vector<unsigned char>(data.size() * 4, 1).data(), 0), (long long)data.size() * 4);
+    EXPECT_EQ(saveAt(compressedFileName, 0, data.size(), data.data()), (long long)data.size());
+    EXPECT_EQ(loadStateFile(compressedFileName, loaded.size(), loaded.data()), (long long)data.size());
+    EXPECT_TRUE(loaded == data);
+}
+
+TEST(TestCoreCompressedFileIO, ReplaceLargerFile)
+{
+    CompressedFileTest test;
+
+    const std::vector<unsigned char> large = generateRecords(8, 64, 4096, 100);
+    EXPECT_EQ(saveCompressedFile(compressedFileName, large.size(), large.data(), 64), (long long)large.size());
+    const std::vector<unsigned char> small = generateRecords(9, 64, 4096, 1);
+    expectRoundTrip(small, 64);
+
+    // no data of the larger file is left behind
+    FILE* file = nullptr;
+    EXPECT_EQ(_wfopen_s(&file, compressedFileName, L"rb"), 0);
+    EXPECT_EQ(fseek(file, 0, SEEK_END), 0);
+    EXPECT_EQ((unsigned long long)ftell(file), compressedFileSize());
+    fclose(file);
+}
+
+TEST(TestCoreCompressedFileIO, RejectIncompleteFile)
+{
+    CompressedFileTest test;
+
+    const std::vector<unsigned char> data = generateRecords(10, 64, 4096, 50);
+    std::vector<unsigned char> loaded(data.size());
+    EXPECT_EQ(saveCompressedFile(compressedFileName, data.size(), data.data(), 64), (long long)data.size());
+
+    // saving interrupted before the final header is written -> neither loaded as compressed nor as raw file
+    CompressedFileHeader header;
+    EXPECT_EQ(loadAt(compressedFileName, 0, sizeof(header), (unsigned char*)&header), (long long)sizeof(header));
+    header.fileSize = 0;
+    EXPECT_EQ(saveAt(compressedFileName, 0, sizeof(header), (unsigned char*)&header), (long long)sizeof(header));
+    EXPECT_EQ(loadStateFile(compressedFileName, loaded.size(), loaded.data()), -1);
+}
+
+TEST(TestCoreCompressedFileIO, LoadLargeFileChunks)
+{
+    CompressedFileTest test;
+
+    // chunks of different formats, last chunk with partial record
+    const std::vector<unsigned char> data = generateRecords(11, 48, 5000, 30);
+    ASSERT_GT(data.size(), 2 * FILE_CHUNK_SIZE);
+    EXPECT_EQ(saveCompressedFile(chunkFileNames[0], FILE_CHUNK_SIZE, data.data(), 48), (long long)FILE_CHUNK_SIZE);
+    EXPECT_EQ(saveAt(chunkFileNames[1], 0, FILE_CHUNK_SIZE, data.data() + FILE_CHUNK_SIZE), (long long)FILE_CHUNK_SIZE);
+    const unsigned long long lastChunkSize = data.size() - 2 * FILE_CHUNK_SIZE;
+    EXPECT_EQ(saveCompressedFile(chunkFileNames[2], lastChunkSize, data.data() + 2 * FILE_CHUNK_SIZE, 48), (long long)lastChunkSize);
+
+    // file without chunk number (such as an old compressed file) doesn't hide the chunks
+    EXPECT_EQ(saveCompressedFile(compressedFileName, data.size(), std::vector<unsigned char>(data.size(), 1).data(), 0), (long long)data.size());
+
+    std::vector<unsigned char> loaded(data.size());
+    EXPECT_EQ(loadStateFile(compressedFileName, loaded.size(), loaded.data(), NULL, true), (long long)data.size());
+    EXPECT_TRUE(loaded == data);
+
+    // missing chunk
+    _wremove((const wchar_t*)chunkFileNames[1]);
+    EXPECT_EQ(loadStateFile(compressedFileName, loaded.size(), loaded.data(), NULL, true), -1);
+}
@@ -6,6 +6,9 @@
 #include "../src/contract_core/stack_buffer.h"
 #include "../src/contract_core/contract_action_tracker.h"
 
+#include <random>
+#include <vector>
+
 TEST(TestCoreContractCore, StackBuffer)
 {
     StackBuffer<unsigned char, 120> s1;
@@ -54,6 +57,86 @@ TEST(TestCoreContractCore, StackBuffer)
     s1.free();
 }
 
+static bool isZeroMemory(const char* p, unsigned int size)
+{
+    for (unsigned int i = 0; i < size; ++i)
+        if (p[i])
+            return false;
+    return true;
+}
+
+TEST(TestCoreContractCore, StackBufferZeroedAllocation)
+{
+    typedef StackBuffer<unsigned int, 16 * 1024> StackBufferType;
+    StackBufferType* s = new StackBufferType;
+    s->init();
+    EXPECT_EQ(s->dirtySize(), s->capacity());
+
+    // make all memory dirty
+    char* p = s->allocate(s->capacity() - sizeof(unsigned int));
+    ASSERT_NE(p, nullptr);
+    memset(p, 0xcd, s->capacity() - sizeof(unsigned int));
+    s->free();
+
+    // allocateZeroed() clears memory below watermark
+    p = s->allocateZeroed(1000);
+    ASSERT_NE(p, nullptr);
+    EXPECT_TRUE(isZeroMemory(p, 1000));
+    s->free();
+
+    // after zeroUnused(), nothing is dirty anymore
+    s->zeroUnused();
+    EXPECT_EQ(s->dirtySize(), 0);
+    p = s->allocate(s->capacity() - sizeof(unsigned int));
+    EXPECT_TRUE(isZeroMemory(p, s->capacity() - sizeof(unsigned int)));
+    s->free();
+    s->zeroUnused();
+
+    // random nested allocations, zeroed allocations always need to be observed as zero
+    std::mt19937_64 gen64(42);
+    std::vector<std::pair<char*, unsigned int>> allocations;
+    for (int i = 0; i < 10000; ++i)
+    {
+        int op = gen64() % 10;
+        if (op < 5)
+        {
+            // allocate (with or without zeroing) and write to memory like a contract
+            unsigned int size = gen64() % 2000;
+            bool zeroed = (gen64() % 4 != 0);
+            p = (zeroed) ? s->allocateZeroed(size) : s->allocate(size);
+            if (!p)
+                continue;
+            if (zeroed)
+                EXPECT_TRUE(isZeroMemory(p, size));
+            allocations.push_back({ p, size });
+            memset(p, int(gen64() % 255) + 1, size);
+        }
+        else if (op < 9 && !allocations.empty())
+        {
+            s->free();
+            allocations.pop_back();
+        }
+        else
+        {
+            s->zeroUnused();
+            EXPECT_EQ(s->dirtySize(), s->size());
+        }
+        EXPECT_GE(s->dirtySize(), s->size());
+    }
+    while (!allocations.empty())
+    {
+        s->free();
+        allocations.pop_back();
+    }
+    s->zeroUnused();
+    EXPECT_EQ(s->dirtySize(), 0);
+    p = s->allocate(s->capacity() - sizeof(unsigned int));
+    EXPECT_TRUE(isZeroMemory(p, s->capacity() - sizeof(unsigned int)));
+    s->free();
+
+    delete s;
+}
+
 TEST(TestCoreContractCore, ContractActionTracker)
 {
     m256i id0(0, 1, 2, 3);
@@ -0,0 +1,238 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include <random>
+#include <vector>
+
+// Collect responses instead of sending them to peers
+#define TEST_UTILS_COLLECT_RESPONSES
+#include "utils.h"
+
+#define ENTITY_TX_HISTORY_NUMBER_OF_CHUNKS (1ULL << 16)
+#include "../src/entity_tx_history.h"
+
+
+static EntityTxHistory entityTxHistory;
+static unsigned int numberOfSpectrumReorganizations = 0; // passed with spectrum index like the request processor does
+static unsigned char responseBuffer[sizeof(RespondEntityTxHistory) + ENTITY_TX_HISTORY_MAX_POSTINGS * sizeof(EntityTxHistoryPosting)];
+
+struct ExpectedPosting
+{
+    unsigned int tick;
+    unsigned short transactionIndex;
+    unsigned char flags;
+};
+
+// Request page and check header, returns postings
+static std::vector<EntityTxHistoryPosting> requestPage(int spectrumIndex, unsigned int firstTick, unsigned int lastTick, unsigned int& nextLastTick)
+{
+    RequestEntityTxHistory request;
+    request.publicKey = m256i(spectrumIndex, 1, 2, 3);
+    request.firstTick = firstTick;
+    request.lastTick = lastTick;
+
+    responses.clear();
+    entityTxHistory.respond(nullptr, 77, spectrumIndex, numberOfSpectrumReorganizations, request, responseBuffer);
+    EXPECT_EQ(responses.size(), 1);
+    EXPECT_EQ(responses[0].type, RespondEntityTxHistory::type);
+    EXPECT_EQ(responses[0].dejavu, 77);
+    EXPECT_GE(responses[0].payload.size(), sizeof(RespondEntityTxHistory));
+
+    const RespondEntityTxHistory* response = (const RespondEntityTxHistory*)responses[0].payload.data();
+    EXPECT_EQ(response->publicKey, request.publicKey);
+    EXPECT_EQ(responses[0].payload.size(), sizeof(RespondEntityTxHistory) + response->numberOfPostings * sizeof(EntityTxHistoryPosting));
+    nextLastTick = response->nextLastTick;
+
+    const EntityTxHistoryPosting* postings = (const EntityTxHistoryPosting*)(response + 1);
+    return std::vector<EntityTxHistoryPosting>(postings, postings + response->numberOfPostings);
+}
+
+static void checkPostings(const std::vector<EntityTxHistoryPosting>& postings, const std::vector<ExpectedPosting>& expected)
+{
+    // postings are expected newest first
+    ASSERT_EQ(postings.size(), expected.size());
+    for (size_t i = 0; i < postings.size(); ++i)
+    {
+        const ExpectedPosting& e = expected[expected.size() - 1 - i];
+        EXPECT_EQ(postings[i].tick, e.tick);
+        EXPECT_EQ(postings[i].transactionIndex, e.transactionIndex);
+        EXPECT_EQ(postings[i].flags, e.flags);
+    }
+}
+
+TEST(TestEntityTxHistory, PostingsAndPagination)
+{
+    EXPECT_TRUE(entityTxHistory.init());
+    numberOfSpectrumReorganizations = 0;
+    std::mt19937_64 gen64(42);
+
+    // entity 0 is involved in many transactions, entity 1 in few, entity 2 sends to itself
+    const unsigned int firstTick = 5000;
+    const unsigned int numberOfTicks = 400;
+    std::vector<ExpectedPosting> expected[3];
+    entityTxHistory.beginEpoch();
+    for (unsigned int tick = firstTick; tick < firstTick + numberOfTicks; ++tick)
+    {
+        entityTxHistory.beginTick(tick, 0);
+        const unsigned int numberOfTransactions = (tick % 7 == 0) ? 0 : (unsigned int)(gen64() % 20);
+        unsigned short transactionIndex = (unsigned short)(gen64() % 10);
+        for (unsigned int i = 0; i < numberOfTransactions; ++i)
+        {
+            transactionIndex += 1 + (unsigned short)(gen64() % 40);
+            if (transactionIndex >= NUMBER_OF_TRANSACTIONS_PER_TICK)
+                break;
+            int source = 0, destination = 1000 + (int)(gen64() % 1000);
+            if (gen64() % 2)
+            {
+                source = destination;
+                destination = 0;
+            }
+            if (gen64() % 10 == 0)
+            {
+                destination = 1;
+            }
+            else if (gen64() % 50 == 0)
+            {
+                source = destination = 2;
+            }
+            else if (gen64() % 30 == 0)
+            {
+                // destination not in spectrum
+                destination = -1;
+            }
+            entityTxHistory.addTransaction(tick, transactionIndex, source, destination);
+            for (int e = 0; e < 3; ++e)
+            {
+                unsigned char flags = ((source == e) ? ENTITY_TX_HISTORY_SOURCE : 0) | ((destination == e) ? ENTITY_TX_HISTORY_DESTINATION : 0);
+                if (flags)
+                    expected[e].push_back({ tick, transactionIndex, flags });
+            }
+        }
+        entityTxHistory.endTick(tick);
+    }
+    ASSERT_GT(expected[0].size(), ENTITY_TX_HISTORY_MAX_POSTINGS);
+    ASSERT_GT(expected[1].size(), 0);
+    ASSERT_GT(expected[2].size(), 0);
+
+    // full history of entities with few postings fits into one page
+    unsigned int nextLastTick;
+    for (int e = 1; e < 3; ++e)
+    {
+        checkPostings(requestPage(e, 0, 0xFFFFFFFF, nextLastTick), expected[e]);
+        EXPECT_EQ(nextLastTick, 0);
+    }
+    const RespondEntityTxHistory* response = (const RespondEntityTxHistory*)responses[0].payload.data();
+    EXPECT_EQ(response->indexedFromTick, firstTick);
+    EXPECT_EQ(response->indexedToTick, firstTick + numberOfTicks - 1);
+
+    // entity without postings
+    checkPostings(requestPage(3, 0, 0xFFFFFFFF, nextLastTick), {});
+    checkPostings(requestPage(-1, 0, 0xFFFFFFFF, nextLastTick), {});
+
+    // paginate through entity 0, pages always contain complete ticks
+    std::vector<EntityTxHistoryPosting> allPostings;
+    unsigned int lastTick = 0xFFFFFFFF;
+    int numberOfPages = 0;
+    do
+    {
+        std::vector<EntityTxHistoryPosting> page = requestPage(0, 0, lastTick, nextLastTick);
+        EXPECT_LE(page.size(), ENTITY_TX_HISTORY_MAX_POSTINGS);
+        if (nextLastTick)
+        {
+            EXPECT_LT(nextLastTick, page.back().tick);
+        }
+        allPostings.insert(allPostings.end(), page.begin(), page.end());
+        lastTick = nextLastTick;
+        ++numberOfPages;
+    } while (lastTick);
+    EXPECT_GT(numberOfPages, 1);
+    checkPostings(allPostings, expected[0]);
+
+    // tick range is clipped
+    const unsigned int rangeFirstTick = firstTick + 100, rangeLastTick = firstTick + 150;
+    for (int e = 0; e < 3; ++e)
+    {
+        std::vector<ExpectedPosting> expectedInRange;
+        for (const auto& p : expected[e])
+            if (p.tick >= rangeFirstTick && p.tick <= rangeLastTick)
+                expectedInRange.push_back(p);
+        checkPostings(requestPage(e, rangeFirstTick, rangeLastTick, nextLastTick), expectedInRange);
+        EXPECT_EQ(nextLastTick, 0);
+    }
+    checkPostings(requestPage(0, rangeLastTick, rangeFirstTick, nextLastTick), {});
+
+    entityTxHistory.deinit();
+}
+
+TEST(TestEntityTxHistory, ClearAndExhaustion)
+{
+    EXPECT_TRUE(entityTxHistory.init());
+    numberOfSpectrumReorganizations = 0;
+    unsigned int nextLastTick;
+
+    // postings of tick that is not completed yet are not reported
+    entityTxHistory.beginEpoch();
+    entityTxHistory.beginTick(100, 0);
+    entityTxHistory.addTransaction(100, 3, 10, 11);
+    entityTxHistory.endTick(100);
+    entityTxHistory.beginTick(101, 0);
+    entityTxHistory.addTransaction(101, 4, 11, 10);
+    checkPostings(requestPage(10, 0, 0xFFFFFFFF, nextLastTick), { { 100, 3, ENTITY_TX_HISTORY_SOURCE } });
+    entityTxHistory.endTick(101);
+    checkPostings(requestPage(10, 0, 0xFFFFFFFF, nextLastTick), { { 100, 3, ENTITY_TX_HISTORY_SOURCE }, { 101, 4, ENTITY_TX_HISTORY_DESTINATION } });
+
+    // large tick delta
+    entityTxHistory.beginTick(3000000, 0);
+    entityTxHistory.addTransaction(3000000, 1023, 10, -1);
+    entityTxHistory.endTick(3000000);
+    checkPostings(requestPage(10, 0, 0xFFFFFFFF, nextLastTick), { { 100, 3, ENTITY_TX_HISTORY_SOURCE }, { 101, 4, ENTITY_TX_HISTORY_DESTINATION }, { 3000000, 1023, ENTITY_TX_HISTORY_SOURCE } });
+
+    // spectrum reorganized during tick -> index is not reported until it is cleared by next tick
+    numberOfSpectrumReorganizations = 1;
+    checkPostings(requestPage(10, 0, 0xFFFFFFFF, nextLastTick), {});
+    const RespondEntityTxHistory* response = (const RespondEntityTxHistory*)responses[0].payload.data();
+    EXPECT_EQ(response->indexedFromTick, 0);
+    EXPECT_EQ(response->indexedToTick, 0);
+
+    // spectrum reorganization clears index
+    entityTxHistory.beginTick(3000001, 1);
+    entityTxHistory.addTransaction(3000001, 0, 12, 10);
+    entityTxHistory.endTick(3000001);
+    checkPostings(requestPage(10, 0, 0xFFFFFFFF, nextLastTick), { { 3000001, 0, ENTITY_TX_HISTORY_DESTINATION } });
+    checkPostings(requestPage(11, 0, 0xFFFFFFFF, nextLastTick), {});
+    response = (const RespondEntityTxHistory*)responses[0].payload.data();
+    EXPECT_EQ(response->indexedFromTick, 3000001);
+    EXPECT_EQ(response->indexedToTick, 3000001);
+
+    // exhaust chunk pool with one chunk per entity, indexing stops at last complete tick
+    entityTxHistory.beginEpoch();
+    unsigned int tick = 200;
+    int entity = 0;
+    while (entityTxHistory.getNumberOfUsedChunks() < ENTITY_TX_HISTORY_NUMBER_OF_CHUNKS)
+    {
+        entityTxHistory.beginTick(tick, 1);
+        for (unsigned short i = 0; i < 1000; ++i)
+        {
+            entityTxHistory.addTransaction(tick, i, entity, entity + 1);
+            entity += 2;
+        }
+        entityTxHistory.endTick(tick);
+        ++tick;
+    }
+    const unsigned int fullTick = tick - 1;
+    checkPostings(requestPage(entity - 1, 0, 0xFFFFFFFF, nextLastTick), {});
+    response = (const RespondEntityTxHistory*)responses[0].payload.data();
+    EXPECT_EQ(response->indexedFromTick, 200);
+    EXPECT_EQ(response->indexedToTick, fullTick - 1);
+    checkPostings(requestPage(0, 0, 0xFFFFFFFF, nextLastTick), { { 200, 0, ENTITY_TX_HISTORY_SOURCE } });
+
+    // next epoch starts from scratch
+    entityTxHistory.beginEpoch();
+    entityTxHistory.beginTick(500, 1);
+    entityTxHistory.addTransaction(500, 7, 0, 1);
+    entityTxHistory.endTick(500);
+    checkPostings(requestPage(0, 0, 0xFFFFFFFF, nextLastTick), { { 500, 7, ENTITY_TX_HISTORY_SOURCE } });
+
+    entityTxHistory.deinit();
+}
@@ -1,10 +1,12 @@
 #define NO_UEFI
 
+#include "../src/platform/m256.h"
 #include "../src/kangaroo_twelve.h"
 
 #include "gtest/gtest.h"
 
 #include <chrono>
+#include <vector>
 
 
 TEST(TestCoreK12, PerformanceDigest32Of1GB)
@@ -35,3 +37,61 @@ TEST(TestCoreK12, PerformanceDigest32Of1GB)
 
     delete [] inputPtr;
 }
+
+TEST(TestCoreK12, Random2PoolLanes)
+{
+    constexpr unsigned int maxCount = 2 * RANDOM2_LANES + 1;
+    alignas(32) m256i publicKeys[maxCount];
+    alignas(32) m256i nonces[maxCount];
+    for (unsigned int i = 0; i < maxCount; ++i)
+    {
+        publicKeys[i] = m256i(i, 2 * i, 3 * i, 0x1234567890abcdefULL ^ i);
+        nonces[i] = m256i(~i, i << 20, 42, i);
+    }
+    std::vector<unsigned char> expectedPools(maxCount * RANDOM2_POOL_SIZE);
+    for (unsigned int i = 0; i < maxCount; ++i)
+        random2Pool(publicKeys[i].m256i_u8, nonces[i].m256i_u8, &expectedPools[i * RANDOM2_POOL_SIZE]);
+
+    // any number of pools, including incomplete groups of lanes, gives the same result as the scalar code
+    std::vector<unsigned char> pools(maxCount * RANDOM2_POOL_SIZE);
+    for (unsigned int count = 1; count <= maxCount; ++count)
+    {
+        const unsigned char* publicKeyPtrs[maxCount];
+        const unsigned char* noncePtrs[maxCount];
+        unsigned char* poolPtrs[maxCount];
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            publicKeyPtrs[i] = publicKeys[i].m256i_u8;
+            noncePtrs[i] = nonces[i].m256i_u8;
+            poolPtrs[i] = &pools[i * RANDOM2_POOL_SIZE];
+        }
+        memset(pools.data(), 0, pools.size());
+        random2PoolLanes(publicKeyPtrs, noncePtrs, poolPtrs, count);
+        for (unsigned int i = 0; i < count; ++i)
+            EXPECT_EQ(memcmp(&pools[i * RANDOM2_POOL_SIZE], &expectedPools[i * RANDOM2_POOL_SIZE], RANDOM2_POOL_SIZE), 0) << "count " << count << ", pool " << i;
+    }
+
+    // random2 is unchanged by splitting it into pool generation and output
+    std::vector<unsigned char> output(4096), expectedOutput(4096);
+    random2(publicKeys[1].m256i_u8, nonces[1].m256i_u8, output.data(), output.size(), pools.data());
+    random2FromPool(&expectedPools[RANDOM2_POOL_SIZE], expectedOutput.data(), expectedOutput.size());
+    EXPECT_TRUE(output == expectedOutput);
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (unsigned int i = 0; i < RANDOM2_LANES; ++i)
+        random2Pool(publicKeys[i].m256i_u8, nonces[i].m256i_u8, &pools[i * RANDOM2_POOL_SIZE]);
+    auto scalarMicroSec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+    const unsigned char* publicKeyPtrs[RANDOM2_LANES];
+    const unsigned char* noncePtrs[RANDOM2_LANES];
+    unsigned char* poolPtrs[RANDOM2_LANES];
+    for (unsigned int i = 0; i < RANDOM2_LANES; ++i)
+    {
+        publicKeyPtrs[i] = publicKeys[i].m256i_u8;
+        noncePtrs[i] = nonces[i].m256i_u8;
+        poolPtrs[i] = &pools[i * RANDOM2_POOL_SIZE];
+    }
+    startTime = std::chrono::high_resolution_clock::now();
+    random2PoolLanes(publicKeyPtrs, noncePtrs, poolPtrs, RANDOM2_LANES);
+    auto lanesMicroSec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+    std::cout << "random2 pools of " << RANDOM2_LANES << " solutions: " << scalarMicroSec << " us scalar, " << lanesMicroSec << " us in lanes" << std::endl;
+}
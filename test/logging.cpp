@@ -0,0 +1,618 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// workaround for name clash with stdlib
+#define system qubicSystemStruct
+
+// enable logging and persisting segments (saving fails in NO_UEFI, so tests mark segments as saved)
+#include "../src/private_settings.h"
+#undef LOG_CUSTOM_MESSAGES
+#define LOG_CUSTOM_MESSAGES 1
+#undef LOG_PERSIST_TO_DISK
+#define LOG_PERSIST_TO_DISK 1
+
+// only two segments in RAM (128 MB)
+#define LOG_BUFFER_SIZE (2 * LOG_SEGMENT_SIZE)
+
+#include "../src/public_settings.h"
+#undef MAX_NUMBER_OF_TICKS_PER_EPOCH
+#define MAX_NUMBER_OF_TICKS_PER_EPOCH 100
+
+#include "../src/logging/logging.h"
+#include "../src/logging/net_msg_impl.h"
+#include "../src/logging/disk_storage_impl.h"
+
+
+// Size of test messages, a segment holds 15 of them
+static constexpr unsigned int testMessageSize = 4 * 1024 * 1024;
+static constexpr unsigned int testMessagesPerSegment = (unsigned int)(LOG_SEGMENT_SIZE / (LOG_HEADER_SIZE + testMessageSize));
+
+class TestLogging : public ::testing::Test
+{
+protected:
+    std::vector<unsigned char> message;
+    Peer testPeers[2];
+
+    TestLogging() : message(testMessageSize)
+    {
+        system.epoch = 100;
+        system.tick = 1000;
+        frequency = 1000000000;
+        EXPECT_TRUE(logger.initLogging());
+        logger.reset(system.tick);
+        logger.registerNewTx(system.tick, 0);
+
+        EXPECT_TRUE(allocatePool(RESPONSE_QUEUE_BUFFER_SIZE, (void**)&responseQueueBuffer));
+        responseQueueBufferHead = responseQueueBufferTail = 0;
+        responseQueueElementHead = responseQueueElementTail = 0;
+
+        setMem(testPeers, sizeof(testPeers), 0);
+        for (unsigned long long i = 0; i < 2; i++)
+        {
+            connectPeer(testPeers[i], (void*)(0x1000 + i));
+        }
+    }
+
+    ~TestLogging()
+    {
+        freePool(responseQueueBuffer);
+        responseQueueBuffer = NULL;
+        logger.deinitLogging();
+    }
+
+    static void connectPeer(Peer& peer, void* connection)
+    {
+        peer.tcp4Protocol = (EFI_TCP4_PROTOCOL*)1;
+        peer.connectAcceptToken.NewChildHandle = connection;
+        peer.isConnectedAccepted = TRUE;
+        peer.isClosing = FALSE;
+    }
+
+    // Log message whose content is derived from the log ID
+    unsigned long long logTestMessage()
+    {
+        const unsigned long long id = logger.logId;
+        setMem(message.data(), message.size(), (unsigned char)id);
+        logger.logMessage(testMessageSize, CUSTOM_MESSAGE, message.data());
+        return id;
+    }
+
+    // Pretend that the main loop has saved the segments before endSegment
+    static void markSegmentsSaved(unsigned int endSegment)
+    {
+        ACQUIRE(logger.logSegmentsLock);
+        while (logger.nextSegmentToPersist < endSegment)
+        {
+            logger.getSegment(logger.nextSegmentToPersist).state = qLogger::SEGMENT_PERSISTED;
+            logger.nextSegmentToPersist = logger.nextSegmentToPersist + 1;
+        }
+        RELEASE(logger.logSegmentsLock);
+    }
+
+    static bool isTestMessageInRam(unsigned long long id)
+    {
+        const char* log = logger.getLog(id);
+        return log && qLogger::getLogSize(log) == testMessageSize && (unsigned char)log[LOG_HEADER_SIZE] == (unsigned char)id;
+    }
+
+    static unsigned long long logQuTransfer(const m256i& source, const m256i& destination, long long amount)
+    {
+        const unsigned long long id = logger.logId;
+        QuTransfer transfer{ source, destination, amount };
+        logger.logMessage(offsetof(QuTransfer, _terminator), QU_TRANSFER, &transfer);
+        return id;
+    }
+
+    // Process RequestFilteredLog and return IDs of logs in response (empty with nextID = -1 if response is empty)
+    std::vector<unsigned long long> requestFilteredLog(unsigned long long fromID, unsigned long long toID, unsigned long long messageTypes,
+        unsigned int contractIndex, const std::vector<m256i>& publicKeys, unsigned long long& nextID, unsigned long long passcodeDiff = 0)
+    {
+        std::vector<unsigned char> buffer(sizeof(RequestResponseHeader) + sizeof(RequestFilteredLog) + publicKeys.size() * sizeof(m256i));
+        RequestResponseHeader* header = (RequestResponseHeader*)buffer.data();
+        header->checkAndSetSize((unsigned int)buffer.size());
+        header->setType(RequestFilteredLog::type);
+        header->setDejavu(123);
+        RequestFilteredLog* request = header->getPayload<RequestFilteredLog>();
+        copyMem(request->passcode, logReaderPasscodes, sizeof(request->passcode));
+        request->passcode[3] += passcodeDiff;
+        request->fromID = fromID;
+        request->toID = toID;
+        request->messageTypes = messageTypes;
+        request->contractIndex = contractIndex;
+        request->numberOfPublicKeys = (unsigned int)publicKeys.size();
+        if (publicKeys.size())
+        {
+            copyMem(request + 1, publicKeys.data(), publicKeys.size() * sizeof(m256i));
+        }
+        qLogger::processRequestFilteredLog(0, &testPeers[0], header);
+
+        std::vector<unsigned long long> ids;
+        std::vector<RequestResponseHeader*> responses = takeResponses(&testPeers[0]);
+        EXPECT_EQ(responses.size(), 1);
+        EXPECT_EQ(responses[0]->type(), RespondFilteredLog::type);
+        EXPECT_EQ(responses[0]->dejavu(), 123);
+        nextID = 0xffffffffffffffffULL;
+        if (responses[0]->size() > sizeof(RequestResponseHeader))
+        {
+            const RespondFilteredLog* response = responses[0]->getPayload<RespondFilteredLog>();
+            nextID = response->nextID;
+            const char* ptr = (const char*)(response + 1);
+            const char* end = (const char*)responses[0] + responses[0]->size();
+            while (ptr < end)
+            {
+                EXPECT_TRUE(qLogger::verifyLog(ptr, qLogger::getLogId(ptr)));
+                ids.push_back(qLogger::getLogId(ptr));
+                ptr += LOG_HEADER_SIZE + qLogger::getLogSize(ptr);
+            }
+            EXPECT_EQ(ptr, end);
+        }
+        return ids;
+    }
+
+    void subscribe(Peer& peer, unsigned int dejavu, unsigned long long fromID, unsigned long long messageTypes, unsigned int maxUnacknowledgedMessages)
+    {
+        struct
+        {
+            RequestResponseHeader header;
+            RequestLogSubscription request;
+        } message;
+        message.header.setSize<sizeof(message)>();
+        message.header.setType(RequestLogSubscription::type);
+        message.header.setDejavu(dejavu);
+        copyMem(message.request.passcode, logReaderPasscodes, sizeof(message.request.passcode));
+        message.request.fromID = fromID;
+        message.request.messageTypes = messageTypes;
+        message.request.maxUnacknowledgedMessages = maxUnacknowledgedMessages;
+        message.request._padding = 0;
+        qLogger::processRequestLogSubscription(&peer, &message.header);
+    }
+
+    void acknowledge(Peer& peer, unsigned long long nextID)
+    {
+        struct
+        {
+            RequestResponseHeader header;
+            AcknowledgeLogSubscription request;
+        } message;
+        message.header.setSize<sizeof(message)>();
+        message.header.setType(AcknowledgeLogSubscription::type);
+        message.header.setDejavu(0);
+        copyMem(message.request.passcode, logReaderPasscodes, sizeof(message.request.passcode));
+        message.request.nextID = nextID;
+        qLogger::processAcknowledgeLogSubscription(&peer, &message.header);
+    }
+
+    struct Push
+    {
+        unsigned int dejavu;
+        unsigned long long fromID;
+        unsigned long long nextID;
+        std::vector<unsigned long long> ids;
+    };
+
+    // Let main loop push logs to subscribers and return the messages queued for peer
+    std::vector<Push> processSubscriptions(const Peer& peer)
+    {
+        qLogger::processSubscriptions();
+        std::vector<Push> pushes;
+        for (const RequestResponseHeader* header : takeResponses(&peer))
+        {
+            EXPECT_EQ(header->type(), RespondLogSubscription::type);
+            Push push{ header->dejavu(), 0xffffffffffffffffULL, 0xffffffffffffffffULL };
+            if (header->size() >= sizeof(RequestResponseHeader) + sizeof(RespondLogSubscription))
+            {
+                const RespondLogSubscription* response = ((RequestResponseHeader*)header)->getPayload<RespondLogSubscription>();
+                push.fromID = response->fromID;
+                push.nextID = response->nextID;
+                for (const char* ptr = (const char*)(response + 1); ptr < (const char*)header + header->size(); ptr += LOG_HEADER_SIZE + qLogger::getLogSize(ptr))
+                {
+                    push.ids.push_back(qLogger::getLogId(ptr));
+                }
+            }
+            pushes.push_back(push);
+        }
+        return pushes;
+    }
+
+    // Return responses queued for peer and remove all responses from queue
+    static std::vector<RequestResponseHeader*> takeResponses(const Peer* peer)
+    {
+        std::vector<RequestResponseHeader*> result;
+        while (responseQueueElementTail != responseQueueElementHead)
+        {
+            if (responseQueueElements[responseQueueElementTail].peer == peer)
+            {
+                result.push_back((RequestResponseHeader*)&responseQueueBuffer[responseQueueElements[responseQueueElementTail].offset]);
+            }
+            responseQueueElementTail++;
+        }
+        return result;
+    }
+};
+
+TEST_F(TestLogging, WriterWaitsUntilSegmentIsSaved)
+{
+    // Saving fails in NO_UEFI, a failed save is retried later
+    const unsigned long long firstId = logTestMessage();
+    while (logger.currentSegment < 1)
+    {
+        logTestMessage();
+    }
+    logger.processDiskStorage();
+    logger.processDiskStorage();
+    EXPECT_EQ(logger.nextSegmentToPersist, 0);
+    EXPECT_EQ(logger.numberOfFailedSegmentSaves, 2);
+    EXPECT_EQ(logger.getSegment(0).state, qLogger::SEGMENT_SEALED);
+
+    // The writer doesn't reuse the RAM of segment 0 before it has been saved
+    std::atomic<bool> writerDone = false;
+    std::thread writer([this, &writerDone]()
+        {
+            while (logger.currentSegment < 2)
+            {
+                logTestMessage();
+            }
+            writerDone = true;
+        });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_FALSE(writerDone);
+    EXPECT_EQ(logger.currentSegment, 1);
+    EXPECT_EQ(logger.getSegment(1).state, qLogger::SEGMENT_SEALED);
+    EXPECT_TRUE(isTestMessageInRam(firstId));
+
+    // After the main loop has saved segment 0, the writer continues and no segment is dropped
+    markSegmentsSaved(1);
+    writer.join();
+    EXPECT_TRUE(writerDone);
+    EXPECT_EQ(logger.currentSegment, 2);
+    EXPECT_EQ(logger.getSegment(0).state, qLogger::SEGMENT_PERSISTED);
+    EXPECT_EQ(logger.getSegment(1).state, qLogger::SEGMENT_SEALED);
+    EXPECT_FALSE(isTestMessageInRam(firstId));
+    EXPECT_TRUE(isTestMessageInRam(firstId + testMessagesPerSegment));
+}
+
+TEST_F(TestLogging, ResetKeepsUnsavedSegmentsOfPreviousEpoch)
+{
+    logTestMessage();
+    while (logger.currentSegment < 1)
+    {
+        logTestMessage();
+    }
+    const unsigned long long previousEpochSize = logger.getSegment(1).size;
+    EXPECT_GT(previousEpochSize, 0);
+
+    // New epoch continues with next segment instead of overwriting segment 1 in RAM (segment 0 has been saved)
+    markSegmentsSaved(1);
+    system.epoch++;
+    system.tick += 10000;
+    logger.reset(system.tick);
+    logger.registerNewTx(system.tick, 0);
+    EXPECT_EQ(logger.currentSegment, 2);
+    EXPECT_EQ(logger.firstSegmentOfEpoch, 2);
+    EXPECT_EQ(logger.nextSegmentToPersist, 1);
+    EXPECT_EQ(logger.getSegment(1).state, qLogger::SEGMENT_SEALED);
+    EXPECT_EQ(logger.getSegment(1).epoch, system.epoch - 1);
+    EXPECT_EQ(logger.getSegment(1).size, previousEpochSize);
+    EXPECT_EQ(logger.getSegment(2).epoch, system.epoch);
+    EXPECT_EQ(logger.getRamSegmentData(0), nullptr);
+
+    // Log IDs restart in new epoch
+    EXPECT_EQ(logTestMessage(), 0);
+    EXPECT_TRUE(isTestMessageInRam(0));
+    EXPECT_FALSE(isTestMessageInRam(1));
+
+    // Resetting without logs in current segment reuses the segment
+    markSegmentsSaved(2);
+    system.epoch++;
+    logger.reset(system.tick);
+    EXPECT_EQ(logger.currentSegment, 3);
+    logger.reset(system.tick);
+    EXPECT_EQ(logger.currentSegment, 3);
+    EXPECT_EQ(logger.firstSegmentOfEpoch, 3);
+}
+
+TEST_F(TestLogging, PendingDiskRequestsAreOnlyAnsweredOnSameConnection)
+{
+    const unsigned long long firstId = logTestMessage();
+    while (logger.currentSegment < 1)
+    {
+        logTestMessage();
+    }
+    markSegmentsSaved(1);
+    while (logger.currentSegment < 2)
+    {
+        logTestMessage();
+    }
+
+    // Segment 0 has been saved, so requests are deferred until it is loaded
+    EXPECT_FALSE(qLogger::respondLog(&testPeers[0], 11, firstId, firstId, true));
+    EXPECT_FALSE(qLogger::respondLog(&testPeers[1], 22, firstId, firstId, true));
+    EXPECT_EQ(logger.numberOfPendingDiskRequests, 2);
+    EXPECT_TRUE(takeResponses(&testPeers[0]).empty());
+
+    // Peer slot 1 is used by another connection before the segment is loaded
+    connectPeer(testPeers[1], (void*)0x2000);
+
+    // Loading fails in NO_UEFI, so empty response is sent to the requestor that is still connected
+    logger.processDiskStorage();
+    EXPECT_EQ(logger.numberOfPendingDiskRequests, 0);
+    std::vector<RequestResponseHeader*> responses = takeResponses(&testPeers[0]);
+    ASSERT_EQ(responses.size(), 1);
+    EXPECT_EQ(responses[0]->dejavu(), 11);
+    EXPECT_EQ(responses[0]->type(), RespondLog::type);
+    EXPECT_TRUE(takeResponses(&testPeers[1]).empty());
+
+    // Request of closed connection isn't answered either
+    EXPECT_FALSE(qLogger::respondLog(&testPeers[0], 33, firstId, firstId, true));
+    testPeers[0].isClosing = TRUE;
+    logger.processDiskStorage();
+    EXPECT_TRUE(takeResponses(&testPeers[0]).empty());
+
+    // Requests are answered directly if logs are in RAM
+    EXPECT_TRUE(qLogger::respondLog(&testPeers[1], 44, logger.logId - 1, logger.logId - 1, true));
+    responses = takeResponses(&testPeers[1]);
+    ASSERT_EQ(responses.size(), 1);
+    EXPECT_EQ(responses[0]->dejavu(), 44);
+    EXPECT_EQ(responses[0]->size(), sizeof(RequestResponseHeader) + LOG_HEADER_SIZE + testMessageSize);
+}
+
+TEST_F(TestLogging, SubscriptionPushesLogsOfCompletedTicksWithFlowControl)
+{
+    const m256i keyA(1, 2, 3, 4), keyB(5, 6, 7, 8);
+    using Ids = std::vector<unsigned long long>;
+    subscribe(testPeers[0], 77, 0, qLogger::getMessageTypeFlag(QU_TRANSFER), 2);
+
+    // logs of current tick are not pushed before tick processor completes the tick
+    const unsigned long long id0 = logQuTransfer(keyA, keyB, 1);
+    logger.logMessage(16, CUSTOM_MESSAGE, message.data());
+    EXPECT_TRUE(processSubscriptions(testPeers[0]).empty());
+    logger.tickCompleted();
+    system.tick++;
+    const unsigned long long id1 = logQuTransfer(keyB, keyA, 2);
+    std::vector<Push> pushes = processSubscriptions(testPeers[0]);
+    ASSERT_EQ(pushes.size(), 1);
+    EXPECT_EQ(pushes[0].dejavu, 77);
+    EXPECT_EQ(pushes[0].fromID, 0);
+    EXPECT_EQ(pushes[0].nextID, id0 + 2);
+    EXPECT_EQ(pushes[0].ids, Ids({ id0 }));
+    EXPECT_TRUE(processSubscriptions(testPeers[0]).empty());
+
+    // at most 2 messages are pushed without acknowledgement
+    logger.tickCompleted();
+    system.tick++;
+    const unsigned long long id2 = logQuTransfer(keyB, keyA, 3);
+    pushes = processSubscriptions(testPeers[0]);
+    ASSERT_EQ(pushes.size(), 1);
+    EXPECT_EQ(pushes[0].fromID, id0 + 2);
+    EXPECT_EQ(pushes[0].ids, Ids({ id1 }));
+    logger.tickCompleted();
+    system.tick++;
+    EXPECT_TRUE(processSubscriptions(testPeers[0]).empty());
+    acknowledge(testPeers[0], id0 + 2);
+    pushes = processSubscriptions(testPeers[0]);
+    ASSERT_EQ(pushes.size(), 1);
+    EXPECT_EQ(pushes[0].fromID, id1 + 1);
+    EXPECT_EQ(pushes[0].nextID, id2 + 1);
+    EXPECT_EQ(pushes[0].ids, Ids({ id2 }));
+
+    // acknowledgement from other connection in same peer slot is ignored and subscription ends
+    connectPeer(testPeers[0], (void*)0x3000);
+    acknowledge(testPeers[0], id2 + 1);
+    logQuTransfer(keyA, keyB, 4);
+    logger.tickCompleted();
+    EXPECT_TRUE(processSubscriptions(testPeers[0]).empty());
+    EXPECT_EQ(logger.logSubscriptions[0].peer, nullptr);
+
+    // new epoch ends subscriptions
+    subscribe(testPeers[1], 88, 0, qLogger::getMessageTypeFlag(QU_TRANSFER), 2);
+    EXPECT_EQ(processSubscriptions(testPeers[1]).size(), 1);
+    logger.reset(system.tick);
+    logger.registerNewTx(system.tick, 0);
+    logQuTransfer(keyA, keyB, 5);
+    logger.tickCompleted();
+    EXPECT_TRUE(processSubscriptions(testPeers[1]).empty());
+}
+
+TEST_F(TestLogging, SubscriptionResendsUnacknowledgedPushes)
+{
+    const m256i keyA(1, 2, 3, 4), keyB(5, 6, 7, 8);
+    using Ids = std::vector<unsigned long long>;
+    subscribe(testPeers[0], 77, 0, qLogger::getMessageTypeFlag(QU_TRANSFER), 3);
+
+    const unsigned long long id0 = logQuTransfer(keyA, keyB, 1);
+    logger.tickCompleted();
+    system.tick++;
+    std::vector<Push> pushes = processSubscriptions(testPeers[0]);
+    ASSERT_EQ(pushes.size(), 1);
+    acknowledge(testPeers[0], pushes[0].nextID);
+
+    // pushes get lost, for example because the response queue is full
+    const unsigned long long id1 = logQuTransfer(keyA, keyB, 2);
+    logger.tickCompleted();
+    system.tick++;
+    EXPECT_EQ(processSubscriptions(testPeers[0]).size(), 1);
+    const unsigned long long id2 = logQuTransfer(keyA, keyB, 3);
+    logger.tickCompleted();
+    system.tick++;
+    EXPECT_EQ(processSubscriptions(testPeers[0]).size(), 1);
+    EXPECT_EQ(logger.logSubscriptions[0].numberOfUnacknowledged, 2);
+
+    // no resend before timeout
+    EXPECT_TRUE(processSubscriptions(testPeers[0]).empty());
+
+    // after timeout, logs after last acknowledgement are sent again
+    frequency = 1000;
+    const unsigned long long waitBegin = __rdtsc();
+    while (__rdtsc() - waitBegin <= LOG_SUBSCRIPTION_ACK_TIMEOUT * frequency)
+    {
+        _mm_pause();
+    }
+    pushes = processSubscriptions(testPeers[0]);
+    ASSERT_EQ(pushes.size(), 1);
+    EXPECT_EQ(pushes[0].fromID, id0 + 1);
+    EXPECT_EQ(pushes[0].nextID, id2 + 1);
+    EXPECT_EQ(pushes[0].ids, Ids({ id1, id2 }));
+    frequency = 1000000000;
+    acknowledge(testPeers[0], pushes[0].nextID);
+    EXPECT_EQ(logger.logSubscriptions[0].numberOfUnacknowledged, 0);
+    EXPECT_EQ(logger.logSubscriptions[0].acknowledgedNextID, id2 + 1);
+    EXPECT_TRUE(processSubscriptions(testPeers[0]).empty());
+}
+
+TEST_F(TestLogging, LaggingSubscribersLoadOneDiskSegmentPerPass)
+{
+    const m256i keyA(1, 2, 3, 4), keyB(5, 6, 7, 8);
+    const unsigned long long quTransferFlag = qLogger::getMessageTypeFlag(QU_TRANSFER);
+
+    // one transfer at the beginning of segments 0, 1 and 2, segments 0 and 1 are only on disk afterwards
+    const unsigned long long id0 = logQuTransfer(keyA, keyB, 1);
+    while (logger.currentSegment < 1)
+    {
+        logTestMessage();
+    }
+    const unsigned long long id1 = logQuTransfer(keyA, keyB, 2);
+    std::vector<char> segment0(logger.getRamSegmentData(0), logger.getRamSegmentData(0) + logger.getSegment(0).size);
+    markSegmentsSaved(1);
+    while (logger.currentSegment < 2)
+    {
+        logTestMessage();
+    }
+    logQuTransfer(keyA, keyB, 3);
+    markSegmentsSaved(2);
+    while (logger.currentSegment < 3)
+    {
+        logTestMessage();
+    }
+    logger.tickCompleted();
+    EXPECT_EQ(logger.getRamSegmentData(1), nullptr);
+
+    // subscribers lagging in different segments are not served before their segment is loaded, only the segment of
+    // the first one is requested
+    subscribe(testPeers[0], 11, id0, quTransferFlag, 1);
+    subscribe(testPeers[1], 22, id1, quTransferFlag, 1);
+    EXPECT_TRUE(processSubscriptions(testPeers[0]).empty());
+    EXPECT_EQ(logger.subscriptionDiskSegment, 0);
+    EXPECT_EQ(logger.logSubscriptions[1].numberOfUnacknowledged, 0);
+
+    // loading fails in NO_UEFI, so pretend that processDiskStorage() has loaded segment 0
+    logger.processDiskStorage();
+    EXPECT_EQ(logger.subscriptionDiskSegment, -1);
+    copyMem(logger.logDiskCache, segment0.data(), segment0.size());
+    logger.logDiskCacheSegment = 0;
+
+    // first subscriber is served from the cached segment, which is kept in this pass
+    std::vector<Push> pushes = processSubscriptions(testPeers[0]);
+    ASSERT_EQ(pushes.size(), 1);
+    EXPECT_EQ(pushes[0].ids, std::vector<unsigned long long>({ id0 }));
+    EXPECT_EQ(pushes[0].nextID, logger.getSegment(1).firstLogId);
+    EXPECT_EQ(logger.subscriptionDiskSegment, -1);
+    EXPECT_EQ(logger.logSubscriptions[1].numberOfUnacknowledged, 0);
+
+    // while the first subscriber waits for acknowledgement, the segment of the second one is requested
+    EXPECT_TRUE(processSubscriptions(testPeers[0]).empty());
+    EXPECT_EQ(logger.subscriptionDiskSegment, 1);
+}
+
+TEST_F(TestLogging, FilteredLogMatchesTypesAndEntities)
+{
+    const m256i keyA(1, 2, 3, 4), keyB(5, 6, 7, 8), keyC(9, 10, 11, 12), keyUnused(13, 14, 15, 16);
+    const unsigned long long quTransferFlag = qLogger::getMessageTypeFlag(QU_TRANSFER);
+    const unsigned long long anyType = 0xffffffffffffffffULL;
+
+    const unsigned long long idAB = logQuTransfer(keyA, keyB, 10);
+    const unsigned long long idCustom = logger.logId;
+    logger.logMessage(16, CUSTOM_MESSAGE, message.data());
+    system.tick++;
+    logger.registerNewTx(system.tick, 0);
+    const unsigned long long idBC = logQuTransfer(keyB, keyC, 20);
+    system.tick++;
+    logger.registerNewTx(system.tick, 0);
+    const unsigned long long idCA = logQuTransfer(keyC, keyA, 30);
+    const unsigned long long lastId = logger.logId - 1;
+
+    unsigned long long nextID;
+    using Ids = std::vector<unsigned long long>;
+    EXPECT_EQ(requestFilteredLog(0, lastId, anyType, 0xffffffff, {}, nextID), Ids({ idAB, idCustom, idBC, idCA }));
+    EXPECT_EQ(nextID, lastId + 1);
+    EXPECT_EQ(requestFilteredLog(0, lastId, quTransferFlag, 0xffffffff, {}, nextID), Ids({ idAB, idBC, idCA }));
+    EXPECT_EQ(requestFilteredLog(0, lastId, qLogger::getMessageTypeFlag(CUSTOM_MESSAGE), 0xffffffff, {}, nextID), Ids({ idCustom }));
+
+    // source and destination are matched, ticks without any requested entity are skipped
+    EXPECT_EQ(requestFilteredLog(0, lastId, anyType, 0xffffffff, { keyA }, nextID), Ids({ idAB, idCA }));
+    EXPECT_EQ(requestFilteredLog(0, lastId, anyType, 0xffffffff, { keyUnused, keyB }, nextID), Ids({ idAB, idBC }));
+    EXPECT_EQ(requestFilteredLog(0, lastId, anyType, 0xffffffff, { keyUnused }, nextID), Ids());
+    EXPECT_EQ(nextID, lastId + 1);
+
+    // contract filter only matches contract messages
+    EXPECT_EQ(requestFilteredLog(0, lastId, anyType, 1, {}, nextID), Ids());
+    EXPECT_EQ(nextID, lastId + 1);
+
+    // range is respected
+    EXPECT_EQ(requestFilteredLog(idBC, idBC, anyType, 0xffffffff, {}, nextID), Ids({ idBC }));
+    EXPECT_EQ(nextID, idBC + 1);
+
+    // invalid requests get empty response
+    EXPECT_EQ(requestFilteredLog(0, lastId, anyType, 0xffffffff, {}, nextID, 1), Ids());
+    EXPECT_EQ(nextID, 0xffffffffffffffffULL);
+    EXPECT_EQ(requestFilteredLog(lastId, 0, anyType, 0xffffffff, {}, nextID), Ids());
+    EXPECT_EQ(nextID, 0xffffffffffffffffULL);
+    EXPECT_EQ(requestFilteredLog(lastId + 1, lastId + 1, anyType, 0xffffffff, {}, nextID), Ids());
+    EXPECT_EQ(nextID, 0xffffffffffffffffULL);
+    std::vector<m256i> tooManyKeys(LOG_FILTER_MAX_PUBLIC_KEYS + 1, keyA);
+    EXPECT_EQ(requestFilteredLog(0, lastId, anyType, 0xffffffff, tooManyKeys, nextID), Ids());
+    EXPECT_EQ(nextID, 0xffffffffffffffffULL);
+
+    // maximum number of public keys is supported
+    std::vector<m256i> maxKeys(LOG_FILTER_MAX_PUBLIC_KEYS, keyUnused);
+    maxKeys.back() = keyC;
+    EXPECT_EQ(requestFilteredLog(0, lastId, anyType, 0xffffffff, maxKeys, nextID), Ids({ idBC, idCA }));
+}
+
+TEST_F(TestLogging, FilteredLogIsPagedBySegmentAndResponseSize)
+{
+    const m256i keyA(1, 2, 3, 4), keyB(5, 6, 7, 8);
+    const unsigned long long quTransferFlag = qLogger::getMessageTypeFlag(QU_TRANSFER);
+
+    // segment 0: transfer followed by large custom messages, segment 1: large custom message and transfers exceeding the
+    // response buffer
+    const unsigned long long firstTransferId = logQuTransfer(keyA, keyB, 1);
+    while (logger.currentSegment < 1)
+    {
+        logTestMessage();
+    }
+    const unsigned long long firstIdOfSegment1 = logger.getSegment(1).firstLogId;
+    const unsigned long long firstTransferIdOfSegment1 = logger.logId;
+    const unsigned int transferLogSize = LOG_HEADER_SIZE + offsetof(QuTransfer, _terminator);
+    const unsigned int transfersPerResponse = (LOG_FILTER_RESPONSE_BUFFER_SIZE - sizeof(RespondFilteredLog)) / transferLogSize;
+    for (unsigned int i = 0; i < transfersPerResponse + 10; i++)
+    {
+        logQuTransfer(keyA, keyB, i);
+    }
+    const unsigned long long lastId = logger.logId - 1;
+
+    // first response ends at end of segment 0
+    unsigned long long nextID;
+    std::vector<unsigned long long> ids = requestFilteredLog(0, lastId, quTransferFlag, 0xffffffff, { keyB }, nextID);
+    EXPECT_EQ(ids, std::vector<unsigned long long>({ firstTransferId }));
+    EXPECT_EQ(nextID, firstIdOfSegment1);
+
+    // second response is limited by response buffer size
+    ids = requestFilteredLog(nextID, lastId, quTransferFlag, 0xffffffff, { keyB }, nextID);
+    ASSERT_EQ(ids.size(), transfersPerResponse);
+    EXPECT_EQ(ids.front(), firstTransferIdOfSegment1);
+    EXPECT_EQ(ids.back(), firstTransferIdOfSegment1 + transfersPerResponse - 1);
+    EXPECT_EQ(nextID, firstTransferIdOfSegment1 + transfersPerResponse);
+
+    // third response has the rest
+    ids = requestFilteredLog(nextID, lastId, quTransferFlag, 0xffffffff, { keyB }, nextID);
+    ASSERT_EQ(ids.size(), 10);
+    EXPECT_EQ(ids.front(), firstTransferIdOfSegment1 + transfersPerResponse);
+    EXPECT_EQ(ids.back(), lastId);
+    EXPECT_EQ(nextID, lastId + 1);
+}
@@ -0,0 +1,186 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/mining/miner_scores.h"
+
+#include <random>
+
+
+// Reference implementation with flat arrays sorted by insertion (as formerly used in processTickTransactionSolution())
+template <unsigned int maxNumberOfMiners>
+struct ReferenceMinerScores
+{
+    m256i minerPublicKeys[maxNumberOfMiners + 1];
+    unsigned int minerScores[maxNumberOfMiners + 1];
+    unsigned int numberOfMiners;
+
+    void reset()
+    {
+        memset(minerPublicKeys, 0, sizeof(minerPublicKeys));
+        memset(minerScores, 0, sizeof(minerScores));
+        numberOfMiners = NUMBER_OF_COMPUTORS;
+    }
+
+    void addSolution(const m256i& publicKey)
+    {
+        unsigned int minerIndex;
+        for (minerIndex = 0; minerIndex < numberOfMiners; minerIndex++)
+        {
+            if (publicKey == minerPublicKeys[minerIndex])
+            {
+                minerScores[minerIndex]++;
+                break;
+            }
+        }
+        if (minerIndex == numberOfMiners
+            && numberOfMiners < maxNumberOfMiners)
+        {
+            minerPublicKeys[numberOfMiners] = publicKey;
+            minerScores[numberOfMiners++] = 1;
+        }
+
+        const m256i tmpPublicKey = minerPublicKeys[minerIndex];
+        const unsigned int tmpScore = minerScores[minerIndex];
+        while (minerIndex > (unsigned int)(minerIndex < NUMBER_OF_COMPUTORS ? 0 : NUMBER_OF_COMPUTORS)
+            && minerScores[minerIndex - 1] < minerScores[minerIndex])
+        {
+            minerPublicKeys[minerIndex] = minerPublicKeys[minerIndex - 1];
+            minerScores[minerIndex] = minerScores[minerIndex - 1];
+            minerPublicKeys[--minerIndex] = tmpPublicKey;
+            minerScores[minerIndex] = tmpScore;
+        }
+    }
+
+    void getCompetitors(m256i* competitorPublicKeys, unsigned int* competitorScores, bool* competitorComputorStatuses)
+    {
+        for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS - QUORUM; i++)
+        {
+            competitorPublicKeys[i] = minerPublicKeys[QUORUM + i];
+            competitorScores[i] = minerScores[QUORUM + i];
+            competitorComputorStatuses[i] = true;
+
+            if (NUMBER_OF_COMPUTORS + i < numberOfMiners)
+            {
+                competitorPublicKeys[i + (NUMBER_OF_COMPUTORS - QUORUM)] = minerPublicKeys[NUMBER_OF_COMPUTORS + i];
+                competitorScores[i + (NUMBER_OF_COMPUTORS - QUORUM)] = minerScores[NUMBER_OF_COMPUTORS + i];
+            }
+            else
+            {
+                competitorScores[i + (NUMBER_OF_COMPUTORS - QUORUM)] = 0;
+            }
+            competitorComputorStatuses[i + (NUMBER_OF_COMPUTORS - QUORUM)] = false;
+        }
+
+        for (unsigned int i = NUMBER_OF_COMPUTORS - QUORUM; i < (NUMBER_OF_COMPUTORS - QUORUM) * 2; i++)
+        {
+            int j = i;
+            const m256i tmpPublicKey = competitorPublicKeys[j];
+            const unsigned int tmpScore = competitorScores[j];
+            const bool tmpComputorStatus = false;
+            while (j
+                && competitorScores[j - 1] < competitorScores[j])
+            {
+                competitorPublicKeys[j] = competitorPublicKeys[j - 1];
+                competitorScores[j] = competitorScores[j - 1];
+                competitorComputorStatuses[j] = competitorComputorStatuses[j - 1];
+                competitorPublicKeys[--j] = tmpPublicKey;
+                competitorScores[j] = tmpScore;
+                competitorComputorStatuses[j] = tmpComputorStatus;
+            }
+        }
+    }
+};
+
+static constexpr unsigned int testMaxNumberOfMiners = 1024;
+static constexpr unsigned int competitorCount = (NUMBER_OF_COMPUTORS - QUORUM) * 2;
+
+static MinerScores<testMaxNumberOfMiners> minerScores;
+static ReferenceMinerScores<testMaxNumberOfMiners> referenceMinerScores;
+
+static m256i rankingPublicKeys[testMaxNumberOfMiners];
+static unsigned int rankingScores[testMaxNumberOfMiners];
+static m256i competitorPublicKeys[competitorCount], referenceCompetitorPublicKeys[competitorCount];
+static unsigned int competitorScores[competitorCount], referenceCompetitorScores[competitorCount];
+static bool competitorComputorStatuses[competitorCount], referenceCompetitorComputorStatuses[competitorCount];
+static m256i topComputors[QUORUM];
+static m256i computors[NUMBER_OF_COMPUTORS];
+
+static void expectEqualToReference()
+{
+    ASSERT_EQ(minerScores.numberOfMiners(), referenceMinerScores.numberOfMiners);
+    minerScores.getRanking(rankingPublicKeys, rankingScores);
+    for (unsigned int i = 0; i < testMaxNumberOfMiners; i++)
+    {
+        EXPECT_EQ(rankingPublicKeys[i], referenceMinerScores.minerPublicKeys[i]);
+        EXPECT_EQ(rankingScores[i], referenceMinerScores.minerScores[i]);
+    }
+
+    minerScores.getTopComputors(topComputors, QUORUM);
+    for (unsigned int i = 0; i < QUORUM; i++)
+        EXPECT_EQ(topComputors[i], referenceMinerScores.minerPublicKeys[i]);
+
+    minerScores.getCompetitors(competitorPublicKeys, competitorScores, competitorComputorStatuses);
+    referenceMinerScores.getCompetitors(referenceCompetitorPublicKeys, referenceCompetitorScores, referenceCompetitorComputorStatuses);
+    for (unsigned int i = 0; i < competitorCount; i++)
+    {
+        EXPECT_EQ(competitorPublicKeys[i], referenceCompetitorPublicKeys[i]);
+        EXPECT_EQ(competitorScores[i], referenceCompetitorScores[i]);
+        EXPECT_EQ(competitorComputorStatuses[i], referenceCompetitorComputorStatuses[i]);
+    }
+}
+
+static m256i testPublicKey(unsigned int id)
+{
+    // keys with many collisions in hash index
+    return m256i(id << 8, id, 0, 0);
+}
+
+TEST(TestCoreMinerScores, SameRankingAsSortedArrays)
+{
+    std::mt19937_64 gen64(42);
+
+    for (int run = 0; run < 4; run++)
+    {
+        minerScores.reset();
+        referenceMinerScores.reset();
+        memset(competitorPublicKeys, 0, sizeof(competitorPublicKeys));
+        memset(referenceCompetitorPublicKeys, 0, sizeof(referenceCompetitorPublicKeys));
+        expectEqualToReference();
+
+        // more miners than capacity in later runs
+        const unsigned int keyCount = (run < 2) ? 800 : 1200;
+        for (int step = 0; step < 3000; step++)
+        {
+            const unsigned int op = gen64() % 1000;
+            if (op == 0)
+            {
+                // new computor list, partly overlapping with current candidates and computors
+                for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+                {
+                    computors[i] = testPublicKey((unsigned int)(gen64() % keyCount) + 1);
+                    referenceMinerScores.minerPublicKeys[i] = computors[i];
+                }
+                minerScores.setComputors(computors);
+            }
+            else if (op == 1)
+            {
+                // save and load
+                minerScores.getRanking(rankingPublicKeys, rankingScores);
+                minerScores.reset();
+                minerScores.setRanking(rankingPublicKeys, rankingScores, referenceMinerScores.numberOfMiners);
+            }
+            else
+            {
+                // skewed distribution of solutions
+                const unsigned int id = (unsigned int)(gen64() % (1 + gen64() % keyCount)) + 1;
+                minerScores.addSolution(testPublicKey(id));
+                referenceMinerScores.addSolution(testPublicKey(id));
+            }
+
+            if (step % 100 == 0)
+                expectEqualToReference();
+        }
+        expectEqualToReference();
+    }
+}
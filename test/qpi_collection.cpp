@@ -3,10 +3,39 @@
 #include "gtest/gtest.h"
 
 static void* __scratchpadBuffer = nullptr;
-static void* __scratchpad()
+static bool __scratchpadAcquired = false;
+static bool __scratchpadTemporary = false;
+static void* __tryAcquireScratchpad(unsigned long long size)
 {
+    if (__scratchpadAcquired || !__scratchpadBuffer)
+        return nullptr;
+    __scratchpadAcquired = true;
     return __scratchpadBuffer;
 }
+static void* __acquireScratchpad(unsigned long long size)
+{
+    // rebuilding the search tree in add() always needs a scratchpad, so tests not setting up a buffer get a temporary one
+    if (!__scratchpadBuffer)
+    {
+        __scratchpadBuffer = new char[size];
+        __scratchpadTemporary = true;
+    }
+    void* ptr = __tryAcquireScratchpad(size);
+    EXPECT_NE(ptr, nullptr);
+    return ptr;
+}
+static void __releaseScratchpad(void* ptr)
+{
+    EXPECT_TRUE(__scratchpadAcquired);
+    EXPECT_EQ(ptr, __scratchpadBuffer);
+    __scratchpadAcquired = false;
+    if (__scratchpadTemporary)
+    {
+        delete[] (char*)__scratchpadBuffer;
+        __scratchpadBuffer = nullptr;
+        __scratchpadTemporary = false;
+    }
+}
 namespace QPI
 {
     struct QpiContextProcedureCall;
@@ -1313,6 +1342,7 @@ TEST(TestCoreQPI, CollectionCleanup)
         testCollectionCleanupPseudoRandom<256>(10, 123 + i, povCollisions);
         testCollectionCleanupPseudoRandom<16>(10, 12 + i, povCollisions);
     }
+    EXPECT_FALSE(__scratchpadAcquired);
     delete[] __scratchpadBuffer;
     __scratchpadBuffer = nullptr;
 }
@@ -1326,6 +1356,7 @@ TEST(TestCoreQPI, CollectionCleanupWithPovCollisions)
     testCollectionMultiPovOneElement<32>(cleanupAfterEachRemove);
     testCollectionMultiPovOneElement<64>(cleanupAfterEachRemove);
     testCollectionMultiPovOneElement<128>(cleanupAfterEachRemove);
+    EXPECT_FALSE(__scratchpadAcquired);
     delete[] __scratchpadBuffer;
     __scratchpadBuffer = nullptr;
 }
@@ -1474,6 +1505,7 @@ TEST(TestCoreQPI, CollectionPerformance)
     durations.push_back(testCollectionPerformance<512>(16, 333));
     descriptions.push_back("[CollectionPerformance] Collection<512>(16, 333)");
 
+    EXPECT_FALSE(__scratchpadAcquired);
     delete[] __scratchpadBuffer;
     __scratchpadBuffer = nullptr;
 
@@ -1489,3 +1521,149 @@ TEST(TestCoreQPI, CollectionPerformance)
         std::cout << "* [CollectionPerformance] Total:\t\t" << total << " ms\n";
     }
 }
+
+template <unsigned long long capacity>
+void testCollectionRemoveAndCompactPseudoRandom(int povs, int seed, bool povCollisions)
+{
+    // add and remove entries with pseudo-random sequence, comparing PoV element counts with reference
+    std::mt19937_64 gen64(seed);
+
+    QPI::collection<unsigned long long, capacity>* coll = new QPI::collection<unsigned long long, capacity>();
+    coll->reset();
+    std::map<QPI::id, unsigned long long> reference;
+
+    for (int op = 0; op < 20000; ++op)
+    {
+        if (gen64() % 100 < 60)
+        {
+            // add to collection (slots of removed PoVs that could not be compacted within budget may still require cleanup)
+            QPI::id pov = (povCollisions) ? QPI::id(0, 0, 0, gen64() % povs) : QPI::id(gen64() % povs, 0, 0, 0);
+            if (coll->population() == capacity)
+            {
+                continue;
+            }
+            QPI::sint64 value = gen64(), priority = gen64();
+            if (coll->add(pov, value, priority) == QPI::NULL_INDEX)
+            {
+                coll->cleanup();
+                EXPECT_NE(coll->add(pov, value, priority), QPI::NULL_INDEX);
+            }
+            ++reference[pov];
+        }
+        else if (coll->population() > 0)
+        {
+            // remove from collection (also testing next index returned by removeAndCompact)
+            QPI::sint64 removeIdx = gen64() % coll->population();
+            QPI::id pov = coll->pov(removeIdx);
+            QPI::sint64 followingRemovedIndex = coll->nextElementIndex(removeIdx);
+            if (followingRemovedIndex != QPI::NULL_INDEX)
+            {
+                unsigned long long followingRemovedValue = coll->element(followingRemovedIndex);
+                QPI::sint64 followingRemovedPrio = coll->priority(followingRemovedIndex);
+                followingRemovedIndex = coll->removeAndCompact(removeIdx);
+                EXPECT_EQ(followingRemovedValue, coll->element(followingRemovedIndex));
+                EXPECT_EQ(followingRemovedPrio, coll->priority(followingRemovedIndex));
+            }
+            else
+            {
+                EXPECT_EQ(coll->removeAndCompact(removeIdx), QPI::NULL_INDEX);
+            }
+            if (--reference[pov] == 0)
+            {
+                reference.erase(pov);
+                EXPECT_EQ(coll->population(pov), 0);
+                EXPECT_EQ(coll->headIndex(pov), QPI::NULL_INDEX);
+            }
+        }
+
+        if (op % 500 == 0)
+        {
+            EXPECT_EQ(getPovElementCounts(*coll), reference);
+            for (const auto& id_count_pair : reference)
+            {
+                checkPriorityQueue(*coll, id_count_pair.first);
+            }
+        }
+    }
+
+    delete coll;
+}
+
+TEST(TestCoreQPI, CollectionRemoveAndCompact)
+{
+    __scratchpadBuffer = new char[10 * 1024 * 1024];
+    for (int i = 0; i < 2; ++i)
+    {
+        bool povCollisions = false;
+        testCollectionRemoveAndCompactPseudoRandom<512>(300, 12345 + i, povCollisions);
+        testCollectionRemoveAndCompactPseudoRandom<256>(256, 1234 + i, povCollisions);
+        testCollectionRemoveAndCompactPseudoRandom<256>(10, 123 + i, povCollisions);
+        testCollectionRemoveAndCompactPseudoRandom<16>(10, 12 + i, povCollisions);
+
+        povCollisions = true;
+        testCollectionRemoveAndCompactPseudoRandom<512>(300, 12345 + i, povCollisions);
+        testCollectionRemoveAndCompactPseudoRandom<256>(256, 1234 + i, povCollisions);
+        testCollectionRemoveAndCompactPseudoRandom<256>(10, 123 + i, povCollisions);
+        testCollectionRemoveAndCompactPseudoRandom<16>(10, 12 + i, povCollisions);
+    }
+    EXPECT_FALSE(__scratchpadAcquired);
+    delete[] __scratchpadBuffer;
+    __scratchpadBuffer = nullptr;
+}
+
+// Measure worst-case duration of a single remove (including cleanup when done after each 1000 removals)
+template <unsigned long long capacity>
+long long testCollectionWorstCaseRemove(QPI::uint64 povs, bool compact)
+{
+    std::mt19937_64 gen64(113377);
+
+    QPI::collection<QPI::uint64, capacity>* coll = new QPI::collection<QPI::uint64, capacity>();
+    coll->reset();
+    long long maxNanoseconds = 0;
+
+    for (int op = 0; op < 200000; ++op)
+    {
+        if (coll->population() < capacity / 2)
+        {
+            QPI::id pov(gen64() % povs, gen64(), 0, 0);
+            coll->add(pov, gen64(), gen64());
+            continue;
+        }
+        QPI::sint64 removeIdx = gen64() % coll->population();
+        auto t0 = std::chrono::high_resolution_clock::now();
+        if (compact)
+        {
+            coll->removeAndCompact(removeIdx);
+        }
+        else
+        {
+            coll->remove(removeIdx);
+            if (op % 1000 == 0)
+            {
+                coll->cleanup();
+            }
+        }
+        auto t1 = std::chrono::high_resolution_clock::now();
+        maxNanoseconds = std::max(maxNanoseconds, (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+    }
+    coll->cleanup();
+
+    delete coll;
+    return maxNanoseconds;
+}
+
+TEST(TestCoreQPI, CollectionRemovePerformance)
+{
+    constexpr unsigned long long capacity = 1 << 16;
+    __scratchpadBuffer = new char[2 * sizeof(QPI::collection<QPI::uint64, capacity>)];
+
+    long long markAndCleanup = testCollectionWorstCaseRemove<capacity>(capacity, false);
+    long long compact = testCollectionWorstCaseRemove<capacity>(capacity, true);
+
+    EXPECT_FALSE(__scratchpadAcquired);
+    delete[] __scratchpadBuffer;
+    __scratchpadBuffer = nullptr;
+
+    std::cout << "- [CollectionRemovePerformance] Worst case of remove() + cleanup() every 1000 ops:\t" << markAndCleanup << " ns\n";
+    std::cout << "- [CollectionRemovePerformance] Worst case of removeAndCompact():\t\t\t" << compact << " ns\n";
+}
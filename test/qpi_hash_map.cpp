@@ -3,10 +3,26 @@
 #include "gtest/gtest.h"
 
 static void* __scratchpadBuffer = nullptr;
-static void* __scratchpad()
+static bool __scratchpadAcquired = false;
+static void* __tryAcquireScratchpad(unsigned long long size)
 {
+	if (__scratchpadAcquired || !__scratchpadBuffer)
+		return nullptr;
+	__scratchpadAcquired = true;
 	return __scratchpadBuffer;
 }
+static void* __acquireScratchpad(unsigned long long size)
+{
+	void* ptr = __tryAcquireScratchpad(size);
+	EXPECT_NE(ptr, nullptr);
+	return ptr;
+}
+static void __releaseScratchpad(void* ptr)
+{
+	EXPECT_TRUE(__scratchpadAcquired);
+	EXPECT_EQ(ptr, __scratchpadBuffer);
+	__scratchpadAcquired = false;
+}
 namespace QPI
 {
 	struct QpiContextProcedureCall;
@@ -18,8 +34,12 @@ typedef void (*USER_PROCEDURE)(const QPI::QpiContextProcedureCall&, void* state,
 #include "../src/contracts/qpi.h"
 #include "../src/contract_core/qpi_hash_map_impl.h"
 #include <unordered_set>
+#include <unordered_map>
 #include <array>
 #include <ranges>
+#include <random>
+#include <chrono>
+#include <iostream>
 
 
 // New KeyT, ValueT combinations for testing need to implement the following functions:
@@ -269,10 +289,77 @@ TYPED_TEST_P(QPIHashMapTest, TestCleanup)
 	EXPECT_NE(returnedIndex, QPI::NULL_INDEX);
 	EXPECT_EQ(hashMap.population(), 4);
 
+	EXPECT_FALSE(__scratchpadAcquired);
 	delete[] __scratchpadBuffer;
 	__scratchpadBuffer = nullptr;
 }
 
+TYPED_TEST_P(QPIHashMapTest, TestRemoveAndCompact)
+{
+	constexpr QPI::uint64 capacity = 8;
+	QPI::HashMap<TypeParam::first_type, TypeParam::second_type, capacity> hashMap;
+	hashMap.reset();
+
+	typedef HashMapTestData<TypeParam::first_type, TypeParam::second_type> TestData;
+
+	std::array<TypeParam, 4> keyValuePairs = TestData::CreateKeyValueTestPairs();
+	auto ids = std::views::keys(keyValuePairs);
+	auto values = std::views::values(keyValuePairs);
+
+	for (int i = 0; i < 4; ++i)
+	{
+		hashMap.set(ids[i], values[i]);
+	}
+
+	// Try to remove key not contained in the hash map.
+	EXPECT_EQ(hashMap.removeByKeyAndCompact(TestData::GetKeyNotInTestPairs()), QPI::NULL_INDEX);
+	EXPECT_EQ(hashMap.population(), 4);
+
+	// Remove by key and index, slots become available without cleanup.
+	EXPECT_NE(hashMap.removeByKeyAndCompact(ids[3]), QPI::NULL_INDEX);
+	hashMap.removeByIndexAndCompact(hashMap.getElementIndex(ids[0]));
+	EXPECT_EQ(hashMap.population(), 2);
+	EXPECT_EQ(hashMap.getElementIndex(ids[0]), QPI::NULL_INDEX);
+	EXPECT_EQ(hashMap.getElementIndex(ids[3]), QPI::NULL_INDEX);
+	for (int i = 1; i < 3; ++i)
+	{
+		typename TypeParam::second_type value;
+		EXPECT_TRUE(hashMap.get(ids[i], value));
+		EXPECT_EQ(value, values[i]);
+	}
+
+	// Removing and adding repeatedly does not require cleanup, because no slots are marked for removal
+	// (with removeByKey() set() would fail after capacity removals).
+	for (int j = 0; j < 10; ++j)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			EXPECT_NE(hashMap.set(ids[i], values[i]), QPI::NULL_INDEX);
+		}
+		EXPECT_EQ(hashMap.population(), 4);
+		for (int i = 0; i < 4; ++i)
+		{
+			EXPECT_NE(hashMap.removeByKeyAndCompact(ids[(i + j) % 4]), QPI::NULL_INDEX);
+		}
+		EXPECT_EQ(hashMap.population(), 0);
+	}
+
+	// In a full hash map no empty slot is reached, so the removed slot is marked for removal.
+	QPI::HashMap<TypeParam::first_type, TypeParam::second_type, 4> fullHashMap;
+	fullHashMap.reset();
+	for (int i = 0; i < 4; ++i)
+	{
+		EXPECT_NE(fullHashMap.set(ids[i], values[i]), QPI::NULL_INDEX);
+	}
+	EXPECT_NE(fullHashMap.removeByKeyAndCompact(ids[2]), QPI::NULL_INDEX);
+	EXPECT_EQ(fullHashMap.population(), 3);
+	EXPECT_EQ(fullHashMap.set(ids[2], values[2]), QPI::NULL_INDEX);
+	for (int i = 0; i < 4; ++i)
+	{
+		EXPECT_EQ(fullHashMap.getElementIndex(ids[i]) == QPI::NULL_INDEX, i == 2);
+	}
+}
+
 TYPED_TEST_P(QPIHashMapTest, TestCleanupPerformanceShortcuts)
 {
 	constexpr QPI::uint64 capacity = 4;
@@ -319,10 +406,138 @@ TEST(NonTypedQPIHashMapTest, TestCleanupLargeMapSameHashes)
 	// Cleanup will have to iterate through the whole map to find an empty slot for the last element.
 	hashMap.cleanup();
 
+	EXPECT_FALSE(__scratchpadAcquired);
 	delete[] __scratchpadBuffer;
 	__scratchpadBuffer = nullptr;
 }
 
+// Random operations with many hash collisions, comparing with std::unordered_map
+template <QPI::uint64 capacity>
+static void testHashMapRemoveAndCompactRandom(QPI::uint64 seed, QPI::uint64 numberOfHashes)
+{
+	QPI::HashMap<QPI::id, QPI::uint64, capacity>* hashMap = new QPI::HashMap<QPI::id, QPI::uint64, capacity>();
+	hashMap->reset();
+	__scratchpadBuffer = new char[2 * sizeof(*hashMap)];
+	std::unordered_map<QPI::uint64, QPI::uint64> reference;
+	std::mt19937_64 gen64(seed);
+
+	for (int op = 0; op < 20000; ++op)
+	{
+		// key with hash out of small range to get long probe sequences
+		const QPI::uint64 keyNumber = gen64() % (2 * capacity);
+		const QPI::id key(keyNumber % numberOfHashes, keyNumber, 0, 0);
+		if (gen64() % 100 < 55 && reference.size() < capacity * 3 / 4)
+		{
+			// Slots marked for removal (if compaction budget is exceeded) may still require cleanup
+			const QPI::uint64 value = gen64();
+			if (hashMap->set(key, value) == QPI::NULL_INDEX)
+			{
+				hashMap->cleanup();
+				EXPECT_NE(hashMap->set(key, value), QPI::NULL_INDEX);
+			}
+			reference[keyNumber] = value;
+		}
+		else if (gen64() % 2 && hashMap->population())
+		{
+			const QPI::sint64 elementIndex = hashMap->removeByKeyAndCompact(key);
+			EXPECT_EQ(elementIndex != QPI::NULL_INDEX, reference.erase(keyNumber) == 1);
+		}
+		else
+		{
+			hashMap->removeByIndexAndCompact(gen64());
+			reference.clear();
+			for (QPI::uint64 i = 0; i < 2 * capacity; ++i)
+			{
+				QPI::uint64 value;
+				if (hashMap->get(QPI::id(i % numberOfHashes, i, 0, 0), value))
+					reference[i] = value;
+			}
+		}
+
+		ASSERT_EQ(hashMap->population(), reference.size());
+		if (op % 100 == 0)
+		{
+			for (const auto& entry : reference)
+			{
+				QPI::uint64 value = 0;
+				EXPECT_TRUE(hashMap->get(QPI::id(entry.first % numberOfHashes, entry.first, 0, 0), value));
+				EXPECT_EQ(value, entry.second);
+			}
+		}
+	}
+
+	EXPECT_FALSE(__scratchpadAcquired);
+	delete[] __scratchpadBuffer;
+	__scratchpadBuffer = nullptr;
+	delete hashMap;
+}
+
+TEST(NonTypedQPIHashMapTest, TestRemoveAndCompactRandom)
+{
+	testHashMapRemoveAndCompactRandom<16>(42, 4);
+	testHashMapRemoveAndCompactRandom<64>(43, 64);
+	testHashMapRemoveAndCompactRandom<256>(44, 8);
+	testHashMapRemoveAndCompactRandom<1024>(45, 1024);
+	testHashMapRemoveAndCompactRandom<1024>(46, 32);
+}
+
+// Measure worst-case duration of a single remove (including cleanup when done after each 1000 removals)
+template <QPI::uint64 capacity>
+static long long testHashMapWorstCaseRemove(bool compact)
+{
+	QPI::HashMap<QPI::id, QPI::uint64, capacity>* hashMap = new QPI::HashMap<QPI::id, QPI::uint64, capacity>();
+	hashMap->reset();
+	std::mt19937_64 gen64(1234);
+	std::vector<QPI::id> keys;
+	long long maxNanoseconds = 0;
+
+	for (int op = 0; op < 200000; ++op)
+	{
+		if (keys.size() < capacity / 2)
+		{
+			keys.push_back(QPI::id(gen64(), gen64(), 0, 0));
+			hashMap->set(keys.back(), op);
+			continue;
+		}
+		const size_t i = gen64() % keys.size();
+		auto t0 = std::chrono::high_resolution_clock::now();
+		if (compact)
+		{
+			hashMap->removeByKeyAndCompact(keys[i]);
+		}
+		else
+		{
+			hashMap->removeByKey(keys[i]);
+			if (op % 1000 == 0)
+				hashMap->cleanup();
+		}
+		auto t1 = std::chrono::high_resolution_clock::now();
+		maxNanoseconds = std::max(maxNanoseconds, (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+		keys[i] = keys.back();
+		keys.pop_back();
+	}
+	hashMap->cleanup();
+
+	delete hashMap;
+	return maxNanoseconds;
+}
+
+TEST(NonTypedQPIHashMapTest, TestRemovePerformance)
+{
+	constexpr QPI::uint64 capacity = 1 << 18;
+	__scratchpadBuffer = new char[2 * sizeof(QPI::HashMap<QPI::id, QPI::uint64, capacity>)];
+
+	long long markAndCleanup = testHashMapWorstCaseRemove<capacity>(false);
+	long long compact = testHashMapWorstCaseRemove<capacity>(true);
+
+	EXPECT_FALSE(__scratchpadAcquired);
+	delete[] __scratchpadBuffer;
+	__scratchpadBuffer = nullptr;
+
+	std::cout << "- [HashMapRemovePerformance] Worst case of removeByKey() + cleanup() every 1000 ops:\t" << markAndCleanup << " ns\n";
+	std::cout << "- [HashMapRemovePerformance] Worst case of removeByKeyAndCompact():\t\t\t" << compact << " ns\n";
+}
+
 TYPED_TEST_P(QPIHashMapTest, TestReplace)
 {
 	constexpr QPI::uint64 capacity = 8;
@@ -386,6 +601,7 @@ REGISTER_TYPED_TEST_CASE_P(QPIHashMapTest,
 	TestSet,
 	TestRemove,
 	TestCleanup,
+	TestRemoveAndCompact,
 	TestCleanupPerformanceShortcuts,
 	TestReplace,
 	TestReset
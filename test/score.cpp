@@ -48,7 +48,7 @@ std::map<unsigned int, unsigned long long> gScoreProcessingTime;
 std::map<unsigned long long, unsigned long long> gScoreIndexMap;
 
 // Recursive template to process each element in scoreSettings
-template <unsigned long long i>
+template <unsigned long long i, bool useBitPlaneKernel>
 static void processElement(unsigned char* miningSeed, unsigned char* publicKey, unsigned char* nonce, int sampleIndex)
 {
     if (!filteredSettings.empty()
@@ -57,7 +57,7 @@ static void processElement(unsigned char* miningSeed, unsigned char* publicKey,
         return;
     }
 
-    auto pScore = std::make_unique<ScoreFunction<kDataLength, kSettings[i][NR_NEURONS], kSettings[i][NR_NEIGHBOR_NEURONS], kSettings[i][DURATIONS], 1>>();
+    auto pScore = std::make_unique<ScoreFunction<kDataLength, kSettings[i][NR_NEURONS], kSettings[i][NR_NEIGHBOR_NEURONS], kSettings[i][DURATIONS], 1, useBitPlaneKernel>>();
     pScore->initMemory();
     pScore->initMiningData(miningSeed);
     int x = 0;
@@ -127,19 +127,20 @@ static void processElement(unsigned char* miningSeed, unsigned char* publicKey,
 }
 
 // Main processing function
-template <unsigned long long N, unsigned long long... Is>
+template <unsigned long long N, bool useBitPlaneKernel, unsigned long long... Is>
 static void processHelper(unsigned char* miningSeed, unsigned char* publicKey, unsigned char* nonce, int sampleIndex, std::index_sequence<Is...>)
 {
-    (processElement<Is>(miningSeed, publicKey, nonce, sampleIndex), ...);
+    (processElement<Is, useBitPlaneKernel>(miningSeed, publicKey, nonce, sampleIndex), ...);
 }
 
 // Recursive template to process each element in scoreSettings
-template <unsigned long long N>
+template <unsigned long long N, bool useBitPlaneKernel>
 static void process(unsigned char* miningSeed, unsigned char* publicKey, unsigned char* nonce, int sampleIndex)
 {
-    processHelper<N>(miningSeed, publicKey, nonce, sampleIndex, std::make_index_sequence<N>{});
+    processHelper<N, useBitPlaneKernel>(miningSeed, publicKey, nonce, sampleIndex, std::make_index_sequence<N>{});
 }
 
+template <bool useBitPlaneKernel>
 void runCommonTests()
 {
 #if defined (__AVX512F__) && !GENERIC_K12
@@ -260,7 +261,7 @@ void runCommonTests()
     for (int i = 0; i < samples.size(); ++i)
     {
         int index = samples[i];
-        process<numberOfGeneratedSetting>(miningSeeds[index].m256i_u8, publicKeys[index].m256i_u8, nonces[index].m256i_u8, index);
+        process<numberOfGeneratedSetting, useBitPlaneKernel>(miningSeeds[index].m256i_u8, publicKeys[index].m256i_u8, nonces[index].m256i_u8, index);
 #pragma omp critical
         std::cout << i << ", ";
     }
@@ -284,5 +285,288 @@ void runCommonTests()
 
 TEST(TestQubicScoreFunction, CommonTests)
 {
-    runCommonTests();
+    runCommonTests<false>();
+}
+
+// The bit-plane kernel has to give exactly the same scores as the byte kernel
+TEST(TestQubicScoreFunction, CommonTestsBitPlaneKernel)
+{
+    runCommonTests<true>();
+}
+
+// A burst of solutions processed through the task queue is scored in batches of up to RANDOM2_LANES solutions,
+// whose random2 pools are generated together. Scores have to match the reference implementation.
+TEST(TestQubicScoreFunction, TaskQueueBatches)
+{
+    constexpr unsigned int numberOfTasks = 2 * RANDOM2_LANES + 1;
+    auto sampleString = readCSV(COMMON_TEST_SAMPLES_FILE_NAME);
+    ASSERT_GE(sampleString.size(), numberOfTasks);
+
+    // all tasks use the mining seed of the first sample
+    m256i miningSeed = hexToByte(sampleString[0][0], 32);
+    std::vector<m256i> publicKeys(numberOfTasks);
+    std::vector<m256i> nonces(numberOfTasks);
+    for (unsigned int i = 0; i < numberOfTasks; ++i)
+    {
+        publicKeys[i] = hexToByte(sampleString[i][1], 32);
+        nonces[i] = hexToByte(sampleString[i][2], 32);
+    }
+
+    // one solution buffer, so getTasks() always takes as many tasks as there are lanes
+    auto pScore = std::make_unique<ScoreFunction<kDataLength, kSettings[0][NR_NEURONS], kSettings[0][NR_NEIGHBOR_NEURONS], kSettings[0][DURATIONS], 1>>();
+    pScore->initMemory();
+    pScore->initMiningData(miningSeed);
+    pScore->resetTaskQueue();
+    for (unsigned int i = 0; i < numberOfTasks; ++i)
+    {
+        pScore->addTask(publicKeys[i], miningSeed, nonces[i]);
+    }
+    pScore->startProcessTaskQueue();
+    unsigned int numberOfCalls = 0;
+    while (!pScore->isTaskQueueProcessed())
+    {
+        pScore->tryProcessSolution(0);
+        ++numberOfCalls;
+    }
+    pScore->stopProcessTaskQueue();
+    EXPECT_EQ(numberOfCalls, (numberOfTasks + RANDOM2_LANES - 1) / RANDOM2_LANES);
+
+    auto pReference = std::make_unique<ScoreReferenceImplementation<kDataLength, kSettings[0][NR_NEURONS], kSettings[0][NR_NEIGHBOR_NEURONS], kSettings[0][DURATIONS], 1>>();
+    pReference->initMemory();
+    pReference->initMiningData(miningSeed);
+    for (unsigned int i = 0; i < numberOfTasks; ++i)
+    {
+        unsigned int scoreCacheIndex = pScore->scoreCache.getCacheIndex(publicKeys[i], miningSeed, nonces[i]);
+        int cachedScore = pScore->scoreCache.tryFetching(publicKeys[i], miningSeed, nonces[i], scoreCacheIndex);
+        EXPECT_EQ(cachedScore, (int)(*pReference)(0, publicKeys[i].m256i_u8, nonces[i].m256i_u8)) << "task " << i;
+    }
+}
+
+TEST(TestQubicScoreFunction, TaskQueueScheduling)
+{
+    // 3 solution processors, scoring is not needed to test the scheduling
+    auto pScore = std::make_unique<ScoreFunction<kDataLength, kSettings[0][NR_NEURONS], kSettings[0][NR_NEIGHBOR_NEURONS], kSettings[0][DURATIONS], 3>>();
+    auto& score = *pScore;
+    const m256i miningSeed(1, 2, 3, 4);
+    m256i publicKey[RANDOM2_LANES], taskMiningSeed[RANDOM2_LANES], nonce[RANDOM2_LANES];
+    score.resetTaskQueue();
+
+    // prefetch tasks are processed before the queue is started, current tick tasks are not
+    score.addTask(m256i(1, 0, 0, 0), miningSeed, m256i(1, 0, 0, 0), score.PrefetchTask);
+    score.addTask(m256i(2, 0, 0, 0), miningSeed, m256i(2, 0, 0, 0));
+    EXPECT_EQ(score.getTasks(0, score.CurrentTickTask, publicKey, taskMiningSeed, nonce), 0);
+    EXPECT_FALSE(score.isTaskQueueProcessed());
+    EXPECT_EQ(score.getTasks(0, score.PrefetchTask, publicKey, taskMiningSeed, nonce), 1);
+    EXPECT_EQ(publicKey[0], m256i(1, 0, 0, 0));
+
+    // the current tick task is in the deque of processor 1 and is stolen by processor 2
+    score.startProcessTaskQueue();
+    EXPECT_EQ(score.getTasks(2, score.PrefetchTask, publicKey, taskMiningSeed, nonce), 1);
+    EXPECT_EQ(publicKey[0], m256i(2, 0, 0, 0));
+    EXPECT_EQ(score._nStolenTasks, 1);
+    EXPECT_FALSE(score.isTaskQueueProcessed());
+    score.finishTasks(publicKey, taskMiningSeed, nonce, 1);
+    EXPECT_TRUE(score.isTaskQueueProcessed());
+
+    // duplicates are not queued again, a queued prefetch task is raised to current tick priority
+    score.addTask(m256i(2, 0, 0, 0), miningSeed, m256i(2, 0, 0, 0), score.PrefetchTask);
+    score.addTask(m256i(3, 0, 0, 0), miningSeed, m256i(3, 0, 0, 0), score.PrefetchTask);
+    score.addTask(m256i(4, 0, 0, 0), miningSeed, m256i(4, 0, 0, 0), score.PrefetchTask);
+    score.addTask(m256i(4, 0, 0, 0), miningSeed, m256i(4, 0, 0, 0));
+    EXPECT_EQ(score._nDuplicateTasks, 2);
+    EXPECT_FALSE(score.isTaskQueueProcessed());
+    EXPECT_EQ(score.getTasks(2, score.PrefetchTask, publicKey, taskMiningSeed, nonce), 1);
+    EXPECT_EQ(publicKey[0], m256i(4, 0, 0, 0));
+    score.finishTasks(publicKey, taskMiningSeed, nonce, 1);
+    EXPECT_TRUE(score.isTaskQueueProcessed());
+    EXPECT_EQ(score.getTasks(2, score.PrefetchTask, publicKey, taskMiningSeed, nonce), 1);
+    EXPECT_EQ(publicKey[0], m256i(3, 0, 0, 0));
+    EXPECT_EQ(score.getTasks(2, score.PrefetchTask, publicKey, taskMiningSeed, nonce), 0);
+
+    // tasks being scored during reset are not queued again, finishing them completes the current tick task
+    score.resetTaskQueue();
+    score.addTask(m256i(1, 0, 0, 0), miningSeed, m256i(1, 0, 0, 0));
+    score.addTask(m256i(3, 0, 0, 0), miningSeed, m256i(3, 0, 0, 0));
+    score.startProcessTaskQueue();
+    EXPECT_EQ(score._nDuplicateTasks, 2);
+    EXPECT_EQ(score.getTasks(0, score.PrefetchTask, publicKey, taskMiningSeed, nonce), 0);
+    EXPECT_FALSE(score.isTaskQueueProcessed());
+    publicKey[0] = m256i(1, 0, 0, 0);
+    nonce[0] = m256i(1, 0, 0, 0);
+    publicKey[1] = m256i(3, 0, 0, 0);
+    nonce[1] = m256i(3, 0, 0, 0);
+    taskMiningSeed[0] = taskMiningSeed[1] = miningSeed;
+    score.finishTasks(publicKey, taskMiningSeed, nonce, 2);
+    EXPECT_TRUE(score.isTaskQueueProcessed());
+}
+
+// Replay bursts of solutions like the node does: the tick processor queues the solutions of the current tick while
+// those of the next tick are prefetched, solution processors score them concurrently. Like the waiting loop of the
+// tick processor, the prefetch passes over the next tick many times but adds each transaction slot only once.
+TEST(TestQubicScoreFunction, TaskQueueBurstBenchmark)
+{
+    constexpr unsigned int numberOfProcessors = 4;
+    constexpr unsigned int numberOfBursts = 4;
+    constexpr unsigned int solutionsPerBurst = 6;
+    auto sampleString = readCSV(COMMON_TEST_SAMPLES_FILE_NAME);
+    ASSERT_GE(sampleString.size(), numberOfBursts * solutionsPerBurst);
+
+    // all solutions use the mining seed of the first sample
+    m256i miningSeed = hexToByte(sampleString[0][0], 32);
+    std::vector<m256i> publicKeys(numberOfBursts * solutionsPerBurst);
+    std::vector<m256i> nonces(numberOfBursts * solutionsPerBurst);
+    for (unsigned int i = 0; i < publicKeys.size(); ++i)
+    {
+        publicKeys[i] = hexToByte(sampleString[i][1], 32);
+        nonces[i] = hexToByte(sampleString[i][2], 32);
+    }
+
+    auto pScore = std::make_unique<ScoreFunction<kDataLength, kSettings[0][NR_NEURONS], kSettings[0][NR_NEIGHBOR_NEURONS], kSettings[0][DURATIONS], numberOfProcessors>>();
+    pScore->initMemory();
+    pScore->initMiningData(miningSeed);
+    pScore->resetTaskQueue();
+
+    volatile bool stopProcessors = false;
+    std::vector<std::thread> processors;
+    for (unsigned int i = 1; i < numberOfProcessors; ++i)
+    {
+        processors.emplace_back([&pScore, &stopProcessors, i]()
+            {
+                while (!stopProcessors)
+                {
+                    pScore->tryProcessSolution(i);
+                    std::this_thread::yield();
+                }
+            });
+    }
+
+    for (unsigned int burst = 0; burst < numberOfBursts; ++burst)
+    {
+        // the tick processor is processor 0, it only helps with the current tick
+        auto startTime = std::chrono::high_resolution_clock::now();
+        pScore->resetTaskQueue();
+        for (unsigned int i = burst * solutionsPerBurst; i < (burst + 1) * solutionsPerBurst; ++i)
+        {
+            pScore->addTask(publicKeys[i], miningSeed, nonces[i]);
+        }
+        pScore->startProcessTaskQueue();
+        while (!pScore->isTaskQueueProcessed())
+        {
+            pScore->tryProcessSolution(0, pScore->CurrentTickTask);
+        }
+        pScore->stopProcessTaskQueue();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+        std::cout << "burst " << burst << ": " << solutionsPerBurst << " solutions in " << elapsed << " ms, "
+            << pScore->_nDuplicateTasks << " duplicates, " << pScore->_nStolenTasks << " stolen" << std::endl;
+
+        for (unsigned int i = burst * solutionsPerBurst; i < (burst + 1) * solutionsPerBurst; ++i)
+        {
+            unsigned int scoreCacheIndex = pScore->scoreCache.getCacheIndex(publicKeys[i], miningSeed, nonces[i]);
+            EXPECT_GE(pScore->scoreCache.tryFetching(publicKeys[i], miningSeed, nonces[i], scoreCacheIndex), 0);
+        }
+
+        // prefetch the next burst while waiting for the next tick, until all of its solutions are in the score cache
+        const unsigned int nextBurstBegin = (burst + 1) * solutionsPerBurst;
+        if (nextBurstBegin < publicKeys.size())
+        {
+            const unsigned int duplicateTasks = pScore->_nDuplicateTasks;
+            unsigned long long prefetchFlags = 0;
+            unsigned int numberOfPrefetchedSolutions = 0;
+            for (unsigned int pass = 0; pass < 6000 && numberOfPrefetchedSolutions < solutionsPerBurst; ++pass)
+            {
+                numberOfPrefetchedSolutions = 0;
+                for (unsigned int slot = 0; slot < solutionsPerBurst; ++slot)
+                {
+                    const unsigned int i = nextBurstBegin + slot;
+                    if (!(prefetchFlags & (1ULL << slot)))
+                    {
+                        prefetchFlags |= (1ULL << slot);
+                        pScore->addTask(publicKeys[i], miningSeed, nonces[i], pScore->PrefetchTask);
+                    }
+                    unsigned int scoreCacheIndex = pScore->scoreCache.getCacheIndex(publicKeys[i], miningSeed, nonces[i]);
+                    if (pScore->scoreCache.tryFetching(publicKeys[i], miningSeed, nonces[i], scoreCacheIndex) >= 0)
+                    {
+                        numberOfPrefetchedSolutions++;
+                    }
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            EXPECT_EQ(numberOfPrefetchedSolutions, solutionsPerBurst);
+            EXPECT_EQ(pScore->_nDuplicateTasks, duplicateTasks);
+        }
+    }
+
+    stopProcessors = true;
+    for (auto& processor : processors)
+    {
+        processor.join();
+    }
+}
+
+// A single solution is scored by processor 0 while idle processors help computing its neuron ticks. Scores have to be
+// the same as without helpers and match the reference implementation.
+TEST(TestQubicScoreFunction, HelpersComputeNeuronTicks)
+{
+    constexpr unsigned int numberOfHelpers = 3;
+    constexpr unsigned int numberOfSolutions = 4;
+    auto sampleString = readCSV(COMMON_TEST_SAMPLES_FILE_NAME);
+    ASSERT_GE(sampleString.size(), numberOfSolutions);
+
+    // all solutions use the mining seed of the first sample
+    m256i miningSeed = hexToByte(sampleString[0][0], 32);
+    std::vector<m256i> publicKeys(numberOfSolutions);
+    std::vector<m256i> nonces(numberOfSolutions);
+    for (unsigned int i = 0; i < numberOfSolutions; ++i)
+    {
+        publicKeys[i] = hexToByte(sampleString[i][1], 32);
+        nonces[i] = hexToByte(sampleString[i][2], 32);
+    }
+
+    auto pScore = std::make_unique<ScoreFunction<kDataLength, kSettings[0][NR_NEURONS], kSettings[0][NR_NEIGHBOR_NEURONS], kSettings[0][DURATIONS], 1>>();
+    pScore->initMemory();
+    pScore->initMiningData(miningSeed);
+
+    // without helpers, processor 0 computes all chunks of the neuron ticks itself
+    std::vector<unsigned int> scores(numberOfSolutions);
+    for (unsigned int i = 0; i < numberOfSolutions; ++i)
+    {
+        scores[i] = (*pScore)(0, publicKeys[i], miningSeed, nonces[i]);
+    }
+
+    pScore->initMemory();
+    volatile bool stopHelpers = false;
+    volatile long numberOfHelpCalls = 0;
+    std::vector<std::thread> helpers;
+    for (unsigned int i = 1; i <= numberOfHelpers; ++i)
+    {
+        helpers.emplace_back([&pScore, &stopHelpers, &numberOfHelpCalls, i]()
+            {
+                while (!stopHelpers)
+                {
+                    if (pScore->tryHelpScoring(i))
+                    {
+                        _InterlockedIncrement(&numberOfHelpCalls);
+                    }
+                    std::this_thread::yield();
+                }
+            });
+    }
+    for (unsigned int i = 0; i < numberOfSolutions; ++i)
+    {
+        EXPECT_EQ((*pScore)(0, publicKeys[i], miningSeed, nonces[i]), scores[i]) << "solution " << i;
+    }
+    stopHelpers = true;
+    for (auto& helper : helpers)
+    {
+        helper.join();
+    }
+    EXPECT_GT(numberOfHelpCalls, 0);
+
+    auto pReference = std::make_unique<ScoreReferenceImplementation<kDataLength, kSettings[0][NR_NEURONS], kSettings[0][NR_NEIGHBOR_NEURONS], kSettings[0][DURATIONS], 1>>();
+    pReference->initMemory();
+    pReference->initMiningData(miningSeed);
+    for (unsigned int i = 0; i < numberOfSolutions; ++i)
+    {
+        EXPECT_EQ(scores[i], (*pReference)(0, publicKeys[i].m256i_u8, nonces[i].m256i_u8)) << "solution " << i;
+    }
 }
@@ -24,6 +24,7 @@
 
 #include <chrono>
 #include <random>
+#include <vector>
 
 static bool transfer(const m256i& src, const m256i& dst, long long amount)
 {
@@ -292,16 +293,18 @@ TEST(TestCoreSpectrum, AntiDustEdgeCaseAllInSameBin)
 
 SpectrumStats* getSpectrumStatsLog(long long id)
 {
-    qLogger::BlobInfo bi = logger.logBuf.getBlobInfo(id);
-    EXPECT_EQ(bi.length, LOG_HEADER_SIZE + sizeof(SpectrumStats));
-    return reinterpret_cast<SpectrumStats*>(logger.logBuffer + bi.startIndex + LOG_HEADER_SIZE);
+    const char* log = logger.getLog(id);
+    EXPECT_NE(log, nullptr);
+    EXPECT_EQ(qLogger::getLogSize(log), sizeof(SpectrumStats));
+    return reinterpret_cast<SpectrumStats*>(const_cast<char*>(log) + LOG_HEADER_SIZE);
 }
 
 DustBurning* getDustBurningLog(long long id)
 {
-    qLogger::BlobInfo bi = logger.logBuf.getBlobInfo(id);
-    DustBurning* db = reinterpret_cast<DustBurning*>(logger.logBuffer + bi.startIndex + LOG_HEADER_SIZE);
-    EXPECT_EQ(bi.length, LOG_HEADER_SIZE + db->messageSize());
+    const char* log = logger.getLog(id);
+    EXPECT_NE(log, nullptr);
+    DustBurning* db = reinterpret_cast<DustBurning*>(const_cast<char*>(log) + LOG_HEADER_SIZE);
+    EXPECT_EQ(qLogger::getLogSize(log), db->messageSize());
     return db;
 }
 
@@ -407,3 +410,114 @@ TEST(TestCoreSpectrum, AntiDustEdgeCaseHugeBinZeroBalance)
     test.afterAntiDust();
 }
 
+static m256i parentDigest(const m256i& left, const m256i& right)
+{
+    m256i pair[2] = { left, right }, result;
+    KangarooTwelve64To32(pair, &result);
+    return result;
+}
+
+TEST(TestCoreSpectrum, SpectrumDigestsTickIsResetByChanges)
+{
+    SpectrumTest test;
+    const m256i id1(1, 2, 3, 4), id2(5, 6, 7, 8);
+    increaseEnergy(id1, 1000);
+
+    // digests are up to date after tick processing, until spectrum is changed
+    spectrumDigestsTick = system.tick;
+    EXPECT_FALSE(decreaseEnergy(spectrumIndex(id1), 2000));
+    EXPECT_EQ(spectrumDigestsTick, system.tick);
+    EXPECT_TRUE(decreaseEnergy(spectrumIndex(id1), 100));
+    EXPECT_EQ(spectrumDigestsTick, 0);
+
+    spectrumDigestsTick = system.tick;
+    increaseEnergy(id1, 100);
+    EXPECT_EQ(spectrumDigestsTick, 0);
+
+    spectrumDigestsTick = system.tick;
+    increaseEnergy(id2, 100);
+    EXPECT_EQ(spectrumDigestsTick, 0);
+
+    spectrumDigestsTick = system.tick;
+    reorganizeSpectrum();
+    EXPECT_EQ(spectrumDigestsTick, 0);
+}
+
+TEST(TestCoreSpectrum, MultiProofSiblings)
+{
+    constexpr unsigned int depth = 6;
+    constexpr unsigned int capacity = 1 << depth;
+    std::mt19937_64 gen64(42);
+
+    // build tree
+    m256i digests[capacity * 2 - 1];
+    for (unsigned int i = 0; i < capacity; ++i)
+        digests[i] = m256i(gen64(), gen64(), gen64(), gen64());
+    unsigned int previousLevelBeginning = 0, digestIndex = capacity;
+    for (unsigned int numberOfLeafs = capacity; numberOfLeafs > 1; numberOfLeafs >>= 1)
+    {
+        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+            KangarooTwelve64To32(&digests[previousLevelBeginning + i], &digests[digestIndex++]);
+        previousLevelBeginning += numberOfLeafs;
+    }
+    const m256i& root = digests[capacity * 2 - 2];
+
+    for (int test = 0; test < 200; ++test)
+    {
+        // random sorted leaf indices without duplicates
+        std::vector<unsigned int> leafIndices;
+        const unsigned long long probability = (test < 2) ? test * 100 : gen64() % 100;
+        for (unsigned int i = 0; i < capacity; ++i)
+            if (gen64() % 100 < probability)
+                leafIndices.push_back(i);
+        if (leafIndices.empty())
+            leafIndices.push_back((unsigned int)(gen64() % capacity));
+
+        std::vector<unsigned int> indices = leafIndices;
+        m256i siblings[capacity * depth];
+        const unsigned int numberOfSiblings = getMultiProofSiblings<depth>(indices.data(), (unsigned int)indices.size(), digests, siblings);
+        EXPECT_LE(numberOfSiblings, leafIndices.size() * depth);
+        if (leafIndices.size() == capacity)
+        {
+            EXPECT_EQ(numberOfSiblings, 0);
+        }
+        if (leafIndices.size() == 1)
+        {
+            m256i singleSiblings[depth];
+            getSiblings<depth>(leafIndices[0], digests, singleSiblings);
+            ASSERT_EQ(numberOfSiblings, depth);
+            for (unsigned int j = 0; j < depth; ++j)
+                EXPECT_EQ(siblings[j], singleSiblings[j]);
+        }
+
+        // verify proof like a client, computing the root from the leaves and the siblings
+        std::vector<std::pair<unsigned int, m256i>> nodes;
+        for (unsigned int index : leafIndices)
+            nodes.push_back({ index, digests[index] });
+        unsigned int siblingIndex = 0;
+        for (unsigned int j = 0; j < depth; ++j)
+        {
+            std::vector<std::pair<unsigned int, m256i>> parents;
+            for (size_t i = 0; i < nodes.size(); ++i)
+            {
+                const unsigned int index = nodes[i].first;
+                const m256i node = nodes[i].second;
+                m256i sibling;
+                if (i + 1 < nodes.size() && nodes[i + 1].first == (index ^ 1))
+                {
+                    sibling = nodes[++i].second;
+                }
+                else
+                {
+                    ASSERT_LT(siblingIndex, numberOfSiblings);
+                    sibling = siblings[siblingIndex++];
+                }
+                parents.push_back({ index >> 1, (index & 1) ? parentDigest(sibling, node) : parentDigest(node, sibling) });
+            }
+            nodes = parents;
+        }
+        EXPECT_EQ(siblingIndex, numberOfSiblings);
+        ASSERT_EQ(nodes.size(), 1);
+        EXPECT_EQ(nodes[0].second, root);
+    }
+}
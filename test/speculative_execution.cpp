@@ -0,0 +1,176 @@
+#define NO_UEFI
+
+// run with two speculative lanes (disabled by default)
+#include "../src/public_settings.h"
+#undef NUMBER_OF_SPECULATIVE_CONTRACT_PROCESSORS
+#define NUMBER_OF_SPECULATIVE_CONTRACT_PROCESSORS 2
+
+#include "contract_testing.h"
+
+static_assert(NUMBER_OF_SPECULATIVE_LANES == 2, "Test requires two speculative lanes.");
+
+// Transfers of a batch: A->B, C->D, B->E, D->B
+static const unsigned int transferSources[] = { 0, 2, 1, 3 };
+static const unsigned int transferDestinations[] = { 1, 3, 4, 1 };
+static const long long transferAmounts[] = { 1000, 500, 1500, 500 };
+static constexpr unsigned int batchSize = 4;
+static constexpr unsigned int numberOfEntities = 5;
+
+class SpeculativeExecutionTest : public ContractTesting
+{
+public:
+    SpeculativeExecutionTest()
+    {
+        initEmptySpectrum();
+        EXPECT_TRUE(initSpeculativeExecution(1024 * 1024));
+        for (unsigned int i = 0; i < numberOfEntities; ++i)
+            increaseEnergy(entityId(i), 1000);
+    }
+
+    ~SpeculativeExecutionTest()
+    {
+        deinitSpeculativeExecution();
+    }
+
+    static m256i entityId(unsigned int i)
+    {
+        return m256i(i + 1, 1, 2, 3);
+    }
+
+    // Transfer of transaction at position in batch, as in processTickTransaction()
+    static void transferSequentially(unsigned int position)
+    {
+        const int index = spectrumIndex(entityId(transferSources[position]));
+        if (decreaseEnergy(index, transferAmounts[position]))
+            increaseEnergy(entityId(transferDestinations[position]), transferAmounts[position]);
+    }
+
+    // Transfer of transaction at position in batch, as in processTickTransactionSpeculatively()
+    static void transferSpeculatively(SpeculativeLane& lane, unsigned int position)
+    {
+        ASSERT_TRUE(lane.beginTransaction(position));
+        const int index = spectrumIndex(entityId(transferSources[position]));
+        if (decreaseEnergySpeculative(lane, index, transferAmounts[position]))
+            increaseEnergySpeculative(lane, entityId(transferDestinations[position]), transferAmounts[position]);
+    }
+
+    // Digest of the entities changed by the batch and of the total amount
+    static m256i spectrumStateDigest()
+    {
+        ::Entity entities[numberOfEntities];
+        for (unsigned int i = 0; i < numberOfEntities; ++i)
+            entities[i] = spectrum[spectrumIndex(entityId(i))];
+        m256i digest[2];
+        KangarooTwelve(entities, sizeof(entities), &digest[0], sizeof(m256i));
+        KangarooTwelve(&spectrumInfo.totalAmount, sizeof(spectrumInfo.totalAmount), &digest[1], sizeof(m256i));
+        KangarooTwelve(digest, sizeof(digest), &digest[0], sizeof(m256i));
+        return digest[0];
+    }
+
+    // Assign transactions to lanes like processSpeculativeBatch()
+    static void assignLanes()
+    {
+        beginSpeculativeBatch(batchSize);
+        for (unsigned int position = 0; position < batchSize; ++position)
+        {
+            SpeculativeLane& lane = speculativeLanes[position & 1];
+            lane.transactionPositions[lane.numberOfTransactions++] = (unsigned short)position;
+        }
+    }
+};
+
+TEST(TestCoreSpeculativeExecution, ConflictingBatchIsRolledBackAndReexecutedSequentially)
+{
+    m256i expectedDigest;
+    {
+        SpeculativeExecutionTest test;
+        for (unsigned int position = 0; position < batchSize; ++position)
+            SpeculativeExecutionTest::transferSequentially(position);
+        expectedDigest = SpeculativeExecutionTest::spectrumStateDigest();
+    }
+
+    SpeculativeExecutionTest test;
+    const m256i initialDigest = SpeculativeExecutionTest::spectrumStateDigest();
+    SpeculativeExecutionTest::assignLanes();
+
+    // Interleaving of lanes: D->B (position 3) changes B before B->E (position 2) reads it
+    SpeculativeExecutionTest::transferSpeculatively(speculativeLanes[0], 0);
+    SpeculativeExecutionTest::transferSpeculatively(speculativeLanes[1], 1);
+    SpeculativeExecutionTest::transferSpeculatively(speculativeLanes[1], 3);
+    SpeculativeExecutionTest::transferSpeculatively(speculativeLanes[0], 2);
+    EXPECT_EQ(speculativeEscapePosition, 2);
+    EXPECT_NE(SpeculativeExecutionTest::spectrumStateDigest(), expectedDigest);
+
+    // Changes of positions 2 and 3 are undone, positions 0 and 1 are kept
+    rollbackSpeculativeBatch();
+    EXPECT_EQ(spectrum[spectrumIndex(SpeculativeExecutionTest::entityId(4))].incomingAmount, 1000);
+    EXPECT_EQ(energy(spectrumIndex(SpeculativeExecutionTest::entityId(1))), 2000);
+    EXPECT_NE(SpeculativeExecutionTest::spectrumStateDigest(), initialDigest);
+
+    // Sequential execution of escaped transactions leads to the same state as sequential execution of the whole batch
+    for (unsigned int position = speculativeEscapePosition; position < batchSize; ++position)
+        SpeculativeExecutionTest::transferSequentially(position);
+    EXPECT_EQ(SpeculativeExecutionTest::spectrumStateDigest(), expectedDigest);
+}
+
+TEST(TestCoreSpeculativeExecution, AbortedLaneIsRolledBackAndReleasesResources)
+{
+    m256i expectedDigest;
+    {
+        SpeculativeExecutionTest test;
+        for (unsigned int position = 0; position < batchSize; ++position)
+            SpeculativeExecutionTest::transferSequentially(position);
+        expectedDigest = SpeculativeExecutionTest::spectrumStateDigest();
+    }
+
+    SpeculativeExecutionTest test;
+    SpeculativeExecutionTest::assignLanes();
+    SpeculativeLane& lane = speculativeLanes[1];
+
+    // Lane 0 completes, lane 1 times out in the procedure of position 3 after __qpiAbort() while holding locks and an
+    // execution buffer
+    SpeculativeExecutionTest::transferSpeculatively(speculativeLanes[0], 0);
+    SpeculativeExecutionTest::transferSpeculatively(speculativeLanes[0], 2);
+    SpeculativeExecutionTest::transferSpeculatively(lane, 1);
+    SpeculativeExecutionTest::transferSpeculatively(lane, 3);
+    contractStateLock[1].acquireWrite();
+    lane.stateLockAcquired(1, true);
+    contractStateLock[2].acquireRead();
+    lane.stateLockAcquired(2, false);
+    contractStateLock[2].acquireRead();
+    lane.stateLockAcquired(2, false);
+    int stackIndex = -1;
+    acquireContractLocalsStack(stackIndex);
+    lane.heldLocalsStackIndex = stackIndex;
+    EXPECT_NE(contractLocalsStack[stackIndex].allocate(128), nullptr);
+    ACQUIRE(spectrumLock);
+    lane.heldSpectrumLock = &spectrumLock;
+    ACQUIRE(speculativeAccessTableLock);
+    lane.heldAccessTableLock = true;
+    lane.abortedContractIndex = 1;
+    lane.contractErrorBeforeAbort = contractError[1];
+    contractError[1] = ContractErrorAllocLocalsFailed;
+    EXPECT_EQ(speculativeEscapePosition, batchSize);
+
+    abortSpeculativeLane(lane);
+    EXPECT_EQ(speculativeEscapePosition, 3);
+    EXPECT_TRUE(contractStateLock[1].tryAcquireWrite());
+    contractStateLock[1].releaseWrite();
+    EXPECT_TRUE(contractStateLock[2].tryAcquireWrite());
+    contractStateLock[2].releaseWrite();
+    EXPECT_EQ(lane.heldLocalsStackIndex, -1);
+    EXPECT_EQ(contractLocalsStack[stackIndex].size(), 0);
+    EXPECT_EQ(contractLocalsStackLock[stackIndex], 0);
+    EXPECT_EQ(spectrumLock, 0);
+    EXPECT_EQ(speculativeAccessTableLock, 0);
+    EXPECT_FALSE(lane.heldAccessTableLock);
+    EXPECT_EQ(lane.heldSpectrumLock, nullptr);
+    EXPECT_EQ(contractError[1], 0);
+    EXPECT_EQ(lane.abortedContractIndex, -1);
+
+    // The aborted transaction is undone and executed again sequentially
+    rollbackSpeculativeBatch();
+    for (unsigned int position = speculativeEscapePosition; position < batchSize; ++position)
+        SpeculativeExecutionTest::transferSequentially(position);
+    EXPECT_EQ(SpeculativeExecutionTest::spectrumStateDigest(), expectedDigest);
+}
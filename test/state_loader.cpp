@@ -0,0 +1,164 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include <random>
+#include <thread>
+#include <vector>
+
+// Small reads and tasks, so each tree is verified by many tasks
+#define STATE_LOADER_READ_SIZE (40 * 1024ULL)
+#define STATE_LOADER_TASK_SIZE (4 * 1024ULL)
+#include "../src/state_loader.h"
+
+
+static const CHAR16* stateFileName = L"state_loader_test.bin";
+
+// Digest tree as built by the node for spectrum and universe
+static std::vector<m256i> buildDigestTree(const std::vector<unsigned char>& data, unsigned long long leafSize, unsigned int numberOfLeaves)
+{
+    std::vector<m256i> digests(numberOfLeaves * 2 - 1);
+    unsigned int digestIndex;
+    for (digestIndex = 0; digestIndex < numberOfLeaves; digestIndex++)
+    {
+        KangarooTwelve(data.data() + digestIndex * leafSize, (unsigned int)leafSize, &digests[digestIndex], 32);
+    }
+    unsigned int previousLevelBeginning = 0;
+    unsigned int numberOfLeafs = numberOfLeaves;
+    while (numberOfLeafs > 1)
+    {
+        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+        {
+            KangarooTwelve64To32(&digests[previousLevelBeginning + i], &digests[digestIndex++]);
+        }
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+    return digests;
+}
+
+struct StateLoaderTest
+{
+    std::vector<std::thread> workers;
+
+    StateLoaderTest(unsigned int numberOfWorkers)
+    {
+        StateLoader::begin();
+        for (unsigned int i = 0; i < numberOfWorkers; i++)
+            workers.emplace_back(StateLoader::runWorker);
+    }
+
+    ~StateLoaderTest()
+    {
+        StateLoader::end();
+        for (auto& worker : workers)
+            worker.join();
+        _wremove((const wchar_t*)stateFileName);
+    }
+
+    // Save random state to file, load and verify it, and return verification result
+    bool saveAndLoad(unsigned long long seed, unsigned long long leafSize, unsigned int numberOfLeaves, std::vector<m256i>* digests = nullptr, long long corruptedByte = -1)
+    {
+        std::mt19937_64 gen64(seed);
+        std::vector<unsigned char> data(leafSize * numberOfLeaves);
+        for (auto& byte : data)
+            byte = (unsigned char)gen64();
+        std::vector<m256i> savedDigests = buildDigestTree(data, leafSize, numberOfLeaves);
+        if (digests)
+            *digests = savedDigests;
+
+        if (corruptedByte >= 0)
+            data[corruptedByte] ^= 1;
+        EXPECT_EQ(saveAt(stateFileName, 0, data.size(), data.data()), (long long)data.size());
+
+        std::vector<unsigned char> loaded(data.size(), 0);
+        const int tree = StateLoader::addTree((digests) ? digests->data() : savedDigests.data(), numberOfLeaves, leafSize);
+        EXPECT_GE(tree, 0);
+        EXPECT_TRUE(StateLoader::loadLeaves(tree, stateFileName, NULL, loaded.data()));
+        const bool verified = StateLoader::endTree(tree);
+        EXPECT_TRUE(loaded == data);
+        return verified;
+    }
+};
+
+TEST(TestCoreStateLoader, VerifyMatchingStates)
+{
+    for (unsigned int numberOfWorkers : { 0, 1, 4 })
+    {
+        StateLoaderTest test(numberOfWorkers);
+
+        // entity-like leaves hashed with KangarooTwelve64To32 and asset-like leaves
+        EXPECT_TRUE(test.saveAndLoad(1, 64, 4096));
+        EXPECT_TRUE(test.saveAndLoad(2, 48, 8192));
+
+        // tree with less leaves than a task
+        EXPECT_TRUE(test.saveAndLoad(3, 48, 16));
+        EXPECT_TRUE(test.saveAndLoad(4, 1000, 1));
+    }
+}
+
+TEST(TestCoreStateLoader, DetectMismatch)
+{
+    StateLoaderTest test(3);
+
+    // changed leaf data
+    EXPECT_FALSE(test.saveAndLoad(5, 64, 4096, nullptr, 12345));
+    EXPECT_FALSE(test.saveAndLoad(6, 48, 8192, nullptr, 48 * 8192 - 1));
+
+    // changed inner node within subtree of task and above
+    std::vector<m256i> digests;
+    EXPECT_TRUE(test.saveAndLoad(7, 64, 4096, &digests));
+    const unsigned int levelOneBeginning = 4096;
+    const unsigned int rootIndex = 4096 * 2 - 2;
+    for (unsigned int node : { levelOneBeginning + 7, rootIndex - 1, rootIndex })
+    {
+        std::vector<m256i> corrupted = digests;
+        corrupted[node].m256i_u8[3] ^= 0x80;
+        const int tree = StateLoader::addTree(corrupted.data(), 4096, 64);
+        std::vector<unsigned char> loaded(64 * 4096);
+        EXPECT_TRUE(StateLoader::loadLeaves(tree, stateFileName, NULL, loaded.data()));
+        EXPECT_FALSE(StateLoader::endTree(tree));
+    }
+}
+
+TEST(TestCoreStateLoader, VerifyLeavesOfDifferentSizes)
+{
+    StateLoaderTest test(2);
+
+    // contract-like states: some of different sizes and zero digests for remaining leaves
+    constexpr unsigned int numberOfLeaves = 64;
+    constexpr unsigned int numberOfStates = 13;
+    std::mt19937_64 gen64(8);
+    std::vector<std::vector<unsigned char>> states(numberOfStates);
+    std::vector<m256i> digests(numberOfLeaves * 2 - 1);
+    for (unsigned int i = 0; i < numberOfLeaves; i++)
+    {
+        if (i < numberOfStates)
+        {
+            states[i].resize(1 + gen64() % 20000);
+            for (auto& byte : states[i])
+                byte = (unsigned char)gen64();
+            KangarooTwelve(states[i].data(), (unsigned int)states[i].size(), &digests[i], 32);
+        }
+        else
+        {
+            digests[i] = m256i::zero();
+        }
+    }
+    unsigned int digestIndex = numberOfLeaves;
+    for (unsigned int levelBeginning = 0, levelSize = numberOfLeaves; levelSize > 1; levelBeginning += levelSize, levelSize >>= 1)
+        for (unsigned int i = 0; i < levelSize; i += 2)
+            KangarooTwelve64To32(&digests[levelBeginning + i], &digests[digestIndex++]);
+
+    for (unsigned int changedState : { numberOfStates, 0u, 5u })
+    {
+        const int tree = StateLoader::addTree(digests.data(), numberOfLeaves, 0);
+        if (changedState < numberOfStates)
+            states[changedState][0] ^= 1;
+        for (unsigned int i = 0; i < numberOfLeaves; i++)
+            StateLoader::verifyLeaf(tree, i, (i < numberOfStates) ? states[i].data() : nullptr, (i < numberOfStates) ? states[i].size() : 0);
+        EXPECT_EQ(StateLoader::endTree(tree), changedState == numberOfStates);
+        if (changedState < numberOfStates)
+            states[changedState][0] ^= 1;
+    }
+}
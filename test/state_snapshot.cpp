@@ -0,0 +1,363 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Small pool and batches, so pages are shadowed and writers have to wait for free shadow pages
+#define STATE_SNAPSHOT_SHADOW_PAGES 256ULL
+#define STATE_SNAPSHOT_WRITE_BATCH_SIZE (8 * 4096ULL)
+#include "../src/state_snapshot.h"
+
+
+static const CHAR16* regionFileNames[] = { L"state_snapshot_test_0.bin", L"state_snapshot_test_1.bin", L"state_snapshot_test_2.bin" };
+static const unsigned long long regionSizes[] = { 2 * 1024 * 1024 + 123, 300 * 1024, 5 };
+static constexpr unsigned int numberOfRegions = sizeof(regionSizes) / sizeof(regionSizes[0]);
+static const CHAR16* deltaFileNames[] = { L"state_snapshot_test_delta_1.bin", L"state_snapshot_test_delta_2.bin" };
+
+struct StateSnapshotTest
+{
+    std::vector<unsigned char> regions[numberOfRegions];
+    std::mt19937_64 gen64;
+
+    StateSnapshotTest(unsigned long long seed) : gen64(seed)
+    {
+        unsigned long long totalSize = 0;
+        for (unsigned int i = 0; i < numberOfRegions; i++)
+        {
+            regions[i].resize(regionSizes[i]);
+            for (auto& byte : regions[i])
+                byte = (unsigned char)gen64();
+            totalSize += regionSizes[i];
+        }
+        EXPECT_TRUE(StateSnapshot::init(totalSize));
+    }
+
+    ~StateSnapshotTest()
+    {
+        StateSnapshot::deinit();
+        for (unsigned int i = 0; i < numberOfRegions; i++)
+            _wremove((const wchar_t*)regionFileNames[i]);
+        for (auto deltaFileName : deltaFileNames)
+            _wremove((const wchar_t*)deltaFileName);
+    }
+
+    void addRegions()
+    {
+        for (unsigned int i = 0; i < numberOfRegions; i++)
+            EXPECT_TRUE(StateSnapshot::addRegion(regions[i].data(), regions[i].size(), regionFileNames[i]));
+    }
+
+    void start(const CHAR16* deltaFileName = NULL)
+    {
+        EXPECT_TRUE(StateSnapshot::prepare(NULL));
+        addRegions();
+        if (deltaFileName)
+            EXPECT_TRUE(StateSnapshot::canWriteDelta());
+        StateSnapshot::start(deltaFileName);
+        EXPECT_TRUE(StateSnapshot::isActive());
+        EXPECT_EQ(StateSnapshot::isDelta(), deltaFileName != NULL);
+    }
+
+    void copyRegions(std::vector<unsigned char>* copy)
+    {
+        for (unsigned int i = 0; i < numberOfRegions; i++)
+            copy[i] = regions[i];
+    }
+
+    // Change size bytes of region at random offset like the tick processor changes the state
+    void mutate(std::mt19937_64& gen, unsigned long long size)
+    {
+        std::vector<unsigned char>& region = regions[gen() % numberOfRegions];
+        if (size > region.size())
+            size = region.size();
+        const unsigned long long offset = gen() % (region.size() - size + 1);
+        StateSnapshot::beforeWrite(region.data() + offset, size);
+        for (unsigned long long i = 0; i < size; i++)
+            region[offset + i] ^= (unsigned char)(gen() | 1);
+    }
+
+    void writeAll()
+    {
+        StateSnapshotWriteResult result;
+        do
+        {
+            result = StateSnapshot::writeStep();
+            EXPECT_NE(result, StateSnapshotWriteFailed);
+        } while (result == StateSnapshotWriteInProgress);
+        EXPECT_FALSE(StateSnapshot::isActive());
+        EXPECT_EQ(StateSnapshot::getWrittenBytes(), StateSnapshot::getTotalBytes());
+    }
+
+    void checkFiles(const std::vector<unsigned char>* expectedRegions)
+    {
+        for (unsigned int i = 0; i < numberOfRegions; i++)
+        {
+            std::vector<unsigned char> loaded(expectedRegions[i].size() + 1, 0);
+            EXPECT_EQ(load(regionFileNames[i], expectedRegions[i].size(), loaded.data()), (long long)expectedRegions[i].size());
+            loaded.resize(expectedRegions[i].size());
+            EXPECT_TRUE(loaded == expectedRegions[i]);
+        }
+    }
+
+    // Load files of full snapshot, apply numberOfDeltas delta files, and compare with expectedRegions
+    void checkFilesWithDeltas(unsigned int numberOfDeltas, const std::vector<unsigned char>* expectedRegions)
+    {
+        std::vector<unsigned char> loaded[numberOfRegions];
+        EXPECT_TRUE(StateSnapshot::prepare(NULL));
+        for (unsigned int i = 0; i < numberOfRegions; i++)
+        {
+            loaded[i].resize(regionSizes[i]);
+            EXPECT_EQ(load(regionFileNames[i], regionSizes[i], loaded[i].data()), (long long)regionSizes[i]);
+            EXPECT_TRUE(StateSnapshot::addRegion(loaded[i].data(), loaded[i].size(), regionFileNames[i]));
+        }
+        for (unsigned int i = 0; i < numberOfDeltas; i++)
+            EXPECT_TRUE(StateSnapshot::applyDelta(deltaFileNames[i]));
+        for (unsigned int i = 0; i < numberOfRegions; i++)
+            EXPECT_TRUE(loaded[i] == expectedRegions[i]);
+    }
+};
+
+TEST(TestCoreStateSnapshot, WriteWithoutChanges)
+{
+    StateSnapshotTest test(42);
+    test.start();
+    test.writeAll();
+    test.checkFiles(test.regions);
+    EXPECT_EQ(StateSnapshot::getNumberOfShadowedPages(), 0);
+
+    // second snapshot overwrites files of first one
+    std::mt19937_64 gen(1);
+    for (int i = 0; i < 100; i++)
+        test.mutate(gen, 100);
+    test.start();
+    test.writeAll();
+    test.checkFiles(test.regions);
+}
+
+TEST(TestCoreStateSnapshot, ChangesBetweenWriteSteps)
+{
+    StateSnapshotTest test(1234);
+    test.start();
+    std::vector<unsigned char> cut[numberOfRegions];
+    for (unsigned int i = 0; i < numberOfRegions; i++)
+        cut[i] = test.regions[i];
+
+    std::mt19937_64 gen(5678);
+    StateSnapshotWriteResult result;
+    unsigned int step = 0;
+    do
+    {
+        // small changes and changes spanning multiple pages, without exceeding the shadow pool (this thread would wait forever)
+        test.mutate(gen, 1 + gen() % 64);
+        if (++step % 4 == 0)
+            test.mutate(gen, 2 * 4096);
+        result = StateSnapshot::writeStep();
+        EXPECT_NE(result, StateSnapshotWriteFailed);
+    } while (result == StateSnapshotWriteInProgress);
+
+    test.checkFiles(cut);
+    EXPECT_GT(StateSnapshot::getNumberOfShadowedPages(), 0);
+    EXPECT_EQ(StateSnapshot::getNumberOfStalls(), 0);
+    for (unsigned int i = 0; i < 2; i++)
+        EXPECT_FALSE(test.regions[i] == cut[i]);
+
+    // changes after the snapshot has been written are not shadowed anymore
+    const long long shadowedPages = StateSnapshot::getNumberOfShadowedPages();
+    test.mutate(gen, 4096);
+    EXPECT_EQ(StateSnapshot::getNumberOfShadowedPages(), shadowedPages);
+}
+
+TEST(TestCoreStateSnapshot, ConcurrentChanges)
+{
+    StateSnapshotTest test(987);
+    test.start();
+    std::vector<unsigned char> cut[numberOfRegions];
+    for (unsigned int i = 0; i < numberOfRegions; i++)
+        cut[i] = test.regions[i];
+
+    // change state in other thread while snapshot is written (the shadow pool is too small, so the thread has to wait)
+    std::atomic<bool> stop(false);
+    std::atomic<unsigned int> numberOfMutations(0);
+    std::thread mutator([&test, &stop, &numberOfMutations]()
+        {
+            std::mt19937_64 gen(4321);
+            while (!stop)
+            {
+                test.mutate(gen, 1 + gen() % (16 * 4096));
+                ++numberOfMutations;
+            }
+        });
+
+    // make sure that writing overlaps with changes (few enough not to exhaust the shadow pool before writing)
+    while (numberOfMutations < 10)
+        std::this_thread::yield();
+    test.writeAll();
+    stop = true;
+    mutator.join();
+
+    test.checkFiles(cut);
+    EXPECT_GT(StateSnapshot::getNumberOfShadowedPages(), 0);
+}
+
+TEST(TestCoreStateSnapshot, WaitingWriters)
+{
+    StateSnapshotTest test(654);
+    test.start();
+    std::vector<unsigned char> cut[numberOfRegions];
+    test.copyRegions(cut);
+    EXPECT_FALSE(StateSnapshot::hasWaitingWriters());
+
+    // change whole first region (more pages than shadow pages), so the thread has to wait for writeStep()
+    std::thread mutator([&test]()
+        {
+            std::vector<unsigned char>& region = test.regions[0];
+            StateSnapshot::beforeWrite(region.data(), region.size());
+            for (auto& byte : region)
+                byte = ~byte;
+        });
+    while (!StateSnapshot::hasWaitingWriters())
+        std::this_thread::yield();
+
+    test.writeAll();
+    EXPECT_FALSE(StateSnapshot::hasWaitingWriters());
+    mutator.join();
+
+    test.checkFiles(cut);
+    EXPECT_GT(StateSnapshot::getNumberOfStalls(), 0);
+}
+
+TEST(TestCoreStateSnapshot, Abort)
+{
+    StateSnapshotTest test(77);
+    test.start();
+    EXPECT_EQ(StateSnapshot::writeStep(), StateSnapshotWriteInProgress);
+    EXPECT_FALSE(StateSnapshot::prepare(NULL));
+    StateSnapshot::abort();
+    EXPECT_FALSE(StateSnapshot::isActive());
+    EXPECT_EQ(StateSnapshot::writeStep(), StateSnapshotWriteDone);
+
+    // no shadowing after abort
+    std::mt19937_64 gen(3);
+    test.mutate(gen, 4096);
+    EXPECT_EQ(StateSnapshot::getNumberOfShadowedPages(), 0);
+
+    // new snapshot can be started
+    test.start();
+    test.writeAll();
+    test.checkFiles(test.regions);
+}
+
+TEST(TestCoreStateSnapshot, DeltaWithChangesBetweenWriteSteps)
+{
+    StateSnapshotTest test(555);
+
+    // first snapshot has to be full
+    EXPECT_FALSE(StateSnapshot::canWriteDelta());
+    test.start();
+    test.writeAll();
+    std::vector<unsigned char> base[numberOfRegions];
+    test.copyRegions(base);
+
+    // delta only contains changed pages
+    std::mt19937_64 gen(99);
+    for (int i = 0; i < 20; i++)
+        test.mutate(gen, 1 + gen() % 64);
+    test.mutate(gen, 3 * 4096);
+    test.start(deltaFileNames[0]);
+    std::vector<unsigned char> cut1[numberOfRegions];
+    test.copyRegions(cut1);
+    EXPECT_GT(StateSnapshot::getTotalBytes(), 0);
+    EXPECT_LE(StateSnapshot::getTotalBytes(), 25 * 4096);
+
+    // changes while writing delta are shadowed and recorded for next delta
+    StateSnapshotWriteResult result;
+    do
+    {
+        test.mutate(gen, 1 + gen() % 64);
+        result = StateSnapshot::writeStep();
+        EXPECT_NE(result, StateSnapshotWriteFailed);
+    } while (result == StateSnapshotWriteInProgress);
+    EXPECT_EQ(StateSnapshot::getWrittenBytes(), StateSnapshot::getTotalBytes());
+
+    // second delta without further changes
+    test.start(deltaFileNames[1]);
+    std::vector<unsigned char> cut2[numberOfRegions];
+    test.copyRegions(cut2);
+    test.writeAll();
+
+    // full snapshot files are not changed by deltas
+    test.checkFiles(base);
+    test.checkFilesWithDeltas(1, cut1);
+    test.checkFilesWithDeltas(2, cut2);
+}
+
+TEST(TestCoreStateSnapshot, DeltaWithoutChanges)
+{
+    StateSnapshotTest test(556);
+    test.start();
+    test.writeAll();
+
+    test.start(deltaFileNames[0]);
+    EXPECT_EQ(StateSnapshot::getTotalBytes(), 0);
+    test.writeAll();
+    test.checkFilesWithDeltas(1, test.regions);
+}
+
+TEST(TestCoreStateSnapshot, DeltaWithRegionWrittenAlways)
+{
+    StateSnapshotTest test(558);
+    EXPECT_TRUE(StateSnapshot::prepare(NULL));
+    for (unsigned int i = 0; i < numberOfRegions; i++)
+        EXPECT_TRUE(StateSnapshot::addRegion(test.regions[i].data(), test.regions[i].size(), regionFileNames[i], i == 1));
+    StateSnapshot::start();
+    test.writeAll();
+
+    // region 1 is changed without beforeWrite() like a copy filled before the cut -> whole region is in delta
+    EXPECT_TRUE(StateSnapshot::prepare(NULL));
+    for (unsigned int i = 0; i < numberOfRegions; i++)
+        EXPECT_TRUE(StateSnapshot::addRegion(test.regions[i].data(), test.regions[i].size(), regionFileNames[i], i == 1));
+    EXPECT_TRUE(StateSnapshot::canWriteDelta());
+    test.regions[1][12345] ^= 1;
+    StateSnapshot::start(deltaFileNames[0]);
+    EXPECT_EQ(StateSnapshot::getTotalBytes(), regionSizes[1]);
+    test.writeAll();
+    test.checkFilesWithDeltas(1, test.regions);
+}
+
+TEST(TestCoreStateSnapshot, FullSnapshotRequiredAfterAbortOrRegionChange)
+{
+    StateSnapshotTest test(557);
+    test.start();
+    test.writeAll();
+
+    // aborted snapshot cannot be base of delta
+    test.start(deltaFileNames[0]);
+    StateSnapshot::abort();
+    EXPECT_TRUE(StateSnapshot::prepare(NULL));
+    test.addRegions();
+    EXPECT_FALSE(StateSnapshot::canWriteDelta());
+
+    test.start();
+    test.writeAll();
+    EXPECT_TRUE(StateSnapshot::prepare(NULL));
+    test.addRegions();
+    EXPECT_TRUE(StateSnapshot::canWriteDelta());
+
+    // different regions
+    EXPECT_TRUE(StateSnapshot::prepare(NULL));
+    for (unsigned int i = 0; i < numberOfRegions - 1; i++)
+        EXPECT_TRUE(StateSnapshot::addRegion(test.regions[i].data(), test.regions[i].size(), regionFileNames[i]));
+    EXPECT_FALSE(StateSnapshot::canWriteDelta());
+    test.start();
+    test.writeAll();
+
+    // different directory
+    EXPECT_TRUE(StateSnapshot::prepare(L"other"));
+    for (unsigned int i = 0; i < numberOfRegions - 1; i++)
+        EXPECT_TRUE(StateSnapshot::addRegion(test.regions[i].data(), test.regions[i].size(), regionFileNames[i]));
+    EXPECT_FALSE(StateSnapshot::canWriteDelta());
+}
@@ -0,0 +1,356 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#define system qubicSystemStruct
+
+// Collect responses instead of sending them to peers
+#define TEST_UTILS_COLLECT_RESPONSES
+#include "utils.h"
+
+// Peer pointer is used as connection identity, peers in closedPeers are disconnected
+static std::vector<const Peer*> closedPeers;
+
+static void* getPeerConnection(const Peer* peer)
+{
+    return (void*)peer;
+}
+
+static bool isPeerConnectionActive(const Peer* peer, void* connection)
+{
+    return peer == connection && std::find(closedPeers.begin(), closedPeers.end(), peer) == closedPeers.end();
+}
+
+#include "../src/public_settings.h"
+#undef MAX_NUMBER_OF_TICKS_PER_EPOCH
+#define MAX_NUMBER_OF_TICKS_PER_EPOCH 400
+#undef TICKS_TO_KEEP_FROM_PRIOR_EPOCH
+#define TICKS_TO_KEEP_FROM_PRIOR_EPOCH 10
+#include "../src/tick_archive.h"
+
+
+static TickStorage ts;
+static TickArchive tickArchive;
+
+static const unsigned short firstEpoch = 123;
+static const unsigned int firstTick = 1000;
+static const unsigned int numberOfTicksFirstEpoch = 300;
+static const unsigned int numberOfTicksSecondEpoch = 100;
+static const unsigned int numberOfVotesPerTick = 8;
+
+class TestTickArchive : public ::testing::Test
+{
+protected:
+    std::mt19937_64 gen64;
+
+    // expected data by tick - firstTick
+    std::vector<std::vector<Tick>> votes;
+    std::vector<TickData> tickData;
+    std::vector<std::vector<std::vector<unsigned char>>> transactions;
+
+    TestTickArchive() : gen64(42)
+    {
+        ts.init();
+        tickArchive.init();
+        responses.clear();
+        closedPeers.clear();
+    }
+
+    ~TestTickArchive()
+    {
+        tickArchive.deinit();
+        ts.deinit();
+    }
+
+    // Add votes, tick data (except for every 7th tick), and transactions of tick to tick storage
+    void addTick(unsigned int tick, unsigned short epoch)
+    {
+        const unsigned int t = tick - firstTick;
+        votes.resize(t + 1);
+        tickData.resize(t + 1);
+        transactions.resize(t + 1);
+
+        for (unsigned int v = 0; v < numberOfVotesPerTick; v++)
+        {
+            Tick vote;
+            setMem(&vote, sizeof(Tick), 0);
+            vote.computorIndex = (tick + v * 41) % NUMBER_OF_COMPUTORS;
+            vote.epoch = epoch;
+            vote.tick = tick;
+            vote.saltedSpectrumDigest = m256i(gen64(), gen64(), gen64(), gen64());
+            copyMem(ts.ticks.getByTickInCurrentEpoch(tick) + vote.computorIndex, &vote, sizeof(Tick));
+            votes[t].push_back(vote);
+        }
+
+        TickData& td = tickData[t];
+        setMem(&td, sizeof(TickData), 0);
+        transactions[t].resize(NUMBER_OF_TRANSACTIONS_PER_TICK);
+        if (tick % 7 == 0)
+        {
+            return;
+        }
+        td.computorIndex = tick % NUMBER_OF_COMPUTORS;
+        td.epoch = epoch;
+        td.tick = tick;
+        const unsigned int numberOfTransactions = gen64() % 40;
+        for (unsigned int i = 0; i < numberOfTransactions; i++)
+        {
+            const unsigned int slot = (unsigned int)(gen64() % NUMBER_OF_TRANSACTIONS_PER_TICK);
+            if (!transactions[t][slot].empty())
+            {
+                continue;
+            }
+            const unsigned short inputSize = (unsigned short)(gen64() % 100);
+            std::vector<unsigned char>& data = transactions[t][slot];
+            data.resize(sizeof(Transaction) + inputSize + SIGNATURE_SIZE);
+            Transaction* transaction = (Transaction*)data.data();
+            transaction->sourcePublicKey = m256i(gen64(), gen64(), gen64(), gen64());
+            transaction->destinationPublicKey = m256i(gen64(), gen64(), gen64(), gen64());
+            transaction->amount = gen64() % 1000;
+            transaction->tick = tick;
+            transaction->inputType = 0;
+            transaction->inputSize = inputSize;
+            for (unsigned int j = 0; j < inputSize + SIGNATURE_SIZE; j++)
+            {
+                transaction->inputPtr()[j] = (unsigned char)gen64();
+            }
+            td.transactionDigests[slot] = m256i(gen64(), gen64(), gen64(), gen64());
+
+            unsigned long long* offsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(tick);
+            offsets[slot] = ts.nextTickTransactionOffset;
+            copyMem(ts.tickTransactions(ts.nextTickTransactionOffset), transaction, transaction->totalSize());
+            ts.nextTickTransactionOffset += transaction->totalSize();
+        }
+        copyMem(&ts.tickData.getByTickInCurrentEpoch(tick), &td, sizeof(TickData));
+    }
+
+    // Run main loop processing until all finalized ticks are archived
+    void archiveTicks()
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            tickArchive.process();
+        }
+        EXPECT_EQ(tickArchive.getNextTickToArchive(), system.tick - 1);
+    }
+
+    // Fill tick storage with two epochs and archive all finalized ticks
+    void setupArchive()
+    {
+        system.epoch = firstEpoch;
+        system.initialTick = firstTick;
+        ts.beginEpoch(firstTick);
+        for (unsigned int tick = firstTick; tick < firstTick + numberOfTicksFirstEpoch; tick++)
+        {
+            addTick(tick, firstEpoch);
+        }
+        system.tick = firstTick + numberOfTicksFirstEpoch;
+        archiveTicks();
+
+        const unsigned int secondEpochTick = firstTick + numberOfTicksFirstEpoch;
+        system.epoch = firstEpoch + 1;
+        system.initialTick = secondEpochTick;
+        ts.beginEpoch(secondEpochTick);
+        for (unsigned int tick = secondEpochTick; tick < secondEpochTick + numberOfTicksSecondEpoch; tick++)
+        {
+            addTick(tick, firstEpoch + 1);
+        }
+        system.tick = secondEpochTick + numberOfTicksSecondEpoch;
+        archiveTicks();
+    }
+
+    const std::vector<unsigned char>* findTransaction(const m256i& digest, unsigned int& tick)
+    {
+        for (unsigned int t = 0; t < tickData.size(); t++)
+        {
+            for (unsigned int slot = 0; slot < NUMBER_OF_TRANSACTIONS_PER_TICK; slot++)
+            {
+                if (!transactions[t][slot].empty() && tickData[t].transactionDigests[slot] == digest)
+                {
+                    tick = firstTick + t;
+                    return &transactions[t][slot];
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    void checkTickData(unsigned int tick)
+    {
+        const TickData& expected = tickData[tick - firstTick];
+        responses.clear();
+        EXPECT_TRUE(tickArchive.respondTickRequest(NULL, tick, RequestTickData::type, tick, NULL, 0));
+        ASSERT_EQ(responses.size(), 1);
+        EXPECT_EQ(responses[0].dejavu, tick);
+        if (expected.epoch)
+        {
+            EXPECT_EQ(responses[0].type, BroadcastFutureTickData::type);
+            ASSERT_EQ(responses[0].payload.size(), sizeof(TickData));
+            EXPECT_EQ(memcmp(responses[0].payload.data(), &expected, sizeof(TickData)), 0);
+        }
+        else
+        {
+            EXPECT_EQ(responses[0].type, EndResponse::type);
+        }
+    }
+
+    void checkQuorumTick(unsigned int tick)
+    {
+        const std::vector<Tick>& expected = votes[tick - firstTick];
+        RequestedQuorumTick request;
+        request.tick = tick;
+        setMem(request.voteFlags, sizeof(request.voteFlags), 0);
+        request.voteFlags[expected[0].computorIndex >> 3] |= 1 << (expected[0].computorIndex & 7);
+        responses.clear();
+        EXPECT_TRUE(tickArchive.respondTickRequest(NULL, tick, RequestQuorumTick::type, tick, request.voteFlags, sizeof(request.voteFlags)));
+        ASSERT_EQ(responses.size(), numberOfVotesPerTick);
+        for (unsigned int i = 0; i < numberOfVotesPerTick - 1; i++)
+        {
+            EXPECT_EQ(responses[i].type, BroadcastTick::type);
+            ASSERT_EQ(responses[i].payload.size(), sizeof(Tick));
+            const Tick* vote = (const Tick*)responses[i].payload.data();
+            bool found = false;
+            for (unsigned int v = 1; v < numberOfVotesPerTick; v++)
+            {
+                found = found || memcmp(vote, &expected[v], sizeof(Tick)) == 0;
+            }
+            EXPECT_TRUE(found);
+        }
+        EXPECT_EQ(responses.back().type, EndResponse::type);
+    }
+
+    void checkTickTransactions(unsigned int tick)
+    {
+        const std::vector<std::vector<unsigned char>>& expected = transactions[tick - firstTick];
+        RequestedTickTransactions request;
+        request.tick = tick;
+        setMem(request.transactionFlags, sizeof(request.transactionFlags), 0);
+        unsigned int numberOfExpected = 0;
+        bool skippedFirst = false;
+        for (unsigned int slot = 0; slot < NUMBER_OF_TRANSACTIONS_PER_TICK; slot++)
+        {
+            if (expected[slot].empty())
+                continue;
+            if (!skippedFirst)
+            {
+                request.transactionFlags[slot >> 3] |= 1 << (slot & 7);
+                skippedFirst = true;
+                continue;
+            }
+            numberOfExpected++;
+        }
+
+        responses.clear();
+        EXPECT_TRUE(tickArchive.respondTickRequest(NULL, tick, REQUEST_TICK_TRANSACTIONS, tick, request.transactionFlags, sizeof(request.transactionFlags)));
+        ASSERT_EQ(responses.size(), numberOfExpected + 1);
+        unsigned int r = 0;
+        for (unsigned int slot = 0; slot < NUMBER_OF_TRANSACTIONS_PER_TICK; slot++)
+        {
+            if (expected[slot].empty() || (request.transactionFlags[slot >> 3] & (1 << (slot & 7))))
+                continue;
+            EXPECT_EQ(responses[r].type, BROADCAST_TRANSACTION);
+            EXPECT_EQ(responses[r].payload, expected[slot]);
+            r++;
+        }
+        EXPECT_EQ(responses.back().type, EndResponse::type);
+    }
+};
+
+TEST_F(TestTickArchive, ArchiveAndRespondFromCache)
+{
+    setupArchive();
+
+    // epoch 1: 4 full segments and 1 segment sealed at epoch change, epoch 2: 1 full segment + open segment
+    EXPECT_EQ(tickArchive.getNumberOfSegments(), 6);
+
+    // ticks of the 4 most recently sealed segments are cached (saving fails in test, so older segments are lost)
+    const unsigned int firstCachedTick = firstTick + 2 * ARCHIVE_MAX_TICKS_PER_SEGMENT;
+    const unsigned int firstTickInStorage = firstTick + numberOfTicksFirstEpoch - TICKS_TO_KEEP_FROM_PRIOR_EPOCH;
+    for (unsigned int tick = firstCachedTick; tick < firstTickInStorage; tick++)
+    {
+        checkTickData(tick);
+        checkQuorumTick(tick);
+        checkTickTransactions(tick);
+    }
+
+    // ticks in tick storage and unknown ticks are not handled by archive
+    EXPECT_FALSE(tickArchive.respondTickRequest(NULL, 0, RequestTickData::type, firstTickInStorage, NULL, 0));
+    EXPECT_FALSE(tickArchive.respondTickRequest(NULL, 0, RequestTickData::type, firstTick - 1, NULL, 0));
+
+    // transaction info of cached segments
+    for (unsigned int t = firstCachedTick - firstTick; t < firstTickInStorage - firstTick; t++)
+    {
+        for (unsigned int slot = 0; slot < NUMBER_OF_TRANSACTIONS_PER_TICK; slot++)
+        {
+            if (transactions[t][slot].empty())
+                continue;
+            responses.clear();
+            EXPECT_TRUE(tickArchive.respondTransactionInfo(NULL, t, tickData[t].transactionDigests[slot]));
+            ASSERT_EQ(responses.size(), 1);
+            EXPECT_EQ(responses[0].type, BROADCAST_TRANSACTION);
+            EXPECT_EQ(responses[0].payload, transactions[t][slot]);
+        }
+    }
+}
+
+TEST_F(TestTickArchive, PendingRequests)
+{
+    setupArchive();
+
+    // segment of first tick has been evicted from cache -> request is answered by main loop
+    responses.clear();
+    EXPECT_TRUE(tickArchive.respondTickRequest(NULL, 1, RequestTickData::type, firstTick + 1, NULL, 0));
+    EXPECT_TRUE(responses.empty());
+
+    // transaction of evicted segment
+    unsigned int slot = 0;
+    while (transactions[1][slot].empty())
+        slot++;
+    EXPECT_TRUE(tickArchive.respondTransactionInfo(NULL, 2, tickData[1].transactionDigests[slot]));
+    EXPECT_TRUE(responses.empty());
+
+    // unknown transaction is rejected by digest filters
+    m256i unknownDigest(gen64(), gen64(), gen64(), gen64());
+    unsigned int tick;
+    EXPECT_EQ(findTransaction(unknownDigest, tick), nullptr);
+    EXPECT_FALSE(tickArchive.respondTransactionInfo(NULL, 3, unknownDigest));
+
+    // segment files could not be saved in test, so loading fails and empty responses are sent
+    tickArchive.process();
+    tickArchive.process();
+    ASSERT_EQ(responses.size(), 2);
+    EXPECT_EQ(responses[0].type, EndResponse::type);
+    EXPECT_EQ(responses[0].dejavu, 1u);
+    EXPECT_EQ(responses[1].type, EndResponse::type);
+    EXPECT_EQ(responses[1].dejavu, 2u);
+
+    // queue overflow -> empty response sent directly
+    responses.clear();
+    for (unsigned int i = 0; i < ARCHIVE_MAX_PENDING_REQUESTS + 1; i++)
+    {
+        EXPECT_TRUE(tickArchive.respondTickRequest(NULL, i, RequestTickData::type, firstTick + 1, NULL, 0));
+    }
+    ASSERT_EQ(responses.size(), 1);
+    EXPECT_EQ(responses[0].dejavu, ARCHIVE_MAX_PENDING_REQUESTS);
+
+    // all requests of same segment are answered at once
+    tickArchive.process();
+    EXPECT_EQ(responses.size(), ARCHIVE_MAX_PENDING_REQUESTS + 1);
+
+    // queued requests of peers that disconnected in the meantime are dropped
+    Peer* peerA = (Peer*)&responses;
+    Peer* peerB = (Peer*)&closedPeers;
+    responses.clear();
+    EXPECT_TRUE(tickArchive.respondTickRequest(peerA, 1, RequestTickData::type, firstTick + 1, NULL, 0));
+    EXPECT_TRUE(tickArchive.respondTickRequest(peerB, 2, RequestTickData::type, firstTick + 1, NULL, 0));
+    EXPECT_TRUE(tickArchive.respondTransactionInfo(peerA, 3, tickData[1].transactionDigests[slot]));
+    closedPeers.push_back(peerA);
+    tickArchive.process();
+    tickArchive.process();
+    ASSERT_EQ(responses.size(), 1);
+    EXPECT_EQ(responses[0].dejavu, 2u);
+}
@@ -9,7 +9,9 @@
 #define TICKS_TO_KEEP_FROM_PRIOR_EPOCH 5
 #include "../src/tick_storage.h"
 
+#include <chrono>
 #include <random>
+#include <vector>
 
 
 class TestTickStorage : public TickStorage
@@ -17,7 +19,7 @@ class TestTickStorage : public TickStorage
     unsigned char transactionBuffer[MAX_TRANSACTION_SIZE];
 public:
 
-    void addTransaction(unsigned int tick, unsigned int transactionIdx, unsigned int inputSize)
+    void addTransaction(unsigned int tick, unsigned int transactionIdx, unsigned int inputSize, const m256i& digest)
     {
         ASSERT_TRUE(inputSize <= MAX_INPUT_SIZE);
         Transaction* transaction = (Transaction*)transactionBuffer;
@@ -36,6 +38,13 @@ public:
             EXPECT_EQ(offsets[transactionIdx], 0);
             offsets[transactionIdx] = nextTickTransactionOffset;
             copyMem(tickTransactions(nextTickTransactionOffset), transaction, transactionSize);
+
+            // record digest like tick processing does
+            tickData.getByTickInCurrentEpoch(tick).transactionDigests[transactionIdx] = digest;
+            transactionsDigestAccess.acquireLock();
+            transactionsDigestAccess.insertTransaction(digest, tickTransactions(nextTickTransactionOffset));
+            transactionsDigestAccess.releaseLock();
+
             nextTickTransactionOffset += transactionSize;
         }
     }
@@ -73,20 +82,34 @@ void addTick(unsigned int tick, unsigned long long seed, unsigned short maxTrans
             transactionSlot = transaction;  // standard order
         else if (orderMode == 1)
             transactionSlot = transactionNum - 1 - transaction;  // backward order
-        ts.addTransaction(tick, transactionSlot, gen64() % MAX_INPUT_SIZE);
+        const unsigned int inputSize = gen64() % MAX_INPUT_SIZE;
+        const m256i digest(gen64(), gen64(), gen64(), gen64());
+        ts.addTransaction(tick, transactionSlot, inputSize, digest);
     }
     ts.checkStateConsistencyWithAssert();
 }
 
 void checkTick(unsigned int tick, unsigned long long seed, unsigned short maxTransactions, bool previousEpoch = false)
 {
-    // only last ticks of previous epoch are kept in storage -> check okay
-    if (previousEpoch && !ts.tickInPreviousEpochStorage(tick))
-        return;
-
     // use pseudo-random sequence
     std::mt19937_64 gen64(seed);
 
+    // only last ticks of previous epoch are kept in storage -> check okay, but transactions must not be found by digest
+    if (previousEpoch && !ts.tickInPreviousEpochStorage(tick))
+    {
+        for (int i = 0; i < NUMBER_OF_COMPUTORS; ++i)
+            gen64();
+        unsigned int transactionNum = gen64() % (maxTransactions + 1);
+        gen64();
+        for (unsigned int transaction = 0; transaction < transactionNum; ++transaction)
+        {
+            gen64();
+            const m256i digest(gen64(), gen64(), gen64(), gen64());
+            EXPECT_EQ(ts.transactionsDigestAccess.findTransaction(digest), nullptr);
+        }
+        return;
+    }
+
     // check tick data
     TickData& td = previousEpoch ? ts.tickData.getByTickInPreviousEpoch(tick) : ts.tickData.getByTickInCurrentEpoch(tick);
     EXPECT_EQ((int)td.epoch, (int)1234);
@@ -112,6 +135,7 @@ void checkTick(unsigned int tick, unsigned long long seed, unsigned short maxTra
         for (unsigned int transaction = 0; transaction < transactionNum; ++transaction)
         {
             int expectedInputSize = (int)(gen64() % MAX_INPUT_SIZE);
+            const m256i digest(gen64(), gen64(), gen64(), gen64());
 
             if (orderMode == 0)
                 transactionSlot = transaction;  // standard order
@@ -121,12 +145,16 @@ void checkTick(unsigned int tick, unsigned long long seed, unsigned short maxTra
             // If previousEpoch, some transactions at the beginning may not have fit into the storage and are missing -> check okay
             // If current epoch, some may be missing at he end due to limited storage -> check okay
             if (!offsets[transactionSlot])
+            {
+                EXPECT_EQ(ts.transactionsDigestAccess.findTransaction(digest), nullptr);
                 continue;
+            }
 
             Transaction* tp = ts.tickTransactions(offsets[transactionSlot]);
             EXPECT_TRUE(tp->checkValidity());
             EXPECT_EQ(tp->tick, tick);
             EXPECT_EQ((int)tp->inputSize, expectedInputSize);
+            EXPECT_EQ(ts.transactionsDigestAccess.findTransaction(digest), tp);
         }
     }
 }
@@ -208,3 +236,89 @@ TEST(TestCoreTickStorage, EpochTransition) {
         ts.deinit();
     }
 }
+
+TEST(TestCoreTickStorage, TransactionsDigestMapHoldsAllTransactionSlots)
+{
+    ts.init();
+    ts.beginEpoch(1000);
+
+    // capacity guarantees that the digests of all transaction slots can be inserted without exceeding the max load
+    std::mt19937_64 gen64(42);
+    const unsigned long long maxEntries = ts.transactionsDigestAccess.capacity() - ts.transactionsDigestAccess.capacity() / 16;
+    std::vector<m256i> digests(maxEntries + 1);
+    ts.transactionsDigestAccess.acquireLock();
+    for (unsigned long long i = 0; i <= maxEntries; ++i)
+    {
+        digests[i] = m256i(gen64(), gen64(), gen64(), gen64());
+        ts.transactionsDigestAccess.insertTransaction(digests[i], ts.tickTransactions.ptr(i + 1));
+    }
+    ts.transactionsDigestAccess.releaseLock();
+
+    // inserting beyond max load is refused
+    EXPECT_EQ(ts.transactionsDigestAccess.population(), maxEntries);
+    for (unsigned long long i = 0; i < maxEntries; ++i)
+        EXPECT_EQ(ts.transactionsDigestAccess.findTransaction(digests[i]), ts.tickTransactions.ptr(i + 1));
+    EXPECT_EQ(ts.transactionsDigestAccess.findTransaction(digests[maxEntries]), nullptr);
+
+    ts.deinit();
+}
+
+static void benchmarkTransactionsDigestLookup(unsigned int loadPercent)
+{
+    ts.init();
+    ts.beginEpoch(1000);
+
+    // fill hash map up to given load with random digests
+    std::mt19937_64 gen64(loadPercent);
+    const unsigned long long numberOfEntries = ts.transactionsDigestAccess.capacity() * loadPercent / 100;
+    std::vector<m256i> digests(numberOfEntries);
+    ts.transactionsDigestAccess.acquireLock();
+    for (unsigned long long i = 0; i < numberOfEntries; ++i)
+    {
+        digests[i] = m256i(gen64(), gen64(), gen64(), gen64());
+        ts.transactionsDigestAccess.insertTransaction(digests[i], ts.tickTransactions.ptr(i + 1));
+    }
+    ts.transactionsDigestAccess.releaseLock();
+    EXPECT_EQ(ts.transactionsDigestAccess.population(), numberOfEntries);
+
+    std::vector<m256i> missingDigests(numberOfEntries);
+    for (unsigned long long i = 0; i < numberOfEntries; ++i)
+        missingDigests[i] = m256i(gen64(), gen64(), gen64(), gen64());
+
+    constexpr int rounds = 20;
+    unsigned long long numberOfHits = 0, numberOfMisses = 0;
+
+    // measure lookup of existing digests
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (unsigned long long i = 0; i < numberOfEntries; ++i)
+            numberOfHits += ts.transactionsDigestAccess.findTransaction(digests[i]) == ts.tickTransactions.ptr(i + 1);
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    double nsPerHit = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / (rounds * numberOfEntries);
+
+    // measure lookup of missing digests
+    t0 = std::chrono::high_resolution_clock::now();
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (unsigned long long i = 0; i < numberOfEntries; ++i)
+            numberOfMisses += ts.transactionsDigestAccess.findTransaction(missingDigests[i]) == nullptr;
+    }
+    t1 = std::chrono::high_resolution_clock::now();
+    double nsPerMiss = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / (rounds * numberOfEntries);
+
+    EXPECT_EQ(numberOfHits, rounds * numberOfEntries);
+    EXPECT_EQ(numberOfMisses, rounds * numberOfEntries);
+    std::cout << "Transaction digest lookup at " << loadPercent << "% load (" << numberOfEntries << " of " << ts.transactionsDigestAccess.capacity()
+        << " slots): " << nsPerHit << " ns per hit, " << nsPerMiss << " ns per miss" << std::endl;
+
+    ts.deinit();
+}
+
+// Benchmark is not part of the default test run, use --gtest_also_run_disabled_tests to run it
+TEST(TestCoreTickStorage, DISABLED_TransactionsDigestLookupBenchmark)
+{
+    benchmarkTransactionsDigestLookup(50);
+    benchmarkTransactionsDigestLookup(90);
+}
@@ -0,0 +1,504 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include <random>
+#include <thread>
+#include <vector>
+
+#define system qubicSystemStruct
+
+// Loopback stand-in for the peer layer: responses of the serving node are collected and delivered to the syncing node
+#define TEST_UTILS_COLLECT_RESPONSES
+#include "utils.h"
+
+#include "../src/public_settings.h"
+#undef MAX_NUMBER_OF_TICKS_PER_EPOCH
+#define MAX_NUMBER_OF_TICKS_PER_EPOCH 50
+#undef TICKS_TO_KEEP_FROM_PRIOR_EPOCH
+#define TICKS_TO_KEEP_FROM_PRIOR_EPOCH 5
+#include "../src/tick_sync.h"
+
+
+static TickStorage ts;
+static TickSync tickSync;
+
+// Computor keys shared by serving and syncing node
+static m256i subseeds[NUMBER_OF_COMPUTORS];
+static m256i publicKeys[NUMBER_OF_COMPUTORS];
+
+// Deliver message to syncing node like peers.h does (header at start of receive buffer)
+static void deliverMessage(const ResponseMessage& message, unsigned char* receiveBuffer)
+{
+    RequestResponseHeader* header = (RequestResponseHeader*)receiveBuffer;
+    header->checkAndSetSize((unsigned int)(sizeof(RequestResponseHeader) + message.payload.size()));
+    header->setType(message.type);
+    header->setDejavu(message.dejavu);
+    copyMem(header->getPayload<unsigned char>(), message.payload.data(), message.payload.size());
+    if (header->type() == RespondTickRange::type)
+    {
+        tickSync.processRespondTickRange(header->getPayload<RespondTickRange>(), header->getPayloadSize(), publicKeys);
+    }
+}
+
+// Deliver every step-th message starting with first, run by several threads like the request processors
+static void deliverMessages(unsigned int first, unsigned int step)
+{
+    unsigned char* receiveBuffer = (unsigned char*)_mm_malloc(sizeof(RequestResponseHeader) + sizeof(RespondTickRange) + TICK_SYNC_MAX_TICK_SIZE, 32);
+    for (unsigned int i = first; i < responses.size(); i += step)
+    {
+        deliverMessage(responses[i], receiveBuffer);
+    }
+    _mm_free(receiveBuffer);
+}
+
+static const unsigned short epoch = 123;
+static const unsigned int firstTick = 1000;
+static const unsigned int numberOfTicks = 20;
+static const unsigned int numberOfVotesPerTick = 16;
+
+class TestTickSync : public ::testing::Test
+{
+protected:
+    std::vector<unsigned char> buffer;
+
+    // data of serving node
+    std::vector<Tick> votes;
+    std::vector<TickData> tickData;
+    std::vector<std::vector<std::vector<unsigned char>>> transactions;
+
+    TestTickSync() : buffer(sizeof(RespondTickRange) + TICK_SYNC_MAX_TICK_SIZE)
+    {
+        std::mt19937_64 gen64(42);
+        for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+        {
+            subseeds[i] = m256i(gen64(), gen64(), gen64(), gen64());
+            m256i privateKey;
+            getPrivateKey(subseeds[i].m256i_u8, privateKey.m256i_u8);
+            getPublicKey(privateKey.m256i_u8, publicKeys[i].m256i_u8);
+        }
+        system.epoch = epoch;
+        ts.init();
+        responses.clear();
+        setMem(faultyComputorFlags, sizeof(faultyComputorFlags), 0);
+
+        // clock of node at 2024-06-01 12:00
+        setMem(&utcTime, sizeof(utcTime), 0);
+        utcTime.Year = 2024;
+        utcTime.Month = 6;
+        utcTime.Day = 1;
+        utcTime.Hour = 12;
+    }
+
+    ~TestTickSync()
+    {
+        ts.deinit();
+    }
+
+    void signVote(Tick& vote)
+    {
+        m256i digest;
+        vote.computorIndex ^= BroadcastTick::type;
+        KangarooTwelve(&vote, sizeof(Tick) - SIGNATURE_SIZE, &digest, sizeof(digest));
+        vote.computorIndex ^= BroadcastTick::type;
+        sign(subseeds[vote.computorIndex].m256i_u8, publicKeys[vote.computorIndex].m256i_u8, digest.m256i_u8, vote.signature);
+    }
+
+    void signTickData(TickData& td)
+    {
+        m256i digest;
+        td.computorIndex ^= BroadcastFutureTickData::type;
+        KangarooTwelve(&td, sizeof(TickData) - SIGNATURE_SIZE, &digest, sizeof(digest));
+        td.computorIndex ^= BroadcastFutureTickData::type;
+        sign(subseeds[td.computorIndex].m256i_u8, publicKeys[td.computorIndex].m256i_u8, digest.m256i_u8, td.signature);
+    }
+
+    // Set timestamp of Tick or TickData to some seconds before clock of node
+    template <typename T>
+    static void setTimestamp(T& t, unsigned int tickOffset)
+    {
+        t.year = 24;
+        t.month = 6;
+        t.day = 1;
+        t.hour = 11;
+        t.minute = 59;
+        t.second = tickOffset;
+        t.millisecond = 0;
+    }
+
+    static bool isComputorFaulty(unsigned int computorIndex)
+    {
+        return (faultyComputorFlags[computorIndex >> 6] >> (computorIndex & 63)) & 1;
+    }
+
+    // Fill tick storage of serving node with signed votes, tick data, and transactions
+    void setupServingNode()
+    {
+        std::mt19937_64 gen64(1234);
+        ts.beginEpoch(firstTick);
+        system.tick = firstTick + numberOfTicks - 1;
+        votes.resize(numberOfTicks * numberOfVotesPerTick);
+        tickData.resize(numberOfTicks);
+        transactions.resize(numberOfTicks);
+        for (unsigned int t = 0; t < numberOfTicks; t++)
+        {
+            const unsigned int tick = firstTick + t;
+            for (unsigned int v = 0; v < numberOfVotesPerTick; v++)
+            {
+                Tick& vote = votes[t * numberOfVotesPerTick + v];
+                setMem(&vote, sizeof(Tick), 0);
+                vote.computorIndex = (tick + v * 41) % NUMBER_OF_COMPUTORS;
+                vote.epoch = epoch;
+                vote.tick = tick;
+                setTimestamp(vote, t);
+                vote.saltedSpectrumDigest = m256i(gen64(), gen64(), gen64(), gen64());
+                signVote(vote);
+                copyMem(ts.ticks.getByTickInCurrentEpoch(tick) + vote.computorIndex, &vote, sizeof(Tick));
+            }
+
+            TickData& td = tickData[t];
+            setMem(&td, sizeof(TickData), 0);
+            td.computorIndex = tick % NUMBER_OF_COMPUTORS;
+            td.epoch = epoch;
+            td.tick = tick;
+            setTimestamp(td, t);
+            transactions[t].resize(NUMBER_OF_TRANSACTIONS_PER_TICK);
+            const unsigned int numberOfTransactions = gen64() % 40;
+            for (unsigned int i = 0; i < numberOfTransactions; i++)
+            {
+                const unsigned int slot = (unsigned int)(gen64() % NUMBER_OF_TRANSACTIONS_PER_TICK);
+                if (!transactions[t][slot].empty())
+                {
+                    continue;
+                }
+                const unsigned int source = (unsigned int)(gen64() % NUMBER_OF_COMPUTORS);
+                const unsigned short inputSize = (unsigned short)(gen64() % 100);
+                std::vector<unsigned char>& data = transactions[t][slot];
+                data.resize(sizeof(Transaction) + inputSize + SIGNATURE_SIZE);
+                Transaction* transaction = (Transaction*)data.data();
+                transaction->sourcePublicKey = publicKeys[source];
+                transaction->destinationPublicKey = m256i(gen64(), gen64(), gen64(), gen64());
+                transaction->amount = gen64() % 1000;
+                transaction->tick = tick;
+                transaction->inputType = 0;
+                transaction->inputSize = inputSize;
+                for (unsigned int j = 0; j < inputSize; j++)
+                {
+                    transaction->inputPtr()[j] = (unsigned char)gen64();
+                }
+                m256i digest;
+                KangarooTwelve(transaction, sizeof(Transaction) + inputSize, &digest, sizeof(digest));
+                sign(subseeds[source].m256i_u8, publicKeys[source].m256i_u8, digest.m256i_u8, transaction->signaturePtr());
+                KangarooTwelve(transaction, transaction->totalSize(), &td.transactionDigests[slot], 32);
+
+                unsigned long long* offsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(tick);
+                offsets[slot] = ts.nextTickTransactionOffset;
+                copyMem(ts.tickTransactions(ts.nextTickTransactionOffset), transaction, transaction->totalSize());
+                ts.nextTickTransactionOffset += transaction->totalSize();
+            }
+            signTickData(td);
+            copyMem(&ts.tickData.getByTickInCurrentEpoch(tick), &td, sizeof(TickData));
+        }
+    }
+
+    // Reset tick storage to simulate syncing node that is at firstTick
+    void setupSyncingNode()
+    {
+        ts.deinit();
+        ts.init();
+        ts.beginEpoch(firstTick);
+        system.tick = firstTick;
+    }
+};
+
+TEST_F(TestTickSync, PipelinedRequests)
+{
+    system.tick = firstTick;
+    RequestTickRange request;
+
+    // not lagging behind
+    tickSync.updateLatestKnownTick(firstTick + 1);
+    tickSync.beginRequestRound();
+    EXPECT_FALSE(tickSync.getNextRequest(request));
+
+    // lagging behind -> pipeline windows up to limit
+    tickSync.updateLatestKnownTick(firstTick + 100);
+    tickSync.beginRequestRound();
+    unsigned int expectedFirstTick = firstTick;
+    for (unsigned int i = 0; i < TICK_SYNC_NUMBER_OF_PIPELINED_REQUESTS; i++)
+    {
+        EXPECT_TRUE(tickSync.getNextRequest(request));
+        EXPECT_EQ(request.firstTick, expectedFirstTick);
+        EXPECT_EQ(request.numberOfTicks, TICK_RANGE_MAX_NUMBER_OF_TICKS);
+        expectedFirstTick += TICK_RANGE_MAX_NUMBER_OF_TICKS;
+    }
+    EXPECT_FALSE(tickSync.getNextRequest(request));
+
+    // progress frees one window
+    system.tick = firstTick + TICK_RANGE_MAX_NUMBER_OF_TICKS;
+    tickSync.beginRequestRound();
+    EXPECT_TRUE(tickSync.getNextRequest(request));
+    EXPECT_EQ(request.firstTick, expectedFirstTick);
+    EXPECT_FALSE(tickSync.getNextRequest(request));
+
+    // no progress for several rounds -> request again
+    for (unsigned int i = 0; i < TICK_SYNC_STALL_ROUNDS; i++)
+    {
+        tickSync.beginRequestRound();
+    }
+    EXPECT_TRUE(tickSync.getNextRequest(request));
+    EXPECT_EQ(request.firstTick, system.tick);
+}
+
+TEST_F(TestTickSync, SyncOverLoopback)
+{
+    setupServingNode();
+
+    // serve windows requested by syncing node
+    for (unsigned int tick = firstTick; tick < firstTick + numberOfTicks; tick += TICK_RANGE_MAX_NUMBER_OF_TICKS)
+    {
+        RequestTickRange request;
+        request.firstTick = tick;
+        request.numberOfTicks = TICK_RANGE_MAX_NUMBER_OF_TICKS;
+        request.flags = TICK_RANGE_QUORUM_TICKS | TICK_RANGE_TICK_DATA | TICK_RANGE_TRANSACTIONS;
+        request._padding = 0;
+        tickSync.respondTickRange(NULL, 42, request, buffer.data());
+    }
+    unsigned int numberOfEndResponses = 0;
+    for (const auto& message : responses)
+    {
+        EXPECT_EQ(message.dejavu, 42u);
+        if (message.type == EndResponse::type)
+        {
+            numberOfEndResponses++;
+        }
+    }
+    EXPECT_EQ(numberOfEndResponses, (numberOfTicks + TICK_RANGE_MAX_NUMBER_OF_TICKS - 1) / TICK_RANGE_MAX_NUMBER_OF_TICKS);
+    EXPECT_EQ(responses.size(), numberOfTicks + numberOfEndResponses);
+
+    // tampered vote is rejected
+    ResponseMessage tampered = responses[0];
+    ASSERT_EQ(tampered.type, RespondTickRange::type);
+    ((Tick*)(tampered.payload.data() + sizeof(RespondTickRange)))->saltedSpectrumDigest.m256i_u8[0] ^= 1;
+
+    setupSyncingNode();
+    unsigned char* receiveBuffer = (unsigned char*)_mm_malloc(sizeof(RequestResponseHeader) + sizeof(RespondTickRange) + TICK_SYNC_MAX_TICK_SIZE, 32);
+    deliverMessage(tampered, receiveBuffer);
+    _mm_free(receiveBuffer);
+    unsigned int storedVotes = 0;
+    for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+    {
+        storedVotes += ts.ticks.getByTickInCurrentEpoch(firstTick)[i].epoch == epoch;
+    }
+    EXPECT_EQ(storedVotes, numberOfVotesPerTick - 1);
+
+    // verify and store responses in parallel
+    std::thread threads[4];
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        threads[i] = std::thread(deliverMessages, i, 4);
+    }
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        threads[i].join();
+    }
+
+    for (unsigned int t = 0; t < numberOfTicks; t++)
+    {
+        const unsigned int tick = firstTick + t;
+        for (unsigned int v = 0; v < numberOfVotesPerTick; v++)
+        {
+            const Tick& vote = votes[t * numberOfVotesPerTick + v];
+            EXPECT_EQ(memcmp(ts.ticks.getByTickInCurrentEpoch(tick) + vote.computorIndex, &vote, sizeof(Tick)), 0);
+        }
+
+        // tick data of current and next tick is left to regular requests
+        const TickData& td = ts.tickData.getByTickInCurrentEpoch(tick);
+        if (tick <= system.tick + 1)
+        {
+            EXPECT_EQ(td.epoch, 0);
+            continue;
+        }
+        EXPECT_EQ(memcmp(&td, &tickData[t], sizeof(TickData)), 0);
+
+        const unsigned long long* offsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(tick);
+        for (unsigned int slot = 0; slot < NUMBER_OF_TRANSACTIONS_PER_TICK; slot++)
+        {
+            const std::vector<unsigned char>& expected = transactions[t][slot];
+            if (expected.empty())
+            {
+                EXPECT_EQ(offsets[slot], 0);
+            }
+            else
+            {
+                ASSERT_NE(offsets[slot], 0);
+                EXPECT_EQ(memcmp(ts.tickTransactions(offsets[slot]), expected.data(), expected.size()), 0);
+            }
+        }
+    }
+    ts.checkStateConsistencyWithAssert();
+}
+
+TEST_F(TestTickSync, TransactionBundles)
+{
+    setupServingNode();
+
+    // tick with most transactions
+    unsigned int t = 0;
+    std::vector<unsigned int> slots;
+    for (unsigned int i = 0; i < numberOfTicks; i++)
+    {
+        std::vector<unsigned int> tickSlots;
+        for (unsigned int slot = 0; slot < NUMBER_OF_TRANSACTIONS_PER_TICK; slot++)
+        {
+            if (!transactions[i][slot].empty())
+            {
+                tickSlots.push_back(slot);
+            }
+        }
+        if (tickSlots.size() > slots.size())
+        {
+            t = i;
+            slots = tickSlots;
+        }
+    }
+    ASSERT_GE(slots.size(), 3);
+
+    // request is processed in place like in the processor buffer
+    auto request = [&](unsigned int tick, unsigned int maxBundleSize, unsigned int knownSlot, unsigned int size)
+    {
+        RequestResponseHeader* header = (RequestResponseHeader*)buffer.data();
+        header->checkAndSetSize(size);
+        header->setType(RequestTickTransactionBundle::type);
+        header->setDejavu(42);
+        RequestTickTransactionBundle* payload = header->getPayload<RequestTickTransactionBundle>();
+        payload->tick = tick;
+        payload->maxBundleSize = maxBundleSize;
+        setMem(payload->transactionFlags, sizeof(payload->transactionFlags), 0);
+        payload->transactionFlags[knownSlot >> 3] |= 1 << (knownSlot & 7);
+        responses.clear();
+        tickSync.processRequestTickTransactionBundle(NULL, header);
+        for (const auto& message : responses)
+        {
+            EXPECT_EQ(message.dejavu, 42u);
+        }
+        EXPECT_EQ(responses.back().type, EndResponse::type);
+        EXPECT_TRUE(responses.back().payload.empty());
+    };
+    const unsigned int requestSize = sizeof(RequestResponseHeader) + sizeof(RequestTickTransactionBundle);
+
+    // small bundles contain all transactions except the known one in order of slot
+    request(firstTick + t, 1, slots[1], requestSize);
+    ASSERT_GE(responses.size(), 2);
+    std::vector<unsigned int> receivedSlots;
+    for (unsigned int m = 0; m + 1 < responses.size(); m++)
+    {
+        const ResponseMessage& message = responses[m];
+        ASSERT_EQ(message.type, RespondTickTransactionBundle::type);
+        ASSERT_GE(message.payload.size(), sizeof(RespondTickTransactionBundle));
+        EXPECT_LE(message.payload.size(), sizeof(RespondTickTransactionBundle) + MAX_TRANSACTION_SIZE);
+        const RespondTickTransactionBundle* bundle = (const RespondTickTransactionBundle*)message.payload.data();
+        EXPECT_EQ(bundle->tick, firstTick + t);
+        unsigned int offset = sizeof(RespondTickTransactionBundle);
+        unsigned int numberOfTransactions = 0;
+        for (unsigned int slot = 0; slot < NUMBER_OF_TRANSACTIONS_PER_TICK; slot++)
+        {
+            if (bundle->transactionFlags[slot >> 3] & (1 << (slot & 7)))
+            {
+                const std::vector<unsigned char>& expected = transactions[t][slot];
+                ASSERT_LE(offset + expected.size(), message.payload.size());
+                EXPECT_EQ(memcmp(message.payload.data() + offset, expected.data(), expected.size()), 0);
+                offset += (unsigned int)expected.size();
+                receivedSlots.push_back(slot);
+                numberOfTransactions++;
+            }
+        }
+        EXPECT_EQ(numberOfTransactions, bundle->numberOfTransactions);
+        EXPECT_EQ(offset, message.payload.size());
+    }
+    slots.erase(slots.begin() + 1);
+    EXPECT_EQ(receivedSlots, slots);
+
+    // by default, the whole tick fits into one bundle (slots now lacks one transaction, request skips another one)
+    request(firstTick + t, 0, slots[0], requestSize);
+    ASSERT_EQ(responses.size(), 2);
+    EXPECT_EQ(((const RespondTickTransactionBundle*)responses[0].payload.data())->numberOfTransactions, slots.size());
+
+    // tick not in storage
+    request(firstTick + numberOfTicks + MAX_NUMBER_OF_TICKS_PER_EPOCH, 0, 0, requestSize);
+    EXPECT_EQ(responses.size(), 1);
+
+    // invalid size
+    request(firstTick + t, 0, 0, requestSize - 1);
+    EXPECT_EQ(responses.size(), 1);
+    request(firstTick + t, 0, 0, requestSize + 1);
+    EXPECT_EQ(responses.size(), 1);
+}
+
+TEST_F(TestTickSync, ReceivedDataIsValidatedLikeBroadcasts)
+{
+    setupServingNode();
+    const unsigned int t = 5;
+    const unsigned int tick = firstTick + t;
+    RequestTickRange request;
+    request.firstTick = tick;
+    request.numberOfTicks = 1;
+    request.flags = TICK_RANGE_QUORUM_TICKS | TICK_RANGE_TICK_DATA;
+    request._padding = 0;
+    tickSync.respondTickRange(NULL, 42, request, buffer.data());
+    ASSERT_EQ(responses.size(), 2);
+    const ResponseMessage original = responses[0];
+    ASSERT_EQ(original.type, RespondTickRange::type);
+    ASSERT_EQ(((const RespondTickRange*)original.payload.data())->numberOfVotes, numberOfVotesPerTick);
+    ASSERT_TRUE(((const RespondTickRange*)original.payload.data())->flags & TICK_RANGE_TICK_DATA);
+
+    setupSyncingNode();
+    unsigned char* receiveBuffer = (unsigned char*)_mm_malloc(sizeof(RequestResponseHeader) + sizeof(RespondTickRange) + TICK_SYNC_MAX_TICK_SIZE, 32);
+    Tick* tsVotes = ts.ticks.getByTickInCurrentEpoch(tick);
+    TickData& tsTickData = ts.tickData.getByTickInCurrentEpoch(tick);
+
+    // invalid date of vote and tick data too far in the future are rejected even if signed correctly
+    ResponseMessage invalid = original;
+    Tick* firstVote = (Tick*)(invalid.payload.data() + sizeof(RespondTickRange));
+    TickData* td = (TickData*)(invalid.payload.data() + sizeof(RespondTickRange) + numberOfVotesPerTick * sizeof(Tick));
+    firstVote->day = 31;
+    signVote(*firstVote);
+    td->hour = 12;
+    td->minute = 0;
+    td->second = (TIME_ACCURACY / 1000) + 1;
+    signTickData(*td);
+    deliverMessage(invalid, receiveBuffer);
+    EXPECT_EQ(tsVotes[firstVote->computorIndex].epoch, 0);
+    EXPECT_EQ(tsVotes[(firstVote + 1)->computorIndex].epoch, epoch);
+    EXPECT_EQ(tsTickData.epoch, 0);
+
+    // timestamp within accuracy of clock is accepted
+    td->second = (TIME_ACCURACY / 1000) - 1;
+    signTickData(*td);
+    deliverMessage(invalid, receiveBuffer);
+    EXPECT_EQ(tsTickData.epoch, epoch);
+
+    // conflicting vote and tick data mark computors as faulty without replacing stored data
+    setupSyncingNode();
+    deliverMessage(original, receiveBuffer);
+    EXPECT_EQ(memcmp(&tsTickData, &tickData[t], sizeof(TickData)), 0);
+    ResponseMessage conflicting = original;
+    firstVote = (Tick*)(conflicting.payload.data() + sizeof(RespondTickRange));
+    td = (TickData*)(conflicting.payload.data() + sizeof(RespondTickRange) + numberOfVotesPerTick * sizeof(Tick));
+    firstVote->saltedSpectrumDigest.m256i_u8[0] ^= 1;
+    signVote(*firstVote);
+    td->transactionDigests[NUMBER_OF_TRANSACTIONS_PER_TICK - 1].m256i_u8[0] ^= 1;
+    signTickData(*td);
+    for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+    {
+        EXPECT_FALSE(isComputorFaulty(i));
+    }
+    deliverMessage(conflicting, receiveBuffer);
+    for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+    {
+        EXPECT_EQ(isComputorFaulty(i), i == firstVote->computorIndex || i == td->computorIndex);
+    }
+    EXPECT_EQ(memcmp(&tsVotes[firstVote->computorIndex], original.payload.data() + sizeof(RespondTickRange), sizeof(Tick)), 0);
+    EXPECT_EQ(memcmp(&tsTickData, &tickData[t], sizeof(TickData)), 0);
+    _mm_free(receiveBuffer);
+}
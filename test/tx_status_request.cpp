@@ -52,9 +52,24 @@ struct {
 
 RespondTxStatus responseMessage;
 
+struct {
+    RequestResponseHeader header;
+    RequestTxStatusByDigest payload;
+} requestByDigestMessage;
+
+RespondTxStatusByDigest responseByDigestMessage;
+
 
 static void enqueueResponse(Peer* peer, unsigned int dataSize, unsigned char type, unsigned int dejavu, const void* data)
 {
+    if (type == RESPOND_TX_STATUS_BY_DIGEST)
+    {
+        EXPECT_EQ(dejavu, requestByDigestMessage.header.dejavu());
+        EXPECT_EQ(dataSize, sizeof(RespondTxStatusByDigest));
+        copyMem(&responseByDigestMessage, data, sizeof(RespondTxStatusByDigest));
+        return;
+    }
+
     const RespondTxStatus* txStatus = (const RespondTxStatus*)data;
 
     EXPECT_EQ(type, RESPOND_TX_STATUS);
@@ -64,6 +79,27 @@ static void enqueueResponse(Peer* peer, unsigned int dataSize, unsigned char typ
     copyMem(&responseMessage, txStatus, txStatus->size());
 }
 
+// Query status of single tx by digest
+static void checkTxByDigest(const m256i& digest, unsigned char expectedStatus, unsigned int expectedTick, unsigned char expectedMoneyFlew)
+{
+    requestByDigestMessage.header.checkAndSetSize(sizeof(requestByDigestMessage));
+    requestByDigestMessage.header.setType(REQUEST_TX_STATUS_BY_DIGEST);
+    requestByDigestMessage.header.setDejavu(digest.m256i_u32[1]);
+    requestByDigestMessage.payload.digest = digest;
+
+    setMem(&responseByDigestMessage, sizeof(responseByDigestMessage), 0xff);
+    processRequestConfirmedTxByDigest(nullptr, &requestByDigestMessage.header);
+
+    EXPECT_EQ(responseByDigestMessage.currentTickOfNode, system.tick);
+    EXPECT_EQ(responseByDigestMessage.digest, digest);
+    EXPECT_EQ(responseByDigestMessage.status, expectedStatus);
+    if (expectedStatus == TX_STATUS_CONFIRMED)
+    {
+        EXPECT_EQ(responseByDigestMessage.tick, expectedTick);
+        EXPECT_EQ(responseByDigestMessage.moneyFlew, expectedMoneyFlew);
+    }
+}
+
 static void checkTick(unsigned int tick, unsigned long long seed, unsigned short maxTransactions, bool fullyStoredTick, bool previousEpoch)
 {
     // Ensure that we do not skip processRequestConfirmedTx()
@@ -77,7 +113,15 @@ static void checkTick(unsigned int tick, unsigned long long seed, unsigned short
         EXPECT_LT(tick, txStatusData.confirmedTxCurrentEpochBeginTick);
         if (tick < txStatusData.confirmedTxPreviousEpochBeginTick)
         {
-            // tick not available -> okay
+            // tick not available -> okay, but its transactions must not be found by digest either
+            std::mt19937_64 gen64(seed);
+            unsigned int transactionNum = gen64() % (maxTransactions + 1);
+            for (unsigned int transaction = 0; transaction < transactionNum; ++transaction)
+            {
+                m256i digest(gen64(), gen64(), gen64(), gen64());
+                gen64();
+                checkTxByDigest(digest, TX_STATUS_UNKNOWN, 0, 0);
+            }
             return;
         }
     }
@@ -123,6 +167,16 @@ static void checkTick(unsigned int tick, unsigned long long seed, unsigned short
         unsigned char receivedMoneyFlow = (responseMessage.moneyFlew[transaction / 8] >> (transaction % 8)) & 1;
         unsigned char expectedMoneyFlew = gen64() % 2;
         EXPECT_EQ(receivedMoneyFlow, expectedMoneyFlew);
+
+        checkTxByDigest(digest, TX_STATUS_CONFIRMED, tick, expectedMoneyFlew);
+    }
+
+    // transactions that could not be stored are unknown
+    for (unsigned int transaction = responseMessage.txCount; transaction < transactionNum; ++transaction)
+    {
+        m256i digest(gen64(), gen64(), gen64(), gen64());
+        gen64();
+        checkTxByDigest(digest, TX_STATUS_UNKNOWN, 0, 0);
     }
 }
 
@@ -5,6 +5,9 @@
 #include <iomanip>
 #include <fstream>
 #include <filesystem>
+#include <vector>
+
+#include "../src/platform/m256.h"
 
 namespace test_utils
 {
@@ -88,3 +91,28 @@ std::vector<unsigned long long> convertULLFromString(std::string& rStr)
 }
 
 } // test_utils
+
+#ifdef TEST_UTILS_COLLECT_RESPONSES
+// Collect responses instead of sending them to peers. The peer is not dereferenced, so tests may pass any pointer as
+// peer identity. Define TEST_UTILS_COLLECT_RESPONSES and include this file before the code that sends responses.
+#define Peer void
+struct ResponseMessage
+{
+    unsigned char type;
+    unsigned int dejavu;
+    std::vector<unsigned char> payload;
+};
+static std::vector<ResponseMessage> responses;
+
+static void enqueueResponse(Peer* peer, unsigned int dataSize, unsigned char type, unsigned int dejavu, const void* data)
+{
+    ResponseMessage message;
+    message.type = type;
+    message.dejavu = dejavu;
+    if (dataSize)
+    {
+        message.payload.assign((const unsigned char*)data, (const unsigned char*)data + dataSize);
+    }
+    responses.push_back(message);
+}
+#endif
@@ -0,0 +1,309 @@
+#define NO_UEFI
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Time the phases of scoring. Set to 2 to split the mask computation from the neuron ticks, which adds timing overhead
+// to every synapse block and lowers the number of solutions per second.
+#define SCORE_PHASE_STATISTICS 1
+
+#include "../../src/score.h"
+#include "../../test/utils.h"
+
+using namespace test_utils;
+
+// Benchmarks the scoring of the node: solutions built from the sample inputs in test/data are verified by several
+// processors in parallel with the same ScoreFunction parameters as the node. A part of the solutions are repeated to
+// get the requested score cache hit ratio. For each combination of number of processors and hit ratio the tool
+// reports solutions per second, CPU cycles per phase of a scored solution and the score cache statistics.
+
+typedef ScoreFunction<
+    DATA_LENGTH,
+    NUMBER_OF_HIDDEN_NEURONS,
+    NUMBER_OF_NEIGHBOR_NEURONS,
+    MAX_DURATION,
+    NUMBER_OF_SOLUTION_PROCESSORS
+> BenchmarkScoreFunction;
+
+static std::unique_ptr<BenchmarkScoreFunction> score;
+static m256i miningSeed;
+static std::vector<m256i> publicKeys;
+static std::vector<m256i> nonces;
+
+static bool readSamples(const std::string& sampleFileName)
+{
+    if (!std::filesystem::exists(sampleFileName))
+    {
+        std::cerr << "Sample file " << sampleFileName << " does not exist!" << std::endl;
+        return false;
+    }
+    auto sampleString = readCSV(sampleFileName);
+    for (unsigned long long i = 0; i < sampleString.size(); i++)
+    {
+        if (sampleString[i].size() != 3)
+        {
+            std::cerr << "Number of elements in line " << i << " is mismatched. " << sampleString[i].size() << " vs 3" << std::endl;
+            return false;
+        }
+
+        // all solutions are scored with the mining seed of the first sample, like during an epoch of the node
+        if (i == 0)
+        {
+            miningSeed = hexToByte(sampleString[i][0], 32);
+        }
+        publicKeys.push_back(hexToByte(sampleString[i][1], 32));
+        nonces.push_back(hexToByte(sampleString[i][2], 32));
+    }
+    if (publicKeys.empty())
+    {
+        std::cerr << "Sample file " << sampleFileName << " is empty!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Indices of the solutions to verify: with probability hitPercent a solution repeats one of the earlier ones, the others
+// are new. More new solutions than samples are made unique by changing the nonce.
+static void generateSolutions(unsigned int numberOfSolutions, unsigned int hitPercent, std::vector<m256i>& solutionPublicKeys, std::vector<m256i>& solutionNonces)
+{
+    std::mt19937_64 gen64(hitPercent);
+    unsigned int numberOfNewSolutions = 0;
+    solutionPublicKeys.resize(numberOfSolutions);
+    solutionNonces.resize(numberOfSolutions);
+    for (unsigned int i = 0; i < numberOfSolutions; i++)
+    {
+        if (i > 0 && gen64() % 100 < hitPercent)
+        {
+            const unsigned int repeated = gen64() % i;
+            solutionPublicKeys[i] = solutionPublicKeys[repeated];
+            solutionNonces[i] = solutionNonces[repeated];
+        }
+        else
+        {
+            const unsigned int sampleIndex = numberOfNewSolutions % publicKeys.size();
+            solutionPublicKeys[i] = publicKeys[sampleIndex];
+            solutionNonces[i] = nonces[sampleIndex];
+            solutionNonces[i].m256i_u64[3] ^= numberOfNewSolutions / publicKeys.size();
+            numberOfNewSolutions++;
+        }
+    }
+}
+
+// Each processor takes the next batch of up to batchSize solutions, the batch is scored with computeScores() like
+// the tasks of the scoring task queue in the node. Processors without solutions left help the others like idle
+// processors of the node.
+static void processSolutions(unsigned int processorIndex, unsigned int batchSize, const std::vector<m256i>& solutionPublicKeys, const std::vector<m256i>& solutionNonces, std::atomic<unsigned int>& nextSolution, std::atomic<unsigned int>& busyProcessors)
+{
+    const unsigned int numberOfSolutions = (unsigned int)solutionPublicKeys.size();
+    m256i miningSeeds[RANDOM2_LANES];
+    unsigned int scores[RANDOM2_LANES];
+    for (unsigned int i = 0; i < RANDOM2_LANES; i++)
+    {
+        miningSeeds[i] = miningSeed;
+    }
+
+    unsigned int first;
+    while ((first = nextSolution.fetch_add(batchSize)) < numberOfSolutions)
+    {
+        const unsigned int count = std::min(batchSize, numberOfSolutions - first);
+        score->computeScores(processorIndex, &solutionPublicKeys[first], miningSeeds, &solutionNonces[first], count, scores);
+    }
+
+    busyProcessors--;
+    while (busyProcessors)
+    {
+        if (!score->tryHelpScoring(processorIndex))
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// CPU cycles per second, for converting the phase statistics into time
+static unsigned long long measureTimeStampCounterFrequency()
+{
+    const auto begin = std::chrono::steady_clock::now();
+    const unsigned long long beginCycles = __rdtsc();
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    const unsigned long long cycles = __rdtsc() - beginCycles;
+    const unsigned long long microseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+    return cycles * 1000000 / microseconds;
+}
+
+static void runBenchmark(unsigned int numberOfProcessors, unsigned int hitPercent, unsigned int numberOfSolutions, unsigned int batchSize, unsigned long long cyclesPerSecond)
+{
+    std::vector<m256i> solutionPublicKeys;
+    std::vector<m256i> solutionNonces;
+    generateSolutions(numberOfSolutions, hitPercent, solutionPublicKeys, solutionNonces);
+
+    score->scoreCache.reset();
+    score->resetPhaseStatistics();
+
+    std::atomic<unsigned int> nextSolution = 0;
+    std::atomic<unsigned int> busyProcessors = numberOfProcessors;
+    std::vector<std::thread> processors;
+    const auto begin = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < numberOfProcessors; i++)
+    {
+        processors.emplace_back(processSolutions, i, batchSize, std::cref(solutionPublicKeys), std::cref(solutionNonces), std::ref(nextSolution), std::ref(busyProcessors));
+    }
+    for (auto& processor : processors)
+    {
+        processor.join();
+    }
+    const unsigned long long microseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+
+    unsigned long long numberOfScores = 0, random2PoolCycles = 0, synapseCycles = 0, neuronTickCycles = 0, maskCycles = 0;
+    for (unsigned int i = 0; i < NUMBER_OF_SOLUTION_PROCESSORS; i++)
+    {
+        const auto& phaseStatistics = score->_computeBuffer[i].phaseStatistics;
+        numberOfScores += phaseStatistics.numberOfScores;
+        random2PoolCycles += phaseStatistics.random2PoolCycles;
+        synapseCycles += phaseStatistics.synapseCycles;
+        neuronTickCycles += phaseStatistics.neuronTickCycles;
+        maskCycles += phaseStatistics.maskCycles;
+    }
+
+    std::cout << "Processors " << numberOfProcessors << ", hit ratio " << hitPercent << "%: "
+        << numberOfSolutions << " solutions in " << microseconds / 1000 << " ms, "
+        << std::fixed << std::setprecision(2) << numberOfSolutions * 1000000.0 / microseconds << " solutions/s" << std::endl;
+    std::cout << "    score cache: " << score->scoreCache.hitCount() << " hits, " << score->scoreCache.missCount() << " misses, "
+        << score->scoreCache.collisionCount() << " collisions" << std::endl;
+    if (numberOfScores)
+    {
+        auto printPhase = [&](const char* name, unsigned long long cycles)
+        {
+            std::cout << "    " << name << ": " << cycles / numberOfScores / 1000 << " kcycles ("
+                << std::fixed << std::setprecision(2) << cycles * 1000.0 / numberOfScores / cyclesPerSecond << " ms)" << std::endl;
+        };
+        std::cout << "    per scored solution (" << numberOfScores << " scored):" << std::endl;
+        printPhase("random2 pool", random2PoolCycles);
+        printPhase("synapse generation", synapseCycles);
+        printPhase("neuron ticks", neuronTickCycles);
+        if (SCORE_PHASE_STATISTICS > 1)
+        {
+            printPhase("  thereof masks", maskCycles);
+        }
+    }
+}
+
+static std::vector<unsigned int> parseList(const std::string& list)
+{
+    std::vector<unsigned int> values;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        values.push_back(std::stoi(item));
+    }
+    return values;
+}
+
+static void printHelp()
+{
+    std::cout << "Usage: program [options]\n";
+    std::cout << "--help, -h  Show this help message\n";
+    std::cout << "--samplefile, -s <filename>              Sample file with mining seed, public key and nonce per line\n";
+    std::cout << "                                            (default: ../../test/data/samples_20240815.csv)\n";
+    std::cout << "--processors, -p <list>                  Comma separated numbers of processors, at most " << NUMBER_OF_SOLUTION_PROCESSORS << " (default: 1,2,4)\n";
+    std::cout << "--hitratio, -r <list>                    Comma separated score cache hit ratios in percent (default: 0,50)\n";
+    std::cout << "--numsolutions, -n <number>              Number of solutions per run (default: 32)\n";
+    std::cout << "--batch, -b <number>                     Solutions scored together by a processor, at most " << RANDOM2_LANES << " (default: 1)\n";
+}
+
+int main(int argc, char* argv[])
+{
+    std::string sampleFile = "../../test/data/samples_20240815.csv";
+    std::vector<unsigned int> processorCounts = { 1, 2, 4 };
+    std::vector<unsigned int> hitRatios = { 0, 50 };
+    unsigned int numberOfSolutions = 32;
+    unsigned int batchSize = 1;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+
+        if (arg == "--help" || arg == "-h")
+        {
+            printHelp();
+            return 0;
+        }
+        else if ((arg == "--samplefile" || arg == "-s") && i + 1 < argc)
+        {
+            sampleFile = std::string(argv[++i]);
+        }
+        else if ((arg == "--processors" || arg == "-p") && i + 1 < argc)
+        {
+            processorCounts = parseList(argv[++i]);
+        }
+        else if ((arg == "--hitratio" || arg == "-r") && i + 1 < argc)
+        {
+            hitRatios = parseList(argv[++i]);
+        }
+        else if ((arg == "--numsolutions" || arg == "-n") && i + 1 < argc)
+        {
+            numberOfSolutions = std::stoi(argv[++i]);
+        }
+        else if ((arg == "--batch" || arg == "-b") && i + 1 < argc)
+        {
+            batchSize = std::stoi(argv[++i]);
+        }
+        else
+        {
+            std::cout << "Unknown argument: " << arg << "\n";
+            printHelp();
+            return 1;
+        }
+    }
+    batchSize = std::clamp(batchSize, 1u, (unsigned int)RANDOM2_LANES);
+    for (auto& processorCount : processorCounts)
+    {
+        processorCount = std::clamp(processorCount, 1u, (unsigned int)NUMBER_OF_SOLUTION_PROCESSORS);
+    }
+    for (auto& hitRatio : hitRatios)
+    {
+        hitRatio = std::min(hitRatio, 100u);
+    }
+
+    if (!readSamples(sampleFile))
+    {
+        return 1;
+    }
+
+#if defined (__AVX512F__) && !GENERIC_K12
+    initAVX512KangarooTwelveConstants();
+#endif
+    score = std::make_unique<BenchmarkScoreFunction>();
+    if (!score->initMemory())
+    {
+        std::cerr << "Failed to allocate memory of the score function!" << std::endl;
+        return 1;
+    }
+    score->initMiningData(miningSeed);
+    int x = 0;
+    top_of_stack = (unsigned long long)(&x);
+
+    const unsigned long long cyclesPerSecond = measureTimeStampCounterFrequency();
+    std::cout << "Score benchmark: " << publicKeys.size() << " samples, NEURON " << NUMBER_OF_HIDDEN_NEURONS
+        << ", NEIGHBOR " << NUMBER_OF_NEIGHBOR_NEURONS << ", DURATION " << MAX_DURATION
+        << ", batch " << batchSize << ", " << cyclesPerSecond / 1000000 << " MHz time stamp counter" << std::endl;
+
+    for (unsigned int processorCount : processorCounts)
+    {
+        for (unsigned int hitRatio : hitRatios)
+        {
+            runBenchmark(processorCount, hitRatio, numberOfSolutions, batchSize, cyclesPerSecond);
+        }
+    }
+
+    score->freeMemory();
+    return 0;
+}
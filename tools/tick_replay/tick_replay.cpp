@@ -0,0 +1,504 @@
+#define NO_UEFI
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+// workaround for name clash with stdlib
+#define system qubicSystemStruct
+
+// contract_def.h needs to be included first to make sure that contracts have minimal access
+#include "../../src/contract_core/contract_def.h"
+#include "../../src/contract_core/contract_exec.h"
+
+#include "../../src/private_settings.h"
+#include "../../src/public_settings.h"
+
+// loading the tick storage saved with the node states is only compiled with auto save enabled
+#undef TICK_STORAGE_AUTOSAVE_MODE
+#define TICK_STORAGE_AUTOSAVE_MODE 1
+
+#include "../../src/tick_processing.h"
+#include "../../src/compressed_file_io.h"
+
+// Replays the ticks of a saved node state (directory ep<epoch> written by TICK_STORAGE_AUTOSAVE_MODE) without network
+// and UEFI, checks the resulting digests against the quorum votes stored in the tick storage and reports how long the
+// phases of the tick processing take. The ticks are processed by the same code as in the node (tick_processing.h),
+// including the scoring of solutions and IPO bids, but single-threaded.
+
+struct ReplayStats
+{
+    unsigned long long numberOfTicks = 0;
+    unsigned long long numberOfEmptyTicks = 0;
+    unsigned long long numberOfTransactions = 0;
+    unsigned long long numberOfContractTransactions = 0;
+    unsigned long long numberOfSolutions = 0;
+    unsigned long long numberOfVerifiedTicks = 0;
+
+    // Accumulated duration of the phases in microseconds
+    unsigned long long beginTickTime = 0;
+    unsigned long long transactionTime = 0;
+    unsigned long long endTickTime = 0;
+    unsigned long long digestTime = 0;
+};
+
+
+static unsigned long long microsecondsSince(const std::chrono::high_resolution_clock::time_point& begin)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - begin).count();
+}
+
+// Output goes through logToConsole(), because mixing it with narrow output doesn't work on all platforms
+static void appendDigest(CHAR16* dst, const m256i& digest)
+{
+    CHAR16 digestChars[60 + 1];
+    getIdentity(digest.m256i_u8, digestChars, true);
+    appendText(dst, digestChars);
+}
+
+static void setContractFileName(unsigned int contractIndex)
+{
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 9] = contractIndex / 1000 + L'0';
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 8] = (contractIndex % 1000) / 100 + L'0';
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 7] = (contractIndex % 100) / 10 + L'0';
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 6] = contractIndex % 10 + L'0';
+}
+
+static bool loadFile(const CHAR16* fileName, unsigned long long size, void* buffer)
+{
+    if (loadStateFile(fileName, size, (unsigned char*)buffer) != (long long)size)
+    {
+        setText(message, L"Failed to load ");
+        appendText(message, fileName);
+        logToConsole(message);
+        return false;
+    }
+    return true;
+}
+
+static bool initReplay()
+{
+    initTime();
+    getPublicKeyFromIdentity((const unsigned char*)ARBITRATOR, arbitratorPublicKey.m256i_u8);
+
+    if (!initSpectrum() || !initCommonBuffers() || !initAssets() || !initContractExec() || !ts.init() || !logger.initLogging())
+    {
+        return false;
+    }
+    unsigned long long totalContractStateSize = 0;
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
+    {
+        const unsigned long long size = contractDescriptions[contractIndex].stateSize;
+        if (!allocatePool(size, (void**)&contractStates[contractIndex]))
+        {
+            return false;
+        }
+        setMem(contractStates[contractIndex], size, 0);
+        totalContractStateSize += (size + 63) & ~63ULL;
+    }
+    if (!allocatePool(NUMBER_OF_MINER_SOLUTION_FLAGS / 8, (void**)&minerSolutionFlags))
+    {
+        return false;
+    }
+    if (!allocatePool(sizeof(*score), (void**)&score))
+    {
+        return false;
+    }
+    setMem(score, sizeof(*score), 0);
+    if (!score->initMemory())
+    {
+        return false;
+    }
+    if (!StateSnapshot::init(spectrumSizeInBytes + spectrumDigestsSizeInByte + universeSizeInBytes + assetDigestsSizeInBytes
+        + totalContractStateSize + contractStateDigestsSizeInBytes + sizeof(system) + sizeof(nodeStateBuffer) + NUMBER_OF_MINER_SOLUTION_FLAGS / 8))
+    {
+        return false;
+    }
+    initializeContracts();
+    return true;
+}
+
+// Load spectrum, universe, contract states and other node states of the last full snapshot and apply its deltas.
+static bool loadNodeStates(const std::string& stateDirectory)
+{
+    std::filesystem::current_path(stateDirectory);
+
+    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 4] = L'0';
+    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 3] = L'0';
+    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 2] = L'0';
+    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 4] = L'0';
+    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 3] = L'0';
+    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 2] = L'0';
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 4] = L'0';
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 3] = L'0';
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 2] = L'0';
+    if (!loadFile(L"system.snp", sizeof(system), &system)
+        || !loadFile(L"snapshotNodeMiningState", sizeof(nodeStateBuffer), &nodeStateBuffer)
+        || !loadFile(SPECTRUM_FILE_NAME, spectrumSizeInBytes, spectrum)
+        || !loadFile(UNIVERSE_FILE_NAME, universeSizeInBytes, assets)
+        || !loadFile(L"snapshotMinerSolutionFlag", NUMBER_OF_MINER_SOLUTION_FLAGS / 8, minerSolutionFlags))
+    {
+        return false;
+    }
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
+    {
+        setContractFileName(contractIndex);
+        if (!loadFile(CONTRACT_FILE_NAME, contractDescriptions[contractIndex].stateSize, contractStates[contractIndex]))
+        {
+            return false;
+        }
+    }
+
+    unsigned int numberOfDeltas = 0;
+    if (load(L"snapshotDeltaCount", sizeof(numberOfDeltas), (unsigned char*)&numberOfDeltas) != sizeof(numberOfDeltas))
+    {
+        numberOfDeltas = 0;
+    }
+    if (numberOfDeltas)
+    {
+        bool ok = StateSnapshot::prepare(NULL) && addNodeStateSnapshotRegions(&system);
+        for (unsigned int deltaIndex = 1; deltaIndex <= numberOfDeltas && ok; deltaIndex++)
+        {
+            CHAR16 deltaFileName[] = L"snapshotDelta.000";
+            deltaFileName[14] = L'0' + deltaIndex / 100;
+            deltaFileName[15] = L'0' + (deltaIndex % 100) / 10;
+            deltaFileName[16] = L'0' + deltaIndex % 10;
+            ok = StateSnapshot::applyDelta(deltaFileName);
+        }
+        if (!ok)
+        {
+            logToConsole(L"Failed to apply snapshot deltas");
+            return false;
+        }
+        setText(message, L"Applied ");
+        appendNumber(message, numberOfDeltas, FALSE);
+        appendText(message, L" snapshot deltas");
+        logToConsole(message);
+    }
+    updateSpectrumInfo();
+
+    // Like loadAllNodeStates() and beginEpoch() of qubic.cpp. Solution thresholds set by the operator are not saved,
+    // so the default one is used.
+    loadTickProcessingStates(nodeStateBuffer);
+    score->initMiningData(nodeStateBuffer.currentRandomSeed);
+    if (system.epoch < MAX_NUMBER_EPOCH)
+    {
+        solutionThreshold[system.epoch] = SOLUTION_THRESHOLD_DEFAULT;
+    }
+    return true;
+}
+
+// Compare the digests computed by updateTickDigests() with the prev digests of the votes stored for the tick. Returns
+// the number of votes agreeing with the digests or -1 if no vote for the tick is stored.
+static int countAgreeingVotes(unsigned int tick)
+{
+    if (!ts.tickInCurrentEpochStorage(tick))
+    {
+        return -1;
+    }
+    const Tick* votes = ts.ticks.getByTickInCurrentEpoch(tick);
+    int numberOfVotes = 0, numberOfAgreeingVotes = 0;
+    for (unsigned int computorIndex = 0; computorIndex < NUMBER_OF_COMPUTORS; computorIndex++)
+    {
+        if (votes[computorIndex].epoch == system.epoch)
+        {
+            numberOfVotes++;
+            if (votes[computorIndex].prevSpectrumDigest == etalonTick.saltedSpectrumDigest
+                && votes[computorIndex].prevUniverseDigest == etalonTick.saltedUniverseDigest
+                && votes[computorIndex].prevComputerDigest == etalonTick.saltedComputerDigest
+                && votes[computorIndex].prevResourceTestingDigest == resourceTestingDigest)
+            {
+                numberOfAgreeingVotes++;
+            }
+        }
+    }
+    return (numberOfVotes) ? numberOfAgreeingVotes : -1;
+}
+
+// Count the transactions of tick system.tick. Returns false if one of them is missing in the tick storage, because
+// the node doesn't process a tick before all its transactions are available.
+static bool countTickTransactions(ReplayStats& stats)
+{
+    const TickData& tickData = ts.tickData.getByTickInCurrentEpoch(system.tick);
+    if (tickData.epoch != system.epoch)
+    {
+        stats.numberOfEmptyTicks++;
+        return true;
+    }
+    const unsigned long long* transactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(system.tick);
+    for (unsigned int transactionIndex = 0; transactionIndex < NUMBER_OF_TRANSACTIONS_PER_TICK; transactionIndex++)
+    {
+        if (!isZero(tickData.transactionDigests[transactionIndex]))
+        {
+            if (!transactionOffsets[transactionIndex])
+            {
+                setText(message, L"Transaction ");
+                appendNumber(message, transactionIndex, FALSE);
+                appendText(message, L" of tick ");
+                appendNumber(message, system.tick, FALSE);
+                appendText(message, L" is missing in tick storage");
+                logToConsole(message);
+                return false;
+            }
+            const Transaction* transaction = ts.tickTransactions(transactionOffsets[transactionIndex]);
+            const unsigned int contractIndex = (unsigned int)transaction->destinationPublicKey.m256i_u64[0];
+            m256i maskedDestinationPublicKey = transaction->destinationPublicKey;
+            maskedDestinationPublicKey.m256i_u64[0] &= ~(MAX_NUMBER_OF_CONTRACTS - 1ULL);
+            if (isZero(transaction->destinationPublicKey))
+            {
+                if (transaction->inputType == MiningSolutionTransaction::transactionType())
+                {
+                    stats.numberOfSolutions++;
+                }
+            }
+            else if (isZero(maskedDestinationPublicKey) && contractIndex < contractCount)
+            {
+                stats.numberOfContractTransactions++;
+            }
+        }
+    }
+    return true;
+}
+
+// Process tick system.tick like processTick() of the node, without publishing data of ticks led by own computors
+static void replayTick(ReplayStats& stats)
+{
+    const unsigned int previousNumberOfTransactions = numberOfTransactions;
+
+    auto phaseBegin = std::chrono::high_resolution_clock::now();
+    beginTick();
+    stats.beginTickTime += microsecondsSince(phaseBegin);
+
+    phaseBegin = std::chrono::high_resolution_clock::now();
+    processTickTransactions(0);
+    stats.transactionTime += microsecondsSince(phaseBegin);
+
+    phaseBegin = std::chrono::high_resolution_clock::now();
+    endTick();
+    stats.endTickTime += microsecondsSince(phaseBegin);
+
+    phaseBegin = std::chrono::high_resolution_clock::now();
+    updateTickDigests();
+    stats.digestTime += microsecondsSince(phaseBegin);
+
+    stats.numberOfTicks++;
+    stats.numberOfTransactions += numberOfTransactions - previousNumberOfTransactions;
+}
+
+static void logPhase(const CHAR16* name, unsigned long long microseconds, unsigned long long numberOfTicks)
+{
+    setText(message, L"  ");
+    appendText(message, name);
+    appendText(message, L": ");
+    appendNumber(message, microseconds / 1000, TRUE);
+    appendText(message, L" ms total, ");
+    appendNumber(message, (numberOfTicks) ? microseconds / numberOfTicks : 0, TRUE);
+    appendText(message, L" us per tick");
+    logToConsole(message);
+}
+
+static void printHelp()
+{
+    std::cout << "Usage: program [options]\n";
+    std::cout << "--help, -h  Show this help message\n";
+    std::cout << "--state, -s <directory>                  Directory of the saved node states (ep<epoch>)\n";
+    std::cout << "--ticks, -t <directory>                  Directory of the saved tick storage, may be a later save of the same epoch\n";
+    std::cout << "                                            (default: directory of the node states)\n";
+    std::cout << "--numticks, -n <number>                  Maximum number of ticks to replay (default: all stored ticks)\n";
+    std::cout << "--keepgoing, -k                          Continue replaying after a digest mismatch\n";
+}
+
+int main(int argc, char* argv[])
+{
+    std::string stateDirectory;
+    std::string tickDirectory;
+    unsigned int maxNumberOfTicks = 0xFFFFFFFF;
+    bool keepGoing = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+
+        if (arg == "--help" || arg == "-h")
+        {
+            printHelp();
+            return 0;
+        }
+        else if ((arg == "--state" || arg == "-s") && i + 1 < argc)
+        {
+            stateDirectory = std::string(argv[++i]);
+        }
+        else if ((arg == "--ticks" || arg == "-t") && i + 1 < argc)
+        {
+            tickDirectory = std::string(argv[++i]);
+        }
+        else if ((arg == "--numticks" || arg == "-n") && i + 1 < argc)
+        {
+            maxNumberOfTicks = std::stoi(argv[++i]);
+        }
+        else if (arg == "--keepgoing" || arg == "-k")
+        {
+            keepGoing = true;
+        }
+        else
+        {
+            std::cout << "Unknown argument: " << arg << "\n";
+            printHelp();
+            return 1;
+        }
+    }
+    if (stateDirectory.empty())
+    {
+        printHelp();
+        return 1;
+    }
+    stateDirectory = std::filesystem::absolute(stateDirectory).string();
+    tickDirectory = (tickDirectory.empty()) ? stateDirectory : std::filesystem::absolute(tickDirectory).string();
+
+    if (!initReplay())
+    {
+        logToConsole(L"Failed to initialize");
+        return 1;
+    }
+
+    auto loadingBegin = std::chrono::high_resolution_clock::now();
+    if (!loadNodeStates(stateDirectory))
+    {
+        return 1;
+    }
+    std::filesystem::current_path(tickDirectory);
+    ts.beginEpoch(system.initialTick);
+    if (ts.tryLoadFromFile(system.epoch, NULL) != 0)
+    {
+        logToConsole(L"Failed to load tick storage");
+        return 1;
+    }
+    const unsigned int lastStoredTick = ts.getPreloadTick();
+    setText(message, L"Loaded node states of epoch ");
+    appendNumber(message, system.epoch, FALSE);
+    appendText(message, L" at tick ");
+    appendNumber(message, system.tick, FALSE);
+    appendText(message, L" and ticks up to ");
+    appendNumber(message, lastStoredTick, FALSE);
+    appendText(message, L" in ");
+    appendNumber(message, microsecondsSince(loadingBegin) / 1000, TRUE);
+    appendText(message, L" ms");
+    logToConsole(message);
+
+    // compute all digests from scratch and check the loaded states against the votes for the first tick to process
+    auto digestBegin = std::chrono::high_resolution_clock::now();
+    for (unsigned int digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
+    {
+        KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
+    }
+    setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0xFF);
+    setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0xFF);
+    setMem(contractStateChangeFlags, MAX_NUMBER_OF_CONTRACTS / 8, 0xFF);
+    updateTickDigests();
+    setText(message, L"Computed all digests in ");
+    appendNumber(message, microsecondsSince(digestBegin) / 1000, TRUE);
+    appendText(message, L" ms: spectrum ");
+    appendDigest(message, etalonTick.saltedSpectrumDigest);
+    appendText(message, L", universe ");
+    appendDigest(message, etalonTick.saltedUniverseDigest);
+    appendText(message, L", computer ");
+    appendDigest(message, etalonTick.saltedComputerDigest);
+    logToConsole(message);
+    if (system.tick > system.initialTick)
+    {
+        // the prev digests of the first tick of an epoch are the ones before the epoch transition
+        const int agreeingVotes = countAgreeingVotes(system.tick);
+        if (agreeingVotes == 0)
+        {
+            setText(message, L"Loaded states don't match the votes for tick ");
+            appendNumber(message, system.tick, FALSE);
+            logToConsole(message);
+            return 1;
+        }
+        if (agreeingVotes > 0)
+        {
+            setText(message, L"Loaded states match ");
+            appendNumber(message, agreeingVotes, FALSE);
+            appendText(message, L" votes for tick ");
+            appendNumber(message, system.tick, FALSE);
+            logToConsole(message);
+        }
+    }
+
+    ReplayStats stats;
+    unsigned int firstMismatchTick = 0;
+    auto replayBegin = std::chrono::high_resolution_clock::now();
+    while (system.tick <= lastStoredTick && stats.numberOfTicks < maxNumberOfTicks)
+    {
+        if (!countTickTransactions(stats))
+        {
+            break;
+        }
+        replayTick(stats);
+
+        const int agreeingVotes = countAgreeingVotes(system.tick + 1);
+        if (agreeingVotes > 0)
+        {
+            stats.numberOfVerifiedTicks++;
+        }
+        else if (agreeingVotes == 0 && !firstMismatchTick)
+        {
+            firstMismatchTick = system.tick;
+            setText(message, L"Digests after tick ");
+            appendNumber(message, system.tick, FALSE);
+            appendText(message, L" don't match the votes");
+            logToConsole(message);
+            if (!keepGoing)
+            {
+                break;
+            }
+        }
+
+        // like the tick processor of the node after processTick()
+        if (isEpochEndReached())
+        {
+            setText(message, L"Stopping before epoch transition after tick ");
+            appendNumber(message, system.tick, FALSE);
+            logToConsole(message);
+            break;
+        }
+        advanceEtalonTick();
+        logger.tickCompleted();
+        system.tick++;
+        checkAndSwitchMiningPhase();
+    }
+    const unsigned long long replayTime = microsecondsSince(replayBegin);
+
+    setText(message, L"Replayed ");
+    appendNumber(message, stats.numberOfTicks, TRUE);
+    appendText(message, L" ticks (");
+    appendNumber(message, stats.numberOfEmptyTicks, TRUE);
+    appendText(message, L" empty) with ");
+    appendNumber(message, stats.numberOfTransactions, TRUE);
+    appendText(message, L" transactions (");
+    appendNumber(message, stats.numberOfContractTransactions, TRUE);
+    appendText(message, L" to contracts, ");
+    appendNumber(message, stats.numberOfSolutions, TRUE);
+    appendText(message, L" solutions) in ");
+    appendNumber(message, replayTime / 1000, TRUE);
+    appendText(message, L" ms, ");
+    appendNumber(message, (replayTime) ? stats.numberOfTransactions * 1000000 / replayTime : 0, TRUE);
+    appendText(message, L" transactions/s");
+    logToConsole(message);
+    logPhase(L"Begin tick", stats.beginTickTime, stats.numberOfTicks);
+    logPhase(L"Transactions", stats.transactionTime, stats.numberOfTicks);
+    logPhase(L"End tick", stats.endTickTime, stats.numberOfTicks);
+    logPhase(L"Digests", stats.digestTime, stats.numberOfTicks);
+    setText(message, L"Digests after ");
+    appendNumber(message, stats.numberOfVerifiedTicks, TRUE);
+    appendText(message, L" ticks match the votes");
+    if (firstMismatchTick)
+    {
+        appendText(message, L", first mismatch after tick ");
+        appendNumber(message, firstMismatchTick, FALSE);
+    }
+    logToConsole(message);
+
+    return (firstMismatchTick) ? 2 : 0;
+}